@@ -0,0 +1,104 @@
+#ifndef __ADAPTIVEINTEGRATOR_HH__
+#define __ADAPTIVEINTEGRATOR_HH__
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+#include <cfit/phasespace.hh>
+
+// Adaptive integration with error control, in one dimension on an interval and
+//    in two over the phase space of a three-body decay. The region with the
+//    largest error estimate is split in two until the error of every component
+//    is below max( absTol, relTol |integral| ), or the number of evaluations of
+//    the integrand reaches maxEval, in which case the best estimate is returned
+//    and error() tells how good it is.
+//    In one dimension each interval is integrated with the 15-point Gauss-Kronrod
+//    rule, with the difference to the embedded 7-point Gauss rule as error.
+//    In two, the Dalitz plot is mapped to the unit square, with mSq12 running
+//    between its limits and mSq13 between its limits at each mSq12, so that its
+//    boundary is the boundary of the square. mSq12 is further transformed with
+//    u = ( 1 - cos( pi t ) ) / 2, which removes the square-root behaviour of the
+//    width of the plot at its ends. Each rectangle is integrated with the 17-point
+//    degree 7 rule of Genz and Malik, with the difference to the embedded degree 5
+//    rule as error, and is split along the direction with the largest fourth
+//    difference.
+class AdaptiveIntegrator
+{
+public:
+  // Function that evaluates nComps components of the integrand at n points,
+  //    storing component c of point i in out[ c * n + i ].
+  typedef std::function< void( const double* x, const std::size_t& n, double* out ) > function_type;
+
+  typedef std::function< void( const double* mSq12, const double* mSq13, const double* mSq23,
+                               const std::size_t& n, double* out ) > integrand_type;
+
+private:
+  // Interval or rectangle, with the integral and error of each component in it,
+  //    and the direction to split it along.
+  struct Region
+  {
+    double                lower[ 2 ];
+    double                upper[ 2 ];
+    std::vector< double > result;
+    std::vector< double > error;
+    double                maxError;
+    unsigned              axis;
+
+    bool operator<( const Region& right ) const { return maxError < right.maxError; }
+  };
+
+  // Function that integrates a region, setting its result, errors and axis.
+  typedef std::function< void( Region& region ) > rule_type;
+
+  double   _relTol;
+  double   _absTol;
+  unsigned _maxEval;
+
+  // Number of equal parts in which each direction is divided at the start, so
+  //    that narrow structures are not missed by the first rules.
+  unsigned _divisions;
+
+  // Evaluations and largest error of the last integral.
+  mutable unsigned _nEval;
+  mutable double   _error;
+
+  // Whether the errors of all the components are within tolerance.
+  bool converged( const std::vector< double >& result, const std::vector< double >& error ) const;
+
+  // Split the worst of the given regions, each integrated by rule with cost
+  //    evaluations, until convergence, and sum their integrals into result.
+  void refine( const rule_type& rule, const unsigned& cost,
+               std::vector< Region >& regions, const std::size_t& nComps, double* result ) const;
+
+public:
+  AdaptiveIntegrator( const double& relTol = 1.e-8, const double& absTol = 0.0, const unsigned& maxEval = 1000000 )
+    : _relTol( relTol ), _absTol( absTol ), _maxEval( maxEval ), _divisions( 4 ), _nEval( 0 ), _error( 0.0 )
+  {}
+
+  void setRelTol   ( const double&   relTol    ) { _relTol    = relTol;                   }
+  void setAbsTol   ( const double&   absTol    ) { _absTol    = absTol;                   }
+  void setMaxEval  ( const unsigned& maxEval   ) { _maxEval   = maxEval;                  }
+  void setDivisions( const unsigned& divisions ) { _divisions = std::max( divisions, 1u ); }
+
+  const double&   relTol   () const { return _relTol;    }
+  const double&   absTol   () const { return _absTol;    }
+  const unsigned& maxEval  () const { return _maxEval;   }
+  const unsigned& divisions() const { return _divisions; }
+
+  // Number of points evaluated by the last integral, and estimate of the absolute
+  //    error of its least accurate component.
+  const unsigned& evaluations() const { return _nEval; }
+  const double&   error()       const { return _error; }
+
+  // Integrate the nComps components of f between min and max into result.
+  void   integrate( const function_type& f, const std::size_t& nComps,
+                    const double& min, const double& max, double* result ) const;
+  double integrate( const function_type& f, const double& min, const double& max ) const;
+
+  // Integrate the nComps components of f over the phase space into result.
+  void   integrate( const PhaseSpace& ps, const integrand_type& f, const std::size_t& nComps, double* result ) const;
+  double integrate( const PhaseSpace& ps, const integrand_type& f ) const;
+};
+
+#endif
@@ -5,6 +5,7 @@
 #include <string>
 #include <complex>
 #include <map>
+#include <memory>
 
 #include <cfit/operation.hh>
 #include <cfit/exceptions.hh>
@@ -12,6 +13,7 @@
 #include <cfit/coefexpr.hh>
 #include <cfit/resonance.hh>
 #include <cfit/fvector.hh>
+#include <cfit/parameterregistry.hh>
 
 class PhaseSpace;
 
@@ -20,13 +22,88 @@ class Amplitude
 private:
   std::map< std::string, Parameter > _parMap;
 
-  std::vector< std::complex< double > > _ctnts;
-  std::vector< Parameter              > _parms;
-  std::vector< Coef                   > _coefs;
-  std::vector< Resonance*             > _resos;
-  std::vector< Fvector                > _fvecs;
-  std::vector< Operation::Op          > _opers;
-  std::string                           _expression;
+  std::vector< std::complex< double >       > _ctnts;
+  std::vector< Parameter                    > _parms;
+  std::vector< Coef                         > _coefs;
+  std::vector< std::shared_ptr< Resonance > > _resos; // Shared by the copies until one of them modifies them.
+  std::vector< Fvector                      > _fvecs;
+  std::vector< Operation::Op                > _opers;
+  std::string                                 _expression;
+
+  // Resonance at index that can be modified, copying it if it is shared. The
+  //    resonances keep their own parameter values, so copies of an amplitude
+  //    share them only until one of the copies sets its parameters.
+  Resonance& own( const std::size_t& index );
+
+  // Compiled form of the expression. Parameters and coefficients are both
+  //    hoisted into a vector of values that is only updated by setPars.
+  struct Instruction
+  {
+    enum Code { ctnt, value, reso, fvec, binary, unary };
+
+    Code     code;
+    unsigned index;
+
+    Instruction( const Code& c, const unsigned& i ) : code( c ), index( i ) {}
+  };
+
+  std::vector< Instruction >            _tape;
+  std::vector< std::complex< double > > _values; // Values of the parameters and coefficients, in order of appearance.
+  std::vector< char >                   _isCoef; // Whether each of the hoisted values is a coefficient.
+  std::size_t                           _depth;  // Maximum depth of the value stack.
+  bool                                  _valid;  // Whether the expression leaves exactly one value.
+
+  // Positions in the tape of the operands of each operation, used to propagate
+  //    the derivatives backwards from the result to the hoisted values.
+  std::vector< std::pair< unsigned, unsigned > > _args;
+
+  // Parameters that enter the amplitude only through the hoisted values, and
+  //    the derivatives of each hoisted value with respect to them.
+  std::vector< std::string >                                                  _gradPars;
+  std::vector< std::vector< std::pair< unsigned, std::complex< double > > > > _valueGrad;
+
+  // Translate the expression into the tape. Called whenever the expression changes.
+  void compile() throw( PdfException );
+
+  // Update the hoisted values of the parameters and coefficients.
+  void hoist();
+
+  // Run the tape over the n points given, all of which must be inside the phase space.
+  //    The resonances take their kinematics from kin if it is not null.
+  void evaluateTape( const PhaseSpace& ps, const double* mSq12, const double* mSq13, const double* mSq23,
+                     const double* const* kin, const std::size_t& n, std::complex< double >* out ) const throw( PdfException );
+
+  // Run the tape over the n points given and over the same points with mSq12 and
+  //    mSq13 swapped, all of which must be inside the phase space.
+  void evaluateTapePair( const PhaseSpace& ps, const double* mSq12, const double* mSq13, const double* mSq23,
+                         const std::size_t& n, std::complex< double >* dir, std::complex< double >* cnj ) const throw( PdfException );
+
+  // Index of the first column of kinematics of resonance reso.
+  std::size_t kinematicsOffset( const std::size_t& reso ) const;
+
+  // Tape positions of the basis functions of the linear decomposition, if any.
+  std::vector< unsigned > _basis;
+  bool                    _linear;
+  bool                    _hasUnit; // Whether the decomposition has a constant term.
+
+  // Positions in the registry given to bind of the parameters of _parMap, of
+  //    _parms, of the real and imaginary parts of _coefs, one after the other,
+  //    and of those of each resonance and F vector, in their own orders.
+  std::vector< unsigned >                _mapIdx;
+  std::vector< unsigned >                _parmIdx;
+  std::vector< unsigned >                _coefIdx;
+  std::vector< std::vector< unsigned > > _resoIdx;
+  std::vector< std::vector< unsigned > > _fvecIdx;
+  bool                                   _bound;
+
+  // Take the positions found by the bind of an amplitude with the same expression.
+  void copyBinding( const Amplitude& amp );
+
+  void decompose();
+
+  // Derivative of the amplitude with respect to the value of each instruction of the tape.
+  void backward( const std::vector< std::complex< double > >& values,
+                 std::vector< std::complex< double > >&       adjoint ) const throw( PdfException );
 
   // Clean up the content of the Amplitude containers.
   void clear();
@@ -44,6 +121,7 @@ private:
   // Constructor to be called by binary operators.
   template< class L, class R >
   Amplitude( const L& left, const R& right, const Operation::Op& oper )
+    : _depth( 0 ), _valid( false ), _linear( false ), _hasUnit( false ), _bound( false )
   {
     append( left  );
     append( right );
@@ -51,65 +129,190 @@ private:
   }
 
 public:
-  Amplitude() {};
+  Amplitude() : _depth( 0 ), _valid( false ), _linear( false ), _hasUnit( false ), _bound( false ) {};
 
   Amplitude( const double& ctnt )
+    : _depth( 0 ), _valid( false ), _linear( false ), _hasUnit( false ), _bound( false )
   {
     append( ctnt );
   }
 
   Amplitude( const std::complex< double >& ctnt )
+    : _depth( 0 ), _valid( false ), _linear( false ), _hasUnit( false ), _bound( false )
   {
     append( ctnt );
   }
 
   Amplitude( const Coef& coef )
+    : _depth( 0 ), _valid( false ), _linear( false ), _hasUnit( false ), _bound( false )
   {
     append( coef );
   }
 
   Amplitude( const CoefExpr& expr )
+    : _depth( 0 ), _valid( false ), _linear( false ), _hasUnit( false ), _bound( false )
   {
     append( expr );
   }
 
   Amplitude( const Resonance& reso )
+    : _depth( 0 ), _valid( false ), _linear( false ), _hasUnit( false ), _bound( false )
   {
     append( reso );
   }
 
   Amplitude( const Fvector& vec )
+    : _depth( 0 ), _valid( false ), _linear( false ), _hasUnit( false ), _bound( false )
   {
     append( vec );
   }
 
   Amplitude( const Amplitude& amp )
+    : _depth( 0 ), _valid( false ), _linear( false ), _hasUnit( false ), _bound( false )
   {
     append( amp );
+    copyBinding( amp );
   }
 
-  ~Amplitude()
-  {
-    // Delete all the pointers to resonance, since they have been allocated
-    //    by the copy() function of each resonance.
-    typedef std::vector< Resonance* >::iterator rIter;
-    for ( rIter res = _resos.begin(); res != _resos.end(); ++res )
-      delete *res;
-  }
+  // The moved amplitude is left empty.
+  Amplitude( Amplitude&& amp ) = default;
+
+  ~Amplitude() {}
 
   const bool isFixed() const;
 
   void useHelicity( const bool helicity = true );
   void useTwoBW   ( const bool twoBW    = true );
 
+  // Tabulate the propagators of the resonances and F vector components already
+  //    added, with the given relative tolerance. A null tolerance removes the tables.
+  void tabulate( const PhaseSpace& ps, const double& tolerance = 1e-6 );
+
   const std::map< std::string, Parameter >& getPars() const { return _parMap; };
   void setPars( const std::map< std::string, Parameter >& pars );
 
+  // Find the positions of all the parameters in a registry of the parameters of
+  //    a model, so that setPars takes their values from it without looking up
+  //    any name. Any change of the expression undoes it.
+  void bind( const ParameterRegistry& registry ) throw( PdfException );
+  bool isBound() const { return _bound; }
+  void setPars( const ParameterRegistry& registry );
+
   std::complex< double > evaluate( const PhaseSpace& ps,
 				   const double&     mSq12,
 				   const double&     mSq13,
 				   const double&     mSq23 ) const throw( PdfException );
 
+  // Evaluate the amplitude at n points. Points outside the phase space evaluate to zero.
+  void evaluate( const PhaseSpace&       ps   ,
+                 const double*           mSq12,
+                 const double*           mSq13,
+                 const double*           mSq23,
+                 const std::size_t&      n    ,
+                 std::complex< double >* out    ) const throw( PdfException );
+
+  // Columns of kinematics of the resonances, nKinematics() in total, with those of
+  //    each resonance after the ones of the previous. They do not depend on any
+  //    parameter, so they can be filled once by kinematics() for a fixed set of
+  //    points and passed to evaluate, which then only computes what depends on
+  //    the parameters.
+  std::size_t nKinematics() const { return kinematicsOffset( _resos.size() ); }
+
+  void kinematics( const PhaseSpace&  ps   ,
+                   const double*      mSq12,
+                   const double*      mSq13,
+                   const double*      mSq23,
+                   const std::size_t& n    ,
+                   double* const*     kin    ) const;
+
+  // Evaluate the amplitude at n points given their kinematics. Points outside the
+  //    phase space evaluate to zero.
+  void evaluate( const PhaseSpace&       ps   ,
+                 const double*           mSq12,
+                 const double*           mSq13,
+                 const double*           mSq23,
+                 const double* const*    kin  ,
+                 const std::size_t&      n    ,
+                 std::complex< double >* out    ) const throw( PdfException );
+
+  // Evaluate the amplitude at n points, into dir, and at the same points with mSq12
+  //    and mSq13 swapped, into cnj, in a single pass that shares the kinematics of
+  //    the resonances between both orderings. Points outside the phase space
+  //    evaluate to zero.
+  void evaluatePair( const PhaseSpace&       ps   ,
+                     const double*           mSq12,
+                     const double*           mSq13,
+                     const double*           mSq23,
+                     const std::size_t&      n    ,
+                     std::complex< double >* dir  ,
+                     std::complex< double >* cnj    ) const throw( PdfException );
+
+  // Linear decomposition A = sum_k a_k B_k. The basis functions B_k are the resonances
+  //    and F vector components in the expression, in order of appearance, followed by the
+  //    unit function if the amplitude has a constant term. The coefficients a_k only
+  //    depend on the parameters of the coefficients and parameter expressions.
+  bool        linear() const { return _linear; }
+  std::size_t nBasis() const { return _basis.size() + ( _hasUnit ? 1 : 0 ); }
+
+  void coefficients( std::vector< std::complex< double > >& coefs ) const throw( PdfException );
+
+  // Evaluate the basis function k at n points. Points outside the phase space evaluate to zero.
+  void evaluateBasis( const std::size_t&      k    ,
+                      const PhaseSpace&       ps   ,
+                      const double*           mSq12,
+                      const double*           mSq13,
+                      const double*           mSq23,
+                      const std::size_t&      n    ,
+                      std::complex< double >* out    ) const throw( PdfException );
+
+  // Evaluate the basis function k at n points given their kinematics.
+  void evaluateBasis( const std::size_t&      k    ,
+                      const PhaseSpace&       ps   ,
+                      const double*           mSq12,
+                      const double*           mSq13,
+                      const double*           mSq23,
+                      const double* const*    kin  ,
+                      const std::size_t&      n    ,
+                      std::complex< double >* out    ) const throw( PdfException );
+
+  // Evaluate the basis function k at n points and at the same points with mSq12 and mSq13 swapped.
+  void evaluateBasisPair( const std::size_t&      k    ,
+                          const PhaseSpace&       ps   ,
+                          const double*           mSq12,
+                          const double*           mSq13,
+                          const double*           mSq23,
+                          const std::size_t&      n    ,
+                          std::complex< double >* dir  ,
+                          std::complex< double >* cnj    ) const throw( PdfException );
+
+  // Versions of the parameters that determine the shape of the basis function k.
+  const std::vector< unsigned > basisVersions( const std::size_t& k ) const;
+
+  // Description of the shape of the basis function k, given by the structure of
+  //    its resonance or F vector, e.g. to tell whether integrals saved by another
+  //    job can be reused.
+  const std::string basisShape( const std::size_t& k ) const;
+
+  // Description of the whole expression, but for the values of the parameters
+  //    and coefficients outside the resonances: its operations, constants, the
+  //    names of the parameters and coefficients, and the resonances and F vectors.
+  const std::string structure() const;
+
+  // Parameters with respect to which the amplitude can be differentiated analytically,
+  //    i.e. those of the coefficients and parameter expressions that no resonance uses.
+  const std::vector< std::string >& gradientPars() const { return _gradPars; }
+
+  // Evaluate the amplitude and its derivatives with respect to gradientPars() at n points.
+  //    grad holds one array of n values per parameter. Points outside the phase space
+  //    evaluate to zero, as do their derivatives.
+  void evaluateGradient( const PhaseSpace&                             ps   ,
+                         const double*                                 mSq12,
+                         const double*                                 mSq13,
+                         const double*                                 mSq23,
+                         const std::size_t&                            n    ,
+                         std::complex< double >*                       out  ,
+                         const std::vector< std::complex< double >* >& grad   ) const throw( PdfException );
+
   // Assignment operations.
   const Amplitude& operator= ( const double&                 ctnt );
   const Amplitude& operator= ( const std::complex< double >& ctnt );
@@ -119,6 +322,7 @@ public:
   const Amplitude& operator= ( const Resonance&              right );
   const Amplitude& operator= ( const Fvector&                right );
   const Amplitude& operator= ( const Amplitude&              right );
+  const Amplitude& operator= ( Amplitude&&                   right );
 
   const Amplitude& operator+=( const double&                 right );
   const Amplitude& operator-=( const double&                 right );
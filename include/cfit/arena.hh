@@ -0,0 +1,58 @@
+#ifndef __ARENA_HH__
+#define __ARENA_HH__
+
+#include <vector>
+#include <cstddef>
+
+// Arena from which the objects of a model graph, e.g. the pdf of a minimizer
+//    and all the models of its expressions, are allocated contiguously, in
+//    blocks of memory that are only freed, all at once, when the arena is
+//    destroyed. Deleting an object of the arena runs its destructor but does
+//    not free its memory.
+//
+// Classes that support it allocate their objects with node() and release them
+//    with release(). Their objects are placed in the arena of the innermost
+//    Scope active in the calling thread, or on the heap if there is none. An
+//    arena must outlive all the objects allocated in it.
+class Arena
+{
+private:
+  std::vector< char* > _blocks;
+  std::size_t          _blockSize;
+  char*                _next;      // First free byte of the current block.
+  std::size_t          _left;      // Free bytes of the current block.
+  std::size_t          _bytes;     // Total bytes of the blocks.
+
+  // Arena of the innermost scope of each thread.
+  static thread_local Arena* _current;
+
+  void* allocate( const std::size_t& bytes );
+
+  Arena( const Arena& );
+  Arena& operator=( const Arena& );
+
+public:
+  Arena( const std::size_t& blockSize = 1 << 16 );
+  ~Arena();
+
+  // Bytes of memory taken by the arena.
+  std::size_t memory() const { return _bytes; }
+
+  // Allocate objects in the arena while the scope lives.
+  class Scope
+  {
+  private:
+    Arena* _previous;
+
+  public:
+    Scope( Arena& arena ) : _previous( _current ) { _current = &arena; }
+    ~Scope() { _current = _previous; }
+  };
+
+  // Memory for an object of the given size, from the arena of the current
+  //    scope if any, and its release.
+  static void* node   ( const std::size_t& bytes );
+  static void  release( void* ptr );
+};
+
+#endif
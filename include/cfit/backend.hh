@@ -0,0 +1,48 @@
+#ifndef __BACKEND_HH__
+#define __BACKEND_HH__
+
+#include <functional>
+
+#include <cfit/exceptions.hh>
+
+class Minimizer;
+
+// Evaluation of the pdf of a minimizer at all its events, e.g. to compute an
+//    nll or a chi2. A backend that evaluates them on another device, with its
+//    own copy of the events and of the values cached by the pdf, derives from
+//    it and is given to the minimizer with setBackend, so that the code that
+//    builds the pdf and the minimizer does not change. The gradients and the
+//    scores are always computed by the minimizer itself.
+class Backend
+{
+public:
+  // Contribution of a block of n events starting at entry first, given the values of the pdf at them.
+  typedef std::function< double( const std::size_t& first, const std::size_t& n, const double* values ) > term_type;
+
+  virtual ~Backend() {}
+
+  virtual Backend* copy() const = 0;
+
+  // Sum of the terms of all the blocks of events of the minimizer, scaled by its
+  //    sample scale, with the same meaning of shape and first as in
+  //    Minimizer::sumBlocks. first must be executed on the calling thread.
+  virtual double sumBlocks( const Minimizer&                minimizer,
+                            const term_type&                term     ,
+                            const bool&                     shape    ,
+                            const std::function< void() >& first      ) const throw( PdfException ) = 0;
+};
+
+
+// Evaluation on the threads of the pool of the minimizer, which is the default.
+class CpuBackend : public Backend
+{
+public:
+  CpuBackend* copy() const { return new CpuBackend( *this ); }
+
+  double sumBlocks( const Minimizer&                minimizer,
+                    const term_type&                term     ,
+                    const bool&                     shape    ,
+                    const std::function< void() >& first      ) const throw( PdfException );
+};
+
+#endif
@@ -14,6 +14,7 @@
 #include <cfit/resonance.hh>
 #include <cfit/fvector.hh>
 #include <cfit/binning.hh>
+#include <cfit/parameterregistry.hh>
 
 
 class PhaseSpace;
@@ -30,6 +31,28 @@ private:
   std::vector< ParameterExpr > _nmb;
   std::vector< CoefExpr      > _xb;
 
+  // Values of the T_{+b}, T_{-b} and X_b expressions, and crossed terms
+  //    sqrt( T_{+b} T_{-b} ) X_b, computed once for each set of parameters.
+  std::vector< double                 > _tpb;
+  std::vector< double                 > _tmb;
+  std::vector< std::complex< double > > _vxb;
+  std::vector< std::complex< double > > _txb;
+
+  // Positions in _parMap of the parameters that the expressions of each bin
+  //    depend on, so that setPars only evaluates again the bins that change.
+  std::vector< std::vector< std::size_t > > _binPars;
+
+  // Positions of the parameters of _parMap in the registry given to bind.
+  std::vector< unsigned > _mapIdx;
+
+  // Set the values of the parameters of _parMap, in its order, and evaluate
+  //    again the bins that depend on those that have changed.
+  void setValues( const std::vector< double >& values );
+
+  void mapPars();
+  void cacheValues( const unsigned& bin );
+  void cacheValues();
+
 public:
   BinnedAmplitude() = default;
 
@@ -50,16 +73,21 @@ public:
   const std::map< std::string, Parameter >& getPars() const { return _parMap; };
   void setPars( const std::map< std::string, Parameter >& pars );
 
+  // Analogous to those of Amplitude.
+  void bind( const ParameterRegistry& registry ) throw( PdfException ) { _mapIdx = registry.indices( _parMap ); }
+  bool isBound() const { return _mapIdx.size() == _parMap.size(); }
+  void setPars( const ParameterRegistry& registry );
+
   const std::vector< ParameterExpr >& npb() const { return _npb; }
   const std::vector< ParameterExpr >& nmb() const { return _nmb; }
   const std::vector< CoefExpr      >& xb()  const { return _xb;  }
 
-  const double                 getN( const int& bin ) const
+  const double&                getN( const int& bin ) const
   {
     if ( std::abs( bin ) > (int) _nbins )
       throw PdfException( "BinnedAmplitude: requesting invalid bin" );
 
-    return ( ( bin > 0 ) ? _npb[ bin - 1 ] : _nmb[ std::abs( bin ) - 1 ] ).evaluate();
+    return ( bin > 0 ) ? _tpb[ bin - 1 ] : _tmb[ std::abs( bin ) - 1 ];
   }
 
   const std::complex< double > getX( const int& bin ) const
@@ -67,16 +95,20 @@ public:
     if ( std::abs( bin ) > (int) _nbins )
       throw PdfException( "BinnedAmplitude: requesting invalid bin" );
 
-    return ( bin > 0 ) ? _xb[ bin - 1 ].evaluate() : std::conj( _xb[ std::abs( bin ) - 1 ].evaluate() );
+    return ( bin > 0 ) ? _vxb[ bin - 1 ] : std::conj( _vxb[ std::abs( bin ) - 1 ] );
   }
 
 
   const std::tuple< double, double, std::complex< double > > evaluate( const int& bin ) const
   {
-    const double&&                 tpb = getN(   bin );
-    const double&&                 tmb = getN( - bin );
-    const std::complex< double >&& txb = std::sqrt( tpb * tmb ) * getX( bin );
-    return std::tuple< double, double, std::complex< double > >( tpb, tmb, txb );
+    if ( std::abs( bin ) > (int) _nbins )
+      throw PdfException( "BinnedAmplitude: requesting invalid bin" );
+
+    const std::size_t index = std::abs( bin ) - 1;
+    if ( bin > 0 )
+      return std::tuple< double, double, std::complex< double > >( _tpb[ index ], _tmb[ index ], _txb[ index ] );
+
+    return std::tuple< double, double, std::complex< double > >( _tmb[ index ], _tpb[ index ], std::conj( _txb[ index ] ) );
   }
 
 
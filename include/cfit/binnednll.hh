@@ -0,0 +1,87 @@
+#ifndef __BINNEDNLL_HH__
+#define __BINNEDNLL_HH__
+
+#include <vector>
+#include <string>
+#include <memory>
+
+#include <cfit/minimizer.hh>
+#include <cfit/pdfbase.hh>
+#include <cfit/variable.hh>
+#include <cfit/dataset.hh>
+#include <cfit/exceptions.hh>
+
+// Binned Poisson nll of the events of a dataset, histogrammed in a regular 2D
+//    grid of bins of two variables of the pdf, e.g. the invariant masses of a
+//    Dalitz plot. The events are histogrammed only once, when the dataset is
+//    set, so that the cost of each call does not depend on the number of
+//    events, but only on that of projecting the pdf on the bins:
+//       2 Sum( mu - n + n log( n / mu ) ),
+//    where n is the number of events of each bin and mu = N int_bin pdf its
+//    prediction, with N the total number of events in the histogram and the
+//    pdf normalized in the histogram. Its minimum is then a goodness of fit
+//    statistic. Events in bins where the pdf vanishes add a large penalty.
+//
+// Models of the Decay3Body family project themselves on the points of their
+//    norm grids, so each bin should contain several of them. Events outside
+//    the histogram are ignored. The minimizer itself only keeps one event of
+//    each occupied bin, on which the pdf caches its values.
+class BinnedNll : public Minimizer
+{
+private:
+  std::string _var1;
+  double      _min1;
+  double      _max1;
+  unsigned    _nBins1;
+
+  std::string _var2;
+  double      _min2;
+  double      _max2;
+  unsigned    _nBins2;
+
+  // Number of events of each bin, bin1 * nBins2 + bin2, which are shared by
+  //    the copies of the nll, and their sum.
+  std::shared_ptr< const std::vector< double > > _counts;
+  double                                         _total;
+
+  // Bin of the given event, or -1 if it is outside the histogram.
+  const long bin( const double& val1, const double& val2 ) const;
+
+  // Histogram the events of data and return the first event of each occupied bin.
+  const std::shared_ptr< const Dataset > histogram( const Dataset& data ) throw( PdfException );
+
+  // Add the events of data to counts and return the first event of each bin
+  //    that was empty before.
+  const Dataset fill( const Dataset& data, std::vector< double >& counts ) const;
+
+  // The events are bins with counts, so they cannot be subsampled. Since the
+  //    cost of each call does not depend on the number of events, progressive
+  //    fits are not needed either.
+  void select( const std::vector< std::size_t >& entries ) throw( PdfException );
+
+public:
+  BinnedNll( const PdfModel& pdf, const Dataset& data,
+             const Variable& var1, const double& min1, const double& max1, const unsigned& nBins1,
+             const Variable& var2, const double& min2, const double& max2, const unsigned& nBins2 );
+  BinnedNll( const PdfExpr&  pdf, const Dataset& data,
+             const Variable& var1, const double& min1, const double& max1, const unsigned& nBins1,
+             const Variable& var2, const double& min2, const double& max2, const unsigned& nBins2 );
+
+  BinnedNll( const BinnedNll& nll );
+
+  BinnedNll* copy() const { return new BinnedNll( *this ); }
+
+  // Histogram the events of a new dataset.
+  void setData( const std::shared_ptr< const Dataset >& data );
+
+  // Add new events to the histogram. The pdf only caches values for one event of
+  //    each bin that they occupy for the first time.
+  void append( const Dataset& events ) throw( PdfException );
+
+  const std::vector< double >& counts() const { return *_counts; }
+  const double&                total()  const { return _total;   }
+
+  double operator()( const std::vector<double>& par ) const throw( PdfException );
+};
+
+#endif
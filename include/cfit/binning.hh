@@ -4,7 +4,20 @@
 
 #include <vector>
 #include <string>
-
+#include <memory>
+
+#include <cfit/exceptions.hh>
+
+// Binning scheme defined by a set of points in the ( x, y ) plane with x >= y,
+//    each with a bin number. Any position belongs to the bin of its nearest point,
+//    or to minus that of ( y, x ) if x < y. The nearest point is found with a
+//    uniform grid of cells over the bounding box of the points, holding about one
+//    point each, and optionally with a lookup raster that stores the bin of each
+//    raster cell whose points all have the same nearest point.
+//
+// The arrays of the scheme can be written to a binary file, which is memory
+//    mapped and used directly when read back, so that nothing needs to be sorted
+//    or computed again. They are shared by all the copies of a binning.
 class Binning
 {
   typedef std::pair< std::pair< float, float >, unsigned > Datum;
@@ -22,89 +35,79 @@ class Binning
     }
   };
 
-  class ByY
-  {
-  public:
-    bool operator()( const Datum& p1, const Datum& p2 )
-    {
-      if ( p1.first.second == p2.first.second )
-        return p1.first.first < p2.first.first;
-
-      return p1.first.second < p2.first.second;
-    }
-  };
-
-  class PosX
-  {
-  public:
-    bool operator()( const Datum& p1, const float& p2 )
-    {
-      return p1.first.first < p2;
-      // return std::fabs( p1.first.first  - p2.first.first );
-    }
-
-    bool operator()( const float& p1, const Datum& p2 )
-    {
-      return p1 < p2.first.first;
-      // return std::fabs( p1.first.second - p2.first.second );
-    }
-  };
-
-  class PosY
+  // Arrays owned by the binning, when it has not been mapped from a file.
+  struct Arrays
   {
-  public:
-    bool operator()( const Datum& p1, const float& p2 )
-    {
-      return p1.first.second < p2;
-      // return std::fabs( p1.first.second - p2.first.second );
-    }
-
-    bool operator()( const float& p1, const Datum& p2 )
-    {
-      return p1 < p2.first.second;
-      // return std::fabs( p1.first.second - p2.first.second );
-    }
+    std::vector< float    > x;
+    std::vector< float    > y;
+    std::vector< unsigned > bins;
+    std::vector< unsigned > cellStart;
+    std::vector< unsigned > cellPoints;
+    std::vector< int      > raster;
   };
 
-  class Dist
-  {
-  private:
-    float _x;
-    float _y;
-  public:
-    Dist( const float& x, const float& y )
-      : _x( x ), _y( y )
-      {}
-
-    bool operator()( const Datum& p1, const Datum& p2 )
-    {
-      // return distance( p1.first, _x, _y ) < distance( p2.first, _x, _y );
+private:
+  // Owner of the arrays, either an Arrays object or a file mapping.
+  std::shared_ptr< const void > _storage;
+
+  // Coordinates and bins of the points, sorted by x.
+  std::size_t     _nPoints;
+  const float*    _x;
+  const float*    _y;
+  const unsigned* _bins;
+
+  // Grid of cells over the bounding box of the points, and indices of the
+  //    points in each cell, which are those from _cellStart[ c ] to _cellStart[ c + 1 ].
+  float           _xMin;
+  float           _yMin;
+  float           _cellWidth;
+  float           _cellHeight;
+  unsigned        _nCellsX;
+  unsigned        _nCellsY;
+  const unsigned* _cellStart;
+  const unsigned* _cellPoints;
+
+  // Lookup raster over the same box, with -1 in the cells that need a search.
+  unsigned        _nRasterX;
+  unsigned        _nRasterY;
+  const int*      _raster;
+
+  // Point the arrays to those of arrays, which become owned by the binning.
+  void adopt( const std::shared_ptr< Arrays >& arrays );
+
+  // Copy of the arrays of the points and the cells.
+  const std::shared_ptr< Arrays > copyArrays() const;
+
+  void buildCells( Arrays& arrays );
+
+  // Index of the point nearest to ( x, y ), and squared distance to the second
+  //    nearest one if second is given.
+  unsigned nearest( const float& x, const float& y, float* second = 0 ) const;
 
-      return std::pow( p1.first.first  - _x, 2 ) + std::pow( p1.first.second - _y, 2 ) <
-             std::pow( p2.first.first  - _x, 2 ) + std::pow( p2.first.second - _y, 2 );
+public:
+  Binning()
+    : _nPoints( 0 ), _x( 0 ), _y( 0 ), _bins( 0 ),
+      _xMin( 0.0 ), _yMin( 0.0 ), _cellWidth( 1.0 ), _cellHeight( 1.0 ),
+      _nCellsX( 0 ), _nCellsY( 0 ), _cellStart( 0 ), _cellPoints( 0 ),
+      _nRasterX( 0 ), _nRasterY( 0 ), _raster( 0 )
+  {}
 
-      // return std::sqrt( std::pow( p.first.first  - _x, 2 ) +
-      //                   std::pow( p.first.second - _y, 2 ) );
-    }
-  };
+  // Map a binning written with write().
+  Binning( const std::string& binsfile ) throw( PdfException );
 
-private:
-  Data _xybinx;
-  Data _xybiny;
+  Binning( const Data& xybin, const unsigned& nRasterX = 0, const unsigned& nRasterY = 0 );
 
-  static float distance( const std::pair< float, float >& a, const std::pair< float, float >& b );
-  static float distance( const std::pair< float, float >& a, const float& bx, const float& by );
+  std::size_t size() const { return _nPoints; }
 
-public:
-  Binning() = default;
-  // Binning( const std::string& binsfile );
-  Binning( const Data& xybin );
+  // Precompute the bins of an nRasterX x nRasterY raster over the bounding box
+  //    of the points. Zero disables the raster.
+  void setRaster( const unsigned& nRasterX, const unsigned& nRasterY );
 
-  std::size_t size() const { return _xybinx.size(); }
+  // Write the points, the cells and the raster to a binary file.
+  void write( const std::string& binsfile ) const throw( PdfException );
 
   // Find the bin corresponding to position (x,y) over the phase space.
   int bin( const float& x, const float& y ) const;
 };
 
 #endif
-
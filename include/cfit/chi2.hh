@@ -2,6 +2,7 @@
 #define __CHI2_HH__
 
 #include <vector>
+#include <memory>
 
 #include <cfit/minimizer.hh>
 #include <cfit/pdfbase.hh>
@@ -9,19 +10,54 @@
 #include <cfit/dataset.hh>
 #include <cfit/exceptions.hh>
 
+// Chi2 of the values of y in the dataset with respect to the values of the pdf
+//    at its variables. The variance of each entry, the sum of the squared errors
+//    of y and of the variables, never changes, so it is only computed when the
+//    dataset is set, and it is shared by the copies of the chi2.
+//
+// In binned mode, y holds the contents of the bins of a histogram, whose centres
+//    are given by the variables, and the prediction of each bin is the pdf at its
+//    centre times its volume and the total number of entries, so that the pdf
+//    does not need an area parameter. Bins without errors take the Poisson
+//    variance of their content, or one if they are empty.
 class Chi2 : public Minimizer
 {
 private:
   const Variable _y;
 
+  bool   _binned;
+  double _binVolume;
+
+  std::size_t                                   _yColumn;
+  double                                        _scale;
+  std::shared_ptr< const std::vector< double > > _variances;
+
+  void cacheVariances();
+
+  void select( const std::vector< std::size_t >& entries ) throw( PdfException );
+
 public:
   Chi2( const PdfModel& pdf, const Variable& y, const Dataset& data );
   Chi2( const PdfExpr&  pdf, const Variable& y, const Dataset& data );
 
+  // Chi2 of the entries selected by a view.
+  Chi2( const PdfModel& pdf, const Variable& y, const DatasetView& data );
+  Chi2( const PdfExpr&  pdf, const Variable& y, const DatasetView& data );
+
+  // Chi2 of a dataset shared with its owner, which is not copied.
+  Chi2( const PdfModel& pdf, const Variable& y, const std::shared_ptr< const Dataset >& data );
+  Chi2( const PdfExpr&  pdf, const Variable& y, const std::shared_ptr< const Dataset >& data );
+
   Chi2( const Chi2& chi2 );
 
   Chi2* copy() const { return new Chi2( *this ); }
 
+  void setData( const std::shared_ptr< const Dataset >& data );
+  void append ( const Dataset& events ) throw( PdfException );
+
+  // Fit the contents of bins of the given volume.
+  void setBinned( const double& binVolume );
+
   double operator()( const std::vector<double>& par ) const throw( PdfException );
 };
 
@@ -0,0 +1,55 @@
+#ifndef __COMPENSATEDSUM_HH__
+#define __COMPENSATEDSUM_HH__
+
+#include <cstddef>
+#include <cmath>
+
+// Sum with Neumaier's compensated summation, which keeps the rounding error
+//    of the running sum and adds it back at the end, so that the error of a
+//    sum of n terms does not grow with n. The result only depends on the order
+//    in which the terms are added, so sums of the same terms in the same order,
+//    e.g. block by block whatever thread computes each block, are identical, e.g.
+//       CompensatedSum sum;
+//       for ( std::size_t entry = 0; entry < n; ++entry )
+//         sum += - 2. * log( values[ entry ] );
+//       return sum.value();
+class CompensatedSum
+{
+private:
+  double _sum;
+  double _comp;
+
+public:
+  CompensatedSum()
+    : _sum ( 0.0 ),
+      _comp( 0.0 )
+  {}
+
+  CompensatedSum& operator+=( const double& value )
+  {
+    const double total = _sum + value;
+
+    if ( std::fabs( _sum ) >= std::fabs( value ) )
+      _comp += ( _sum - total ) + value;
+    else
+      _comp += ( value - total ) + _sum;
+
+    _sum = total;
+
+    return *this;
+  }
+
+  const double value() const { return _sum + _comp; }
+
+  // Sum of n values separated by stride.
+  static double sum( const double* values, const std::size_t& n, const std::size_t& stride = 1 )
+  {
+    CompensatedSum sum;
+    for ( std::size_t i = 0; i < n; ++i )
+      sum += values[ i * stride ];
+
+    return sum.value();
+  }
+};
+
+#endif
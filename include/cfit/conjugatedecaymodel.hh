@@ -0,0 +1,128 @@
+#ifndef __CONJUGATEDECAYMODEL_HH__
+#define __CONJUGATEDECAYMODEL_HH__
+
+#include <vector>
+#include <map>
+#include <complex>
+#include <memory>
+#include <mutex>
+
+#include <cfit/decaymodel.hh>
+#include <cfit/amplitude.hh>
+#include <cfit/phasespace.hh>
+#include <cfit/dataset.hh>
+
+// Three-body models that combine the amplitude A with the amplitude Ac with the
+//    invariant masses mSq12 and mSq13 swapped, such as Decay3BodyCP and
+//    Decay3BodyMix. It owns what they have in common: the norm components
+//    dir = int eff |A|^2, cnj = int eff |Ac|^2 and xed = int eff conj( A ) Ac,
+//    which can also be given if the amplitude and the efficiency are fixed, and
+//    the pairs of amplitudes cached for the events of a dataset. If only the
+//    coefficients of a linear amplitude float, the pairs of its basis functions
+//    are cached instead, and the amplitudes of each block of events are their
+//    products by the vector of coefficients.
+//
+// Models with the same amplitude and phase space can share the cached pairs
+//    with shareAmplitudes, so that only the first of them to be cached on a
+//    dataset computes them, and the others take the same columns of the cache.
+class ConjugateDecayModel : public DecayModel< Amplitude >
+{
+private:
+  // Indices of the pairs cached by the last of the models sharing them, and
+  //    the pass and dataset they were cached for.
+  struct SharedPairs
+  {
+    unsigned       pass;
+    const Dataset* data;
+    std::size_t    size;
+    unsigned       dirCache;
+    unsigned       cnjCache;
+    std::mutex     lock;    // Models copied for several threads may be cached at the same time.
+
+    SharedPairs() : pass( 0 ), data( 0 ), size( 0 ), dirCache( 0 ), cnjCache( 0 ) {}
+  };
+
+  std::shared_ptr< SharedPairs > _pairs; // Shared by the copies and by the models given to shareAmplitudes.
+
+protected:
+  // Norm components.
+  double                 _nDir;
+  double                 _nCnj;
+  std::complex< double > _nXed;
+
+  // Whether the norm components have been given, with the amplitude and the
+  //    efficiency they depend on all fixed.
+  bool _fixedNorm;
+
+  // Indices of the cached direct and conjugated amplitudes.
+  bool     _cacheAmps;
+  unsigned _ampDirCache;
+  unsigned _ampCnjCache;
+
+  // Whether the basis functions B_k of the amplitude are cached instead, with
+  //    the indices of the direct ones followed by those of the conjugated ones,
+  //    and the coefficients a_k, brought up to date by updateNormComponents.
+  //    They take 2 nBasis complex values per event.
+  bool                                  _cacheBasis;
+  std::vector< unsigned >               _basisCache;
+  std::vector< std::complex< double > > _coefs;
+
+  // Whether the amplitude and all the efficiency functions are fixed.
+  const bool isFixedAmp() const;
+
+  // Whether the amplitude is linear and only the parameters of its coefficients float.
+  const bool isFixedShape() const;
+
+  // Direct and conjugated amplitudes sum_k a_k B_k of one event or of a block of
+  //    n events from their cached basis functions.
+  void combineBasis( const std::vector< std::complex< double > >& cacheC,
+                     std::complex< double >& dir, std::complex< double >& cnj ) const;
+  void combineBasis( const std::vector< const std::complex< double >* >& cacheC, const std::size_t& n,
+                     std::complex< double >* dir, std::complex< double >* cnj ) const;
+
+  // Bring the norm components up to date, unless they have been given.
+  void updateNormComponents() throw( PdfException );
+
+  // Cache the direct and conjugated amplitudes of the events of data if
+  //    _cacheAmps is set, or take those of a model sharing them, already cached
+  //    in the same pass on the same dataset. Otherwise, cache the basis
+  //    functions if the shape of the amplitude is fixed.
+  const std::map< unsigned, std::vector< std::complex< double > > > cacheAmplitudes( const Dataset& data );
+  const std::map< unsigned, std::vector< std::complex< double > > > cacheBasis     ( const Dataset& data );
+
+  // Whether the cached pairs may be shared with other models, which must then
+  //    not be modified, e.g. by folding the efficiency into them.
+  const bool sharesAmplitudes() const { return bool( _pairs ); }
+
+  // The norm components must be computed again on the new points.
+  void invalidateNorm()
+  {
+    _fixedNorm = false;
+    DecayModel< Amplitude >::invalidateNorm();
+  }
+
+public:
+  ConjugateDecayModel( const Variable&   mSq12,
+                       const Variable&   mSq13,
+                       const Variable&   mSq23,
+                       const Amplitude&  amp  ,
+                       const PhaseSpace& ps    );
+
+  virtual ConjugateDecayModel* copy() const = 0;
+
+  // Share the cached pairs of amplitudes with other, which must have the same
+  //    amplitude and phase space.
+  void shareAmplitudes( ConjugateDecayModel& other );
+
+  // Getters for the norm components.
+  const double&                 nDir() const { return _nDir; }
+  const double&                 nCnj() const { return _nCnj; }
+  const std::complex< double >& nXed() const { return _nXed; }
+
+  // Norm components setters, which only take effect if the amplitude and the
+  //    efficiency are fixed. Without nCnj, it is taken to be equal to nDir.
+  void setNormComponents( const double& nDir, const double& nCnj, const std::complex< double >& nXed );
+  void setNormComponents( const double& nDir,                     const std::complex< double >& nXed );
+};
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef __DALITZENVELOPE_HH__
+#define __DALITZENVELOPE_HH__
+
+#include <vector>
+#include <functional>
+
+#include <cfit/exceptions.hh>
+#include <cfit/phasespace.hh>
+
+// Piecewise constant upper bound of a density over the Dalitz plot, to generate
+//    events by accept-reject with proposals that follow the density. Points are
+//    proposed by choosing a cell with probability proportional to its volume and
+//    then uniformly inside it, so the acceptance only suffers from the variation
+//    of the density inside each cell.
+//
+// The rectangle that contains the phase space is first split into nCells x nCells
+//    cells in ( mSq12, mSq13 ). The density is evaluated at 3 x 3 points of each
+//    cell, including its corners, and its height is the largest of these values
+//    plus a safety margin on their spread. As in a cell tree of Foam, the cells
+//    that waste most of the volume under the envelope, such as those across
+//    narrow resonances, are then split in four, until most of the volume is
+//    under the density or there are maxCells cells.
+//
+// Where the density is found above the height of a cell, the height is raised
+//    for the rest of that generation, but the envelope itself does not change,
+//    so that the events only depend on the random numbers.
+class DalitzEnvelope
+{
+public:
+  // Density at n points, such as the values of a pdf.
+  typedef std::function< void( const double* mSq12, const double* mSq13, const double* mSq23,
+                               const std::size_t& n, double* out ) > density_type;
+
+private:
+  PhaseSpace _ps;
+
+  // Lower corner, sizes and height of each cell, and cumulative sums of their volumes.
+  std::vector< double > _min12;
+  std::vector< double > _min13;
+  std::vector< double > _size12;
+  std::vector< double > _size13;
+  std::vector< double > _heights;
+  std::vector< double > _cumulative;
+
+  // Estimate of the integral of the density, i.e. of the volume under it.
+  double _integral;
+
+  void accumulate( const std::vector< double >& heights, std::vector< double >& cumulative ) const;
+
+public:
+  // Safety margin applied to the values of the density.
+  static double margin() { return 1.2; }
+
+  // Flat envelope of the given height, i.e. uniform proposals over the rectangle.
+  DalitzEnvelope( const PhaseSpace& ps, const double& height );
+
+  // Envelope of a density.
+  DalitzEnvelope( const PhaseSpace&   ps                 ,
+                  const density_type& f                  ,
+                  const unsigned&     nCells   = 32      ,
+                  const std::size_t&  maxCells = 16384     );
+
+  std::size_t size() const { return _heights.size(); }
+
+  // Bytes of the cells.
+  std::size_t memory() const;
+
+  // Fraction of the proposals expected to be accepted, for a density normalised
+  //    over the phase space.
+  double efficiency() const;
+
+  // Generate n events distributed according to f, normally the density the
+  //    envelope was built from, by accept-reject under the envelope.
+  void generate( const density_type& f    , const std::size_t& n,
+                 double*             mSq12, double*            mSq13, double* mSq23 ) const throw( PdfException );
+};
+
+#endif
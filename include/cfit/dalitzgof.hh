@@ -0,0 +1,102 @@
+#ifndef __DALITZGOF_HH__
+#define __DALITZGOF_HH__
+
+#include <vector>
+#include <string>
+
+#include <cfit/exceptions.hh>
+#include <cfit/variable.hh>
+#include <cfit/dataset.hh>
+#include <cfit/pdfbase.hh>
+
+// Chi2 goodness of fit of a pdf to the events of a dataset over adaptive bins
+//    of two of its variables, e.g. the invariant masses of a Dalitz plot.
+//
+// The range of the variables is split into a raster of nCells x nCells cells,
+//    in which the events are counted once. The bins are then built as in a k-d
+//    tree: starting from the whole range, each bin is cut along its longest
+//    side, at the edge of the cells closest to its median, until cutting again
+//    would leave less than minEvents events at either side. Since the bins are
+//    unions of cells, their expected contents are the sums of the projection of
+//    the pdf on the raster, computed by a single call to projectHist, which the
+//    Decay3Body models do in one pass over the points of their norm grids.
+//
+// The projection uses the current state of the pdf, so it should be one that has
+//    been updated with the parameters of the fit, such as the pdf of its minimizer.
+class DalitzGof
+{
+public:
+  // Range of the bin in both variables, number of events, prediction and pull.
+  struct Bin
+  {
+    double min1;
+    double max1;
+    double min2;
+    double max2;
+    double observed;
+    double expected;
+    double pull;
+  };
+
+private:
+  std::string _var1;
+  double      _min1;
+  double      _max1;
+
+  std::string _var2;
+  double      _min2;
+  double      _max2;
+
+  unsigned    _nCells;
+
+  // Events of each cell, cell1 * nCells + cell2, and their sum.
+  std::vector< double > _counts;
+  double                _total;
+
+  // Bin of each cell, and cells in which each bin starts and ends in each variable.
+  std::vector< unsigned > _cellBins;
+  std::vector< unsigned > _first1;
+  std::vector< unsigned > _end1;
+  std::vector< unsigned > _first2;
+  std::vector< unsigned > _end2;
+
+  std::vector< Bin > _bins;
+
+  double   _chi2;
+  unsigned _nUsed;
+
+  // Split the cells [ first1, end1 ) x [ first2, end2 ), with nEvents events, into bins.
+  void split( const unsigned& first1, const unsigned& end1,
+              const unsigned& first2, const unsigned& end2,
+              const double& nEvents, const unsigned& minEvents );
+
+  // Cell edge along var1 or var2 closest to the median of the events in the
+  //    given cells, or 0 if cutting there leaves less than minEvents at either side.
+  unsigned median( const bool& along1,
+                   const unsigned& first1, const unsigned& end1,
+                   const unsigned& first2, const unsigned& end2,
+                   const double& nEvents, const unsigned& minEvents ) const;
+
+public:
+  DalitzGof( const Dataset&  data,
+             const Variable& var1, const double& min1, const double& max1,
+             const Variable& var2, const double& min2, const double& max2,
+             const unsigned& minEvents = 20, const unsigned& nCells = 100 ) throw( PdfException );
+
+  // Compute the expected contents of the bins, normalized to the number of events
+  //    in the range, and return the chi2 = Sum( ( observed - expected )^2 / expected ).
+  //    Bins without events where nothing is expected are skipped, and a bin with
+  //    events where the pdf vanishes throws.
+  double chi2( const PdfBase& pdf ) throw( PdfException );
+
+  // Chi2 of the last call, number of bins used minus one (0 if at most one was),
+  //    and bins with their expected contents and pulls, ( observed - expected ) / sqrt( expected ).
+  const double&             value() const { return _chi2;                   }
+  unsigned                  ndf()   const { return _nUsed ? _nUsed - 1 : 0; }
+  const std::vector< Bin >& bins()  const { return _bins;                   }
+
+  // Bin of a point of the range, or -1 if it is outside.
+  int bin( const double& val1, const double& val2 ) const;
+};
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef __DALITZGRID_HH__
+#define __DALITZGRID_HH__
+
+#include <vector>
+#include <string>
+
+#include <cfit/exceptions.hh>
+
+class PhaseSpace;
+class Dataset;
+
+// Points at which to evaluate the integrals over the kinematically allowed region,
+//    stored row after row, one array per squared invariant mass. The integral of f
+//    is stepSq() * sum_i w_i f( x_i ).
+//
+// A grid keeps the cells of a grid of nSteps x nSteps cells in ( mSq12, mSq13 ),
+//    both between mSq12min and mSq12max, that lie inside the region. By default
+//    each cell is represented by its centre, with unit weight, and only the cells
+//    whose centre is inside the region are kept. With boundary weights, the cells
+//    crossed by the boundary are sampled on a finer grid and represented by the
+//    centroid of their inside part, weighted by the fraction of the cell that it
+//    covers.
+//
+// A Monte Carlo sample keeps a fixed set of events, either generated uniformly in
+//    the phase space or accepted from such a sample after detector effects, in
+//    which case the efficiency is already included in their distribution.
+class DalitzGrid
+{
+private:
+  unsigned _nSteps; // Zero for Monte Carlo samples.
+  double   _stepSq; // Area of the region represented by each point of unit weight.
+  bool     _withEff;
+
+  std::vector< double >      _mSq12;
+  std::vector< double >      _mSq13;
+  std::vector< double >      _mSq23;
+  std::vector< double >      _weights; // Empty unless boundary weights are used.
+  std::vector< std::size_t > _rows;    // Index of the first point of each row, and the end.
+  std::vector< std::size_t > _mirrors; // Index of the mirror image of each point. Empty for samples.
+
+  void push( const double& mSq12, const double& mSq13, const double& mSq23 );
+
+  // Split the points of a sample into rows, to be handed out to different threads.
+  void splitRows();
+
+  // Find the mirror images of the points, given the point of each cell of the grid.
+  void findMirrors( const std::vector< std::size_t >& cells );
+
+public:
+  static const std::size_t noMirror;
+
+  DalitzGrid() : _nSteps( 0 ), _stepSq( 0.0 ), _withEff( false ), _rows( 1, 0 ) {}
+  DalitzGrid( const PhaseSpace& ps, const unsigned& nSteps, const bool& weighted = false );
+
+  // Sample of the events in data, which are those accepted out of nGenerated
+  //    events generated uniformly in the phase space.
+  DalitzGrid( const PhaseSpace&  ps        ,
+              const Dataset&     data      ,
+              const std::string& mSq12     ,
+              const std::string& mSq13     ,
+              const std::size_t& nGenerated  ) throw( DataException );
+
+  // Sample of nEvents events generated uniformly in the phase space.
+  static DalitzGrid sample( const PhaseSpace& ps, const std::size_t& nEvents );
+
+  // Area of the kinematically allowed region in ( mSq12, mSq13 ).
+  static double area( const PhaseSpace& ps );
+
+  const unsigned& steps()    const { return _nSteps;            }
+  const double&   stepSq()   const { return _stepSq;            }
+  std::size_t     size()     const { return _mSq12.size();      }
+  std::size_t     nRows()    const { return _rows.size() - 1;   }
+  bool            weighted() const { return ! _weights.empty(); }
+
+  // Whether the points are distributed according to the efficiency.
+  bool efficiencyWeighted() const { return _withEff; }
+
+  // Bytes of the points, their weights, rows and mirror images.
+  std::size_t memory() const;
+
+  const double* mSq12()   const { return _mSq12.data(); }
+  const double* mSq13()   const { return _mSq13.data(); }
+  const double* mSq23()   const { return _mSq23.data(); }
+  const double* weights() const { return weighted() ? _weights.data() : 0; }
+
+  // Weight of a point, one if boundary weights are not used.
+  double weight( const std::size_t& point ) const { return weighted() ? _weights[ point ] : 1.0; }
+
+  // Index of the point with mSq12 and mSq13 swapped, or noMirror if there is no
+  //    such point. On a grid, the only candidate is the point of the mirrored cell,
+  //    which may have been dropped or moved differently by the boundary.
+  bool               hasMirrors()                          const { return ! _mirrors.empty(); }
+  const std::size_t& mirror    ( const std::size_t& point ) const { return _mirrors[ point ]; }
+
+  // Range of indices of the points of a row.
+  std::size_t rowBegin( const std::size_t& row ) const { return _rows[ row     ]; }
+  std::size_t rowEnd  ( const std::size_t& row ) const { return _rows[ row + 1 ]; }
+};
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef __DALITZINTEGRATOR_HH__
+#define __DALITZINTEGRATOR_HH__
+
+#include <vector>
+#include <functional>
+#include <memory>
+
+#include <cfit/threadpool.hh>
+#include <cfit/phasespace.hh>
+#include <cfit/dalitzgrid.hh>
+
+// Midpoint integration on a grid of nSteps x nSteps points in ( mSq12, mSq13 ),
+//    or on any other set of points such as a Monte Carlo sample. The integrand
+//    is evaluated one row at a time on the points inside the phase space, which
+//    are computed once, the rows are distributed among the threads and the sums
+//    are done with compensated summation, in the same order whatever the number
+//    of threads.
+class DalitzIntegrator
+{
+public:
+  // Function that evaluates nComps components of the integrand at n points,
+  //    storing component c of point i in out[ c * n + i ].
+  typedef std::function< void( const double* mSq12, const double* mSq13, const double* mSq23,
+                               const std::size_t& n, double* out ) > integrand_type;
+
+  // Function that evaluates nComps components of the integrand at the n points
+  //    of a grid starting at index begin, e.g. from values cached at them.
+  typedef std::function< void( const std::size_t& begin, const std::size_t& n, double* out ) > cached_type;
+
+  // Task executed on the n points of a row of a grid starting at index begin.
+  typedef std::function< void( const std::size_t& begin, const std::size_t& n ) > row_type;
+
+private:
+  PhaseSpace                          _ps;
+  std::shared_ptr< const DalitzGrid > _grid; // Shared by the copies, since it is never modified.
+  ThreadPool*                         _pool;
+
+  // Contribution of each of the points of grid to the integral of f.
+  void contributions( const DalitzGrid& grid, const integrand_type& f, double* out ) const;
+
+public:
+  DalitzIntegrator( const PhaseSpace& ps, const unsigned& nSteps = 400, const bool& weighted = false )
+    : _ps( ps ), _grid( new DalitzGrid( ps, nSteps, weighted ) ), _pool( 0 )
+  {}
+
+  DalitzIntegrator( const DalitzIntegrator& integ )
+    : _ps( integ._ps ), _grid( integ._grid ), _pool( integ._pool ? new ThreadPool( integ._pool->size() ) : 0 )
+  {}
+
+  const DalitzIntegrator& operator=( const DalitzIntegrator& right );
+
+  ~DalitzIntegrator() { delete _pool; }
+
+  // Number of integration steps in each direction.
+  void            setSteps( const unsigned& nSteps ) { _grid.reset( new DalitzGrid( _ps, nSteps, _grid->weighted() ) ); }
+  const unsigned& steps() const                      { return _grid->steps(); }
+
+  // Whether to weight the cells crossed by the boundary of the phase space by
+  //    the fraction of their area inside it.
+  void setBoundaryWeights( const bool& weighted ) { _grid.reset( new DalitzGrid( _ps, _grid->steps(), weighted ) ); }
+
+  const std::shared_ptr< const DalitzGrid >& grid() const { return _grid; }
+
+  // Number of threads used to integrate. Zero means as many as the hardware supports.
+  void     setThreads( const unsigned& nThreads );
+  unsigned threads() const { return _pool ? _pool->size() : 1; }
+
+  // Integrate the nComps components of f over the phase space into result, on
+  //    the grid of the integrator or on the given points.
+  void integrate( const integrand_type& f, const std::size_t& nComps, double* result ) const;
+  void integrate( const DalitzGrid& grid, const integrand_type& f, const std::size_t& nComps, double* result ) const;
+
+  // Integrate the nComps components of a function of the indices of the points,
+  //    or only their contribution from the rows between firstRow and endRow.
+  void integrateCached( const DalitzGrid& grid, const cached_type& f, const std::size_t& nComps, double* result ) const;
+  void integrateCached( const DalitzGrid& grid, const cached_type& f, const std::size_t& nComps, double* result,
+                        const std::size_t& firstRow, const std::size_t& endRow ) const;
+
+  // Execute task on each non-empty row of grid, or of the rows between firstRow
+  //    and endRow, distributing them among the threads.
+  void forEachRow( const DalitzGrid& grid, const row_type& task ) const;
+  void forEachRow( const DalitzGrid& grid, const row_type& task,
+                   const std::size_t& firstRow, const std::size_t& endRow ) const;
+
+  double integrate(                         const integrand_type& f ) const;
+  double integrate( const DalitzGrid& grid, const integrand_type& f ) const;
+
+  // Integrate f over the squared invariant mass next to the one with the given
+  //    index ( 0, 1 or 2 for mSq12, mSq13 or mSq23 ), with the latter fixed to x,
+  //    or to each of the n values in x, evaluating f on all the points at once.
+  double project( const unsigned& index, const double& x, const integrand_type& f ) const;
+  void   project( const unsigned& index, const double* x, const std::size_t& n,
+                  const integrand_type& f, double* out ) const;
+
+  // Integrals of f in each of nBins equal bins between min and max of the squared
+  //    invariant mass with the given index, or in each of the nBins1 x nBins2 bins
+  //    of two of them, with the bins of the second running fastest. They are all
+  //    filled in a single pass over the given points, and points out of the range
+  //    are ignored.
+  void histogram( const DalitzGrid& grid, const integrand_type& f,
+                  const unsigned& index, const double& min, const double& max, const unsigned& nBins,
+                  double* out ) const;
+  void histogram( const DalitzGrid& grid, const integrand_type& f,
+                  const unsigned& index1, const double& min1, const double& max1, const unsigned& nBins1,
+                  const unsigned& index2, const double& min2, const double& max2, const unsigned& nBins2,
+                  double* out ) const;
+};
+
+#endif
@@ -5,25 +5,86 @@
 #include <map>
 #include <vector>
 #include <utility>
+#include <memory>
 
 #include <cfit/exceptions.hh>
 #include <cfit/region.hh>
 
+class DatasetView;
+
+// Dataset stored in columns: one contiguous array of values per field and
+//    a separate array of errors, which is only allocated for fields that
+//    have been pushed some non-zero error. Field names are resolved to
+//    column indices with column(), such that event loops can access the
+//    data through the index instead of looking up the name for every entry.
+//
+// A dataset can also be mapped read-only from a binary file written by write(),
+//    in which case its columns are the arrays of the file, without any copy,
+//    and processes that map the same file share its pages. The columns are
+//    only copied into memory if the dataset is modified.
 class Dataset
 {
 private:
-  typedef std::map< std::string, std::vector< std::pair< double, double > > > data_type;
-  typedef std::map< std::string, std::pair< double, double > >                datum_type;
-  data_type _data;
+  typedef std::map< std::string, std::pair< double, double > > datum_type;
+
+  std::map< std::string, std::size_t > _index;  // Column index of each field.
+  std::vector< std::vector< double > > _values; // Values of each column.
+  std::vector< std::vector< double > > _errors; // Errors of each column, empty if they are all zero.
+
+  // Mapping of a binary file, the number of entries in it and its arrays of
+  //    values and errors of each column, null for columns without errors.
+  std::shared_ptr< const void > _mapping;
+  std::size_t                   _mappedSize;
+  std::vector< const double* >  _mappedValues;
+  std::vector< const double* >  _mappedErrors;
+
+  // Copy the mapped columns into memory, before modifying them.
+  void own();
+
+  std::size_t addColumn ( const std::string& field );
+  void        pushColumn( const std::size_t& column, const double& value, const double& error );
 
 public:
-  Dataset()  {};
+  Dataset() : _mappedSize( 0 ) {};
   ~Dataset() {};
 
+  // Copy of the entries selected by a view.
+  Dataset( const DatasetView& view );
+
+  // Dataset mapped from a binary file written by write().
+  static Dataset map( const std::string& file ) throw( DataException );
+
+  // Dataset read from a text file with the values of the given fields in each
+  //    line, separated by blanks or commas. Empty lines and lines that start
+  //    with # are skipped. The file is mapped and split into chunks of whole
+  //    lines, which are parsed in parallel by nThreads threads, or as many as
+  //    the hardware supports if zero, straight into the columns, e.g.
+  //       Dataset data = Dataset::readText( "data/dalitz.dat", { "m2AB", "m2AC", "m2BC", "t" } );
+  static Dataset readText( const std::string&                file    ,
+                           const std::vector< std::string >& fields  ,
+                           const unsigned&                   nThreads = 0 ) throw( DataException );
+
+  // Piece number part out of nParts of the entries of a binary file written by
+  //    write(), with the same number of entries for each piece as scatter(). Each
+  //    piece is read directly from its offsets in the file, so that with MPI every
+  //    process can read its own events without scattering them, e.g.
+  //       Dataset data( file, MPI::COMM_WORLD.Get_rank(), MPI::COMM_WORLD.Get_size() );
+  explicit Dataset( const std::string& file, const std::size_t& part = 0, const std::size_t& nParts = 1 ) throw( DataException );
+
+  // Write the dataset to a binary file, column after column in native byte order.
+  void write( const std::string& file ) const throw( DataException );
+
   void push( const std::string& field, const double& value, const double& error = 0. );
   void push( const std::map< std::string, double >& event ); // Map of fields and values.
   void push( const std::map< std::string, std::pair< double, double > >& event );
 
+  // Append n values to the column of a field, e.g. all the generated values of a
+  //    variable at once, and all the entries of another dataset, which must have
+  //    the same fields unless this one is empty.
+  void append( const std::string& field, const double* values, const std::size_t& n );
+  void append( const Dataset&     data ) throw( DataException );
+  void append( const DatasetView& view ) throw( DataException );
+
   // Getters.
   bool                       empty ()                                      const;
   std::size_t                size  ()                                      const;
@@ -34,13 +95,118 @@ public:
   std::vector< double >      errors( const std::string& field )            const throw( DataException );
   std::vector< std::string > fields()                                      const;
 //void                       dump  ()                                      const;
-  const Dataset              slice( const Region& region )                 const;
+
+  // View of the entries inside the limits of a region, without copying them.
+  const DatasetView slice( const Region& region ) const;
+
+  // Copy of the n entries that start at entry first.
+  const Dataset range( const std::size_t& first, const std::size_t& n ) const;
+
+  // Reorder the entries once after loading them, so that consecutive entries
+  //    are close to each other, e.g. in the Dalitz plot, and blocks of events
+  //    read neighbouring entries of tables and rasters. Either along a Hilbert
+  //    curve over a 2^order x 2^order grid on the range of two fields, or by
+  //    increasing value of a field, such as a bin index, keeping the order of
+  //    equal values. They return the permutation applied, where entry i is the
+  //    former entry order[ i ], to put the results back in the original order.
+  const std::vector< std::size_t > sort( const std::string& field1, const std::string& field2,
+                                         const unsigned& order = 10 ) throw( DataException );
+  const std::vector< std::size_t > sort( const std::string& field ) throw( DataException );
+
+  // Make entry i the former entry order[ i ] or, if inverse, make entry order[ i ]
+  //    the former entry i, which undoes the permutation. Throws if order is not a
+  //    permutation of the entries.
+  void permute( const std::vector< std::size_t >& order, const bool& inverse = false ) throw( DataException );
+
+  // Hints that the n entries that start at entry first are about to be read, or
+  //    will not be read for a while, for datasets mapped from a file.
+  void prefetch( const std::size_t& first, const std::size_t& n ) const;
+  void release ( const std::size_t& first, const std::size_t& n ) const;
+
+  // Bytes of the columns held in memory, and bytes of the columns mapped from a
+  //    file, which are only in memory while the kernel keeps their pages.
+  std::size_t memory() const;
+  std::size_t mapped() const;
+
+  // Column getters. The arrays of a column hold size() entries, and that of
+  //    the errors is null if they are all zero.
+  std::size_t nColumns   ()                            const { return _index.size();                    }
+  std::size_t column     ( const std::string& field  ) const throw( DataException );
+  bool        hasErrors  ( const std::size_t& column ) const { return errorColumn( column ) != 0;    }
+
+  const double* valueColumn( const std::size_t& column ) const
+  {
+    return _mapping ? _mappedValues[ column ] : _values[ column ].data();
+  }
+
+  const double* errorColumn( const std::size_t& column ) const
+  {
+    if ( _mapping )
+      return _mappedErrors[ column ];
+
+    return _errors[ column ].empty() ? 0 : _errors[ column ].data();
+  }
+
+  double value( const std::size_t& column, const std::size_t& entry ) const
+  {
+    return valueColumn( column )[ entry ];
+  }
+
+  double error( const std::size_t& column, const std::size_t& entry ) const
+  {
+    const double* errors = errorColumn( column );
+    return errors ? errors[ entry ] : 0.;
+  }
 
 #ifdef MPI_ON
-  // Scatter the data through all the processes in an MPI communicator.
+  // Scatter the data through all the processes in an MPI communicator, in ranges
+  //    of consecutive events. By default each process gets the same number of
+  //    events. Otherwise, each one gets about the same total cost, given for each
+  //    event or for each value of a category field, e.g. the sample that the
+  //    events of a simultaneous fit belong to. Categories without a cost cost one.
+  //    The costs are only read on the root process, which holds the data.
   void scatter();
+  void scatter( const std::vector< double >& costs );
+  void scatter( const std::string& category, const std::map< double, double >& costs ) throw( DataException );
 #endif
 };
 
-#endif
 
+// Selection of some of the entries of a dataset, kept as their indices in it
+//    instead of copies of their values, e.g. to split the same sample into
+//    signal, sidebands and many Dalitz plot regions. The dataset must outlive
+//    its views. Slicing a view gives another view of the same dataset, so that
+//    selections compose, and minimizers copy the selected entries only once.
+class DatasetView
+{
+private:
+  const Dataset*                                      _data;
+  std::shared_ptr< const std::vector< std::size_t > > _entries;
+
+public:
+  // View of all the entries of a dataset.
+  DatasetView( const Dataset& data );
+
+  // View of the given entries of a dataset, in increasing order.
+  DatasetView( const Dataset& data, const std::shared_ptr< const std::vector< std::size_t > >& entries )
+    : _data( &data ), _entries( entries )
+  {}
+
+  const Dataset&                    data   () const { return *_data;           }
+  const std::vector< std::size_t >& entries() const { return *_entries;        }
+  bool                              empty  () const { return _entries->empty(); }
+  std::size_t                       size   () const { return _entries->size();  }
+
+  // Index in the dataset of entry number index of the view.
+  const std::size_t& entry( const std::size_t& index ) const { return ( *_entries )[ index ]; }
+
+  std::size_t column( const std::string& field ) const throw( DataException ) { return _data->column( field ); }
+
+  double value( const std::size_t& column, const std::size_t& index ) const { return _data->value( column, entry( index ) ); }
+  double error( const std::size_t& column, const std::size_t& index ) const { return _data->error( column, entry( index ) ); }
+
+  // View of the entries of this view inside the limits of a region.
+  const DatasetView slice( const Region& region ) const;
+};
+
+#endif
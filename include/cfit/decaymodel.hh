@@ -1,12 +1,21 @@
 #ifndef __DECAYMODEL_HH__
 #define __DECAYMODEL_HH__
 
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <memory>
+
 #include <cfit/pdfmodel.hh>
 #include <cfit/variable.hh>
 #include <cfit/parameter.hh>
 #include <cfit/amplitude.hh>
+#include <cfit/normgrid.hh>
+#include <cfit/dalitzgrid.hh>
 #include <cfit/binnedamplitude.hh>
 #include <cfit/phasespace.hh>
+#include <cfit/dataset.hh>
+#include <cfit/parameterregistry.hh>
 
 
 #include <cfit/function.hh>
@@ -23,13 +32,51 @@ protected:
   // One or more functions to define the efficiency.
   std::vector< Function > _funcs;
 
+  // Append a function to the efficiency, binding it to the positions of the
+  //    squared invariant masses ( mSq12, mSq13, mSq23 ).
+  void appendFunc( const Function& func ) throw( PdfException );
+
+  // Index of the efficiency cached for the events, if all the efficiency functions are fixed.
+  bool     _cacheFuncs;
+  unsigned _funcsCache;
+
+  // Cache the efficiency of the events of data if it cannot change, i.e. if
+  //    all the parameters of the efficiency functions are fixed.
+  const std::map< unsigned, std::vector< double > > cacheFuncs( const Dataset& data );
+
+  // Points on which the norm is computed, values cached at them and threads.
+  NormGrid _normGrid;
+
+  // Efficiency at the points on which the norm is computed, which is one if the
+  //    points of the sample are already distributed according to it.
+  void evaluateNormFuncs( const double* mSq12, const double* mSq13, const double* mSq23,
+                          const std::size_t& n, double* out ) const throw( PdfException );
+
+  // Bring the norm integrals of the amplitude up to date with its parameters
+  //    and the efficiency.
+  void updateNorm() throw( PdfException );
+
+  // Called whenever the points of the norm change, so that the models can drop
+  //    anything computed on the previous ones.
+  virtual void invalidateNorm() { invalidate(); }
+
+  // Registry of all the parameters of the model, and positions in it of the
+  //    parameters of each efficiency function, in alphabetical order. The
+  //    amplitude and the functions take their values from it, without looking
+  //    up their names. They are found again whenever the parameters change.
+  ParameterRegistry                      _registry;
+  std::vector< std::vector< unsigned > > _funcIdx;
+
+  // Propagate the values of _parMap to the amplitude and the functions.
+  void propagatePars() throw( PdfException );
+
 public:
   DecayModel< AmplitudeClass >( const Variable&       mSq12,
                                 const Variable&       mSq13,
                                 const Variable&       mSq23,
                                 const AmplitudeClass& amp  ,
                                 const PhaseSpace&     ps    )
-    : _amp( amp ), _ps( ps )
+    : _amp( amp ), _ps( ps ), _cacheFuncs( false ), _funcsCache( 0 ), _normGrid( ps )
   {
     push( mSq12 );
     push( mSq13 );
@@ -50,6 +97,77 @@ public:
 
   const double evaluateFuncs( const double& mSq12, const double& mSq13, const double& mSq23 ) const;
   const double evaluateFuncs( const double& mSq12, const double& mSq13                      ) const;
+
+  // Evaluate the product of the efficiency functions at n points.
+  void evaluateFuncs( const double* mSq12, const double* mSq13, const double* mSq23,
+                      const std::size_t& n, double* out ) const throw( PdfException );
+
+  // Compute the norm on a fixed Monte Carlo sample instead of a grid, which can
+  //    be shared by all the models with the same phase space. A null sample goes
+  //    back to the grid.
+  void setNormSample( const std::shared_ptr< const DalitzGrid >& sample )
+  {
+    _normGrid.setSample( sample );
+    invalidateNorm();
+  }
+
+  const std::shared_ptr< const DalitzGrid >& normSample() const { return _normGrid.sample(); }
+
+  // Number of integration steps in each direction and threads used to integrate.
+  //    Zero threads means as many as the hardware supports.
+  const unsigned& integrationSteps()   const { return _normGrid.steps();   }
+  unsigned        integrationThreads() const { return _normGrid.threads(); }
+
+  void setIntegrationSteps( const unsigned& steps )
+  {
+    _normGrid.setSteps( steps );
+    invalidateNorm();
+  }
+
+  void setIntegrationThreads( const unsigned& nThreads ) { _normGrid.setThreads( nThreads ); }
+
+  // Integrals on a sample of points or read from a file are kept as they are.
+  void scaleNormSteps( const double& factor )
+  {
+    if ( normSample() || ! _normGrid.file().empty() )
+      return;
+
+    setIntegrationSteps( std::max( unsigned( integrationSteps() * factor + 0.5 ), 16u ) );
+  }
+
+  // Number of norms of the most recent values of the parameters that are kept to
+  //    be taken again without integrating. Zero disables it.
+  void setNormRecent( const std::size_t& nRecent ) { _normGrid.setRecent( nRecent ); }
+
+  // File where the integrals of the norm are saved, to be read by later jobs with
+  //    the same points, structure of the resonances and efficiency functions. See
+  //    NormGrid::setFile.
+  void setNormFile( const std::string& file )
+  {
+    _normGrid.setFile( file );
+    invalidateNorm();
+  }
+
+  // Share the norm integrals with other, which must have the same amplitude,
+  //    efficiency and phase space, e.g. the same model in several categories of
+  //    a simultaneous fit. They are then only computed once for each set of
+  //    values of the parameters.
+  void shareNorm( DecayModel< AmplitudeClass >& other )
+  {
+    _normGrid.share( other._normGrid );
+    other.invalidateNorm();
+  }
+
+  // Number of efficiency functions followed by the versions of their parameters,
+  //    such that any change of the efficiency changes the returned vector.
+  const std::vector< unsigned > funcVersions() const;
+
+  // Number of efficiency functions followed by the values of their parameters.
+  const std::vector< double > funcValues() const;
+
+  // Values cached at the points of the norm, and the points themselves, which
+  //    may be shared with other models.
+  const std::map< std::string, std::size_t > memory() const;
 };
 
 
@@ -63,14 +181,7 @@ inline
 void DecayModel< AmplitudeClass >::setPars( const std::vector< double >& pars ) throw( PdfException )
 {
   setParMap( pars );
-
-  _amp.setPars( _parMap );
-
-  typedef std::vector< Function >::iterator fIter;
-  for ( fIter func = _funcs.begin(); func != _funcs.end(); ++func )
-    func->setPars( _parMap );
-
-  setParExpr();
+  propagatePars();
 }
 
 
@@ -80,14 +191,7 @@ inline
 void DecayModel< AmplitudeClass >::setPars( const std::map< std::string, Parameter >& pars ) throw( PdfException )
 {
   setParMap( pars );
-
-  _amp.setPars( pars );
-
-  typedef std::vector< Function >::iterator fIter;
-  for ( fIter func = _funcs.begin(); func != _funcs.end(); ++func )
-    func->setPars( _parMap );
-
-  setParExpr();
+  propagatePars();
 }
 
 
@@ -97,41 +201,211 @@ inline
 void DecayModel< AmplitudeClass >::setPars( const FunctionMinimum& min ) throw( PdfException )
 {
   setParMap( min );
+  propagatePars();
+}
 
-  _amp.setPars( _parMap );
 
-  typedef std::vector< Function >::iterator fIter;
-  for ( fIter func = _funcs.begin(); func != _funcs.end(); ++func )
-    func->setPars( _parMap );
+// The registry is built again, and the positions found, if any parameter or
+//    efficiency function has been added since the last time, or if the
+//    amplitude has lost its binding, e.g. after being modified.
+template < class AmplitudeClass >
+inline
+void DecayModel< AmplitudeClass >::propagatePars() throw( PdfException )
+{
+  if ( ( _registry.size() != _parMap.size() ) || ( _funcIdx.size() != _funcs.size() ) || ! _amp.isBound() )
+  {
+    _registry = ParameterRegistry( _parMap );
+    _amp.bind( _registry );
+
+    _funcIdx.clear();
+    typedef std::vector< Function >::const_iterator fIter;
+    for ( fIter func = _funcs.begin(); func != _funcs.end(); ++func )
+      _funcIdx.push_back( _registry.indices( func->getParMap() ) );
+  }
+
+  _registry.set( _parMap );
+  _amp.setPars( _registry );
+
+  const double* values = _registry.values();
+  std::vector< double > funcValues;
+  for ( std::size_t func = 0; func < _funcs.size(); ++func )
+  {
+    const std::vector< unsigned >& funcIdx = _funcIdx[ func ];
+    funcValues.resize( funcIdx.size() );
+    for ( std::size_t par = 0; par < funcIdx.size(); ++par )
+      funcValues[ par ] = values[ funcIdx[ par ] ];
+
+    _funcs[ func ].setValues( funcValues );
+  }
 
   setParExpr();
 }
 
 
+template < class AmplitudeClass >
+inline
+void DecayModel< AmplitudeClass >::appendFunc( const Function& func ) throw( PdfException )
+{
+  std::vector< std::string > names;
+  names.push_back( mSq12name() );
+  names.push_back( mSq13name() );
+  names.push_back( mSq23name() );
+
+  _funcs.push_back( func );
+  _funcs.back().bind( names );
+
+  // Files of norm integrals written with other efficiencies must not be read.
+  std::string shape;
+  typedef std::vector< Function >::const_iterator fIter;
+  for ( fIter f = _funcs.begin(); f != _funcs.end(); ++f )
+    shape += f->structure() + "\n";
+  _normGrid.setEfficiencyShape( shape );
+}
+
+
 template < class AmplitudeClass >
 inline
 const double DecayModel< AmplitudeClass >::evaluateFuncs( const double& mSq12, const double& mSq13, const double& mSq23 ) const
 {
   double value = 1.0;
 
-  const std::string& name12 = mSq12name(); // mSq12
-  const std::string& name13 = mSq13name(); // mSq13
-  const std::string& name23 = mSq23name(); // mSq23
+  const double vars[ 3 ] = { mSq12, mSq13, mSq23 };
 
   typedef std::vector< Function >::const_iterator fIter;
+  for ( fIter func = _funcs.begin(); func != _funcs.end(); ++func )
+    value *= func->evaluate( vars );
 
-  std::map< std::string, double > varMap;
+  // Always return a non-negative value. Default to zero.
+  return std::max( value, 0.0 );
+}
+
+
+template < class AmplitudeClass >
+inline
+void DecayModel< AmplitudeClass >::evaluateFuncs( const double* mSq12, const double* mSq13, const double* mSq23,
+                                                  const std::size_t& n, double* out ) const throw( PdfException )
+{
+  std::fill( out, out + n, 1.0 );
+
+  if ( _funcs.empty() )
+    return;
+
+  std::vector< const double* > vars( 3 );
+  vars[ 0 ] = mSq12;
+  vars[ 1 ] = mSq13;
+  vars[ 2 ] = mSq23;
+
+  std::vector< double > values( n );
+
+  typedef std::vector< Function >::const_iterator fIter;
   for ( fIter func = _funcs.begin(); func != _funcs.end(); ++func )
   {
-    if ( func->dependsOn( name12 ) ) varMap[ name12 ] = mSq12;
-    if ( func->dependsOn( name13 ) ) varMap[ name13 ] = mSq13;
-    if ( func->dependsOn( name23 ) ) varMap[ name23 ] = mSq23;
-
-    value *= func->evaluate( varMap );
+    func->evaluate( vars, n, values.data() );
+    for ( std::size_t i = 0; i < n; ++i )
+      out[ i ] *= values[ i ];
   }
 
   // Always return a non-negative value. Default to zero.
-  return std::max( value, 0.0 );
+  for ( std::size_t i = 0; i < n; ++i )
+    out[ i ] = std::max( out[ i ], 0.0 );
+}
+
+
+template < class AmplitudeClass >
+inline
+const std::map< unsigned, std::vector< double > > DecayModel< AmplitudeClass >::cacheFuncs( const Dataset& data )
+{
+  std::map< unsigned, std::vector< double > > cached;
+
+  _cacheFuncs = ! _funcs.empty();
+  typedef std::vector< Function >::const_iterator fIter;
+  for ( fIter func = _funcs.begin(); func != _funcs.end(); ++func )
+    _cacheFuncs &= func->isFixed();
+
+  if ( ! _cacheFuncs )
+    return cached;
+
+  // Get an index for the cached efficiency.
+  _funcsCache = nextCacheIdxReal();
+
+  const std::size_t mSq12col = data.column( mSq12name() );
+  const std::size_t mSq13col = data.column( mSq13name() );
+  const std::size_t mSq23col = data.column( mSq23name() );
+
+  const std::size_t& size = data.size();
+  cached[ _funcsCache ].resize( size );
+
+  evaluateFuncs( data.valueColumn( mSq12col ),
+                 data.valueColumn( mSq13col ),
+                 data.valueColumn( mSq23col ), size, cached[ _funcsCache ].data() );
+
+  return cached;
+}
+
+
+template < class AmplitudeClass >
+inline
+void DecayModel< AmplitudeClass >::evaluateNormFuncs( const double* mSq12, const double* mSq13, const double* mSq23,
+                                                      const std::size_t& n, double* out ) const throw( PdfException )
+{
+  if ( _normGrid.points()->efficiencyWeighted() )
+    std::fill( out, out + n, 1.0 );
+  else
+    evaluateFuncs( mSq12, mSq13, mSq23, n, out );
+}
+
+
+template < class AmplitudeClass >
+inline
+void DecayModel< AmplitudeClass >::updateNorm() throw( PdfException )
+{
+  _normGrid.update( _amp,
+                    [ this ]( const double* mSq12, const double* mSq13, const double* mSq23, const std::size_t& n, double* out )
+                    { evaluateNormFuncs( mSq12, mSq13, mSq23, n, out ); },
+                    funcVersions(), funcValues() );
+}
+
+
+template < class AmplitudeClass >
+inline
+const std::vector< unsigned > DecayModel< AmplitudeClass >::funcVersions() const
+{
+  std::vector< unsigned > versions( 1, _funcs.size() );
+
+  typedef std::vector< Function >::const_iterator           fIter;
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  for ( fIter func = _funcs.begin(); func != _funcs.end(); ++func )
+    for ( pIter par = func->getParMap().begin(); par != func->getParMap().end(); ++par )
+      versions.push_back( par->second.version() );
+
+  return versions;
+}
+
+
+template < class AmplitudeClass >
+inline
+const std::vector< double > DecayModel< AmplitudeClass >::funcValues() const
+{
+  std::vector< double > values( 1, _funcs.size() );
+
+  typedef std::vector< Function >::const_iterator           fIter;
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  for ( fIter func = _funcs.begin(); func != _funcs.end(); ++func )
+    for ( pIter par = func->getParMap().begin(); par != func->getParMap().end(); ++par )
+      values.push_back( par->second.value() );
+
+  return values;
+}
+
+
+template < class AmplitudeClass >
+const std::map< std::string, std::size_t > DecayModel< AmplitudeClass >::memory() const
+{
+  std::map< std::string, std::size_t > bytes;
+  bytes[ "norm cache"  ] = _normGrid.memory();
+  bytes[ "norm points" ] = _normGrid.points() ? _normGrid.points()->memory() : 0;
+
+  return bytes;
 }
 
 
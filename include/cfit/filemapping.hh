@@ -0,0 +1,28 @@
+#ifndef __FILEMAPPING_HH__
+#define __FILEMAPPING_HH__
+
+#include <string>
+#include <memory>
+#include <cstddef>
+
+#include <cfit/exceptions.hh>
+
+// Read-only mappings of whole files, which are unmapped when the last of the
+//    pointers that share them is destroyed, and hints to the kernel about the
+//    ranges of a mapping that are about to be read or that are not needed for
+//    a while, so that large files can be streamed through a bounded amount of
+//    memory.
+class FileMapping
+{
+public:
+  // Map the file and set size to its size in bytes.
+  static std::shared_ptr< const void > map( const std::string& file, std::size_t& size ) throw( DataException );
+
+  // Start reading the pages of a range in the background.
+  static void prefetch( const void* addr, const std::size_t& bytes );
+
+  // Let the kernel drop the pages of a range, that are read again from the file if needed.
+  static void release( const void* addr, const std::size_t& bytes );
+};
+
+#endif
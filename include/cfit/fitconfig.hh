@@ -0,0 +1,283 @@
+#ifndef __FITCONFIG_HH__
+#define __FITCONFIG_HH__
+
+#include <Minuit/FunctionMinimum.h>
+#include <Minuit/MnUserParameterState.h>
+#include <Minuit/MnStrategy.h>
+#include <Minuit/MnSimplex.h>
+#include <Minuit/MnMigrad.h>
+#include <Minuit/MnHesse.h>
+#include <Minuit/MinuitParameter.h>
+
+#include <vector>
+#include <limits>
+
+#include <cfit/lbfgs.hh>
+
+// Configuration of the sequence of Minuit calls of a fit: an optional Simplex
+//    pre-minimisation, Migrad with the given strategy, tolerance and maximum
+//    number of calls, a retry with a stronger strategy starting from the first
+//    result if it is not valid, and an optional Hesse. The default is a single
+//    Migrad with the defaults of Minuit. Cheap fits, e.g. of toys, can use
+//       FitConfig config;
+//       config.setStrategy( 0 );
+//       config.setRetryStrategy( 1 );
+//    Large models with analytic gradients can use the limited memory quasi-Newton
+//    steps of Lbfgs instead of Migrad, with
+//       config.setEngine( FitConfig::lbfgs );
+//    Migrad then only starts from its minimum with the covariance given by Hesse,
+//    which it usually confirms in a few calls, to provide the FunctionMinimum.
+//    Functions without a gradient, such as the FCNBase of MasterWorker, get it
+//    from central differences.
+//    Fits of large datasets can first be run on subsamples of the events, e.g.
+//       config.setProgressive( { 0.01, 0.1 } );
+//    which fits 1% of them, then 10% from that minimum, and then all of them, so
+//    that most calls far from the minimum only evaluate a few events.
+//    Minos, scans, fits from several starting points or of bootstrap replicas and
+//    the numeric derivatives of gradients are run in parallel by as many copies
+//    of the minimizer as their numbers of threads.
+class FitConfig
+{
+public:
+  enum Engine { migrad, lbfgs };
+
+private:
+  Engine   _engine;
+  unsigned _strategy;
+  double   _tolerance;
+  unsigned _maxCalls;     // Zero means the default of Minuit.
+  bool     _simplex;
+  bool     _hesse;
+  bool     _retry;
+  unsigned _retryStrategy;
+  unsigned _minosThreads; // Zero means as many as the hardware supports.
+  unsigned _scanThreads;  // Zero means as many as the hardware supports.
+  unsigned _gradThreads;  // Zero means as many as the hardware supports.
+  unsigned _startThreads; // Zero means as many as the hardware supports.
+  unsigned _bootThreads;  // Zero means as many as the hardware supports.
+  unsigned _startCalls;   // Zero means that no start is stopped early.
+  double   _startCut;
+
+  std::vector< double > _fractions;
+  unsigned              _progressiveSeed;
+
+public:
+  FitConfig()
+    : _engine       ( migrad ),
+      _strategy     ( 1     ),
+      _tolerance    ( 0.1   ),
+      _maxCalls     ( 0     ),
+      _simplex      ( false ),
+      _hesse        ( false ),
+      _retry        ( false ),
+      _retryStrategy( 2     ),
+      _minosThreads ( 1     ),
+      _scanThreads  ( 1     ),
+      _gradThreads  ( 1     ),
+      _startThreads ( 1     ),
+      _bootThreads  ( 1     ),
+      _startCalls   ( 0     ),
+      _startCut     ( 0.0   ),
+      _progressiveSeed( 0     )
+  {}
+
+  // Setters.
+  void setEngine       ( const Engine&   engine    ) { _engine    = engine;    }
+  void setStrategy     ( const unsigned& strategy  ) { _strategy  = strategy;  }
+  void setTolerance    ( const double&   tolerance ) { _tolerance = tolerance; }
+  void setMaxCalls     ( const unsigned& maxCalls  ) { _maxCalls  = maxCalls;  }
+  void setSimplex      ( const bool&     val = true ) { _simplex  = val; }
+  void setHesse        ( const bool&     val = true ) { _hesse    = val; }
+  void setRetryStrategy( const unsigned& strategy  ) { _retry = true; _retryStrategy = strategy; }
+  void noRetry         ()                            { _retry = false; }
+  void setMinosThreads ( const unsigned& nThreads  ) { _minosThreads = nThreads; }
+  void setScanThreads  ( const unsigned& nThreads  ) { _scanThreads  = nThreads; }
+  void setGradThreads  ( const unsigned& nThreads  ) { _gradThreads  = nThreads; }
+  void setStartThreads ( const unsigned& nThreads  ) { _startThreads = nThreads; }
+  void setBootThreads  ( const unsigned& nThreads  ) { _bootThreads  = nThreads; }
+
+  // Fits from several starting points first run Migrad with at most calls calls,
+  //    and those whose function value is then larger than the smallest one by
+  //    more than cut are stopped there.
+  void setStartStage( const unsigned& calls, const double& cut ) { _startCalls = calls; _startCut = cut; }
+
+  // Minimizer::minimize first fits the subsamples of the given increasing
+  //    fractions of the events, each from the minimum of the previous one, before
+  //    the whole dataset. The events of each subsample are drawn from the seed,
+  //    and each subsample contains the smaller ones.
+  void setProgressive( const std::vector< double >& fractions, const unsigned& seed = 0 )
+  {
+    _fractions       = fractions;
+    _progressiveSeed = seed;
+  }
+  void noProgressive() { _fractions.clear(); }
+
+  // Getters.
+  const Engine&   engine()        const { return _engine;        }
+  const unsigned& strategy()      const { return _strategy;      }
+  const double&   tolerance()     const { return _tolerance;     }
+  const unsigned& maxCalls()      const { return _maxCalls;      }
+  const bool&     simplex()       const { return _simplex;       }
+  const bool&     hesse()         const { return _hesse;         }
+  const bool&     retry()         const { return _retry;         }
+  const unsigned& retryStrategy() const { return _retryStrategy; }
+  const unsigned& minosThreads()  const { return _minosThreads;  }
+  const unsigned& scanThreads()   const { return _scanThreads;   }
+  const unsigned& gradThreads()   const { return _gradThreads;   }
+  const unsigned& startThreads()  const { return _startThreads;  }
+  const unsigned& bootThreads()   const { return _bootThreads;   }
+  const unsigned& startCalls()    const { return _startCalls;    }
+  const double&   startCut()      const { return _startCut;      }
+
+  const std::vector< double >& progressive()     const { return _fractions;       }
+  const unsigned&              progressiveSeed() const { return _progressiveSeed; }
+
+  // Run the sequence of Minuit calls on fcn from the given starting state.
+  template < class FCN >
+  FunctionMinimum minimize( const FCN& fcn, const MnUserParameterState& start ) const;
+
+private:
+  // Gradient of fcn at point for the quasi-Newton steps: its own if it provides
+  //    one, otherwise central differences with the given steps, where a zero step
+  //    leaves a zero derivative.
+  template < class FCN >
+  static auto gradient( const FCN& fcn, const std::vector< double >& point,
+                        const std::vector< double >& steps, int )
+    -> decltype( fcn.gradient( point ) )
+  {
+    return fcn.gradient( point );
+  }
+
+  template < class FCN >
+  static std::vector< double > gradient( const FCN& fcn, const std::vector< double >& point,
+                                         const std::vector< double >& steps, long );
+};
+
+
+
+template < class FCN >
+FunctionMinimum FitConfig::minimize( const FCN& fcn, const MnUserParameterState& start ) const
+{
+  MnUserParameterState state( start );
+
+  // The simplex only brings the starting values closer to the minimum.
+  if ( _simplex )
+  {
+    MnSimplex simplex( fcn, state.parameters(), MnStrategy( _strategy ) );
+    state = simplex( _maxCalls, _tolerance ).userState();
+  }
+
+  unsigned strategy = _strategy;
+
+  if ( _engine == lbfgs )
+  {
+    // The quasi-Newton steps only move the free parameters.
+    const std::vector< MinuitParameter >& pars = state.parameters().parameters();
+
+    std::vector< double   > all;
+    std::vector< unsigned > free;
+    std::vector< double   > values;
+    std::vector< double   > lower;
+    std::vector< double   > upper;
+    std::vector< double   > scale;
+    const double inf = std::numeric_limits< double >::infinity();
+    for ( unsigned index = 0; index < pars.size(); ++index )
+    {
+      const MinuitParameter& par = pars[ index ];
+      all.push_back( par.value() );
+      if ( par.isFixed() || par.isConst() )
+        continue;
+
+      free  .push_back( index );
+      values.push_back( par.value() );
+      lower .push_back( par.hasLowerLimit() ? par.lowerLimit() : - inf );
+      upper .push_back( par.hasUpperLimit() ? par.upperLimit() :   inf );
+      scale .push_back( par.error() > 0.0 ? par.error() : 1.0 );
+    }
+
+    // Steps of the numeric derivatives of functions without a gradient.
+    std::vector< double > steps( all.size(), 0.0 );
+    for ( std::size_t index = 0; index < free.size(); ++index )
+      steps[ free[ index ] ] = 1.e-3 * scale[ index ];
+
+    const auto expand = [ & ]( const std::vector< double >& freeValues )
+    {
+      std::vector< double > point( all );
+      for ( std::size_t index = 0; index < free.size(); ++index )
+        point[ free[ index ] ] = freeValues[ index ];
+      return point;
+    };
+
+    const Lbfgs::function_type function = [ & ]( const std::vector< double >& freeValues )
+    {
+      return fcn( expand( freeValues ) );
+    };
+
+    const Lbfgs::gradient_type gradient = [ & ]( const std::vector< double >& freeValues )
+    {
+      const std::vector< double > grad = FitConfig::gradient( fcn, expand( freeValues ), steps, 0 );
+
+      std::vector< double > freeGrad;
+      for ( std::size_t index = 0; index < free.size(); ++index )
+        freeGrad.push_back( grad[ free[ index ] ] );
+      return freeGrad;
+    };
+
+    // Same default maximum number of calls and convergence criterion as Migrad.
+    const std::size_t nFree    = free.size();
+    const unsigned    maxCalls = _maxCalls ? _maxCalls : 200 + 100 * nFree + 5 * nFree * nFree;
+
+    const Lbfgs::Result result = Lbfgs().minimize( function, gradient, values, lower, upper, scale,
+                                                   0.002 * _tolerance * fcn.up(), maxCalls );
+
+    for ( std::size_t index = 0; index < nFree; ++index )
+      state.setValue( free[ index ], result.values[ index ] );
+
+    state = MnHesse( strategy )( fcn, state, _maxCalls );
+  }
+
+  MnMigrad migrad( fcn, state, MnStrategy( strategy ) );
+  FunctionMinimum min = migrad( _maxCalls, _tolerance );
+
+  if ( _retry && ( _retryStrategy > _strategy ) && ! min.isValid() )
+  {
+    strategy = _retryStrategy;
+
+    MnMigrad retry( fcn, min.userState(), MnStrategy( strategy ) );
+    min = retry( _maxCalls, _tolerance );
+  }
+
+  if ( _hesse )
+  {
+    const MnHesse hesse( strategy );
+    hesse( fcn, min, _maxCalls );
+  }
+
+  return min;
+}
+
+
+template < class FCN >
+std::vector< double > FitConfig::gradient( const FCN& fcn, const std::vector< double >& point,
+                                           const std::vector< double >& steps, long )
+{
+  std::vector< double > grad( point.size(), 0.0 );
+  std::vector< double > shifted( point );
+  for ( std::size_t index = 0; index < point.size(); ++index )
+  {
+    if ( steps[ index ] == 0.0 )
+      continue;
+
+    shifted[ index ] = point[ index ] + steps[ index ];
+    const double upper = fcn( shifted );
+    shifted[ index ] = point[ index ] - steps[ index ];
+    const double lower = fcn( shifted );
+    shifted[ index ] = point[ index ];
+
+    grad[ index ] = ( upper - lower ) / ( 2.0 * steps[ index ] );
+  }
+
+  return grad;
+}
+
+#endif
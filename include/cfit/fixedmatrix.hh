@@ -0,0 +1,296 @@
+#ifndef __FIXEDMATRIX_HH__
+#define __FIXEDMATRIX_HH__
+
+#include <iostream>
+#include <cmath>
+#include <complex>
+#include <array>
+#include <sstream>
+#include <utility>
+
+#include <cfit/matrix.hh>
+
+// Square matrix of a range fixed at compile time, with its elements stored
+//    contiguously row after row, so that it can live on the stack. All the loops
+//    have constant bounds, which lets the compiler unroll them. The determinant,
+//    the inverse and the solutions of linear systems are computed from an LU
+//    decomposition with partial pivoting.
+template < class T, int N >
+class FixedMatrix
+{
+public:
+  typedef std::array< T, N > vector_type;
+
+private:
+  std::array< T, N * N > _mat;
+
+  // LU decomposition in place, with perm the row of the original matrix at each
+  //    row of the decomposition. Returns the sign of the permutation, or zero if
+  //    the matrix is singular.
+  int decompose( std::array< int, N >& perm );
+
+  // Solve L U x = b in place, with b already permuted.
+  void substitute( vector_type& b ) const;
+
+public:
+  FixedMatrix() { _mat.fill( T( 0. ) ); }
+
+  // Copy of the elements of a matrix of the same range.
+  explicit FixedMatrix( const Matrix< T >& mat );
+
+  static constexpr int range() { return N; }
+
+  T&       operator()( int row, int col )       { return _mat[ row * N + col ]; }
+  const T& operator()( int row, int col ) const { return _mat[ row * N + col ]; }
+
+  // Elements of a row, contiguous in memory.
+  const T* row( int row ) const { return _mat.data() + row * N; }
+
+  T           det    ()                        const;
+  FixedMatrix inverse()                        const;
+  vector_type solve  ( const vector_type& b  ) const; // Solution of M x = b.
+  std::string dump   ()                        const;
+
+  const FixedMatrix& operator+=( const FixedMatrix& right );
+  const FixedMatrix& operator-=( const FixedMatrix& right );
+  const FixedMatrix& operator*=( const FixedMatrix& right );
+  const FixedMatrix& operator*=( const T&           right );
+
+  const FixedMatrix operator+( const FixedMatrix& right ) const { FixedMatrix mat( *this ); return mat += right; }
+  const FixedMatrix operator-( const FixedMatrix& right ) const { FixedMatrix mat( *this ); return mat -= right; }
+  const FixedMatrix operator*( const T&           right ) const { FixedMatrix mat( *this ); return mat *= right; }
+  const FixedMatrix operator*( const FixedMatrix& right ) const;
+  const vector_type operator*( const vector_type& right ) const;
+};
+
+
+
+template < class T, int N >
+FixedMatrix< T, N >::FixedMatrix( const Matrix< T >& mat )
+{
+  if ( mat.range() != N )
+    std::cerr << "The matrix does not have the right range. Copying the overlapping elements." << std::endl;
+
+  _mat.fill( T( 0. ) );
+
+  const int range = ( mat.range() < N ) ? mat.range() : N;
+  for ( int row = 0; row < range; ++row )
+    for ( int col = 0; col < range; ++col )
+      _mat[ row * N + col ] = mat( row, col );
+}
+
+
+template < class T, int N >
+int FixedMatrix< T, N >::decompose( std::array< int, N >& perm )
+{
+  int sign = 1;
+  for ( int row = 0; row < N; ++row )
+    perm[ row ] = row;
+
+  for ( int col = 0; col < N; ++col )
+  {
+    // Choose the largest pivot available in the column.
+    int pivot = col;
+    for ( int row = col + 1; row < N; ++row )
+      if ( std::norm( _mat[ row * N + col ] ) > std::norm( _mat[ pivot * N + col ] ) )
+        pivot = row;
+
+    if ( _mat[ pivot * N + col ] == T( 0. ) )
+      return 0;
+
+    if ( pivot != col )
+    {
+      for ( int elem = 0; elem < N; ++elem )
+        std::swap( _mat[ col * N + elem ], _mat[ pivot * N + elem ] );
+      std::swap( perm[ col ], perm[ pivot ] );
+      sign = -sign;
+    }
+
+    const T inv = T( 1. ) / _mat[ col * N + col ];
+    for ( int row = col + 1; row < N; ++row )
+    {
+      T& factor = _mat[ row * N + col ];
+      factor *= inv;
+      for ( int elem = col + 1; elem < N; ++elem )
+        _mat[ row * N + elem ] -= factor * _mat[ col * N + elem ];
+    }
+  }
+
+  return sign;
+}
+
+
+template < class T, int N >
+void FixedMatrix< T, N >::substitute( vector_type& b ) const
+{
+  // Forward substitution with the unit lower triangle.
+  for ( int row = 1; row < N; ++row )
+    for ( int col = 0; col < row; ++col )
+      b[ row ] -= _mat[ row * N + col ] * b[ col ];
+
+  // Backward substitution with the upper triangle.
+  for ( int row = N - 1; row >= 0; --row )
+  {
+    for ( int col = row + 1; col < N; ++col )
+      b[ row ] -= _mat[ row * N + col ] * b[ col ];
+    b[ row ] /= _mat[ row * N + row ];
+  }
+}
+
+
+template < class T, int N >
+T FixedMatrix< T, N >::det() const
+{
+  FixedMatrix< T, N >  lu( *this );
+  std::array< int, N > perm;
+
+  T result = T( lu.decompose( perm ) );
+  for ( int row = 0; row < N; ++row )
+    result *= lu._mat[ row * N + row ];
+
+  return result;
+}
+
+
+template < class T, int N >
+FixedMatrix< T, N > FixedMatrix< T, N >::inverse() const
+{
+  FixedMatrix< T, N >  lu( *this );
+  std::array< int, N > perm;
+
+  FixedMatrix< T, N > inv;
+  if ( ! lu.decompose( perm ) )
+  {
+    std::cerr << "This matrix has a null determinant and cannot be inverted. Returning zero matrix." << std::endl;
+    return inv;
+  }
+
+  // Solve for each column of the identity.
+  for ( int col = 0; col < N; ++col )
+  {
+    vector_type unit;
+    for ( int row = 0; row < N; ++row )
+      unit[ row ] = T( perm[ row ] == col ? 1. : 0. );
+
+    lu.substitute( unit );
+
+    for ( int row = 0; row < N; ++row )
+      inv._mat[ row * N + col ] = unit[ row ];
+  }
+
+  return inv;
+}
+
+
+template < class T, int N >
+typename FixedMatrix< T, N >::vector_type FixedMatrix< T, N >::solve( const vector_type& b ) const
+{
+  FixedMatrix< T, N >  lu( *this );
+  std::array< int, N > perm;
+
+  vector_type x;
+  if ( ! lu.decompose( perm ) )
+  {
+    std::cerr << "This matrix has a null determinant and the system cannot be solved. Returning zero vector." << std::endl;
+    x.fill( T( 0. ) );
+    return x;
+  }
+
+  for ( int row = 0; row < N; ++row )
+    x[ row ] = b[ perm[ row ] ];
+
+  lu.substitute( x );
+
+  return x;
+}
+
+
+template < class T, int N >
+std::string FixedMatrix< T, N >::dump() const
+{
+  std::ostringstream str;
+
+  for ( int row = 0; row < N; row++ )
+  {
+    str << "|";
+    for ( int col = 0; col < N; col++ )
+      str << "\t" << _mat[ row * N + col ];
+    str << "\t|" << std::endl;
+  }
+
+  return str.str();
+}
+
+
+template < class T, int N >
+const FixedMatrix< T, N >& FixedMatrix< T, N >::operator+=( const FixedMatrix< T, N >& right )
+{
+  for ( int elem = 0; elem < N * N; ++elem )
+    _mat[ elem ] += right._mat[ elem ];
+
+  return *this;
+}
+
+
+template < class T, int N >
+const FixedMatrix< T, N >& FixedMatrix< T, N >::operator-=( const FixedMatrix< T, N >& right )
+{
+  for ( int elem = 0; elem < N * N; ++elem )
+    _mat[ elem ] -= right._mat[ elem ];
+
+  return *this;
+}
+
+
+template < class T, int N >
+const FixedMatrix< T, N >& FixedMatrix< T, N >::operator*=( const FixedMatrix< T, N >& right )
+{
+  *this = *this * right;
+
+  return *this;
+}
+
+
+template < class T, int N >
+const FixedMatrix< T, N >& FixedMatrix< T, N >::operator*=( const T& right )
+{
+  for ( int elem = 0; elem < N * N; ++elem )
+    _mat[ elem ] *= right;
+
+  return *this;
+}
+
+
+template < class T, int N >
+const FixedMatrix< T, N > FixedMatrix< T, N >::operator*( const FixedMatrix< T, N >& right ) const
+{
+  FixedMatrix< T, N > mat;
+
+  // Accumulate whole rows of the right matrix, which are contiguous.
+  for ( int row = 0; row < N; ++row )
+    for ( int line = 0; line < N; ++line )
+    {
+      const T& left = _mat[ row * N + line ];
+      for ( int col = 0; col < N; ++col )
+        mat._mat[ row * N + col ] += left * right._mat[ line * N + col ];
+    }
+
+  return mat;
+}
+
+
+template < class T, int N >
+const typename FixedMatrix< T, N >::vector_type FixedMatrix< T, N >::operator*( const vector_type& right ) const
+{
+  vector_type vec;
+  vec.fill( T( 0. ) );
+
+  for ( int row = 0; row < N; ++row )
+    for ( int col = 0; col < N; ++col )
+      vec[ row ] += _mat[ row * N + col ] * right[ col ];
+
+  return vec;
+}
+
+
+#endif
@@ -6,12 +6,14 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
 
 #include <cfit/exceptions.hh>
 #include <cfit/variable.hh>
 #include <cfit/parameter.hh>
 #include <cfit/parameterexpr.hh>
 #include <cfit/operation.hh>
+#include <cfit/lookuptable.hh>
 
 
 class FunctionMinimum;
@@ -28,6 +30,22 @@ private:
   std::vector< std::string   > _varbs;
   std::vector< std::string   > _parms;
 
+  // Ranges and coefficients of the Chebyshev series in the expression.
+  std::vector< std::pair< double, double > > _ranges;
+  std::vector< std::vector< double >       > _series;
+
+  // Tables looked up in the expression, shared by the copies of the function.
+  std::vector< std::shared_ptr< const LookupTable > > _tables;
+
+  // Positional binding: index of each variable in the array passed to the
+  //    positional evaluate functions, value of each parameter in _parms and
+  //    maximum depth of the evaluation stack.
+  std::vector< unsigned      > _varIdx;
+  std::vector< double        > _parValues;
+  unsigned                     _depth;
+
+  void bindPars();
+
   void append( const double&        ctnt );
   void append( const Variable&      var  );
   void append( const Parameter&     par  );
@@ -36,8 +54,13 @@ private:
 
   void clear();
 
+  // Values of the Chebyshev series with index idx.
+  double series( const double& x,                        const std::size_t& idx ) const;
+  void   series(       double* x, const std::size_t& n, const std::size_t& idx ) const;
+
   template< class L, class R >
   Function( const L& left, const R& right, const Operation::Op& oper )
+    : _depth( 0 )
   {
     append( left  );
     append( right );
@@ -48,6 +71,7 @@ private:
 
   template< class T >
   Function( const T& var, const Operation::Op& oper )
+    : _depth( 0 )
   {
     append( var );
 
@@ -56,12 +80,20 @@ private:
   }
 
 public:
-  Function() {};
+  Function() : _depth( 0 ) {};
+
+  // Moving a function takes its expression instead of copying it.
+  Function( const Function& func ) = default;
+  Function( Function&&      func ) = default;
+
+  Function& operator=( const Function& func ) = default;
+  Function& operator=( Function&&      func ) = default;
 
   // Constructor from other objects.
   // arg could be a variable, parameter, parameter expression, or constant.
   template< class T >
   explicit Function( const T& arg )
+    : _depth( 0 )
   {
     append( arg );
   }
@@ -84,12 +116,20 @@ public:
   void setPars( const std::map< std::string, Parameter >& pars ) throw( PdfException );
   void setPars( const FunctionMinimum&                    pars ) throw( PdfException );
 
+  // Set the values of the parameters in alphabetical order.
+  void setValues( const std::vector< double >& values );
+
   // Getters.
   const std::map< std::string, Variable  >& getVarMap() const { return _varMap; }
   const std::map< std::string, Parameter >& getParMap() const { return _parMap; }
 
   const bool dependsOn( const std::string& varName ) const { return _varMap.count( varName ); };
 
+  // Everything that determines the function but the values of its parameters:
+  //    the expression with its operations, constants, variables and their bound
+  //    positions, names of the parameters, series and tables.
+  const std::string structure() const;
+
   const bool isFixed() const
   {
     bool fixed = true;
@@ -99,8 +139,20 @@ public:
     return fixed;
   }
 
+  // Bind the variables of the function to their positions in varNames, which
+  //    must contain all of them. It must be called before using the positional
+  //    evaluate functions, and again after the function has been modified.
+  void bind( const std::vector< std::string >& varNames ) throw( PdfException );
+  bool isBound() const { return _depth != 0; }
+
   double evaluate( const std::map< std::string, double >& varMap ) const throw( PdfException );
 
+  // Evaluate the function at the values in vars, given in the order of the bound names.
+  double evaluate( const double* vars ) const throw( PdfException );
+
+  // Evaluate the function at n points. vars holds one array of n values per bound name.
+  void evaluate( const std::vector< const double* >& vars, const std::size_t& n, double* out ) const throw( PdfException );
+
   // Assignment operators.
   template< class T > const Function& operator+=( const T& arg );
   template< class T > const Function& operator-=( const T& arg );
@@ -110,6 +162,20 @@ public:
   friend const Function pow( const Function& left, const double& right );
   friend const Function pow( const Variable& left, const double& right );
 
+  // Chebyshev series Sum( c_k T_k( t ) ), k = 0, ..., n - 1, of the argument,
+  //    where t maps [ lower, upper ] onto [ -1, 1 ]. It is evaluated in a single
+  //    step with Clenshaw's recurrence, e.g. for efficiency shapes,
+  //       Function eff = chebyshev( mSq12, coefs12, 0.3, 3.0 ) * chebyshev( mSq13, coefs13, 0.3, 3.0 );
+  friend const Function chebyshev( const Variable& arg, const std::vector< double >& coefs, const double& lower, const double& upper );
+  friend const Function chebyshev( const Function& arg, const std::vector< double >& coefs, const double& lower, const double& upper );
+
+  // Value of a table interpolated at the point given by two arguments, e.g. for
+  //    efficiencies given by histograms,
+  //       Function eff = lookup( mSq12, mSq13, table );
+  //    The positional evaluate functions look up all the points at once.
+  friend const Function lookup( const Variable& x, const Variable& y, const LookupTable& table );
+  friend const Function lookup( const Function& x, const Function& y, const LookupTable& table );
+
   // Binary operations that need access to this class.
   // Operations with variables with themselves.
   friend const Function operator+( const Variable&      left, const Variable&      right );
@@ -199,6 +265,11 @@ public:
 };
 
 
+// The friends above are only found through their arguments when one of them is
+//    a function, so the lookup of variables is also declared here.
+const Function lookup( const Variable& x, const Variable& y, const LookupTable& table );
+const Function lookup( const Function& x, const Function& y, const LookupTable& table );
+
 
 
 template< class T >
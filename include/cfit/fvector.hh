@@ -4,16 +4,19 @@
 #include <map>
 #include <vector>
 #include <complex>
+#include <string>
 #include <functional>
 
 #include <cfit/parameter.hh>
 #include <cfit/coef.hh>
 #include <cfit/exceptions.hh>
 #include <cfit/matrix.hh>
+#include <cfit/fixedmatrix.hh>
+#include <cfit/phasespace.hh>
+#include <cfit/propagatortable.hh>
 
 class Coef;
 class Amplitude;
-class PhaseSpace;
 
 class Fvector
 {
@@ -23,9 +26,11 @@ protected:
   unsigned  _resoB;      //
   unsigned  _noRes;      // Index of the non-resonant particle.
 
-  std::vector< double > _m0;  // K-matrix poles.
-  Matrix< double >      _g0;  // Base residue functions.
-  Matrix< double >      _fSc; // K-matrix background terms.
+  std::string _name;     // Name shown in the traces of its evaluation, if any.
+
+  std::vector< double >     _m0;  // K-matrix poles.
+  FixedMatrix< double, 5 >  _g0;  // Base residue functions.
+  FixedMatrix< double, 5 >  _fSc; // K-matrix background terms.
 
   double                _s0sc; // Pole of the resonant term (typically outside the phase space).
   double                _s0A;  // Adler pole (typically outside the phase space).
@@ -38,6 +43,26 @@ protected:
   std::vector< std::pair< std::string, std::string > > _fPr;  // Name of fPr elements.
   std::string                                          _s0pr; // Name of s0pr.
 
+  // Terms of the propagator that do not depend on the invariant mass, computed
+  //    when the poles are given or the parameters change: the squared pole masses,
+  //    g0( pole, row ) * g0( pole, col ) at [ ( pole * 5 + row ) * 5 + col ],
+  //    beta( pole ) * g0( pole, row ) at [ pole * 5 + row ], and the values of fPr and s0pr.
+  std::vector< double >                 _m0Sq;
+  std::vector< double >                 _poleTerms;
+  std::vector< std::complex< double > > _betaTerms;
+  std::vector< std::complex< double > > _fPrValues;
+  double                                _s0prValue;
+
+  void cachePoles();
+  void cacheCoefs();
+
+  // Table of the propagator, and phase space and tolerance to build it again.
+  PropagatorTable _table;
+  PhaseSpace      _tablePs;
+  double          _tableTolerance;
+
+  void buildTable();
+
   std::map< const std::string, Parameter > _parMap;
   std::vector< std::string >               _parOrder;
 
@@ -64,7 +89,7 @@ public:
            const double&                s0A  , const double&           sA   ,
            const std::vector< Coef >&   beta ,
            const std::vector< Coef >&   fPr  , const Parameter&        s0pr  )
-    : _m0( m0 ), _g0( g0 ), _fSc( fSc ), _s0sc( s0sc ), _s0A( s0A ), _sA( sA ), _usePvecSvp( true )
+    : _m0( m0 ), _g0( g0 ), _fSc( fSc ), _s0sc( s0sc ), _s0A( s0A ), _sA( sA ), _usePvecSvp( true ), _tableTolerance( 0. )
   {
     _resoA  = resoA;
     _resoB  = resoB;
@@ -73,13 +98,37 @@ public:
     pushBeta( beta );
     pushfPr ( fPr  );
     pushS0pr( s0pr );
+
+    cachePoles();
+    cacheCoefs();
   }
 
   ~Fvector() {};
 
+  // Name of the F vector, shown in the traces of its evaluation.
+  void               setName( const std::string& name ) { _name = name; }
+  const std::string& name()                       const { return _name; }
+  const char*        traceName()                  const { return _name.empty() ? "Fvector" : _name.c_str(); }
+
+  // Everything that determines the shape of the F vector: its pair, poles,
+  //    residues, background terms, P-vector, table and the values of its
+  //    production parameters.
+  const std::string structure() const;
+
   const bool isFixed() const;
 
-  void usePvecSvp( const bool& val = true ) { _usePvecSvp = val; }
+  void usePvecSvp( const bool& val = true ) { _usePvecSvp = val; if ( ! _table.empty() ) buildTable(); }
+
+  // Tabulate the propagator over the range of mSqAB allowed by the phase space, with
+  //    the given relative tolerance, as for resonances. A null tolerance removes the table.
+  void                   tabulate( const PhaseSpace& ps, const double& tolerance = 1e-6 );
+  const PropagatorTable& table()                                                 const { return _table; }
+
+  // Propagator at mSqAB, interpolated from the table if there is one.
+  std::complex< double > lookup( const PhaseSpace& ps, const double& mSqAB ) const
+  {
+    return _table.contains( mSqAB ) ? _table( mSqAB ) : propagator( ps, mSqAB );
+  }
 
   void pushBeta( const std::vector< Coef >& beta );
   void pushfPr ( const std::vector< Coef >& fPr  );
@@ -87,6 +136,9 @@ public:
 
   void setPars( const std::map< std::string, Parameter >& pars );
 
+  // Set the values of the parameters in alphabetical order.
+  void setValues( const std::vector< double >& values );
+
   // AB is the resonant pair, with A the first and B the second particle in the pair.
   //    Order is only relevant for the sign of the Zemach angular term for l = 1.
   // m2ij functions below select the squared invariant mass according to the given
@@ -108,6 +160,15 @@ public:
                                               const double&     mSqAC,
                                               const double&     mSqBC )                                       const;
 
+  // Values at ( mSq12, mSq13, mSq23 ) and at ( mSq13, mSq12, mSq23 ), which are
+  //    the same for an F vector in the pair 23.
+  void                   evaluatePair       ( const PhaseSpace&       ps   ,
+                                              const double&           mSq12,
+                                              const double&           mSq13,
+                                              const double&           mSq23,
+                                              std::complex< double >& dir  ,
+                                              std::complex< double >& cnj   )                                 const;
+
   virtual std::complex< double > propagator( const PhaseSpace& ps, const double& mSqAB ) const;
   virtual Fvector*               copy()                                                  const
     {
@@ -155,15 +216,18 @@ inline Fvector::Fvector( const char&                  resoA, const char&
                          const double&                s0A  , const double&           sA   ,
                          const std::vector< Coef >&   beta ,
                          const std::vector< Coef >&   fPr  , const Parameter&        s0pr  )
-  : _m0( m0 ), _g0( g0 ), _fSc( fSc ), _s0sc( s0sc ), _s0A( s0A ), _sA( sA ), _usePvecSvp( true )
+  : _m0( m0 ), _g0( g0 ), _fSc( fSc ), _s0sc( s0sc ), _s0A( s0A ), _sA( sA ), _usePvecSvp( true ), _tableTolerance( 0. )
 {
   _resoA  = std::tolower( resoA ) - 'a' + 1;
   _resoB  = std::tolower( resoB ) - 'a' + 1;
-  _noRes  = 6 - resoA - resoB;
+  _noRes  = 6 - _resoA - _resoB;
 
   pushBeta( beta );
   pushfPr ( fPr  );
   pushS0pr( s0pr );
+
+  cachePoles();
+  cacheCoefs();
 }
 
 
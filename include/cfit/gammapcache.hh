@@ -0,0 +1,27 @@
+#ifndef __GAMMAPCACHE_HH__
+#define __GAMMAPCACHE_HH__
+
+#include <map>
+#include <utility>
+
+#include <cfit/membermutex.hh>
+
+// Values of the regularized incomplete gamma function gamma_p( a, x ) that a
+//    pdf has computed since its parameters were last set, e.g. for the norm of
+//    the Argus family, whose areas are differences of gamma_p at the limits.
+//    Only a few of them are used between parameter changes, so the cache is
+//    kept small. It can be called from several threads at once, and copies
+//    get their own values.
+class GammaPCache
+{
+private:
+  std::map< std::pair< double, double >, double > _values;
+  MemberMutex                                      _lock;
+
+public:
+  const double operator()( const double& a, const double& x );
+
+  void clear();
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef __GRADIENTMINIMIZER_HH__
+#define __GRADIENTMINIMIZER_HH__
+
+#include <vector>
+
+#include <Minuit/FCNGradientBase.h>
+#include <Minuit/FunctionMinimum.h>
+
+#include <cfit/minimizer.hh>
+#include <cfit/exceptions.hh>
+
+// Minuit function that provides the gradient of a minimizer, so that Migrad uses
+//    it instead of estimating the derivatives by finite differences. It keeps its
+//    own copy of the minimizer, e.g.
+//       GradientMinimizer nll( Nll( pdf, data ) );
+//       FunctionMinimum   min = nll.minimize();
+class GradientMinimizer : public FCNGradientBase
+{
+private:
+  Minimizer* _minimizer;
+
+public:
+  GradientMinimizer( const Minimizer& minimizer )
+    : _minimizer( minimizer.copy() )
+  {}
+
+  GradientMinimizer( const GradientMinimizer& right )
+    : _minimizer( right._minimizer->copy() )
+  {}
+
+  ~GradientMinimizer()
+  {
+    delete _minimizer;
+  }
+
+  const Minimizer& minimizer() const { return *_minimizer; }
+
+  // Should be const double, but minuit declares these functions as double.
+  double up() const throw( MinimizerException ) { return _minimizer->up(); }
+
+  double operator()( const std::vector< double >& pars ) const throw( PdfException )
+  {
+    return (*_minimizer)( pars );
+  }
+
+  std::vector< double > gradient( const std::vector< double >& pars ) const throw( PdfException )
+  {
+    return _minimizer->gradient( pars );
+  }
+
+  // Number of threads used to evaluate the events, as in Minimizer::setThreads.
+  void setThreads( const unsigned& nThreads, const bool& numa = false ) { _minimizer->setThreads( nThreads, numa ); }
+  void verbose   ( const bool&     val = true  ) { _minimizer->verbose( val ); }
+
+  // Profiling of the fits, as in Minimizer::setProfiling.
+  void                   setProfiling( const bool& val = true, const bool& summary = false ) { _minimizer->setProfiling( val, summary ); }
+  const Minimizer::Stats stats() const { return _minimizer->stats(); }
+
+  // Sequence of Minuit calls run by minimize(), shared with the minimizer.
+  void             setConfig( const FitConfig& config ) { _minimizer->setConfig( config ); }
+  const FitConfig& config() const                       { return _minimizer->config();     }
+
+  FunctionMinimum minimize()                              const;
+  FunctionMinimum minimize( const FunctionMinimum& start ) const;
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef __LBFGS_HH__
+#define __LBFGS_HH__
+
+#include <vector>
+#include <functional>
+
+// Quasi-Newton minimisation with limited memory and box constraints, for
+//    functions with a gradient. The inverse of the hessian is approximated from
+//    the last steps, with the two-loop recursion of L-BFGS, so that each
+//    iteration costs a few vector operations per step kept instead of the update
+//    of a full covariance matrix of Migrad. Variables at a limit whose gradient
+//    points out of the box are held there, the others move along the projection
+//    of the direction, and the points of the backtracking line search are
+//    projected back into the box. The variables are measured in units of their
+//    scales, usually their expected errors, which is the first approximation of
+//    the inverse hessian.
+class Lbfgs
+{
+public:
+  typedef std::function< double( const std::vector< double >& ) >                function_type;
+  typedef std::function< std::vector< double >( const std::vector< double >& ) > gradient_type;
+
+  // Values of the variables at the minimum, the function there, the distance to
+  //    the minimum expected from the approximate hessian, and the number of calls
+  //    to the function and to its gradient.
+  struct Result
+  {
+    std::vector< double > values;
+    double                fval;
+    double                edm;
+    unsigned              nCalls;
+    bool                  converged;
+  };
+
+private:
+  unsigned _history;
+
+  // Direction - H grad, with H the approximate inverse hessian restricted to the
+  //    variables that are not held.
+  std::vector< double > direction( const std::vector< double >&                grad ,
+                                   const std::vector< bool >&                  held ,
+                                   const std::vector< std::vector< double > >& steps,
+                                   const std::vector< std::vector< double > >& diffs,
+                                   const double&                               gamma  ) const;
+
+public:
+  // Number of steps kept to approximate the inverse hessian.
+  Lbfgs( const unsigned& history = 10 ) : _history( history ) {}
+
+  // Minimum of function between lower and upper, which may be infinite, from
+  //    values. It stops when the expected distance to the minimum is below edm,
+  //    or after maxCalls calls to the function and its gradient.
+  Result minimize( const function_type&         function,
+                   const gradient_type&         gradient,
+                   const std::vector< double >& values  ,
+                   const std::vector< double >& lower   ,
+                   const std::vector< double >& upper   ,
+                   const std::vector< double >& scale   ,
+                   const double&                edm     ,
+                   const unsigned&              maxCalls  ) const;
+};
+
+#endif
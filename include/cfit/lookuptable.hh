@@ -0,0 +1,64 @@
+#ifndef __LOOKUPTABLE_HH__
+#define __LOOKUPTABLE_HH__
+
+#include <vector>
+#include <string>
+
+#include <cfit/exceptions.hh>
+
+// Function of two variables tabulated on a regular grid of bins, e.g. an
+//    efficiency histogram from simulation, interpolated between the centres
+//    of the bins. The values are stored contiguously, with the bins of y of
+//    each bin of x together, i.e. bin ( ix, iy ) at values[ ix * nBinsY + iy ].
+//    Beyond the outermost centres the table is continued with the values of
+//    its edges. It is used through functions, e.g.
+//       LookupTable table( 100, 0.3, 3.0, 100, 0.3, 3.0, values, LookupTable::bicubic );
+//       Decay3Body  pdf = Decay3Body( mSq12, mSq13, mSq23, amp, ps ) * lookup( mSq12, mSq13, table );
+//    The bicubic interpolation uses the Catmull-Rom spline through the 4 x 4
+//    closest centres, and is not allowed below zero where it overshoots.
+class LookupTable
+{
+public:
+  enum Interpolation { bilinear, bicubic };
+
+private:
+  unsigned              _nBinsX;
+  unsigned              _nBinsY;
+  double                _lowerX;
+  double                _lowerY;
+  double                _invStepX;
+  double                _invStepY;
+  std::vector< double > _values;
+  Interpolation         _interp;
+
+  // Position of x in units of bins from the first centre, limited to the centres,
+  //    split into the lower bin and the fraction of the way to the next one.
+  static void locate( const double& pos, const unsigned& nBins, int& bin, double& frac );
+
+  double bilinearAt( const double& x, const double& y ) const;
+  double bicubicAt ( const double& x, const double& y ) const;
+
+public:
+  LookupTable( const unsigned&              nBinsX,
+               const double&                lowerX,
+               const double&                upperX,
+               const unsigned&              nBinsY,
+               const double&                lowerY,
+               const double&                upperY,
+               const std::vector< double >& values,
+               const Interpolation&         interp = bilinear ) throw( PdfException );
+
+  const unsigned&              nBinsX() const { return _nBinsX; }
+  const unsigned&              nBinsY() const { return _nBinsY; }
+  const std::vector< double >& values() const { return _values; }
+
+  // Bins, ranges, interpolation and values, which determine the table.
+  const std::string structure() const;
+
+  double evaluate( const double& x, const double& y ) const;
+
+  // Values at n points. out may be the same array as x or y.
+  void evaluate( const double* x, const double* y, const std::size_t& n, double* out ) const;
+};
+
+#endif
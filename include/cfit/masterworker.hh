@@ -0,0 +1,94 @@
+#ifndef __MASTERWORKER_HH__
+#define __MASTERWORKER_HH__
+
+#ifdef MPI_ON
+
+#include <vector>
+
+#include <Minuit/FCNGradientBase.h>
+#include <Minuit/FunctionMinimum.h>
+
+#include <cfit/minimizer.hh>
+#include <cfit/exceptions.hh>
+
+// Minuit function for fits with MPI in which only the master process, rank 0,
+//    runs Minuit. The other processes wait in serve() for the requests of the
+//    master, each of which is a broadcast of its type and of the values of the
+//    parameters, and evaluate their piece of the minimizer, whose reduction
+//    gives the result to all of them. It keeps its own copy of the minimizer, e.g.
+//       MasterWorker fcn( Nll( pdf, data ) );
+//       if ( fcn.isMaster() )
+//       {
+//         FunctionMinimum min = fcn.minimize();
+//         fcn.shutdown();
+//       }
+//       else
+//         fcn.serve();
+//
+// With gradient set, Migrad also asks for the gradient of the minimizer instead
+//    of estimating the derivatives by finite differences.
+class MasterWorker : public FCNGradientBase
+{
+private:
+  // Type of the requests of the master process.
+  enum Request { valueRequest, gradientRequest, shutdownRequest };
+
+  Minimizer*    _minimizer;
+  bool          _gradient;
+  mutable bool  _shutdown; // Whether the workers have already been shut down.
+
+  // Send a request to the workers, with the values of the parameters if it needs them.
+  void request( const Request& type, const std::vector< double >& pars ) const;
+
+  FunctionMinimum minimize( const MnUserParameterState& start ) const;
+
+public:
+  MasterWorker( const Minimizer& minimizer, const bool& gradient = false )
+    : _minimizer( minimizer.copy() ), _gradient( gradient ), _shutdown( false )
+  {}
+
+  MasterWorker( const MasterWorker& right )
+    : _minimizer( right._minimizer->copy() ), _gradient( right._gradient ), _shutdown( right._shutdown )
+  {}
+
+  ~MasterWorker()
+  {
+    delete _minimizer;
+  }
+
+  const Minimizer& minimizer() const { return *_minimizer; }
+
+  // Whether this is the process that runs Minuit.
+  static bool isMaster();
+
+  // Should be const double, but minuit declares these functions as double.
+  double up() const throw( MinimizerException ) { return _minimizer->up(); }
+
+  // Evaluations on the master process, which are also requested to the workers.
+  double                operator()( const std::vector< double >& pars ) const throw( PdfException );
+  std::vector< double > gradient  ( const std::vector< double >& pars ) const throw( PdfException );
+
+  // Sequence of Minuit calls run by minimize(), shared with the minimizer.
+  void             setConfig( const FitConfig& config ) { _minimizer->setConfig( config ); }
+  const FitConfig& config() const                       { return _minimizer->config();     }
+
+  // Profiling of the fits on this process, as in Minimizer::setProfiling.
+  void                   setProfiling( const bool& val = true, const bool& summary = false ) { _minimizer->setProfiling( val, summary ); }
+  const Minimizer::Stats stats() const { return _minimizer->stats(); }
+
+  // Run the fit on the master process. If it throws, the workers are shut down
+  //    before the exception is passed on, so that they do not wait in serve().
+  FunctionMinimum minimize()                              const;
+  FunctionMinimum minimize( const FunctionMinimum& start ) const;
+
+  // Evaluate the requests of the master on a worker process, until it shuts them down.
+  void serve() const throw( PdfException );
+
+  // Tell the workers to leave serve(), once the master does not need them any
+  //    more. Only the first call sends the request.
+  void shutdown() const;
+};
+
+#endif
+
+#endif
@@ -1,6 +1,9 @@
 #ifndef __MATH_HH__
 #define __MATH_HH__
 
+#include <cstddef>
+#include <complex>
+
 class Math
 {
 private:
@@ -8,6 +11,10 @@ private:
   static const double gammastirf( const double& x  );
   static const double invnormal ( const double& y0 );
 
+  // Incomplete gamma integrals with the value of lngamma( a ) already computed.
+  static const double gamma_p   ( const double& a, const double& x, const double& lnga );
+  static const double gamma_q   ( const double& a, const double& x, const double& lnga );
+
 public:
   static const double erf       ( const double& x );
   static const double erfc      ( const double& x );
@@ -16,6 +23,41 @@ public:
   static const double gamma_q   ( const double& a, const double& x );
   static const double invgamma_q( const double& a, const double& y0 );
   static const double inverf    ( const double& x );
+
+  // The same functions on the n values of an array, with the same accuracy.
+  //    erf and erfc evaluate all the ranges of their rational approximations
+  //    and select the right one, without branches, so that their loops can be
+  //    vectorised. inverf does the same for the central range, which holds
+  //    most of the values, and evaluates the tails one at a time afterwards.
+  //    The series and continued fractions of the incomplete gamma integrals
+  //    take a number of iterations that depends on x, so they are evaluated
+  //    one at a time, but lngamma( a ) is only computed once. erf and erfc
+  //    can be evaluated in place, with out equal to x.
+  static void erf    ( const double* x, const std::size_t& n, double* out );
+  static void erfc   ( const double* x, const std::size_t& n, double* out );
+  static void gamma_p( const double& a, const double* x, const std::size_t& n, double* out );
+  static void gamma_q( const double& a, const double* x, const std::size_t& n, double* out );
+  static void inverf ( const double* x, const std::size_t& n, double* out );
+
+  // Chebyshev series Sum( c_k T_k( t ) ), k < nCoefs, with Clenshaw's recurrence,
+  //    at a single point and at n points. The array version runs the recurrence
+  //    over all the points at each order, and can be evaluated in place.
+  static const double chebyshev( const double* coefs, const std::size_t& nCoefs, const double& t );
+  static void         chebyshev( const double* coefs, const std::size_t& nCoefs,
+                                 const double* t, const std::size_t& n, double* out );
+
+  // Coefficients of the antiderivative of a Chebyshev series of nCoefs
+  //    coefficients, which has nCoefs + 1 of them and vanishes at t = 0.
+  static void chebyshevIntegral( const double* coefs, const std::size_t& nCoefs, double* integ );
+
+  // Discrete Fourier transform of n values in place, with n a power of 2, by the
+  //    radix-2 fast Fourier transform. The inverse transform is not divided by n.
+  static void fft( std::complex< double >* data, const std::size_t& n, const bool& inverse = false );
+
+  // Faddeeva function w( z ) = exp( - z^2 ) erfc( - i z ), with the rational approximation
+  //    of Weideman in the upper half plane and w( z ) = 2 exp( - z^2 ) - w( - z ) in the
+  //    lower one. erfc( z ) = exp( - z^2 ) w( i z ) for complex arguments.
+  static const std::complex< double > faddeeva( const std::complex< double >& z );
 };
 
 
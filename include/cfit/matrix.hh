@@ -22,6 +22,7 @@ public:
   ~Matrix();
 
   inline void setRange( int range );
+  int         range   () const { return _range; }
 
   T&          operator()( int row, int col ) const { return _mat[ row ][ col ]; }
   T           det       ()                   const;
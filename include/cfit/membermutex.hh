@@ -0,0 +1,41 @@
+#ifndef __MEMBERMUTEX_HH__
+#define __MEMBERMUTEX_HH__
+
+#include <mutex>
+#include <atomic>
+
+// Mutex of an object that guards what it computes lazily in its const members,
+//    e.g. caches of areas or the envelope used to generate, so that a single
+//    object can be evaluated by several threads at once. Unlike std::mutex it
+//    can be copied, and copies of the object get their own unlocked mutex.
+class MemberMutex : public std::mutex
+{
+public:
+  MemberMutex() {}
+  MemberMutex( const MemberMutex& ) : std::mutex() {}
+
+  MemberMutex& operator=( const MemberMutex& ) { return *this; }
+};
+
+
+// Flag that tells whether something computed lazily under a MemberMutex must be
+//    computed again. It is read without holding the mutex, so that it costs
+//    nothing once the value is there: test() acquires what was computed before
+//    clear() released it. Unlike std::atomic it can be copied, taking the state.
+class MemberFlag
+{
+private:
+  std::atomic< bool > _set;
+
+public:
+  MemberFlag( const bool& set = false ) : _set( set ) {}
+  MemberFlag( const MemberFlag& flag ) : _set( flag.test() ) {}
+
+  MemberFlag& operator=( const MemberFlag& flag ) { _set.store( flag.test(), std::memory_order_release ); return *this; }
+
+  bool test()  const { return _set.load( std::memory_order_acquire ); }
+  void set()         { _set.store( true , std::memory_order_release ); }
+  void clear()       { _set.store( false, std::memory_order_release ); }
+};
+
+#endif
@@ -2,23 +2,189 @@
 #define __MINIMIZER_HH__
 
 #include <vector>
+#include <string>
+#include <map>
+#include <functional>
+#include <memory>
+#include <chrono>
+#include <ostream>
 
 #include <Minuit/FCNBase.h>
 #include <Minuit/FunctionMinimum.h>
+#include <Minuit/MnUserParameters.h>
+#include <Minuit/MinosError.h>
+#include <Minuit/MnUserCovariance.h>
 
 #include <cfit/variable.hh>
 #include <cfit/dataset.hh>
 #include <cfit/pdfbase.hh>
+#include <cfit/threadpool.hh>
+#include <cfit/backend.hh>
+#include <cfit/fitconfig.hh>
+#include <cfit/arena.hh>
 
 
 class Minimizer : public FCNBase
 {
+  friend class CpuBackend;
+
+public:
+  // Fit at a point of a likelihood scan, with the scanned parameters fixed.
+  //    values holds the values of all the parameters at the minimum, in the
+  //    order of getPars().
+  struct ScanPoint
+  {
+    std::vector< double > point;
+    bool                  valid;
+    double                fval;
+    std::vector< double > values;
+  };
+
+  // Fit from one of the starting points of multiStart, with the values of all
+  //    the parameters at the start and at the minimum, in the order of getPars().
+  //    stopped tells whether it was stopped after the first stage.
+  struct StartFit
+  {
+    std::vector< double > start;
+    bool                  valid;
+    bool                  stopped;
+    double                fval;
+    std::vector< double > values;
+  };
+
+  // Counters and wall times, in seconds, of the fits run while profiling. update
+  //    is the time spent updating the pdf before each evaluation, usually to
+  //    compute its norm, loop that of the loops over the events, and reduce
+  //    that of the MPI reductions. components holds the time spent evaluating
+  //    each of the components of the pdf, e.g. the models of an expression,
+  //    summed over the threads that evaluate the events.
+  struct Stats
+  {
+    unsigned long         calls;
+    unsigned long         gradients;
+    double                cache;
+    double                fit;
+    double                update;
+    double                loop;
+    double                reduce;
+    std::vector< double > components;
+
+    Stats()
+      : calls    ( 0   ),
+        gradients( 0   ),
+        cache    ( 0.0 ),
+        fit      ( 0.0 ),
+        update   ( 0.0 ),
+        loop     ( 0.0 ),
+        reduce   ( 0.0 )
+    {}
+  };
+
 private:
   void cache();
 
+  // Record the wall time of a profiled fit and print its summary if requested.
+  void endFit( const double& time ) const;
+
+  // Number of events whose values are cached at once when spilling them to a file.
+  static const std::size_t _cacheChunk;
+
+  // Number of consecutive points of a row of a scan fitted one after the other.
+  static const std::size_t _scanChain;
+
+  // Copies of the minimizer that evaluate the shifted points of the numeric
+  //    derivatives, one per thread of the pool. They share the dataset and the
+  //    cached values, and are kept from one gradient to the next, so that each
+  //    one only computes again the parts of the norm that have changed.
+  struct Shifts
+  {
+    std::unique_ptr< ThreadPool >               pool;
+    std::vector< std::unique_ptr< Minimizer > > copies;
+  };
+
+  mutable std::unique_ptr< Shifts > _shifts;
+
+  // Step of the numeric derivative with respect to the parameter at position index.
+  double derivativeStep( const std::vector< double >& pars, const std::size_t& index ) const;
+
+  // Fits of the subsamples of config().progressive(), each from the minimum of
+  //    the previous one, and then of the whole dataset, from the given state.
+  FunctionMinimum progressive( const MnUserParameterState& start ) const;
+
+  // Scan of one parameter, if name2 is empty, or of two, from the given starting state.
+  std::vector< ScanPoint > scanGrid( const std::string&           name1  ,
+                                     const std::vector< double >& values1,
+                                     const std::string&           name2  ,
+                                     const std::vector< double >& values2,
+                                     const MnUserParameterState&  start    ) const throw( PdfException );
+
 protected:
-  PdfBase*      _pdf;
-  const Dataset _data;
+  // Values of the expressions cached by the pdf, stored contiguously slot after
+  //    slot. The values of cache index idxR[ k ] for all the events start at
+  //    element k * size of the dataset of valuesR, and analogously for complex
+  //    values. nR and nC are the numbers of cache indices handed out when they
+  //    were computed. The values are either kept in valuesR and valuesC or in
+  //    a file mapping, and realValues and complexValues point to them.
+  //
+  // In single precision, they are only kept in singleR and singleC, and the
+  //    values of the variables of the pdf in singleVars, in the same layout,
+  //    to be converted back to double precision block by block.
+  struct Cache
+  {
+    unsigned                              nR;
+    unsigned                              nC;
+    std::vector< unsigned >               idxR;
+    std::vector< unsigned >               idxC;
+    std::vector< double >                 valuesR;
+    std::vector< std::complex< double > > valuesC;
+    std::shared_ptr< const void >         mapping;
+    const double*                         realValues;
+    const std::complex< double >*         complexValues;
+    bool                                  single;
+    std::vector< float >                  singleVars;
+    std::vector< float >                  singleR;
+    std::vector< std::complex< float > >  singleC;
+  };
+
+  // Compute the values cached by the pdf chunk by chunk of the dataset, write
+  //    them to the cache file in the same layout as in memory and map them.
+  void spill( Cache& cache ) throw( PdfException );
+
+  // Hint that the events and cached values of a block are about to be read, or
+  //    that they have been read, when streaming.
+  void advise( const std::size_t& first, const std::size_t& n, const bool& prefetch ) const;
+
+  // Arena in which the copy of the pdf and all its models are allocated, such
+  //    that they lie in contiguous memory and are freed at once.
+  std::unique_ptr< Arena > _arena;
+  PdfBase*                 _pdf;
+
+  // Copy of the pdf allocated in the given arena.
+  static PdfBase* build( const PdfBase& pdf, Arena& arena )
+  {
+    const Arena::Scope scope( arena );
+    return pdf.copy();
+  }
+
+  // The dataset and the cached values never change once the minimizer has been
+  //    built, so they are shared by all its copies.
+  std::shared_ptr< const Dataset > _data;
+  std::shared_ptr< const Cache   > _cache;
+
+  // Factor that multiplies every sum over the events, the inverse of the fraction
+  //    of the events kept in a subsample, so that the function to minimize and its
+  //    derivatives estimate those of the whole dataset.
+  double _sampleScale;
+
+  // Keep only the given entries of the dataset, in increasing order, with the
+  //    values already cached for them. Minimizers that compute other quantities
+  //    from the events compute them again.
+  virtual void select( const std::vector< std::size_t >& entries ) throw( PdfException );
+
+  // Copy of the minimizer on the events whose uniform number drawn from the seed
+  //    and their position is below fraction. Its configuration runs neither
+  //    subsamples nor Hesse, and its pdf integrates the norm on fewer points.
+  Minimizer* subsample( const double& fraction, const unsigned& seed ) const throw( PdfException );
 
   // Minimizer variation to produce uncertaities at a given number of sigmas.
   //    Notice that, if the user wants n-sigma uncertainties, up = n^2.
@@ -26,39 +192,280 @@ protected:
 
   bool   _verbose;
 
-  // Maps of cached expressions.
-  std::map< unsigned, std::vector< double >                 > _cacheR;
-  std::map< unsigned, std::vector< std::complex< double > > > _cacheC;
+  // Sequence of Minuit calls run by minimize().
+  FitConfig _config;
+
+  // Pool of threads to evaluate blocks of events in parallel, if any.
+  ThreadPool* _pool;
+
+  // Backend that evaluates the pdf at all the events in sumBlocks.
+  std::unique_ptr< Backend > _backend;
+
+  // File to which the cached values are spilled, if any, and whether to stream
+  //    the events and the cached values from their files block by block.
+  std::string _cacheFile;
+  bool        _streaming;
+
+  // Whether to store the variables and the cached values in single precision.
+  bool        _single;
+
+  // Whether to count the calls and time the parts of each fit, whether to print
+  //    a summary of them at the end of minimize(), and the counters themselves.
+  //    The time spent caching the dataset is always measured.
+  bool          _profiling;
+  bool          _summary;
+  double        _cacheTime;
+  mutable Stats _stats;
+
+  // Adds the wall time spent in its scope to the given total, if not null.
+  class Timer
+  {
+  private:
+    double*                               _total;
+    std::chrono::steady_clock::time_point _start;
+
+  public:
+    Timer( double* total )
+      : _total( total )
+    {
+      if ( _total )
+        _start = std::chrono::steady_clock::now();
+    }
+
+    ~Timer()
+    {
+      if ( _total )
+        *_total += std::chrono::duration< double >( std::chrono::steady_clock::now() - _start ).count();
+    }
+  };
+
+  // Total to which to add the time of a part of the fit, or null if not profiling.
+  double* profiled( double& total ) const { return _profiling ? &total : 0; }
+
+  // Count a call to the function to minimize or to its gradient.
+  void count( unsigned long& calls ) const { if ( _profiling ) ++calls; }
+
+  // Update the pdf after setting its parameters, timing it if profiling.
+  void update() const
+  {
+    const Timer timer( profiled( _stats.update ) );
+    _pdf->update();
+  }
+
+  // Copies of the values of the variables of the pdf and of the cached values
+  //    for the events [ first, end ) of the blocks of a thread of a pinned
+  //    pool, in the same layouts as the columns and the cache. They are made
+  //    by the thread itself, so that their pages are on its own NUMA node.
+  struct Chunk
+  {
+    std::size_t                           first;
+    std::size_t                           end;
+    std::vector< double >                 vars;
+    std::vector< double >                 valuesR;
+    std::vector< std::complex< double > > valuesC;
+    std::vector< float >                  singleVars;
+    std::vector< float >                  singleR;
+    std::vector< std::complex< float > >  singleC;
+  };
+
+  // Chunks of the threads of the pool, null unless it is pinned.
+  std::shared_ptr< const std::vector< Chunk > > _chunks;
+
+  // Make the chunks of the threads of a pinned pool, for the current dataset and cache.
+  void place();
+
+  // Number of events passed to the pdf in each call to evaluateUnchecked.
+  static const std::size_t _blockSize;
+
+  // Set the pointers to the values of the variables in the given dataset
+  //    columns and to the cached values for the block of events that
+  //    starts at the given entry, taken from the chunk of the thread if any.
+  //    In single precision, they point to their values converted to double
+  //    precision in the given buffers.
+  void block( const std::vector< std::size_t >&                   columns,
+              const std::size_t&                                  first  ,
+              const Chunk*                                        chunk  ,
+              std::vector< const double*                 >&       vars   ,
+              std::vector< const double*                 >&       cacheR ,
+              std::vector< const std::complex< double >* >&       cacheC ,
+              std::vector< double                        >&       bufferR,
+              std::vector< std::complex< double >        >&       bufferC ) const;
+
+  // Contribution of a block of n events starting at entry first, given the values of the pdf at them.
+  typedef Backend::term_type term_type;
+
+  // Evaluate the pdf at all the events, block by block and possibly in several
+  //    threads, and sum the terms of all the blocks. The partial sums are added
+  //    in block order, so the result does not depend on the number of threads.
+  //    With shape, the values are those of the shape of a pdf that splits its
+  //    norm, which need not have been updated. If first is given, the calling
+  //    thread executes it while the other threads of the pool start on the blocks,
+  //    so that any MPI calls it makes stay on the calling thread. The sum is
+  //    computed by the backend of the minimizer.
+  double sumBlocks( const term_type& term, const bool& shape = false,
+                    const std::function< void() >& first = std::function< void() >() ) const throw( PdfException )
+  {
+    return _backend->sumBlocks( *this, term, shape, first );
+  }
+
+  // Implementation of sumBlocks of the default backend, on the threads of the pool.
+  double cpuSumBlocks( const term_type& term, const bool& shape, const std::function< void() >& first ) const throw( PdfException );
+
+  // Contribution of a block of n events to the derivative with respect to one
+  //    parameter, given the values of the pdf and of its derivative at them.
+  typedef std::function< double( const std::size_t& first, const std::size_t& n, const double* values, const double* derivs ) > grad_term_type;
+
+  // Analogous to sumBlocks, but using the analytic derivatives of the pdf. Returns
+  //    the sum of the terms for each of the parameters of the pdf flagged in requested,
+  //    and zero for the rest. cacheGradient must have been called on the pdf.
+  std::vector< double > sumGradientBlocks( const std::vector< bool >& requested,
+                                           const grad_term_type&      term       ) const throw( PdfException );
+
+  // Derivative with respect to the parameter at position index computed with
+  //    central finite differences, with a step of a thousandth of its error.
+  double numericDerivative( const std::vector< double >& pars, const std::size_t& index ) const throw( PdfException );
+
+  // Numeric derivatives with respect to the parameters flagged in requested,
+  //    written to their positions in grad. With config().gradThreads() other
+  //    than one, the two shifted points of all of them are evaluated at once
+  //    by that many copies of the minimizer, with the same steps, except with
+  //    MPI, whose reductions must be made in the same order by all processes.
+  void numericGradient( const std::vector< double >& pars     ,
+                        const std::vector< bool   >& requested,
+                        std::vector< double >&       grad       ) const throw( PdfException );
+
+  // Factors that multiply the outer product of the scores of the event at entry
+  //    in each of the matrices summed by sumScoreBlocks.
+  typedef std::function< void( const std::size_t& entry, double* factors ) > score_factor_type;
+
+  // Flags of the free parameters, after checking that the pdf provides analytic
+  //    derivatives with respect to all of them.
+  std::vector< bool > scoreParameters() const throw( PdfException );
+
+  // Sums over the events of the outer products of their scores, the derivatives
+  //    of log( pdf ) with respect to the parameters flagged in requested, times
+  //    each of the nMatrices factors given by factor, computed in the same pass
+  //    as sumGradientBlocks. Each matrix is returned in full, row after row, over
+  //    the requested parameters. cacheGradient must have been called on the pdf.
+  std::vector< std::vector< double > > sumScoreBlocks( const std::vector< bool >& requested,
+                                                       const std::size_t&         nMatrices,
+                                                       const score_factor_type&   factor     ) const throw( PdfException );
+
+  // Inverse of a symmetric positive definite matrix of size n, with its Cholesky decomposition.
+  static std::vector< double > invert( const std::vector< double >& matrix, const std::size_t& n ) throw( PdfException );
+
+  // Minuit covariance of the free parameters from a matrix over them.
+  static MnUserCovariance userCovariance( const std::vector< double >& matrix, const std::size_t& n );
 
 public:
   Minimizer( const PdfBase& pdf, const Dataset& data )
-    : _pdf    ( pdf.copy() ),
-      _data   ( data       ),
-      _up     ( -1.0       ),
-      _verbose( false      )
+    : _arena      ( new Arena() ),
+      _pdf        ( build( pdf, *_arena ) ),
+      _data       ( std::make_shared< const Dataset >( data ) ),
+      _sampleScale( 1.0        ),
+      _up         ( -1.0       ),
+      _verbose    ( false      ),
+      _pool       ( 0          ),
+      _backend    ( new CpuBackend() ),
+      _streaming  ( false      ),
+      _single     ( false      ),
+      _profiling  ( false      ),
+      _summary    ( false      ),
+      _cacheTime  ( 0.0        )
+  {
+    cache();
+  }
+
+  // Minimizer on the entries selected by a view, which are copied once.
+  Minimizer( const PdfBase& pdf, const DatasetView& data )
+    : _arena      ( new Arena() ),
+      _pdf        ( build( pdf, *_arena ) ),
+      _data       ( std::make_shared< const Dataset >( data ) ),
+      _sampleScale( 1.0        ),
+      _up         ( -1.0       ),
+      _verbose    ( false      ),
+      _pool       ( 0          ),
+      _backend    ( new CpuBackend() ),
+      _streaming  ( false      ),
+      _single     ( false      ),
+      _profiling  ( false      ),
+      _summary    ( false      ),
+      _cacheTime  ( 0.0        )
+  {
+    cache();
+  }
+
+  // Minimizer on a dataset shared with its owner, which is not copied.
+  Minimizer( const PdfBase& pdf, const std::shared_ptr< const Dataset >& data )
+    : _arena      ( new Arena() ),
+      _pdf        ( build( pdf, *_arena ) ),
+      _data       ( data       ),
+      _sampleScale( 1.0        ),
+      _up         ( -1.0       ),
+      _verbose    ( false      ),
+      _pool       ( 0          ),
+      _backend    ( new CpuBackend() ),
+      _streaming  ( false      ),
+      _single     ( false      ),
+      _profiling  ( false      ),
+      _summary    ( false      ),
+      _cacheTime  ( 0.0        )
   {
     cache();
   }
 
-  // Copy constructor.
+  // Copy constructor. The copy shares the dataset and the cached values.
   Minimizer( const Minimizer& minimizer )
-    : _pdf    ( minimizer._pdf->copy() ),
-      _data   ( minimizer._data        ),
-      _up     ( minimizer._up          ),
-      _verbose( minimizer._verbose     ),
-      _cacheR ( minimizer._cacheR      ),
-      _cacheC ( minimizer._cacheC      )
-    {}
+    : _arena      ( new Arena() ),
+      _pdf        ( build( *minimizer._pdf, *_arena ) ),
+      _data       ( minimizer._data        ),
+      _cache      ( minimizer._cache       ),
+      _sampleScale( minimizer._sampleScale ),
+      _up         ( minimizer._up          ),
+      _verbose    ( minimizer._verbose     ),
+      _config     ( minimizer._config      ),
+      _pool       ( minimizer._pool ? new ThreadPool( minimizer._pool->size(), minimizer._pool->pinned() ) : 0 ),
+      _backend    ( minimizer._backend->copy() ),
+      _cacheFile  ( minimizer._cacheFile   ),
+      _streaming  ( minimizer._streaming   ),
+      _single     ( minimizer._single      ),
+      _profiling  ( minimizer._profiling   ),
+      _summary    ( minimizer._summary     ),
+      _cacheTime  ( minimizer._cacheTime   ),
+      _chunks     ( minimizer._chunks      )
+  {
+    resetStats();
+  }
 
   virtual Minimizer* copy() const = 0;
 
   virtual ~Minimizer()
   {
     delete _pdf;
+    delete _pool;
   }
 
   const PdfBase& pdf()  const { return *_pdf; }
-  const Dataset& data() const { return _data; }
+  const Dataset& data() const { return *_data; }
+
+  const std::shared_ptr< const Dataset >& sharedData() const { return _data; }
+
+  // Replace the dataset, e.g. by the next toy sample, keeping the pdf and all
+  //    the quantities it has cached that do not depend on the events.
+  virtual void setData( const std::shared_ptr< const Dataset >& data );
+
+  // Append new events to the dataset, e.g. to fit again as they arrive. Only the
+  //    new events are cached by the pdf, and a fit may start again from the
+  //    previous minimum, e.g.
+  //       nll.append( events );
+  //       min = nll.minimize( min );
+  //    The dataset and the values already cached are copied, but never computed
+  //    again, unless they are spilled to a file or the pdf caches other values
+  //    for the new events, in which case all of them are cached again.
+  virtual void append( const Dataset& events ) throw( PdfException );
+
+  // Set the values of the parameters of the pdf, from which minimize() starts.
+  void setPars( const std::map< std::string, Parameter >& pars ) throw( PdfException ) { _pdf->setPars( pars ); }
 
   // Should be const double, but minuit declares these functions as double.
   double up() const throw( MinimizerException );
@@ -68,7 +475,150 @@ public:
   void setUp  ( const double& up         ) { _up      = up;  }
   void verbose( const bool&   val = true ) { _verbose = val; }
 
-  FunctionMinimum minimize() const;
+  void             setConfig( const FitConfig& config ) { _config = config; }
+  const FitConfig& config() const                       { return _config;   }
+
+  // Number of threads used to evaluate the events. Zero means as many as the
+  //    hardware supports. With numa, the threads are pinned to the cores that
+  //    the process may run on, each evaluates the same blocks at every call,
+  //    and the events and cached values of its blocks are copied to its own
+  //    NUMA node. On nodes with several sockets, one MPI process per socket,
+  //    bound to it, with one thread per core, keeps all the memory local.
+  void     setThreads( const unsigned& nThreads, const bool& numa = false );
+  unsigned threads() const { return _pool ? _pool->size() : 1; }
+
+  // Backend that evaluates the pdf at all the events to compute the function to
+  //    minimize, by default on the threads set by setThreads.
+  void           setBackend( const Backend& backend ) { _backend.reset( backend.copy() ); }
+  const Backend& backend() const                      { return *_backend; }
+
+  // Spill the values cached by the pdf to the given file, computing them chunk
+  //    by chunk of the dataset, and map them from it instead of keeping them in
+  //    memory. An empty name keeps them in memory again.
+  void setCacheFile( const std::string& file ) throw( PdfException );
+
+  // Whether to read ahead the events and cached values of the next blocks and to
+  //    let the kernel drop those already evaluated, for datasets mapped from a
+  //    file and spilled caches, so that the memory in use stays bounded.
+  void setStreaming( const bool& val = true ) { _streaming = val; }
+
+  // Whether to store the values of the variables of the pdf and those that it
+  //    caches in single precision, which halves the memory that they use and
+  //    that the event loop reads, while the pdf is still evaluated and the
+  //    terms summed in double precision. Values spilled to a file are kept in
+  //    double precision.
+  void setSinglePrecision( const bool& val = true );
+
+  // Whether to count the calls to the function to minimize and to its gradient,
+  //    and to measure the time spent in each part of them and in each of the
+  //    components of the pdf. With summary, minimize() prints the statistics
+  //    of each fit. Profiling also resets the statistics, which are otherwise
+  //    reset by each call to minimize(). When off, it only costs a branch per
+  //    call and per block of events.
+  void setProfiling( const bool& val = true, const bool& summary = false );
+
+  const Stats stats() const;
+  void        resetStats() const;
+  void        printStats( std::ostream& os ) const;
+
+  // Bytes of memory used by the dataset, the values cached for its events, the
+  //    chunks of the threads of a pinned pool and the structures of the pdf, by
+  //    name. Those mapped from a file are reported apart, since the kernel can
+  //    drop their pages. The dataset and the cache are shared by all the copies
+  //    of the minimizer, so they are only counted once by the process.
+  const std::map< std::string, std::size_t > memory() const;
+
+  // Gradient of the function to minimize. By default it is computed with finite differences.
+  virtual std::vector< double > gradient( const std::vector< double >& pars ) const throw( PdfException );
+
+  // Covariance of the free parameters at the given values of all of them, or
+  //    at a minimum, estimated from the scores of the events, in one pass over
+  //    the data instead of the second derivatives of Hesse, e.g.
+  //       MnUserParameterState state( min.userParameters(), nll.scoreCovariance( min ) );
+  //    It needs analytic derivatives of the pdf with respect to all the free
+  //    parameters, and is only provided by some minimizers.
+  virtual MnUserCovariance scoreCovariance( const std::vector< double >& pars ) const throw( PdfException );
+  MnUserCovariance         scoreCovariance( const FunctionMinimum&       min  ) const throw( PdfException );
+
+  // Minuit parameters built from those of the pdf.
+  MnUserParameters userParameters() const;
+
+  // Run the configured fit from the current values of the parameters of the pdf,
+  //    or from the state of a previous minimum, e.g. of a faster strategy. With
+  //    config().progressive(), the subsamples are fitted first, each one by a
+  //    copy of the minimizer that takes the values cached for its events, and
+  //    whose sums over them are scaled up to the whole dataset. Each fit starts
+  //    from the minimum and covariance of the previous one, if it was valid.
+  FunctionMinimum minimize()                              const;
+  FunctionMinimum minimize( const FunctionMinimum& start ) const;
+
+  // Run the configured fit of fcn, which is either this minimizer or a function
+  //    that evaluates it, from the given state, and profile it if requested.
+  template < class FCN >
+  FunctionMinimum fit( const FCN& fcn, const MnUserParameterState& start ) const;
+
+  // Minos errors of the given parameters, or of all the free ones if none are
+  //    given. The parameters are distributed over config().minosThreads() copies
+  //    of the minimizer, which share nothing but the minimum and evaluate the
+  //    events in a single thread each.
+  std::vector< MinosError > minos( const FunctionMinimum&            min          ,
+                                   const std::vector< std::string >& names = std::vector< std::string >() ) const throw( PdfException );
+
+  // Profile of the function to minimize over a grid of values of one or two
+  //    parameters, which are fixed at each point while all the other free
+  //    parameters are fitted again, from the current values of the parameters
+  //    or from a previous minimum. The points of each row of the grid, i.e. the
+  //    values of the second parameter for each value of the first one, are cut
+  //    in chains of consecutive points, each of which starts from the given
+  //    values and then from the minimum of the previous point. The chains are
+  //    distributed over config().scanThreads() copies of the minimizer, and
+  //    the result does not depend on their number. The points are returned in
+  //    the order of the grid.
+  std::vector< ScanPoint > scan( const std::string&           name  ,
+                                 const std::vector< double >& values  ) const throw( PdfException );
+  std::vector< ScanPoint > scan( const std::string&           name  ,
+                                 const std::vector< double >& values,
+                                 const FunctionMinimum&       start   ) const throw( PdfException );
+  std::vector< ScanPoint > scan( const std::string&           name1  ,
+                                 const std::vector< double >& values1,
+                                 const std::string&           name2  ,
+                                 const std::vector< double >& values2  ) const throw( PdfException );
+  std::vector< ScanPoint > scan( const std::string&           name1  ,
+                                 const std::vector< double >& values1,
+                                 const std::string&           name2  ,
+                                 const std::vector< double >& values2,
+                                 const FunctionMinimum&       start    ) const throw( PdfException );
+
+  // Configured fits from several starting points, e.g. to find the global minimum
+  //    of a likelihood with many local ones, each given by the values of all the
+  //    parameters in the order of getPars(). They are distributed over
+  //    config().startThreads() copies of the minimizer, which share the dataset
+  //    and the cached values. With config().setStartStage, the fits clearly worse
+  //    than the best one after a first stage are stopped. The fits are returned
+  //    from the smallest minimum to the largest, followed by the stopped ones.
+  std::vector< StartFit > multiStart( const std::vector< std::vector< double > >& starts ) const throw( PdfException );
+
+  // Fits from nStarts starting points drawn from the stream of the given seed
+  //    with the number of the start. The free parameters are uniform within
+  //    their limits, if they have them, or within width errors of their values.
+  std::vector< StartFit > multiStart( const std::size_t& nStarts, const unsigned& seed, const double& width = 5.0 ) const throw( PdfException );
 };
 
+
+
+template < class FCN >
+FunctionMinimum Minimizer::fit( const FCN& fcn, const MnUserParameterState& start ) const
+{
+  if ( ! _profiling )
+    return _config.minimize( fcn, start );
+
+  resetStats();
+
+  const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+  const FunctionMinimum min = _config.minimize( fcn, start );
+  endFit( std::chrono::duration< double >( std::chrono::steady_clock::now() - begin ).count() );
+
+  return min;
+}
+
 #endif
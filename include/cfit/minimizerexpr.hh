@@ -3,12 +3,21 @@
 
 #include <string>
 #include <vector>
+#include <memory>
 
 #include <Minuit/FCNBase.h>
 #include <Minuit/FunctionMinimum.h>
 
 #include <cfit/minimizer.hh>
-
+#include <cfit/threadpool.hh>
+
+// Sum of minimizers, e.g. the Nll of several datasets or categories with their
+//    own pdfs fitted simultaneously, with the parameters of the same name shared.
+//    The position of each parameter of each minimizer in the parameters of the
+//    sum is found once, when it is added. The minimizers, which each have their
+//    own copy of their pdf, can be evaluated in parallel with setThreads(), and
+//    the decay models that appear in several of them can share their norms with
+//    DecayModel::shareNorm(), so that they are only computed once.
 class MinimizerExpr : public FCNBase
 {
 private:
@@ -18,14 +27,25 @@ private:
   std::vector< const Minimizer* > _minimizers;
   std::map< std::string, Parameter > _parMap;
 
+  // Position in the parameters of the sum of each parameter of each minimizer.
+  std::vector< std::vector< std::size_t > > _indices;
+
+  // Threads that evaluate the minimizers.
+  std::shared_ptr< ThreadPool > _pool;
+
   void clear()
   {
     for ( std::vector< const Minimizer* >::iterator mmzr = _minimizers.begin(); mmzr != _minimizers.end(); ++mmzr )
       delete *mmzr;
 
-    _parMap.clear();
+    _minimizers.clear();
+    _parMap    .clear();
+    _indices   .clear();
   }
 
+  // Find the positions of the parameters of the minimizers.
+  void mapPars();
+
 public:
   MinimizerExpr()
     : _up( -1.0 ), _verbose( false )
@@ -43,6 +63,12 @@ public:
   void setUp  ( const double& up  ) { _up      = up;  }
   void verbose( const bool&   val ) { _verbose = val; }
 
+  // Number of threads that evaluate the minimizers at the same time. Zero means
+  //    as many as the hardware supports, and one evaluates them in turn, which is
+  //    always the case with MPI.
+  void     setThreads( const unsigned& nThreads );
+  unsigned threads() const { return _pool ? _pool->size() : 1; }
+
   double operator()( const std::vector< double >& par ) const throw( PdfException );
 
   FunctionMinimum minimize() const;
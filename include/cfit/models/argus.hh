@@ -7,6 +7,7 @@
 #include <cfit/variable.hh>
 #include <cfit/parameter.hh>
 #include <cfit/pdfmodel.hh>
+#include <cfit/gammapcache.hh>
 
 
 class Argus : public PdfModel
@@ -22,6 +23,9 @@ private:
 
   double _norm;
 
+  // Intended to cache the incomplete gamma integrals gamma_p( a, x ).
+  mutable GammaPCache _gammaP;
+
   void setParExpr();
 
 public:
@@ -46,7 +50,15 @@ public:
   const double evaluate( const double& x                   ) const throw( PdfException );
   const double evaluate( const std::vector< double >& vars ) const throw( PdfException );
 
+  // Evaluate a block of events, with the values of the parameters computed once.
+  void evaluateBlock( const std::vector< const double*                 >& vars  ,
+                      const std::vector< const double*                 >& cacheR,
+                      const std::vector< const std::complex< double >* >& cacheC,
+                      const std::size_t&                                  n     ,
+                      double*                                             out    ) const throw( PdfException );
+
   const double area( const double& min, const double& max ) const throw( PdfException );
+  void         areas( const double* min, const double* max, const std::size_t& n, double* out ) const throw( PdfException );
 };
 
 #endif
@@ -0,0 +1,79 @@
+#ifndef __CHEBYSHEV_HH__
+#define __CHEBYSHEV_HH__
+
+#include <vector>
+#include <cmath>
+
+#include <cfit/variable.hh>
+#include <cfit/parameter.hh>
+#include <cfit/pdfmodel.hh>
+
+
+// Polynomial in the basis of Chebyshev polynomials of the first kind,
+//    ( 1 + Sum( c_k T_k( t ) ) ) / norm, k = 1, ..., n, where t maps the
+//    range between the lower and upper limits onto [ -1, 1 ]. It is evaluated
+//    with Clenshaw's recurrence, which keeps it stable at high order, and it is
+//    zero outside the limits, which must be defined.
+class Chebyshev : public PdfModel
+{
+private:
+  std::vector< ParameterExpr > _coefs;
+
+  bool   _hasLower;
+  bool   _hasUpper;
+  double _lower;
+  double _upper;
+
+  double _norm;
+
+  // Coefficients of the whole series, including the constant term.
+  const std::vector< double > series() const;
+
+  // Antiderivative in t of the series.
+  const std::vector< double > integral() const;
+
+  void setParExpr();
+
+public:
+  Chebyshev( const Variable& x, const Parameter& c1 );
+  Chebyshev( const Variable& x, const Parameter& c1, const Parameter& c2 );
+  Chebyshev( const Variable& x, const std::vector< Parameter >& coefs );
+
+  Chebyshev( const Variable& x, const ParameterExpr& c1 );
+  Chebyshev( const Variable& x, const ParameterExpr& c1, const ParameterExpr& c2 );
+  Chebyshev( const Variable& x, const std::vector< ParameterExpr >& coefs );
+
+  Chebyshev* copy() const;
+
+  // Getters.
+  double coef( const unsigned& index ) const;
+
+  void setLowerLimit  ( const double& lower );
+  void setUpperLimit  ( const double& upper );
+  void setLimits      ( const double& lower, const double& upper );
+
+  void cache();
+
+  const double evaluate( const double& x                   ) const throw( PdfException );
+  const double evaluate( const std::vector< double >& vars ) const throw( PdfException );
+
+  // Evaluate a block of events, with the recurrence run over the whole block at each order.
+  void evaluateBlock( const std::vector< const double*                 >& vars  ,
+                      const std::vector< const double*                 >& cacheR,
+                      const std::vector< const std::complex< double >* >& cacheC,
+                      const std::size_t&                                  n     ,
+                      double*                                             out    ) const throw( PdfException );
+
+  void check( const std::size_t& nVars ) const throw( PdfException );
+
+  void evaluateUnchecked( const std::vector< const double*                 >& vars  ,
+                          const std::vector< const double*                 >& cacheR,
+                          const std::vector< const std::complex< double >* >& cacheC,
+                          const std::size_t&                                  n     ,
+                          double*                                             out    ) const;
+
+  const double area    ( const double& min, const double& max ) const throw( PdfException );
+  void         areas   ( const double* min, const double* max, const std::size_t& n, double* out ) const throw( PdfException );
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef __CONVOLUTION_HH__
+#define __CONVOLUTION_HH__
+
+#include <vector>
+#include <map>
+#include <string>
+
+#include <cfit/variable.hh>
+#include <cfit/pdfmodel.hh>
+
+
+// Numerical convolution of a pdf of a single variable x with a resolution
+//    model, ( f * g )( x ) = Int f( x - u ) g( u ) du, normalized between the
+//    lower and upper limits. The resolution model is a pdf of a single variable,
+//    which is evaluated at the differences u.
+//
+// Both models are averaged in the bins of a grid of nBins bins between the
+//    limits, padded on both sides by padding times the width of the range,
+//    and with a size rounded up to a power of 2. The convolution is computed with fast Fourier
+//    transforms in O( N log N ) operations, whenever cache() is called, i.e.
+//    only when the parameters change, and interpolated linearly between the
+//    centres of the bins for every event. The resolution must be negligible
+//    beyond the padding, since the convolution on the grid is circular.
+class Convolution : public PdfModel
+{
+private:
+  PdfModel* _pdf;
+  PdfModel* _resolution;
+
+  double   _lower;
+  double   _upper;
+  unsigned _nBins;
+  double   _padding;
+
+  // Grid of the convolution: bin width, bins before the lower limit,
+  //    values at the centres of the bins and integrals of the linear
+  //    interpolation up to each centre.
+  double                _step;
+  std::size_t           _offset;
+  std::vector< double > _values;
+  std::vector< double > _integrals;
+
+  double _norm;
+
+  // Integral of the linear interpolation of the grid up to x.
+  const double integral( const double& x ) const;
+
+  void setParExpr();
+
+public:
+  Convolution( const Variable& x, const PdfModel& pdf, const PdfModel& resolution,
+               const double& lower, const double& upper,
+               const unsigned& nBins = 1024, const double& padding = 0.25 ) throw( PdfException );
+
+  Convolution( const Convolution& right );
+  ~Convolution();
+
+  const Convolution& operator=( const Convolution& right );
+
+  Convolution* copy() const;
+
+  void setLimits( const double& lower, const double& upper );
+
+  void cache();
+
+  const double evaluate( const double& x                   ) const throw( PdfException );
+  const double evaluate( const std::vector< double >& vars ) const throw( PdfException );
+
+  // Evaluate a block of events, interpolating the grid computed by cache().
+  void evaluateBlock( const std::vector< const double*                 >& vars  ,
+                      const std::vector< const double*                 >& cacheR,
+                      const std::vector< const std::complex< double >* >& cacheC,
+                      const std::size_t&                                  n     ,
+                      double*                                             out    ) const throw( PdfException );
+
+  const double area( const double& min, const double& max ) const throw( PdfException );
+
+  const std::map< std::string, std::size_t > memory() const;
+};
+
+#endif
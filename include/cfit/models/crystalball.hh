@@ -24,10 +24,24 @@ private:
 
   double _norm;
 
+  // Constants of the shape, computed by cache(). In terms of
+  //    chi = sign( alpha ) ( x - mu ) / sigma, the unnormalized pdf is
+  //    exp( - chi^2 / 2 ) in the core, chi >= - |alpha|, and
+  //    A ( B - chi )^-n in the tail, with A = ( n / |alpha| )^n exp( - alpha^2 / 2 )
+  //    and B = n / |alpha| - |alpha|.
+  double _vmu;
+  double _scale;
+  double _absAlpha;
+  double _vn;
+  double _tailA;
+  double _tailB;
+  double _invNorm;
+
   const double cumulativeNorm( const double& x ) const;
 
-  const double core( const double& x ) const;
-  const double tail( const double& x ) const;
+  // Value of the pdf at x within the limits, blending the core and the tail
+  //    without branches, so that loops over events can be vectorised.
+  double shape( const double& x ) const;
 
   void setParExpr();
 
@@ -59,9 +73,17 @@ public:
   const double evaluate( const double& x                   ) const throw( PdfException );
   const double evaluate( const std::vector< double >& vars ) const throw( PdfException );
 
+  // Evaluate a block of events, with the constants of the shape computed by cache().
+  void evaluateBlock( const std::vector< const double*                 >& vars  ,
+                      const std::vector< const double*                 >& cacheR,
+                      const std::vector< const std::complex< double >* >& cacheC,
+                      const std::size_t&                                  n     ,
+                      double*                                             out    ) const throw( PdfException );
+
   const double area    ( const double& min, const double& max ) const throw( PdfException );
 
   const std::map< std::string, double > generate() const throw( PdfException );
+  using PdfBase::generate;
 };
 
 #endif
@@ -3,10 +3,14 @@
 
 #include <vector>
 #include <complex>
+#include <utility>
+#include <memory>
+#include <string>
 
 #include <cfit/variable.hh>
 #include <cfit/parameter.hh>
 #include <cfit/pdfmodel.hh>
+#include <cfit/threadpool.hh>
 
 #include <cfit/models/d0mix/dalitzReso.hh>
 
@@ -29,17 +33,46 @@ private:
   // Parameter of CPV in the mixing (q/p).
   std::complex< double > _qp;
 
-  DalitzReso* _reso; // Resonances.
+  std::vector< DalitzReso > _reso; // Resonances.
 
   // Booleans to control if direct and crossed matrices should be computed at each iteration.
-  bool  _propagatorsFixed; // True if all the propagators are fixed.
-  bool  _integralsFixed;   // True if all amplitudes and propagators are fixed.
-  bool* _unfixed;          // Propagators that may vary in minuit iterations.
-  bool* _conjOfPrevious;   // True if a resonance is the conjugate of the previous one (e.g. K*+ after K*-).
-
-  // Direct and crossed matrices to compute the norm of the pdf with splitting.
-  std::complex< double >** _Id;
-  std::complex< double >** _Ix;
+  bool                _propagatorsFixed; // True if all the propagators are fixed.
+  bool                _integralsFixed;   // True if all amplitudes and propagators are fixed.
+  std::vector< bool > _unfixed;          // Propagators that may vary in minuit iterations.
+  std::vector< bool > _conjOfPrevious;   // True if a resonance is the conjugate of the previous one (e.g. K*+ after K*-).
+
+  // Direct and crossed matrices to compute the norm of the pdf with splitting,
+  //    whether they have been computed, and file where those of fixed
+  //    propagators are saved to be read by later jobs.
+  std::vector< std::vector< std::complex< double > > > _Id;
+  std::vector< std::vector< std::complex< double > > > _Ix;
+  bool                                                 _cached;
+  std::string                                          _normFile;
+
+  // Description of everything the matrices depend on: the masses, the grid and
+  //    the values of the parameters of the propagators.
+  const std::string fileKey() const;
+
+  // Read the matrices from the file if it was written with the same key, or write them to it.
+  bool loadMatrices( const std::string& key );
+  void saveMatrices( const std::string& key ) const;
+
+  // Bins in m2AC of the points of the integration grid inside the Dalitz plot,
+  //    and first point of each bin in m2AB, filled by the first computation of
+  //    the matrices. The values of the resonances at these points, as given and
+  //    with swapped invariant masses, are kept, so that only those that may
+  //    vary are evaluated again. They, and the matrices, are only written by
+  //    the constructor and by cache(), never by the const members that may run
+  //    in several threads at once.
+  std::vector< int >                    _gridBinY;
+  std::vector< std::size_t >            _gridRow;
+  std::vector< std::complex< double > > _gridA;
+  std::vector< std::complex< double > > _gridABar;
+
+  // Threads that compute the rows of the integration grid. The pool is only
+  //    created by the first computation that is not the last one, i.e. if some
+  //    propagators may vary, and copies of the model create their own.
+  std::unique_ptr< ThreadPool > _pool;
 
   // Integrals over the Dalitz plot.
   std::complex< double > _i1;
@@ -48,11 +81,11 @@ private:
   // Value of the norm (cached after setPars).
   double _norm;
 
-  // Variables of the model.
-  double m2AB() const { return getVar( 0 ).value(); }
-  double m2AC() const { return getVar( 1 ).value(); }
-  double m2BC() const { return pow( _mD0, 2 ) + pow( _mKs, 2 ) + 2. * pow( _mPi, 2 ) - m2AB() - m2AC(); }
-  double t()    const { return getVar( 2 ).value(); }
+  // Squared invariant mass of the pair BC, given those of AB and AC.
+  static double m2BC( const double& m2AB, const double& m2AC )
+  {
+    return pow( _mD0, 2 ) + pow( _mKs, 2 ) + 2. * pow( _mPi, 2 ) - m2AB - m2AC;
+  }
 
   // Parameters of the model.
   double invGamma()    const { return getPar(  0 ).value(); }
@@ -122,36 +155,38 @@ private:
 
   std::complex< double > evaluateReso( int index, double m2AB, double m2AC, double m2BC ) const;
   std::complex< double > coef        ( int index ) const;
-  void cacheIntegralsMatrix( bool all = false ) const;
+  void cacheIntegralsMatrix( bool all = false );
   void cacheDalitzIntegrals();
 
   //std::pair< Complex, Complex > matrixElements( int x, int y ) const;
 
-  // < f | H | D^0 (t) > = 1/2 * [ ( 1 + \chi_f ) * A_f * e_1(gt) + ( 1 - \chi_f ) * A_f * e_2(gt) ]
-  std::complex< double > e1( const double& gt ) const;
-  std::complex< double > e2( const double& gt ) const;
+  void setParExpr() {}
+
+  DalitzD0mix& operator=( const DalitzD0mix& );
 
 public:
+  // The variables are m2AB, m2AC and the decay time, in this order.
   DalitzD0mix( const std::vector< Variable >& vars, const std::vector< Parameter >& pars );
 
+  // Copies have their own values at the grid points and matrices, but no threads.
+  DalitzD0mix( const DalitzD0mix& right );
+
+  DalitzD0mix* copy() const { return new DalitzD0mix( *this ); }
+
+  // File where the matrices of integrals are saved the first time they are
+  //    computed, and read from by later jobs with the same propagators. It is
+  //    only used if all the propagators are fixed. An empty name disables it.
+  void               setNormFile( const std::string& file ) { _normFile = file; }
+  const std::string& normFile() const                       { return _normFile; }
+
   static const double& mPi() { return _mPi; }
   static const double& mKs() { return _mKs; }
   static const double& mD0() { return _mD0; }
 
-  void cache()
-  {
-    // Compute the terms of the matrices of integrals (Id and Ix) that need recalculation.
-    if ( ! _propagatorsFixed )
-      cacheIntegralsMatrix();
-
-    // Compute the integrals I_1 and I_\chi if the amplitudes are constant.
-    if ( ! _integralsFixed )
-      cacheDalitzIntegrals();
-
-    _norm = norm();
-  }
-  double evaluate()                                    const throw( PdfException );
-  double evaluate( const std::vector< double >& vars ) const throw( PdfException );
+  // The matrices and integrals are computed at the first call, and then again
+  //    only if they may vary.
+  void cache();
+  const double evaluate( const std::vector< double >& vars ) const throw( PdfException );
 
   double norm() const;
 };
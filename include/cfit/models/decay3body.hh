@@ -2,10 +2,14 @@
 #define __DECAY3BODY_HH__
 
 #include <vector>
+#include <memory>
 
 #include <cfit/decaymodel.hh>
 #include <cfit/variable.hh>
 #include <cfit/amplitude.hh>
+#include <cfit/dalitzintegrator.hh>
+#include <cfit/dalitzenvelope.hh>
+#include <cfit/membermutex.hh>
 #include <cfit/phasespace.hh>
 #include <cfit/function.hh>
 
@@ -17,19 +21,56 @@ class Decay3Body : public DecayModel< Amplitude >
 private:
   double _norm;
 
-  // Maximum value of the pdf.
-  double _maxPdf;
+  // Whether _norm has to be computed before it is used. Building the model,
+  //    multiplying it by a function or changing the points of the norm only
+  //    mark it, so that it is computed once, at the first update of a minimizer
+  //    or at the first evaluation.
+  MemberFlag _stale;
 
-  const double evaluateFuncs( const double& mSq12, const double& mSq13, const double& mSq23 ) const;
+  const double& norm() const;
 
-  // Auxiliary function to compute the center of a bin.
-  static const double binCenter( const unsigned& bin, const unsigned& nbins, const double& min, const double& max )
-  {
-    return ( max - min ) / double( nbins ) * ( bin + 0.5 ) + min;
-  }
+  // Mark the norm to be computed again. With MPI it is reduced over the rows of
+  //    all the processes, so it is computed at once instead, while all of them
+  //    build or change the model, rather than by whichever evaluates it first.
+  void staleNorm();
+
+  void invalidateNorm() { invalidate(); staleNorm(); }
+
+  // Upper bound of the pdf for the generation. Unless a flat one is set by
+  //    hand, it is an envelope that follows the pdf, which is only built again
+  //    after the parameters change.
+  double                                          _maxPdf;
+  bool                                            _autoMax;
+  mutable std::shared_ptr< const DalitzEnvelope > _envelope;
+
+  // Guard the norm computed at the first evaluation and the envelope, so that
+  //    const members can be called from several threads. They are apart, since
+  //    the envelope is built by evaluating the pdf, which may compute the norm.
+  mutable MemberMutex                             _normLock;
+  mutable MemberMutex                             _envelopeLock;
+
+  // Derivatives of the norm with respect to the parameters in the gradient of
+  //    the amplitude, and index in it of each of the parameters of the pdf.
+  std::vector< double > _normGrad;
+  std::vector< int    > _gradIdx;
+
+  // Whether the kinematics of the resonances are cached for the events, and index
+  //    of their first column.
+  bool     _cacheKin;
+  unsigned _kinCache;
 
   void setParExpr() {}
 
+  const std::map< unsigned, std::vector< double > > cacheReal( const Dataset& data );
+
+  // Index of a variable of the pdf, or -1 if the pdf does not depend on it.
+  int varIndex( const std::string& varName ) const;
+
+  // Values of the pdf at n points. If atNormPoints is set, the efficiency is
+  //    applied as in the norm, i.e. not if the norm sample already includes it.
+  void evaluatePdf( const double* mSq12, const double* mSq13, const double* mSq23,
+                    const std::size_t& n, double* out, const bool& atNormPoints = false ) const throw( PdfException );
+
 public:
   Decay3Body( const Variable&   mSq12,
 	      const Variable&   mSq13,
@@ -39,16 +80,87 @@ public:
 
   Decay3Body* copy() const;
 
+  // Bytes of memory of the caches of the norm and of the envelope of the pdf.
+  const std::map< std::string, std::size_t > memory() const;
+
   void cache();
   const double evaluate( const double& mSq12, const double& mSq13, const double& mSq23 ) const throw( PdfException );
   const double evaluate( const double& mSq12, const double& mSq13                      ) const throw( PdfException );
   const double evaluate( const std::vector< double >& vars                             ) const throw( PdfException );
 
+  void evaluateBlock( const std::vector< const double*                 >& vars  ,
+                      const std::vector< const double*                 >& cacheR,
+                      const std::vector< const std::complex< double >* >& cacheC,
+                      const std::size_t&                                  n     ,
+                      double*                                             out    ) const throw( PdfException );
+
+  void check( const std::size_t& nVars ) const throw( PdfException );
+
+  void evaluateUnchecked( const std::vector< const double*                 >& vars  ,
+                          const std::vector< const double*                 >& cacheR,
+                          const std::vector< const std::complex< double >* >& cacheC,
+                          const std::size_t&                                  n     ,
+                          double*                                             out    ) const;
+
+  // The squared modulus of the amplitude times the efficiency does not depend on
+  //    the norm, so it can be evaluated while the norm is being computed.
+  bool splitsNorm() const { return true; }
+
+  void evaluateShape( const std::vector< const double*                 >& vars  ,
+                      const std::vector< const double*                 >& cacheR,
+                      const std::vector< const std::complex< double >* >& cacheC,
+                      const std::size_t&                                  n     ,
+                      double*                                             out    ) const;
+
+  const double normFactor() const { return norm(); }
+
+  // Analytic derivatives with respect to the coefficients of the amplitude.
+  bool hasGradient( const std::string& par ) const;
+  void cacheGradient() throw( PdfException );
+  void evaluateGradient( const std::vector< const double*                 >& vars  ,
+                         const std::vector< const double*                 >& cacheR,
+                         const std::vector< const std::complex< double >* >& cacheC,
+                         const std::size_t&                                  n     ,
+                         double*                                             out   ,
+                         const std::vector< double*                       >& grad   ) const throw( PdfException );
+
   const double project ( const std::string& varName, const double& value ) const throw( PdfException );
 
-  void setMaxPdf( const double& max ) { _maxPdf = max; }
+  // Batched projections. The histograms are filled in a single pass over the
+  //    points on which the norm is computed.
+  void projectBlock( const std::string& varName,
+                     const double*      values ,
+                     const std::size_t& n      ,
+                     double*            out      ) const throw( PdfException );
+
+  void projectHist( const std::string& varName,
+                    const double&      min    ,
+                    const double&      max    ,
+                    const unsigned&    nBins  ,
+                    double*            out      ) const throw( PdfException );
+  void projectHist( const std::string& var1  ,
+                    const double&      min1  ,
+                    const double&      max1  ,
+                    const unsigned&    nBins1,
+                    const std::string& var2  ,
+                    const double&      min2  ,
+                    const double&      max2  ,
+                    const unsigned&    nBins2,
+                    double*            out     ) const throw( PdfException );
+
+  // Do not hide the other projection members defined in PdfBase.
+  using PdfBase::projectBlock;
+
+  // Flat upper bound of the pdf for the generation, i.e. uniform proposals over
+  //    the Dalitz plot, which is still raised if any value above it is found.
+  void setMaxPdf( const double& max ) { _maxPdf = max; _autoMax = false; _envelope.reset(); }
+
   const std::map< std::string, double > generate() const throw( PdfException );
 
+  // Generate n events at once, distributed according to the pdf.
+  void generate( const std::size_t& n, double* mSq12, double* mSq13, double* mSq23 ) const throw( PdfException );
+  void generate( const std::size_t& n, Dataset& data                               ) const throw( PdfException );
+
   friend const Decay3Body  operator* (       Decay3Body left, const Function&  right );
   friend const Decay3Body  operator* ( const Function&  left,       Decay3Body right );
   const        Decay3Body& operator*=( const Function& right ) throw( PdfException );
@@ -8,6 +8,7 @@
 #include <cfit/variable.hh>
 #include <cfit/amplitude.hh>
 #include <cfit/phasespace.hh>
+#include <cfit/dalitzgrid.hh>
 #include <cfit/binnedamplitude.hh>
 
 #include <Minuit/FunctionMinimum.h>
@@ -34,12 +35,24 @@ private:
   // // Maximum value of the pdf.
   // double _maxPdf;
 
-  // Index of the cached bins.
+  // Whether the bins of the events have been cached, and index of the cached bins.
+  bool     _cacheBins;
   unsigned _binIndex;
 
-  std::vector< unsigned > _binCache;
+  // Bins of the points on which the norm is computed, and points they belong to.
+  std::vector< int >                  _binCache;
+  std::shared_ptr< const DalitzGrid > _binCachePoints;
 
-  // const double evaluateUnnorm( const int& bin ) const throw( PdfException );
+  // Bin of each of the points on which the norm is computed.
+  void gridBins( std::vector< int >& bins ) const throw( PdfException );
+
+  // Fraction of the pdf at each of the points on which the norm is computed.
+  void gridFractions( std::vector< double >& fracs ) const throw( PdfException );
+
+  // Index of a variable of the pdf, or -1 if the pdf does not depend on it.
+  int varIndex( const std::string& varName ) const;
+
+  const double evaluateUnnorm( const int& bin ) const throw( PdfException );
   const double evaluateUnnorm( const double& mSq12, const double& mSq13 ) const throw( PdfException );
 
   const std::map< unsigned, std::vector< double > > cacheReal( const Dataset& data );
@@ -78,6 +91,9 @@ public:
 
   Decay3BodyBin* copy() const;
 
+  // Bytes of memory of the caches of the norm and of the bins of its points.
+  const std::map< std::string, std::size_t > memory() const;
+
   // Getters.
   const std::complex< double > phi()   const { return             _phi  .evaluate();       }
   const std::complex< double > z()     const { return             std::tanh( phi() );      }
@@ -110,6 +126,44 @@ public:
   const double evaluate( const std::vector< double >&                 vars  ,
                          const std::vector< double >&                 cacheR,
                          const std::vector< std::complex< double > >& cacheC ) const throw( PdfException );
+
+  void evaluateBlock( const std::vector< const double*                 >& vars  ,
+                      const std::vector< const double*                 >& cacheR,
+                      const std::vector< const std::complex< double >* >& cacheC,
+                      const std::size_t&                                  n     ,
+                      double*                                             out    ) const throw( PdfException );
+
+  void check( const std::size_t& nVars ) const throw( PdfException );
+
+  void evaluateUnchecked( const std::vector< const double*                 >& vars  ,
+                          const std::vector< const double*                 >& cacheR,
+                          const std::vector< const std::complex< double >* >& cacheC,
+                          const std::size_t&                                  n     ,
+                          double*                                             out    ) const;
+
+  // Dataset with one event of each of the bins that the events of data fall in,
+  //    and the number of events of data in that bin in the column of w. The pdf
+  //    only depends on the events through their bins, so the WeightedNll of the
+  //    pdf with weights w on the returned dataset is equal to its Nll on data,
+  //       - 2 Sum_bins( n_b log( p_b ) ) + 2,
+  //    at a cost that grows with the number of bins instead of events.
+  const Dataset binCounts( const Dataset& data, const Variable& w ) const throw( PdfException );
+
+  // Histograms of the pdf, filled from the bins of the points on which the norm is computed.
+  void projectHist( const std::string& varName,
+                    const double&      min    ,
+                    const double&      max    ,
+                    const unsigned&    nBins  ,
+                    double*            out      ) const throw( PdfException );
+  void projectHist( const std::string& var1  ,
+                    const double&      min1  ,
+                    const double&      max1  ,
+                    const unsigned&    nBins1,
+                    const std::string& var2  ,
+                    const double&      min2  ,
+                    const double&      max2  ,
+                    const unsigned&    nBins2,
+                    double*            out     ) const throw( PdfException );
 };
 
 #endif
@@ -3,11 +3,14 @@
 
 #include <vector>
 #include <map>
+#include <memory>
 
-#include <cfit/decaymodel.hh>
+#include <cfit/conjugatedecaymodel.hh>
 #include <cfit/variable.hh>
 #include <cfit/amplitude.hh>
 #include <cfit/phasespace.hh>
+#include <cfit/dalitzenvelope.hh>
+#include <cfit/membermutex.hh>
 #include <cfit/function.hh>
 
 #include <Minuit/FunctionMinimum.h>
@@ -15,35 +18,20 @@
 
 class Dataset;
 
-class Decay3BodyCP : public DecayModel< Amplitude >
+class Decay3BodyCP : public ConjugateDecayModel
 {
 private:
   bool          _hasKappa;
   ParameterExpr _kappa;
   CoefExpr      _phi;
 
-  // Constants to speed up norm calculation.
-  double                 _nDir;
-  double                 _nCnj;
-  std::complex< double > _nXed;
-  double                 _norm;
+  double _norm;
 
-  // Keep track of whether the amplitudes and functions are all fixed.
-  bool                   _fixed;
-
-  // Maximum value of the pdf.
-  double _maxPdf;
-
-  // Indices of the cached direct and conjugated amplitudes.
-  bool     _cacheAmps;
-  unsigned _ampDirCache;
-  unsigned _ampCnjCache;
-
-  // Vector to cache values of the amplitude for the norm evaluation.
-  std::vector< std::complex< double > > _ampCache;
-
-  // Number of integration steps in each direction.
-  unsigned _nIntegSteps;
+  // Upper bound of the pdf for the generation, as in Decay3Body.
+  double                                          _maxPdf;
+  bool                                            _autoMax;
+  mutable std::shared_ptr< const DalitzEnvelope > _envelope;
+  mutable MemberMutex                             _lock;
 
   // Auxiliary function to compute the center of a bin.
   static const double binCenter( const unsigned& bin, const unsigned& nbins, const double& min, const double& max )
@@ -53,6 +41,7 @@ private:
 
   const double evaluateUnnorm( const double& mSq12, const double& mSq13, const double& mSq23 ) const throw( PdfException );
 
+  const std::map< unsigned, std::vector<               double   > > cacheReal   ( const Dataset& data );
   const std::map< unsigned, std::vector< std::complex< double > > > cacheComplex( const Dataset& data );
 
   void setParExpr();
@@ -86,6 +75,9 @@ public:
 
   Decay3BodyCP* copy() const;
 
+  // Bytes of memory of the caches of the norm and of the envelope of the pdf.
+  const std::map< std::string, std::size_t > memory() const;
+
   const std::string mSq12name() const { return getVar( 0 ).name(); }
   const std::string mSq13name() const { return getVar( 1 ).name(); }
   const std::string mSq23name() const { return getVar( 2 ).name(); }
@@ -95,47 +87,6 @@ public:
   const std::complex< double > z()     const { return             std::tanh( phi() );      }
   const double                 kappa() const { return _hasKappa ? _kappa.evaluate() : 1.0; }
 
-  // Norm components getters.
-  const double&                 nDir() const { return _nDir; }
-  const double&                 nCnj() const { return _nCnj; }
-  const std::complex< double >& nXed() const { return _nXed; }
-
-  // Getter of the number of integration steps.
-  const unsigned& integrationSteps() const { return _nIntegSteps; }
-
-  // Setters.
-  void setIntegrationSteps( const unsigned& steps ) { _nIntegSteps = steps; }
-
-  // Norm components setters.
-  void setNormComponents( const double& nDir, const double& nCnj, const std::complex< double >& nXed )
-  {
-    _fixed = _amp.isFixed();
-    for ( std::vector< Function >::const_iterator func = _funcs.begin(); func != _funcs.end(); ++func )
-      _fixed &= func->isFixed();
-
-    if ( _fixed )
-    {
-      _nDir = nDir;
-      _nCnj = nCnj;
-      _nXed = nXed;
-    }
-  }
-
-  void setNormComponents( const double& nDir, const std::complex< double >& nXed )
-  {
-    _fixed = _amp.isFixed();
-    for ( std::vector< Function >::const_iterator func = _funcs.begin(); func != _funcs.end(); ++func )
-      _fixed &= func->isFixed();
-
-    if ( _fixed )
-    {
-      _nDir = nDir;
-      _nCnj = nDir;
-      _nXed = nXed;
-    }
-  }
-
-
   void cache();
   const double evaluate( const double& mSq12, const double& mSq13, const double& mSq23 ) const throw( PdfException );
   const double evaluate( const double& mSq12, const double& mSq13                      ) const throw( PdfException );
@@ -145,6 +96,20 @@ public:
                          const std::vector< double >&                 cacheR,
                          const std::vector< std::complex< double > >& cacheC           ) const throw( PdfException );
 
+  void evaluateBlock( const std::vector< const double*                 >& vars  ,
+                      const std::vector< const double*                 >& cacheR,
+                      const std::vector< const std::complex< double >* >& cacheC,
+                      const std::size_t&                                  n     ,
+                      double*                                             out    ) const throw( PdfException );
+
+  void check( const std::size_t& nVars ) const throw( PdfException );
+
+  void evaluateUnchecked( const std::vector< const double*                 >& vars  ,
+                          const std::vector< const double*                 >& cacheR,
+                          const std::vector< const std::complex< double >* >& cacheC,
+                          const std::size_t&                                  n     ,
+                          double*                                             out    ) const;
+
   virtual const double project ( const std::string& varName, const double& value                ) const throw( PdfException );
   virtual const double project ( const std::string& varName, const double& value, const Region& ) const throw( PdfException )
   {
@@ -155,8 +120,12 @@ public:
   // Do not override other project members defined in PdfModel.
   using PdfModel::project;
 
-  void setMaxPdf( const double& max ) { _maxPdf = max; }
+  // Flat upper bound of the pdf for the generation, instead of an envelope that follows it.
+  void setMaxPdf( const double& max ) { _maxPdf = max; _autoMax = false; _envelope.reset(); }
+
   const std::map< std::string, double > generate() const throw( PdfException );
+  void generate( const std::size_t& n, double* mSq12, double* mSq13, double* mSq23 ) const throw( PdfException );
+  void generate( const std::size_t& n, Dataset& data                               ) const throw( PdfException );
 
   friend const Decay3BodyCP  operator* (       Decay3BodyCP left, const Function&    right );
   friend const Decay3BodyCP  operator* ( const Function&    left,       Decay3BodyCP right );
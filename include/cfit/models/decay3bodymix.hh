@@ -5,7 +5,7 @@
 #include <map>
 
 #include <cfit/pdfmodel.hh>
-#include <cfit/decaymodel.hh>
+#include <cfit/conjugatedecaymodel.hh>
 #include <cfit/variable.hh>
 #include <cfit/amplitude.hh>
 #include <cfit/phasespace.hh>
@@ -16,7 +16,7 @@
 
 class Dataset;
 
-class Decay3BodyMix : public DecayModel< Amplitude >
+class Decay3BodyMix : public ConjugateDecayModel
 {
 private:
   // Names of the squared invariant mass and life time variables.
@@ -34,25 +34,36 @@ private:
   bool _hasMixing;
   bool _hasCPV;
 
-  // Constants to speed up norm calculation.
-  double                 _nDir;
-  double                 _nCnj;
-  std::complex< double > _nXed;
-  double                 _norm;
-
-  bool                   _fixedAmp;
+  double _norm;
 
   // Maximum value of the pdf.
   double _maxPdf;
 
-  // Indices of the cached direct and conjugated amplitudes.
-  bool     _cacheAmps;
-  unsigned _ampDirCache;
-  unsigned _ampCnjCache;
+  // Indices of the time dependence cached for the events, if the width and the
+  //    mixing parameters are fixed.
+  bool     _cacheTime;
+  unsigned _psipCache;
+  unsigned _psimCache;
+  unsigned _psiiCache;
+
+  // Whether the fixed efficiency is folded into the cached amplitudes, each of
+  //    them multiplied by its square root, since the pdf is quadratic in them.
+  bool _foldFuncs;
+
+  // Per-event Gaussian time resolution, with the errors of t in the dataset
+  //    times a scale as widths. When the scale is fixed, the widths and the
+  //    values of exp( - t^2 / 2 sigma^2 ) are cached for the events.
+  bool          _resolution;
+  ParameterExpr _resScale;
+  bool          _resFixed;
+  unsigned      _sigmaCache;
+  unsigned      _gaussCache;
 
-  // const double evaluateFuncs() const;
-  const double evaluateFuncs( const double& mSq12, const double& mSq13, const double& mSq23 ) const;
-  const double evaluateFuncs( const double& mSq12, const double& mSq13                      ) const;
+  // Whether the width, the mixing parameters and the scale of the resolution are fixed.
+  const bool timeFixed() const;
+
+  // Widths of the time resolution of the events of data, with the current scale.
+  const std::vector< double > resolutionWidths( const Dataset& data ) const throw( PdfException );
 
   // Auxiliary function to compute the center of a bin.
   static const double binCenter( const unsigned& bin, const unsigned& nbins, const double& min, const double& max )
@@ -62,13 +73,15 @@ private:
 
   const double evaluateUnnorm( const double& mSq12, const double& mSq13, const double& mSq23, const double& t ) const;
 
-  void cacheNormComponents();
-
+  const std::map< unsigned, std::vector<               double   > > cacheReal   ( const Dataset& data );
   const std::map< unsigned, std::vector< std::complex< double > > > cacheComplex( const Dataset& data );
 
-  const double                 psip( const double& t ) const;
-  const double                 psim( const double& t ) const;
-  const std::complex< double > psii( const double& t ) const;
+  // The time evolution functions of n events, with the current width and mixing
+  //    parameters, convolved with Gaussians of widths sigma if given, with the values
+  //    of exp( - t^2 / 2 sigma^2 ) taken from gauss if given. Events with zero width
+  //    have perfect resolution.
+  void psiBlock( const double* t, const double* sigma, const double* gauss, const std::size_t& n,
+                 double* psip, double* psim, std::complex< double >* psii ) const;
 
   void setParExpr();
 
@@ -104,45 +117,16 @@ public:
   const std::complex< double > z()      const { return _z     .evaluate();         }
   const std::complex< double > qoverp() const { return _qoverp.evaluate();         }
 
-  // Getters for the norm components.
-  const double&                 nDir() const { return _nDir; }
-  const double&                 nCnj() const { return _nCnj; }
-  const std::complex< double >& nXed() const { return _nXed; }
-
   // Setters for the mixing and CP violation parameters.
   void setMixing       ( const CoefExpr& z      );
   void setCPV          ( const CoefExpr& qoverp );
   inline void setqoverp( const CoefExpr& qoverp ) { setCPV( qoverp ); }
 
-  // Norm components setters.
-  void setNormComponents( const double& nDir, const double& nCnj, const std::complex< double >& nXed )
-  {
-    _fixedAmp = _amp.isFixed();
-
-    if ( _fixedAmp )
-    {
-      _nDir = nDir;
-      _nCnj = nCnj;
-      _nXed = nXed;
-    }
-
-    cache();
-  }
-
-  void setNormComponents( const double& nDir, const std::complex< double >& nXed )
-  {
-    _fixedAmp = _amp.isFixed();
-
-    if ( _fixedAmp )
-    {
-      _nDir = nDir;
-      _nCnj = nDir;
-      _nXed = nXed;
-    }
-
-    cache();
-  }
-
+  // Convolve the time dependence with a Gaussian resolution for each event, of
+  //    width the error of t in the dataset times scale. The evaluation without
+  //    cached values, used to generate, has no errors and assumes perfect resolution.
+  void setResolution( const ParameterExpr& scale = ParameterExpr( 1.0 ) );
+  const bool& hasResolution() const { return _resolution; }
 
   void cache();
   const double evaluate( const double& mSq12, const double& mSq13, const double& mSq23, const double& t ) const;
@@ -153,10 +137,26 @@ public:
                          const std::vector< double >&                 cacheR,
                          const std::vector< std::complex< double > >& cacheC  ) const throw( PdfException );
 
+  void evaluateBlock( const std::vector< const double*                 >& vars  ,
+                      const std::vector< const double*                 >& cacheR,
+                      const std::vector< const std::complex< double >* >& cacheC,
+                      const std::size_t&                                  n     ,
+                      double*                                             out    ) const throw( PdfException );
+
+  void check( const std::size_t& nVars ) const throw( PdfException );
+
+  void evaluateUnchecked( const std::vector< const double*                 >& vars  ,
+                          const std::vector< const double*                 >& cacheR,
+                          const std::vector< const std::complex< double >* >& cacheC,
+                          const std::size_t&                                  n     ,
+                          double*                                             out    ) const;
+
   const double project ( const std::string& varName, const double& value ) const throw( PdfException );
 
   void setMaxPdf( const double& max ) { _maxPdf = max; }
+
   const std::map< std::string, double > generate() const throw( PdfException );
+  using PdfBase::generate;
 
   friend const Decay3BodyMix  operator* (       Decay3BodyMix left, const Function&     right );
   friend const Decay3BodyMix  operator* ( const Function&     left,       Decay3BodyMix right );
@@ -26,11 +26,28 @@ private:
 
   double _norm;
 
+  // Constants of the shape, computed by cache(). In terms of t = ( x - mu ) / sigma,
+  //    the unnormalized pdf is exp( - t^2 / 2 ) in the core, - alpha <= t <= beta,
+  //    A_lo ( B_lo - t )^-n in the lower tail and A_up ( B_up + t )^-m in the
+  //    upper one, with A_lo = ( n / alpha )^n exp( - alpha^2 / 2 ),
+  //    B_lo = n / alpha - alpha, and the same with beta and m for the upper tail.
+  double _vmu;
+  double _invSigma;
+  double _valpha;
+  double _vbeta;
+  double _vn;
+  double _vm;
+  double _loA;
+  double _loB;
+  double _upA;
+  double _upB;
+  double _invNorm;
+
   const double cumulativeNorm( const double& x ) const;
 
-  const double core  ( const double& x ) const;
-  const double tailLo( const double& x ) const;
-  const double tailUp( const double& x ) const;
+  // Value of the pdf at x within the limits, blending the core and the tails
+  //    without branches, so that loops over events can be vectorised.
+  double shape( const double& x ) const;
 
   // Index of the cached pdf.
   bool     _doCache;
@@ -74,9 +91,17 @@ public:
                          const std::vector< double >&                 cacheR,
                          const std::vector< std::complex< double > >& cacheC ) const throw( PdfException );
 
+  // Evaluate a block of events, with the constants of the shape computed by cache().
+  void evaluateBlock( const std::vector< const double*                 >& vars  ,
+                      const std::vector< const double*                 >& cacheR,
+                      const std::vector< const std::complex< double >* >& cacheC,
+                      const std::size_t&                                  n     ,
+                      double*                                             out    ) const throw( PdfException );
+
   const double area    ( const double& min, const double& max ) const throw( PdfException );
 
   const std::map< std::string, double > generate()              const throw( PdfException );
+  using PdfBase::generate;
 };
 
 #endif
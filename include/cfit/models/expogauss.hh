@@ -28,6 +28,9 @@ private:
 
   const double expogauss( const double& x ) const;
 
+  // Integral of expogauss between min and max, with adaptive quadrature.
+  const double integral( const double& min, const double& max ) const;
+
   void setParExpr();
 
 public:
@@ -56,9 +59,17 @@ public:
   const double evaluate( const double& x                   ) const throw( PdfException );
   const double evaluate( const std::vector< double >& vars ) const throw( PdfException );
 
+  // Evaluate a block of events, with the values of the parameters computed once.
+  void evaluateBlock( const std::vector< const double*                 >& vars  ,
+                      const std::vector< const double*                 >& cacheR,
+                      const std::vector< const std::complex< double >* >& cacheC,
+                      const std::size_t&                                  n     ,
+                      double*                                             out    ) const throw( PdfException );
+
   const double area    ( const double& min, const double& max ) const throw( PdfException );
 
   const std::map< std::string, double > generate()              const throw( PdfException );
+  using PdfBase::generate;
 };
 
 #endif
@@ -9,6 +9,11 @@ class PhaseSpace;
 // Flatt resonance.
 class Flatte : public Resonance
 {
+private:
+  // Propagator at n points given the squared momenta of the resonant particles at them.
+  void propagators( const PhaseSpace& ps, const double* mSqAB, const double* qSq,
+                    const std::size_t& n, std::complex< double >* out ) const;
+
 public:
   template <class T>
   Flatte( const T&         resoA ,
@@ -39,7 +44,11 @@ public:
   double m02aSq()   const { return std::pow( m02a()  , 2 ); }
   double m02bSq()   const { return std::pow( m02b()  , 2 ); }
 
-  std::complex< double > propagator( const PhaseSpace& ps, const double& mSqAB ) const;
+  std::complex< double > propagator ( const PhaseSpace& ps, const double& mSqAB ) const;
+  void                   propagators( const PhaseSpace& ps, const double* mSqAB, const std::size_t& n,
+                                      std::complex< double >* out ) const;
+  void                   propagators( const PhaseSpace& ps, const double* mSqAB, const double* const* kin,
+                                      const std::size_t& n, std::complex< double >* out ) const;
   Flatte*                copy()                                                  const;
 };
 
@@ -55,7 +55,15 @@ public:
                          const std::vector< double >&                 cacheR,
                          const std::vector< std::complex< double > >& cacheC ) const throw( PdfException );
 
+  // Evaluate a block of events, with the values of the parameters computed once.
+  void evaluateBlock( const std::vector< const double*                 >& vars  ,
+                      const std::vector< const double*                 >& cacheR,
+                      const std::vector< const std::complex< double >* >& cacheC,
+                      const std::size_t&                                  n     ,
+                      double*                                             out    ) const throw( PdfException );
+
   const std::map< std::string, double > generate() const throw( PdfException );
+  using PdfBase::generate;
 
   const double area    ( const double& min, const double& max ) const throw( PdfException );
 };
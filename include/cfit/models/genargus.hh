@@ -2,11 +2,13 @@
 #define __GENARGUS_HH__
 
 #include <vector>
+#include <map>
 #include <cmath>
 
 #include <cfit/variable.hh>
 #include <cfit/parameter.hh>
 #include <cfit/pdfmodel.hh>
+#include <cfit/gammapcache.hh>
 
 
 class GenArgus : public PdfModel
@@ -23,6 +25,9 @@ private:
 
   double _norm;
 
+  // Intended to cache the incomplete gamma integrals gamma_p( a, x ).
+  mutable GammaPCache _gammaP;
+
   void setParExpr();
 
 public:
@@ -48,9 +53,18 @@ public:
   const double evaluate( const double& x                   ) const throw( PdfException );
   const double evaluate( const std::vector< double >& vars ) const throw( PdfException );
 
+  // Evaluate a block of events, with the values of the parameters computed once.
+  void evaluateBlock( const std::vector< const double*                 >& vars  ,
+                      const std::vector< const double*                 >& cacheR,
+                      const std::vector< const std::complex< double >* >& cacheC,
+                      const std::size_t&                                  n     ,
+                      double*                                             out    ) const throw( PdfException );
+
   const double area    ( const double& min, const double& max ) const throw( PdfException );
+  void         areas   ( const double* min, const double* max, const std::size_t& n, double* out ) const throw( PdfException );
 
   const std::map< std::string, double > generate()              const throw( PdfException );
+  using PdfBase::generate;
 };
 
 #endif
@@ -2,11 +2,14 @@
 #define __GENARGUSGAUSS_HH__
 
 #include <vector>
+#include <map>
 #include <cmath>
 
 #include <cfit/variable.hh>
 #include <cfit/parameter.hh>
 #include <cfit/pdfmodel.hh>
+#include <cfit/membermutex.hh>
+#include <cfit/gammapcache.hh>
 
 
 class GenArgusGauss : public PdfModel
@@ -35,12 +38,21 @@ private:
   // Intented to cache areas within a range.
   mutable std::map< std::pair< double, double >, double > _areas;
 
+  // Guards the areas, so that const members can be called from several threads.
+  mutable MemberMutex                                      _cacheLock;
+
+  // Intended to cache the incomplete gamma integrals gamma_p( a, x ).
+  mutable GammaPCache                                      _gammaP;
+
   const double genargus     ( const double& x ) const;
   const double gauss        ( const double& x ) const;
   const double genargusgauss( const double& x ) const;
 
   const double genarguscore ( const double& x ) const;
 
+  // Integral of genargusgauss between min and max, with adaptive quadrature.
+  const double integral( const double& min, const double& max ) const;
+
   const double generateArgus() const;
 
   void setParExpr();
@@ -80,9 +92,17 @@ public:
                          const std::vector< double >&                 cacheR,
                          const std::vector< std::complex< double > >& cacheC ) const throw( PdfException );
 
+  // Evaluate a block of events, with the values of the parameters computed once.
+  void evaluateBlock( const std::vector< const double*                 >& vars  ,
+                      const std::vector< const double*                 >& cacheR,
+                      const std::vector< const std::complex< double >* >& cacheC,
+                      const std::size_t&                                  n     ,
+                      double*                                             out    ) const throw( PdfException );
+
   const double area    ( const double& min, const double& max ) const throw( PdfException );
 
   const std::map< std::string, double > generate()              const throw( PdfException );
+  using PdfBase::generate;
 };
 
 #endif
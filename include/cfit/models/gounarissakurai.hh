@@ -9,10 +9,26 @@ class PhaseSpace;
 class GounarisSakurai : public Resonance
 {
 private:
-  double gsf     ( const PhaseSpace& ps, const double& mSq12 ) const;
+  // Terms of the propagator that only depend on the parameters, computed once
+  //    for all the points of a batch.
+  struct Pole
+  {
+    double qSq;      // Squared momentum at the mass.
+    double gsh;      // h function and its derivative at the mass.
+    double gshPrime;
+    double factor;   // Gamma m^2 / q0, that multiplies the f function.
+    double norm;     // 1 + d Gamma / m.
+  };
+
+  const Pole pole( const PhaseSpace& ps ) const;
+
   double gsh     ( const PhaseSpace& ps, const double& mSq12 ) const;
   double gshprime( const PhaseSpace& ps, const double& mSq12 ) const;
 
+  // Propagator at n points given the squared momenta, the h function and the running width at them.
+  void propagators( const Pole& pole, const double* mSqAB, const double* qSq, const double* gsh,
+                    const double* width, const std::size_t& n, std::complex< double >* out ) const;
+
   // Decide whether to use the BaBar buggy or corrected GS propagator.
   bool _buggy;
 
@@ -29,7 +45,18 @@ public:
     : Resonance( right ), _buggy( right._buggy )
     {}
 
-  std::complex< double > propagator( const PhaseSpace& ps, const double& mSqAB ) const;
+  const std::string structure() const { return Resonance::structure() + ( _buggy ? " buggy" : " corrected" ); }
+
+  // The h function at each point is kept with the kinematics, after the common columns.
+  std::size_t            nKinematics() const { return nCommonKinematics + 1; }
+  void                   kinematics ( const PhaseSpace& ps, const double* mSq12, const double* mSq13, const double* mSq23,
+                                      const std::size_t& n, double* const* kin ) const;
+
+  std::complex< double > propagator ( const PhaseSpace& ps, const double& mSqAB ) const;
+  void                   propagators( const PhaseSpace& ps, const double* mSqAB, const std::size_t& n,
+                                      std::complex< double >* out ) const;
+  void                   propagators( const PhaseSpace& ps, const double* mSqAB, const double* const* kin,
+                                      const std::size_t& n, std::complex< double >* out ) const;
   GounarisSakurai*       copy()                                                  const;
 };
 
@@ -8,6 +8,11 @@ class PhaseSpace;
 
 class RelBreitWigner : public Resonance
 {
+private:
+  // Propagator at n points given the running width at them.
+  void propagators( const double* mSqAB, const double* width, const std::size_t& n,
+                    std::complex< double >* out ) const;
+
 public:
   template <class T>
   RelBreitWigner( const T&         resoA, const T&         resoB,
@@ -21,6 +26,10 @@ public:
     {}
 
   std::complex< double > propagator( const PhaseSpace& ps, const double& mSqAB ) const;
+  void                   propagators( const PhaseSpace& ps, const double* mSqAB, const std::size_t& n,
+                                      std::complex< double >* out ) const;
+  void                   propagators( const PhaseSpace& ps, const double* mSqAB, const double* const* kin,
+                                      const std::size_t& n, std::complex< double >* out ) const;
   RelBreitWigner*        copy()                                                  const;
 };
 
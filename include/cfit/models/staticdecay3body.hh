@@ -0,0 +1,150 @@
+#ifndef __STATICDECAY3BODY_HH__
+#define __STATICDECAY3BODY_HH__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <complex>
+#include <functional>
+
+#include <cfit/pdfmodel.hh>
+#include <cfit/variable.hh>
+#include <cfit/phasespace.hh>
+#include <cfit/dalitzintegrator.hh>
+#include <cfit/staticamplitude.hh>
+
+
+// Three body decay with an amplitude built at compile time, e.g.
+//       StaticDecay3Body< decltype( amp ) > pdf( mSq12, mSq13, mSq23, amp, ps );
+//    or makeStaticDecay3Body( mSq12, mSq13, mSq23, amp, ps ). The squared modulus
+//    of the amplitude is evaluated over each block of events in a single fused
+//    kernel. It is a PdfModel like any other, so it can be fitted with Nll or
+//    combined in expressions of pdfs, but it has no efficiency functions.
+template< class E >
+class StaticDecay3Body : public PdfModel
+{
+private:
+  E                _amp;
+  PhaseSpace       _ps;
+  DalitzIntegrator _integ;
+  double           _norm;
+
+  void setParExpr() { _amp.setPars( _parMap ); }
+
+  // Squared modulus of the amplitude at n points.
+  void evaluateAmp( const double* mSq12, const double* mSq13, const double* mSq23,
+                    const std::size_t& n, double* out ) const
+  {
+    std::vector< std::complex< double > > amp    ( n                   );
+    std::vector< std::complex< double > > scratch( n * E::scratch + 1 );
+
+    _amp.evaluate( _ps, mSq12, mSq13, mSq23, n, &amp[ 0 ], &scratch[ 0 ] );
+    for ( std::size_t entry = 0; entry < n; ++entry )
+      out[ entry ] = std::norm( amp[ entry ] );
+  }
+
+  DalitzIntegrator::integrand_type integrand() const
+  {
+    using namespace std::placeholders;
+    return std::bind( &StaticDecay3Body::evaluateAmp, this, _1, _2, _3, _4, _5 );
+  }
+
+public:
+  StaticDecay3Body( const Variable&          mSq12,
+                    const Variable&          mSq13,
+                    const Variable&          mSq23,
+                    const StaticNode< E >&   amp  ,
+                    const PhaseSpace&        ps     )
+    : _amp( amp.self() ), _ps( ps ), _integ( ps ), _norm( 1. )
+  {
+    push( mSq12 );
+    push( mSq13 );
+    push( mSq23 );
+
+    // Resonances and coefficients may share parameters.
+    std::map< std::string, Parameter > pars;
+    _amp.collect( pars );
+    for ( std::map< std::string, Parameter >::const_iterator par = pars.begin(); par != pars.end(); ++par )
+      push( par->second );
+
+    cache();
+  }
+
+  StaticDecay3Body* copy() const { return new StaticDecay3Body( *this ); }
+
+  // Number of points of the grid on which the norm is computed, and threads used.
+  void setSteps  ( const unsigned& nSteps   ) { _integ.setSteps  ( nSteps   ); cache(); }
+  void setThreads( const unsigned& nThreads ) { _integ.setThreads( nThreads );          }
+
+  void cache() { _norm = _integ.integrate( integrand() ); }
+
+  const double evaluate( const double& mSq12, const double& mSq13, const double& mSq23 ) const throw( PdfException )
+  {
+    double value;
+    evaluateAmp( &mSq12, &mSq13, &mSq23, 1, &value );
+
+    return value / _norm;
+  }
+
+  const double evaluate( const std::vector< double >& vars ) const throw( PdfException )
+  {
+    check( vars.size() );
+
+    return evaluate( vars[ 0 ], vars[ 1 ], vars[ 2 ] );
+  }
+
+  void check( const std::size_t& nVars ) const throw( PdfException )
+  {
+    if ( nVars != 3 )
+      throw PdfException( "StaticDecay3Body can only take 3 arguments." );
+  }
+
+  void evaluateBlock( const std::vector< const double*                 >& vars  ,
+                      const std::vector< const double*                 >& cacheR,
+                      const std::vector< const std::complex< double >* >& cacheC,
+                      const std::size_t&                                  n     ,
+                      double*                                             out    ) const throw( PdfException )
+  {
+    check( vars.size() );
+
+    evaluateUnchecked( vars, cacheR, cacheC, n, out );
+  }
+
+  void evaluateUnchecked( const std::vector< const double*                 >& vars  ,
+                          const std::vector< const double*                 >& cacheR,
+                          const std::vector< const std::complex< double >* >& cacheC,
+                          const std::size_t&                                  n     ,
+                          double*                                             out    ) const
+  {
+    evaluateAmp( vars[ 0 ], vars[ 1 ], vars[ 2 ], n, out );
+
+    const double invNorm = 1. / _norm;
+    for ( std::size_t entry = 0; entry < n; ++entry )
+      out[ entry ] *= invNorm;
+  }
+
+  const double project( const std::string& varName, const double& value ) const throw( PdfException )
+  {
+    for ( unsigned index = 0; index < 3; ++index )
+      if ( _varOrder[ index ] == varName )
+        return _integ.project( index, value, integrand() ) / _norm;
+
+    return 1.0;
+  }
+
+  // Do not hide the other projection members defined in PdfModel.
+  using PdfModel::project;
+};
+
+
+template< class E >
+inline const StaticDecay3Body< E > makeStaticDecay3Body( const Variable&        mSq12,
+                                                         const Variable&        mSq13,
+                                                         const Variable&        mSq23,
+                                                         const StaticNode< E >& amp  ,
+                                                         const PhaseSpace&      ps     )
+{
+  return StaticDecay3Body< E >( mSq12, mSq13, mSq23, amp, ps );
+}
+
+#endif
@@ -14,11 +14,29 @@ public:
   Nll( const PdfModel& pdf, const Dataset& data );
   Nll( const PdfExpr&  pdf, const Dataset& data );
 
+  // Nll of the entries selected by a view.
+  Nll( const PdfModel& pdf, const DatasetView& data );
+  Nll( const PdfExpr&  pdf, const DatasetView& data );
+
+  // Nll of a dataset shared with its owner, which is not copied.
+  Nll( const PdfModel& pdf, const std::shared_ptr< const Dataset >& data );
+  Nll( const PdfExpr&  pdf, const std::shared_ptr< const Dataset >& data );
+
   Nll( const Nll& nll );
 
   Nll* copy() const { return new Nll( *this ); }
 
   double operator()( const std::vector<double>& par ) const throw( PdfException );
+
+  // Gradient of the nll. The derivatives with respect to the parameters for which
+  //    the pdf provides them are computed analytically in a single pass over the
+  //    data, and those with respect to the rest of free parameters numerically.
+  std::vector< double > gradient( const std::vector< double >& pars ) const throw( PdfException );
+
+  // Covariance given by the inverse of the Fisher information, estimated with
+  //    the sum over the events of the outer products of their scores.
+  MnUserCovariance scoreCovariance( const std::vector< double >& pars ) const throw( PdfException );
+  using Minimizer::scoreCovariance;
 };
 
 #endif
@@ -0,0 +1,280 @@
+#ifndef __NORMGRID_HH__
+#define __NORMGRID_HH__
+
+#include <string>
+#include <vector>
+#include <list>
+#include <algorithm>
+#include <complex>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include <cfit/exceptions.hh>
+#include <cfit/amplitude.hh>
+#include <cfit/phasespace.hh>
+#include <cfit/dalitzgrid.hh>
+#include <cfit/dalitzintegrator.hh>
+
+// Norm integrals of the three-body models, shared by all of them. It owns the
+//    points on which they are computed, either a grid of nSteps x nSteps cells
+//    or a Monte Carlo sample, the values of the efficiency and the amplitude
+//    cached at them, and the threads used to compute them. The models only
+//    combine the integrals
+//
+//    dir = int eff |A|^2,  cnj = int eff |Ac|^2,  xed = int eff conj( A ) Ac,
+//
+// where Ac is the amplitude with the invariant masses mSq12 and mSq13 swapped,
+//    which are only computed if conjugate is set.
+//
+// If the amplitude is linear, A = sum_k a_k B_k, the integrals are factorised as
+//    dir = sum_kl a_k conj( a_l ) I_kl, with I_kl = int eff B_k conj( B_l ), and only
+//    the integrals of the basis functions whose parameters have changed are computed
+//    again, so that a change of the coefficients only costs a quadratic form.
+//    Otherwise the whole amplitude is treated as a single basis function, that is
+//    only evaluated again if any of its parameters has changed.
+//
+// With MPI, each process only evaluates and integrates the rows of the points
+//    that it is assigned, about the same number of points for each of them, and
+//    the partial integrals of all the basis functions that have changed are
+//    added up with a single reduction. Every update is then a collective call,
+//    which all the processes make together, as they do when evaluating an Nll.
+//
+// Grids of models with the same amplitude, efficiency and phase space, e.g. in
+//    several categories of a simultaneous fit, can share their integrals. The
+//    first of them to be updated with some values of the parameters computes
+//    them, while the others wait for it and take its result.
+class NormGrid
+{
+public:
+  // Function that evaluates the efficiency at n points.
+  typedef std::function< void( const double* mSq12, const double* mSq13, const double* mSq23,
+                               const std::size_t& n, double* out ) > eff_type;
+
+private:
+  PhaseSpace _ps;
+  bool       _conjugate;
+
+  // Integrator that owns the grid and the threads, and sample that replaces the grid.
+  DalitzIntegrator                    _integ;
+  std::shared_ptr< const DalitzGrid > _sample;
+
+  // Points on which the cached values have been computed, and range of the rows
+  //    that this process evaluates, which is all of them without MPI.
+  std::shared_ptr< const DalitzGrid > _points;
+  std::size_t                         _firstRow;
+  std::size_t                         _endRow;
+
+  // Values of a basis function at the points, as given and with swapped
+  //    invariant masses. Their real and imaginary parts are stored separately,
+  //    so that the integrands are computed at the full width of the vector
+  //    instructions.
+  struct Basis
+  {
+    std::vector< double > dirRe;
+    std::vector< double > dirIm;
+    std::vector< double > cnjRe;
+    std::vector< double > cnjIm;
+  };
+
+  // The values cached at the points are shared by the copies of the grid, e.g.
+  //    those of the models of the minimizers of several threads, and each copy
+  //    only takes its own one when it has to compute them again.
+  //
+  // Efficiency at the points, and versions of its parameters.
+  std::shared_ptr< std::vector< double > > _effs;
+  std::vector< unsigned >                  _effVersions;
+
+  // Kinematics of the resonances of the amplitude at the points, one column after
+  //    the other, which do not change with its parameters.
+  std::shared_ptr< std::vector< double > > _kinematics;
+
+  // Values of each basis function, and versions of their parameters.
+  bool                                    _linear;
+  std::size_t                             _nBasis;
+  std::vector< std::shared_ptr< Basis > > _basis;
+  std::vector< std::vector< unsigned > >  _versions;
+
+  // Integrals of the pairs of basis functions, row after row.
+  std::vector< std::complex< double > > _dirInts;
+  std::vector< std::complex< double > > _cnjInts;
+  std::vector< std::complex< double > > _xedInts;
+
+  // Integrals of the whole amplitude.
+  double                 _dir;
+  double                 _cnj;
+  std::complex< double > _xed;
+
+  // Integrals of the last update of the grids that share them, with the points
+  //    and the values of the parameters they were computed with.
+  struct SharedIntegrals
+  {
+    std::mutex                          lock;
+    std::shared_ptr< const DalitzGrid > points;
+    bool                                conjugate;
+    std::vector< double >               key;
+    double                              dir;
+    double                              cnj;
+    std::complex< double >              xed;
+
+    SharedIntegrals() : conjugate( false ), dir( 0.0 ), cnj( 0.0 ), xed( 0.0 ) {}
+  };
+
+  std::shared_ptr< SharedIntegrals > _shared;
+
+  // Integrals of the last updates, most recently used first, with the points and
+  //    the values of the parameters they were computed with, and a hash of the
+  //    latter. Minuit revisits the same values, e.g. when Hesse and Minos step
+  //    around the minimum, or when a finite difference steps back, and they are
+  //    then taken from here without computing anything.
+  struct RecentIntegrals
+  {
+    std::size_t                         hash;
+    std::shared_ptr< const DalitzGrid > points;
+    bool                                conjugate;
+    std::vector< double >               key;
+    double                              dir;
+    double                              cnj;
+    std::complex< double >              xed;
+  };
+
+  std::list< RecentIntegrals > _recent;
+  std::size_t                  _nRecent;
+
+  static std::size_t hash( const std::vector< double >& key );
+  static std::size_t hash( const std::string&           key );
+
+  // Take the integrals of the given values from the recent ones, if they are
+  //    there, or store those just computed with them.
+  bool recall  ( const std::vector< double >& key, const std::size_t& hash );
+  void remember( const std::vector< double >& key, const std::size_t& hash );
+
+  // File where the integrals of the basis functions are saved, and whether the
+  //    current ones were read from it, in which case the values at the points
+  //    have not been computed.
+  std::string _file;
+  bool        _loaded;
+
+  // Description of the efficiency, e.g. the structure of its functions, that
+  //    enters the key of the file.
+  std::string _effShape;
+
+  // Compute the integrals, only evaluating again what has changed.
+  void compute( const Amplitude& amp, const eff_type& eff,
+                const std::vector< unsigned >& effVersions, const std::vector< double >& effValues ) throw( PdfException );
+
+  // Combine the integrals of the basis functions with the coefficients.
+  void combine( const Amplitude& amp );
+
+  // Description of everything the integrals of the basis functions depend on: the
+  //    phase space, the points, the structure of the basis functions, or of the
+  //    whole amplitude if it is not linear, and the efficiency.
+  const std::string fileKey( const Amplitude& amp, const std::vector< double >& effValues ) const;
+
+  // Read the integrals of the basis functions from the file if it was written
+  //    with the same key, or write them to it.
+  bool load( const std::string& key );
+  void save( const std::string& key ) const;
+
+  // Values pointed to by ptr, copied first if they are shared with another grid.
+  template < class T >
+  static T& own( std::shared_ptr< T >& ptr )
+  {
+    if ( ! ptr )
+      ptr = std::make_shared< T >();
+    else if ( ptr.use_count() > 1 )
+      ptr = std::make_shared< T >( *ptr );
+
+    return *ptr;
+  }
+
+  // Evaluate basis function k at all the points.
+  void evaluate( const Amplitude& amp, const std::size_t& k ) throw( PdfException );
+
+  // Assign the rows of the points to the processes.
+  void partition();
+
+  // Compute the integrals of basis function k with all the others over the rows
+  //    of this process into ints, and store those of all the processes.
+  void integrate( const std::size_t& k, double* ints ) const;
+  void store    ( const std::size_t& k, const double* ints );
+
+  // Number of real values of the integrals of a basis function with the others.
+  std::size_t nInts() const { return _nBasis * ( _conjugate ? 8 : 2 ); }
+
+  double quadratic( const std::vector< std::complex< double > >& ints,
+                    const std::vector< std::complex< double > >& coefs ) const;
+
+public:
+  NormGrid( const PhaseSpace& ps, const bool& conjugate = false, const unsigned& nSteps = 400 )
+    : _ps( ps ), _conjugate( conjugate ), _integ( ps, nSteps ), _firstRow( 0 ), _endRow( 0 ),
+      _linear( false ), _nBasis( 0 ), _dir( 0.0 ), _cnj( 0.0 ), _xed( 0.0 ), _nRecent( 8 ), _loaded( false )
+  {}
+
+  // Whether to compute the integrals of the conjugated amplitude.
+  void        setConjugate( const bool& conjugate ) { _conjugate = conjugate; _points.reset(); }
+  const bool& conjugate() const                     { return _conjugate; }
+
+  // Number of steps of the grid in each direction.
+  void            setSteps( const unsigned& nSteps ) { _integ.setSteps( nSteps ); }
+  const unsigned& steps() const                      { return _integ.steps();     }
+
+  // Number of threads. Zero means as many as the hardware supports.
+  void     setThreads( const unsigned& nThreads ) { _integ.setThreads( nThreads ); }
+  unsigned threads() const                        { return _integ.threads();       }
+
+  // Number of recent integrals kept to be taken again. Zero disables it.
+  void               setRecent( const std::size_t& nRecent ) { _nRecent = nRecent; _recent.resize( std::min( _recent.size(), nRecent ) ); }
+  const std::size_t& recent() const                          { return _nRecent; }
+
+  // File where the integrals of the basis functions are saved the first time they
+  //    are computed, and read from by later jobs with the same points, shapes of
+  //    the basis functions and efficiency, e.g. toys of a model with fixed shapes,
+  //    which then only combine them with the coefficients. An empty name disables it.
+  void               setFile( const std::string& file ) { _file = file; _points.reset(); }
+  const std::string& file() const                       { return _file; }
+
+  // Description of everything that determines the efficiency but the values of
+  //    its parameters, which the models must give whenever it changes, since the
+  //    file is only read if it was written with the same one.
+  void               setEfficiencyShape( const std::string& shape ) { _effShape = shape; }
+  const std::string& efficiencyShape() const                        { return _effShape; }
+
+  // Monte Carlo sample on which to compute the integrals instead of the grid.
+  //    A null sample goes back to the grid.
+  void setSample( const std::shared_ptr< const DalitzGrid >& sample ) { _sample = sample; }
+
+  const std::shared_ptr< const DalitzGrid >& sample() const { return _sample; }
+
+  // Points on which the integrals are computed: the sample if there is one, or the grid.
+  const std::shared_ptr< const DalitzGrid >& points() const { return _sample ? _sample : _integ.grid(); }
+
+  // Integrator with the same grid and threads, for the other integrals of the models.
+  const DalitzIntegrator& integrator() const { return _integ; }
+
+  // Bring the integrals up to date with the current amplitude and efficiency,
+  //    given the versions of the efficiency parameters. Changing the points on
+  //    which they are computed recomputes everything. When the integrals are
+  //    shared, the values of the efficiency parameters tell whether those of
+  //    another grid can be taken.
+  void update( const Amplitude&               amp                                ,
+               const eff_type&                eff                                ,
+               const std::vector< unsigned >& effVersions                        ,
+               const std::vector< double >&   effValues = std::vector< double >() ) throw( PdfException );
+
+  // Share the integrals with other, whose model must have the same amplitude,
+  //    efficiency and phase space, and which takes the points, the number of
+  //    steps and the threads of this grid. Copies of the grid share them too.
+  void share( NormGrid& other );
+
+  // Bytes of the values cached at the points, not including the points themselves,
+  //    and including those shared with copies of the grid.
+  std::size_t memory() const;
+
+  // Integrals of eff |A|^2, of eff |Ac|^2 and of eff conj( A ) Ac at the last update.
+  const double&                 dir() const { return _dir; }
+  const double&                 cnj() const { return _cnj; }
+  const std::complex< double >& xed() const { return _xed; }
+};
+
+#endif
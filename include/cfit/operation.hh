@@ -38,6 +38,20 @@ public:
   template < class T >
   static T operate( const T& x,             const Operation::Op& oper ) throw( PdfException );
 
+  // Element-wise operations on arrays of n values. The result is stored in x.
+  template < class T >
+  static void operate( T* x, const T* y, const std::size_t& n, const Operation::Op& oper ) throw( PdfException );
+
+  template < class T >
+  static void operate( T* x,             const std::size_t& n, const Operation::Op& oper ) throw( PdfException );
+
+  // Partial derivatives of the binary operations with respect to x and y.
+  template < class T >
+  static void derivative( const T& x, const T& y, const Operation::Op& oper, T& dx, T& dy ) throw( PdfException );
+
+  // Derivative of the unary operations.
+  template < class T >
+  static T derivative( const T& x,             const Operation::Op& oper ) throw( PdfException );
 };
 
 
@@ -85,4 +99,92 @@ inline T Operation::operate( const T& x, const Operation::Op& oper ) throw( PdfE
 }
 
 
+// Element-wise binary operations.
+template < class T >
+inline void Operation::operate( T* x, const T* y, const std::size_t& n, const Operation::Op& oper ) throw( PdfException )
+{
+  if ( oper == Operation::plus )
+    for ( std::size_t i = 0; i < n; ++i ) x[ i ] += y[ i ];
+  else if ( oper == Operation::minus )
+    for ( std::size_t i = 0; i < n; ++i ) x[ i ] -= y[ i ];
+  else if ( oper == Operation::mult )
+    for ( std::size_t i = 0; i < n; ++i ) x[ i ] *= y[ i ];
+  else if ( oper == Operation::div )
+    for ( std::size_t i = 0; i < n; ++i ) x[ i ] /= y[ i ];
+  else
+    for ( std::size_t i = 0; i < n; ++i ) x[ i ] = operate( x[ i ], y[ i ], oper );
+}
+
+
+// Element-wise unary operations.
+template < class T >
+inline void Operation::operate( T* x, const std::size_t& n, const Operation::Op& oper ) throw( PdfException )
+{
+  if ( oper == Operation::minus )
+    for ( std::size_t i = 0; i < n; ++i ) x[ i ] = -x[ i ];
+  else
+    for ( std::size_t i = 0; i < n; ++i ) x[ i ] = operate( x[ i ], oper );
+}
+
+
+
+// Partial derivatives of the binary operations.
+template < class T >
+inline void Operation::derivative( const T& x, const T& y, const Operation::Op& oper, T& dx, T& dy ) throw( PdfException )
+{
+  if ( oper == Operation::plus )
+  {
+    dx = T( 1 );
+    dy = T( 1 );
+  }
+  else if ( oper == Operation::minus )
+  {
+    dx = T(  1 );
+    dy = T( -1 );
+  }
+  else if ( oper == Operation::mult )
+  {
+    dx = y;
+    dy = x;
+  }
+  else if ( oper == Operation::div )
+  {
+    dx = T( 1 ) / y;
+    dy = - x / ( y * y );
+  }
+  else if ( oper == Operation::pow )
+  {
+    dx = y * std::pow( x, y - T( 1 ) );
+    dy = std::pow( x, y ) * std::log( x );
+  }
+  else
+    throw PdfException( std::string( "Parse error: unknown binary operation " ) + Operation::tostring( oper ) + "." );
+}
+
+
+// Derivatives of the unary operations.
+template < class T >
+inline T Operation::derivative( const T& x, const Operation::Op& oper ) throw( PdfException )
+{
+  if ( oper == Operation::minus )
+    return T( -1 );
+  if ( oper == Operation::exp )
+    return std::exp( x );
+  if ( oper == Operation::log )
+    return T( 1 ) / x;
+  if ( oper == Operation::sin )
+    return std::cos( x );
+  if ( oper == Operation::cos )
+    return - std::sin( x );
+  if ( oper == Operation::tan )
+    return T( 1 ) / ( std::cos( x ) * std::cos( x ) );
+  if ( oper == Operation::tanh )
+    return T( 1 ) / ( std::cosh( x ) * std::cosh( x ) );
+  if ( oper == Operation::atanh )
+    return T( 1 ) / ( T( 1 ) - x * x );
+
+  throw PdfException( std::string( "Parse error: unknown unary operation " ) + Operation::tostring( oper ) + "." );
+}
+
+
 #endif
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <complex>
+#include <algorithm>
 
 class PdfModel;
 class PdfExpr;
@@ -24,6 +25,7 @@ private:
   double      _lower;
   double      _upper;
   bool        _hasLimits;
+  unsigned    _version;   // Number of times the value has changed.
 
 public:
   Parameter()
@@ -34,7 +36,8 @@ public:
       _isBlind  ( false ),
       _lower    ( 0.0   ),
       _upper    ( 0.0   ),
-      _hasLimits( false )
+      _hasLimits( false ),
+      _version  ( 0     )
     {}
 
   Parameter( std::string name, double value = 0., double error = 0. )
@@ -45,7 +48,8 @@ public:
       _isBlind  ( false ),
       _lower    ( 0.0   ),
       _upper    ( 0.0   ),
-      _hasLimits( false )
+      _hasLimits( false ),
+      _version  ( 0     )
     {}
 
   Parameter( const Parameter& right )
@@ -56,17 +60,23 @@ public:
       _isBlind  ( right._isBlind   ),
       _lower    ( right._lower     ),
       _upper    ( right._upper     ),
-      _hasLimits( right._hasLimits )
+      _hasLimits( right._hasLimits ),
+      _version  ( right._version   )
     {}
 
   // Setters.
   void set ( double value, double error = -1. )
   {
-    _value = value;
+    setValue( value );
     if ( error >= 0. )
       _error = error;
   }
-  void setValue( double value ) { _value   = value; }
+  void setValue( double value )
+  {
+    if ( value != _value )
+      ++_version;
+    _value = value;
+  }
   void setError( double error ) { _error   = error; }
   void fix()                    { _isFixed = true;  }
   void release()                { _isFixed = false; }
@@ -91,9 +101,13 @@ public:
   double      upperLimit() const { return   _upper;     }
   double      lower()      const { return   _lower;     }
   double      lowerLimit() const { return   _lower;     }
+  unsigned    version()    const { return   _version;   }
 
   const Parameter& operator=( const Parameter& right )
   {
+    // Keep the version increasing, so that a new value is noticed as a change.
+    _version   = std::max( _version, right._version ) + ( ( _value != right._value ) ? 1 : 0 );
+
     _name      = right._name;
     _value     = right._value;
     _error     = right._error;
@@ -0,0 +1,57 @@
+#ifndef __PARAMETERREGISTRY_HH__
+#define __PARAMETERREGISTRY_HH__
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <cfit/parameter.hh>
+#include <cfit/exceptions.hh>
+
+// Dense numbering of the parameters of a model and their current values. The
+//    parameters are numbered in alphabetical order, which is the order of the
+//    vectors of values passed by the minimizers, so that setting them is a
+//    single copy. The components of the model find the positions of their own
+//    parameters once, with indices(), and then read their values from values()
+//    without looking up any name.
+class ParameterRegistry
+{
+private:
+  std::vector< std::string > _names;
+  std::vector< double >      _values;
+
+public:
+  ParameterRegistry() {}
+
+  ParameterRegistry( const std::map< std::string, Parameter >& pars );
+
+  std::size_t                       size()   const { return _names.size();   }
+  const std::vector< std::string >& names()  const { return _names;          }
+  const double*                     values() const { return _values.data();  }
+
+  // Position of a parameter.
+  unsigned index( const std::string& name ) const throw( PdfException );
+
+  // Positions of the parameters of a map, in its order.
+  template< class Map >
+  std::vector< unsigned > indices( const Map& pars ) const throw( PdfException )
+  {
+    std::vector< unsigned > idx;
+    idx.reserve( pars.size() );
+
+    for ( typename Map::const_iterator par = pars.begin(); par != pars.end(); ++par )
+      idx.push_back( index( par->first ) );
+
+    return idx;
+  }
+
+  // Positions of the given parameters.
+  std::vector< unsigned > indices( const std::vector< std::string >& names ) const throw( PdfException );
+
+  // Set the values of all the parameters, in alphabetical order, or those of
+  //    a map of the same parameters.
+  void set( const std::vector< double >&              values ) throw( PdfException );
+  void set( const std::map< std::string, Parameter >& pars   ) throw( PdfException );
+};
+
+#endif
@@ -6,11 +6,13 @@
 #include <map>
 #include <complex>
 #include <algorithm>
+#include <atomic>
 
 #include <cfit/variable.hh>
 #include <cfit/parameter.hh>
 #include <cfit/exceptions.hh>
 #include <cfit/functors.hh>
+#include <cfit/arena.hh>
 
 
 class Dataset;
@@ -38,9 +40,56 @@ protected:
   std::map< std::string, Variable  > _varMap;
   std::map< std::string, Parameter > _parMap;
 
+  // Versions of the parameters when the cached quantities were last computed by update().
+  std::vector< unsigned > _cachedVersions;
+
+public:
+  // Counters of the cache indices handed out to the models of a pdf while they
+  //    cache values on a dataset. Each minimizer has its own layout, which is
+  //    made current in the calling thread by a Scope, so that the indices of
+  //    every fit are dense and start at zero, whatever other fits the process
+  //    runs at the same time or has run before. Without a scope, each thread
+  //    hands them out from a default layout.
+  struct CacheLayout
+  {
+    unsigned nReal;
+    unsigned nComplex;
+
+    CacheLayout() : nReal( 0 ), nComplex( 0 ) {}
+
+    class Scope
+    {
+    private:
+      CacheLayout* _previous;
+
+    public:
+      Scope( CacheLayout& layout ) : _previous( _layout ) { _layout = &layout; }
+      ~Scope() { _layout = _previous; }
+    };
+  };
+
+private:
+  static thread_local CacheLayout* _layout; // Null for the default layout.
+  static thread_local CacheLayout  _defaultLayout;
+
+  static CacheLayout& layout() { return _layout ? *_layout : _defaultLayout; }
+
 public:
-  static unsigned _cacheIdxReal;
-  static unsigned _cacheIdxComplex;
+  // Next cache indices of the current layout.
+  static unsigned nextCacheIdxReal()    { return layout().nReal++;    }
+  static unsigned nextCacheIdxComplex() { return layout().nComplex++; }
+
+  // Number of the current pass of caching on a dataset, which the minimizers
+  //    advance before each pair of calls to cacheReal and cacheComplex, so that
+  //    models sharing cached values can tell whether they are already there.
+  static std::atomic< unsigned > _cachePass;
+
+  static void beginCachePass() { ++_cachePass; }
+
+  // Pdfs, and the models they are made of, built while an Arena::Scope is
+  //    active are allocated in its arena.
+  static void* operator new   ( std::size_t bytes ) { return Arena::node( bytes ); }
+  static void  operator delete( void*       ptr   ) { Arena::release( ptr );      }
 
   virtual PdfBase* copy() const = 0;
 
@@ -68,16 +117,24 @@ public:
                         []( const std::pair< std::string, Parameter >& par ){ return par.second.isFixed(); } );
   }
 
-  const unsigned& nCachedReal()    const { return _cacheIdxReal;    }
-  const unsigned& nCachedComplex() const { return _cacheIdxComplex; }
+  // Number of cache indices handed out from the current layout.
+  const unsigned nCachedReal()    const { return layout().nReal;    }
+  const unsigned nCachedComplex() const { return layout().nComplex; }
 
-  virtual const unsigned assignCacheIdxReal()    { return _cacheIdxReal++;    }
-  virtual const unsigned assignCacheIdxComplex() { return _cacheIdxComplex++; }
+  virtual const unsigned assignCacheIdxReal()    { return nextCacheIdxReal();    }
+  virtual const unsigned assignCacheIdxComplex() { return nextCacheIdxComplex(); }
 
   // Before evaluating the pdf at all data points, cache anything common to
   //    all points (usually compute the norm).
   virtual void cache() = 0;
 
+  // Call cache() only if some parameter has changed since the last update, such
+  //    that the parts of a fit whose parameters Minuit has not moved are not
+  //    recomputed. invalidate() forces the next update() to call cache().
+  virtual void update();
+  virtual void invalidate() { _cachedVersions.clear(); }
+  bool         changed() const;
+
   // Evaluate functions.
   virtual const double evaluate( const std::vector< double >& vars ) const throw( PdfException ) = 0; // For any pdf.
   virtual const double evaluate( const double& value )               const throw( PdfException )      // For pdfs of a single variable.
@@ -89,8 +146,89 @@ public:
                                  const std::vector< double                 >&     ,
                                  const std::vector< std::complex< double > >&       ) const throw( PdfException ) = 0;
 
+  // Evaluate the pdf at a block of n consecutive events and write the results to out.
+  //    vars holds one pointer per variable, in the order given by varNames(), to the
+  //    values of the first event of the block. cacheR and cacheC hold one pointer per
+  //    cache index to the cached values of the first event of the block.
+  virtual void evaluateBlock( const std::vector< const double*                 >& vars  ,
+                              const std::vector< const double*                 >& cacheR,
+                              const std::vector< const std::complex< double >* >& cacheC,
+                              const std::size_t&                                  n     ,
+                              double*                                             out    ) const throw( PdfException ) = 0;
+
+  // Check, once, that the pdf can be evaluated at nVars variables, e.g. when a
+  //    minimizer binds it to a dataset. Throws if it cannot.
+  virtual void check( const std::size_t& nVars ) const throw( PdfException );
+
+  // Same as evaluateBlock, but without validating its arguments, for the event
+  //    loops of pdfs on which check has succeeded with vars.size() variables.
+  //    Interactive code should call evaluateBlock instead.
+  virtual void evaluateUnchecked( const std::vector< const double*                 >& vars  ,
+                                  const std::vector< const double*                 >& cacheR,
+                                  const std::vector< const std::complex< double >* >& cacheC,
+                                  const std::size_t&                                  n     ,
+                                  double*                                             out    ) const
+  {
+    evaluateBlock( vars, cacheR, cacheC, n, out );
+  }
+
+  // Pdfs whose values are a shape divided by a norm that only update() computes
+  //    may let the shape be evaluated while the norm is computed in another
+  //    thread. splitsNorm() tells whether they do. evaluateShape() works as
+  //    evaluateUnchecked, but without dividing by the norm, and must not read
+  //    anything that update() writes. normFactor() is the norm once updated.
+  virtual bool splitsNorm() const { return false; }
+
+  virtual void evaluateShape( const std::vector< const double*                 >& vars  ,
+                              const std::vector< const double*                 >& cacheR,
+                              const std::vector< const std::complex< double >* >& cacheC,
+                              const std::size_t&                                  n     ,
+                              double*                                             out    ) const
+  {
+    evaluateUnchecked( vars, cacheR, cacheC, n, out );
+  }
+
+  virtual const double normFactor() const { return 1.0; }
+
+  // Scale the number of steps in each direction of the grids on which the pdf
+  //    integrates its norm, e.g. for a fit to a subsample of the events, whose
+  //    statistical precision does not need as precise a norm. Pdfs without such
+  //    grids ignore it.
+  virtual void scaleNormSteps( const double& factor ) {}
+
+  // Bytes of memory used by each of the structures that the pdf keeps, such as
+  //    the values cached at the points of its norm integrals, by name.
+  virtual const std::map< std::string, std::size_t > memory() const { return std::map< std::string, std::size_t >(); }
+
+  // Whether to measure the wall time spent evaluating each of the components of
+  //    the pdf in evaluateBlock, e.g. each of the models of an expression, and
+  //    the times measured since profiling was last set, in seconds. A pdf that
+  //    is not made of components measures nothing.
+  virtual void                        setProfiling( const bool& val = true ) {}
+  virtual const std::vector< double > profile() const { return std::vector< double >(); }
+
+  // Analytic derivatives of the pdf. hasGradient tells whether the derivative with respect
+  //    to a parameter can be computed analytically. cacheGradient computes the terms common
+  //    to all events, and must be called after cache(). evaluateGradient works as evaluateBlock
+  //    and also writes the derivatives: grad holds one pointer per parameter of getPars(),
+  //    which is null for those not requested. Only parameters with hasGradient can be requested.
+  virtual bool hasGradient( const std::string& par ) const { return false; }
+  virtual void cacheGradient() throw( PdfException ) {}
+  virtual void evaluateGradient( const std::vector< const double*                 >& vars  ,
+                                 const std::vector< const double*                 >& cacheR,
+                                 const std::vector< const std::complex< double >* >& cacheC,
+                                 const std::size_t&                                  n     ,
+                                 double*                                             out   ,
+                                 const std::vector< double*                       >& grad   ) const throw( PdfException )
+  {
+    throw PdfException( "PdfBase::evaluateGradient: this pdf does not provide analytic derivatives." );
+  }
+
   virtual const std::map< std::string, double > generate()           const throw( PdfException ) = 0;
 
+  // Generate n events and append them to data. By default, one event at a time.
+  virtual void generate( const std::size_t& n, Dataset& data ) const throw( PdfException );
+
   virtual const double project( const std::string& varName,
                                 const double&      value    ) const throw( PdfException ) = 0;
   virtual const double project( const std::string& var1,
@@ -107,12 +245,45 @@ public:
                                 const double&      val2  ,
                                 const Region&      region   ) const throw( PdfException ) = 0;
 
+  // Projections at n values of a variable, or at n pairs of values of two variables.
+  //    By default project is called once per value. Models that can share the
+  //    integration among all the values override them.
+  virtual void projectBlock( const std::string& varName,
+                             const double*      values ,
+                             const std::size_t& n      ,
+                             double*            out      ) const throw( PdfException );
+  virtual void projectBlock( const std::string& var1,
+                             const std::string& var2,
+                             const double*      val1,
+                             const double*      val2,
+                             const std::size_t& n   ,
+                             double*            out   ) const throw( PdfException );
+
+  // Fraction of the pdf in each of nBins equal bins of varName between min and max,
+  //    or in each of the nBins1 x nBins2 bins of var1 and var2, with the bins of var2
+  //    running fastest. The fraction is one in the bins of a variable that the pdf
+  //    does not depend on. By default the projections are integrated numerically.
+  virtual void projectHist( const std::string& varName,
+                            const double&      min    ,
+                            const double&      max    ,
+                            const unsigned&    nBins  ,
+                            double*            out      ) const throw( PdfException );
+  virtual void projectHist( const std::string& var1  ,
+                            const double&      min1  ,
+                            const double&      max1  ,
+                            const unsigned&    nBins1,
+                            const std::string& var2  ,
+                            const double&      min2  ,
+                            const double&      max2  ,
+                            const unsigned&    nBins2,
+                            double*            out     ) const throw( PdfException );
+
   virtual const double yield() const = 0;
 
+  // Look the variable up in the map, without building the list of names.
   const bool dependsOn( const std::string& var ) const
   {
-    const std::vector< std::string >& vars = varNames();
-    return std::find( vars.begin(), vars.end(), var ) != vars.end();
+    return _varMap.count( var );
   }
 };
 
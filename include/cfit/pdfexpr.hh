@@ -6,6 +6,9 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <functional>
+#include <memory>
+#include <atomic>
 
 #include <cfit/exceptions.hh>
 #include <cfit/parameter.hh>
@@ -13,6 +16,7 @@
 #include <cfit/pdfbase.hh>
 #include <cfit/pdfmodel.hh>
 #include <cfit/operation.hh>
+#include <cfit/membermutex.hh>
 
 
 class FunctionMinimum;
@@ -30,6 +34,64 @@ private:
   std::map< std::string, std::pair< double, double > > _limits;
   double _scale;
 
+  // Compiled form of the expression. Each instruction refers by index to
+  //    the model, parameter value, constant or operation it acts on.
+  struct Instruction
+  {
+    enum Code { model, param, ctnt, binary, unary };
+
+    Code     code;
+    unsigned index;
+
+    Instruction( const Code& c, const unsigned& i ) : code( c ), index( i ) {}
+  };
+
+  std::vector< Instruction >                _tape;
+  std::vector< std::vector< std::size_t > > _pdfVars;   // Index in _varMap of the variables of each model.
+  std::vector< double >                     _parValues; // Current value of each parameter in _parms.
+  std::size_t                               _depth;     // Maximum depth of the value stack.
+  bool                                      _valid;     // Whether the expression leaves exactly one value.
+
+  // Nanoseconds spent evaluating blocks of each model while profiling, added
+  //    up by all the threads that evaluate them. Null when not profiling.
+  std::shared_ptr< std::vector< std::atomic< long long > > > _times;
+
+  // Areas of each model within intervals of its variables, by variable and
+  //    interval, and the versions of the parameters of the model when they
+  //    were computed. They are dropped as soon as any of the versions changes.
+  typedef std::map< std::pair< std::string, std::pair< double, double > >, double > area_map;
+  mutable std::vector< area_map                > _areas;
+  mutable std::vector< std::vector< unsigned > > _areaVersions;
+  mutable MemberMutex                            _areaLock;
+
+  // Area of the model with index pdf between min and max of var, or the value of
+  //    compute() if given, e.g. a projection that does not depend on the point
+  //    and integrates the model within that interval, from the cache if possible.
+  const double modelArea( const std::size_t& pdf, const std::string& var, const double& min, const double& max,
+                          const std::function< double() >& compute = std::function< double() >() ) const throw( PdfException );
+
+  // Projection of the model with index pdf on variables that it does not depend
+  //    on, which is the area within the first limit of region on its variables.
+  const double modelArea( const std::size_t& pdf, const Region& region,
+                          const std::function< double() >& project ) const throw( PdfException );
+
+  // Translate the expression into the tape. Called whenever the expression changes.
+  void compile() throw( PdfException );
+
+  // Update the values of the parameters used by the tape.
+  void bindPars();
+
+  const double evaluateTape( const std::vector< double                 >&  vars  ,
+                             const std::vector< double                 >*  cacheR,
+                             const std::vector< std::complex< double > >*  cacheC  ) const throw( PdfException );
+
+  // Run the tape on blocks of n values, with model( pdf, out ) filling the
+  //    block of values of each model. runTape does not check that the
+  //    expression leaves exactly one value.
+  typedef std::function< void( const std::size_t& pdf, double* out ) > block_type;
+  void evaluateTape( const std::size_t& n, double* out, const block_type& model ) const throw( PdfException );
+  void runTape     ( const std::size_t& n, double* out, const block_type& model ) const;
+
   // Clean up the content of all the PdfExpr containers.
   void clear();
 
@@ -42,7 +104,7 @@ private:
 
   template< class L, class R >
   PdfExpr( const L& left, const R& right, const Operation::Op& oper )
-    : _scale( 1.0 )
+    : _scale( 1.0 ), _depth( 0 ), _valid( false )
   {
     append( left  );
     append( right );
@@ -50,6 +112,7 @@ private:
   }
 
   const std::map< std::string, double > generateFull() const throw( PdfException );
+  void generateFull( const std::size_t& n, Dataset& data ) const throw( PdfException );
 
 
   template < class T >
@@ -63,21 +126,24 @@ private:
   const std::map< unsigned, std::vector< std::complex< double > > > cacheComplex( const Dataset& data );
 
 public:
-  PdfExpr() : _scale( 1.0 ) {};
+  PdfExpr() : _scale( 1.0 ), _depth( 0 ), _valid( false ) {};
   PdfExpr( const PdfModel& model )
-    : _scale( 1.0 )
+    : _scale( 1.0 ), _depth( 0 ), _valid( false )
   {
     append( model );
   }
 
   PdfExpr( const ParameterExpr& expr )
-    : _scale( 1.0 )
+    : _scale( 1.0 ), _depth( 0 ), _valid( false )
   {
     append( expr );
   }
 
   PdfExpr( const PdfExpr& right );
 
+  // Take the models of right, which is left empty, instead of copying them.
+  PdfExpr( PdfExpr&& right );
+
   PdfExpr* copy() const { return new PdfExpr( *this ); }
 
   ~PdfExpr();
@@ -89,13 +155,51 @@ public:
   void setPars( const FunctionMinimum&                    min  ) throw( PdfException );
 
   void         cache();
+
+  // Update and invalidate each of the pdfs in the expression separately, so that
+  //    only those that depend on the parameters that have changed are recomputed.
+  void         update();
+  void         invalidate();
   const double evaluate( const std::vector< double >& vars ) const throw( PdfException );
 
   const std::map< std::string, double > generate() const throw( PdfException );
+
+  // Generate n events and append them to data. The events are split between
+  //    the terms of each sum with binomial draws, and each model generates all
+  //    its events with a single call, so the events of each term of a sum
+  //    come one after the other.
+  void generate( const std::size_t& n, Dataset& data ) const throw( PdfException );
   const double evaluate( const std::vector< double                 >& vars  ,
                          const std::vector< double                 >& cacheR,
                          const std::vector< std::complex< double > >& cacheC  ) const throw( PdfException );
 
+  void evaluateBlock( const std::vector< const double*                 >& vars  ,
+                      const std::vector< const double*                 >& cacheR,
+                      const std::vector< const std::complex< double >* >& cacheC,
+                      const std::size_t&                                  n     ,
+                      double*                                             out    ) const throw( PdfException );
+
+  // Check the expression and each of its models, so that the unchecked
+  //    evaluation of the expression evaluates its models unchecked as well.
+  void check( const std::size_t& nVars ) const throw( PdfException );
+
+  void evaluateUnchecked( const std::vector< const double*                 >& vars  ,
+                          const std::vector< const double*                 >& cacheR,
+                          const std::vector< const std::complex< double >* >& cacheC,
+                          const std::size_t&                                  n     ,
+                          double*                                             out    ) const;
+
+  // Memory of each of the models, with the names of the structures prefixed by
+  //    the name of the model, or by its position in the expression if it has none.
+  const std::map< std::string, std::size_t > memory() const;
+
+  // Scale the norm grids of all the models.
+  void scaleNormSteps( const double& factor );
+
+  // Times of the models, in the order in which they appear in the expression.
+  void                        setProfiling( const bool& val = true );
+  const std::vector< double > profile() const;
+
   const double project( const std::string& varName,
                         const double&      value    ) const throw( PdfException );
   const double project( const std::string& var1,
@@ -112,6 +216,33 @@ public:
                         const double&      val2,
                         const Region&      region   ) const throw( PdfException );
 
+  // Batched projections, combining the batched projections of the models.
+  void projectBlock( const std::string& varName,
+                     const double*      values ,
+                     const std::size_t& n      ,
+                     double*            out      ) const throw( PdfException );
+  void projectBlock( const std::string& var1,
+                     const std::string& var2,
+                     const double*      val1,
+                     const double*      val2,
+                     const std::size_t& n   ,
+                     double*            out   ) const throw( PdfException );
+
+  void projectHist( const std::string& varName,
+                    const double&      min    ,
+                    const double&      max    ,
+                    const unsigned&    nBins  ,
+                    double*            out      ) const throw( PdfException );
+  void projectHist( const std::string& var1  ,
+                    const double&      min1  ,
+                    const double&      max1  ,
+                    const unsigned&    nBins1,
+                    const std::string& var2  ,
+                    const double&      min2  ,
+                    const double&      max2  ,
+                    const unsigned&    nBins2,
+                    double*            out     ) const throw( PdfException );
+
 
   // Not sure if this is a dirty hack.
   void setLimits( const Variable& var, const double& min, const double& max );
@@ -124,6 +255,7 @@ public:
   // Assignment operator.
   const PdfExpr& operator= ( const PdfModel&      right );
   const PdfExpr& operator= ( const PdfExpr&       right );
+  const PdfExpr& operator= ( PdfExpr&&            right );
   const PdfExpr& operator= ( const ParameterExpr& right );
 
   // Assignment operators with pdf objects.
@@ -26,6 +26,8 @@ protected:
   std::vector< std::string > _varOrder;
   std::vector< std::string > _parOrder;
 
+  std::string                _name;     // Name shown in the traces of its evaluation, if any.
+
   void push( const Variable&        var  );
   void push( const Parameter&       par  );
   void push( const Coef&            coef );
@@ -53,6 +55,11 @@ public:
 
   virtual void setParExpr() = 0;
 
+  // Name of the model, e.g. "signal", shown in the traces of its evaluation in an expression.
+  void               setName( const std::string& name ) { _name = name; }
+  const std::string& name()                       const { return _name; }
+  const char*        traceName()                  const { return _name.empty() ? "PdfModel" : _name.c_str(); }
+
   void setPar ( const std::string& name, const double& val, const double& err = -1. ) throw( PdfException );
 
   virtual void setPars( const std::vector< double >&              pars ) throw( PdfException );
@@ -79,15 +86,28 @@ public:
     return evaluate( vars );
   }
 
+  // By default, evaluate a block of events one at a time.
+  virtual void evaluateBlock( const std::vector< const double*                 >& vars  ,
+                              const std::vector< const double*                 >& cacheR,
+                              const std::vector< const std::complex< double >* >& cacheC,
+                              const std::size_t&                                  n     ,
+                              double*                                             out    ) const throw( PdfException );
+
   virtual const std::map< std::string, double > generate()           const throw( PdfException )
   {
     throw PdfException( "Generate error: attempting to generate with a model without generate() implementation" );
   }
 
+  // Do not hide the batch generation defined in PdfBase.
+  using PdfBase::generate;
+
 
   // Calculate the area of single-variable functions within given interval.
   virtual const double area( const double& min, const double& max ) const throw( PdfException );
 
+  // Areas within n intervals ( min[ i ], max[ i ] ). By default, find them one at a time.
+  virtual void areas( const double* min, const double* max, const std::size_t& n, double* out ) const throw( PdfException );
+
 
   // Projection function for pdfs with one single variable.
   virtual const double project( const std::string& varName, const double& value ) const throw( PdfException )
@@ -105,15 +125,10 @@ public:
     if ( this->dependsOn( varName ) )
       return this->evaluate( value );
 
-    typedef const std::map< const std::string, std::pair< double, double > > cspMap;
-
     // Check if there's any variable that should be integrated over some region.
-    cspMap& limits = region.limits();
-    cspMap::const_iterator begin = limits.begin();
-    cspMap::const_iterator end   = limits.end();
-    for ( cspMap::const_iterator limit = begin; limit != end; ++limit )
-      if ( this->dependsOn( limit->first ) )
-        return this->area( limit->second.first, limit->second.second );
+    for ( std::size_t limit = 0; limit < region.size(); ++limit )
+      if ( this->dependsOn( region.name( limit ) ) )
+        return this->area( region.lower( limit ), region.upper( limit ) );
 
     return 1.0;
   }
@@ -150,13 +165,9 @@ public:
       return this->evaluate( vals );
     }
 
-    const   std::map< const std::string, std::pair< double, double > > limits = region.limits();
-    typedef std::map< const std::string, std::pair< double, double > > spMap;
-    typedef spMap::const_iterator                                      spmIter;
-
-    for ( spmIter limit = limits.begin(); limit != limits.end(); ++limit )
-      if ( this->dependsOn( limit->first ) )
-        return this->area( limit->second.first, limit->second.second );
+    for ( std::size_t limit = 0; limit < region.size(); ++limit )
+      if ( this->dependsOn( region.name( limit ) ) )
+        return this->area( region.lower( limit ), region.upper( limit ) );
 
     return 1.0;
   }
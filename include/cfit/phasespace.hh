@@ -2,6 +2,7 @@
 #define __PHASESPACE_HH__
 
 #include <cmath>
+#include <cstddef>
 #include <exception>
 
 class PhaseSpace
@@ -19,8 +20,30 @@ private:
 
   double _mSqSum;
 
+  // Limits of the squared invariant masses over the whole phase space.
+  double _mSq12lower;
+  double _mSq12upper;
+  double _mSq13lower;
+  double _mSq13upper;
+  double _mSq23lower;
+  double _mSq23upper;
+
+  // Constant terms of the limits of one squared invariant mass given another,
+  //    ( mSqMother + mSqI - mSqJ - mSqK )^2 for i = 1, 2, 3.
+  double _first1;
+  double _first2;
+  double _first3;
+
+  void precompute();
+
   static const double kallen( const double& x, const double& y, const double& z );
 
+  // Square roots of the Kallen functions of mSqAB with the squared masses of
+  //    the daughters A and B, and with those of the mother and the daughter C.
+  //    Both limits of mSqAC and mSqBC given mSqAB follow from them.
+  void roots( const double& mSqAB, const double& mSqA, const double& mSqB, const double& mSqC,
+              double& rootAB, double& rootMC ) const;
+
 public:
   PhaseSpace();
   PhaseSpace( const double& mMother, const double& m1, const double& m2, const double& m3 );
@@ -50,12 +73,12 @@ public:
   const double mSq23min( const double& mSq12, const double& mSq13 ) const;
   const double mSq23max( const double& mSq12, const double& mSq13 ) const;
 
-  const double mSq12min() const { return std::pow( _m1      + _m2, 2 ); };
-  const double mSq12max() const { return std::pow( _mMother - _m3, 2 ); };
-  const double mSq13min() const { return std::pow( _m1      + _m3, 2 ); };
-  const double mSq13max() const { return std::pow( _mMother - _m2, 2 ); };
-  const double mSq23min() const { return std::pow( _m2      + _m3, 2 ); };
-  const double mSq23max() const { return std::pow( _mMother - _m1, 2 ); };
+  const double mSq12min() const { return _mSq12lower; };
+  const double mSq12max() const { return _mSq12upper; };
+  const double mSq13min() const { return _mSq13lower; };
+  const double mSq13max() const { return _mSq13upper; };
+  const double mSq23min() const { return _mSq23lower; };
+  const double mSq23max() const { return _mSq23upper; };
 
   const double mSqMin( const unsigned& index ) const
   {
@@ -78,6 +101,19 @@ public:
   // Check if the kinematically allowed region contains a given point.
   bool contains( const double& mSq12, const double& mSq13, const double& mSq23 ) const;
   bool contains( const double& mSq12, const double& mSq13                      ) const;
+
+  // Limits at n points at once, the same as those of the functions above. Each
+  //    pair of limits shares the square roots of a single point.
+  void mSq12limits( const double* mSq13, const std::size_t& n, double* lower, double* upper ) const;
+  void mSq13limits( const double* mSq12, const std::size_t& n, double* lower, double* upper ) const;
+  void mSq23limits( const double* mSq12, const std::size_t& n, double* lower, double* upper ) const;
+  void mSq23limits( const double* mSq12, const double* mSq13, const std::size_t& n, double* lower, double* upper ) const;
+
+  // Mask of the points inside the kinematically allowed region, 1 inside and 0
+  //    outside, with the same decision as the functions above. The square roots
+  //    of each point are computed once for all its limits.
+  void contains( const double* mSq12, const double* mSq13, const double* mSq23, const std::size_t& n, unsigned char* inside ) const;
+  void contains( const double* mSq12, const double* mSq13,                      const std::size_t& n, unsigned char* inside ) const;
 };
 
 #endif
@@ -0,0 +1,68 @@
+#ifndef __PROPAGATORTABLE_HH__
+#define __PROPAGATORTABLE_HH__
+
+#include <vector>
+#include <complex>
+#include <functional>
+
+// Table of the values of a propagator on a uniform grid of squared invariant
+//    masses, evaluated by cubic interpolation of the four nearest nodes. The
+//    number of nodes is doubled until the interpolation error at the midpoints
+//    between them is below the tolerance, relative to the largest value.
+class PropagatorTable
+{
+public:
+  typedef std::function< std::complex< double >( const double& mSqAB ) > function_type;
+
+private:
+  double                                _min;
+  double                                _max;
+  double                                _invStep;
+  double                                _error;
+  std::vector< std::complex< double > > _values;
+
+  std::complex< double > interpolate( const double& mSqAB ) const;
+
+public:
+  PropagatorTable() : _min( 0. ), _max( 0. ), _invStep( 0. ), _error( 0. ) {}
+
+  // Tabulate f between min and max, with at most maxNodes nodes.
+  void build( const function_type& f, const double& min, const double& max,
+              const double& tolerance, const unsigned& maxNodes = 1 << 20 );
+
+  void clear() { _values.clear(); }
+
+  bool empty() const { return _values.empty(); }
+
+  // Largest error relative to the largest value found at the midpoints.
+  const double& error() const { return _error; }
+
+  // Whether mSqAB is inside the tabulated range.
+  bool contains( const double& mSqAB ) const { return ! _values.empty() && ( mSqAB >= _min ) && ( mSqAB <= _max ); }
+
+  std::complex< double > operator()( const double& mSqAB ) const { return interpolate( mSqAB ); }
+};
+
+
+inline std::complex< double > PropagatorTable::interpolate( const double& mSqAB ) const
+{
+  const int    last = int( _values.size() ) - 4;
+  const double pos  = ( mSqAB - _min ) * _invStep;
+
+  // First of the four nodes, with the point between the second and the third if possible.
+  int node = int( pos ) - 1;
+  node = ( node < 0 ) ? 0 : ( ( node > last ) ? last : node );
+
+  // Lagrange weights of the nodes at -1, 0, 1 and 2 relative to the second one.
+  const double t  = pos - node - 1;
+  const double w0 = - t * ( t - 1. ) * ( t - 2. ) / 6.;
+  const double w1 =   ( t + 1. ) * ( t - 1. ) * ( t - 2. ) / 2.;
+  const double w2 = - ( t + 1. ) * t * ( t - 2. ) / 2.;
+  const double w3 =   ( t + 1. ) * t * ( t - 1. ) / 6.;
+
+  const std::complex< double >* v = _values.data() + node;
+
+  return w0 * v[ 0 ] + w1 * v[ 1 ] + w2 * v[ 2 ] + w3 * v[ 3 ];
+}
+
+#endif
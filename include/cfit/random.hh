@@ -2,22 +2,85 @@
 #define __RANDOM_HH__
 
 #include <random>
+#include <cstdint>
 
+// Random numbers for the generation of events. The numbers are drawn from the
+//    stream in use by the calling thread, so that several threads can generate
+//    at the same time. Each thread uses its own default stream, all of them
+//    starting from the same default seed, unless a Scope makes it use another
+//    one. Independent reproducible sequences, such as those of toys generated in
+//    parallel, are obtained from streams numbered from the same seed, e.g.
+//       Random::Stream stream( seed, toy );
+//       Random::Scope  scope ( stream );
+//       pdf.generate();
 class Random
 {
+public:
+  // Engine and the state of the distributions that keep one, which must follow
+  //    the engine for the sequence to be reproducible.
+  class Stream
+  {
+    friend class Random;
+
+  private:
+    std::mt19937_64                     _engine;
+    std::normal_distribution< double > _normal;
+
+  public:
+    Stream() {}
+
+    // Stream number stream of the given seed. Different streams give independent sequences.
+    Stream( const unsigned& seed, const unsigned& stream ) { setSeed( seed, stream ); }
+
+    void setSeed( const unsigned& seed )
+    {
+      _engine.seed( seed );
+      _normal.reset();
+    }
+
+    void setSeed( const unsigned& seed, const unsigned& stream )
+    {
+      std::seed_seq seq{ seed, stream };
+      _engine.seed( seq );
+      _normal.reset();
+    }
+
+    std::mt19937_64& engine() { return _engine; }
+  };
+
+  // Make the calling thread use the given stream until the scope is left.
+  class Scope
+  {
+  private:
+    Stream* _previous;
+
+    Scope( const Scope& );
+    Scope& operator=( const Scope& );
+
+  public:
+    Scope( Stream& stream ) : _previous( _current ) { _current = &stream;   }
+    ~Scope()                                         { _current = _previous; }
+  };
+
 private:
-  static std::mt19937_64                          _engine;
+  static thread_local Stream  _default;
+  static thread_local Stream* _current; // Null for the default stream.
 
-  static std::uniform_real_distribution< double > _uniform;
-  static std::normal_distribution      < double > _normal;
+  static thread_local std::uniform_real_distribution< double > _uniform;
 
 public:
+  // Stream in use by the calling thread.
+  static Stream& stream() { return _current ? *_current : _default; }
+
   static std::mt19937_64& engine()
   {
-    return _engine;
+    return stream()._engine;
   }
 
-  static void setSeed( const unsigned& seed ) { _engine.seed( seed ); }
+  static void setSeed( const unsigned& seed ) { stream().setSeed( seed ); }
+
+  // Seed the stream in use with stream number stream of the given seed.
+  static void setSeed( const unsigned& seed, const unsigned& stream ) { Random::stream().setSeed( seed, stream ); }
 
   static const double flat   ( const double& min = 0.0, const double& max = 1.0 )
   {
@@ -29,12 +92,39 @@ public:
     return min + ( max - min ) * _uniform( engine() );
   }
 
+  // Number of successes in n trials of probability p, e.g. to split events
+  //    between the components of a sum.
+  static std::size_t binomial( const std::size_t& n, const double& p )
+  {
+    return std::binomial_distribution< std::size_t >( n, p )( engine() );
+  }
+
   static const double normal( const double& mu = 0.0, const double& sigma = 1.0 )
   {
-    return mu + sigma * _normal( _engine );
+    Stream& current = stream();
+    return mu + sigma * current._normal( current._engine );
+  }
+
+  // Uniform number in [ 0, 1 ) that only depends on the seed, the stream and the
+  //    counter, e.g. to draw a number for each event whatever the thread or the
+  //    order in which they are visited. It needs no state: the three of them are
+  //    mixed with the finalizer of splitmix64.
+  static const double counter( const unsigned& seed, const unsigned& stream, const std::uint64_t& counter )
+  {
+    const std::uint64_t key = mix( ( std::uint64_t( seed ) << 32 ) | stream );
+
+    return ( mix( key ^ counter ) >> 11 ) * ( 1.0 / 9007199254740992.0 );
+  }
+
+private:
+  static std::uint64_t mix( std::uint64_t value )
+  {
+    value += 0x9e3779b97f4a7c15ULL;
+    value = ( value ^ ( value >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+    value = ( value ^ ( value >> 27 ) ) * 0x94d049bb133111ebULL;
+    return value ^ ( value >> 31 );
   }
 };
 
 
 #endif
-
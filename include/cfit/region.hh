@@ -4,7 +4,46 @@
 
 #include <map>
 #include <string>
+#include <vector>
 #include <utility>
+#include <algorithm>
+
+
+// Limits of a region bound to positions, such as the columns of a dataset or
+//    the variables of a pdf, in flat arrays. A point is inside if the value at
+//    each bound position is strictly between its limits.
+class BoundRegion
+{
+private:
+  std::vector< std::size_t > _index;
+  std::vector< double      > _lower;
+  std::vector< double      > _upper;
+
+public:
+  BoundRegion() {}
+
+  void push( const std::size_t& index, const double& lower, const double& upper )
+  {
+    _index.push_back( index );
+    _lower.push_back( lower );
+    _upper.push_back( upper );
+  }
+
+  std::size_t        size ()                          const { return _index.size(); }
+  const std::size_t& index( const std::size_t& limit ) const { return _index[ limit ]; }
+  const double&      lower( const std::size_t& limit ) const { return _lower[ limit ]; }
+  const double&      upper( const std::size_t& limit ) const { return _upper[ limit ]; }
+
+  bool contains( const double* values ) const
+  {
+    bool inside = true;
+    for ( std::size_t limit = 0; limit < _index.size(); ++limit )
+      inside &= ( values[ _index[ limit ] ] > _lower[ limit ] ) & ( values[ _index[ limit ] ] < _upper[ limit ] );
+
+    return inside;
+  }
+};
+
 
 class Region
 {
@@ -13,6 +52,25 @@ private:
 
   spMap _limits;
 
+  // The same limits in flat arrays, in the order of the names, such that
+  //    loops over them do not walk the map.
+  std::vector< std::string > _names;
+  std::vector< double      > _lower;
+  std::vector< double      > _upper;
+
+  void flatten()
+  {
+    _names.clear();
+    _lower.clear();
+    _upper.clear();
+    for ( spMap::const_iterator limit = _limits.begin(); limit != _limits.end(); ++limit )
+    {
+      _names.push_back( limit->first         );
+      _lower.push_back( limit->second.first  );
+      _upper.push_back( limit->second.second );
+    }
+  }
+
 public:
   Region() {}
 
@@ -20,32 +78,45 @@ public:
   void setLimits( const std::string& name, const std::pair< double, double >& limits )
   {
     _limits[ name ] = limits;
+    flatten();
   }
 
   void setLimits( const std::string& name, const double& lower, const double& upper )
   {
     _limits[ name ] = std::make_pair( lower, upper );
+    flatten();
   }
 
   // Getters.
   const spMap&                       limits     ()                          const { return _limits;               }
   const bool                         hasLimits  ( const std::string& name ) const { return _limits.count( name ); }
-  const std::vector< std::string >   limitedPars()                          const
-  {
-    std::vector< std::string > names;
-
-    typedef std::map< const std::string, std::pair< double, double > >::const_iterator mIter;
-    for ( mIter limit = _limits.begin(); limit != _limits.end(); ++limit )
-      names.push_back( limit->first );
-
-    return names;
-  }
+  const std::vector< std::string >&  limitedPars()                          const { return _names;                }
 
   const std::pair< double, double >& limits     ( const std::string& name ) const
   {
     return _limits.at( name );
   }
+
+  // Flat getters of the limits, in the order of their names.
+  std::size_t        size ()                           const { return _names.size(); }
+  const std::string& name ( const std::size_t& limit ) const { return _names[ limit ]; }
+  const double&      lower( const std::size_t& limit ) const { return _lower[ limit ]; }
+  const double&      upper( const std::size_t& limit ) const { return _upper[ limit ]; }
+
+  // Limits bound to the positions of their names in names. Limits on other names
+  //    are left out.
+  const BoundRegion bind( const std::vector< std::string >& names ) const
+  {
+    BoundRegion bound;
+    for ( std::size_t limit = 0; limit < _names.size(); ++limit )
+    {
+      std::vector< std::string >::const_iterator name = std::find( names.begin(), names.end(), _names[ limit ] );
+      if ( name != names.end() )
+        bound.push( name - names.begin(), _lower[ limit ], _upper[ limit ] );
+    }
+
+    return bound;
+  }
 };
 
 #endif
-
@@ -4,13 +4,15 @@
 #include <map>
 #include <vector>
 #include <complex>
+#include <string>
 
 #include <cfit/parameter.hh>
 #include <cfit/exceptions.hh>
+#include <cfit/phasespace.hh>
+#include <cfit/propagatortable.hh>
 
 class Coef;
 class Amplitude;
-class PhaseSpace;
 
 class Resonance
 {
@@ -25,8 +27,34 @@ protected:
   bool     _helicity;   // Use helicity formalism for angular distribution, instead of Zemach.
   bool     _twoBW;      // Use two Blatt-Weisskopf centrifugal terms, instead of one.
 
+  std::string _name;    // Name shown in the traces of its evaluation, if any.
+
   std::map< std::string, Parameter > _parMap;
   std::vector< std::string >         _parOrder;
+  std::vector< double >              _values;   // Values of the parameters, in the same order.
+
+  // Table of the propagator, and phase space and tolerance to build it again.
+  PropagatorTable _table;
+  PhaseSpace      _tablePs;
+  double          _tableTolerance;
+
+  void buildTable();
+
+  // Angular terms given the squared invariant mass of the resonant pair and the
+  //    difference mSqAC - mSqBC, which is all they depend on for given masses.
+  void zemach  ( const PhaseSpace& ps, const double* mSqAB, const double* diff,
+                 const std::size_t& n, double* out ) const;
+  void helicity( const PhaseSpace& ps, const double* mSqAB, const double* diff,
+                 const std::size_t& n, double* out ) const;
+
+  // Array of the squared invariant mass of the pair that does not contain particle index.
+  static const double* pairMass( const unsigned& index, const double* mSq12, const double* mSq13, const double* mSq23 );
+
+  // Squared Blatt-Weisskopf factors and running width at n points, given the
+  //    squared momenta qSq of the resonant particles at them, and qSq0 at the mass.
+  void blattWeisskopfSq( const double& qSq0, const double* qSq, const std::size_t& n, double* out ) const;
+  void runningWidth    ( const PhaseSpace& ps, const double* mSqAB, const double* qSq,
+                         const std::size_t& n, double* out ) const;
 
 public:
   template <class T>
@@ -42,6 +70,8 @@ public:
     _helicity = false;
     _twoBW    = false;
 
+    _tableTolerance = 0.;
+
     push( mass  );
     push( width );
     push( r     );
@@ -54,6 +84,30 @@ public:
   void useHelicity( const bool helicity = true ) { _helicity = helicity; }
   void useTwoBW   ( const bool twoBW    = true ) { _twoBW    = twoBW;    }
 
+  // Name of the resonance, e.g. "K*(892)", shown in the traces of its evaluation.
+  void               setName( const std::string& name ) { _name = name; }
+  const std::string& name()                       const { return _name; }
+  const char*        traceName()                  const { return _name.empty() ? "Resonance" : _name.c_str(); }
+
+  // Everything that determines the shape of the resonance: its class, pair, spin,
+  //    angular terms, table and the values of its parameters in the order in
+  //    which they were pushed. Subclasses with other members that change the
+  //    shape must add them.
+  virtual const std::string structure() const;
+
+  // Tabulate the propagator over the range of mSqAB allowed by the phase space, with
+  //    the given relative tolerance. The table is built again whenever setPars changes
+  //    the parameters, so it only pays off if they are fixed. A null tolerance
+  //    removes the table.
+  void                   tabulate( const PhaseSpace& ps, const double& tolerance = 1e-6 );
+  const PropagatorTable& table()                                                 const { return _table; }
+
+  // Propagator at mSqAB, interpolated from the table if there is one.
+  std::complex< double > lookup( const PhaseSpace& ps, const double& mSqAB ) const
+  {
+    return _table.contains( mSqAB ) ? _table( mSqAB ) : propagator( ps, mSqAB );
+  }
+
   // For resonances with larger number of parameters, be able to get them by index.
   //    Important: the zeroth extra parameter is the 3rd element in the vector.
   double                                    getPar( const unsigned index ) const;
@@ -61,17 +115,21 @@ public:
 
   const bool   isFixed() const;
 
-  const double mass()   const { return _parMap.find( _parOrder[ 0 ] )->second.value(); }
-  const double m()      const { return _parMap.find( _parOrder[ 0 ] )->second.value(); }
-  const double width()  const { return _parMap.find( _parOrder[ 1 ] )->second.value(); }
-  const double r()      const { return _parMap.find( _parOrder[ 2 ] )->second.value(); }
-  const double radius() const { return _parMap.find( _parOrder[ 2 ] )->second.value(); }
+  const double mass()   const { return _values[ 0 ]; }
+  const double m()      const { return _values[ 0 ]; }
+  const double width()  const { return _values[ 1 ]; }
+  const double r()      const { return _values[ 2 ]; }
+  const double radius() const { return _values[ 2 ]; }
 
   const double mSq()    const { return std::pow( m(), 2 );                             }
   const double mGamma() const { return m() * width();                                  }
 
   void setPars( const std::map< std::string, Parameter >& pars );
 
+  // Set the values of the parameters in the order in which they were pushed.
+  const std::vector< std::string >& parOrder() const { return _parOrder; }
+  void setValues( const std::vector< double >& values );
+
   // AB is the resonant pair, with A the first and B the second particle in the pair.
   //    Order is only relevant for the sign of the Zemach angular term for l = 1.
   // m2ij functions below select the squared invariant mass according to the given
@@ -110,7 +168,86 @@ public:
                                                const double&     mSqAC,
                                                const double&     mSqBC )                                       const;
 
+  // Values at ( mSq12, mSq13, mSq23 ) and at ( mSq13, mSq12, mSq23 ). For a resonance
+  //    in the pair 23 both share the propagator and the centrifugal terms.
+  void                   evaluatePair        ( const PhaseSpace&       ps   ,
+                                               const double&           mSq12,
+                                               const double&           mSq13,
+                                               const double&           mSq23,
+                                               std::complex< double >& dir  ,
+                                               std::complex< double >& cnj   )                                 const;
+
+  // Batch versions of the functions above, over n values stored in arrays. They are
+  //    plain loops that the compiler can vectorise, which it does with the vector
+  //    instructions of the host if SIMD_ON is defined in the makefile.
+  void                   q                   ( const PhaseSpace& ps, const double* mSqAB, const std::size_t& n, double* out ) const;
+  void                   qSq                 ( const PhaseSpace& ps, const double* mSqAB, const std::size_t& n, double* out ) const;
+  void                   p                   ( const PhaseSpace& ps, const double* mSqAB, const std::size_t& n, double* out ) const;
+  void                   pSq                 ( const PhaseSpace& ps, const double* mSqAB, const std::size_t& n, double* out ) const;
+  void                   rho                 ( const PhaseSpace& ps, const double* mSqAB, const std::size_t& n, double* out ) const;
+  void                   runningWidth        ( const PhaseSpace& ps, const double* mSqAB, const std::size_t& n, double* out ) const;
+  void                   blattWeisskopfPrime ( const PhaseSpace& ps, const double* mSqAB, const std::size_t& n, double* out ) const;
+  void                   blattWeisskopfPrimeP( const PhaseSpace& ps, const double* mSqAB, const std::size_t& n, double* out ) const;
+  void                   blattWeisskopf      ( const PhaseSpace& ps, const double* mSqAB, const std::size_t& n, double* out ) const;
+  void                   zemach              ( const PhaseSpace& ps,
+                                               const double*     mSqAB,
+                                               const double*     mSqAC,
+                                               const double*     mSqBC,
+                                               const std::size_t& n,
+                                               double*           out   )                                       const;
+  void                   helicity            ( const PhaseSpace& ps,
+                                               const double*     mSqAB,
+                                               const double*     mSqAC,
+                                               const double*     mSqBC,
+                                               const std::size_t& n,
+                                               double*           out   )                                       const;
+
+  // Values at n points. Those at points outside the phase space are meaningless.
+  void                   evaluate            ( const PhaseSpace&       ps   ,
+                                               const double*           mSq12,
+                                               const double*           mSq13,
+                                               const double*           mSq23,
+                                               const std::size_t&      n    ,
+                                               std::complex< double >* out   )                                 const;
+
+  // Columns of kinematics, that only depend on the masses of the particles. They
+  //    can be computed once for a set of points that does not change, such as the
+  //    events of a dataset or the points of a grid, and reused whatever the
+  //    parameters. All resonances have mSqAC - mSqBC, qSq and pSq, followed by
+  //    the columns that the propagator of each of them needs.
+  static const std::size_t nCommonKinematics = 3;
+
+  virtual std::size_t    nKinematics()                                                           const { return nCommonKinematics; }
+
+  // Fill the nKinematics() columns in kin with the kinematics at n points.
+  virtual void           kinematics          ( const PhaseSpace&       ps   ,
+                                               const double*           mSq12,
+                                               const double*           mSq13,
+                                               const double*           mSq23,
+                                               const std::size_t&      n    ,
+                                               double* const*          kin   )                                 const;
+
+  // Values at n points, given their kinematics as filled by kinematics().
+  void                   evaluate            ( const PhaseSpace&       ps   ,
+                                               const double*           mSq12,
+                                               const double*           mSq13,
+                                               const double*           mSq23,
+                                               const double* const*    kin  ,
+                                               const std::size_t&      n    ,
+                                               std::complex< double >* out   )                                 const;
+
   virtual std::complex< double > propagator( const PhaseSpace& ps, const double& mSqAB ) const = 0;
+
+  // Propagator at n values of mSqAB. By default it calls propagator at each of them.
+  virtual void                   propagators( const PhaseSpace& ps, const double* mSqAB, const std::size_t& n,
+                                              std::complex< double >* out ) const;
+
+  // Propagator at n values of mSqAB, given their kinematics. The terms that only
+  //    depend on the parameters are computed once for all of them. By default the
+  //    kinematics are ignored.
+  virtual void                   propagators( const PhaseSpace& ps, const double* mSqAB, const double* const* kin,
+                                              const std::size_t& n, std::complex< double >* out ) const;
+
   virtual Resonance*             copy()                                                  const = 0;
 
   // Operations of resonances with themselves.
@@ -152,12 +289,14 @@ inline Resonance::Resonance( const char&      resoA, const char&      resoB,
 {
   _resoA  = std::tolower( resoA ) - 'a' + 1;
   _resoB  = std::tolower( resoB ) - 'a' + 1;
-  _noRes  = 6 - resoA - resoB;
+  _noRes  = 6 - _resoA - _resoB;
   _l      = l;
 
   _helicity = false;
   _twoBW    = false;
 
+  _tableTolerance = 0.;
+
   push( mass  );
   push( width );
   push( r     );
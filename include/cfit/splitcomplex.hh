@@ -0,0 +1,51 @@
+#ifndef __SPLITCOMPLEX_HH__
+#define __SPLITCOMPLEX_HH__
+
+#include <complex>
+#include <cstddef>
+
+// Operations on arrays of complex numbers stored as separate arrays of real and
+//    imaginary parts. The loops only read and write contiguous arrays of doubles
+//    and do not go through the complex multiplication of the standard library,
+//    which has to check for infinities and NaNs, so that they run at the full
+//    width of the vector instructions.
+class SplitComplex
+{
+public:
+  // Real and imaginary parts of n complex numbers.
+  static void split( const std::complex< double >* in, const std::size_t& n, double* re, double* im )
+  {
+    for ( std::size_t point = 0; point < n; ++point )
+    {
+      re[ point ] = std::real( in[ point ] );
+      im[ point ] = std::imag( in[ point ] );
+    }
+  }
+
+  // Products w a conj( b ), with w one if they are not given. Each point is
+  //    computed in a single pass, with all the values read before any is written.
+  static void product( const double* w,
+                       const double* aRe, const double* aIm,
+                       const double* bRe, const double* bIm,
+                       const std::size_t& n, double* outRe, double* outIm )
+  {
+    if ( w )
+      for ( std::size_t point = 0; point < n; ++point )
+      {
+        const double re = w[ point ] * ( aRe[ point ] * bRe[ point ] + aIm[ point ] * bIm[ point ] );
+        const double im = w[ point ] * ( aIm[ point ] * bRe[ point ] - aRe[ point ] * bIm[ point ] );
+        outRe[ point ] = re;
+        outIm[ point ] = im;
+      }
+    else
+      for ( std::size_t point = 0; point < n; ++point )
+      {
+        const double re = aRe[ point ] * bRe[ point ] + aIm[ point ] * bIm[ point ];
+        const double im = aIm[ point ] * bRe[ point ] - aRe[ point ] * bIm[ point ];
+        outRe[ point ] = re;
+        outIm[ point ] = im;
+      }
+  }
+};
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef __STATICAMPLITUDE_HH__
+#define __STATICAMPLITUDE_HH__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <complex>
+#include <algorithm>
+
+#include <cfit/parameter.hh>
+#include <cfit/coef.hh>
+#include <cfit/resonance.hh>
+#include <cfit/phasespace.hh>
+
+
+// Amplitudes whose structure is fixed at compile time. An expression such as
+//       auto amp = coefRho * staticReso( rho ) + coefKst * staticReso( kstar );
+//    with resonances of known classes is a tree of nodes whose type encodes the
+//    whole expression, so that its evaluation over a block of points is a single
+//    function that the compiler can inline, without the tape of Amplitude. It is
+//    optional: Amplitude is still the way to build models at run time.
+//
+// Each node evaluates itself at n points into out, and may use the scratch
+//    array, that must hold at least scratch * n values.
+template< class E >
+class StaticNode
+{
+public:
+  const E& self() const { return static_cast< const E& >( *this ); }
+  E&       self()       { return static_cast<       E& >( *this ); }
+};
+
+
+// Resonance of class R. It is held by value, so its class is known wherever it
+//    is evaluated.
+template< class R >
+class StaticReso : public StaticNode< StaticReso< R > >
+{
+private:
+  R _reso;
+
+public:
+  static const unsigned scratch = 0;
+
+  explicit StaticReso( const R& reso ) : _reso( reso ) {}
+
+  const R& resonance() const { return _reso; }
+
+  void collect( std::map< std::string, Parameter >& pars ) const
+  {
+    const std::map< std::string, Parameter >& resoPars = _reso.getPars();
+    pars.insert( resoPars.begin(), resoPars.end() );
+  }
+
+  void setPars( const std::map< std::string, Parameter >& pars ) { _reso.setPars( pars ); }
+
+  void evaluate( const PhaseSpace& ps,
+                 const double* mSq12, const double* mSq13, const double* mSq23,
+                 const std::size_t& n, std::complex< double >* out, std::complex< double >* ) const
+  {
+    _reso.evaluate( ps, mSq12, mSq13, mSq23, n, out );
+  }
+};
+
+
+// Node multiplied by a coefficient, whose value is only computed when the
+//    parameters change.
+template< class E >
+class StaticScaled : public StaticNode< StaticScaled< E > >
+{
+private:
+  Coef                   _coef;
+  std::complex< double > _value;
+  E                      _node;
+
+public:
+  static const unsigned scratch = E::scratch;
+
+  StaticScaled( const Coef& coef, const E& node ) : _coef( coef ), _value( coef.value() ), _node( node ) {}
+
+  void collect( std::map< std::string, Parameter >& pars ) const
+  {
+    pars[ _coef.real().name() ] = _coef.real();
+    pars[ _coef.imag().name() ] = _coef.imag();
+    _node.collect( pars );
+  }
+
+  void setPars( const std::map< std::string, Parameter >& pars )
+  {
+    _coef.setValue( pars.find( _coef.real().name() )->second.value(),
+                    pars.find( _coef.imag().name() )->second.value() );
+    _value = _coef.value();
+    _node.setPars( pars );
+  }
+
+  void evaluate( const PhaseSpace& ps,
+                 const double* mSq12, const double* mSq13, const double* mSq23,
+                 const std::size_t& n, std::complex< double >* out, std::complex< double >* scratch ) const
+  {
+    _node.evaluate( ps, mSq12, mSq13, mSq23, n, out, scratch );
+    for ( std::size_t entry = 0; entry < n; ++entry )
+      out[ entry ] *= _value;
+  }
+};
+
+
+// Sum and product of two nodes. The right one is evaluated into the first
+//    block of the scratch array, and the rest of it is left to the two nodes.
+template< class L, class R >
+class StaticSum : public StaticNode< StaticSum< L, R > >
+{
+private:
+  L _left;
+  R _right;
+
+public:
+  static const unsigned scratch = ( L::scratch > R::scratch + 1 ) ? L::scratch : R::scratch + 1;
+
+  StaticSum( const L& left, const R& right ) : _left( left ), _right( right ) {}
+
+  void collect( std::map< std::string, Parameter >& pars ) const { _left.collect( pars ); _right.collect( pars ); }
+  void setPars( const std::map< std::string, Parameter >& pars ) { _left.setPars( pars ); _right.setPars( pars ); }
+
+  void evaluate( const PhaseSpace& ps,
+                 const double* mSq12, const double* mSq13, const double* mSq23,
+                 const std::size_t& n, std::complex< double >* out, std::complex< double >* scratch ) const
+  {
+    _left .evaluate( ps, mSq12, mSq13, mSq23, n, out    , scratch     );
+    _right.evaluate( ps, mSq12, mSq13, mSq23, n, scratch, scratch + n );
+    for ( std::size_t entry = 0; entry < n; ++entry )
+      out[ entry ] += scratch[ entry ];
+  }
+};
+
+
+template< class L, class R >
+class StaticProd : public StaticNode< StaticProd< L, R > >
+{
+private:
+  L _left;
+  R _right;
+
+public:
+  static const unsigned scratch = ( L::scratch > R::scratch + 1 ) ? L::scratch : R::scratch + 1;
+
+  StaticProd( const L& left, const R& right ) : _left( left ), _right( right ) {}
+
+  void collect( std::map< std::string, Parameter >& pars ) const { _left.collect( pars ); _right.collect( pars ); }
+  void setPars( const std::map< std::string, Parameter >& pars ) { _left.setPars( pars ); _right.setPars( pars ); }
+
+  void evaluate( const PhaseSpace& ps,
+                 const double* mSq12, const double* mSq13, const double* mSq23,
+                 const std::size_t& n, std::complex< double >* out, std::complex< double >* scratch ) const
+  {
+    _left .evaluate( ps, mSq12, mSq13, mSq23, n, out    , scratch     );
+    _right.evaluate( ps, mSq12, mSq13, mSq23, n, scratch, scratch + n );
+    for ( std::size_t entry = 0; entry < n; ++entry )
+      out[ entry ] *= scratch[ entry ];
+  }
+};
+
+
+template< class R >
+inline const StaticReso< R > staticReso( const R& reso )
+{
+  return StaticReso< R >( reso );
+}
+
+template< class E >
+inline const StaticScaled< E > operator*( const Coef& left, const StaticNode< E >& right )
+{
+  return StaticScaled< E >( left, right.self() );
+}
+
+template< class E >
+inline const StaticScaled< E > operator*( const StaticNode< E >& left, const Coef& right )
+{
+  return StaticScaled< E >( right, left.self() );
+}
+
+template< class L, class R >
+inline const StaticSum< L, R > operator+( const StaticNode< L >& left, const StaticNode< R >& right )
+{
+  return StaticSum< L, R >( left.self(), right.self() );
+}
+
+template< class L, class R >
+inline const StaticProd< L, R > operator*( const StaticNode< L >& left, const StaticNode< R >& right )
+{
+  return StaticProd< L, R >( left.self(), right.self() );
+}
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef __THREADPOOL_HH__
+#define __THREADPOOL_HH__
+
+#include <vector>
+#include <utility>
+#include <functional>
+#include <exception>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Pool of worker threads that execute the tasks of a range in parallel.
+//    run() hands tasks out in increasing order, with the calling thread
+//    taking part, and does not return until they are all finished.
+//
+// The threads of a pinned pool are bound each to one of the cores that the
+//    process may run on, in order, the calling thread only while it executes
+//    tasks. runRanges() then gives each thread the same tasks at every call,
+//    so that each one only touches the memory it has placed on its own NUMA
+//    node. With MPI, one process bound to each socket keeps all the threads
+//    of a pool on the same one.
+class ThreadPool
+{
+public:
+  typedef std::function< void( const std::size_t& task, const unsigned& thread ) > task_type;
+
+private:
+  std::vector< std::thread > _threads;
+
+  std::mutex              _mutex;
+  std::condition_variable _start;
+  std::condition_variable _done;
+
+  const task_type*   _task;
+  std::size_t        _nTasks;
+  std::size_t        _next;     // Next task to be handed out.
+  std::size_t        _finished; // Number of finished tasks.
+  unsigned           _round;    // Number of calls to run, to wake up the workers.
+  bool               _stop;
+  bool               _ranges;   // Whether each thread executes its own range of tasks.
+
+  // Cores that the threads are bound to, empty if the pool is not pinned.
+  std::vector< unsigned > _cores;
+
+  std::exception_ptr _error;    // First exception thrown by a task.
+
+  void work( const unsigned thread );
+  void execute( const unsigned& thread, std::unique_lock< std::mutex >& lock );
+  void call   ( const std::size_t& task, const unsigned& thread, std::unique_lock< std::mutex >& lock );
+  void start  ( const std::size_t& nTasks, const task_type& task, const bool& ranges, const std::function< void() >& first );
+
+  // Bind the calling thread to the core of the given thread, if pinned.
+  void pin( const unsigned& thread ) const;
+
+  ThreadPool( const ThreadPool& );
+  ThreadPool& operator=( const ThreadPool& );
+
+public:
+  // The pool has nThreads threads in total, including the calling one.
+  ThreadPool( const unsigned& nThreads, const bool& pinned = false );
+  ~ThreadPool();
+
+  unsigned size()   const { return _threads.size() + 1; }
+  bool     pinned() const { return ! _cores.empty();    }
+
+  // Range of tasks [ first, end ) that thread number thread executes in runRanges().
+  static std::pair< std::size_t, std::size_t > range( const std::size_t& nTasks, const unsigned& nThreads, const unsigned& thread )
+  {
+    return std::make_pair( nTasks * thread / nThreads, nTasks * ( thread + 1 ) / nThreads );
+  }
+
+  // Execute task( i, thread ) for all i in [ 0, nTasks ). The first exception
+  //    thrown by any task is rethrown once all the tasks have finished. If first
+  //    is given, the calling thread executes it before taking part in the tasks,
+  //    while the other threads have already started on them.
+  void run( const std::size_t& nTasks, const task_type& task,
+            const std::function< void() >& first = std::function< void() >() );
+
+  // Execute the tasks split in as many consecutive ranges as threads, each
+  //    thread executing those in its range given by range().
+  void runRanges( const std::size_t& nTasks, const task_type& task,
+                  const std::function< void() >& first = std::function< void() >() );
+};
+
+#endif
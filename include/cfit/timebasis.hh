@@ -0,0 +1,31 @@
+#ifndef __TIMEBASIS_HH__
+#define __TIMEBASIS_HH__
+
+#include <complex>
+#include <cstddef>
+
+// Time dependence of the decay rate of a neutral meson that mixes, with width
+//    Gamma and mixing parameters x and y, in the basis of the three functions
+//       psip = exp( - ( 1 - x ) Gamma t ),
+//       psim = exp( - ( 1 + x ) Gamma t ),
+//       psii = exp( - ( 1 - i y ) Gamma t ),
+//    which multiply | A + Abar |^2, | A - Abar |^2 and their interference.
+//    Any model whose amplitude evolves as a combination of exp( - ( 1 +- x ) Gamma t / 2 )
+//    with phases +- y Gamma t / 2 can be written in it, so the time-dependent
+//    Dalitz models share these functions.
+class TimeBasis
+{
+public:
+  // The three functions at time t, which share exp( - Gamma t ).
+  static void evaluate( const double& t, const double& gamma, const double& x, const double& y,
+                        double& psip, double& psim, std::complex< double >& psii );
+
+  // The three functions at n times, convolved with Gaussians of widths sigma if
+  //    given, with the values of exp( - t^2 / 2 sigma^2 ) taken from gauss if
+  //    given. Times with zero width have perfect resolution.
+  static void evaluate( const double* t, const double* sigma, const double* gauss, const std::size_t& n,
+                        const double& gamma, const double& x, const double& y,
+                        double* psip, double* psim, std::complex< double >* psii );
+};
+
+#endif
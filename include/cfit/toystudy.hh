@@ -0,0 +1,99 @@
+#ifndef __TOYSTUDY_HH__
+#define __TOYSTUDY_HH__
+
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+#include <functional>
+
+#include <cfit/pdfbase.hh>
+#include <cfit/pdfmodel.hh>
+#include <cfit/pdfexpr.hh>
+#include <cfit/parameter.hh>
+#include <cfit/dataset.hh>
+#include <cfit/minimizer.hh>
+#include <cfit/fitconfig.hh>
+#include <cfit/exceptions.hh>
+
+// Study of toy samples generated from a pdf and fitted back with an Nll, e.g.
+//    ToyStudy study( pdf, 5000 );
+//    study.setThreads( 8 );
+//    study.run( 10000 );
+//    study.write( "toys.txt" );
+//
+// The toys are distributed over the threads, each of which generates and fits
+//    its toys one after the other with its own copy of the pdf and a single Nll,
+//    so that the quantities cached by the pdf that do not depend on its free
+//    parameters, such as the norm integrals of fixed resonances, are reused by
+//    all of them. Toy number i is generated from stream i of the seed, so the
+//    results do not depend on the number of threads.
+class ToyStudy
+{
+public:
+  // Result of the fit of a toy. values and errors are those of all the
+  //    parameters of the pdf, in the order of getPars().
+  struct Result
+  {
+    unsigned              toy;
+    bool                  valid;
+    double                fval;
+    double                edm;
+    unsigned              nfcn;
+    unsigned              nEvents;
+    std::vector< double > values;
+    std::vector< double > errors;
+  };
+
+private:
+  // Function that builds the Nll of a toy, from a pdf of the same type as the given one.
+  typedef std::function< Minimizer*( const PdfBase& pdf, const std::shared_ptr< const Dataset >& data ) > nll_type;
+
+  std::unique_ptr< PdfBase > _pdf;
+  nll_type                   _nll;
+
+  // Values of the parameters with which the toys are generated.
+  std::map< std::string, Parameter > _truth;
+
+  unsigned  _nEvents;
+  bool      _poisson;
+  unsigned  _seed;
+  unsigned  _nThreads;
+  FitConfig _config;
+
+  std::vector< Result > _results;
+
+  // Generate the events of toy number toy with the given pdf.
+  const std::shared_ptr< const Dataset > generate( const PdfBase& pdf, const unsigned& toy ) const throw( PdfException );
+
+  ToyStudy( const ToyStudy& );
+  ToyStudy& operator=( const ToyStudy& );
+
+public:
+  ToyStudy( const PdfModel& pdf, const unsigned& nEvents, const unsigned& seed = 0 );
+  ToyStudy( const PdfExpr&  pdf, const unsigned& nEvents, const unsigned& seed = 0 );
+
+  // Whether the number of events of each toy follows a Poisson distribution of mean nEvents.
+  void setPoisson( const bool&     val = true ) { _poisson  = val;      }
+
+  // Number of threads. Zero means as many as the hardware supports.
+  void setThreads( const unsigned& nThreads   ) { _nThreads = nThreads; }
+
+  // Sequence of Minuit calls of the fits, e.g. strategy 0 with a retry.
+  void setConfig ( const FitConfig& config    ) { _config   = config;   }
+
+  const std::map< std::string, Parameter >& truth()   const { return _truth;   }
+  const std::vector< Result >&              results() const { return _results; }
+
+  // Generate and fit nToys toys, numbered from first, and append their results.
+  void run( const unsigned& nToys, const unsigned& first = 0 ) throw( PdfException );
+
+  // Pull of free parameter name in each of the toys, ( value - truth ) / error.
+  std::vector< double > pulls( const std::string& name ) const throw( PdfException );
+
+  // Write one line per toy with its status and the value, error and pull of each
+  //    free parameter, after a header line with the names of the columns.
+  void write( const std::string& file ) const throw( PdfException );
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef __TRACE_HH__
+#define __TRACE_HH__
+
+#include <atomic>
+
+// Receiver of the named ranges of the evaluation annotated for external
+//    profilers, e.g. one that forwards them to the task API of VTune, to the
+//    zones of Tracy or to markers of perf. begin and end are called by every
+//    thread that runs a range, in the thread itself, so they must be thread safe.
+//    The name of a range stays valid until its end.
+class TraceSink
+{
+public:
+  virtual ~TraceSink() {}
+
+  virtual void begin( const char* name ) = 0;
+  virtual void end  ( const char* name ) = 0;
+};
+
+
+// Sink of the traces, if any, and range that lasts for the scope of a Scope.
+//    The ranges are reported around the evaluation of each model of a PdfExpr,
+//    of each resonance and F vector of an Amplitude, of each norm integration on
+//    a grid and of each MPI collective, so that profiles show them by name, e.g.
+//       kst.setName( "K*(892)" );
+//       Trace::setSink( &sink );
+//
+// The annotations are only compiled in with TRACE_ON. Otherwise TRACE_SCOPE
+//    expands to nothing, together with the expression of its name.
+class Trace
+{
+private:
+  static std::atomic< TraceSink* > _sink;
+
+public:
+  static void       setSink( TraceSink* sink ) { _sink = sink; }
+  static TraceSink* sink()                     { return _sink; }
+
+  class Scope
+  {
+  private:
+    TraceSink*  _sink;
+    const char* _name;
+
+    Scope( const Scope& );
+    Scope& operator=( const Scope& );
+
+  public:
+    Scope( const char* name )
+      : _sink( Trace::sink() ), _name( name )
+    {
+      if ( _sink )
+        _sink->begin( _name );
+    }
+
+    ~Scope()
+    {
+      if ( _sink )
+        _sink->end( _name );
+    }
+  };
+};
+
+
+#ifdef TRACE_ON
+#define TRACE_CONCAT_( a, b ) a##b
+#define TRACE_CONCAT( a, b )  TRACE_CONCAT_( a, b )
+#define TRACE_SCOPE( name )   const Trace::Scope TRACE_CONCAT( traceScope, __LINE__ )( name )
+#else
+#define TRACE_SCOPE( name )
+#endif
+
+#endif
@@ -2,6 +2,7 @@
 #define __VARIABLE_HH__
 
 #include <string>
+#include <vector>
 
 class Parameter;
 class ParameterExpr;
@@ -29,6 +30,7 @@ public:
 
   // Binary operations that need access to this class.
   friend const Function pow( const Variable& left, const double& right );
+  friend const Function chebyshev( const Variable& arg, const std::vector< double >& coefs, const double& lower, const double& upper );
 
   // Operations with variables with themselves.
   friend const Function operator+( const Variable&      left, const Variable&      right );
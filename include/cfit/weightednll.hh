@@ -0,0 +1,117 @@
+#ifndef __WEIGHTEDNLL_HH__
+#define __WEIGHTEDNLL_HH__
+
+#include <vector>
+#include <memory>
+
+#include <cfit/minimizer.hh>
+#include <cfit/pdfbase.hh>
+#include <cfit/variable.hh>
+#include <cfit/dataset.hh>
+#include <cfit/exceptions.hh>
+
+// Nll in which the term of each event is multiplied by its weight, read from
+//    the column of the dataset given by w, e.g. for background subtracted fits
+//    with sWeights:
+//       - 2 Sum( w log( pdf ) ) + 2 yield.
+//
+// The sums of the weights and of their squares are computed when the dataset
+//    is set. With the sum of weights squared correction, the nll is multiplied
+//    by Sum( w ) / Sum( w^2 ), so that the errors given by up = 1 approximately
+//    account for the statistical power of the weighted sample.
+//
+// Bootstrap replicas of the dataset are weights drawn for its events, e.g.
+//       std::vector< WeightedNll::Replica > fits = nll.bootstrap( 500, seed, min );
+//    so that all of them are fitted on the same dataset and cached values.
+class WeightedNll : public Minimizer
+{
+public:
+  // Fit of a bootstrap replica, with the values of all the parameters at the
+  //    minimum, in the order of getPars().
+  struct Replica
+  {
+    unsigned              replica;
+    bool                  valid;
+    double                fval;
+    std::vector< double > values;
+  };
+
+private:
+  const Variable _w;
+
+  bool _sumW2;
+
+  std::size_t _wColumn;
+  double      _sumW;
+  double      _sumW2Weights;
+
+  // Number of times each event is drawn in the bootstrap replica in use, if any.
+  std::shared_ptr< const std::vector< unsigned char > > _draws;
+  unsigned                                              _seed;
+  unsigned                                              _replica;
+
+  void cacheWeights();
+  void drawReplica();
+
+  // Keep the weights and the draws of the selected events.
+  void select( const std::vector< std::size_t >& entries ) throw( PdfException );
+
+  // Factor that multiplies the nll.
+  double scale() const { return _sumW2 ? _sumW / _sumW2Weights : 1.0; }
+
+public:
+  WeightedNll( const PdfModel& pdf, const Variable& w, const Dataset& data );
+  WeightedNll( const PdfExpr&  pdf, const Variable& w, const Dataset& data );
+
+  // Weighted nll of the entries selected by a view.
+  WeightedNll( const PdfModel& pdf, const Variable& w, const DatasetView& data );
+  WeightedNll( const PdfExpr&  pdf, const Variable& w, const DatasetView& data );
+
+  // Weighted nll of a dataset shared with its owner, which is not copied.
+  WeightedNll( const PdfModel& pdf, const Variable& w, const std::shared_ptr< const Dataset >& data );
+  WeightedNll( const PdfExpr&  pdf, const Variable& w, const std::shared_ptr< const Dataset >& data );
+
+  WeightedNll( const WeightedNll& nll );
+
+  WeightedNll* copy() const { return new WeightedNll( *this ); }
+
+  void setData( const std::shared_ptr< const Dataset >& data );
+  void append ( const Dataset& events ) throw( PdfException );
+
+  // Whether to apply the sum of weights squared correction.
+  void setSumW2( const bool& val = true ) { _sumW2 = val; }
+
+  const double& sumW()  const { return _sumW;         }
+  const double& sumW2() const { return _sumW2Weights; }
+
+  // Use bootstrap replica number replica of the given seed, in which the weight
+  //    of each event is multiplied by the number of times it is drawn, from a
+  //    Poisson distribution of mean one. The draws only depend on the seed, the
+  //    replica and the position of the event, and take a byte per event. The
+  //    sums of the weights include them.
+  void setReplica  ( const unsigned& seed, const unsigned& replica );
+  void clearReplica();
+
+  const bool resampled() const { return bool( _draws ); }
+
+  // Fits of the replicas 0, ..., nReplicas - 1 of the given seed, started from
+  //    a minimum, usually that of the fit to the whole dataset. They are
+  //    distributed over config().bootThreads() copies of the nll, which share
+  //    the dataset and the cached values, and are returned in the order of the
+  //    replicas.
+  std::vector< Replica > bootstrap( const std::size_t& nReplicas, const unsigned& seed, const FunctionMinimum& start ) const throw( PdfException );
+
+  double operator()( const std::vector<double>& par ) const throw( PdfException );
+
+  // Gradient of the weighted nll, analytic for the parameters for which the pdf
+  //    provides derivatives and numeric for the rest, as that of Nll.
+  std::vector< double > gradient( const std::vector< double >& pars ) const throw( PdfException );
+
+  // Sandwich covariance H^-1 C H^-1 of the weighted fit, with H and C the sums
+  //    over the events of the outer products of their scores times w and w^2,
+  //    respectively. It does not depend on the sum of weights squared correction.
+  MnUserCovariance scoreCovariance( const std::vector< double >& pars ) const throw( PdfException );
+  using Minimizer::scoreCovariance;
+};
+
+#endif
@@ -0,0 +1,333 @@
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include <cfit/adaptiveintegrator.hh>
+#include <cfit/compensatedsum.hh>
+#include <cfit/trace.hh>
+
+
+// Nodes of the 15-point Kronrod rule on [ -1, 1 ], with the 7-point Gauss rule
+//    on the odd ones and the centre, and their weights.
+static const double kronrodNodes[ 8 ] = { 0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+                                          0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+                                          0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+                                          0.207784955007898467600689403773245, 0.000000000000000000000000000000000 };
+
+static const double kronrodWeights[ 8 ] = { 0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+                                            0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+                                            0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+                                            0.204432940075298892414161999234649, 0.209482141084727828012999174891714 };
+
+static const double gaussWeights[ 4 ] = { 0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+                                          0.381830050505118944950369775488975, 0.417959183673469387755102040816327 };
+
+// Nodes of the 17-point rule of Genz and Malik on [ -1, 1 ]^2: the centre, the
+//    two points at +-lambda2 and at +-lambda4 on each axis, the four at
+//    ( +-lambda4, +-lambda4 ) and the four at ( +-lambda5, +-lambda5 ). Their
+//    weights of degree 7 and 5 are normalised to the area of the square.
+static const double lambda2 = std::sqrt( 9.0 / 70.0 );
+static const double lambda4 = std::sqrt( 9.0 / 10.0 );
+static const double lambda5 = std::sqrt( 9.0 / 19.0 );
+
+static const double genzMalikX[ 17 ] = { 0.0,
+                                         - lambda2, lambda2, 0.0, 0.0,
+                                         - lambda4, lambda4, 0.0, 0.0,
+                                         - lambda4, lambda4, - lambda4, lambda4,
+                                         - lambda5, lambda5, - lambda5, lambda5 };
+
+static const double genzMalikY[ 17 ] = { 0.0,
+                                         0.0, 0.0, - lambda2, lambda2,
+                                         0.0, 0.0, - lambda4, lambda4,
+                                         - lambda4, - lambda4, lambda4, lambda4,
+                                         - lambda5, - lambda5, lambda5, lambda5 };
+
+static const double genzMalik7[ 5 ] = { - 3816.0 / 19683.0, 980.0 / 6561.0, 1020.0 / 19683.0, 200.0 / 19683.0, 6859.0 / 78732.0 };
+static const double genzMalik5[ 5 ] = { -  971.0 /   729.0, 245.0 /  486.0,   65.0 /  1458.0,  25.0 /   729.0, 0.0              };
+
+// Group of weights of each node.
+static const unsigned genzMalikGroup[ 17 ] = { 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4 };
+
+
+bool AdaptiveIntegrator::converged( const std::vector< double >& result, const std::vector< double >& error ) const
+{
+  for ( std::size_t comp = 0; comp < result.size(); ++comp )
+    if ( error[ comp ] > std::max( _absTol, _relTol * std::fabs( result[ comp ] ) ) )
+      return false;
+
+  return true;
+}
+
+
+void AdaptiveIntegrator::refine( const rule_type& rule, const unsigned& cost,
+                                 std::vector< Region >& regions, const std::size_t& nComps, double* result ) const
+{
+  std::vector< double > total( nComps, 0.0 );
+  std::vector< double > error( nComps, 0.0 );
+
+  _nEval = 0;
+
+  typedef std::vector< Region >::iterator rIter;
+  for ( rIter region = regions.begin(); region != regions.end(); ++region )
+  {
+    rule( *region );
+    _nEval += cost;
+
+    for ( std::size_t comp = 0; comp < nComps; ++comp )
+    {
+      total[ comp ] += region->result[ comp ];
+      error[ comp ] += region->error [ comp ];
+    }
+  }
+
+  std::make_heap( regions.begin(), regions.end() );
+
+  // Split the region with the largest error in two along its axis.
+  while ( ! converged( total, error ) && ( _nEval + 2 * cost <= _maxEval ) )
+  {
+    const Region&  worst = regions.front();
+    const unsigned axis  = worst.axis;
+    const double   mid   = ( worst.lower[ axis ] + worst.upper[ axis ] ) / 2.0;
+
+    // Stop if the region cannot be split anymore.
+    if ( ! ( ( worst.lower[ axis ] < mid ) && ( mid < worst.upper[ axis ] ) ) )
+      break;
+
+    Region left  = worst;
+    Region right = worst;
+    left .upper[ axis ] = mid;
+    right.lower[ axis ] = mid;
+
+    rule( left  );
+    rule( right );
+    _nEval += 2 * cost;
+
+    for ( std::size_t comp = 0; comp < nComps; ++comp )
+    {
+      total[ comp ] += left.result[ comp ] + right.result[ comp ] - worst.result[ comp ];
+      error[ comp ] += left.error [ comp ] + right.error [ comp ] - worst.error [ comp ];
+    }
+
+    std::pop_heap( regions.begin(), regions.end() );
+    regions.back() = left;
+    std::push_heap( regions.begin(), regions.end() );
+    regions.push_back( right );
+    std::push_heap( regions.begin(), regions.end() );
+  }
+
+  // Sum the final regions again, so that the rounding errors of the running
+  //    totals do not pile up.
+  _error = 0.0;
+  for ( std::size_t comp = 0; comp < nComps; ++comp )
+  {
+    CompensatedSum sum;
+    CompensatedSum err;
+    for ( rIter region = regions.begin(); region != regions.end(); ++region )
+    {
+      sum += region->result[ comp ];
+      err += region->error [ comp ];
+    }
+
+    result[ comp ] = sum.value();
+    _error         = std::max( _error, err.value() );
+  }
+}
+
+
+void AdaptiveIntegrator::integrate( const function_type& f, const std::size_t& nComps,
+                                    const double& min, const double& max, double* result ) const
+{
+  TRACE_SCOPE( "AdaptiveIntegrator::integrate" );
+
+  if ( max < min )
+  {
+    integrate( f, nComps, max, min, result );
+    for ( std::size_t comp = 0; comp < nComps; ++comp )
+      result[ comp ] = - result[ comp ];
+    return;
+  }
+
+  std::vector< double > x     ( 15 );
+  std::vector< double > values( 15 * nComps );
+
+  const rule_type rule = [ & ]( Region& region )
+  {
+    const double centre = ( region.lower[ 0 ] + region.upper[ 0 ] ) / 2.0;
+    const double half   = ( region.upper[ 0 ] - region.lower[ 0 ] ) / 2.0;
+
+    for ( unsigned node = 0; node < 7; ++node )
+    {
+      x[ 2 * node     ] = centre - half * kronrodNodes[ node ];
+      x[ 2 * node + 1 ] = centre + half * kronrodNodes[ node ];
+    }
+    x[ 14 ] = centre;
+
+    f( x.data(), 15, values.data() );
+
+    region.result.resize( nComps );
+    region.error .resize( nComps );
+    region.maxError = 0.0;
+    region.axis     = 0;
+
+    for ( std::size_t comp = 0; comp < nComps; ++comp )
+    {
+      const double* value = values.data() + 15 * comp;
+
+      double kronrod = kronrodWeights[ 7 ] * value[ 14 ];
+      double gauss   = gaussWeights  [ 3 ] * value[ 14 ];
+      for ( unsigned node = 0; node < 7; ++node )
+      {
+        const double pair = value[ 2 * node ] + value[ 2 * node + 1 ];
+        kronrod += kronrodWeights[ node ] * pair;
+        if ( node % 2 )
+          gauss += gaussWeights[ node / 2 ] * pair;
+      }
+
+      region.result[ comp ] = half * kronrod;
+      region.error [ comp ] = half * std::fabs( kronrod - gauss );
+      region.maxError       = std::max( region.maxError, region.error[ comp ] );
+    }
+  };
+
+  const double step = ( max - min ) / _divisions;
+
+  std::vector< Region > regions( _divisions );
+  for ( unsigned part = 0; part < _divisions; ++part )
+  {
+    regions[ part ].lower[ 0 ] = min + part * step;
+    regions[ part ].upper[ 0 ] = ( part + 1 == _divisions ) ? max : min + ( part + 1 ) * step;
+  }
+
+  refine( rule, 15, regions, nComps, result );
+}
+
+
+double AdaptiveIntegrator::integrate( const function_type& f, const double& min, const double& max ) const
+{
+  double result = 0.0;
+  integrate( f, 1, min, max, &result );
+
+  return result;
+}
+
+
+void AdaptiveIntegrator::integrate( const PhaseSpace& ps, const integrand_type& f, const std::size_t& nComps, double* result ) const
+{
+  TRACE_SCOPE( "AdaptiveIntegrator::integrate" );
+
+  const double min12   = ps.mSq12min();
+  const double range12 = ps.mSq12max() - min12;
+
+  // Point inside the phase space, used where the width of the plot vanishes by rounding.
+  const double inner12 = min12 + range12 / 2.0;
+  const double inner13 = ( ps.mSq13min( inner12 ) + ps.mSq13max( inner12 ) ) / 2.0;
+
+  std::vector< double > mSq12 ( 17 );
+  std::vector< double > mSq13 ( 17 );
+  std::vector< double > mSq23 ( 17 );
+  std::vector< double > jacob ( 17 );
+  std::vector< double > values( 17 * nComps );
+
+  // Rectangles of the unit square in ( t, v ), with
+  //    mSq12 = min12 + range12 ( 1 - cos( pi t ) ) / 2,
+  //    mSq13 = mSq13min( mSq12 ) + v ( mSq13max( mSq12 ) - mSq13min( mSq12 ) ).
+  const rule_type rule = [ & ]( Region& region )
+  {
+    const double centreT = ( region.lower[ 0 ] + region.upper[ 0 ] ) / 2.0;
+    const double centreV = ( region.lower[ 1 ] + region.upper[ 1 ] ) / 2.0;
+    const double halfT   = ( region.upper[ 0 ] - region.lower[ 0 ] ) / 2.0;
+    const double halfV   = ( region.upper[ 1 ] - region.lower[ 1 ] ) / 2.0;
+
+    for ( unsigned node = 0; node < 17; ++node )
+    {
+      const double t = centreT + halfT * genzMalikX[ node ];
+      const double v = centreV + halfV * genzMalikY[ node ];
+
+      const double m12   = min12 + range12 * ( 1.0 - std::cos( M_PI * t ) ) / 2.0;
+      const double lower = ps.mSq13min( m12 );
+      const double width = ps.mSq13max( m12 ) - lower;
+
+      if ( width > 0.0 )
+      {
+        mSq12[ node ] = m12;
+        mSq13[ node ] = lower + v * width;
+        jacob[ node ] = range12 * M_PI / 2.0 * std::sin( M_PI * t ) * width;
+      }
+      else
+      {
+        mSq12[ node ] = inner12;
+        mSq13[ node ] = inner13;
+        jacob[ node ] = 0.0;
+      }
+
+      mSq23[ node ] = ps.mSqSum() - mSq12[ node ] - mSq13[ node ];
+    }
+
+    f( mSq12.data(), mSq13.data(), mSq23.data(), 17, values.data() );
+
+    region.result.resize( nComps );
+    region.error .resize( nComps );
+    region.maxError = 0.0;
+
+    const double area = 4.0 * halfT * halfV;
+
+    // Fourth differences along each axis, summed over the components.
+    double diffT = 0.0;
+    double diffV = 0.0;
+
+    for ( std::size_t comp = 0; comp < nComps; ++comp )
+    {
+      double* value = values.data() + 17 * comp;
+      for ( unsigned node = 0; node < 17; ++node )
+        value[ node ] *= jacob[ node ];
+
+      double rule7 = 0.0;
+      double rule5 = 0.0;
+      for ( unsigned node = 0; node < 17; ++node )
+      {
+        rule7 += genzMalik7[ genzMalikGroup[ node ] ] * value[ node ];
+        rule5 += genzMalik5[ genzMalikGroup[ node ] ] * value[ node ];
+      }
+
+      region.result[ comp ] = area * rule7;
+      region.error [ comp ] = area * std::fabs( rule7 - rule5 );
+      region.maxError       = std::max( region.maxError, region.error[ comp ] );
+
+      // lambda2^2 / lambda4^2 = 1 / 7.
+      const double twice = 2.0 * value[ 0 ];
+      diffT += std::fabs( value[ 1 ] + value[ 2 ] - twice - ( value[ 5 ] + value[ 6 ] - twice ) / 7.0 );
+      diffV += std::fabs( value[ 3 ] + value[ 4 ] - twice - ( value[ 7 ] + value[ 8 ] - twice ) / 7.0 );
+    }
+
+    // Split along the direction where the integrand changes most, or the widest one.
+    if ( diffT != diffV )
+      region.axis = ( diffT > diffV ) ? 0 : 1;
+    else
+      region.axis = ( halfT >= halfV ) ? 0 : 1;
+  };
+
+  const double step = 1.0 / _divisions;
+
+  std::vector< Region > regions( _divisions * _divisions );
+  for ( unsigned partT = 0; partT < _divisions; ++partT )
+    for ( unsigned partV = 0; partV < _divisions; ++partV )
+    {
+      Region& region = regions[ partT * _divisions + partV ];
+      region.lower[ 0 ] = partT * step;
+      region.upper[ 0 ] = ( partT + 1 == _divisions ) ? 1.0 : ( partT + 1 ) * step;
+      region.lower[ 1 ] = partV * step;
+      region.upper[ 1 ] = ( partV + 1 == _divisions ) ? 1.0 : ( partV + 1 ) * step;
+    }
+
+  refine( rule, 17, regions, nComps, result );
+}
+
+
+double AdaptiveIntegrator::integrate( const PhaseSpace& ps, const integrand_type& f ) const
+{
+  double result = 0.0;
+  integrate( ps, f, 1, &result );
+
+  return result;
+}
@@ -1,24 +1,32 @@
 
 #include <stack>
+#include <set>
 #include <algorithm>
 #include <functional>
+#include <sstream>
+#include <typeinfo>
 
 #include <cfit/phasespace.hh>
 #include <cfit/amplitude.hh>
 #include <cfit/coef.hh>
 #include <cfit/resonance.hh>
 #include <cfit/operation.hh>
+#include <cfit/trace.hh>
 
 void Amplitude::append( const double& ctnt )
 {
   _ctnts.push_back( std::complex< double >( ctnt ) );
   _expression += "c"; // c = constant.
+
+  compile();
 }
 
 void Amplitude::append( const std::complex< double >& ctnt )
 {
   _ctnts.push_back( ctnt );
   _expression += "c"; // c = constant.
+
+  compile();
 }
 
 void Amplitude::append( const Coef& coef )
@@ -29,6 +37,8 @@ void Amplitude::append( const Coef& coef )
   _parMap[ coef.imag().name() ] = coef.imag();
 
   _expression += "k"; // k = coefficient.
+
+  compile();
 }
 
 void Amplitude::append( const CoefExpr& expr )
@@ -50,15 +60,19 @@ void Amplitude::append( const CoefExpr& expr )
   }
 
   _expression += expr._expression;
+
+  compile();
 }
 
 void Amplitude::append( const Resonance& reso )
 {
-  _resos.push_back( reso.copy() );
+  _resos.push_back( std::shared_ptr< Resonance >( reso.copy() ) );
 
   _parMap.insert( reso._parMap.begin(), reso._parMap.end() );
 
   _expression += "r"; // r = resonance.
+
+  compile();
 }
 
 void Amplitude::append( const Fvector& fvec )
@@ -68,6 +82,8 @@ void Amplitude::append( const Fvector& fvec )
   _parMap.insert( fvec._parMap.begin(), fvec._parMap.end() );
 
   _expression += "F"; // F = element of F vector.
+
+  compile();
 }
 
 void Amplitude::append( const Amplitude& ampl )
@@ -77,19 +93,32 @@ void Amplitude::append( const Amplitude& ampl )
   _coefs.insert( _coefs.end(), ampl._coefs.begin(), ampl._coefs.end() );
   _opers.insert( _opers.end(), ampl._opers.begin(), ampl._opers.end() );
 
-  std::transform( ampl._resos.begin(), ampl._resos.end(),
-                  std::back_inserter( _resos ), std::mem_fun( &Resonance::copy ) );
+  _resos.insert( _resos.end(), ampl._resos.begin(), ampl._resos.end() );
   _fvecs.insert( _fvecs.end(), ampl._fvecs.begin(), ampl._fvecs.end() );
 
   _parMap.insert( ampl._parMap.begin(), ampl._parMap.end() );
 
   _expression += ampl._expression;
+
+  compile();
+}
+
+Resonance& Amplitude::own( const std::size_t& index )
+{
+  std::shared_ptr< Resonance >& reso = _resos[ index ];
+  if ( reso.use_count() > 1 )
+    reso.reset( reso->copy() );
+
+  return *reso;
 }
 
+
 void Amplitude::append( const Operation::Op& oper )
 {
   _opers.push_back( oper );
   _expression += "b"; // b = binary operation.
+
+  compile();
 }
 
 
@@ -98,7 +127,7 @@ const bool Amplitude::isFixed() const
   bool fixed = true;
   fixed &= std::all_of( _parms.begin(), _parms.end(), std::mem_fun_ref( &Parameter::isFixed ) );
   fixed &= std::all_of( _coefs.begin(), _coefs.end(), std::mem_fun_ref( &Coef     ::isFixed ) );
-  fixed &= std::all_of( _resos.begin(), _resos.end(), std::mem_fun    ( &Resonance::isFixed ) );
+  fixed &= std::all_of( _resos.begin(), _resos.end(), []( const std::shared_ptr< Resonance >& reso ) { return reso->isFixed(); } );
   fixed &= std::all_of( _fvecs.begin(), _fvecs.end(), std::mem_fun_ref( &Fvector  ::isFixed ) );
 
   return fixed;
@@ -110,19 +139,26 @@ const bool Amplitude::isFixed() const
 //    Resonances still to be added will use the angular formalism carried in their respective objects.
 void Amplitude::useHelicity( const bool helicity )
 {
-  typedef std::vector< Resonance* >::const_iterator rIter;
-
-  for ( rIter res = _resos.begin(); res != _resos.end(); ++res )
-    (*res)->useHelicity( helicity );
+  for ( std::size_t reso = 0; reso < _resos.size(); ++reso )
+    own( reso ).useHelicity( helicity );
 }
 
 
 void Amplitude::useTwoBW( const bool twoBW )
 {
-  typedef std::vector< Resonance* >::const_iterator rIter;
+  for ( std::size_t reso = 0; reso < _resos.size(); ++reso )
+    own( reso ).useTwoBW( twoBW );
+}
+
+
+void Amplitude::tabulate( const PhaseSpace& ps, const double& tolerance )
+{
+  for ( std::size_t reso = 0; reso < _resos.size(); ++reso )
+    own( reso ).tabulate( ps, tolerance );
 
-  for ( rIter res = _resos.begin(); res != _resos.end(); ++res )
-    (*res)->useTwoBW( twoBW );
+  typedef std::vector< Fvector >::iterator fIter;
+  for ( fIter fvec = _fvecs.begin(); fvec != _fvecs.end(); ++fvec )
+    fvec->tabulate( ps, tolerance );
 }
 
 
@@ -143,18 +179,256 @@ void Amplitude::setPars( const std::map< std::string, Parameter >& pars )
     coef->setValue( pars.find( coef->real().name() )->second.value(),
                     pars.find( coef->imag().name() )->second.value() );
 
-  // Propagate the values to the list of resonances.
-  typedef std::vector< Resonance* >::iterator rIter;
-  for ( rIter reso = _resos.begin(); reso != _resos.end(); ++reso )
-    (*reso)->setPars( pars );
+  // Propagate the values to the list of resonances. Those shared with other
+  //    copies are only copied if any of their parameters changes.
+  typedef std::map< std::string, Parameter >::const_iterator rpIter;
+  for ( std::size_t reso = 0; reso < _resos.size(); ++reso )
+  {
+    const std::map< std::string, Parameter >& resoPars = _resos[ reso ]->_parMap;
+
+    bool changed = false;
+    for ( rpIter par = resoPars.begin(); ( par != resoPars.end() ) && ( ! changed ); ++par )
+      changed = ( pars.find( par->first )->second.value() != par->second.value() );
+
+    if ( changed )
+      own( reso ).setPars( pars );
+  }
 
   // Propagate the values to the list of fvector components.
   typedef std::vector< Fvector >::iterator fIter;
   for ( fIter fvec = _fvecs.begin(); fvec != _fvecs.end(); ++fvec )
     fvec->setPars( pars );
+
+  hoist();
+}
+
+
+void Amplitude::bind( const ParameterRegistry& registry ) throw( PdfException )
+{
+  _mapIdx = registry.indices( _parMap );
+
+  _parmIdx.clear();
+  typedef std::vector< Parameter >::const_iterator pIter;
+  for ( pIter par = _parms.begin(); par != _parms.end(); ++par )
+    _parmIdx.push_back( registry.index( par->name() ) );
+
+  _coefIdx.clear();
+  typedef std::vector< Coef >::const_iterator cIter;
+  for ( cIter coef = _coefs.begin(); coef != _coefs.end(); ++coef )
+  {
+    _coefIdx.push_back( registry.index( coef->real().name() ) );
+    _coefIdx.push_back( registry.index( coef->imag().name() ) );
+  }
+
+  _resoIdx.clear();
+  for ( std::size_t reso = 0; reso < _resos.size(); ++reso )
+    _resoIdx.push_back( registry.indices( _resos[ reso ]->parOrder() ) );
+
+  _fvecIdx.clear();
+  typedef std::vector< Fvector >::const_iterator fIter;
+  for ( fIter fvec = _fvecs.begin(); fvec != _fvecs.end(); ++fvec )
+    _fvecIdx.push_back( registry.indices( fvec->_parMap ) );
+
+  _bound = true;
 }
 
 
+void Amplitude::copyBinding( const Amplitude& amp )
+{
+  _mapIdx  = amp._mapIdx;
+  _parmIdx = amp._parmIdx;
+  _coefIdx = amp._coefIdx;
+  _resoIdx = amp._resoIdx;
+  _fvecIdx = amp._fvecIdx;
+  _bound   = amp._bound;
+}
+
+
+// Same as setPars from a map, with the values read at the positions found by bind.
+void Amplitude::setPars( const ParameterRegistry& registry )
+{
+  const double* values = registry.values();
+
+  std::vector< unsigned >::const_iterator idx = _mapIdx.begin();
+  typedef std::map< std::string, Parameter >::iterator mIter;
+  for ( mIter par = _parMap.begin(); par != _parMap.end(); ++par )
+    par->second.setValue( values[ *idx++ ] );
+
+  for ( std::size_t par = 0; par < _parms.size(); ++par )
+    _parms[ par ].setValue( values[ _parmIdx[ par ] ] );
+
+  for ( std::size_t coef = 0; coef < _coefs.size(); ++coef )
+    _coefs[ coef ].setValue( values[ _coefIdx[ 2 * coef ] ], values[ _coefIdx[ 2 * coef + 1 ] ] );
+
+  // Resonances shared with other copies are only copied if any of their parameters changes.
+  std::vector< double > resoValues;
+  for ( std::size_t reso = 0; reso < _resos.size(); ++reso )
+  {
+    const std::vector< unsigned >& resoIdx = _resoIdx[ reso ];
+    resoValues.resize( resoIdx.size() );
+    for ( std::size_t par = 0; par < resoIdx.size(); ++par )
+      resoValues[ par ] = values[ resoIdx[ par ] ];
+
+    if ( resoValues != _resos[ reso ]->_values )
+      own( reso ).setValues( resoValues );
+  }
+
+  std::vector< double > fvecValues;
+  for ( std::size_t fvec = 0; fvec < _fvecs.size(); ++fvec )
+  {
+    const std::vector< unsigned >& fvecIdx = _fvecIdx[ fvec ];
+    fvecValues.resize( fvecIdx.size() );
+    for ( std::size_t par = 0; par < fvecIdx.size(); ++par )
+      fvecValues[ par ] = values[ fvecIdx[ par ] ];
+
+    _fvecs[ fvec ].setValues( fvecValues );
+  }
+
+  hoist();
+}
+
+
+
+void Amplitude::compile() throw( PdfException )
+{
+  _tape  .clear();
+  _isCoef.clear();
+  _args  .clear();
+
+  // The positions of the parameters must be found again.
+  _bound = false;
+
+  std::size_t depth = 0;
+  _depth = 0;
+
+  // Tape positions of the values in the stack.
+  std::vector< unsigned > positions;
+
+  unsigned ctt = 0;
+  unsigned val = 0;
+  unsigned res = 0;
+  unsigned fvc = 0;
+  unsigned ops = 0;
+
+  typedef std::string::const_iterator eIter;
+  for ( eIter ch = _expression.begin(); ch != _expression.end(); ++ch )
+  {
+    if ( *ch == 'c' )
+      _tape.push_back( Instruction( Instruction::ctnt, ctt++ ) );
+    else if ( ( *ch == 'p' ) || ( *ch == 'k' ) )
+    {
+      _tape  .push_back( Instruction( Instruction::value, val++ ) );
+      _isCoef.push_back( *ch == 'k' );
+    }
+    else if ( *ch == 'r' )
+      _tape.push_back( Instruction( Instruction::reso, res++ ) );
+    else if ( *ch == 'F' )
+      _tape.push_back( Instruction( Instruction::fvec, fvc++ ) );
+    else if ( *ch == 'b' )
+    {
+      if ( depth < 2 )
+        throw PdfException( "Parse error: not enough values in the stack." );
+      _tape.push_back( Instruction( Instruction::binary, ops++ ) );
+      depth -= 2;
+    }
+    else if ( *ch == 'u' )
+    {
+      if ( depth < 1 )
+        throw PdfException( "Parse error: not enough values in the stack." );
+      _tape.push_back( Instruction( Instruction::unary, ops++ ) );
+      depth -= 1;
+    }
+    else
+      throw PdfException( std::string( "Parse error: unknown operation " ) + *ch + "." );
+
+    // Every instruction leaves one value in the stack.
+    _depth = std::max( _depth, ++depth );
+
+    std::pair< unsigned, unsigned > args( 0, 0 );
+    if ( *ch == 'b' )
+    {
+      args.second = positions.back();
+      positions.pop_back();
+      args.first  = positions.back();
+      positions.pop_back();
+    }
+    else if ( *ch == 'u' )
+    {
+      args.first = positions.back();
+      positions.pop_back();
+    }
+
+    _args.push_back( args );
+    positions.push_back( _tape.size() - 1 );
+  }
+
+  _valid = ( depth == 1 );
+
+  decompose();
+
+  // Collect the parameters used by resonances and F vectors, which cannot be differentiated.
+  std::set< std::string > opaque;
+  typedef std::vector< std::shared_ptr< Resonance > >::const_iterator rIter;
+  for ( rIter reso = _resos.begin(); reso != _resos.end(); ++reso )
+    for ( std::map< std::string, Parameter >::const_iterator par = (*reso)->_parMap.begin(); par != (*reso)->_parMap.end(); ++par )
+      opaque.insert( par->first );
+
+  typedef std::vector< Fvector >::const_iterator fIter;
+  for ( fIter fvec = _fvecs.begin(); fvec != _fvecs.end(); ++fvec )
+    for ( std::map< std::string, Parameter >::const_iterator par = fvec->_parMap.begin(); par != fvec->_parMap.end(); ++par )
+      opaque.insert( par->first );
+
+  // Derivatives of each hoisted value: parameters are real, and coefficients
+  //    are re + i im, so they only depend on their own components.
+  std::vector< std::vector< std::pair< std::string, std::complex< double > > > > valueGrad;
+  std::vector< Parameter >::const_iterator par = _parms.begin();
+  std::vector< Coef      >::const_iterator coe = _coefs.begin();
+  for ( std::size_t val = 0; val < _isCoef.size(); ++val )
+  {
+    std::vector< std::pair< std::string, std::complex< double > > > derivs;
+    if ( _isCoef[ val ] )
+    {
+      derivs.push_back( std::make_pair( coe  ->real().name(), std::complex< double >( 1.0, 0.0 ) ) );
+      derivs.push_back( std::make_pair( coe++->imag().name(), std::complex< double >( 0.0, 1.0 ) ) );
+    }
+    else
+      derivs.push_back( std::make_pair( par++->name(), std::complex< double >( 1.0, 0.0 ) ) );
+    valueGrad.push_back( derivs );
+  }
+
+  _gradPars .clear();
+  _valueGrad.clear();
+  for ( std::map< std::string, Parameter >::const_iterator par = _parMap.begin(); par != _parMap.end(); ++par )
+    if ( ! opaque.count( par->first ) )
+      _gradPars.push_back( par->first );
+
+  for ( std::size_t val = 0; val < valueGrad.size(); ++val )
+  {
+    std::vector< std::pair< unsigned, std::complex< double > > > derivs;
+    for ( std::size_t der = 0; der < valueGrad[ val ].size(); ++der )
+    {
+      typedef std::vector< std::string >::const_iterator sIter;
+      sIter pos = std::lower_bound( _gradPars.begin(), _gradPars.end(), valueGrad[ val ][ der ].first );
+      if ( ( pos != _gradPars.end() ) && ( *pos == valueGrad[ val ][ der ].first ) )
+        derivs.push_back( std::make_pair( unsigned( pos - _gradPars.begin() ), valueGrad[ val ][ der ].second ) );
+    }
+    _valueGrad.push_back( derivs );
+  }
+
+  hoist();
+}
+
+
+void Amplitude::hoist()
+{
+  _values.resize( _isCoef.size() );
+
+  std::vector< Parameter >::const_iterator par = _parms.begin();
+  std::vector< Coef      >::const_iterator coe = _coefs.begin();
+  for ( std::size_t val = 0; val < _isCoef.size(); ++val )
+    _values[ val ] = _isCoef[ val ] ? coe++->value() : std::complex< double >( par++->value(), 0. );
+}
+
 
 // Evaluate the amplitude at the given point, with the current values of its parameters.
 std::complex< double > Amplitude::evaluate( const PhaseSpace& ps,
@@ -165,61 +439,744 @@ std::complex< double > Amplitude::evaluate( const PhaseSpace& ps,
   if ( ! ps.contains( mSq12, mSq13, mSq23 ) )
     return 0.0;
 
-  std::stack< std::complex< double > > values;
+  if ( ! _valid )
+    throw PdfException( "Amplitude parse error: too many values have been supplied." );
 
-  std::complex< double > x;
-  std::complex< double > y;
+  // Fixed-depth stack of values.
+  std::complex< double >  local[ 16 ];
+  std::vector< std::complex< double > > heap( ( _depth > 16 ) ? _depth : 0 );
+  std::complex< double >* values = ( _depth > 16 ) ? heap.data() : local;
 
-  std::vector< std::complex< double > >::const_iterator ctt = _ctnts.begin();
-  std::vector< Parameter              >::const_iterator par = _parms.begin();
-  std::vector< Coef                   >::const_iterator coe = _coefs.begin();
-  std::vector< Resonance*             >::const_iterator res = _resos.begin();
-  std::vector< Fvector                >::const_iterator fvc = _fvecs.begin();
-  std::vector< Operation::Op          >::const_iterator ops = _opers.begin();
+  std::size_t top = 0;
+  typedef std::vector< Instruction >::const_iterator tIter;
+  for ( tIter ins = _tape.begin(); ins != _tape.end(); ++ins )
+    switch ( ins->code )
+    {
+    case Instruction::ctnt:
+      values[ top++ ] = _ctnts[ ins->index ];
+      break;
+    case Instruction::value:
+      values[ top++ ] = _values[ ins->index ];
+      break;
+    case Instruction::reso:
+      values[ top++ ] = _resos[ ins->index ]->evaluate( ps, mSq12, mSq13, mSq23 );
+      break;
+    case Instruction::fvec:
+      values[ top++ ] = _fvecs[ ins->index ].evaluate( ps, mSq12, mSq13, mSq23 );
+      break;
+    case Instruction::binary:
+      --top;
+      values[ top - 1 ] = Operation::operate( values[ top - 1 ], values[ top ], _opers[ ins->index ] );
+      break;
+    case Instruction::unary:
+      values[ top - 1 ] = Operation::operate( values[ top - 1 ], _opers[ ins->index ] );
+      break;
+    }
 
-  // Parsing loop.
-  typedef std::string::const_iterator eIter;
-  for ( eIter ch = _expression.begin(); ch != _expression.end(); ++ch )
-    if ( *ch == 'c' )
-      values.push( *ctt++ );
-    else if ( *ch == 'p' )
-      values.push( std::complex< double >( par++->value(), 0. ) );
-    else if ( *ch == 'k' )
-      values.push( coe++->value() );
-    else if ( *ch == 'r' )
-      values.push( (*res++)->evaluate( ps, mSq12, mSq13, mSq23 ) );
-    else if ( *ch == 'F' )
-      values.push( fvc++->evaluate( ps, mSq12, mSq13, mSq23 ) );
+  return values[ 0 ];
+}
+
+
+void Amplitude::evaluateTape( const PhaseSpace& ps, const double* mSq12, const double* mSq13, const double* mSq23,
+                              const double* const* kin, const std::size_t& n, std::complex< double >* out ) const throw( PdfException )
+{
+  // The bottom of the stack is the output array itself.
+  std::vector< std::complex< double > > stack( ( _depth - 1 ) * n );
+  std::vector< std::complex< double >* > values( _depth );
+  values[ 0 ] = out;
+  for ( std::size_t level = 1; level < _depth; ++level )
+    values[ level ] = stack.data() + ( level - 1 ) * n;
+
+  std::size_t top = 0;
+  typedef std::vector< Instruction >::const_iterator tIter;
+  for ( tIter ins = _tape.begin(); ins != _tape.end(); ++ins )
+  {
+    // Only the instructions that push a value write to the next level, which
+    //    is past the end of the stack for the operations at its full depth.
+    std::complex< double >* x = ( top < _depth ) ? values[ top ] : 0;
+    switch ( ins->code )
+    {
+    case Instruction::ctnt:
+      std::fill( x, x + n, _ctnts[ ins->index ] );
+      ++top;
+      break;
+    case Instruction::value:
+      std::fill( x, x + n, _values[ ins->index ] );
+      ++top;
+      break;
+    case Instruction::reso:
+      {
+        TRACE_SCOPE( _resos[ ins->index ]->traceName() );
+        if ( kin )
+          _resos[ ins->index ]->evaluate( ps, mSq12, mSq13, mSq23, kin + kinematicsOffset( ins->index ), n, x );
+        else
+          _resos[ ins->index ]->evaluate( ps, mSq12, mSq13, mSq23, n, x );
+        ++top;
+        break;
+      }
+    case Instruction::fvec:
+      {
+        const Fvector& fvec = _fvecs[ ins->index ];
+        TRACE_SCOPE( fvec.traceName() );
+        for ( std::size_t point = 0; point < n; ++point )
+          x[ point ] = fvec.evaluate( ps, mSq12[ point ], mSq13[ point ], mSq23[ point ] );
+        ++top;
+        break;
+      }
+    case Instruction::binary:
+      --top;
+      Operation::operate( values[ top - 1 ], values[ top ], n, _opers[ ins->index ] );
+      break;
+    case Instruction::unary:
+      Operation::operate( values[ top - 1 ], n, _opers[ ins->index ] );
+      break;
+    }
+  }
+}
+
+
+void Amplitude::evaluate( const PhaseSpace&       ps   ,
+                          const double*           mSq12,
+                          const double*           mSq13,
+                          const double*           mSq23,
+                          const std::size_t&      n    ,
+                          std::complex< double >* out    ) const throw( PdfException )
+{
+  evaluate( ps, mSq12, mSq13, mSq23, 0, n, out );
+}
+
+
+std::size_t Amplitude::kinematicsOffset( const std::size_t& reso ) const
+{
+  std::size_t offset = 0;
+  for ( std::size_t prev = 0; prev < reso; ++prev )
+    offset += _resos[ prev ]->nKinematics();
+
+  return offset;
+}
+
+
+void Amplitude::kinematics( const PhaseSpace&  ps   ,
+                            const double*      mSq12,
+                            const double*      mSq13,
+                            const double*      mSq23,
+                            const std::size_t& n    ,
+                            double* const*     kin    ) const
+{
+  std::size_t offset = 0;
+  for ( std::size_t reso = 0; reso < _resos.size(); ++reso )
+  {
+    _resos[ reso ]->kinematics( ps, mSq12, mSq13, mSq23, n, kin + offset );
+    offset += _resos[ reso ]->nKinematics();
+  }
+}
+
+
+// A null kin makes the resonances compute their kinematics.
+void Amplitude::evaluate( const PhaseSpace&       ps   ,
+                          const double*           mSq12,
+                          const double*           mSq13,
+                          const double*           mSq23,
+                          const double* const*    kin  ,
+                          const std::size_t&      n    ,
+                          std::complex< double >* out    ) const throw( PdfException )
+{
+  if ( ! _valid )
+    throw PdfException( "Amplitude parse error: too many values have been supplied." );
+
+  // Gather the points inside the phase space.
+  std::vector< unsigned char > mask( n );
+  ps.contains( mSq12, mSq13, mSq23, n, mask.data() );
+
+  std::vector< std::size_t > inside;
+  inside.reserve( n );
+  for ( std::size_t point = 0; point < n; ++point )
+    if ( mask[ point ] )
+      inside.push_back( point );
+
+  const std::size_t m = inside.size();
+
+  // If all of them are, evaluate directly on the given arrays.
+  if ( m == n )
+  {
+    evaluateTape( ps, mSq12, mSq13, mSq23, kin, n, out );
+    return;
+  }
+
+  std::vector< double > x12( m );
+  std::vector< double > x13( m );
+  std::vector< double > x23( m );
+  for ( std::size_t point = 0; point < m; ++point )
+  {
+    x12[ point ] = mSq12[ inside[ point ] ];
+    x13[ point ] = mSq13[ inside[ point ] ];
+    x23[ point ] = mSq23[ inside[ point ] ];
+  }
+
+  // Gather the kinematics of the same points, column after column.
+  const std::size_t nKin = kin ? nKinematics() : 0;
+
+  std::vector< double >        xKin( nKin * m );
+  std::vector< const double* > xCols( nKin );
+  for ( std::size_t column = 0; column < nKin; ++column )
+  {
+    double* x = xKin.data() + column * m;
+    for ( std::size_t point = 0; point < m; ++point )
+      x[ point ] = kin[ column ][ inside[ point ] ];
+    xCols[ column ] = x;
+  }
+
+  std::vector< std::complex< double > > amps( m );
+  if ( m )
+    evaluateTape( ps, x12.data(), x13.data(), x23.data(), kin ? xCols.data() : 0, m, amps.data() );
+
+  std::fill( out, out + n, std::complex< double >( 0.0 ) );
+  for ( std::size_t point = 0; point < m; ++point )
+    out[ inside[ point ] ] = amps[ point ];
+}
+
+
+void Amplitude::evaluateTapePair( const PhaseSpace& ps, const double* mSq12, const double* mSq13, const double* mSq23,
+                                  const std::size_t& n, std::complex< double >* dir, std::complex< double >* cnj ) const throw( PdfException )
+{
+  // Each level of the stack holds the n direct values followed by the n conjugated ones.
+  const std::size_t m = 2 * n;
+
+  std::vector< std::complex< double > > stack( _depth * m );
+  std::vector< std::complex< double >* > values( _depth );
+  for ( std::size_t level = 0; level < _depth; ++level )
+    values[ level ] = stack.data() + level * m;
+
+  std::size_t top = 0;
+  typedef std::vector< Instruction >::const_iterator tIter;
+  for ( tIter ins = _tape.begin(); ins != _tape.end(); ++ins )
+  {
+    // Only the instructions that push a value write to the next level, which
+    //    is past the end of the stack for the operations at its full depth.
+    std::complex< double >* x = ( top < _depth ) ? values[ top ] : 0;
+    switch ( ins->code )
+    {
+    case Instruction::ctnt:
+      std::fill( x, x + m, _ctnts[ ins->index ] );
+      ++top;
+      break;
+    case Instruction::value:
+      std::fill( x, x + m, _values[ ins->index ] );
+      ++top;
+      break;
+    case Instruction::reso:
+      {
+        const Resonance& reso = *_resos[ ins->index ];
+        TRACE_SCOPE( reso.traceName() );
+        for ( std::size_t point = 0; point < n; ++point )
+          reso.evaluatePair( ps, mSq12[ point ], mSq13[ point ], mSq23[ point ], x[ point ], x[ point + n ] );
+        ++top;
+        break;
+      }
+    case Instruction::fvec:
+      {
+        const Fvector& fvec = _fvecs[ ins->index ];
+        TRACE_SCOPE( fvec.traceName() );
+        for ( std::size_t point = 0; point < n; ++point )
+          fvec.evaluatePair( ps, mSq12[ point ], mSq13[ point ], mSq23[ point ], x[ point ], x[ point + n ] );
+        ++top;
+        break;
+      }
+    case Instruction::binary:
+      --top;
+      Operation::operate( values[ top - 1 ], values[ top ], m, _opers[ ins->index ] );
+      break;
+    case Instruction::unary:
+      Operation::operate( values[ top - 1 ], m, _opers[ ins->index ] );
+      break;
+    }
+  }
+
+  std::copy( values[ 0 ]    , values[ 0 ] + n, dir );
+  std::copy( values[ 0 ] + n, values[ 0 ] + m, cnj );
+}
+
+
+void Amplitude::evaluatePair( const PhaseSpace&       ps   ,
+                              const double*           mSq12,
+                              const double*           mSq13,
+                              const double*           mSq23,
+                              const std::size_t&      n    ,
+                              std::complex< double >* dir  ,
+                              std::complex< double >* cnj    ) const throw( PdfException )
+{
+  if ( ! _valid )
+    throw PdfException( "Amplitude parse error: too many values have been supplied." );
+
+  // Gather the points inside the phase space in both orderings. Unless the phase
+  //    space is symmetric, some may only be inside in one of them.
+  std::vector< unsigned char > maskDir( n );
+  std::vector< unsigned char > maskCnj( n );
+  ps.contains( mSq12, mSq13, mSq23, n, maskDir.data() );
+  ps.contains( mSq13, mSq12, mSq23, n, maskCnj.data() );
+
+  std::vector< std::size_t > inside;
+  inside.reserve( n );
+  for ( std::size_t point = 0; point < n; ++point )
+  {
+    const bool inDir = maskDir[ point ];
+    const bool inCnj = maskCnj[ point ];
+
+    if ( inDir && inCnj )
+      inside.push_back( point );
     else
     {
-      if ( *ch == 'b' ) // Binary operation with complex numbers.
+      dir[ point ] = inDir ? evaluate( ps, mSq12[ point ], mSq13[ point ], mSq23[ point ] ) : 0.0;
+      cnj[ point ] = inCnj ? evaluate( ps, mSq13[ point ], mSq12[ point ], mSq23[ point ] ) : 0.0;
+    }
+  }
+
+  const std::size_t m = inside.size();
+
+  if ( m == n )
+  {
+    evaluateTapePair( ps, mSq12, mSq13, mSq23, n, dir, cnj );
+    return;
+  }
+
+  if ( m == 0 )
+    return;
+
+  std::vector< double > x12( m );
+  std::vector< double > x13( m );
+  std::vector< double > x23( m );
+  for ( std::size_t point = 0; point < m; ++point )
+  {
+    x12[ point ] = mSq12[ inside[ point ] ];
+    x13[ point ] = mSq13[ inside[ point ] ];
+    x23[ point ] = mSq23[ inside[ point ] ];
+  }
+
+  std::vector< std::complex< double > > ampsDir( m );
+  std::vector< std::complex< double > > ampsCnj( m );
+  evaluateTapePair( ps, x12.data(), x13.data(), x23.data(), m, ampsDir.data(), ampsCnj.data() );
+
+  for ( std::size_t point = 0; point < m; ++point )
+  {
+    dir[ inside[ point ] ] = ampsDir[ point ];
+    cnj[ inside[ point ] ] = ampsCnj[ point ];
+  }
+}
+
+
+void Amplitude::evaluateGradient( const PhaseSpace&                             ps   ,
+                                  const double*                                 mSq12,
+                                  const double*                                 mSq13,
+                                  const double*                                 mSq23,
+                                  const std::size_t&                            n    ,
+                                  std::complex< double >*                       out  ,
+                                  const std::vector< std::complex< double >* >& grad   ) const throw( PdfException )
+{
+  if ( ! _valid )
+    throw PdfException( "Amplitude parse error: too many values have been supplied." );
+
+  if ( grad.size() != _gradPars.size() )
+    throw PdfException( "Amplitude::evaluateGradient: wrong number of derivative arrays." );
+
+  const std::size_t nIns = _tape.size();
+  const std::size_t last = nIns - 1;
+
+  // Value of every instruction and derivative of the amplitude with respect to it.
+  std::vector< std::complex< double > > values ( nIns );
+  std::vector< std::complex< double > > adjoint( nIns );
+
+  std::vector< unsigned char > inside( n );
+  ps.contains( mSq12, mSq13, mSq23, n, inside.data() );
+
+  for ( std::size_t point = 0; point < n; ++point )
+  {
+    for ( std::size_t par = 0; par < grad.size(); ++par )
+      grad[ par ][ point ] = 0.0;
+
+    if ( ! inside[ point ] )
+    {
+      out[ point ] = 0.0;
+      continue;
+    }
+
+    // Forward pass: value of each instruction.
+    for ( std::size_t pos = 0; pos < nIns; ++pos )
+    {
+      const Instruction& ins = _tape[ pos ];
+      switch ( ins.code )
       {
-        if ( values.size() < 2 )
-          throw PdfException( "Parse error: not enough values in the stack." );
-        y = values.top();
-        values.pop();
-        x = values.top();
-        values.pop();
-
-        values.push( Operation::operate( x, y, *ops++ ) );
+      case Instruction::ctnt:
+        values[ pos ] = _ctnts[ ins.index ];
+        break;
+      case Instruction::value:
+        values[ pos ] = _values[ ins.index ];
+        break;
+      case Instruction::reso:
+        values[ pos ] = _resos[ ins.index ]->evaluate( ps, mSq12[ point ], mSq13[ point ], mSq23[ point ] );
+        break;
+      case Instruction::fvec:
+        values[ pos ] = _fvecs[ ins.index ].evaluate( ps, mSq12[ point ], mSq13[ point ], mSq23[ point ] );
+        break;
+      case Instruction::binary:
+        values[ pos ] = Operation::operate( values[ _args[ pos ].first ], values[ _args[ pos ].second ], _opers[ ins.index ] );
+        break;
+      case Instruction::unary:
+        values[ pos ] = Operation::operate( values[ _args[ pos ].first ], _opers[ ins.index ] );
+        break;
       }
-      else if ( *ch == 'u' ) // Unary operation with complex numbers.
+    }
+
+    out[ point ] = values[ last ];
+
+    backward( values, adjoint );
+
+    for ( std::size_t pos = 0; pos < nIns; ++pos )
+      if ( _tape[ pos ].code == Instruction::value )
       {
-        if ( values.empty() )
-          throw PdfException( "Parse error: not enough values in the stack." );
-        x = values.top();
-        values.pop();
+        typedef std::vector< std::pair< unsigned, std::complex< double > > >::const_iterator dIter;
+        const std::vector< std::pair< unsigned, std::complex< double > > >& derivs = _valueGrad[ _tape[ pos ].index ];
+        for ( dIter der = derivs.begin(); der != derivs.end(); ++der )
+          grad[ der->first ][ point ] += adjoint[ pos ] * der->second;
+      }
+  }
+}
+
+
+// Backward pass: derivative of the amplitude with respect to the value of each
+//    instruction. All the operations are holomorphic, so the derivatives
+//    propagate through them as through real functions.
+void Amplitude::backward( const std::vector< std::complex< double > >& values,
+                          std::vector< std::complex< double > >&       adjoint ) const throw( PdfException )
+{
+  const std::size_t nIns = _tape.size();
+
+  std::complex< double > dx;
+  std::complex< double > dy;
+
+  std::fill( adjoint.begin(), adjoint.end(), std::complex< double >( 0.0 ) );
+  adjoint[ nIns - 1 ] = 1.0;
+
+  for ( std::size_t pos = nIns; pos-- > 0; )
+  {
+    const Instruction& ins = _tape[ pos ];
+    if ( adjoint[ pos ] == 0.0 )
+      continue;
+
+    if ( ins.code == Instruction::binary )
+    {
+      Operation::derivative( values[ _args[ pos ].first ], values[ _args[ pos ].second ], _opers[ ins.index ], dx, dy );
+      adjoint[ _args[ pos ].first  ] += adjoint[ pos ] * dx;
+      adjoint[ _args[ pos ].second ] += adjoint[ pos ] * dy;
+    }
+    else if ( ins.code == Instruction::unary )
+      adjoint[ _args[ pos ].first ] += adjoint[ pos ] * Operation::derivative( values[ _args[ pos ].first ], _opers[ ins.index ] );
+  }
+}
+
+
+// Find whether the amplitude is a linear combination of its resonances and F vector
+//    components, and possibly a constant term, with coefficients that do not depend
+//    on the point of the phase space.
+void Amplitude::decompose()
+{
+  _basis.clear();
+  _linear  = _valid;
+  _hasUnit = false;
+
+  if ( ! _valid )
+    return;
+
+  const std::size_t nIns = _tape.size();
+
+  // Whether the value of each instruction depends on the basis functions,
+  //    and whether it has a term that does not.
+  std::vector< char > dep( nIns, 0 );
+  std::vector< char > scl( nIns, 0 );
+
+  for ( std::size_t pos = 0; _linear && ( pos < nIns ); ++pos )
+  {
+    const Instruction&                     ins  = _tape[ pos ];
+    const std::pair< unsigned, unsigned >& args = _args[ pos ];
+
+    if ( ( ins.code == Instruction::ctnt ) || ( ins.code == Instruction::value ) )
+      scl[ pos ] = 1;
+    else if ( ( ins.code == Instruction::reso ) || ( ins.code == Instruction::fvec ) )
+    {
+      dep[ pos ] = 1;
+      _basis.push_back( pos );
+    }
+    else if ( ins.code == Instruction::binary )
+    {
+      const char& dx = dep[ args.first  ];
+      const char& dy = dep[ args.second ];
+      const Operation::Op& oper = _opers[ ins.index ];
 
-        values.push( Operation::operate( x, *ops++ ) );
+      if ( ( oper == Operation::plus ) || ( oper == Operation::minus ) )
+      {
+        dep[ pos ] = dx || dy;
+        scl[ pos ] = scl[ args.first ] || scl[ args.second ];
+      }
+      else if ( ( oper == Operation::mult ) && ! ( dx && dy ) )
+      {
+        dep[ pos ] = dx || dy;
+        scl[ pos ] = dx ? scl[ args.first ] : ( dy ? scl[ args.second ] : 1 );
       }
+      else if ( ( oper == Operation::div ) && ! dy )
+      {
+        dep[ pos ] = dx;
+        scl[ pos ] = dx ? scl[ args.first ] : 1;
+      }
+      else if ( ! dx && ! dy )
+        scl[ pos ] = 1;
       else
-        throw PdfException( std::string( "Parse error: unknown operation " ) + *ch + "." );
+        _linear = false;
     }
+    else if ( ins.code == Instruction::unary )
+    {
+      if ( _opers[ ins.index ] == Operation::minus )
+      {
+        dep[ pos ] = dep[ args.first ];
+        scl[ pos ] = scl[ args.first ];
+      }
+      else if ( ! dep[ args.first ] )
+        scl[ pos ] = 1;
+      else
+        _linear = false;
+    }
+  }
 
-  if ( values.size() != 1 )
-    throw PdfException( "Amplitude parse error: too many values have been supplied." );
+  _hasUnit = _linear && scl[ nIns - 1 ];
+
+  if ( ! _linear )
+    _basis.clear();
+}
+
+
+void Amplitude::coefficients( std::vector< std::complex< double > >& coefs ) const throw( PdfException )
+{
+  if ( ! _linear )
+    throw PdfException( "Amplitude::coefficients: the amplitude is not a linear combination of its resonances." );
+
+  // Since the amplitude is linear in the basis functions, it is enough to
+  //    evaluate it with all of them set to zero.
+  const std::size_t nIns = _tape.size();
+
+  std::vector< std::complex< double > > values ( nIns );
+  std::vector< std::complex< double > > adjoint( nIns );
+
+  for ( std::size_t pos = 0; pos < nIns; ++pos )
+  {
+    const Instruction& ins = _tape[ pos ];
+    switch ( ins.code )
+    {
+    case Instruction::ctnt:
+      values[ pos ] = _ctnts[ ins.index ];
+      break;
+    case Instruction::value:
+      values[ pos ] = _values[ ins.index ];
+      break;
+    case Instruction::reso:
+    case Instruction::fvec:
+      values[ pos ] = 0.0;
+      break;
+    case Instruction::binary:
+      values[ pos ] = Operation::operate( values[ _args[ pos ].first ], values[ _args[ pos ].second ], _opers[ ins.index ] );
+      break;
+    case Instruction::unary:
+      values[ pos ] = Operation::operate( values[ _args[ pos ].first ], _opers[ ins.index ] );
+      break;
+    }
+  }
+
+  backward( values, adjoint );
+
+  coefs.resize( nBasis() );
+  for ( std::size_t k = 0; k < _basis.size(); ++k )
+    coefs[ k ] = adjoint[ _basis[ k ] ];
+
+  if ( _hasUnit )
+    coefs.back() = values[ nIns - 1 ];
+}
+
+
+void Amplitude::evaluateBasis( const std::size_t&      k    ,
+                               const PhaseSpace&       ps   ,
+                               const double*           mSq12,
+                               const double*           mSq13,
+                               const double*           mSq23,
+                               const std::size_t&      n    ,
+                               std::complex< double >* out    ) const throw( PdfException )
+{
+  evaluateBasis( k, ps, mSq12, mSq13, mSq23, 0, n, out );
+}
+
+
+// A null kin makes the resonance compute its kinematics.
+void Amplitude::evaluateBasis( const std::size_t&      k    ,
+                               const PhaseSpace&       ps   ,
+                               const double*           mSq12,
+                               const double*           mSq13,
+                               const double*           mSq23,
+                               const double* const*    kin  ,
+                               const std::size_t&      n    ,
+                               std::complex< double >* out    ) const throw( PdfException )
+{
+  if ( k >= nBasis() )
+    throw PdfException( "Amplitude::evaluateBasis: basis function index out of range." );
+
+  // Resonances are evaluated in a single batch, and the points outside set to zero afterwards.
+  const bool reso = ( k < _basis.size() ) && ( _tape[ _basis[ k ] ].code == Instruction::reso );
+  if ( reso )
+  {
+    const unsigned& index = _tape[ _basis[ k ] ].index;
+    TRACE_SCOPE( _resos[ index ]->traceName() );
+    if ( kin )
+      _resos[ index ]->evaluate( ps, mSq12, mSq13, mSq23, kin + kinematicsOffset( index ), n, out );
+    else
+      _resos[ index ]->evaluate( ps, mSq12, mSq13, mSq23, n, out );
+  }
+
+  std::vector< unsigned char > inside( n );
+  ps.contains( mSq12, mSq13, mSq23, n, inside.data() );
+
+  for ( std::size_t point = 0; point < n; ++point )
+  {
+    if ( ! inside[ point ] )
+      out[ point ] = 0.0;
+    else if ( k == _basis.size() )
+      out[ point ] = 1.0;
+    else if ( ! reso )
+      out[ point ] = _fvecs[ _tape[ _basis[ k ] ].index ].evaluate( ps, mSq12[ point ], mSq13[ point ], mSq23[ point ] );
+  }
+}
+
+
+void Amplitude::evaluateBasisPair( const std::size_t&      k    ,
+                                   const PhaseSpace&       ps   ,
+                                   const double*           mSq12,
+                                   const double*           mSq13,
+                                   const double*           mSq23,
+                                   const std::size_t&      n    ,
+                                   std::complex< double >* dir  ,
+                                   std::complex< double >* cnj    ) const throw( PdfException )
+{
+  if ( k >= nBasis() )
+    throw PdfException( "Amplitude::evaluateBasisPair: basis function index out of range." );
+
+  std::vector< unsigned char > maskDir( n );
+  std::vector< unsigned char > maskCnj( n );
+  ps.contains( mSq12, mSq13, mSq23, n, maskDir.data() );
+  ps.contains( mSq13, mSq12, mSq23, n, maskCnj.data() );
+
+  for ( std::size_t point = 0; point < n; ++point )
+  {
+    const bool inDir = maskDir[ point ];
+    const bool inCnj = maskCnj[ point ];
+
+    if ( k == _basis.size() )
+    {
+      dir[ point ] = inDir ? 1.0 : 0.0;
+      cnj[ point ] = inCnj ? 1.0 : 0.0;
+      continue;
+    }
+
+    const Instruction& ins  = _tape[ _basis[ k ] ];
+    const bool         reso = ( ins.code == Instruction::reso );
+
+    if ( inDir && inCnj )
+    {
+      if ( reso )
+        _resos[ ins.index ]->evaluatePair( ps, mSq12[ point ], mSq13[ point ], mSq23[ point ], dir[ point ], cnj[ point ] );
+      else
+        _fvecs[ ins.index ].evaluatePair( ps, mSq12[ point ], mSq13[ point ], mSq23[ point ], dir[ point ], cnj[ point ] );
+      continue;
+    }
+
+    dir[ point ] = 0.0;
+    cnj[ point ] = 0.0;
+
+    if ( inDir )
+      dir[ point ] = reso ? _resos[ ins.index ]->evaluate( ps, mSq12[ point ], mSq13[ point ], mSq23[ point ] )
+                          : _fvecs[ ins.index ].evaluate( ps, mSq12[ point ], mSq13[ point ], mSq23[ point ] );
+    if ( inCnj )
+      cnj[ point ] = reso ? _resos[ ins.index ]->evaluate( ps, mSq13[ point ], mSq12[ point ], mSq23[ point ] )
+                          : _fvecs[ ins.index ].evaluate( ps, mSq13[ point ], mSq12[ point ], mSq23[ point ] );
+  }
+}
+
+
+const std::vector< unsigned > Amplitude::basisVersions( const std::size_t& k ) const
+{
+  std::vector< unsigned > versions;
+
+  if ( k >= _basis.size() )
+    return versions;
+
+  const Instruction& ins = _tape[ _basis[ k ] ];
+  if ( ins.code == Instruction::reso )
+  {
+    typedef std::map< std::string, Parameter >::const_iterator pIter;
+    const std::map< std::string, Parameter >& pars = _resos[ ins.index ]->_parMap;
+    for ( pIter par = pars.begin(); par != pars.end(); ++par )
+      versions.push_back( par->second.version() );
+  }
+  else
+  {
+    typedef std::map< const std::string, Parameter >::const_iterator pIter;
+    const std::map< const std::string, Parameter >& pars = _fvecs[ ins.index ]._parMap;
+    for ( pIter par = pars.begin(); par != pars.end(); ++par )
+      versions.push_back( par->second.version() );
+  }
+
+  return versions;
+}
 
-  return values.top();
+
+const std::string Amplitude::basisShape( const std::size_t& k ) const
+{
+  if ( k >= _basis.size() )
+    return "unit";
+
+  const Instruction& ins = _tape[ _basis[ k ] ];
+  if ( ins.code == Instruction::reso )
+    return _resos[ ins.index ]->structure();
+
+  return _fvecs[ ins.index ].structure();
+}
+
+
+const std::string Amplitude::structure() const
+{
+  std::ostringstream shape;
+  shape.precision( 17 );
+
+  shape << _expression << " tape=";
+  for ( std::size_t pos = 0; pos < _tape.size(); ++pos )
+    shape << ( pos ? "," : "" ) << _tape[ pos ].code << ":" << _tape[ pos ].index;
+
+  shape << " opers=";
+  for ( std::size_t oper = 0; oper < _opers.size(); ++oper )
+    shape << ( oper ? "," : "" ) << _opers[ oper ];
+
+  shape << " ctnts=";
+  for ( std::size_t ctnt = 0; ctnt < _ctnts.size(); ++ctnt )
+    shape << ( ctnt ? "," : "" ) << _ctnts[ ctnt ];
+
+  shape << " parms=";
+  for ( std::size_t par = 0; par < _parms.size(); ++par )
+    shape << ( par ? "," : "" ) << _parms[ par ].name();
+
+  shape << " coefs=";
+  for ( std::size_t coef = 0; coef < _coefs.size(); ++coef )
+    shape << ( coef ? "," : "" ) << _coefs[ coef ].real().name() << ":" << _coefs[ coef ].imag().name();
+
+  for ( std::size_t reso = 0; reso < _resos.size(); ++reso )
+    shape << "\nreso " << _resos[ reso ]->structure();
+
+  for ( std::size_t fvec = 0; fvec < _fvecs.size(); ++fvec )
+    shape << "\nfvec " << _fvecs[ fvec ].structure();
+
+  return shape.str();
 }
 
 
@@ -235,6 +1192,8 @@ void Amplitude::clear()
   _opers.clear();
 
   _expression.clear();
+
+  compile();
 }
 
 
@@ -289,9 +1248,44 @@ const Amplitude& Amplitude::operator=( const Fvector& right )
 
 const Amplitude& Amplitude::operator=( const Amplitude& right )
 {
+  if ( &right == this )
+    return *this;
+
   clear();
 
   append( right );
+  copyBinding( right );
+  return *this;
+}
+
+const Amplitude& Amplitude::operator=( Amplitude&& right )
+{
+  _parMap     = std::move( right._parMap     );
+  _ctnts      = std::move( right._ctnts      );
+  _parms      = std::move( right._parms      );
+  _coefs      = std::move( right._coefs      );
+  _resos      = std::move( right._resos      );
+  _fvecs      = std::move( right._fvecs      );
+  _opers      = std::move( right._opers      );
+  _expression = std::move( right._expression );
+  _tape       = std::move( right._tape       );
+  _values     = std::move( right._values     );
+  _isCoef     = std::move( right._isCoef     );
+  _depth      = right._depth;
+  _valid      = right._valid;
+  _args       = std::move( right._args       );
+  _gradPars   = std::move( right._gradPars   );
+  _valueGrad  = std::move( right._valueGrad  );
+  _basis      = std::move( right._basis      );
+  _linear     = right._linear;
+  _hasUnit    = right._hasUnit;
+  _mapIdx     = std::move( right._mapIdx     );
+  _parmIdx    = std::move( right._parmIdx    );
+  _coefIdx    = std::move( right._coefIdx    );
+  _resoIdx    = std::move( right._resoIdx    );
+  _fvecIdx    = std::move( right._fvecIdx    );
+  _bound      = right._bound;
+
   return *this;
 }
 
@@ -0,0 +1,77 @@
+#include <new>
+#include <cstdlib>
+#include <cstddef>
+#include <algorithm>
+
+#include <cfit/arena.hh>
+
+
+thread_local Arena* Arena::_current = 0;
+
+// Each node is preceded by the arena it belongs to, or null if it is on the
+//    heap, padded to keep the node aligned for any type.
+static const std::size_t header = alignof( std::max_align_t );
+
+
+Arena::Arena( const std::size_t& blockSize )
+  : _blockSize( blockSize ), _next( 0 ), _left( 0 ), _bytes( 0 )
+{}
+
+
+Arena::~Arena()
+{
+  typedef std::vector< char* >::iterator bIter;
+  for ( bIter block = _blocks.begin(); block != _blocks.end(); ++block )
+    std::free( *block );
+}
+
+
+void* Arena::allocate( const std::size_t& bytes )
+{
+  const std::size_t size = ( bytes + header - 1 ) / header * header;
+
+  if ( size > _left )
+  {
+    // Objects larger than a block get a block of their own, and the current
+    //    one is kept for the next ones.
+    const std::size_t blockSize = std::max( size, _blockSize );
+    char* block = static_cast< char* >( std::malloc( blockSize ) );
+    if ( ! block )
+      throw std::bad_alloc();
+
+    _blocks.push_back( block );
+    _bytes += blockSize;
+
+    if ( size > _blockSize )
+      return block;
+
+    _next = block;
+    _left = blockSize;
+  }
+
+  void* ptr = _next;
+  _next += size;
+  _left -= size;
+
+  return ptr;
+}
+
+
+void* Arena::node( const std::size_t& bytes )
+{
+  char* ptr = static_cast< char* >( _current ? _current->allocate( bytes + header ) : ::operator new( bytes + header ) );
+  *reinterpret_cast< Arena** >( ptr ) = _current;
+
+  return ptr + header;
+}
+
+
+void Arena::release( void* ptr )
+{
+  if ( ! ptr )
+    return;
+
+  char* base = static_cast< char* >( ptr ) - header;
+  if ( ! *reinterpret_cast< Arena** >( base ) )
+    ::operator delete( base );
+}
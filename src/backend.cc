@@ -0,0 +1,12 @@
+
+#include <cfit/backend.hh>
+#include <cfit/minimizer.hh>
+
+
+double CpuBackend::sumBlocks( const Minimizer&                minimizer,
+                              const term_type&                term     ,
+                              const bool&                     shape    ,
+                              const std::function< void() >& first      ) const throw( PdfException )
+{
+  return minimizer.cpuSumBlocks( term, shape, first );
+}
@@ -43,6 +43,9 @@ BinnedAmplitude::BinnedAmplitude( const std::vector< Parameter >& npb,
     // _parMap.emplace( x->real().name(), x->real() );
     // _parMap.emplace( x->imag().name(), x->imag() );
   }
+
+  mapPars();
+  cacheValues();
 }
 
 
@@ -77,15 +80,113 @@ BinnedAmplitude::BinnedAmplitude( const std::vector< ParameterExpr >& npb,
     const std::map< std::string, Parameter >& pars = x->getPars();
     _parMap.insert( pars.begin(), pars.end() );
   }
+
+  mapPars();
+  cacheValues();
+}
+
+
+
+void BinnedAmplitude::mapPars()
+{
+  _binPars.assign( _nbins, std::vector< std::size_t >() );
+
+  const std::map< std::string, Parameter >& parMap = _parMap;
+
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  for ( unsigned bin = 0; bin < _nbins; ++bin )
+  {
+    std::map< std::string, Parameter > pars = _npb[ bin ].getPars();
+    const std::map< std::string, Parameter >& nmPars = _nmb[ bin ].getPars();
+    const std::map< std::string, Parameter >& xPars  = _xb [ bin ].getPars();
+    pars.insert( nmPars.begin(), nmPars.end() );
+    pars.insert( xPars .begin(), xPars .end() );
+
+    for ( pIter par = pars.begin(); par != pars.end(); ++par )
+      _binPars[ bin ].push_back( std::distance( parMap.begin(), parMap.find( par->first ) ) );
+  }
+}
+
+
+
+void BinnedAmplitude::cacheValues( const unsigned& bin )
+{
+  _tpb[ bin ] = _npb[ bin ].evaluate();
+  _tmb[ bin ] = _nmb[ bin ].evaluate();
+  _vxb[ bin ] = _xb [ bin ].evaluate();
+  _txb[ bin ] = std::sqrt( _tpb[ bin ] * _tmb[ bin ] ) * _vxb[ bin ];
+}
+
+
+
+void BinnedAmplitude::cacheValues()
+{
+  _tpb.resize( _nbins );
+  _tmb.resize( _nbins );
+  _vxb.resize( _nbins );
+  _txb.resize( _nbins );
+
+  for ( unsigned bin = 0; bin < _nbins; ++bin )
+    cacheValues( bin );
 }
 
 
 
 void BinnedAmplitude::setPars( const std::map< std::string, Parameter >& pars )
 {
-  typedef std::map< std::string, Parameter >::iterator mIter;
+  std::vector< double > values;
+
+  typedef std::map< std::string, Parameter >::const_iterator mIter;
   for ( mIter par = _parMap.begin(); par != _parMap.end(); ++par )
-    par->second.setValue( pars.find( par->first )->second.value() );
+    values.push_back( pars.find( par->first )->second.value() );
+
+  setValues( values );
+}
+
+
+void BinnedAmplitude::setPars( const ParameterRegistry& registry )
+{
+  const double* values = registry.values();
+
+  std::vector< double > parValues( _mapIdx.size() );
+  for ( std::size_t par = 0; par < _mapIdx.size(); ++par )
+    parValues[ par ] = values[ _mapIdx[ par ] ];
+
+  setValues( parValues );
+}
+
+
+void BinnedAmplitude::setValues( const std::vector< double >& values )
+{
+  // Positions of the parameters whose values have changed.
+  std::vector< bool > changed( _parMap.size(), false );
+
+  std::size_t index = 0;
+  typedef std::map< std::string, Parameter >::iterator mIter;
+  for ( mIter par = _parMap.begin(); par != _parMap.end(); ++par, ++index )
+  {
+    const double& value = values[ index ];
+    if ( value != par->second.value() )
+    {
+      par->second.setValue( value );
+      changed[ index ] = true;
+    }
+  }
+
+  // Propagate the values to the expressions, which hold their own parameters,
+  //    and evaluate them again, only for the bins that depend on any of them.
+  for ( unsigned bin = 0; bin < _nbins; ++bin )
+  {
+    const std::vector< std::size_t >& binPars = _binPars[ bin ];
+    if ( std::none_of( binPars.begin(), binPars.end(), [ & ]( const std::size_t& par ) { return changed[ par ]; } ) )
+      continue;
+
+    _npb[ bin ].setPars( _parMap );
+    _nmb[ bin ].setPars( _parMap );
+    _xb [ bin ].setPars( _parMap );
+
+    cacheValues( bin );
+  }
 
   // // Set the values of the parameters.
   // typedef std::vector< Parameter >::iterator pIter;
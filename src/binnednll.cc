@@ -0,0 +1,203 @@
+#include <iostream>
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+
+#ifdef MPI_ON
+#include <mpi.h>
+#endif
+
+#include <cfit/variable.hh>
+#include <cfit/dataset.hh>
+#include <cfit/pdfmodel.hh>
+#include <cfit/pdfexpr.hh>
+#include <cfit/binnednll.hh>
+#include <cfit/trace.hh>
+#include <cfit/compensatedsum.hh>
+
+// Contribution of each event in a bin where the pdf vanishes. It is large
+//    but finite, so that the minimizer can still compare such points.
+static const double zeroPenalty = 1.e10;
+
+
+// The minimizer is first built on no events, so that the pdf does not cache
+//    anything for the whole dataset.
+BinnedNll::BinnedNll( const PdfModel& pdf, const Dataset& data,
+                      const Variable& var1, const double& min1, const double& max1, const unsigned& nBins1,
+                      const Variable& var2, const double& min2, const double& max2, const unsigned& nBins2 )
+  : Minimizer( pdf, data.range( 0, 0 ) ),
+    _var1( var1.name() ), _min1( min1 ), _max1( max1 ), _nBins1( nBins1 ),
+    _var2( var2.name() ), _min2( min2 ), _max2( max2 ), _nBins2( nBins2 ),
+    _total( 0.0 )
+{
+  _up = 1.0;
+
+  Minimizer::setData( histogram( data ) );
+}
+
+
+BinnedNll::BinnedNll( const PdfExpr& pdf, const Dataset& data,
+                      const Variable& var1, const double& min1, const double& max1, const unsigned& nBins1,
+                      const Variable& var2, const double& min2, const double& max2, const unsigned& nBins2 )
+  : Minimizer( pdf, data.range( 0, 0 ) ),
+    _var1( var1.name() ), _min1( min1 ), _max1( max1 ), _nBins1( nBins1 ),
+    _var2( var2.name() ), _min2( min2 ), _max2( max2 ), _nBins2( nBins2 ),
+    _total( 0.0 )
+{
+  _up = 1.0;
+
+  Minimizer::setData( histogram( data ) );
+}
+
+
+BinnedNll::BinnedNll( const BinnedNll& nll )
+  : Minimizer( nll ),
+    _var1( nll._var1 ), _min1( nll._min1 ), _max1( nll._max1 ), _nBins1( nll._nBins1 ),
+    _var2( nll._var2 ), _min2( nll._min2 ), _max2( nll._max2 ), _nBins2( nll._nBins2 ),
+    _counts( nll._counts ), _total( nll._total )
+{}
+
+
+void BinnedNll::setData( const std::shared_ptr< const Dataset >& data )
+{
+  Minimizer::setData( histogram( *data ) );
+}
+
+
+const long BinnedNll::bin( const double& val1, const double& val2 ) const
+{
+  if ( ( val1 < _min1 ) || ( val1 >= _max1 ) || ( val2 < _min2 ) || ( val2 >= _max2 ) )
+    return -1;
+
+  const unsigned bin1 = std::min( unsigned( ( val1 - _min1 ) / ( _max1 - _min1 ) * _nBins1 ), _nBins1 - 1 );
+  const unsigned bin2 = std::min( unsigned( ( val2 - _min2 ) / ( _max2 - _min2 ) * _nBins2 ), _nBins2 - 1 );
+
+  return long( bin1 ) * _nBins2 + bin2;
+}
+
+
+const std::shared_ptr< const Dataset > BinnedNll::histogram( const Dataset& data ) throw( PdfException )
+{
+  if ( ( _nBins1 == 0 ) || ( _nBins2 == 0 ) || ( _max1 <= _min1 ) || ( _max2 <= _min2 ) )
+    throw PdfException( "BinnedNll: the histogram must have at least one bin of positive width in each variable." );
+
+  std::vector< double > counts( std::size_t( _nBins1 ) * _nBins2, 0.0 );
+
+  const Dataset occupied = fill( data, counts );
+
+  _total  = CompensatedSum::sum( counts.data(), counts.size() );
+  _counts = std::make_shared< const std::vector< double > >( counts );
+
+  return std::make_shared< const Dataset >( occupied );
+}
+
+
+const Dataset BinnedNll::fill( const Dataset& data, std::vector< double >& counts ) const
+{
+  const double* val1 = data.valueColumn( data.column( _var1 ) );
+  const double* val2 = data.valueColumn( data.column( _var2 ) );
+
+  std::vector< double > added( counts.size(), 0.0 );
+
+  // First event of each bin occupied for the first time.
+  std::vector< std::size_t > first;
+
+  const std::size_t size = data.size();
+  for ( std::size_t entry = 0; entry < size; ++entry )
+  {
+    const long index = bin( val1[ entry ], val2[ entry ] );
+    if ( index == -1 )
+      continue;
+
+    if ( ! added[ index ]++ && ! counts[ index ] )
+      first.push_back( entry );
+  }
+
+  Dataset occupied = data.range( 0, 0 );
+  for ( std::vector< std::size_t >::const_iterator entry = first.begin(); entry != first.end(); ++entry )
+    occupied.append( data.range( *entry, 1 ) );
+
+#ifdef MPI_ON
+  // If running with MPI, each process only has a piece of the dataset. All of
+  //    them evaluate the whole histogram, so they need the counts of all the pieces.
+  std::vector< double > result( added.size(), 0.0 );
+  MPI::COMM_WORLD.Allreduce( added.data(), result.data(), added.size(), MPI::DOUBLE, MPI::SUM );
+  added.swap( result );
+#endif
+
+  for ( std::size_t index = 0; index < counts.size(); ++index )
+    counts[ index ] += added[ index ];
+
+  return occupied;
+}
+
+
+void BinnedNll::append( const Dataset& events ) throw( PdfException )
+{
+  std::vector< double > counts( *_counts );
+
+  const Dataset occupied = fill( events, counts );
+
+  _total  = CompensatedSum::sum( counts.data(), counts.size() );
+  _counts = std::make_shared< const std::vector< double > >( counts );
+
+  Minimizer::append( occupied );
+}
+
+
+void BinnedNll::select( const std::vector< std::size_t >& entries ) throw( PdfException )
+{
+  throw PdfException( "BinnedNll: the histogram cannot be subsampled, fit it without a progressive configuration." );
+}
+
+
+double BinnedNll::operator()( const std::vector<double>& pars ) const throw( PdfException )
+{
+  if ( pars.size() != _pdf->nPars() )
+    throw PdfException( "Number of parameters passed does not match number of required arguments." );
+
+  count( _stats.calls );
+
+  _pdf->setPars( pars );
+
+  // Cache anything common to all bins (usually compute the norm), for the
+  //    parts of the pdf whose parameters have changed since the previous call.
+  update();
+
+  const std::vector< double >& counts = *_counts;
+
+  std::vector< double > hist( counts.size() );
+  {
+    const Timer timer( profiled( _stats.loop ) );
+    _pdf->projectHist( _var1, _min1, _max1, _nBins1, _var2, _min2, _max2, _nBins2, hist.data() );
+  }
+
+  // The pdf is normalized in its whole domain, which the histogram need not
+  //    cover, but the counts are only those of the events inside it, so the
+  //    prediction is normalized by the integral of the pdf in the histogram.
+  const double inside = CompensatedSum::sum( hist.data(), hist.size() );
+
+  // Sum of the terms of the nll. Empty bins in which the pdf vanishes do not
+  //    contribute, but events in bins that the pdf cannot populate add a large
+  //    penalty, so that the minimizer is pushed away from such parameters.
+  CompensatedSum sum;
+  for ( std::size_t index = 0; index < counts.size(); ++index )
+  {
+    const double  mu = ( inside > 0.0 ) ? _total * hist[ index ] / inside : 0.0;
+    const double& n  = counts[ index ];
+
+    if ( mu > 0.0 )
+      sum += 2.0 * ( mu - n + ( n ? n * std::log( n / mu ) : 0.0 ) );
+    else if ( n )
+      sum += zeroPenalty * n;
+  }
+
+  const double nll = sum.value();
+
+  if ( _verbose )
+    std::cout << "nll = " << nll << std::endl;
+
+  return nll;
+}
@@ -1,100 +1,376 @@
-
 #include <cmath>
+#include <cstring>
+#include <cstdint>
 #include <fstream>
 #include <limits>
 #include <stdexcept>
 #include <algorithm>
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include <cfit/binning.hh>
 #include <cfit/exceptions.hh>
 
 
-float Binning::distance( const std::pair< float, float >& a, const std::pair< float, float >& b )
+// Header of the binary binning files, followed by the arrays x, y, bins,
+//    cellStart, cellPoints and raster, in native byte order.
+struct BinningHeader
+{
+  char     magic[ 8 ];
+  uint64_t nPoints;
+  float    xMin;
+  float    yMin;
+  float    cellWidth;
+  float    cellHeight;
+  uint32_t nCellsX;
+  uint32_t nCellsY;
+  uint32_t nRasterX;
+  uint32_t nRasterY;
+};
+
+static const char binningMagic[ 8 ] = { 'C', 'F', 'I', 'T', 'B', 'I', 'N', '1' };
+
+
+Binning::Binning( const Data& xybin, const unsigned& nRasterX, const unsigned& nRasterY )
+  : _nRasterX( 0 ), _nRasterY( 0 )
 {
-  return std::sqrt( std::pow( a.first - b.first, 2 ) + std::pow( a.second - b.second, 2 ) );
+  Data sorted( xybin );
+  std::sort( sorted.begin(), sorted.end(), ByX() );
+
+  std::shared_ptr< Arrays > arrays( new Arrays );
+  for ( Data::const_iterator point = sorted.begin(); point != sorted.end(); ++point )
+  {
+    arrays->x   .push_back( point->first.first  );
+    arrays->y   .push_back( point->first.second );
+    arrays->bins.push_back( point->second       );
+  }
+
+  buildCells( *arrays );
+  adopt( arrays );
+
+  setRaster( nRasterX, nRasterY );
 }
 
 
-float Binning::distance( const std::pair< float, float >& a, const float& bx, const float& by )
+Binning::Binning( const std::string& binsfile ) throw( PdfException )
 {
-  return std::sqrt( std::pow( a.first - bx, 2 ) + std::pow( a.second - by, 2 ) );
+  const int fd = open( binsfile.c_str(), O_RDONLY );
+  if ( fd < 0 )
+    throw PdfException( "Binning: cannot open binning file " + binsfile + "." );
+
+  struct stat info;
+  if ( ( fstat( fd, &info ) != 0 ) || ( std::size_t( info.st_size ) < sizeof( BinningHeader ) ) )
+  {
+    close( fd );
+    throw PdfException( "Binning: " + binsfile + " is not a binning file." );
+  }
+
+  const std::size_t size = info.st_size;
+  void* addr = mmap( 0, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+  close( fd );
+
+  if ( addr == MAP_FAILED )
+    throw PdfException( "Binning: cannot map binning file " + binsfile + "." );
+
+  _storage = std::shared_ptr< const void >( addr, [ size ]( const void* p ) { munmap( const_cast< void* >( p ), size ); } );
+
+  const BinningHeader& header = *static_cast< const BinningHeader* >( addr );
+
+  const std::size_t nCells  = std::size_t( header.nCellsX  ) * header.nCellsY;
+  const std::size_t nRaster = std::size_t( header.nRasterX ) * header.nRasterY;
+  const std::size_t words   = 4 * header.nPoints + ( header.nPoints ? nCells + 1 : 0 ) + nRaster;
+  if ( std::memcmp( header.magic, binningMagic, sizeof( binningMagic ) ) || ( size != sizeof( BinningHeader ) + 4 * words ) )
+    throw PdfException( "Binning: " + binsfile + " is not a binning file, or it is corrupted." );
+
+  _nPoints    = header.nPoints;
+  _xMin       = header.xMin;
+  _yMin       = header.yMin;
+  _cellWidth  = header.cellWidth;
+  _cellHeight = header.cellHeight;
+  _nCellsX    = header.nCellsX;
+  _nCellsY    = header.nCellsY;
+  _nRasterX   = header.nRasterX;
+  _nRasterY   = header.nRasterY;
+
+  const char* data = static_cast< const char* >( addr ) + sizeof( BinningHeader );
+  _x          = reinterpret_cast< const float*    >( data );
+  _y          = reinterpret_cast< const float*    >( _x          + _nPoints );
+  _bins       = reinterpret_cast< const unsigned* >( _y          + _nPoints );
+  _cellStart  = reinterpret_cast< const unsigned* >( _bins       + _nPoints );
+  _cellPoints = reinterpret_cast< const unsigned* >( _cellStart  + ( _nPoints ? nCells + 1 : 0 ) );
+  _raster     = nRaster ? reinterpret_cast< const int* >( _cellPoints + _nPoints ) : 0;
 }
 
 
-Binning::Binning( const Data& xybin )
-  : _xybinx( xybin ), _xybiny( xybin )
+void Binning::write( const std::string& binsfile ) const throw( PdfException )
 {
-  std::sort( _xybinx.begin(), _xybinx.end(), ByX() );
-  std::sort( _xybiny.begin(), _xybiny.end(), ByY() );
+  std::ofstream file( binsfile.c_str(), std::ios::binary | std::ios::trunc );
+  if ( ! file )
+    throw PdfException( "Binning: cannot open binning file " + binsfile + " for writing." );
+
+  BinningHeader header;
+  std::memcpy( header.magic, binningMagic, sizeof( binningMagic ) );
+  header.nPoints    = _nPoints;
+  header.xMin       = _xMin;
+  header.yMin       = _yMin;
+  header.cellWidth  = _cellWidth;
+  header.cellHeight = _cellHeight;
+  header.nCellsX    = _nCellsX;
+  header.nCellsY    = _nCellsY;
+  header.nRasterX   = _raster ? _nRasterX : 0;
+  header.nRasterY   = _raster ? _nRasterY : 0;
+
+  const std::size_t nCells  = _nPoints ? std::size_t( _nCellsX ) * _nCellsY + 1 : 0;
+  const std::size_t nRaster = std::size_t( header.nRasterX ) * header.nRasterY;
+
+  file.write( reinterpret_cast< const char* >( &header     ), sizeof( header )              );
+  file.write( reinterpret_cast< const char* >( _x          ), sizeof( float    ) * _nPoints );
+  file.write( reinterpret_cast< const char* >( _y          ), sizeof( float    ) * _nPoints );
+  file.write( reinterpret_cast< const char* >( _bins       ), sizeof( unsigned ) * _nPoints );
+  file.write( reinterpret_cast< const char* >( _cellStart  ), sizeof( unsigned ) * nCells   );
+  file.write( reinterpret_cast< const char* >( _cellPoints ), sizeof( unsigned ) * _nPoints );
+  file.write( reinterpret_cast< const char* >( _raster     ), sizeof( int      ) * nRaster  );
+
+  if ( ! file )
+    throw PdfException( "Binning: error writing binning file " + binsfile + "." );
 }
 
 
-// Find the bin corresponding to position (x,y) over the phase space.
-int Binning::bin( const float& x, const float& y ) const
+void Binning::adopt( const std::shared_ptr< Arrays >& arrays )
 {
-  if ( _xybinx.empty() || _xybiny.empty() )
-    throw PdfException( "Binning: cannot identify bin with an empty binning scheme." );
+  _storage    = arrays;
+  _nPoints    = arrays->x.size();
+  _x          = arrays->x         .data();
+  _y          = arrays->y         .data();
+  _bins       = arrays->bins      .data();
+  _cellStart  = arrays->cellStart .data();
+  _cellPoints = arrays->cellPoints.data();
+  _raster     = arrays->raster.empty() ? 0 : arrays->raster.data();
+}
 
-  if ( x < y )
-    return - bin( y, x );
 
-  // Find the first elements with x-coordinate >= x. Can be more than 1 if
-  //    some points have the same x-coordinate and different y-coordinate.
-  Data::const_iterator pxmin = std::lower_bound( _xybinx.begin(), _xybinx.end(), x                 , PosX() );
-  Data::const_iterator pxmax = std::upper_bound( _xybinx.begin(), _xybinx.end(), pxmin->first.first, PosX() );
+const std::shared_ptr< Binning::Arrays > Binning::copyArrays() const
+{
+  std::shared_ptr< Arrays > arrays( new Arrays );
+
+  const std::size_t nCells = _nPoints ? std::size_t( _nCellsX ) * _nCellsY + 1 : 0;
+
+  arrays->x         .assign( _x         , _x          + _nPoints );
+  arrays->y         .assign( _y         , _y          + _nPoints );
+  arrays->bins      .assign( _bins      , _bins       + _nPoints );
+  arrays->cellStart .assign( _cellStart , _cellStart  + nCells   );
+  arrays->cellPoints.assign( _cellPoints, _cellPoints + _nPoints );
+
+  return arrays;
+}
 
-  // Out of these, find the first point with y-coordinate >= y.
-  Data::const_iterator px = std::lower_bound( pxmin, pxmax, y, PosY() );
 
-  // This point is likely to be close to (x,y). Find an upper limit to the closest point distance.
-  float delta = distance( px->first, x, y );
-  if ( px != _xybinx.begin() )
+void Binning::buildCells( Arrays& arrays )
+{
+  arrays.cellStart .clear();
+  arrays.cellPoints.clear();
+  _nCellsX = _nCellsY = 0;
+
+  const std::vector< float >& xs = arrays.x;
+  const std::vector< float >& ys = arrays.y;
+
+  if ( xs.empty() )
+    return;
+
+  float xMax = xs.back();
+  float yMax = ys.front();
+  _xMin = xs.front();
+  _yMin = yMax;
+  for ( std::size_t point = 0; point < ys.size(); ++point )
   {
-    delta = std::min( delta, distance( ( px - 1 )->first, x, y ) );
-    pxmin = std::lower_bound( _xybinx.begin(), _xybinx.end(), ( pxmin - 1 )->first.first, PosX() );
-    pxmax = std::upper_bound( _xybinx.begin(), _xybinx.end(),   pxmin      ->first.first, PosX() );
-    px = std::lower_bound( pxmin, pxmax, y, PosY() );
-    delta = std::min( delta, distance( px->first, x, y ) );
-    if ( px != _xybinx.begin() )
-      delta = std::min( delta, distance( ( px - 1 )->first, x, y ) );
+    _yMin = std::min( _yMin, ys[ point ] );
+    yMax  = std::max( yMax , ys[ point ] );
   }
 
-  // Find all points with y-coordinate not further away than delta from the given point.
-  Data::const_iterator pymin = std::lower_bound( _xybiny.begin(), _xybiny.end(), y - delta, PosY() );
-  Data::const_iterator pymax = std::upper_bound( _xybiny.begin(), _xybiny.end(), y + delta, PosY() );
+  // About one point per cell, with cells as square as possible.
+  const double width   = std::max( double( xMax - _xMin ), 1e-12 );
+  const double height  = std::max( double( yMax - _yMin ), 1e-12 );
+  const double nPoints = xs.size();
+
+  _nCellsX = unsigned( std::min( std::max( std::sqrt( nPoints * width  / height ), 1.0 ), nPoints ) );
+  _nCellsY = unsigned( std::min( std::max( std::sqrt( nPoints * height / width  ), 1.0 ), nPoints ) );
 
-  Data::const_iterator py;
+  // Enlarge the cells slightly, so that the points on the upper edges fall inside.
+  _cellWidth  = width  / _nCellsX * ( 1.0 + 1e-6 );
+  _cellHeight = height / _nCellsY * ( 1.0 + 1e-6 );
 
-  float dist;
-  Data::const_iterator point;
-  while( pymin != pymax )
+  // Sort the indices of the points by cell, keeping them in increasing order within each cell.
+  std::vector< unsigned > cells( xs.size() );
+  arrays.cellStart.assign( _nCellsX * _nCellsY + 1, 0 );
+  for ( std::size_t point = 0; point < xs.size(); ++point )
   {
-    // Build (pymin, py) as a range of points with equal y, sorted by x.
-    //    Find the two points closest to (x,y).
-    py    = std::upper_bound( pymin, pymax, pymin->first.second, PosY() );
-    pymin = std::lower_bound( pymin, py   , x                  , PosX() );
-    if ( std::fabs( ( pymin - 1 )->first.first - x ) <= delta )
+    const unsigned cx = std::min( unsigned( ( xs[ point ] - _xMin ) / _cellWidth  ), _nCellsX - 1 );
+    const unsigned cy = std::min( unsigned( ( ys[ point ] - _yMin ) / _cellHeight ), _nCellsY - 1 );
+    cells[ point ] = cx * _nCellsY + cy;
+    ++arrays.cellStart[ cells[ point ] + 1 ];
+  }
+
+  for ( std::size_t cell = 0; cell < _nCellsX * _nCellsY; ++cell )
+    arrays.cellStart[ cell + 1 ] += arrays.cellStart[ cell ];
+
+  std::vector< unsigned > next( arrays.cellStart.begin(), arrays.cellStart.end() - 1 );
+  arrays.cellPoints.resize( xs.size() );
+  for ( std::size_t point = 0; point < xs.size(); ++point )
+    arrays.cellPoints[ next[ cells[ point ] ]++ ] = point;
+}
+
+
+unsigned Binning::nearest( const float& x, const float& y, float* second ) const
+{
+  const float inf = std::numeric_limits< float >::max();
+
+  // Cell of the point, or nearest cell if it is outside the grid.
+  const int cx = std::min( std::max( int( std::floor( ( x - _xMin ) / _cellWidth  ) ), 0 ), int( _nCellsX ) - 1 );
+  const int cy = std::min( std::max( int( std::floor( ( y - _yMin ) / _cellHeight ) ), 0 ), int( _nCellsY ) - 1 );
+
+  unsigned best     = 0;
+  float    bestDist = inf;
+  float    nextDist = inf;
+
+  // Look at the rings of cells around ( cx, cy ) until no point in the next ones
+  //    can be closer than the nearest ( or second nearest ) point found.
+  for ( int ring = 0; ; ++ring )
+  {
+    for ( int ix = cx - ring; ix <= cx + ring; ++ix )
     {
-      dist = distance( ( pymin - 1 )->first, x, y );
-      if ( dist <= delta )
+      if ( ( ix < 0 ) || ( ix >= int( _nCellsX ) ) )
+        continue;
+
+      // Only the first and last columns of the ring are complete.
+      const int step = ( ( ix == cx - ring ) || ( ix == cx + ring ) ) ? 1 : std::max( 2 * ring, 1 );
+      for ( int iy = cy - ring; iy <= cy + ring; iy += step )
       {
-        delta = dist;
-        point = pymin - 1;
+        if ( ( iy < 0 ) || ( iy >= int( _nCellsY ) ) )
+          continue;
+
+        const unsigned cell = ix * _nCellsY + iy;
+        for ( unsigned pos = _cellStart[ cell ]; pos < _cellStart[ cell + 1 ]; ++pos )
+        {
+          const unsigned& point = _cellPoints[ pos ];
+          const float     dx    = _x[ point ] - x;
+          const float     dy    = _y[ point ] - y;
+          const float     dist  = dx * dx + dy * dy;
+
+          if ( ( dist < bestDist ) || ( ( dist == bestDist ) && ( point < best ) ) )
+          {
+            nextDist = bestDist;
+            bestDist = dist;
+            best     = point;
+          }
+          else if ( dist < nextDist )
+            nextDist = dist;
+        }
       }
     }
-    if ( std::fabs( pymin->first.first - x ) <= delta )
+
+    // Distance from ( x, y ) to the cells beyond the ring, on the sides where there
+    //    are any, taking into account how far the point is outside the grid.
+    const float left   = x - ( _xMin + ( cx - ring     ) * _cellWidth  );
+    const float right  =     ( _xMin + ( cx + ring + 1 ) * _cellWidth  ) - x;
+    const float bottom = y - ( _yMin + ( cy - ring     ) * _cellHeight );
+    const float top    =     ( _yMin + ( cy + ring + 1 ) * _cellHeight ) - y;
+
+    const float outX = std::max( std::max( _xMin - x, x - ( _xMin + _nCellsX * _cellWidth  ) ), float( 0.0 ) );
+    const float outY = std::max( std::max( _yMin - y, y - ( _yMin + _nCellsY * _cellHeight ) ), float( 0.0 ) );
+
+    float bound = inf;
+    if ( cx - ring > 0                   ) bound = std::min( bound, std::sqrt( left   * left   + outY * outY ) );
+    if ( cx + ring < int( _nCellsX ) - 1 ) bound = std::min( bound, std::sqrt( right  * right  + outY * outY ) );
+    if ( cy - ring > 0                   ) bound = std::min( bound, std::sqrt( bottom * bottom + outX * outX ) );
+    if ( cy + ring < int( _nCellsY ) - 1 ) bound = std::min( bound, std::sqrt( top    * top    + outX * outX ) );
+
+    if ( bound == inf )
+      break;
+
+    const float limit = second ? nextDist : bestDist;
+    if ( ( limit < inf ) && ( bound > 0.0 ) && ( bound * bound >= limit ) )
+      break;
+  }
+
+  if ( second )
+    *second = nextDist;
+
+  return best;
+}
+
+
+void Binning::setRaster( const unsigned& nRasterX, const unsigned& nRasterY )
+{
+  // The arrays may be shared with other binnings or mapped, so the raster goes into a copy.
+  std::shared_ptr< Arrays > arrays = copyArrays();
+
+  if ( ( nRasterX == 0 ) || ( nRasterY == 0 ) || ( _nPoints == 0 ) )
+  {
+    _nRasterX = _nRasterY = 0;
+    adopt( arrays );
+    return;
+  }
+
+  std::vector< int >& raster = arrays->raster;
+  raster.assign( nRasterX * nRasterY, -1 );
+
+  const float width    = _cellWidth  * _nCellsX / nRasterX;
+  const float height   = _cellHeight * _nCellsY / nRasterY;
+  const float diagonal = std::sqrt( width * width + height * height );
+
+  // Moving within a raster cell changes the distance to any point by less than
+  //    half its diagonal. Therefore, if the nearest point to the centre is closer
+  //    than the second nearest by more than a diagonal, it is the nearest point
+  //    to all the positions in the cell.
+  for ( unsigned ix = 0; ix < nRasterX; ++ix )
+    for ( unsigned iy = 0; iy < nRasterY; ++iy )
+    {
+      // Cells entirely in the region x < y are never looked up.
+      if ( _xMin + width * ( ix + 1 ) < _yMin + height * iy )
+        continue;
+
+      const float x = _xMin + width  * ( ix + 0.5 );
+      const float y = _yMin + height * ( iy + 0.5 );
+
+      float second;
+      const unsigned point = nearest( x, y, &second );
+      const float    first = std::sqrt( std::pow( _x[ point ] - x, 2 ) + std::pow( _y[ point ] - y, 2 ) );
+
+      if ( std::sqrt( second ) - first > diagonal )
+        raster[ ix * nRasterY + iy ] = _bins[ point ];
+    }
+
+  _nRasterX = nRasterX;
+  _nRasterY = nRasterY;
+  adopt( arrays );
+}
+
+
+// Find the bin corresponding to position (x,y) over the phase space.
+int Binning::bin( const float& x, const float& y ) const
+{
+  if ( _nPoints == 0 )
+    throw PdfException( "Binning: cannot identify bin with an empty binning scheme." );
+
+  if ( x < y )
+    return - bin( y, x );
+
+  if ( _raster )
+  {
+    const float rx = ( x - _xMin ) / ( _cellWidth  * _nCellsX ) * _nRasterX;
+    const float ry = ( y - _yMin ) / ( _cellHeight * _nCellsY ) * _nRasterY;
+    if ( ( rx >= 0.0 ) && ( ry >= 0.0 ) && ( rx < _nRasterX ) && ( ry < _nRasterY ) )
     {
-      dist = distance( pymin->first, x, y );
-      if ( dist <= delta )
-      {
-        delta = dist;
-        point = pymin;
-      }
+      const int& cached = _raster[ unsigned( rx ) * _nRasterY + unsigned( ry ) ];
+      if ( cached >= 0 )
+        return cached;
     }
-    pymin = py;
   }
 
-  return point->second;
+  return _bins[ nearest( x, y ) ];
 }
 
 
@@ -1,8 +1,8 @@
 
-#include <iostream> // TEMPORAL
-
+#include <iostream>
 #include <vector>
 #include <string>
+#include <memory>
 
 #ifdef MPI_ON
 #include <mpi.h>
@@ -12,84 +12,186 @@
 #include <cfit/dataset.hh>
 #include <cfit/pdfmodel.hh>
 #include <cfit/chi2.hh>
+#include <cfit/trace.hh>
+#include <cfit/compensatedsum.hh>
 
 
 Chi2::Chi2( const PdfModel& pdf, const Variable& y, const Dataset& data )
-  : Minimizer( pdf, data ), _y( y )
+  : Minimizer( pdf, data ), _y( y ), _binned( false ), _binVolume( 1.0 ), _yColumn( 0 ), _scale( 1.0 )
 {
   _up = 1.0;
+
+  cacheVariances();
 }
 
 
 Chi2::Chi2( const PdfExpr& pdf, const Variable& y, const Dataset& data )
-  : Minimizer( pdf, data ), _y( y )
+  : Minimizer( pdf, data ), _y( y ), _binned( false ), _binVolume( 1.0 ), _yColumn( 0 ), _scale( 1.0 )
+{
+  _up = 1.0;
+
+  cacheVariances();
+}
+
+
+Chi2::Chi2( const PdfModel& pdf, const Variable& y, const DatasetView& data )
+  : Minimizer( pdf, data ), _y( y ), _binned( false ), _binVolume( 1.0 ), _yColumn( 0 ), _scale( 1.0 )
 {
   _up = 1.0;
+
+  cacheVariances();
+}
+
+
+Chi2::Chi2( const PdfExpr& pdf, const Variable& y, const DatasetView& data )
+  : Minimizer( pdf, data ), _y( y ), _binned( false ), _binVolume( 1.0 ), _yColumn( 0 ), _scale( 1.0 )
+{
+  _up = 1.0;
+
+  cacheVariances();
+}
+
+
+Chi2::Chi2( const PdfModel& pdf, const Variable& y, const std::shared_ptr< const Dataset >& data )
+  : Minimizer( pdf, data ), _y( y ), _binned( false ), _binVolume( 1.0 ), _yColumn( 0 ), _scale( 1.0 )
+{
+  _up = 1.0;
+
+  cacheVariances();
+}
+
+
+Chi2::Chi2( const PdfExpr& pdf, const Variable& y, const std::shared_ptr< const Dataset >& data )
+  : Minimizer( pdf, data ), _y( y ), _binned( false ), _binVolume( 1.0 ), _yColumn( 0 ), _scale( 1.0 )
+{
+  _up = 1.0;
+
+  cacheVariances();
 }
 
 
 Chi2::Chi2( const Chi2& chi2 )
-  : Minimizer( chi2 ), _y( chi2._y )
+  : Minimizer( chi2 ), _y( chi2._y ), _binned( chi2._binned ), _binVolume( chi2._binVolume ),
+    _yColumn( chi2._yColumn ), _scale( chi2._scale ), _variances( chi2._variances )
 {}
 
 
+void Chi2::setData( const std::shared_ptr< const Dataset >& data )
+{
+  Minimizer::setData( data );
+  cacheVariances();
+}
+
+
+void Chi2::append( const Dataset& events ) throw( PdfException )
+{
+  Minimizer::append( events );
+  cacheVariances();
+}
+
+
+void Chi2::select( const std::vector< std::size_t >& entries ) throw( PdfException )
+{
+  Minimizer::select( entries );
+  cacheVariances();
+}
+
+
+void Chi2::setBinned( const double& binVolume )
+{
+  _binned    = true;
+  _binVolume = binVolume;
+  cacheVariances();
+}
+
+
+// Compute the variance of each entry, s_y^2 + Sum( s_x^2 ), and, in binned mode,
+//    the factor that turns the values of the pdf into predicted contents.
+void Chi2::cacheVariances()
+{
+  const Dataset& data = *_data;
+
+  const std::vector< std::string >& varNames = _pdf->varNames();
+
+  std::vector< std::size_t > columns;
+  for ( std::size_t var = 0; var < varNames.size(); ++var )
+    columns.push_back( data.column( varNames[ var ] ) );
+
+  _yColumn = data.column( _y.name() );
+
+  const std::size_t size = data.size();
+  std::vector< double > variances( size, 0.0 );
+  for ( std::size_t var = 0; var < columns.size(); ++var )
+    if ( data.hasErrors( columns[ var ] ) )
+    {
+      const double* errors = data.errorColumn( columns[ var ] );
+      for ( std::size_t entry = 0; entry < size; ++entry )
+        variances[ entry ] += errors[ entry ] * errors[ entry ];
+    }
+
+  const double* contents = data.valueColumn( _yColumn );
+  if ( data.hasErrors( _yColumn ) )
+  {
+    const double* errors = data.errorColumn( _yColumn );
+    for ( std::size_t entry = 0; entry < size; ++entry )
+      variances[ entry ] += errors[ entry ] * errors[ entry ];
+  }
+  else if ( _binned )
+    for ( std::size_t entry = 0; entry < size; ++entry )
+      variances[ entry ] += ( contents[ entry ] > 0.0 ) ? contents[ entry ] : 1.0;
+
+  _scale = _binned ? CompensatedSum::sum( contents, size ) * _binVolume : 1.0;
+
+  _variances = std::make_shared< const std::vector< double > >( variances );
+}
+
+
 double Chi2::operator()( const std::vector<double>& pars ) const throw( PdfException )
 {
   if ( pars.size() != _pdf->nPars() )
     throw PdfException( "Number of parameters passed does not match number of required arguments." );
 
+  count( _stats.calls );
+
   _pdf->setPars( pars );
 
   // Before evaluating the pdf at all data points, cache anything common to
-  //    all points (usually compute the norm).
-  _pdf->cache();
-
-  // Get the vector of variable names that the pdf depends on.
-  std::vector< std::string > varNames = _pdf->varNames();
-  typedef std::vector< std::string >::const_iterator vIter;
+  //    all points (usually compute the norm), for the parts of the pdf whose
+  //    parameters have changed since the previous call.
+  update();
 
-  // Vector of values of the variables that the pdf must be evaluated at.
-  std::vector< double > vars;
-
-  // Initialize the value of the chi^2.
-  double chi2 = 0.;
+  const double* contents  = _data->valueColumn( _yColumn );
+  const double* variances = _variances->data();
+  const double  scale     = _scale;
 
   // Sum of the terms of the chi^2.
-  for ( std::size_t n = 0; n < _data.size(); ++n )
-    {
-      // Initialize the value of the variance for the current entry.
-      //    It must be s_y^2 + Sum( s_x^2 ).
-      double variance = 0.0;
-
-      // Reset the vector of values of the variables.
-      vars.clear();
-
-      // Fill the vector of values and sum the terms of the variance.
-      for ( vIter var = varNames.begin(); var != varNames.end(); ++var )
-	{
-	  vars.push_back( _data.value( *var, n ) );
-	  variance += pow( _data.error( *var, n ), 2 );
-	}
-
-      // Compute the numerator of the chi^2 term and finish computing the variance.
-      double diff = _pdf->evaluate( vars ) - _data.value( _y.name(), n );
-      variance += pow( _data.error( _y.name(), n ), 2 );
-
-      // Add the term to the chi^2.
-      chi2 += pow( diff, 2 ) / variance;
-    }
+  double chi2 = sumBlocks( [ contents, variances, scale ]( const std::size_t& first, const std::size_t& n, const double* values )
+                           {
+                             CompensatedSum sum;
+                             for ( std::size_t entry = 0; entry < n; ++entry )
+                             {
+                               const double diff = scale * values[ entry ] - contents[ first + entry ];
+                               sum += diff * diff / variances[ first + entry ];
+                             }
+                             return sum.value();
+                           } );
 
 #ifdef MPI_ON
   // If running with MPI, each process has only computed a piece of the chi2.
   //    Add all the pieces up and broadcast them to all the processes.
   double result = 0.;
   MPI::Comm& world = MPI::COMM_WORLD;
-  world.Barrier();
-  world.Allreduce( &chi2, &result, 1, MPI::DOUBLE, MPI::SUM );
+  {
+    const Timer timer( profiled( _stats.reduce ) );
+    TRACE_SCOPE( "MPI::Allreduce" );
+    world.Barrier();
+    world.Allreduce( &chi2, &result, 1, MPI::DOUBLE, MPI::SUM );
+  }
 
   return result;
 #else
-  std::cout << "chi2 = " << chi2 << std::endl;
+  if ( _verbose )
+    std::cout << "chi2 = " << chi2 << std::endl;
 
   return chi2;
 #endif
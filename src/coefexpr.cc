@@ -90,6 +90,13 @@ const std::map< std::string, Parameter > CoefExpr::getPars() const
   for ( pIter par = _parms.begin(); par != _parms.end(); ++par )
     parMap.emplace( par->name(), *par );
 
+  typedef std::vector< Coef >::const_iterator cIter;
+  for ( cIter coef = _coefs.begin(); coef != _coefs.end(); ++coef )
+  {
+    parMap.emplace( coef->real().name(), coef->real() );
+    parMap.emplace( coef->imag().name(), coef->imag() );
+  }
+
   return parMap;
 }
 
@@ -0,0 +1,224 @@
+
+#include <algorithm>
+
+#include <cfit/conjugatedecaymodel.hh>
+
+
+ConjugateDecayModel::ConjugateDecayModel( const Variable&   mSq12,
+                                          const Variable&   mSq13,
+                                          const Variable&   mSq23,
+                                          const Amplitude&  amp  ,
+                                          const PhaseSpace& ps    )
+  : DecayModel( mSq12, mSq13, mSq23, amp, ps ),
+    _nDir( 0.0 ), _nCnj( 0.0 ), _nXed( 0.0 ), _fixedNorm( false ),
+    _cacheAmps( false ), _ampDirCache( 0 ), _ampCnjCache( 0 ), _cacheBasis( false )
+{
+  _normGrid.setConjugate( true );
+}
+
+
+const bool ConjugateDecayModel::isFixedAmp() const
+{
+  bool fixed = _amp.isFixed();
+
+  typedef std::vector< Function >::const_iterator fIter;
+  for ( fIter func = _funcs.begin(); func != _funcs.end(); ++func )
+    fixed &= func->isFixed();
+
+  return fixed;
+}
+
+
+const bool ConjugateDecayModel::isFixedShape() const
+{
+  if ( ! _amp.linear() )
+    return false;
+
+  // The parameters of the coefficients are those that no resonance uses.
+  const std::vector< std::string >& coefPars = _amp.gradientPars();
+
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  const std::map< std::string, Parameter >& pars = _amp.getPars();
+  for ( pIter par = pars.begin(); par != pars.end(); ++par )
+    if ( ! _parMap.at( par->first ).isFixed() && ! std::binary_search( coefPars.begin(), coefPars.end(), par->first ) )
+      return false;
+
+  return true;
+}
+
+
+void ConjugateDecayModel::combineBasis( const std::vector< std::complex< double > >& cacheC,
+                                        std::complex< double >& dir, std::complex< double >& cnj ) const
+{
+  const std::size_t nBasis = _coefs.size();
+
+  dir = cnj = 0.0;
+  for ( std::size_t k = 0; k < nBasis; ++k )
+  {
+    dir += _coefs[ k ] * cacheC[ _basisCache[ k          ] ];
+    cnj += _coefs[ k ] * cacheC[ _basisCache[ nBasis + k ] ];
+  }
+}
+
+
+void ConjugateDecayModel::combineBasis( const std::vector< const std::complex< double >* >& cacheC, const std::size_t& n,
+                                        std::complex< double >* dir, std::complex< double >* cnj ) const
+{
+  const std::size_t nBasis = _coefs.size();
+
+  std::fill( dir, dir + n, 0.0 );
+  std::fill( cnj, cnj + n, 0.0 );
+
+  // Product of the n x nBasis matrices of the block by the coefficients, column
+  //    after column, with the complex numbers as arrays of their real and
+  //    imaginary parts, such that the loops over the events can be vectorized.
+  double* dirRI = reinterpret_cast< double* >( dir );
+  double* cnjRI = reinterpret_cast< double* >( cnj );
+  for ( std::size_t k = 0; k < nBasis; ++k )
+  {
+    const double* basisDir = reinterpret_cast< const double* >( cacheC[ _basisCache[ k          ] ] );
+    const double* basisCnj = reinterpret_cast< const double* >( cacheC[ _basisCache[ nBasis + k ] ] );
+
+    const double re = std::real( _coefs[ k ] );
+    const double im = std::imag( _coefs[ k ] );
+    for ( std::size_t entry = 0; entry < n; ++entry )
+    {
+      dirRI[ 2 * entry     ] += re * basisDir[ 2 * entry ] - im * basisDir[ 2 * entry + 1 ];
+      dirRI[ 2 * entry + 1 ] += re * basisDir[ 2 * entry + 1 ] + im * basisDir[ 2 * entry ];
+      cnjRI[ 2 * entry     ] += re * basisCnj[ 2 * entry ] - im * basisCnj[ 2 * entry + 1 ];
+      cnjRI[ 2 * entry + 1 ] += re * basisCnj[ 2 * entry + 1 ] + im * basisCnj[ 2 * entry ];
+    }
+  }
+}
+
+
+void ConjugateDecayModel::updateNormComponents() throw( PdfException )
+{
+  // The coefficients of the cached basis functions follow the parameters.
+  if ( _cacheBasis )
+    _amp.coefficients( _coefs );
+
+  if ( _fixedNorm )
+    return;
+
+  // Only the parts of the amplitude and the efficiency that have changed are evaluated again.
+  updateNorm();
+  _nDir = _normGrid.dir();
+  _nCnj = _normGrid.cnj();
+  _nXed = _normGrid.xed();
+}
+
+
+const std::map< unsigned, std::vector< std::complex< double > > > ConjugateDecayModel::cacheAmplitudes( const Dataset& data )
+{
+  std::map< unsigned, std::vector< std::complex< double > > > cached;
+
+  _cacheBasis = ! _cacheAmps && isFixedShape();
+  if ( _cacheBasis )
+    return cacheBasis( data );
+
+  if ( ! _cacheAmps )
+    return cached;
+
+  const std::size_t& size = data.size();
+
+  // Take the columns of a model that shares the amplitudes, if it has been cached on the same data.
+  if ( _pairs )
+  {
+    std::lock_guard< std::mutex > guard( _pairs->lock );
+    if ( ( _pairs->pass == _cachePass ) && ( _pairs->data == &data ) && ( _pairs->size == size ) )
+    {
+      _ampDirCache = _pairs->dirCache;
+      _ampCnjCache = _pairs->cnjCache;
+      return cached;
+    }
+  }
+
+  // Get an index for the cached complex amplitudes.
+  _ampDirCache = nextCacheIdxComplex();
+  _ampCnjCache = nextCacheIdxComplex();
+
+  const double* mSq12 = data.valueColumn( data.column( mSq12name() ) );
+  const double* mSq13 = data.valueColumn( data.column( mSq13name() ) );
+  const double* mSq23 = data.valueColumn( data.column( mSq23name() ) );
+
+  // Cache the direct and conjugated amplitudes for every point in the given dataset.
+  cached[ _ampDirCache ].resize( size );
+  cached[ _ampCnjCache ].resize( size );
+
+  _amp.evaluatePair( _ps, mSq12, mSq13, mSq23, size, cached[ _ampDirCache ].data(), cached[ _ampCnjCache ].data() );
+
+  if ( _pairs )
+  {
+    std::lock_guard< std::mutex > guard( _pairs->lock );
+    _pairs->pass     = _cachePass;
+    _pairs->data     = &data;
+    _pairs->size     = size;
+    _pairs->dirCache = _ampDirCache;
+    _pairs->cnjCache = _ampCnjCache;
+  }
+
+  return cached;
+}
+
+
+const std::map< unsigned, std::vector< std::complex< double > > > ConjugateDecayModel::cacheBasis( const Dataset& data )
+{
+  std::map< unsigned, std::vector< std::complex< double > > > cached;
+
+  const std::size_t& size   = data.size();
+  const std::size_t  nBasis = _amp.nBasis();
+
+  _basisCache.resize( 2 * nBasis );
+  for ( std::size_t k = 0; k < 2 * nBasis; ++k )
+    _basisCache[ k ] = nextCacheIdxComplex();
+
+  const double* mSq12 = data.valueColumn( data.column( mSq12name() ) );
+  const double* mSq13 = data.valueColumn( data.column( mSq13name() ) );
+  const double* mSq23 = data.valueColumn( data.column( mSq23name() ) );
+
+  for ( std::size_t k = 0; k < nBasis; ++k )
+  {
+    std::vector< std::complex< double > >& dir = cached[ _basisCache[ k          ] ];
+    std::vector< std::complex< double > >& cnj = cached[ _basisCache[ nBasis + k ] ];
+    dir.resize( size );
+    cnj.resize( size );
+
+    _amp.evaluateBasisPair( k, _ps, mSq12, mSq13, mSq23, size, dir.data(), cnj.data() );
+  }
+
+  // The coefficients are those of the current parameters until the next update.
+  _amp.coefficients( _coefs );
+
+  return cached;
+}
+
+
+void ConjugateDecayModel::shareAmplitudes( ConjugateDecayModel& other )
+{
+  if ( ! _pairs )
+    _pairs = std::make_shared< SharedPairs >();
+
+  other._pairs = _pairs;
+}
+
+
+void ConjugateDecayModel::setNormComponents( const double& nDir, const double& nCnj, const std::complex< double >& nXed )
+{
+  _fixedNorm = isFixedAmp();
+
+  if ( _fixedNorm )
+  {
+    _nDir = nDir;
+    _nCnj = nCnj;
+    _nXed = nXed;
+  }
+
+  cache();
+}
+
+
+void ConjugateDecayModel::setNormComponents( const double& nDir, const std::complex< double >& nXed )
+{
+  setNormComponents( nDir, nDir, nXed );
+}
@@ -0,0 +1,342 @@
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+
+#include <cfit/dalitzenvelope.hh>
+#include <cfit/random.hh>
+
+
+void DalitzEnvelope::accumulate( const std::vector< double >& heights, std::vector< double >& cumulative ) const
+{
+  cumulative.resize( heights.size() );
+
+  double sum = 0.0;
+  for ( std::size_t cell = 0; cell < heights.size(); ++cell )
+    cumulative[ cell ] = sum += heights[ cell ] * _size12[ cell ] * _size13[ cell ];
+}
+
+
+DalitzEnvelope::DalitzEnvelope( const PhaseSpace& ps, const double& height )
+  : _ps( ps ), _integral( 1.0 )
+{
+  _min12  .assign( 1, _ps.mSq12min() );
+  _min13  .assign( 1, _ps.mSq13min() );
+  _size12 .assign( 1, _ps.mSq12max() - _ps.mSq12min() );
+  _size13 .assign( 1, _ps.mSq13max() - _ps.mSq13min() );
+  _heights.assign( 1, height );
+
+  accumulate( _heights, _cumulative );
+}
+
+
+DalitzEnvelope::DalitzEnvelope( const PhaseSpace&   ps      ,
+                                const density_type& f       ,
+                                const unsigned&     nCells  ,
+                                const std::size_t&  maxCells  )
+  : _ps( ps ), _integral( 0.0 )
+{
+  const unsigned nStart = std::max( nCells, 1u );
+  const double   step12 = ( _ps.mSq12max() - _ps.mSq12min() ) / double( nStart );
+  const double   step13 = ( _ps.mSq13max() - _ps.mSq13min() ) / double( nStart );
+
+  for ( unsigned cell12 = 0; cell12 < nStart; ++cell12 )
+    for ( unsigned cell13 = 0; cell13 < nStart; ++cell13 )
+    {
+      _min12 .push_back( _ps.mSq12min() + step12 * cell12 );
+      _min13 .push_back( _ps.mSq13min() + step13 * cell13 );
+      _size12.push_back( step12 );
+      _size13.push_back( step13 );
+    }
+
+  // Estimate of the integral of the density over each cell, and whether any of
+  //    its points is inside the phase space.
+  std::vector< double > means  ( _min12.size(), 0.0 );
+  std::vector< bool   > inside ( _min12.size(), false );
+  _heights.assign( _min12.size(), 0.0 );
+
+  // Evaluate the density at the 3 x 3 points of the given cells, with all the
+  //    points inside the phase space in a single call, to set their heights
+  //    and their integrals, the latter by Simpson's rule.
+  const double simpson[ 3 ] = { 1.0 / 6.0, 4.0 / 6.0, 1.0 / 6.0 };
+  const auto evaluate = [ & ]( const std::vector< std::size_t >& cells )
+  {
+    std::vector< double >        x12 ( cells.size() * 9 );
+    std::vector< double >        x13 ( cells.size() * 9 );
+    std::vector< double >        x23 ( cells.size() * 9 );
+    std::vector< unsigned char > mask( cells.size() * 9 );
+    for ( std::size_t cell = 0; cell < cells.size(); ++cell )
+      for ( unsigned point = 0; point < 9; ++point )
+      {
+        const std::size_t& c   = cells[ cell ];
+        const std::size_t  pos = cell * 9 + point;
+        x12[ pos ] = _min12[ c ] + _size12[ c ] * ( point / 3 ) / 2.0;
+        x13[ pos ] = _min13[ c ] + _size13[ c ] * ( point % 3 ) / 2.0;
+        x23[ pos ] = _ps.mSqSum() - x12[ pos ] - x13[ pos ];
+      }
+
+    _ps.contains( x12.data(), x13.data(), x23.data(), x12.size(), mask.data() );
+
+    // Keep the points inside at the front of the arrays.
+    std::vector< std::size_t > index;
+    for ( std::size_t pos = 0; pos < mask.size(); ++pos )
+      if ( mask[ pos ] )
+      {
+        x12[ index.size() ] = x12[ pos ];
+        x13[ index.size() ] = x13[ pos ];
+        x23[ index.size() ] = x23[ pos ];
+        index.push_back( pos );
+      }
+    x12.resize( index.size() );
+    x13.resize( index.size() );
+    x23.resize( index.size() );
+
+    std::vector< double > values( x12.size() );
+    f( x12.data(), x13.data(), x23.data(), x12.size(), values.data() );
+
+    std::vector< double > samples( cells.size() * 9, 0.0 );
+    for ( std::size_t point = 0; point < index.size(); ++point )
+    {
+      samples[ index[ point ] ] = values[ point ];
+      inside[ cells[ index[ point ] / 9 ] ] = true;
+    }
+
+    for ( std::size_t cell = 0; cell < cells.size(); ++cell )
+    {
+      const double* sample = samples.data() + cell * 9;
+
+      double max  = sample[ 0 ];
+      double min  = sample[ 0 ];
+      double mean = 0.0;
+      for ( unsigned point = 0; point < 9; ++point )
+      {
+        max   = std::max( max, sample[ point ] );
+        min   = std::min( min, sample[ point ] );
+        mean += simpson[ point / 3 ] * simpson[ point % 3 ] * sample[ point ];
+      }
+
+      // The density can only go much above the largest value where it varies on the cell.
+      _heights[ cells[ cell ] ] = max + ( margin() - 1.0 ) * ( max - min );
+      means   [ cells[ cell ] ] = mean;
+    }
+  };
+
+  std::vector< std::size_t > cells( _min12.size() );
+  std::iota( cells.begin(), cells.end(), 0 );
+  evaluate( cells );
+
+  // The cells crossed by the boundary may not have any of their points inside.
+  //    They take the largest height of their neighbours, which is also given
+  //    to some of the cells that are completely outside.
+  const std::vector< double > start( _heights );
+  for ( unsigned cell12 = 0; cell12 < nStart; ++cell12 )
+    for ( unsigned cell13 = 0; cell13 < nStart; ++cell13 )
+    {
+      if ( inside[ cell12 * nStart + cell13 ] )
+        continue;
+
+      double& height = _heights[ cell12 * nStart + cell13 ];
+      for ( int near12 = int( cell12 ) - 1; near12 <= int( cell12 ) + 1; ++near12 )
+        for ( int near13 = int( cell13 ) - 1; near13 <= int( cell13 ) + 1; ++near13 )
+          if ( ( near12 >= 0 ) && ( near12 < int( nStart ) ) && ( near13 >= 0 ) && ( near13 < int( nStart ) ) )
+            height = std::max( height, start[ near12 * nStart + near13 ] );
+    }
+
+  // Split the cells that waste most of the volume, those that together waste
+  //    half of it at each pass, until most of the volume is under the density.
+  const double   target  = 0.8;
+  const unsigned nPasses = 12;
+  for ( unsigned pass = 0; ( pass < nPasses ) && ( size() + 3 <= maxCells ); ++pass )
+  {
+    double volume = 0.0;
+    _integral     = 0.0;
+    std::vector< std::pair< double, std::size_t > > wastes;
+    for ( std::size_t cell = 0; cell < size(); ++cell )
+    {
+      const double area = _size12[ cell ] * _size13[ cell ];
+      volume    += _heights[ cell ] * area;
+      _integral += means   [ cell ] * area;
+
+      // Cells without any point inside cannot be told apart from their parent.
+      if ( inside[ cell ] )
+        wastes.push_back( std::make_pair( ( _heights[ cell ] - means[ cell ] ) * area, cell ) );
+    }
+
+    if ( _integral >= target * volume )
+      break;
+
+    std::sort( wastes.begin(), wastes.end(), std::greater< std::pair< double, std::size_t > >() );
+
+    double total = 0.0;
+    for ( std::size_t cell = 0; cell < wastes.size(); ++cell )
+      total += wastes[ cell ].first;
+
+    cells.clear();
+    double split = 0.0;
+    for ( std::size_t cell = 0; ( cell < wastes.size() ) && ( split < 0.5 * total ) && ( size() + 3 <= maxCells ); ++cell )
+    {
+      const std::size_t parent = wastes[ cell ].second;
+      split += wastes[ cell ].first;
+
+      _size12[ parent ] /= 2.0;
+      _size13[ parent ] /= 2.0;
+      inside [ parent ] = false;
+      cells.push_back( parent );
+
+      for ( unsigned child = 1; child < 4; ++child )
+      {
+        _min12  .push_back( _min12[ parent ] + _size12[ parent ] * ( child / 2 ) );
+        _min13  .push_back( _min13[ parent ] + _size13[ parent ] * ( child % 2 ) );
+        _size12 .push_back( _size12 [ parent ] );
+        _size13 .push_back( _size13 [ parent ] );
+        _heights.push_back( _heights[ parent ] );
+        means   .push_back( 0.0 );
+        inside  .push_back( false );
+        cells   .push_back( size() - 1 );
+      }
+    }
+
+    // The children without any point inside keep the height of their parent.
+    const std::vector< double > parents( _heights );
+    evaluate( cells );
+    for ( std::size_t cell = 0; cell < cells.size(); ++cell )
+      if ( ! inside[ cells[ cell ] ] )
+        _heights[ cells[ cell ] ] = parents[ cells[ cell ] ];
+  }
+
+  _integral = 0.0;
+  for ( std::size_t cell = 0; cell < size(); ++cell )
+    _integral += means[ cell ] * _size12[ cell ] * _size13[ cell ];
+
+  accumulate( _heights, _cumulative );
+
+  if ( _cumulative.back() <= 0.0 )
+    throw PdfException( "DalitzEnvelope: the density is zero everywhere in the phase space." );
+}
+
+
+std::size_t DalitzEnvelope::memory() const
+{
+  return ( _min12  .capacity() + _min13     .capacity() + _size12.capacity() +
+           _size13 .capacity() + _heights   .capacity() + _cumulative.capacity() ) * sizeof( double );
+}
+
+
+double DalitzEnvelope::efficiency() const
+{
+  const double volume = _cumulative.back();
+
+  return ( ( _integral > 0.0 ) && ( _integral < volume ) ) ? _integral / volume : 1.0;
+}
+
+
+void DalitzEnvelope::generate( const density_type& f    , const std::size_t& n,
+                               double*             mSq12, double*            mSq13, double* mSq23 ) const throw( PdfException )
+{
+  // Maximum number of points per block, and of consecutive blocks without any
+  //    accepted event before giving up.
+  const std::size_t maxBlock = 4096;
+  const unsigned    maxEmpty = 100;
+
+  // Heights raised during this generation, only copied from the envelope the
+  //    first time that one of them is raised.
+  std::vector< double >        raised;
+  std::vector< double >        raisedCumulative;
+  const std::vector< double >* heights    = &_heights;
+  const std::vector< double >* cumulative = &_cumulative;
+
+  std::vector< double >      x12   ( maxBlock );
+  std::vector< double >      x13   ( maxBlock );
+  std::vector< double >      x23   ( maxBlock );
+  std::vector< double >      values( maxBlock );
+  std::vector< std::size_t > cells ( maxBlock );
+
+  std::vector< unsigned char > inside( maxBlock );
+
+  const double& mSqSum = _ps.mSqSum();
+
+  double acceptance = efficiency();
+
+  std::size_t accepted = 0;
+  std::size_t proposed = 0;
+  std::size_t found    = 0;
+  unsigned    empty    = 0;
+  while ( accepted < n )
+  {
+    // Propose about as many points as needed for the events left, and keep
+    //    those inside the phase space.
+    const std::size_t size  = std::min( maxBlock, std::size_t( 1.1 * ( n - accepted ) / acceptance ) + 16 );
+    const double      total = cumulative->back();
+
+    for ( std::size_t point = 0; point < size; ++point )
+    {
+      const double      u    = Random::flat( 0.0, total );
+      const std::size_t cell = std::min( std::size_t( std::upper_bound( cumulative->begin(), cumulative->end(), u ) - cumulative->begin() ),
+                                         cumulative->size() - 1 );
+
+      x12  [ point ] = _min12[ cell ] + _size12[ cell ] * Random::flat();
+      x13  [ point ] = _min13[ cell ] + _size13[ cell ] * Random::flat();
+      x23  [ point ] = mSqSum - x12[ point ] - x13[ point ];
+      cells[ point ] = cell;
+    }
+
+    _ps.contains( x12.data(), x13.data(), x23.data(), size, inside.data() );
+
+    std::size_t nInside = 0;
+    for ( std::size_t point = 0; point < size; ++point )
+      if ( inside[ point ] )
+      {
+        x12  [ nInside ] = x12  [ point ];
+        x13  [ nInside ] = x13  [ point ];
+        x23  [ nInside ] = x23  [ point ];
+        cells[ nInside ] = cells[ point ];
+        ++nInside;
+      }
+
+    f( x12.data(), x13.data(), x23.data(), nInside, values.data() );
+
+    // Raise the cells where the density is above them before taking any decision.
+    bool raise = false;
+    for ( std::size_t point = 0; point < nInside; ++point )
+      if ( values[ point ] > ( *heights )[ cells[ point ] ] )
+      {
+        if ( raised.empty() )
+        {
+          raised  = _heights;
+          heights = &raised;
+        }
+        raised[ cells[ point ] ] = margin() * values[ point ];
+        raise = true;
+      }
+
+    if ( raise )
+    {
+      accumulate( raised, raisedCumulative );
+      cumulative = &raisedCumulative;
+    }
+
+    std::size_t block = 0;
+    for ( std::size_t point = 0; point < nInside; ++point )
+      if ( Random::flat( 0.0, ( *heights )[ cells[ point ] ] ) < values[ point ] )
+      {
+        ++block;
+        if ( accepted < n )
+        {
+          mSq12[ accepted ] = x12[ point ];
+          mSq13[ accepted ] = x13[ point ];
+          mSq23[ accepted ] = x23[ point ];
+          ++accepted;
+        }
+      }
+
+    if ( block )
+      empty = 0;
+    else if ( ++empty == maxEmpty )
+      throw PdfException( "DalitzEnvelope: too many attempts trying to generate an event." );
+
+    proposed += size;
+    found    += block;
+    if ( found )
+      acceptance = double( found ) / proposed;
+  }
+}
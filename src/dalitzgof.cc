@@ -0,0 +1,210 @@
+
+#include <vector>
+#include <string>
+#include <cmath>
+#include <algorithm>
+
+#include <cfit/dalitzgof.hh>
+#include <cfit/compensatedsum.hh>
+
+
+DalitzGof::DalitzGof( const Dataset&  data,
+                      const Variable& var1, const double& min1, const double& max1,
+                      const Variable& var2, const double& min2, const double& max2,
+                      const unsigned& minEvents, const unsigned& nCells ) throw( PdfException )
+  : _var1( var1.name() ), _min1( min1 ), _max1( max1 ),
+    _var2( var2.name() ), _min2( min2 ), _max2( max2 ),
+    _nCells( nCells ), _total( 0.0 ), _chi2( 0.0 ), _nUsed( 0 )
+{
+  if ( ( _nCells == 0 ) || ( _max1 <= _min1 ) || ( _max2 <= _min2 ) )
+    throw PdfException( "DalitzGof: the raster must have at least one cell of positive width in each variable." );
+
+  if ( minEvents == 0 )
+    throw PdfException( "DalitzGof: the bins must have at least one event." );
+
+  // Count the events of each cell.
+  const double* val1 = data.valueColumn( data.column( _var1 ) );
+  const double* val2 = data.valueColumn( data.column( _var2 ) );
+
+  _counts.assign( std::size_t( _nCells ) * _nCells, 0.0 );
+
+  const std::size_t size = data.size();
+  for ( std::size_t entry = 0; entry < size; ++entry )
+  {
+    if ( ( val1[ entry ] < _min1 ) || ( val1[ entry ] >= _max1 ) ||
+         ( val2[ entry ] < _min2 ) || ( val2[ entry ] >= _max2 ) )
+      continue;
+
+    const unsigned cell1 = std::min( unsigned( ( val1[ entry ] - _min1 ) / ( _max1 - _min1 ) * _nCells ), _nCells - 1 );
+    const unsigned cell2 = std::min( unsigned( ( val2[ entry ] - _min2 ) / ( _max2 - _min2 ) * _nCells ), _nCells - 1 );
+
+    _counts[ cell1 * _nCells + cell2 ]++;
+    _total++;
+  }
+
+  _cellBins.assign( _counts.size(), 0 );
+  split( 0, _nCells, 0, _nCells, _total, minEvents );
+
+  const double width1 = ( _max1 - _min1 ) / double( _nCells );
+  const double width2 = ( _max2 - _min2 ) / double( _nCells );
+
+  for ( std::size_t bin = 0; bin < _first1.size(); ++bin )
+  {
+    Bin range;
+    range.min1     = _min1 + width1 * _first1[ bin ];
+    range.max1     = _min1 + width1 * _end1  [ bin ];
+    range.min2     = _min2 + width2 * _first2[ bin ];
+    range.max2     = _min2 + width2 * _end2  [ bin ];
+    range.observed = 0.0;
+    range.expected = 0.0;
+    range.pull     = 0.0;
+
+    _bins.push_back( range );
+  }
+
+  for ( std::size_t cell = 0; cell < _counts.size(); ++cell )
+    _bins[ _cellBins[ cell ] ].observed += _counts[ cell ];
+
+  _nUsed = _bins.size();
+}
+
+
+unsigned DalitzGof::median( const bool& along1,
+                            const unsigned& first1, const unsigned& end1,
+                            const unsigned& first2, const unsigned& end2,
+                            const double& nEvents, const unsigned& minEvents ) const
+{
+  const unsigned first = along1 ? first1 : first2;
+  const unsigned end   = along1 ? end1   : end2;
+
+  // Events in each row of cells along the chosen variable.
+  std::vector< double > rows( end - first, 0.0 );
+  for ( unsigned cell1 = first1; cell1 < end1; ++cell1 )
+    for ( unsigned cell2 = first2; cell2 < end2; ++cell2 )
+      rows[ ( along1 ? cell1 : cell2 ) - first ] += _counts[ cell1 * _nCells + cell2 ];
+
+  unsigned cut  = 0;
+  double   best = nEvents;
+  double   left = 0.0;
+  for ( unsigned edge = first + 1; edge < end; ++edge )
+  {
+    left += rows[ edge - first - 1 ];
+
+    const bool   valid = ( left >= minEvents ) && ( nEvents - left >= minEvents );
+    const double dist  = std::abs( left - 0.5 * nEvents );
+    if ( valid && ( dist < best ) )
+    {
+      cut  = edge;
+      best = dist;
+    }
+  }
+
+  return cut;
+}
+
+
+void DalitzGof::split( const unsigned& first1, const unsigned& end1,
+                       const unsigned& first2, const unsigned& end2,
+                       const double& nEvents, const unsigned& minEvents )
+{
+  if ( nEvents >= 2.0 * minEvents )
+  {
+    // Cut along the longest side first, and along the other one if no cut is possible.
+    const bool along1 = ( end1 - first1 ) * ( _max1 - _min1 ) >= ( end2 - first2 ) * ( _max2 - _min2 );
+
+    bool     cut1 = along1;
+    unsigned cut  = median( cut1, first1, end1, first2, end2, nEvents, minEvents );
+    if ( ! cut )
+    {
+      cut1 = ! along1;
+      cut  = median( cut1, first1, end1, first2, end2, nEvents, minEvents );
+    }
+
+    if ( cut )
+    {
+      double left = 0.0;
+      for ( unsigned cell1 = first1; cell1 < ( cut1 ? cut : end1 ); ++cell1 )
+        for ( unsigned cell2 = first2; cell2 < ( cut1 ? end2 : cut ); ++cell2 )
+          left += _counts[ cell1 * _nCells + cell2 ];
+
+      if ( cut1 )
+      {
+        split( first1, cut , first2, end2, left          , minEvents );
+        split( cut   , end1, first2, end2, nEvents - left, minEvents );
+      }
+      else
+      {
+        split( first1, end1, first2, cut , left          , minEvents );
+        split( first1, end1, cut   , end2, nEvents - left, minEvents );
+      }
+
+      return;
+    }
+  }
+
+  // The cells are a bin of their own.
+  const unsigned bin = _first1.size();
+
+  _first1.push_back( first1 );
+  _end1  .push_back( end1   );
+  _first2.push_back( first2 );
+  _end2  .push_back( end2   );
+
+  for ( unsigned cell1 = first1; cell1 < end1; ++cell1 )
+    for ( unsigned cell2 = first2; cell2 < end2; ++cell2 )
+      _cellBins[ cell1 * _nCells + cell2 ] = bin;
+}
+
+
+double DalitzGof::chi2( const PdfBase& pdf ) throw( PdfException )
+{
+  // Projection of the pdf on all the cells at once.
+  std::vector< double > hist( _counts.size() );
+  pdf.projectHist( _var1, _min1, _max1, _nCells, _var2, _min2, _max2, _nCells, hist.data() );
+
+  typedef std::vector< Bin >::iterator bIter;
+  for ( bIter bin = _bins.begin(); bin != _bins.end(); ++bin )
+    bin->expected = 0.0;
+
+  for ( std::size_t cell = 0; cell < hist.size(); ++cell )
+    _bins[ _cellBins[ cell ] ].expected += hist[ cell ];
+
+  // Bins without events where nothing is expected, e.g. the only bin of an
+  //    empty dataset, carry no information, so they are skipped.
+  CompensatedSum sum;
+  _nUsed = 0;
+  for ( bIter bin = _bins.begin(); bin != _bins.end(); ++bin )
+  {
+    bin->expected *= _total;
+    bin->pull      = 0.0;
+
+    if ( ( bin->expected <= 0.0 ) && ( bin->observed == 0.0 ) )
+      continue;
+
+    if ( bin->expected <= 0.0 )
+      throw PdfException( "DalitzGof: the pdf vanishes in a bin with events." );
+
+    ++_nUsed;
+
+    const double diff = bin->observed - bin->expected;
+
+    bin->pull  = diff / std::sqrt( bin->expected );
+    sum       += diff * diff / bin->expected;
+  }
+
+  _chi2 = sum.value();
+
+  return _chi2;
+}
+
+
+int DalitzGof::bin( const double& val1, const double& val2 ) const
+{
+  if ( ( val1 < _min1 ) || ( val1 >= _max1 ) || ( val2 < _min2 ) || ( val2 >= _max2 ) )
+    return -1;
+
+  const unsigned cell1 = std::min( unsigned( ( val1 - _min1 ) / ( _max1 - _min1 ) * _nCells ), _nCells - 1 );
+  const unsigned cell2 = std::min( unsigned( ( val2 - _min2 ) / ( _max2 - _min2 ) * _nCells ), _nCells - 1 );
+
+  return _cellBins[ cell1 * _nCells + cell2 ];
+}
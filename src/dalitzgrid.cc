@@ -0,0 +1,262 @@
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include <cfit/dalitzgrid.hh>
+#include <cfit/phasespace.hh>
+#include <cfit/dataset.hh>
+#include <cfit/random.hh>
+
+
+const std::size_t DalitzGrid::noMirror = std::size_t( -1 );
+
+
+DalitzGrid::DalitzGrid( const PhaseSpace& ps, const unsigned& nSteps, const bool& weighted )
+  : _nSteps( nSteps ), _withEff( false )
+{
+  const double min    = ps.mSq12min();
+  const double max    = ps.mSq12max();
+  const double step   = ( max - min ) / double( nSteps );
+  const double mSqSum = ps.mSqSum();
+
+  _stepSq = std::pow( step, 2 );
+
+  // Number of subdivisions in each direction of the cells crossed by the boundary.
+  const int nSub = 8;
+
+  _rows.reserve( nSteps + 1 );
+  _rows.push_back( 0 );
+
+  // Point kept for each cell, if any.
+  std::vector< std::size_t > cells( nSteps * nSteps, noMirror );
+
+  // Points of a row, or of the subdivisions of a cell, and whether they are
+  //    inside the phase space, decided for all of them at once.
+  std::vector< double >        x12( std::max( nSteps, unsigned( nSub * nSub ) ) );
+  std::vector< double >        x13( x12.size() );
+  std::vector< double >        x23( x12.size() );
+  std::vector< unsigned char > centres( nSteps );
+  std::vector< unsigned char > corners[ 4 ];
+  std::vector< unsigned char > subs( nSub * nSub );
+
+  // Fill the points of the row at mSq12 shifted by shift12 and each centre
+  //    of mSq13 shifted by shift13, and check them.
+  const auto checkRow = [ & ]( const double& mSq12, const double& shift12, const double& shift13, unsigned char* inside )
+  {
+    for ( unsigned binY = 0; binY < nSteps; ++binY )
+    {
+      x12[ binY ] = mSq12 + shift12;
+      x13[ binY ] = min + step * ( binY + 0.5 ) + shift13;
+      x23[ binY ] = mSqSum - x12[ binY ] - x13[ binY ];
+    }
+    ps.contains( x12.data(), x13.data(), x23.data(), nSteps, inside );
+  };
+
+  for ( unsigned binX = 0; binX < nSteps; ++binX )
+  {
+    const double mSq12 = min + step * ( binX + 0.5 );
+
+    checkRow( mSq12, 0.0, 0.0, centres.data() );
+
+    // The cell is fully inside or outside if its centre and corners agree.
+    if ( weighted )
+      for ( int corner = 0; corner < 4; ++corner )
+      {
+        corners[ corner ].resize( nSteps );
+        checkRow( mSq12, step * ( ( corner & 1 ) ? 0.5 : -0.5 ), step * ( ( corner & 2 ) ? 0.5 : -0.5 ), corners[ corner ].data() );
+      }
+
+    for ( unsigned binY = 0; binY < nSteps; ++binY )
+    {
+      const double mSq13  = min + step * ( binY + 0.5 );
+      const bool   inside = centres[ binY ];
+
+      std::size_t& cell = cells[ binX * nSteps + binY ];
+
+      if ( ! weighted )
+      {
+        if ( inside )
+        {
+          cell = size();
+          push( mSq12, mSq13, mSqSum - mSq12 - mSq13 );
+        }
+        continue;
+      }
+
+      bool boundary = false;
+      for ( int corner = 0; corner < 4; ++corner )
+        boundary |= ( bool( corners[ corner ][ binY ] ) != inside );
+
+      if ( ! boundary )
+      {
+        if ( inside )
+        {
+          cell = size();
+          push( mSq12, mSq13, mSqSum - mSq12 - mSq13 );
+          _weights.push_back( 1.0 );
+        }
+        continue;
+      }
+
+      // Since the region is convex, the centroid of its part in the cell lies inside.
+      for ( int subX = 0; subX < nSub; ++subX )
+        for ( int subY = 0; subY < nSub; ++subY )
+        {
+          const int sub = subX * nSub + subY;
+          x12[ sub ] = mSq12 + step * ( ( subX + 0.5 ) / nSub - 0.5 );
+          x13[ sub ] = mSq13 + step * ( ( subY + 0.5 ) / nSub - 0.5 );
+          x23[ sub ] = mSqSum - x12[ sub ] - x13[ sub ];
+        }
+      ps.contains( x12.data(), x13.data(), x23.data(), nSub * nSub, subs.data() );
+
+      int    nInside = 0;
+      double sumX    = 0.0;
+      double sumY    = 0.0;
+      for ( int sub = 0; sub < nSub * nSub; ++sub )
+        if ( subs[ sub ] )
+        {
+          ++nInside;
+          sumX += x12[ sub ];
+          sumY += x13[ sub ];
+        }
+
+      if ( nInside )
+      {
+        const double x = sumX / nInside;
+        const double y = sumY / nInside;
+        cell = size();
+        push( x, y, mSqSum - x - y );
+        _weights.push_back( double( nInside ) / double( nSub * nSub ) );
+      }
+    }
+
+    _rows.push_back( _mSq12.size() );
+  }
+
+  findMirrors( cells );
+}
+
+
+void DalitzGrid::findMirrors( const std::vector< std::size_t >& cells )
+{
+  // Tolerance to accept the point of the mirrored cell as the mirror image.
+  const double tolerance = 1e-9 * std::sqrt( _stepSq );
+
+  _mirrors.assign( size(), noMirror );
+  for ( unsigned binX = 0; binX < _nSteps; ++binX )
+    for ( unsigned binY = 0; binY < _nSteps; ++binY )
+    {
+      const std::size_t& point = cells[ binX * _nSteps + binY ];
+      const std::size_t& image = cells[ binY * _nSteps + binX ];
+      if ( ( point == noMirror ) || ( image == noMirror ) )
+        continue;
+
+      if ( ( std::fabs( _mSq12[ point ] - _mSq13[ image ] ) < tolerance ) &&
+           ( std::fabs( _mSq13[ point ] - _mSq12[ image ] ) < tolerance ) )
+        _mirrors[ point ] = image;
+    }
+}
+
+
+void DalitzGrid::push( const double& mSq12, const double& mSq13, const double& mSq23 )
+{
+  _mSq12.push_back( mSq12 );
+  _mSq13.push_back( mSq13 );
+  _mSq23.push_back( mSq23 );
+}
+
+
+DalitzGrid::DalitzGrid( const PhaseSpace&  ps        ,
+                        const Dataset&     data      ,
+                        const std::string& mSq12     ,
+                        const std::string& mSq13     ,
+                        const std::size_t& nGenerated  ) throw( DataException )
+  : _nSteps( 0 ), _withEff( true )
+{
+  if ( nGenerated == 0 )
+    throw DataException( "DalitzGrid: the number of generated events must be positive." );
+
+  const double* x = data.valueColumn( data.column( mSq12 ) );
+  const double* y = data.valueColumn( data.column( mSq13 ) );
+
+  for ( std::size_t entry = 0; entry < data.size(); ++entry )
+    push( x[ entry ], y[ entry ], ps.mSqSum() - x[ entry ] - y[ entry ] );
+
+  _stepSq = area( ps ) / double( nGenerated );
+
+  splitRows();
+}
+
+
+DalitzGrid DalitzGrid::sample( const PhaseSpace& ps, const std::size_t& nEvents )
+{
+  DalitzGrid grid;
+
+  const double min12 = ps.mSq12min();
+  const double max12 = ps.mSq12max();
+  const double min13 = ps.mSq13min();
+  const double max13 = ps.mSq13max();
+
+  // Draw as many points as events left, which cannot give too many, and keep
+  //    those inside the phase space.
+  std::vector< double >        x12;
+  std::vector< double >        x13;
+  std::vector< double >        x23;
+  std::vector< unsigned char > inside;
+  while ( grid.size() < nEvents )
+  {
+    const std::size_t size = nEvents - grid.size();
+    x12   .resize( size );
+    x13   .resize( size );
+    x23   .resize( size );
+    inside.resize( size );
+    for ( std::size_t point = 0; point < size; ++point )
+    {
+      x12[ point ] = Random::flat( min12, max12 );
+      x13[ point ] = Random::flat( min13, max13 );
+      x23[ point ] = ps.mSqSum() - x12[ point ] - x13[ point ];
+    }
+
+    ps.contains( x12.data(), x13.data(), x23.data(), size, inside.data() );
+    for ( std::size_t point = 0; point < size; ++point )
+      if ( inside[ point ] )
+        grid.push( x12[ point ], x13[ point ], x23[ point ] );
+  }
+
+  grid._stepSq = nEvents ? area( ps ) / double( nEvents ) : 0.0;
+  grid.splitRows();
+
+  return grid;
+}
+
+
+double DalitzGrid::area( const PhaseSpace& ps )
+{
+  const DalitzGrid grid( ps, 1000, true );
+
+  double sum = 0.0;
+  for ( std::size_t point = 0; point < grid.size(); ++point )
+    sum += grid.weight( point );
+
+  return sum * grid.stepSq();
+}
+
+
+void DalitzGrid::splitRows()
+{
+  // Number of points in each row.
+  const std::size_t rowSize = 1024;
+
+  _rows.assign( 1, 0 );
+  for ( std::size_t end = rowSize; end < size(); end += rowSize )
+    _rows.push_back( end );
+  _rows.push_back( size() );
+}
+
+
+std::size_t DalitzGrid::memory() const
+{
+  return ( _mSq12.capacity() + _mSq13.capacity() + _mSq23.capacity() + _weights.capacity() ) * sizeof( double ) +
+         ( _rows.capacity() + _mirrors.capacity() ) * sizeof( std::size_t );
+}
@@ -0,0 +1,263 @@
+
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+
+#include <cfit/dalitzintegrator.hh>
+#include <cfit/trace.hh>
+#include <cfit/compensatedsum.hh>
+
+
+const DalitzIntegrator& DalitzIntegrator::operator=( const DalitzIntegrator& right )
+{
+  if ( this == &right )
+    return *this;
+
+  _ps   = right._ps;
+  _grid = right._grid;
+  setThreads( right.threads() );
+
+  return *this;
+}
+
+
+void DalitzIntegrator::setThreads( const unsigned& nThreads )
+{
+  const unsigned nThread = nThreads ? nThreads : std::max( 1u, std::thread::hardware_concurrency() );
+
+  delete _pool;
+  _pool = ( nThread > 1 ) ? new ThreadPool( nThread ) : 0;
+}
+
+
+void DalitzIntegrator::integrate( const integrand_type& f, const std::size_t& nComps, double* result ) const
+{
+  integrate( *_grid, f, nComps, result );
+}
+
+
+void DalitzIntegrator::integrate( const DalitzGrid& grid, const integrand_type& f, const std::size_t& nComps, double* result ) const
+{
+  const cached_type cached = [ & ]( const std::size_t& begin, const std::size_t& n, double* out )
+  { f( grid.mSq12() + begin, grid.mSq13() + begin, grid.mSq23() + begin, n, out ); };
+
+  integrateCached( grid, cached, nComps, result );
+}
+
+
+void DalitzIntegrator::integrateCached( const DalitzGrid& grid, const cached_type& f, const std::size_t& nComps, double* result ) const
+{
+  integrateCached( grid, f, nComps, result, 0, grid.nRows() );
+}
+
+
+void DalitzIntegrator::integrateCached( const DalitzGrid& grid, const cached_type& f, const std::size_t& nComps, double* result,
+                                        const std::size_t& firstRow, const std::size_t& endRow ) const
+{
+  TRACE_SCOPE( "DalitzIntegrator::integrate" );
+
+  const std::size_t nRows = endRow - firstRow;
+
+  // Sum of each component in each row.
+  std::vector< double > rows( nRows * nComps, 0.0 );
+
+  const ThreadPool::task_type task = [ & ]( const std::size_t& row, const unsigned& thread )
+  {
+    const std::size_t begin = grid.rowBegin( firstRow + row );
+    const std::size_t n     = grid.rowEnd( firstRow + row ) - begin;
+    if ( n == 0 )
+      return;
+
+    std::vector< double > values( nComps * n );
+    f( begin, n, values.data() );
+
+    if ( grid.weighted() )
+      for ( std::size_t comp = 0; comp < nComps; ++comp )
+        for ( std::size_t point = 0; point < n; ++point )
+          values[ comp * n + point ] *= grid.weights()[ begin + point ];
+
+    for ( std::size_t comp = 0; comp < nComps; ++comp )
+      rows[ row * nComps + comp ] = CompensatedSum::sum( values.data() + comp * n, n );
+  };
+
+  if ( _pool )
+    _pool->run( nRows, task );
+  else
+    for ( std::size_t row = 0; row < nRows; ++row )
+      task( row, 0 );
+
+  for ( std::size_t comp = 0; comp < nComps; ++comp )
+    result[ comp ] = CompensatedSum::sum( rows.data() + comp, nRows, nComps ) * grid.stepSq();
+}
+
+
+void DalitzIntegrator::forEachRow( const DalitzGrid& grid, const row_type& task ) const
+{
+  forEachRow( grid, task, 0, grid.nRows() );
+}
+
+
+void DalitzIntegrator::forEachRow( const DalitzGrid& grid, const row_type& task,
+                                   const std::size_t& firstRow, const std::size_t& endRow ) const
+{
+  const ThreadPool::task_type rowTask = [ & ]( const std::size_t& row, const unsigned& thread )
+  {
+    const std::size_t begin = grid.rowBegin( firstRow + row );
+    const std::size_t n     = grid.rowEnd( firstRow + row ) - begin;
+    if ( n != 0 )
+      task( begin, n );
+  };
+
+  if ( _pool )
+    _pool->run( endRow - firstRow, rowTask );
+  else
+    for ( std::size_t row = 0; row < endRow - firstRow; ++row )
+      rowTask( row, 0 );
+}
+
+
+double DalitzIntegrator::integrate( const integrand_type& f ) const
+{
+  return integrate( *_grid, f );
+}
+
+
+double DalitzIntegrator::integrate( const DalitzGrid& grid, const integrand_type& f ) const
+{
+  double result;
+  integrate( grid, f, 1, &result );
+
+  return result;
+}
+
+
+double DalitzIntegrator::project( const unsigned& index, const double& x, const integrand_type& f ) const
+{
+  double proj;
+  project( index, &x, 1, f, &proj );
+
+  return proj;
+}
+
+
+void DalitzIntegrator::project( const unsigned& index, const double* x, const std::size_t& n,
+                                const integrand_type& f, double* out ) const
+{
+  // Minimum and maximum values of the variable wrt which the integration
+  //    is done, i.e. the next to the projected variable.
+  const double min  = _ps.mSqMin( ( index + 1 ) % 3 );
+  const double max  = _ps.mSqMax( ( index + 1 ) % 3 );
+  const double step = ( max - min ) / double( _grid->steps() );
+
+  const std::size_t nBins = _grid->steps();
+
+  // Squared invariant masses of the points inside the phase space, and
+  //    index of the first point of each value of x.
+  std::vector< double >      coords[ 3 ];
+  std::vector< std::size_t > first( 1, 0 );
+  for ( unsigned var = 0; var < 3; ++var )
+    coords[ var ].resize( n * nBins );
+
+  for ( std::size_t value = 0; value < n; ++value )
+    for ( unsigned bin = 0; bin < nBins; ++bin )
+    {
+      const std::size_t pos = value * nBins + bin;
+      const double      y   = min + step * ( bin + 0.5 );
+
+      coords[ index             ][ pos ] = x[ value ];
+      coords[ ( index + 1 ) % 3 ][ pos ] = y;
+      coords[ ( index + 2 ) % 3 ][ pos ] = _ps.mSqSum() - x[ value ] - y;
+    }
+
+  std::vector< unsigned char > inside( n * nBins );
+  _ps.contains( coords[ 0 ].data(), coords[ 1 ].data(), coords[ 2 ].data(), n * nBins, inside.data() );
+
+  // Keep the points inside at the front of the arrays.
+  std::size_t kept = 0;
+  for ( std::size_t value = 0; value < n; ++value )
+  {
+    for ( std::size_t pos = value * nBins; pos < ( value + 1 ) * nBins; ++pos )
+      if ( inside[ pos ] )
+      {
+        for ( unsigned var = 0; var < 3; ++var )
+          coords[ var ][ kept ] = coords[ var ][ pos ];
+        ++kept;
+      }
+    first.push_back( kept );
+  }
+
+  for ( unsigned var = 0; var < 3; ++var )
+    coords[ var ].resize( kept );
+
+  std::vector< double > values( coords[ 0 ].size() );
+  if ( ! values.empty() )
+    f( coords[ 0 ].data(), coords[ 1 ].data(), coords[ 2 ].data(), values.size(), values.data() );
+
+  for ( std::size_t value = 0; value < n; ++value )
+    out[ value ] = CompensatedSum::sum( values.data() + first[ value ], first[ value + 1 ] - first[ value ] ) * step;
+}
+
+
+void DalitzIntegrator::contributions( const DalitzGrid& grid, const integrand_type& f, double* out ) const
+{
+  const row_type task = [ & ]( const std::size_t& begin, const std::size_t& n )
+  {
+    f( grid.mSq12() + begin, grid.mSq13() + begin, grid.mSq23() + begin, n, out + begin );
+
+    for ( std::size_t point = begin; point < begin + n; ++point )
+      out[ point ] *= grid.weight( point ) * grid.stepSq();
+  };
+
+  forEachRow( grid, task );
+}
+
+
+// Bin of value in nBins equal bins between min and max, or -1 if it is out of range.
+static int binOf( const double& value, const double& min, const double& max, const unsigned& nBins )
+{
+  if ( ! ( value >= min ) || ! ( value < max ) )
+    return -1;
+
+  return std::min( int( ( value - min ) / ( max - min ) * nBins ), int( nBins ) - 1 );
+}
+
+
+void DalitzIntegrator::histogram( const DalitzGrid& grid, const integrand_type& f,
+                                  const unsigned& index, const double& min, const double& max, const unsigned& nBins,
+                                  double* out ) const
+{
+  std::vector< double > values( grid.size() );
+  contributions( grid, f, values.data() );
+
+  const double* coords[ 3 ] = { grid.mSq12(), grid.mSq13(), grid.mSq23() };
+
+  std::fill( out, out + nBins, 0.0 );
+  for ( std::size_t point = 0; point < grid.size(); ++point )
+  {
+    const int bin = binOf( coords[ index ][ point ], min, max, nBins );
+    if ( bin >= 0 )
+      out[ bin ] += values[ point ];
+  }
+}
+
+
+void DalitzIntegrator::histogram( const DalitzGrid& grid, const integrand_type& f,
+                                  const unsigned& index1, const double& min1, const double& max1, const unsigned& nBins1,
+                                  const unsigned& index2, const double& min2, const double& max2, const unsigned& nBins2,
+                                  double* out ) const
+{
+  std::vector< double > values( grid.size() );
+  contributions( grid, f, values.data() );
+
+  const double* coords[ 3 ] = { grid.mSq12(), grid.mSq13(), grid.mSq23() };
+
+  std::fill( out, out + nBins1 * nBins2, 0.0 );
+  for ( std::size_t point = 0; point < grid.size(); ++point )
+  {
+    const int bin1 = binOf( coords[ index1 ][ point ], min1, max1, nBins1 );
+    const int bin2 = binOf( coords[ index2 ][ point ], min2, max2, nBins2 );
+    if ( ( bin1 >= 0 ) && ( bin2 >= 0 ) )
+      out[ bin1 * nBins2 + bin2 ] += values[ point ];
+  }
+}
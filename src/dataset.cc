@@ -3,18 +3,100 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <functional>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <cstdlib>
+#include <thread>
 
 #include <cfit/functors.hh>
 #include <cfit/dataset.hh>
+#include <cfit/filemapping.hh>
+#include <cfit/threadpool.hh>
 
 #ifdef MPI_ON
 #include <mpi.h>
 #endif
 
+
+// Header of the binary dataset files. It is followed by the description of each
+//    column, the length of its name, the name and whether it has errors, and then,
+//    from offset, by the values of each column, each followed by its errors if it
+//    has any. The offset is aligned for the vector instructions.
+struct DatasetHeader
+{
+  char     magic[ 8 ];
+  uint64_t nEntries;
+  uint64_t nColumns;
+  uint64_t offset;
+};
+
+static const std::size_t datasetAlignment = 64;
+
+static const char datasetMagic[ 8 ] = { 'C', 'F', 'I', 'T', 'D', 'A', 'T', '1' };
+
+void Dataset::own()
+{
+  if ( ! _mapping )
+    return;
+
+  _values.assign( _mappedValues.size(), std::vector< double >() );
+  _errors.assign( _mappedValues.size(), std::vector< double >() );
+  for ( std::size_t col = 0; col < _mappedValues.size(); ++col )
+  {
+    _values[ col ].assign( _mappedValues[ col ], _mappedValues[ col ] + _mappedSize );
+    if ( _mappedErrors[ col ] )
+      _errors[ col ].assign( _mappedErrors[ col ], _mappedErrors[ col ] + _mappedSize );
+  }
+
+  _mapping.reset();
+  _mappedSize = 0;
+  _mappedValues.clear();
+  _mappedErrors.clear();
+}
+
+
+// Return the index of the column of the given field, creating it if it does not exist.
+std::size_t Dataset::addColumn( const std::string& field )
+{
+  own();
+
+  std::map< std::string, std::size_t >::const_iterator idx = _index.find( field );
+  if ( idx != _index.end() )
+    return idx->second;
+
+  _index[ field ] = _values.size();
+  _values.push_back( std::vector< double >() );
+  _errors.push_back( std::vector< double >() );
+
+  return _values.size() - 1;
+}
+
+
+// Append a value and its error to a column. The errors column is only
+//    allocated once a non-zero error is found for it.
+void Dataset::pushColumn( const std::size_t& column, const double& value, const double& error )
+{
+  std::vector< double >& errors = _errors[ column ];
+
+  // The errors of the previous values are zero, if there were not any.
+  if ( error != 0. && errors.empty() )
+    errors.resize( _values[ column ].size(), 0. );
+
+  _values[ column ].push_back( value );
+
+  // The first value may have an error, with errors still empty.
+  if ( error != 0. || ! errors.empty() )
+    errors.push_back( error );
+}
+
+
 // Add event from field, value and error.
 void Dataset::push( const std::string& field, const double& value, const double& error )
 {
-  _data[ field ].push_back( std::make_pair( value, error ) );
+  pushColumn( addColumn( field ), value, error );
 }
 
 
@@ -23,7 +105,7 @@ void Dataset::push( const std::map< std::string, double >& event )
 {
   typedef std::map< std::string, double >::const_iterator fIter;
   for ( fIter entry = event.begin(); entry != event.end(); ++entry )
-    _data[ entry->first ].push_back( std::make_pair( entry->second, 0.0 ) );
+    pushColumn( addColumn( entry->first ), entry->second, 0.0 );
 }
 
 
@@ -31,22 +113,121 @@ void Dataset::push( const std::map< std::string, double >& event )
 void Dataset::push( const datum_type& event )
 {
   for ( datum_type::const_iterator entry = event.begin(); entry != event.end(); ++entry )
-    _data[ entry->first ].push_back( entry->second );
+    pushColumn( addColumn( entry->first ), entry->second.first, entry->second.second );
+}
+
+
+// Add n values of a field.
+void Dataset::append( const std::string& field, const double* values, const std::size_t& n )
+{
+  const std::size_t column = addColumn( field );
+
+  _values[ column ].insert( _values[ column ].end(), values, values + n );
+
+  if ( ! _errors[ column ].empty() )
+    _errors[ column ].resize( _values[ column ].size(), 0. );
+}
+
+
+// Add all the entries of another dataset, field by field.
+void Dataset::append( const Dataset& data ) throw( DataException )
+{
+  if ( ! empty() && ( data.fields() != fields() ) )
+    throw DataException( "Dataset: cannot append a dataset with different fields." );
+
+  typedef std::map< std::string, std::size_t >::const_iterator cIter;
+  for ( cIter field = data._index.begin(); field != data._index.end(); ++field )
+  {
+    const double*     values = data.valueColumn( field->second );
+    const double*     errors = data.errorColumn( field->second );
+    const std::size_t n      = data.size();
+
+    const std::size_t column = addColumn( field->first );
+
+    // Only allocate the errors if any of the two datasets has them.
+    if ( errors && _errors[ column ].empty() )
+      _errors[ column ].resize( _values[ column ].size(), 0. );
+
+    _values[ column ].insert( _values[ column ].end(), values, values + n );
+
+    if ( errors )
+      _errors[ column ].insert( _errors[ column ].end(), errors, errors + n );
+    else if ( ! _errors[ column ].empty() )
+      _errors[ column ].resize( _values[ column ].size(), 0. );
+  }
+}
+
+
+// Add the entries selected by a view, field by field.
+void Dataset::append( const DatasetView& view ) throw( DataException )
+{
+  const Dataset&    data = view.data();
+  const std::size_t n    = view.size();
+
+  if ( ! empty() && ( data.fields() != fields() ) )
+    throw DataException( "Dataset: cannot append a dataset with different fields." );
+
+  typedef std::map< std::string, std::size_t >::const_iterator cIter;
+  for ( cIter field = data._index.begin(); field != data._index.end(); ++field )
+  {
+    const std::size_t column = addColumn( field->first );
+
+    const double* values = data.valueColumn( field->second );
+    const double* errors = data.errorColumn( field->second );
+
+    if ( errors && _errors[ column ].empty() )
+      _errors[ column ].resize( _values[ column ].size(), 0. );
+
+    std::vector< double >& dest  = _values[ column ];
+    const std::size_t      start = dest.size();
+    dest.resize( start + n );
+    for ( std::size_t e = 0; e < n; ++e )
+      dest[ start + e ] = values[ view.entry( e ) ];
+
+    if ( errors )
+    {
+      _errors[ column ].resize( start + n );
+      for ( std::size_t e = 0; e < n; ++e )
+        _errors[ column ][ start + e ] = errors[ view.entry( e ) ];
+    }
+    else if ( ! _errors[ column ].empty() )
+      _errors[ column ].resize( dest.size(), 0. );
+  }
+}
+
+
+Dataset::Dataset( const DatasetView& view )
+  : _mappedSize( 0 )
+{
+  append( view );
 }
 
 
 // Getters.
 bool Dataset::empty() const
 {
-  return _data.empty();
+  return _index.empty();
 }
 
 std::size_t Dataset::size() const
 {
-  if ( _data.empty() )
+  if ( _mapping )
+    return _mappedSize;
+
+  if ( _values.empty() )
     return 0;
 
-  return _data.begin()->second.size();
+  return _values.front().size();
+}
+
+
+std::size_t Dataset::column( const std::string& field ) const throw( DataException )
+{
+  std::map< std::string, std::size_t >::const_iterator idx = _index.find( field );
+  if ( idx == _index.end() )
+    throw DataException( "Dataset: requested variable " + field + " does not exist in dataset" );
+
+  return idx->second;
 }
 
 
@@ -54,9 +235,11 @@ const Dataset::datum_type Dataset::entry( const std::size_t& index ) const
 {
   Dataset::datum_type ret;
 
-  for ( std::map< std::string, std::vector< std::pair< double, double > > >::const_iterator b = _data.begin();
-        b != _data.end(); ++b )
-    ret.emplace( b->first, b->second.at( index ) );
+  if ( index >= size() )
+    throw std::out_of_range( "Dataset: entry out of range." );
+
+  for ( std::map< std::string, std::size_t >::const_iterator b = _index.begin(); b != _index.end(); ++b )
+    ret.emplace( b->first, std::make_pair( value( b->second, index ), error( b->second, index ) ) );
 
   return ret;
 }
@@ -65,89 +248,679 @@ const Dataset::datum_type Dataset::entry( const std::size_t& index ) const
 
 double Dataset::value( const std::string& field, int entry ) const throw( DataException )
 {
-  if ( ! _data.count( field ) )
-    throw DataException( "Dataset: requested variable " + field + " does not exist in dataset" );
-
-  return _data.find( field )->second[ entry ].first;
+  return value( column( field ), entry );
 }
 
 
 double Dataset::error( const std::string& field, int entry ) const throw( DataException )
 {
-  if ( ! _data.count( field ) )
-    throw DataException( "Dataset: requested variable " + field + " does not exist in dataset" );
-
-  return _data.find( field )->second[ entry ].second;
+  return error( column( field ), entry );
 }
 
 
 std::vector< double > Dataset::values( const std::string& field ) const throw( DataException )
 {
-  std::vector< double > vals;
+  const double* values = valueColumn( column( field ) );
 
-  if ( ! _data.count( field ) )
-    throw DataException( "Dataset: requested variable " + field + " does not exist in dataset" );
+  return std::vector< double >( values, values + size() );
+}
+
+
+std::vector< double > Dataset::errors( const std::string& field ) const throw( DataException )
+{
+  const double* errors = errorColumn( column( field ) );
+
+  if ( ! errors )
+    return std::vector< double >( size(), 0. );
+
+  return std::vector< double >( errors, errors + size() );
+}
 
-  const std::vector< std::pair< double, double > >& entries = _data.find( field )->second;
 
-  std::transform( entries.begin(), entries.end(), std::back_inserter( vals ), Select1st() );
+std::vector< std::string > Dataset::fields() const
+{
+  std::vector< std::string > fieldVect;
 
-  return vals;
+  std::transform( _index.begin(), _index.end(), std::back_inserter( fieldVect ), Select1st() );
+
+  return fieldVect;
 }
 
 
-std::vector< double > Dataset::errors( const std::string& field ) const throw( DataException )
+
+Dataset::Dataset( const std::string& file, const std::size_t& part, const std::size_t& nParts ) throw( DataException )
+  : _mappedSize( 0 )
 {
-  std::vector< double > errs;
+  if ( part >= nParts )
+    throw DataException( "Dataset: cannot read piece " + std::to_string( part ) + " out of " + std::to_string( nParts ) + "." );
 
-  if ( ! _data.count( field ) )
-    throw DataException( "Dataset: requested variable " + field + " does not exist in dataset" );
+  std::ifstream in( file.c_str(), std::ios::binary );
+  if ( ! in )
+    throw DataException( "Dataset: cannot open data file " + file + "." );
+
+  DatasetHeader header;
+  in.read( reinterpret_cast< char* >( &header ), sizeof( header ) );
+  if ( ! in || std::memcmp( header.magic, datasetMagic, sizeof( datasetMagic ) ) )
+    throw DataException( "Dataset: " + file + " is not a binary data file." );
+
+  std::vector< std::string > names;
+  std::vector< bool >        hasErrs;
+  for ( uint64_t col = 0; col < header.nColumns; ++col )
+  {
+    uint64_t length;
+    in.read( reinterpret_cast< char* >( &length ), sizeof( length ) );
+
+    std::string name( length, '\0' );
+    in.read( &name[ 0 ], length );
+
+    char errs;
+    in.read( &errs, 1 );
 
-  const std::vector< std::pair< double, double > >& entries = _data.find( field )->second;
+    if ( ! in )
+      throw DataException( "Dataset: error reading the columns of data file " + file + "." );
+
+    names  .push_back( name );
+    hasErrs.push_back( errs );
+  }
 
-  std::transform( entries.begin(), entries.end(), std::back_inserter( errs ), Select2nd() );
+  // Range of entries of the piece.
+  const std::size_t nEntries = header.nEntries;
+  const std::size_t first    = ( nEntries / nParts ) * part + std::min( nEntries % nParts, part );
+  const std::size_t n        = nEntries / nParts + ( part < nEntries % nParts );
 
-  return errs;
+  // Read the part of each array of the piece.
+  std::streamoff array = header.offset;
+  for ( std::size_t col = 0; col < names.size(); ++col )
+  {
+    const std::size_t column = addColumn( names[ col ] );
+
+    for ( unsigned errs = 0; errs < ( hasErrs[ col ] ? 2u : 1u ); ++errs )
+    {
+      std::vector< double >& values = errs ? _errors[ column ] : _values[ column ];
+      values.resize( n );
+
+      in.seekg( array + std::streamoff( first * sizeof( double ) ) );
+      in.read( reinterpret_cast< char* >( values.data() ), n * sizeof( double ) );
+      if ( ! in )
+        throw DataException( "Dataset: error reading the values of data file " + file + "." );
+
+      array += nEntries * sizeof( double );
+    }
+  }
 }
 
 
-std::vector< std::string > Dataset::fields() const
+void Dataset::write( const std::string& file ) const throw( DataException )
 {
-  std::vector< std::string > fieldVect;
+  std::ofstream out( file.c_str(), std::ios::binary | std::ios::trunc );
+  if ( ! out )
+    throw DataException( "Dataset: cannot open data file " + file + " for writing." );
+
+  // Names of the columns in index order.
+  std::vector< std::string > names( nColumns() );
+  typedef std::map< std::string, std::size_t >::const_iterator fIter;
+  for ( fIter field = _index.begin(); field != _index.end(); ++field )
+    names[ field->second ] = field->first;
+
+  DatasetHeader header;
+  std::memcpy( header.magic, datasetMagic, sizeof( datasetMagic ) );
+  header.nEntries = size();
+  header.nColumns = names.size();
+  header.offset   = sizeof( header );
+  for ( std::size_t col = 0; col < names.size(); ++col )
+    header.offset += sizeof( uint64_t ) + names[ col ].size() + 1;
+  header.offset = ( header.offset + datasetAlignment - 1 ) / datasetAlignment * datasetAlignment;
+
+  out.write( reinterpret_cast< const char* >( &header ), sizeof( header ) );
+
+  std::size_t written = sizeof( header );
+  for ( std::size_t col = 0; col < names.size(); ++col )
+  {
+    const uint64_t length = names[ col ].size();
+    const char     errs   = hasErrors( col );
+    out.write( reinterpret_cast< const char* >( &length ), sizeof( length ) );
+    out.write( names[ col ].data(), length );
+    out.write( &errs, 1 );
+    written += sizeof( length ) + length + 1;
+  }
 
-  std::transform( _data.begin(), _data.end(), std::back_inserter( fieldVect ), Select1st() );
+  const std::vector< char > padding( header.offset - written, 0 );
+  out.write( padding.data(), padding.size() );
 
-  return fieldVect;
+  for ( std::size_t col = 0; col < names.size(); ++col )
+  {
+    out.write( reinterpret_cast< const char* >( valueColumn( col ) ), size() * sizeof( double ) );
+    if ( hasErrors( col ) )
+      out.write( reinterpret_cast< const char* >( errorColumn( col ) ), size() * sizeof( double ) );
+  }
+
+  if ( ! out )
+    throw DataException( "Dataset: error writing data file " + file + "." );
+}
+
+
+Dataset Dataset::map( const std::string& file ) throw( DataException )
+{
+  std::size_t size;
+
+  Dataset data;
+  data._mapping = FileMapping::map( file, size );
+
+  if ( size < sizeof( DatasetHeader ) )
+    throw DataException( "Dataset: " + file + " is not a binary data file." );
+
+  const void* addr = data._mapping.get();
+
+  const char*          bytes  = static_cast< const char* >( addr );
+  const DatasetHeader& header = *reinterpret_cast< const DatasetHeader* >( bytes );
+  if ( std::memcmp( header.magic, datasetMagic, sizeof( datasetMagic ) ) || ( header.offset > size ) || ( header.offset % sizeof( double ) ) )
+    throw DataException( "Dataset: " + file + " is not a binary data file, or it is corrupted." );
+
+  // Resolve the columns and the arrays of their values and errors.
+  std::size_t pos    = sizeof( DatasetHeader );
+  std::size_t arrays = header.offset;
+  for ( uint64_t col = 0; col < header.nColumns; ++col )
+  {
+    uint64_t length;
+    if ( pos + sizeof( length ) > header.offset )
+      throw DataException( "Dataset: " + file + " is corrupted." );
+    std::memcpy( &length, bytes + pos, sizeof( length ) );
+    pos += sizeof( length );
+
+    if ( pos + length + 1 > header.offset )
+      throw DataException( "Dataset: " + file + " is corrupted." );
+    const std::string name( bytes + pos, length );
+    const bool        errs = bytes[ pos + length ];
+    pos += length + 1;
+
+    if ( arrays + ( errs ? 2 : 1 ) * header.nEntries * sizeof( double ) > size )
+      throw DataException( "Dataset: " + file + " is corrupted." );
+
+    data._index[ name ] = col;
+    data._mappedValues.push_back( reinterpret_cast< const double* >( bytes + arrays ) );
+    arrays += header.nEntries * sizeof( double );
+
+    data._mappedErrors.push_back( errs ? reinterpret_cast< const double* >( bytes + arrays ) : 0 );
+    if ( errs )
+      arrays += header.nEntries * sizeof( double );
+  }
+
+  data._mappedSize = header.nEntries;
+
+  return data;
 }
 
 
+// Powers of ten that are exact in double precision.
+static const double exactPowers[ 23 ] = { 1e0 , 1e1 , 1e2 , 1e3 , 1e4 , 1e5 , 1e6 , 1e7 , 1e8 , 1e9 , 1e10, 1e11,
+                                          1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+static bool isBlank( const char& ch )
+{
+  return ch == ' ' || ch == '\t' || ch == '\r' || ch == ',';
+}
+
 
-const Dataset Dataset::slice( const Region& region ) const
+// Parse the number that starts at pos and move pos past it. Numbers whose digits
+//    fit in the mantissa of a double and whose power of ten is exact are converted
+//    with a single multiplication or division, and the rest, as well as nan or
+//    inf, with strtod, so that they are always rounded correctly.
+static bool parseNumber( const char*& pos, const char* end, double& value )
 {
-  std::map< const std::string, std::pair< double, double > > limits = region.limits();
+  const char* start = pos;
+
+  bool negative = false;
+  if ( pos < end && ( *pos == '-' || *pos == '+' ) )
+    negative = ( *pos++ == '-' );
+
+  uint64_t mantissa = 0;
+  int      digits   = 0;
+  int      exponent = 0;
+  bool     any      = false;
+
+  for ( ; pos < end && *pos >= '0' && *pos <= '9'; ++pos, any = true )
+    if ( digits < 19 )
+    {
+      mantissa = 10 * mantissa + ( *pos - '0' );
+      digits  += ( mantissa != 0 );
+    }
+    else
+      ++exponent;
+
+  if ( pos < end && *pos == '.' )
+    for ( ++pos; pos < end && *pos >= '0' && *pos <= '9'; ++pos, any = true )
+      if ( digits < 19 )
+      {
+        mantissa = 10 * mantissa + ( *pos - '0' );
+        digits  += ( mantissa != 0 );
+        --exponent;
+      }
+
+  if ( any && pos < end && ( *pos == 'e' || *pos == 'E' ) )
+  {
+    const char* mark = pos++;
+
+    bool negExp = false;
+    if ( pos < end && ( *pos == '-' || *pos == '+' ) )
+      negExp = ( *pos++ == '-' );
+
+    int  power = 0;
+    bool some  = false;
+    for ( ; pos < end && *pos >= '0' && *pos <= '9'; ++pos, some = true )
+      power = std::min( 10 * power + ( *pos - '0' ), 100000 );
+
+    if ( some )
+      exponent += negExp ? - power : power;
+    else
+      pos = mark;
+  }
+
+  const bool exact = any && ( mantissa < ( uint64_t( 1 ) << 53 ) ) && ( exponent >= -22 ) && ( exponent <= 22 );
+  if ( exact && ( pos == end || isBlank( *pos ) || *pos == '\n' ) )
+  {
+    value = double( mantissa );
+    value = ( exponent < 0 ) ? value / exactPowers[ - exponent ] : value * exactPowers[ exponent ];
+    if ( negative )
+      value = - value;
+    return true;
+  }
+
+  // Fall back to strtod on a copy of the token, which need not be terminated in the file.
+  pos = start;
+  while ( pos < end && ! isBlank( *pos ) && *pos != '\n' )
+    ++pos;
+
+  const std::string token( start, pos );
+  char* last;
+  value = std::strtod( token.c_str(), &last );
+
+  return ! token.empty() && ( last == token.c_str() + token.size() );
+}
+
+
+Dataset Dataset::readText( const std::string&                file    ,
+                           const std::vector< std::string >& fields  ,
+                           const unsigned&                   nThreads  ) throw( DataException )
+{
+  std::size_t size;
+  const std::shared_ptr< const void > mapping = FileMapping::map( file, size );
+
+  const char* text = static_cast< const char* >( mapping.get() );
+  const char* end  = text + size;
+
+  const unsigned nThread = nThreads ? nThreads : std::max( 1u, std::thread::hardware_concurrency() );
+
+  // Chunks of whole lines, several per thread to balance their loads.
+  const std::size_t nChunks = std::max< std::size_t >( 1, std::min< std::size_t >( 8 * nThread, size / 65536 ) );
+
+  std::vector< const char* > bounds( nChunks + 1, end );
+  bounds[ 0 ] = text;
+  for ( std::size_t chunk = 1; chunk < nChunks; ++chunk )
+  {
+    const char* pos = std::max( text + chunk * ( size / nChunks ), bounds[ chunk - 1 ] );
+    pos = std::find( pos, end, '\n' );
+    bounds[ chunk ] = ( pos == end ) ? end : pos + 1;
+  }
 
+  ThreadPool pool( std::min< std::size_t >( nThread, nChunks ) );
+
+  // Number of lines of each chunk, which bounds its number of entries.
+  std::vector< std::size_t > first( nChunks + 1, 0 );
+  pool.run( nChunks, [ & ]( const std::size_t& chunk, const unsigned& )
+            {
+              const char* begin = bounds[ chunk ];
+              const char* stop  = bounds[ chunk + 1 ];
+              first[ chunk + 1 ] = std::count( begin, stop, '\n' ) + ( stop > begin && stop[ -1 ] != '\n' );
+            } );
+
+  for ( std::size_t chunk = 0; chunk < nChunks; ++chunk )
+    first[ chunk + 1 ] += first[ chunk ];
+
+  Dataset data;
+  std::vector< std::size_t > columns;
+  for ( std::size_t field = 0; field < fields.size(); ++field )
+  {
+    columns.push_back( data.addColumn( fields[ field ] ) );
+    data._values[ columns.back() ].resize( first[ nChunks ] );
+  }
+
+  std::vector< double* > out;
+  for ( std::size_t field = 0; field < fields.size(); ++field )
+    out.push_back( data._values[ columns[ field ] ].data() );
+
+  // Parse each chunk from the first entry it may hold.
+  std::vector< std::size_t > nEntries( nChunks, 0 );
+  pool.run( nChunks, [ & ]( const std::size_t& chunk, const unsigned& )
+            {
+              const char* pos   = bounds[ chunk ];
+              const char* stop  = bounds[ chunk + 1 ];
+              std::size_t entry = first[ chunk ];
+
+              while ( pos < stop )
+              {
+                while ( pos < stop && isBlank( *pos ) )
+                  ++pos;
+
+                if ( pos == stop || *pos == '\n' || *pos == '#' )
+                {
+                  pos = std::find( pos, stop, '\n' );
+                  pos += ( pos < stop );
+                  continue;
+                }
+
+                for ( std::size_t field = 0; field < fields.size(); ++field )
+                {
+                  while ( pos < stop && isBlank( *pos ) )
+                    ++pos;
+
+                  if ( pos == stop || *pos == '\n' || ! parseNumber( pos, stop, out[ field ][ entry ] ) )
+                    throw DataException( "Dataset: a line of " + file + " does not hold a number for each field." );
+                }
+
+                while ( pos < stop && isBlank( *pos ) )
+                  ++pos;
+
+                if ( pos < stop && *pos != '\n' )
+                  throw DataException( "Dataset: a line of " + file + " holds more values than fields." );
+
+                pos += ( pos < stop );
+                ++entry;
+              }
+
+              nEntries[ chunk ] = entry - first[ chunk ];
+            } );
+
+  // Close the gaps left by the skipped lines.
+  std::size_t total = nEntries[ 0 ];
+  for ( std::size_t chunk = 1; chunk < nChunks; ++chunk )
+  {
+    if ( total != first[ chunk ] )
+      for ( std::size_t field = 0; field < fields.size(); ++field )
+        std::copy( out[ field ] + first[ chunk ], out[ field ] + first[ chunk ] + nEntries[ chunk ], out[ field ] + total );
+    total += nEntries[ chunk ];
+  }
+
+  for ( std::size_t field = 0; field < fields.size(); ++field )
+  {
+    data._values[ columns[ field ] ].resize( total );
+    data._values[ columns[ field ] ].shrink_to_fit();
+  }
+
+  return data;
+}
+
+
+const Dataset Dataset::range( const std::size_t& first, const std::size_t& n ) const
+{
   Dataset ret;
+  ret._index = _index;
+  ret._values.resize( nColumns() );
+  ret._errors.resize( nColumns() );
+
+  const std::size_t end = std::min( first + n, size() );
+  if ( first >= end )
+    return ret;
 
-  bool accept; // To decide whether a given entry passes the region cuts.
-  std::size_t nentries = this->size();
-  for ( std::size_t e = 0; e < nentries; ++e )
+  for ( std::size_t col = 0; col < nColumns(); ++col )
   {
-    // Check if this entry passes all the region cuts.
-    const datum_type& entry = this->entry( e );
-    accept = true;
-    for ( std::map< const std::string, std::pair< double, double > >::const_iterator limit = limits.begin();
-          accept && ( limit != limits.end() ); ++limit )
+    ret._values[ col ].assign( valueColumn( col ) + first, valueColumn( col ) + end );
+    if ( hasErrors( col ) )
+      ret._errors[ col ].assign( errorColumn( col ) + first, errorColumn( col ) + end );
+  }
+
+  return ret;
+}
+
+
+// Distance along the Hilbert curve that fills a side x side grid, with side a
+//    power of two, of the cell ( x, y ).
+static std::uint64_t hilbert( const std::uint64_t& side, std::uint64_t x, std::uint64_t y )
+{
+  std::uint64_t dist = 0;
+  for ( std::uint64_t half = side / 2; half > 0; half /= 2 )
+  {
+    const std::uint64_t rx = ( x & half ) ? 1 : 0;
+    const std::uint64_t ry = ( y & half ) ? 1 : 0;
+    dist += half * half * ( ( 3 * rx ) ^ ry );
+
+    // Rotate the quadrant, so that the curve inside it starts and ends next to its neighbours.
+    if ( ry == 0 )
     {
-      accept &= entry.at( limit->first ).first > limit->second.first;
-      accept &= entry.at( limit->first ).first < limit->second.second;
+      if ( rx == 1 )
+      {
+        x = side - 1 - x;
+        y = side - 1 - y;
+      }
+      std::swap( x, y );
     }
+  }
+
+  return dist;
+}
+
+
+const std::vector< std::size_t > Dataset::sort( const std::string& field1, const std::string& field2,
+                                                const unsigned& order ) throw( DataException )
+{
+  if ( ( order == 0 ) || ( order > 31 ) )
+    throw DataException( "Dataset: the order of the Hilbert curve must be between 1 and 31." );
+
+  const double* values1 = valueColumn( column( field1 ) );
+  const double* values2 = valueColumn( column( field2 ) );
+
+  const std::size_t n = size();
+
+  std::vector< std::size_t > sorted( n );
+  for ( std::size_t entry = 0; entry < n; ++entry )
+    sorted[ entry ] = entry;
+
+  if ( n == 0 )
+    return sorted;
+
+  const double min1 = *std::min_element( values1, values1 + n );
+  const double max1 = *std::max_element( values1, values1 + n );
+  const double min2 = *std::min_element( values2, values2 + n );
+  const double max2 = *std::max_element( values2, values2 + n );
+
+  // Cell of each entry in the grid over the range of the fields.
+  const std::uint64_t side   = std::uint64_t( 1 ) << order;
+  const double        scale1 = ( max1 > min1 ) ? side / ( max1 - min1 ) : 0.0;
+  const double        scale2 = ( max2 > min2 ) ? side / ( max2 - min2 ) : 0.0;
+
+  std::vector< std::uint64_t > keys( n );
+  for ( std::size_t entry = 0; entry < n; ++entry )
+  {
+    const std::uint64_t x = std::min( std::uint64_t( ( values1[ entry ] - min1 ) * scale1 ), side - 1 );
+    const std::uint64_t y = std::min( std::uint64_t( ( values2[ entry ] - min2 ) * scale2 ), side - 1 );
+    keys[ entry ] = hilbert( side, x, y );
+  }
+
+  std::stable_sort( sorted.begin(), sorted.end(),
+                    [ &keys ]( const std::size_t& left, const std::size_t& right ) { return keys[ left ] < keys[ right ]; } );
+
+  permute( sorted );
+
+  return sorted;
+}
+
+
+const std::vector< std::size_t > Dataset::sort( const std::string& field ) throw( DataException )
+{
+  const double* values = valueColumn( column( field ) );
+
+  std::vector< std::size_t > sorted( size() );
+  for ( std::size_t entry = 0; entry < sorted.size(); ++entry )
+    sorted[ entry ] = entry;
 
-    // If this entry passes all the region cuts, include it in the result dataset.
-    if ( accept )
-      ret.push( entry );
+  std::stable_sort( sorted.begin(), sorted.end(),
+                    [ values ]( const std::size_t& left, const std::size_t& right ) { return values[ left ] < values[ right ]; } );
+
+  permute( sorted );
+
+  return sorted;
+}
+
+
+void Dataset::permute( const std::vector< std::size_t >& order, const bool& inverse ) throw( DataException )
+{
+  if ( order.size() != size() )
+    throw DataException( "Dataset: the permutation must have as many entries as the dataset." );
+
+  // Each entry must appear exactly once, otherwise events would be lost or read out of range.
+  std::vector< bool > seen( order.size(), false );
+  for ( std::size_t entry = 0; entry < order.size(); ++entry )
+  {
+    if ( ( order[ entry ] >= order.size() ) || seen[ order[ entry ] ] )
+      throw DataException( "Dataset: the order given is not a permutation of the entries of the dataset." );
+    seen[ order[ entry ] ] = true;
   }
 
-  return ret;
+  own();
+
+  std::vector< double > permuted( order.size() );
+  const std::function< void( std::vector< double >& ) > apply = [ & ]( std::vector< double >& values )
+  {
+    for ( std::size_t entry = 0; entry < order.size(); ++entry )
+      if ( inverse )
+        permuted[ order[ entry ] ] = values[ entry ];
+      else
+        permuted[ entry ] = values[ order[ entry ] ];
+
+    values.swap( permuted );
+  };
+
+  for ( std::size_t col = 0; col < nColumns(); ++col )
+  {
+    apply( _values[ col ] );
+    if ( ! _errors[ col ].empty() )
+      apply( _errors[ col ] );
+  }
+}
+
+
+void Dataset::prefetch( const std::size_t& first, const std::size_t& n ) const
+{
+  if ( ! _mapping )
+    return;
+
+  for ( std::size_t col = 0; col < nColumns(); ++col )
+  {
+    FileMapping::prefetch( _mappedValues[ col ] + first, n * sizeof( double ) );
+    if ( _mappedErrors[ col ] )
+      FileMapping::prefetch( _mappedErrors[ col ] + first, n * sizeof( double ) );
+  }
+}
+
+
+void Dataset::release( const std::size_t& first, const std::size_t& n ) const
+{
+  if ( ! _mapping )
+    return;
+
+  for ( std::size_t col = 0; col < nColumns(); ++col )
+  {
+    FileMapping::release( _mappedValues[ col ] + first, n * sizeof( double ) );
+    if ( _mappedErrors[ col ] )
+      FileMapping::release( _mappedErrors[ col ] + first, n * sizeof( double ) );
+  }
+}
+
+
+std::size_t Dataset::memory() const
+{
+  std::size_t bytes = 0;
+  for ( std::size_t col = 0; col < _values.size(); ++col )
+    bytes += ( _values[ col ].capacity() + _errors[ col ].capacity() ) * sizeof( double );
+
+  return bytes;
+}
+
+
+std::size_t Dataset::mapped() const
+{
+  if ( ! _mapping )
+    return 0;
+
+  std::size_t bytes = 0;
+  for ( std::size_t col = 0; col < nColumns(); ++col )
+    bytes += ( _mappedErrors[ col ] ? 2 : 1 ) * _mappedSize * sizeof( double );
+
+  return bytes;
+}
+
+
+// Indices of the entries inside the limits of a region, out of the n given
+//    entries of a dataset, or of its first n entries if entries is null. The cuts
+//    are applied one after the other to blocks of entries, in branchless passes
+//    over a single column that the compiler can vectorise.
+static const std::shared_ptr< const std::vector< std::size_t > > select( const Dataset&     data   ,
+                                                                        const Region&      region ,
+                                                                        const std::size_t* entries,
+                                                                        const std::size_t& n       )
+{
+  // Bind the limits to the columns of the limited fields only once.
+  BoundRegion bound;
+  for ( std::size_t limit = 0; limit < region.size(); ++limit )
+    bound.push( data.column( region.name( limit ) ), region.lower( limit ), region.upper( limit ) );
+
+  const std::shared_ptr< std::vector< std::size_t > > selected = std::make_shared< std::vector< std::size_t > >();
+
+  const std::size_t blockSize = 4096;
+  std::vector< unsigned char > accept( blockSize );
+  std::vector< double >        values( blockSize );
+  for ( std::size_t first = 0; first < n; first += blockSize )
+  {
+    const std::size_t size = std::min( blockSize, n - first );
+
+    std::fill( accept.begin(), accept.begin() + size, 1 );
+    for ( std::size_t cut = 0; cut < bound.size(); ++cut )
+    {
+      const double* column = data.valueColumn( bound.index( cut ) );
+      const double& lower  = bound.lower( cut );
+      const double& upper  = bound.upper( cut );
+
+      // Gather the values of the entries of a view first.
+      const double* val = column + first;
+      if ( entries )
+      {
+        for ( std::size_t e = 0; e < size; ++e )
+          values[ e ] = column[ entries[ first + e ] ];
+        val = values.data();
+      }
+
+      for ( std::size_t e = 0; e < size; ++e )
+        accept[ e ] &= ( val[ e ] > lower ) & ( val[ e ] < upper );
+    }
+
+    for ( std::size_t e = 0; e < size; ++e )
+      if ( accept[ e ] )
+        selected->push_back( entries ? entries[ first + e ] : first + e );
+  }
+
+  return selected;
+}
+
+
+const DatasetView Dataset::slice( const Region& region ) const
+{
+  return DatasetView( *this, select( *this, region, 0, size() ) );
+}
+
+
+DatasetView::DatasetView( const Dataset& data )
+  : _data( &data )
+{
+  const std::shared_ptr< std::vector< std::size_t > > entries = std::make_shared< std::vector< std::size_t > >( data.size() );
+  for ( std::size_t entry = 0; entry < data.size(); ++entry )
+    ( *entries )[ entry ] = entry;
+
+  _entries = entries;
+}
+
+
+const DatasetView DatasetView::slice( const Region& region ) const
+{
+  return DatasetView( *_data, select( *_data, region, _entries->data(), _entries->size() ) );
 }
 
 
@@ -155,95 +928,178 @@ const Dataset Dataset::slice( const Region& region ) const
 #ifdef MPI_ON
 void Dataset::scatter()
 {
-  const MPI::Comm& world = MPI::COMM_WORLD;
-  const int size = world.Get_size();
-  const int rank = world.Get_rank();
-
-  int root = 0;
+  scatter( std::vector< double >() );
+}
 
-  int nFields;
-  int nData;    // Number of data this process is assigned.
-  int nAllData; // Total number of data in all processes.
 
-  char* fieldName;
-  int   fieldLength;
+void Dataset::scatter( const std::string& category, const std::map< double, double >& costs ) throw( DataException )
+{
+  const int root = 0;
 
-  // The root process is the one that has read the data, so it knows about it.
-  if ( rank == root )
+  // Only the root process has the data.
+  std::vector< double > eventCosts;
+  if ( MPI::COMM_WORLD.Get_rank() == root )
     {
-      nFields  = _data.size();
-      nAllData = this->size();
+      const double* categories = valueColumn( column( category ) );
+
+      eventCosts.resize( size(), 1.0 );
+      for ( std::size_t entry = 0; entry < size(); ++entry )
+	{
+	  const std::map< double, double >::const_iterator cost = costs.find( categories[ entry ] );
+	  if ( cost != costs.end() )
+	    eventCosts[ entry ] = cost->second;
+	}
     }
 
-  // Broadcast the number of fields and data to be scattered.
-  world.Bcast( &nFields , 1, MPI::INT, root );
-  world.Bcast( &nAllData, 1, MPI::INT, root );
+  scatter( eventCosts );
+}
 
-  // Compute how many events this process must receive from the root and allocate memory for them.
-  nData = nAllData / size + ( rank < nAllData % size );
 
-  // Arrays that will receive sent data.
-  double* values = new double[ nData ];
-  double* errors = new double[ nData ];
+// The description of the columns and all the data are sent in a single
+//    message each. The header holds the number of columns and events, the
+//    length of the description and the number of events of each process. The
+//    description holds, for each column in index order, a flag telling whether
+//    it has errors followed by its null-terminated name. The events of each
+//    process are packed column after column, with the values of each column
+//    followed by its errors, if it has any, so that they can be copied straight
+//    into the columns of the process.
+void Dataset::scatter( const std::vector< double >& costs )
+{
+  const MPI::Comm& world = MPI::COMM_WORLD;
+  const int size = world.Get_size();
+  const int rank = world.Get_rank();
 
+  const int root = 0;
+
+  // The columns of the root are replaced by its own events.
+  own();
+
+  std::vector< int > header( 3 + size, 0 );
+  std::string description;
+
+  // The root process is the one that has read the data, so it knows about it.
   if ( rank == root )
     {
-      // Vectors of the size and offset of the dataset to be delivered to each process.
-      int count [ size ];
-      int offset[ size ];
+      std::vector< std::string > names( _values.size() );
+      typedef std::map< std::string, std::size_t >::const_iterator fIter;
+      for ( fIter field = _index.begin(); field != _index.end(); ++field )
+	names[ field->second ] = field->first;
 
-      // Compute how many events to send each process, and their offsets.
-      for ( int proc = 0; proc < size; proc++ )
+      for ( std::size_t col = 0; col < names.size(); ++col )
 	{
-	  count [ proc ] =   nAllData / size + ( proc < nAllData % size );
-	  offset[ proc ] = ( nAllData / size ) * rank + std::min( nAllData % size, rank );
+	  description += _errors[ col ].empty() ? '0' : '1';
+	  description += names[ col ];
+	  description += '\0';
 	}
 
-      double* allValues = new double[ nAllData ];
-      double* allErrors = new double[ nAllData ];
+      const int nAllData = this->size();
+
+      header[ 0 ] = _values.size();
+      header[ 1 ] = nAllData;
+      header[ 2 ] = description.size();
 
-      typedef std::map< std::string, std::vector< std::pair< double, double > > >::const_iterator dataIter;
-      for ( dataIter field = _data.begin(); field != _data.end(); field++ )
+      // Contiguous ranges of events with about the same cost for each process,
+      //    or with the same number of events if there are no costs.
+      if ( costs.size() == std::size_t( nAllData ) )
 	{
-	  // Determine the name of the field and its length.
-	  fieldName   = const_cast< char* >( field->first.c_str() );
-	  fieldLength = field->first.size() + 1;
+	  std::vector< double > cumulative( nAllData + 1, 0.0 );
+	  for ( int entry = 0; entry < nAllData; ++entry )
+	    cumulative[ entry + 1 ] = cumulative[ entry ] + costs[ entry ];
+
+	  int first = 0;
+	  for ( int proc = 0; proc < size; proc++ )
+	    {
+	      const double target = cumulative.back() * ( proc + 1 ) / size;
+	      const int    end    = ( proc + 1 == size ) ? nAllData :
+		std::lower_bound( cumulative.begin() + first, cumulative.end() - 1, target ) - cumulative.begin();
+
+	      header[ 3 + proc ] = end - first;
+	      first              = end;
+	    }
+	}
+      else
+	for ( int proc = 0; proc < size; proc++ )
+	  header[ 3 + proc ] = nAllData / size + ( proc < nAllData % size );
+    }
 
-	  // Convert the C++ container objects to C arrays.
-	  std::transform( field->second.begin(), field->second.end(), allValues, Select1st() );
-	  std::transform( field->second.begin(), field->second.end(), allErrors, Select2nd() );
+  world.Bcast( header.data(), header.size(), MPI::INT, root );
 
-	  // Broadcast the name of the field.
-	  world.Bcast( &fieldLength, 1          , MPI::INT , root );
-	  world.Bcast( fieldName   , fieldLength, MPI::CHAR, root );
+  const int nColumns = header[ 0 ];
+  const int nAllData = header[ 1 ];
 
-	  // Scatter the data corresponding to this field.
-	  world.Scatterv( allValues, count, offset, MPI::DOUBLE, values, nData, MPI::DOUBLE, root );
-	  world.Scatterv( allErrors, count, offset, MPI::DOUBLE, errors, nData, MPI::DOUBLE, root );
+  std::vector< char > received( header[ 2 ] );
+  if ( rank == root )
+    std::copy( description.begin(), description.end(), received.begin() );
+  world.Bcast( received.data(), header[ 2 ], MPI::CHAR, root );
 
-	  _data[ field->first ].clear();
-	  for ( int datum = 0; datum < nData; datum++ )
-	    this->push( field->first, values[ datum ], errors[ datum ] );
-	}
+  // Resolve the names of the columns and which of them have errors.
+  std::vector< std::string > names;
+  std::vector< bool >        hasErrs;
+  for ( std::size_t pos = 0; pos < received.size(); pos += names.back().size() + 2 )
+    {
+      hasErrs.push_back( received[ pos ] == '1' );
+      names  .push_back( received.data() + pos + 1 );
     }
-  else
+
+  // Number of doubles per event.
+  int width = nColumns;
+  for ( int col = 0; col < nColumns; ++col )
+    width += hasErrs[ col ];
+
+  // Number of events of each process and offset of the first of them.
+  std::vector< int > count ( header.begin() + 3, header.end() );
+  std::vector< int > offset( size, 0 );
+  for ( int proc = 1; proc < size; proc++ )
+    offset[ proc ] = offset[ proc - 1 ] + count[ proc - 1 ];
+
+  const int nData = count[ rank ];
+
+  // Pack the events of all the processes, one after the other.
+  std::vector< double > packed;
+  std::vector< int >    sendCount ( size );
+  std::vector< int >    sendOffset( size );
+  if ( rank == root )
     {
-      for ( int field = 0; field < nFields; field++ )
+      packed.reserve( std::size_t( nAllData ) * width );
+      for ( int proc = 0; proc < size; proc++ )
 	{
-	  world.Bcast( &fieldLength, 1          , MPI::INT , root );
-	  fieldName = new char[ fieldLength ];
-	  world.Bcast( fieldName   , fieldLength, MPI::CHAR, root );
+	  sendCount [ proc ] = count [ proc ] * width;
+	  sendOffset[ proc ] = offset[ proc ] * width;
+
+	  for ( int col = 0; col < nColumns; ++col )
+	    {
+	      const double* colValues = _values[ col ].data() + offset[ proc ];
+	      packed.insert( packed.end(), colValues, colValues + count[ proc ] );
+	      if ( hasErrs[ col ] )
+		{
+		  const double* colErrors = _errors[ col ].data() + offset[ proc ];
+		  packed.insert( packed.end(), colErrors, colErrors + count[ proc ] );
+		}
+	    }
+	}
+    }
 
-	  world.Scatterv( 0, 0, 0, MPI::DOUBLE, values, nData, MPI::DOUBLE, root );
-	  world.Scatterv( 0, 0, 0, MPI::DOUBLE, errors, nData, MPI::DOUBLE, root );
+  std::vector< double > local( std::size_t( nData ) * width );
+  world.Scatterv( packed.data(), sendCount.data(), sendOffset.data(), MPI::DOUBLE,
+		  local.data(), nData * width, MPI::DOUBLE, root );
 
-	  _data[ fieldName ].clear();
-	  for ( int datum = 0; datum < nData; datum++ )
-	    this->push( fieldName, values[ datum ], errors[ datum ] );
+  // Unpack the events of this process into its columns.
+  _index .clear();
+  _values.clear();
+  _errors.clear();
 
-	  delete[] fieldName;
+  const double* current = local.data();
+  for ( int col = 0; col < nColumns; ++col )
+    {
+      addColumn( names[ col ] );
+
+      _values[ col ].assign( current, current + nData );
+      current += nData;
+      if ( hasErrs[ col ] )
+	{
+	  _errors[ col ].assign( current, current + nData );
+	  current += nData;
 	}
     }
 }
 #endif
-
@@ -0,0 +1,72 @@
+#include <string>
+#include <memory>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <cfit/filemapping.hh>
+
+
+// Whole pages of a range of a mapping, as required by madvise.
+static void advise( const void* addr, const std::size_t& bytes, const int& advice )
+{
+  if ( ! addr || ! bytes )
+    return;
+
+  const uintptr_t page  = sysconf( _SC_PAGESIZE );
+  const uintptr_t begin = reinterpret_cast< uintptr_t >( addr ) / page * page;
+  const uintptr_t end   = reinterpret_cast< uintptr_t >( addr ) + bytes;
+
+  madvise( reinterpret_cast< void* >( begin ), end - begin, advice );
+}
+
+
+std::shared_ptr< const void > FileMapping::map( const std::string& file, std::size_t& size ) throw( DataException )
+{
+  const int fd = open( file.c_str(), O_RDONLY );
+  if ( fd < 0 )
+    throw DataException( "FileMapping: cannot open file " + file + "." );
+
+  struct stat info;
+  if ( ( fstat( fd, &info ) != 0 ) || ( info.st_size == 0 ) )
+  {
+    close( fd );
+    throw DataException( "FileMapping: cannot map empty file " + file + "." );
+  }
+
+  const std::size_t bytes = info.st_size;
+  void* addr = mmap( 0, bytes, PROT_READ, MAP_SHARED, fd, 0 );
+  close( fd );
+
+  if ( addr == MAP_FAILED )
+    throw DataException( "FileMapping: cannot map file " + file + "." );
+
+  size = bytes;
+
+  return std::shared_ptr< const void >( addr, [ bytes ]( const void* p ) { munmap( const_cast< void* >( p ), bytes ); } );
+}
+
+
+void FileMapping::prefetch( const void* addr, const std::size_t& bytes )
+{
+  advise( addr, bytes, MADV_WILLNEED );
+}
+
+
+void FileMapping::release( const void* addr, const std::size_t& bytes )
+{
+  // Only whole pages inside the range can be dropped, since their neighbours
+  //    may hold data that is still being read.
+  if ( ! addr )
+    return;
+
+  const uintptr_t page  = sysconf( _SC_PAGESIZE );
+  const uintptr_t begin = ( reinterpret_cast< uintptr_t >( addr ) + page - 1 ) / page * page;
+  const uintptr_t end   = ( reinterpret_cast< uintptr_t >( addr ) + bytes ) / page * page;
+
+  if ( end > begin )
+    madvise( reinterpret_cast< void* >( begin ), end - begin, MADV_DONTNEED );
+}
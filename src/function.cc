@@ -14,6 +14,7 @@
 
 #include <cfit/function.hh>
 #include <cfit/operation.hh>
+#include <cfit/math.hh>
 
 
 void Function::clear()
@@ -27,12 +28,73 @@ void Function::clear()
   _ctnts.clear();
   _varbs.clear();
   _parms.clear();
+
+  _ranges.clear();
+  _series.clear();
+  _tables.clear();
+
+  _varIdx   .clear();
+  _parValues.clear();
+  _depth = 0;
+}
+
+
+const std::string Function::structure() const
+{
+  std::ostringstream shape;
+  shape.precision( 17 );
+
+  shape << _expression << " opers=";
+  for ( std::size_t oper = 0; oper < _opers.size(); ++oper )
+    shape << ( oper ? "," : "" ) << _opers[ oper ];
+
+  shape << " ctnts=";
+  for ( std::size_t ctnt = 0; ctnt < _ctnts.size(); ++ctnt )
+    shape << ( ctnt ? "," : "" ) << _ctnts[ ctnt ];
+
+  shape << " varbs=";
+  for ( std::size_t var = 0; var < _varbs.size(); ++var )
+  {
+    shape << ( var ? "," : "" ) << _varbs[ var ];
+    if ( ! _varIdx.empty() )
+      shape << ":" << _varIdx[ var ];
+  }
+
+  shape << " parms=";
+  for ( std::size_t par = 0; par < _parms.size(); ++par )
+    shape << ( par ? "," : "" ) << _parms[ par ];
+
+  for ( std::size_t idx = 0; idx < _series.size(); ++idx )
+  {
+    shape << " series=" << _ranges[ idx ].first << "," << _ranges[ idx ].second << ":";
+    for ( std::size_t coef = 0; coef < _series[ idx ].size(); ++coef )
+      shape << ( coef ? "," : "" ) << _series[ idx ][ coef ];
+  }
+
+  for ( std::size_t tbl = 0; tbl < _tables.size(); ++tbl )
+    shape << " " << _tables[ tbl ]->structure();
+
+  return shape.str();
+}
+
+
+// Store the value of each parameter in the order they appear in the expression,
+//    so that the positional evaluate functions do not need to look them up.
+void Function::bindPars()
+{
+  _parValues.clear();
+
+  typedef std::vector< std::string >::const_iterator pIter;
+  for ( pIter par = _parms.begin(); par != _parms.end(); ++par )
+    _parValues.push_back( _parMap.find( *par )->second.value() );
 }
 
 
 // Append a constant.
 void Function::append( const double& ctnt )
 {
+  _depth = 0; // Invalidate the binding.
+
   _ctnts.push_back( ctnt );
 
   _expression += "c"; // c = constant.
@@ -42,6 +104,8 @@ void Function::append( const double& ctnt )
 // Append a variable.
 void Function::append( const Variable& var )
 {
+  _depth = 0; // Invalidate the binding.
+
   _varMap[ var.name() ] = var;
   _varbs.push_back( var.name() );
 
@@ -52,8 +116,11 @@ void Function::append( const Variable& var )
 // Append a parameter.
 void Function::append( const Parameter& par )
 {
+  _depth = 0; // Invalidate the binding.
+
   _parMap[ par.name() ] = par;
   _parms.push_back( par.name() );
+  bindPars();
 
   _expression += "p"; // p = parameter.
 }
@@ -62,6 +129,8 @@ void Function::append( const Parameter& par )
 // Append a parameter expression.
 void Function::append( const ParameterExpr& expr )
 {
+  _depth = 0; // Invalidate the binding.
+
   for ( std::vector< Parameter >::const_iterator par = expr._parms.begin(); par != expr._parms.end(); ++par )
   {
     _parMap[ par->name() ] = *par;
@@ -72,12 +141,16 @@ void Function::append( const ParameterExpr& expr )
   _ctnts.insert( _ctnts.end(), expr._ctnts.begin(), expr._ctnts.end() );
 
   _expression += expr._expression;
+
+  bindPars();
 }
 
 
 // Append a pdf expression.
 void Function::append( const Function& func )
 {
+  _depth = 0; // Invalidate the binding.
+
   _varMap.insert(               func._varMap.begin(), func._varMap.end() );
   _parMap.insert(               func._parMap.begin(), func._parMap.end() );
 
@@ -86,7 +159,13 @@ void Function::append( const Function& func )
   _varbs .insert( _varbs.end(), func._varbs .begin(), func._varbs .end() );
   _parms .insert( _parms.end(), func._parms .begin(), func._parms .end() );
 
+  _ranges.insert( _ranges.end(), func._ranges.begin(), func._ranges.end() );
+  _series.insert( _series.end(), func._series.begin(), func._series.end() );
+  _tables.insert( _tables.end(), func._tables.begin(), func._tables.end() );
+
   _expression += func._expression;
+
+  bindPars();
 }
 
 
@@ -97,6 +176,8 @@ void Function::setPar( const std::string& name, const double& val, const double&
     throw PdfException( "Cannot set unexisting parameter " + name + "." );
 
   _parMap[ name ].set( val, err );
+
+  bindPars();
 }
 
 
@@ -105,6 +186,19 @@ void Function::setPars( const std::map< std::string, Parameter >& pars ) throw(
   typedef std::map< std::string, Parameter >::iterator pIter;
   for ( pIter par = _parMap.begin(); par != _parMap.end(); ++par )
     par->second.setValue( pars.find( par->first )->second.value() );
+
+  bindPars();
+}
+
+
+void Function::setValues( const std::vector< double >& values )
+{
+  std::vector< double >::const_iterator value = values.begin();
+  typedef std::map< std::string, Parameter >::iterator pIter;
+  for ( pIter par = _parMap.begin(); par != _parMap.end(); ++par, ++value )
+    par->second.setValue( *value );
+
+  bindPars();
 }
 
 
@@ -117,6 +211,78 @@ void Function::setPars( const FunctionMinimum& min ) throw( PdfException )
   for ( pIter par = parVec.begin(); par != parVec.end(); ++par )
     if ( _parMap.count( par->name() ) )
       _parMap[ par->name() ].set( par->value(), par->error() );
+
+  bindPars();
+}
+
+
+void Function::bind( const std::vector< std::string >& varNames ) throw( PdfException )
+{
+  _varIdx.clear();
+  _depth = 0;
+
+  typedef std::vector< std::string >::const_iterator vIter;
+  for ( vIter var = _varbs.begin(); var != _varbs.end(); ++var )
+  {
+    vIter pos = std::find( varNames.begin(), varNames.end(), *var );
+    if ( pos == varNames.end() )
+      throw PdfException( "Cannot bind function to a set of variables that does not contain " + *var + "." );
+    _varIdx.push_back( pos - varNames.begin() );
+  }
+
+  // Compute the maximum depth of the stack, checking that the expression is well formed.
+  unsigned depth    = 0;
+  unsigned maxDepth = 0;
+
+  typedef std::string::const_iterator eIter;
+  for ( eIter ch = _expression.begin(); ch != _expression.end(); ++ch )
+    if ( *ch == 'c' || *ch == 'v' || *ch == 'p' )
+      maxDepth = std::max( maxDepth, ++depth );
+    else if ( *ch == 'b' || *ch == 't' )
+    {
+      if ( depth < 2 )
+        throw PdfException( "Parse error: not enough values in the stack." );
+      --depth;
+    }
+    else if ( *ch == 'u' || *ch == 's' )
+    {
+      if ( depth < 1 )
+        throw PdfException( "Parse error: not enough values in the stack." );
+    }
+    else
+      throw PdfException( std::string( "Parse error: unknown operation " ) + *ch + "." );
+
+  if ( depth != 1 )
+    throw PdfException( "Function parse error: too many values have been supplied." );
+
+  _depth = maxDepth;
+}
+
+
+
+// Value of the Chebyshev series with index idx at x.
+double Function::series( const double& x, const std::size_t& idx ) const
+{
+  const std::pair< double, double >& range = _ranges[ idx ];
+  const std::vector< double >&       coefs = _series[ idx ];
+
+  const double t = ( 2.0 * x - range.first - range.second ) / ( range.second - range.first );
+
+  return Math::chebyshev( coefs.data(), coefs.size(), t );
+}
+
+
+// Values of the Chebyshev series with index idx at the n values of x, in place.
+void Function::series( double* x, const std::size_t& n, const std::size_t& idx ) const
+{
+  const std::pair< double, double >& range = _ranges[ idx ];
+  const std::vector< double >&       coefs = _series[ idx ];
+
+  const double invWidth = 1.0 / ( range.second - range.first );
+  for ( std::size_t i = 0; i < n; ++i )
+    x[ i ] = ( 2.0 * x[ i ] - range.first - range.second ) * invWidth;
+
+  Math::chebyshev( coefs.data(), coefs.size(), x, n, x );
 }
 
 
@@ -132,6 +298,8 @@ double Function::evaluate( const std::map< std::string, double >& varMap ) const
   std::vector< double        >::const_iterator ctt = _ctnts.begin();
   std::vector< std::string   >::const_iterator var = _varbs.begin();
   std::vector< std::string   >::const_iterator par = _parms.begin();
+  std::size_t                                 srs = 0;
+  std::size_t                                 tbl = 0;
 
   typedef std::string::const_iterator eIter;
   for ( eIter ch = _expression.begin(); ch != _expression.end(); ++ch )
@@ -161,6 +329,24 @@ double Function::evaluate( const std::map< std::string, double >& varMap ) const
         values.pop();
         values.push( Operation::operate( x, *ops++ ) );
       }
+      else if ( *ch == 's' )
+      {
+        if ( values.empty() )
+          throw PdfException( "Parse error: not enough values in the stack." );
+        x = values.top();
+        values.pop();
+        values.push( series( x, srs++ ) );
+      }
+      else if ( *ch == 't' )
+      {
+        if ( values.size() < 2 )
+          throw PdfException( "Parse error: not enough values in the stack." );
+        y = values.top();
+        values.pop();
+        x = values.top();
+        values.pop();
+        values.push( _tables[ tbl++ ]->evaluate( x, y ) );
+      }
       else
         throw PdfException( std::string( "Parse error: unknown operation " ) + *ch + "." );
     }
@@ -172,6 +358,118 @@ double Function::evaluate( const std::map< std::string, double >& varMap ) const
 }
 
 
+double Function::evaluate( const double* vars ) const throw( PdfException )
+{
+  if ( ! isBound() )
+    throw PdfException( "Cannot evaluate a function by position before binding its variables." );
+
+  // Use a fixed-size stack for usual expressions, allocating only for deep ones.
+  //    It is zeroed so that an empty expression evaluates to 0 instead of garbage.
+  double                local[ 16 ] = {};
+  std::vector< double > heap;
+  double*               values = local;
+  if ( _depth > 16 )
+  {
+    heap.resize( _depth );
+    values = heap.data();
+  }
+
+  unsigned top = 0;
+
+  std::vector< Operation::Op >::const_iterator ops = _opers    .begin();
+  std::vector< double        >::const_iterator ctt = _ctnts    .begin();
+  std::vector< unsigned      >::const_iterator var = _varIdx   .begin();
+  std::vector< double        >::const_iterator par = _parValues.begin();
+  std::size_t                                 srs = 0;
+  std::size_t                                 tbl = 0;
+
+  typedef std::string::const_iterator eIter;
+  for ( eIter ch = _expression.begin(); ch != _expression.end(); ++ch )
+    if ( *ch == 'c' )
+      values[ top++ ] = *ctt++;
+    else if ( *ch == 'v' )
+      values[ top++ ] = vars[ *var++ ];
+    else if ( *ch == 'p' )
+      values[ top++ ] = *par++;
+    else if ( *ch == 'b' )
+    {
+      --top;
+      values[ top - 1 ] = Operation::operate( values[ top - 1 ], values[ top ], *ops++ );
+    }
+    else if ( *ch == 's' )
+      values[ top - 1 ] = series( values[ top - 1 ], srs++ );
+    else if ( *ch == 't' )
+    {
+      --top;
+      values[ top - 1 ] = _tables[ tbl++ ]->evaluate( values[ top - 1 ], values[ top ] );
+    }
+    else
+      values[ top - 1 ] = Operation::operate( values[ top - 1 ], *ops++ );
+
+  return values[ 0 ];
+}
+
+
+void Function::evaluate( const std::vector< const double* >& vars, const std::size_t& n, double* out ) const throw( PdfException )
+{
+  if ( ! isBound() )
+    throw PdfException( "Cannot evaluate a function by position before binding its variables." );
+
+  // Each level of the stack holds n values. The bottom level is the output array.
+  std::vector< double > work( ( _depth - 1 ) * n );
+
+  unsigned top = 0;
+  double*  level;
+
+  std::vector< Operation::Op >::const_iterator ops = _opers    .begin();
+  std::vector< double        >::const_iterator ctt = _ctnts    .begin();
+  std::vector< unsigned      >::const_iterator var = _varIdx   .begin();
+  std::vector< double        >::const_iterator par = _parValues.begin();
+  std::size_t                                 srs = 0;
+  std::size_t                                 tbl = 0;
+
+  typedef std::string::const_iterator eIter;
+  for ( eIter ch = _expression.begin(); ch != _expression.end(); ++ch )
+    if ( *ch == 'c' || *ch == 'v' || *ch == 'p' )
+    {
+      level = top ? work.data() + ( top - 1 ) * n : out;
+      ++top;
+
+      if ( *ch == 'v' )
+      {
+        std::copy( vars[ *var ], vars[ *var ] + n, level );
+        ++var;
+      }
+      else if ( *ch == 'c' )
+        std::fill( level, level + n, *ctt++ );
+      else
+        std::fill( level, level + n, *par++ );
+    }
+    else if ( *ch == 'b' )
+    {
+      --top;
+      level = ( top > 1 ) ? work.data() + ( top - 2 ) * n : out;
+      Operation::operate( level, work.data() + ( top - 1 ) * n, n, *ops++ );
+    }
+    else if ( *ch == 's' )
+    {
+      level = ( top > 1 ) ? work.data() + ( top - 2 ) * n : out;
+      series( level, n, srs++ );
+    }
+    else if ( *ch == 't' )
+    {
+      --top;
+      level = ( top > 1 ) ? work.data() + ( top - 2 ) * n : out;
+      _tables[ tbl++ ]->evaluate( level, work.data() + ( top - 1 ) * n, n, level );
+    }
+    else
+    {
+      level = ( top > 1 ) ? work.data() + ( top - 2 ) * n : out;
+      Operation::operate( level, n, *ops++ );
+    }
+}
+
+
 
 const Function pow( const Function& left, const double& right )
 {
@@ -184,6 +482,47 @@ const Function pow( const Variable& left, const double& right )
 }
 
 
+const Function chebyshev( const Variable& arg, const std::vector< double >& coefs, const double& lower, const double& upper )
+{
+  return chebyshev( Function( arg ), coefs, lower, upper );
+}
+
+const Function chebyshev( const Function& arg, const std::vector< double >& coefs, const double& lower, const double& upper )
+{
+  if ( upper <= lower )
+    throw PdfException( "Cannot define a Chebyshev series with an empty range." );
+
+  Function func( arg );
+
+  func._ranges.push_back( std::make_pair( lower, upper ) );
+  func._series.push_back( coefs );
+
+  func._expression += "s"; // s = Chebyshev series.
+  func._depth = 0; // Invalidate the binding.
+
+  return func;
+}
+
+
+const Function lookup( const Variable& x, const Variable& y, const LookupTable& table )
+{
+  return lookup( Function( x ), Function( y ), table );
+}
+
+const Function lookup( const Function& x, const Function& y, const LookupTable& table )
+{
+  Function func( x );
+  func.append( y );
+
+  func._tables.push_back( std::make_shared< const LookupTable >( table ) );
+
+  func._expression += "t"; // t = table lookup.
+  func._depth = 0; // Invalidate the binding.
+
+  return func;
+}
+
+
 // Operations with variables with themselves.
 const Function operator+( const Variable& left, const Variable& right )
 {
@@ -1,5 +1,6 @@
 
 #include <algorithm>
+#include <sstream>
 
 #include <cfit/fvector.hh>
 #include <cfit/phasespace.hh>
@@ -15,6 +16,40 @@ const bool Fvector::isFixed() const
 }
 
 
+const std::string Fvector::structure() const
+{
+  std::ostringstream shape;
+  shape.precision( 17 );
+
+  shape << "Fvector pair=" << _resoA << _resoB << " noRes=" << _noRes << " m0=";
+  for ( std::size_t pole = 0; pole < _m0.size(); ++pole )
+    shape << ( pole ? "," : "" ) << _m0[ pole ];
+
+  shape << " g0=";
+  for ( int row = 0; row < 5; ++row )
+    for ( int col = 0; col < 5; ++col )
+      shape << ( row || col ? "," : "" ) << _g0( row, col );
+
+  shape << " fSc=";
+  for ( int row = 0; row < 5; ++row )
+    for ( int col = 0; col < 5; ++col )
+      shape << ( row || col ? "," : "" ) << _fSc( row, col );
+
+  shape << " s0sc=" << _s0sc << " s0A=" << _s0A << " sA=" << _sA << " svp=" << _usePvecSvp
+        << " table=" << _tableTolerance << " beta=";
+  for ( std::size_t pole = 0; pole < _beta.size(); ++pole )
+    shape << ( pole ? "," : "" ) << getCoef( _beta[ pole ] );
+
+  shape << " fPr=";
+  for ( std::size_t channel = 0; channel < _fPr.size(); ++channel )
+    shape << ( channel ? "," : "" ) << getCoef( _fPr[ channel ] );
+
+  shape << " s0pr=" << getPar( _s0pr );
+
+  return shape.str();
+}
+
+
 void Fvector::pushBeta( const std::vector< Coef >& beta )
 {
   typedef std::vector< Coef >::const_iterator kIter;
@@ -72,9 +107,86 @@ void Fvector::pushS0pr( const Parameter& par )
 
 void Fvector::setPars( const std::map< std::string, Parameter >& pars )
 {
-  typedef std::map< const std::string, Parameter >::iterator pIter;
+  std::vector< double > values;
+
+  typedef std::map< const std::string, Parameter >::const_iterator pIter;
   for ( pIter par = _parMap.begin(); par != _parMap.end(); ++par )
-    par->second.setValue( pars.find( par->first )->second.value() );
+    values.push_back( pars.find( par->first )->second.value() );
+
+  setValues( values );
+}
+
+
+void Fvector::setValues( const std::vector< double >& values )
+{
+  bool changed = false;
+
+  std::vector< double >::const_iterator value = values.begin();
+  typedef std::map< const std::string, Parameter >::iterator pIter;
+  for ( pIter par = _parMap.begin(); par != _parMap.end(); ++par, ++value )
+  {
+    changed |= ( par->second.value() != *value );
+    par->second.setValue( *value );
+  }
+
+  cacheCoefs();
+
+  if ( changed && ! _table.empty() )
+    buildTable();
+}
+
+
+void Fvector::tabulate( const PhaseSpace& ps, const double& tolerance )
+{
+  _tablePs        = ps;
+  _tableTolerance = tolerance;
+
+  if ( tolerance > 0. )
+    buildTable();
+  else
+    _table.clear();
+}
+
+
+void Fvector::buildTable()
+{
+  const double min = std::pow( _tablePs.m( _resoA ) + _tablePs.m( _resoB ), 2 );
+  const double max = std::pow( _tablePs.mMother()   - _tablePs.m( _noRes ), 2 );
+
+  _table.build( [ this ]( const double& mSqAB ) { return propagator( _tablePs, mSqAB ); },
+                min, max, _tableTolerance );
+}
+
+
+void Fvector::cachePoles()
+{
+  _m0Sq     .assign( 5, 0. );
+  _poleTerms.assign( 5 * 5 * 5, 0. );
+
+  for ( int pole = 0; pole < 5; ++pole )
+  {
+    _m0Sq[ pole ] = std::pow( _m0[ pole ], 2 );
+
+    for ( int row = 0; row < 5; ++row )
+      for ( int col = 0; col < 5; ++col )
+        _poleTerms[ ( pole * 5 + row ) * 5 + col ] = _g0( pole, row ) * _g0( pole, col );
+  }
+}
+
+
+void Fvector::cacheCoefs()
+{
+  _betaTerms.assign( 5 * 5, 0. );
+  _fPrValues.assign( 5, 0. );
+
+  for ( int pole = 0; pole < 5; ++pole )
+    for ( int row = 0; row < 5; ++row )
+      _betaTerms[ pole * 5 + row ] = getCoef( _beta[ pole ] ) * _g0( pole, row );
+
+  for ( int row = 0; row < 5; ++row )
+    _fPrValues[ row ] = getCoef( _fPr[ row ] );
+
+  _s0prValue = getPar( _s0pr );
 }
 
 // Kallen function lambda( x, y, z ) = x^2 + y^2 + z^2 - 2xy - 2xz - 2yz.
@@ -198,60 +310,49 @@ std::complex< double > Fvector::rho( const int& index, const double& mSqAB ) con
 
 std::complex< double > Fvector::propagator( const PhaseSpace& ps, const double& mSqAB ) const
 {
-  Matrix< double > K( 5 );
-
-  // Initialize the K matrix to zero.
-  for ( int row = 0; row < 5; ++row )
-    for ( int col = 0; col < 5; ++col )
-      K( row, col ) = 0.;
-
-  // Resonant contribution.
-  for ( int row = 0; row < 5; ++row )
-    for ( int col = 0; col < 5; ++col )
-      for ( int pole = 0; pole < 5; ++pole )
-        K( row, col ) += _g0( pole, row ) * _g0( pole, col ) / ( std::pow( _m0[ pole ], 2 ) - mSqAB );
-
-  // Non-resonant contribution.
-  K += _fSc * ( 1. - _s0sc ) / ( mSqAB - _s0sc );
-
-  // Adler term.
-  K *= ( 1. - _s0A ) / ( mSqAB - _s0A ) * ( mSqAB - _sA * ps.m( _resoA ) * ps.m( _resoB ) / 2. );
-
-  Matrix< std::complex< double > > M( 5 );
   const std::complex< double > I( 0., 1. );
 
-  // Build M = ( 1 - i K rho ).
-  for ( int row = 0; row < 5; ++row )
-    for ( int col = 0; col < 5; ++col )
-      M( row, col ) = 1. * ( row == col ) - I * K( row, col ) * rho( col, mSqAB );
+  double poles[ 5 ];
+  std::complex< double > rhos[ 5 ];
+  for ( int index = 0; index < 5; ++index )
+  {
+    poles[ index ] = 1. / ( _m0Sq[ index ] - mSqAB );
+    rhos [ index ] = rho( index, mSqAB );
+  }
 
-  // Invert M: ( 1 - i K rho )^{ -1 }
-  Matrix< std::complex< double > > invM;
-  invM = M.inverse();
+  // Non-resonant contribution and Adler term.
+  const double nonRes = ( 1. - _s0sc ) / ( mSqAB - _s0sc );
+  const double adler  = ( 1. - _s0A  ) / ( mSqAB - _s0A  ) * ( mSqAB - _sA * ps.m( _resoA ) * ps.m( _resoB ) / 2. );
 
   // Decide if the slowly varying part should be used.
   double svp = 1.0;
   if ( _usePvecSvp )
-    svp = ( 1. - getPar( _s0pr ) ) / ( mSqAB - getPar( _s0pr ) ); // Slowly varying part.
+    svp = ( 1. - _s0prValue ) / ( mSqAB - _s0prValue ); // Slowly varying part.
 
-  // Build the P vector.
-  std::vector< std::complex< double > > P;
+  // Build M = ( 1 - i K rho ) and the P vector.
+  FixedMatrix< std::complex< double >, 5 >              M;
+  FixedMatrix< std::complex< double >, 5 >::vector_type P;
   for ( int row = 0; row < 5; ++row )
   {
-    std::complex< double > poles = 0.;
-    for ( int pole = 0; pole < 5; ++pole )
-      poles += getCoef( _beta[ pole ] ) * _g0( pole, row ) / ( std::pow( _m0[ pole ], 2 ) - mSqAB );
+    for ( int col = 0; col < 5; ++col )
+    {
+      double K = 0.;
+      for ( int pole = 0; pole < 5; ++pole )
+        K += _poleTerms[ ( pole * 5 + row ) * 5 + col ] * poles[ pole ];
 
-    P.push_back( poles + getCoef( _fPr[ row ] ) * svp );
-  }
+      K = ( K + _fSc( row, col ) * nonRes ) * adler;
 
-  std::complex< double > result = 0.;
+      M( row, col ) = 1. * ( row == col ) - I * K * rhos[ col ];
+    }
 
-  // Compute the first component of the F vector: F_0 = ( 1 - i K rho )_{0j}^{ -1 } P_j.
-  for ( int line = 0; line < 5; ++line )
-    result += invM( 0, line ) * P[ line ];
+    P[ row ] = _fPrValues[ row ] * svp;
+    for ( int pole = 0; pole < 5; ++pole )
+      P[ row ] += _betaTerms[ pole * 5 + row ] * poles[ pole ];
+  }
 
-  return result;
+  // The first component of the F vector, F_0 = ( 1 - i K rho )_{0j}^{ -1 } P_j,
+  //    is the first component of the solution of M F = P.
+  return M.solve( P )[ 0 ];
 }
 
 
@@ -263,5 +364,17 @@ std::complex< double > Fvector::evaluate( const PhaseSpace& ps,
   // Determine the resonant pair.
   const double& mSqAB = m2AB( mSq12, mSq13, mSq23 );
 
-  return propagator( ps, mSqAB );
+  return lookup( ps, mSqAB );
+}
+
+
+void Fvector::evaluatePair( const PhaseSpace&       ps   ,
+                            const double&           mSq12,
+                            const double&           mSq13,
+                            const double&           mSq23,
+                            std::complex< double >& dir  ,
+                            std::complex< double >& cnj   ) const
+{
+  dir = evaluate( ps, mSq12, mSq13, mSq23 );
+  cnj = ( _noRes == 1 ) ? dir : evaluate( ps, mSq13, mSq12, mSq23 );
 }
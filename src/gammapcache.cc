@@ -0,0 +1,32 @@
+
+#include <mutex>
+
+#include <cfit/gammapcache.hh>
+#include <cfit/math.hh>
+
+
+const double GammaPCache::operator()( const double& a, const double& x )
+{
+  const std::pair< double, double > key = std::make_pair( a, x );
+
+  std::lock_guard< std::mutex > guard( _lock );
+
+  // If the integral has already been computed, use it.
+  const std::map< std::pair< double, double >, double >::const_iterator found = _values.find( key );
+  if ( found != _values.end() )
+    return found->second;
+
+  // Only a few intervals are used between parameter changes, so keep the cache small.
+  if ( _values.size() >= 64 )
+    _values.clear();
+
+  return _values[ key ] = Math::gamma_p( a, x );
+}
+
+
+void GammaPCache::clear()
+{
+  std::lock_guard< std::mutex > guard( _lock );
+
+  _values.clear();
+}
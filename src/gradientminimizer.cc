@@ -0,0 +1,16 @@
+
+#include <Minuit/MnMigrad.h>
+
+#include <cfit/gradientminimizer.hh>
+
+
+FunctionMinimum GradientMinimizer::minimize() const
+{
+  return _minimizer->fit( *this, MnUserParameterState( _minimizer->userParameters() ) );
+}
+
+
+FunctionMinimum GradientMinimizer::minimize( const FunctionMinimum& start ) const
+{
+  return _minimizer->fit( *this, start.userState() );
+}
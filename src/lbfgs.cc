@@ -0,0 +1,205 @@
+
+#include <vector>
+#include <limits>
+#include <cmath>
+#include <algorithm>
+
+#include <cfit/lbfgs.hh>
+
+
+static double dot( const std::vector< double >& left, const std::vector< double >& right )
+{
+  double sum = 0.0;
+  for ( std::size_t index = 0; index < left.size(); ++index )
+    sum += left[ index ] * right[ index ];
+
+  return sum;
+}
+
+
+std::vector< double > Lbfgs::direction( const std::vector< double >&                grad ,
+                                        const std::vector< bool >&                  held ,
+                                        const std::vector< std::vector< double > >& steps,
+                                        const std::vector< std::vector< double > >& diffs,
+                                        const double&                               gamma  ) const
+{
+  const std::size_t n     = grad.size();
+  const std::size_t nKept = steps.size();
+
+  std::vector< double > dir( n );
+  for ( std::size_t index = 0; index < n; ++index )
+    dir[ index ] = held[ index ] ? 0.0 : grad[ index ];
+
+  // Two-loop recursion, from the newest step to the oldest and back.
+  std::vector< double > alpha( nKept );
+  for ( std::size_t kept = nKept; kept-- > 0; )
+  {
+    alpha[ kept ] = dot( steps[ kept ], dir ) / dot( steps[ kept ], diffs[ kept ] );
+    for ( std::size_t index = 0; index < n; ++index )
+      dir[ index ] -= alpha[ kept ] * diffs[ kept ][ index ];
+  }
+
+  for ( std::size_t index = 0; index < n; ++index )
+    dir[ index ] *= gamma;
+
+  for ( std::size_t kept = 0; kept < nKept; ++kept )
+  {
+    const double beta = dot( diffs[ kept ], dir ) / dot( steps[ kept ], diffs[ kept ] );
+    for ( std::size_t index = 0; index < n; ++index )
+      dir[ index ] += ( alpha[ kept ] - beta ) * steps[ kept ][ index ];
+  }
+
+  for ( std::size_t index = 0; index < n; ++index )
+    dir[ index ] = held[ index ] ? 0.0 : - dir[ index ];
+
+  return dir;
+}
+
+
+Lbfgs::Result Lbfgs::minimize( const function_type&         function,
+                               const gradient_type&         gradient,
+                               const std::vector< double >& values  ,
+                               const std::vector< double >& lower   ,
+                               const std::vector< double >& upper   ,
+                               const std::vector< double >& scale   ,
+                               const double&                edm     ,
+                               const unsigned&              maxCalls  ) const
+{
+  const std::size_t n = values.size();
+
+  // Variables and limits in units of the scales.
+  std::vector< double > point( n );
+  std::vector< double > low  ( n );
+  std::vector< double > upp  ( n );
+  for ( std::size_t index = 0; index < n; ++index )
+  {
+    low  [ index ] = lower[ index ] / scale[ index ];
+    upp  [ index ] = upper[ index ] / scale[ index ];
+    point[ index ] = std::min( std::max( values[ index ] / scale[ index ], low[ index ] ), upp[ index ] );
+  }
+
+  const auto unscaled = [ & ]( const std::vector< double >& scaled )
+  {
+    std::vector< double > result( n );
+    for ( std::size_t index = 0; index < n; ++index )
+      result[ index ] = scaled[ index ] * scale[ index ];
+    return result;
+  };
+
+  const auto scaledGradient = [ & ]( const std::vector< double >& scaled )
+  {
+    std::vector< double > result = gradient( unscaled( scaled ) );
+    for ( std::size_t index = 0; index < n; ++index )
+      result[ index ] *= scale[ index ];
+    return result;
+  };
+
+  Result result;
+  result.nCalls    = 2;
+  result.converged = false;
+  result.edm       = std::numeric_limits< double >::infinity();
+
+  double                fval = function( unscaled( point ) );
+  std::vector< double > grad = scaledGradient( point );
+
+  // Last steps and differences of the gradient, from the oldest to the newest.
+  std::vector< std::vector< double > > steps;
+  std::vector< std::vector< double > > diffs;
+  double                               gamma = 1.0;
+
+  std::vector< bool >   held( n );
+  std::vector< double > next( n );
+  while ( result.nCalls < maxCalls )
+  {
+    for ( std::size_t index = 0; index < n; ++index )
+      held[ index ] = ( point[ index ] <= low[ index ] && grad[ index ] > 0.0 ) ||
+                      ( point[ index ] >= upp[ index ] && grad[ index ] < 0.0 );
+
+    const std::vector< double > dir = direction( grad, held, steps, diffs, gamma );
+
+    const double slope = dot( grad, dir );
+    if ( ! ( slope < 0.0 ) )
+    {
+      // Without steps the direction is minus the gradient, so every variable is held.
+      if ( steps.empty() )
+      {
+        result.edm       = 0.0;
+        result.converged = true;
+        break;
+      }
+
+      steps.clear();
+      diffs.clear();
+      gamma = 1.0;
+      continue;
+    }
+
+    result.edm = - 0.5 * slope;
+    if ( result.edm < edm )
+    {
+      result.converged = true;
+      break;
+    }
+
+    // Halve the step until the function decreases enough along the projected path.
+    double nextFval = fval;
+    bool   accepted = false;
+    double length   = 1.0;
+    for ( unsigned trial = 0; trial < 40 && result.nCalls < maxCalls; ++trial, length *= 0.5 )
+    {
+      double decrease = 0.0;
+      for ( std::size_t index = 0; index < n; ++index )
+      {
+        next[ index ] = std::min( std::max( point[ index ] + length * dir[ index ], low[ index ] ), upp[ index ] );
+        decrease     += grad[ index ] * ( next[ index ] - point[ index ] );
+      }
+
+      nextFval = function( unscaled( next ) );
+      ++result.nCalls;
+
+      if ( std::isfinite( nextFval ) && nextFval <= fval + 1.e-4 * decrease )
+      {
+        accepted = true;
+        break;
+      }
+    }
+
+    if ( ! accepted )
+      break;
+
+    const std::vector< double > nextGrad = scaledGradient( next );
+    ++result.nCalls;
+
+    std::vector< double > step( n );
+    std::vector< double > diff( n );
+    for ( std::size_t index = 0; index < n; ++index )
+    {
+      step[ index ] = next    [ index ] - point[ index ];
+      diff[ index ] = nextGrad[ index ] - grad [ index ];
+    }
+
+    // Only keep steps along which the function is convex.
+    const double curvature = dot( step, diff );
+    const double diffSq    = dot( diff, diff );
+    if ( curvature > 1.e-10 * diffSq )
+    {
+      steps.push_back( step );
+      diffs.push_back( diff );
+      if ( steps.size() > _history )
+      {
+        steps.erase( steps.begin() );
+        diffs.erase( diffs.begin() );
+      }
+      gamma = curvature / diffSq;
+    }
+
+    point = next;
+    fval  = nextFval;
+    grad  = nextGrad;
+  }
+
+  result.values = unscaled( point );
+  result.fval   = fval;
+
+  return result;
+}
@@ -0,0 +1,159 @@
+
+#include <vector>
+#include <sstream>
+#include <cmath>
+#include <algorithm>
+
+#include <cfit/lookuptable.hh>
+
+
+LookupTable::LookupTable( const unsigned&              nBinsX,
+                          const double&                lowerX,
+                          const double&                upperX,
+                          const unsigned&              nBinsY,
+                          const double&                lowerY,
+                          const double&                upperY,
+                          const std::vector< double >& values,
+                          const Interpolation&         interp  ) throw( PdfException )
+  : _nBinsX( nBinsX ), _nBinsY( nBinsY ), _lowerX( lowerX ), _lowerY( lowerY ), _values( values ), _interp( interp )
+{
+  if ( ! nBinsX || ! nBinsY )
+    throw PdfException( "LookupTable: the table must have at least one bin in each direction." );
+
+  if ( upperX <= lowerX || upperY <= lowerY )
+    throw PdfException( "LookupTable: cannot define a table with an empty range." );
+
+  if ( values.size() != std::size_t( nBinsX ) * nBinsY )
+    throw PdfException( "LookupTable: the number of values does not match the number of bins." );
+
+  _invStepX = nBinsX / ( upperX - lowerX );
+  _invStepY = nBinsY / ( upperY - lowerY );
+}
+
+
+const std::string LookupTable::structure() const
+{
+  std::ostringstream shape;
+  shape.precision( 17 );
+
+  shape << "table x=" << _nBinsX << "," << _lowerX << "," << _invStepX
+        << " y=" << _nBinsY << "," << _lowerY << "," << _invStepY << " interp=" << _interp << " values=";
+  for ( std::size_t bin = 0; bin < _values.size(); ++bin )
+    shape << ( bin ? "," : "" ) << _values[ bin ];
+
+  return shape.str();
+}
+
+
+void LookupTable::locate( const double& pos, const unsigned& nBins, int& bin, double& frac )
+{
+  const double last    = nBins - 1.0;
+  const double limited = std::min( std::max( pos, 0.0 ), last );
+
+  bin  = std::min( int( limited ), std::max( int( nBins ) - 2, 0 ) );
+  frac = limited - bin;
+}
+
+
+double LookupTable::bilinearAt( const double& x, const double& y ) const
+{
+  int    binX;
+  int    binY;
+  double fracX;
+  double fracY;
+  locate( ( x - _lowerX ) * _invStepX - 0.5, _nBinsX, binX, fracX );
+  locate( ( y - _lowerY ) * _invStepY - 0.5, _nBinsY, binY, fracY );
+
+  // With a single bin in a direction, its fraction is always zero.
+  const int nextX = std::min( binX + 1, int( _nBinsX ) - 1 );
+  const int nextY = std::min( binY + 1, int( _nBinsY ) - 1 );
+
+  const double* row  = _values.data() + std::size_t( binX  ) * _nBinsY;
+  const double* next = _values.data() + std::size_t( nextX ) * _nBinsY;
+
+  const double low  = row [ binY ] + fracY * ( row [ nextY ] - row [ binY ] );
+  const double high = next[ binY ] + fracY * ( next[ nextY ] - next[ binY ] );
+
+  return low + fracX * ( high - low );
+}
+
+
+double LookupTable::bicubicAt( const double& x, const double& y ) const
+{
+  int    binX;
+  int    binY;
+  double fracX;
+  double fracY;
+  locate( ( x - _lowerX ) * _invStepX - 0.5, _nBinsX, binX, fracX );
+  locate( ( y - _lowerY ) * _invStepY - 0.5, _nBinsY, binY, fracY );
+
+  // Catmull-Rom weights of the centres bin - 1, ..., bin + 2.
+  const auto weights = []( const double& t, double* w )
+  {
+    const double t2 = t * t;
+    const double t3 = t2 * t;
+    w[ 0 ] = 0.5 * ( - t + 2.0 * t2 - t3 );
+    w[ 1 ] = 0.5 * ( 2.0 - 5.0 * t2 + 3.0 * t3 );
+    w[ 2 ] = 0.5 * ( t + 4.0 * t2 - 3.0 * t3 );
+    w[ 3 ] = 0.5 * ( - t2 + t3 );
+  };
+
+  double wx[ 4 ];
+  double wy[ 4 ];
+  weights( fracX, wx );
+  weights( fracY, wy );
+
+  // Values at the 4 x 4 closest centres. Those beyond the edges, needed for the
+  //    first and last bins, are extrapolated linearly from the two last ones.
+  double grid[ 4 ][ 4 ];
+  for ( int k = 0; k < 4; ++k )
+  {
+    const int     rowX = std::min( std::max( binX - 1 + k, 0 ), int( _nBinsX ) - 1 );
+    const double* row  = _values.data() + std::size_t( rowX ) * _nBinsY;
+    for ( int l = 0; l < 4; ++l )
+      grid[ k ][ l ] = row[ std::min( std::max( binY - 1 + l, 0 ), int( _nBinsY ) - 1 ) ];
+  }
+
+  if ( _nBinsX > 1 )
+    for ( int l = 0; l < 4; ++l )
+    {
+      if ( binX == 0 )
+        grid[ 0 ][ l ] = 2.0 * grid[ 1 ][ l ] - grid[ 2 ][ l ];
+      if ( binX + 2 == int( _nBinsX ) )
+        grid[ 3 ][ l ] = 2.0 * grid[ 2 ][ l ] - grid[ 1 ][ l ];
+    }
+
+  if ( _nBinsY > 1 )
+    for ( int k = 0; k < 4; ++k )
+    {
+      if ( binY == 0 )
+        grid[ k ][ 0 ] = 2.0 * grid[ k ][ 1 ] - grid[ k ][ 2 ];
+      if ( binY + 2 == int( _nBinsY ) )
+        grid[ k ][ 3 ] = 2.0 * grid[ k ][ 2 ] - grid[ k ][ 1 ];
+    }
+
+  double value = 0.0;
+  for ( int k = 0; k < 4; ++k )
+    value += wx[ k ] * ( wy[ 0 ] * grid[ k ][ 0 ] + wy[ 1 ] * grid[ k ][ 1 ] +
+                         wy[ 2 ] * grid[ k ][ 2 ] + wy[ 3 ] * grid[ k ][ 3 ] );
+
+  return std::max( value, 0.0 );
+}
+
+
+double LookupTable::evaluate( const double& x, const double& y ) const
+{
+  return ( _interp == bicubic ) ? bicubicAt( x, y ) : bilinearAt( x, y );
+}
+
+
+void LookupTable::evaluate( const double* x, const double* y, const std::size_t& n, double* out ) const
+{
+  // The interpolation is chosen once for all the points.
+  if ( _interp == bicubic )
+    for ( std::size_t entry = 0; entry < n; ++entry )
+      out[ entry ] = bicubicAt( x[ entry ], y[ entry ] );
+  else
+    for ( std::size_t entry = 0; entry < n; ++entry )
+      out[ entry ] = bilinearAt( x[ entry ], y[ entry ] );
+}
@@ -0,0 +1,120 @@
+#ifdef MPI_ON
+
+#include <vector>
+
+#include <mpi.h>
+
+#include <Minuit/MnMigrad.h>
+
+#include <cfit/masterworker.hh>
+#include <cfit/trace.hh>
+
+
+// Rank of the process that runs Minuit.
+static const int master = 0;
+
+
+bool MasterWorker::isMaster()
+{
+  return MPI::COMM_WORLD.Get_rank() == master;
+}
+
+
+void MasterWorker::request( const Request& type, const std::vector< double >& pars ) const
+{
+  MPI::Comm& world = MPI::COMM_WORLD;
+  TRACE_SCOPE( "MPI::Bcast" );
+
+  int code = type;
+  world.Bcast( &code, 1, MPI::INT, master );
+
+  if ( type != shutdownRequest )
+    world.Bcast( const_cast< double* >( pars.data() ), pars.size(), MPI::DOUBLE, master );
+}
+
+
+double MasterWorker::operator()( const std::vector< double >& pars ) const throw( PdfException )
+{
+  request( valueRequest, pars );
+
+  return (*_minimizer)( pars );
+}
+
+
+std::vector< double > MasterWorker::gradient( const std::vector< double >& pars ) const throw( PdfException )
+{
+  request( gradientRequest, pars );
+
+  return _minimizer->gradient( pars );
+}
+
+
+FunctionMinimum MasterWorker::minimize() const
+{
+  return minimize( MnUserParameterState( _minimizer->userParameters() ) );
+}
+
+
+FunctionMinimum MasterWorker::minimize( const FunctionMinimum& start ) const
+{
+  return minimize( start.userState() );
+}
+
+
+FunctionMinimum MasterWorker::minimize( const MnUserParameterState& start ) const
+{
+  try
+  {
+    // Without the gradient, Migrad must see a function that does not provide it.
+    if ( _gradient )
+      return _minimizer->fit( *this, start );
+
+    return _minimizer->fit< FCNBase >( *this, start );
+  }
+  catch ( ... )
+  {
+    shutdown();
+    throw;
+  }
+}
+
+
+void MasterWorker::serve() const throw( PdfException )
+{
+  MPI::Comm& world = MPI::COMM_WORLD;
+
+  std::vector< double > pars( _minimizer->pdf().nPars() );
+
+  for ( ;; )
+  {
+    int code;
+    {
+      TRACE_SCOPE( "MPI::Bcast" );
+      world.Bcast( &code, 1, MPI::INT, master );
+
+      if ( code == shutdownRequest )
+        return;
+
+      world.Bcast( pars.data(), pars.size(), MPI::DOUBLE, master );
+    }
+
+    // The minimizer adds up the pieces of all the processes, which the master
+    //    is computing at the same time.
+    if ( code == gradientRequest )
+      _minimizer->gradient( pars );
+    else
+      (*_minimizer)( pars );
+  }
+}
+
+
+void MasterWorker::shutdown() const
+{
+  if ( _shutdown )
+    return;
+
+  request( shutdownRequest, std::vector< double >() );
+  _shutdown = true;
+}
+
+#endif
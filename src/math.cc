@@ -1,6 +1,8 @@
 
+#include <algorithm>
 #include <cmath>
 #include <limits>
+#include <vector>
 #include <cfit/math.hh>
 
 
@@ -53,7 +55,7 @@ arithmetic   domain     # trials      peak         rms
 Cephes Math Library Release 2.8:  June, 2000
 Copyright 1985, 1987, 2000 by Stephen L. Moshier
 *************************************************************************/
-const double Math::gamma_p( const double& a, const double& x )
+const double Math::gamma_p( const double& a, const double& x, const double& lnga )
 {
   double igammaepsilon;
   double ans;
@@ -66,9 +68,9 @@ const double Math::gamma_p( const double& a, const double& x )
     return 0.0;
 
   if( ( x > 1 ) && ( x > a ) )
-    return 1.0 - gamma_q( a, x );
+    return 1.0 - gamma_q( a, x, lnga );
 
-  ax = a * std::log( x ) - x - lngamma( a );
+  ax = a * std::log( x ) - x - lnga;
   if( ax < -709.78271289338399 )
     return 0.0;
 
@@ -88,6 +90,15 @@ const double Math::gamma_p( const double& a, const double& x )
 }
 
 
+const double Math::gamma_p( const double& a, const double& x )
+{
+  if( ( x <= 0 ) || ( a <= 0 ) )
+    return 0.0;
+
+  return gamma_p( a, x, lngamma( a ) );
+}
+
+
 
 
 /*************************************************************************
@@ -123,7 +134,7 @@ arithmetic   domain   domain     # trials      peak         rms
 Cephes Math Library Release 2.8:  June, 2000
 Copyright 1985, 1987, 2000 by Stephen L. Moshier
 *************************************************************************/
-const double Math::gamma_q( const double& a, const double& x )
+const double Math::gamma_q( const double& a, const double& x, const double& lnga )
 {
   double igammaepsilon;
   double igammabignumber;
@@ -151,9 +162,9 @@ const double Math::gamma_q( const double& a, const double& x )
     return 1.0;
 
   if( ( x < 1.0 ) || ( x < a ) )
-    return 1.0 - gamma_p( a, x );
+    return 1.0 - gamma_p( a, x, lnga );
 
-  ax = a * std::log( x ) - x - lngamma( a );
+  ax = a * std::log( x ) - x - lnga;
   if( ax < -709.78271289338399 )
     return 0.0;
 
@@ -232,6 +243,17 @@ const double Math::gammastirf( const double& x )
 }
 
 
+const double Math::gamma_q( const double& a, const double& x )
+{
+  if( ( x <= 0.0 ) || ( a <= 0 ) )
+    return 1.0;
+
+  return gamma_q( a, x, lngamma( a ) );
+}
+
+
+
+
 /*************************************************************************
 Gamma function
 
@@ -469,6 +491,88 @@ const double Math::lngamma( double x )
 }
 
 
+// Rational approximations shared by the scalar and the array versions.
+//    2 x P4( x^2 ) / ( sqrt( pi ) Q5( x^2 ) ), the erf of |x| < 0.5.
+static inline double erfSmall( const double& x )
+{
+  const double xsq = x*x;
+  double p;
+  double q;
+
+  p = 0.007547728033418631287834;
+  p = -0.288805137207594084924010+xsq*p;
+  p = 14.3383842191748205576712+xsq*p;
+  p = 38.0140318123903008244444+xsq*p;
+  p = 3017.82788536507577809226+xsq*p;
+  p = 7404.07142710151470082064+xsq*p;
+  p = 80437.3630960840172832162+xsq*p;
+  q = 0.0;
+  q = 1.00000000000000000000000+xsq*q;
+  q = 38.0190713951939403753468+xsq*q;
+  q = 658.070155459240506326937+xsq*q;
+  q = 6379.60017324428279487120+xsq*q;
+  q = 34216.5257924628539769006+xsq*q;
+  q = 80437.3630960840172826266+xsq*q;
+  return 1.1283791670955125738961589031 * x * p / q;
+}
+
+
+//    exp( - x^2 ) P( x ) / Q( x ), the erfc of 0.5 <= x < 10.
+static inline double erfcLarge( const double& x )
+{
+  double p;
+  double q;
+
+  p = 0.0;
+  p = 0.5641877825507397413087057563+x*p;
+  p = 9.675807882987265400604202961+x*p;
+  p = 77.08161730368428609781633646+x*p;
+  p = 368.5196154710010637133875746+x*p;
+  p = 1143.262070703886173606073338+x*p;
+  p = 2320.439590251635247384768711+x*p;
+  p = 2898.0293292167655611275846+x*p;
+  p = 1826.3348842295112592168999+x*p;
+  q = 1.0;
+  q = 17.14980943627607849376131193+x*q;
+  q = 137.1255960500622202878443578+x*q;
+  q = 661.7361207107653469211984771+x*q;
+  q = 2094.384367789539593790281779+x*q;
+  q = 4429.612803883682726711528526+x*q;
+  q = 6089.5424232724435504633068+x*q;
+  q = 4958.82756472114071495438422+x*q;
+  q = 1826.3348842295112595576438+x*q;
+  return std::exp( -std::pow( x, 2 ) )*p/q;
+}
+
+
+//    sqrt( 2 pi ) ( w + w^3 R( w^2 ) / S( w^2 ) ), the invnormal of y = w + 0.5,
+//    for exp( -2 ) < y <= 1 - exp( -2 ).
+static inline double invnormalCentral( const double& y )
+{
+  const double y2 = y*y;
+  double p0;
+  double q0;
+
+  p0 = -59.9633501014107895267;
+  p0 = 98.0010754185999661536+y2*p0;
+  p0 = -56.6762857469070293439+y2*p0;
+  p0 = 13.9312609387279679503+y2*p0;
+  p0 = -1.23916583867381258016+y2*p0;
+  q0 = 1;
+  q0 = 1.95448858338141759834+y2*q0;
+  q0 = 4.67627912898881538453+y2*q0;
+  q0 = 86.3602421390890590575+y2*q0;
+  q0 = -225.462687854119370527+y2*q0;
+  q0 = 200.260212380060660359+y2*q0;
+  q0 = -82.0372256168333339912+y2*q0;
+  q0 = 15.9056225126211695515+y2*q0;
+  q0 = -1.18331621121330003142+y2*q0;
+  return ( y+y*y2*p0/q0 )*2.50662827463100050242;
+}
+
+
+
+
 /*************************************************************************
 Error function
 
@@ -498,31 +602,13 @@ Copyright 1984, 1987, 1988, 1992, 2000 by Stephen L. Moshier
 const double Math::erf( const double& x )
 {
   double absx;
-  double xsq;
   double s;
-  double p;
-  double q;
 
   absx = std::fabs( x );
   s = ( x != 0 ) ? x / absx : 0.0; // Sign of x.
   if( absx < 0.5 )
   {
-    xsq = x*x;
-    p = 0.007547728033418631287834;
-    p = 0.288805137207594084924010+xsq*p;
-    p = 14.3383842191748205576712+xsq*p;
-    p = 38.0140318123903008244444+xsq*p;
-    p = 3017.82788536507577809226+xsq*p;
-    p = 7404.07142710151470082064+xsq*p;
-    p = 80437.3630960840172832162+xsq*p;
-    q = 0.0;
-    q = 1.00000000000000000000000+xsq*q;
-    q = 38.0190713951939403753468+xsq*q;
-    q = 658.070155459240506326937+xsq*q;
-    q = 6379.60017324428279487120+xsq*q;
-    q = 34216.5257924628539769006+xsq*q;
-    q = 80437.3630960840172826266+xsq*q;
-    return s*1.1283791670955125738961589031 * absx * p / q;
+    return erfSmall( x );
   }
   if( absx >= 10.0 )
   {
@@ -561,9 +647,6 @@ Copyright 1984, 1987, 1988, 1992, 2000 by Stephen L. Moshier
 *************************************************************************/
 const double Math::erfc( const double& x )
 {
-  double p;
-  double q;
-
   if( x < 0 )
   {
     return 2.0 - erfc( -x );
@@ -576,25 +659,7 @@ const double Math::erfc( const double& x )
   {
     return 0.0;
   }
-  p = 0.0;
-  p = 0.5641877825507397413087057563+x*p;
-  p = 9.675807882987265400604202961+x*p;
-  p = 77.08161730368428609781633646+x*p;
-  p = 368.5196154710010637133875746+x*p;
-  p = 1143.262070703886173606073338+x*p;
-  p = 2320.439590251635247384768711+x*p;
-  p = 2898.0293292167655611275846+x*p;
-  p = 1826.3348842295112592168999+x*p;
-  q = 1.0;
-  q = 17.14980943627607849376131193+x*q;
-  q = 137.1255960500622202878443578+x*q;
-  q = 661.7361207107653469211984771+x*q;
-  q = 2094.384367789539593790281779+x*q;
-  q = 4429.612803883682726711528526+x*q;
-  q = 6089.5424232724435504633068+x*q;
-  q = 4958.82756472114071495438422+x*q;
-  q = 1826.3348842295112595576438+x*q;
-  return std::exp( -std::pow( x, 2 ) )*p/q;
+  return erfcLarge( x );
 }
 
 
@@ -642,23 +707,18 @@ Copyright 1984, 1987, 1988, 1992, 2000 by Stephen L. Moshier
 const double Math::invnormal( const double& y0 )
 {
   double expm2;
-  double s2pi;
   double x;
   double y;
   double z;
-  double y2;
   double x0;
   double x1;
   bool code;
-  double p0;
-  double q0;
   double p1;
   double q1;
   double p2;
   double q2;
 
   expm2 = 0.13533528323661269189;
-  s2pi = 2.50662827463100050242;
 
   if ( y0 <= 0.0 )
     return -std::numeric_limits< double >::infinity();
@@ -677,26 +737,7 @@ const double Math::invnormal( const double& y0 )
 
   if( y > expm2 )
   {
-    y = y-0.5;
-    y2 = y*y;
-    p0 = -59.9633501014107895267;
-    p0 = 98.0010754185999661536+y2*p0;
-    p0 = -56.6762857469070293439+y2*p0;
-    p0 = 13.9312609387279679503+y2*p0;
-    p0 = -1.23916583867381258016+y2*p0;
-    q0 = 1;
-    q0 = 1.95448858338141759834+y2*q0;
-    q0 = 4.67627912898881538453+y2*q0;
-    q0 = 86.3602421390890590575+y2*q0;
-    q0 = -225.462687854119370527+y2*q0;
-    q0 = 200.260212380060660359+y2*q0;
-    q0 = -82.0372256168333339912+y2*q0;
-    q0 = 15.9056225126211695515+y2*q0;
-    q0 = -1.18331621121330003142+y2*q0;
-    x = y+y*y2*p0/q0;
-    x = x*s2pi;
-
-    return x;
+    return invnormalCentral( y-0.5 );
   }
 
   x = std::sqrt( -2.0 * std::log( y ) );
@@ -941,3 +982,269 @@ const double Math::invgamma_q( const double& a, const double& y0 )
   return x;
 }
 
+
+
+
+
+/*************************************************************************
+Array versions of the functions above, with the same accuracy.
+
+erf and erfc evaluate the rational approximations of both ranges of
+|x| for every value, with the argument of the large range clamped to
+[ 0.5, 10 ], and select the result without branches. The argument of
+inverf is in the central range of invnormal for most of the values, so
+that range is evaluated for all of them, and the tails are evaluated
+afterwards one at a time.
+*************************************************************************/
+void Math::erf( const double* x, const std::size_t& n, double* out )
+{
+  for ( std::size_t i = 0; i < n; ++i )
+  {
+    const double absx  = std::fabs( x[ i ] );
+    const double s     = ( x[ i ] > 0.0 ) - ( x[ i ] < 0.0 );
+    const double small = erfSmall( x[ i ] );
+    const double large = s * ( 1.0 - erfcLarge( std::min( std::max( absx, 0.5 ), 10.0 ) ) );
+
+    out[ i ] = ( absx < 0.5 ) ? small : ( absx >= 10.0 ) ? s : large;
+  }
+}
+
+
+void Math::erfc( const double* x, const std::size_t& n, double* out )
+{
+  for ( std::size_t i = 0; i < n; ++i )
+  {
+    const double absx  = std::fabs( x[ i ] );
+    const double small = 1.0 - erfSmall( absx );
+    const double large = erfcLarge( std::min( std::max( absx, 0.5 ), 10.0 ) );
+    const double value = ( absx < 0.5 ) ? small : ( absx >= 10.0 ) ? 0.0 : large;
+
+    out[ i ] = ( x[ i ] < 0.0 ) ? 2.0 - value : value;
+  }
+}
+
+
+void Math::inverf( const double* x, const std::size_t& n, double* out )
+{
+  const double expm2 = 0.13533528323661269189;
+  const double sqrt2 = std::sqrt( 2.0 );
+
+  for ( std::size_t i = 0; i < n; ++i )
+    out[ i ] = invnormalCentral( 0.5 * ( x[ i ] + 1.0 ) - 0.5 ) / sqrt2;
+
+  for ( std::size_t i = 0; i < n; ++i )
+  {
+    const double y = 0.5 * ( x[ i ] + 1.0 );
+    if ( ( y <= expm2 ) || ( y > 1.0 - expm2 ) )
+      out[ i ] = invnormal( y ) / sqrt2;
+  }
+}
+
+
+void Math::gamma_p( const double& a, const double* x, const std::size_t& n, double* out )
+{
+  if ( a <= 0 )
+  {
+    std::fill( out, out + n, 0.0 );
+    return;
+  }
+
+  const double lnga = lngamma( a );
+  for ( std::size_t i = 0; i < n; ++i )
+    out[ i ] = ( x[ i ] <= 0 ) ? 0.0 : gamma_p( a, x[ i ], lnga );
+}
+
+
+void Math::gamma_q( const double& a, const double* x, const std::size_t& n, double* out )
+{
+  if ( a <= 0 )
+  {
+    std::fill( out, out + n, 1.0 );
+    return;
+  }
+
+  const double lnga = lngamma( a );
+  for ( std::size_t i = 0; i < n; ++i )
+    out[ i ] = ( x[ i ] <= 0.0 ) ? 1.0 : gamma_q( a, x[ i ], lnga );
+}
+
+
+
+
+/*************************************************************************
+Chebyshev series
+
+The series Sum( c_k T_k( t ) ) is evaluated with Clenshaw's recurrence
+
+  b_k = c_k + 2 t b_{k+1} - b_{k+2},  b_N+1 = b_N+2 = 0,
+
+  f( t ) = c_0 + t b_1 - b_2,
+
+which is stable for |t| <= 1 at any order. Since T_k( t ) are
+orthogonal, an antiderivative of the series is again a series, with
+
+  A_1 = c_0 - c_2 / 2,  A_k = ( c_{k-1} - c_{k+1} ) / ( 2 k ),
+
+and A_0 chosen so that it vanishes at t = 0.
+*************************************************************************/
+const double Math::chebyshev( const double* coefs, const std::size_t& nCoefs, const double& t )
+{
+  if ( nCoefs == 0 )
+    return 0.0;
+
+  double b1 = 0.0;
+  double b2 = 0.0;
+  for ( std::size_t k = nCoefs - 1; k > 0; --k )
+  {
+    const double b0 = coefs[ k ] + 2.0 * t * b1 - b2;
+    b2 = b1;
+    b1 = b0;
+  }
+
+  return coefs[ 0 ] + t * b1 - b2;
+}
+
+
+void Math::chebyshev( const double* coefs, const std::size_t& nCoefs,
+                      const double* t, const std::size_t& n, double* out )
+{
+  if ( nCoefs == 0 )
+  {
+    std::fill( out, out + n, 0.0 );
+    return;
+  }
+
+  std::vector< double > b1( n, 0.0 );
+  std::vector< double > b2( n, 0.0 );
+  for ( std::size_t k = nCoefs - 1; k > 0; --k )
+    for ( std::size_t i = 0; i < n; ++i )
+    {
+      const double b0 = coefs[ k ] + 2.0 * t[ i ] * b1[ i ] - b2[ i ];
+      b2[ i ] = b1[ i ];
+      b1[ i ] = b0;
+    }
+
+  for ( std::size_t i = 0; i < n; ++i )
+    out[ i ] = coefs[ 0 ] + t[ i ] * b1[ i ] - b2[ i ];
+}
+
+
+void Math::chebyshevIntegral( const double* coefs, const std::size_t& nCoefs, double* integ )
+{
+  for ( std::size_t k = 1; k <= nCoefs; ++k )
+  {
+    const double prev = coefs[ k - 1 ] * ( ( k == 1 ) ? 2.0 : 1.0 );
+    const double next = ( k + 1 < nCoefs ) ? coefs[ k + 1 ] : 0.0;
+    integ[ k ] = ( prev - next ) / ( 2.0 * k );
+  }
+
+  // T_k( 0 ) is 0 for odd k, and ( -1 )^( k / 2 ) for even k.
+  integ[ 0 ] = 0.0;
+  for ( std::size_t k = 2; k <= nCoefs; k += 2 )
+    integ[ 0 ] -= ( ( k / 2 ) % 2 ? -1.0 : 1.0 ) * integ[ k ];
+}
+
+
+
+
+/*************************************************************************
+Fast Fourier transform
+
+Iterative radix-2 Cooley-Tukey transform of n = 2^m values,
+
+  X_k = Sum( x_j exp( -+ 2 pi i j k / n ) ),
+
+with the values first sorted in bit-reversed order. The twiddle factors
+are computed directly at every stage, rather than by recurrence, so that
+the rounding errors do not grow with n.
+*************************************************************************/
+void Math::fft( std::complex< double >* data, const std::size_t& n, const bool& inverse )
+{
+  // Sort the values in bit-reversed order.
+  for ( std::size_t i = 1, j = 0; i < n; ++i )
+  {
+    std::size_t bit = n >> 1;
+    for ( ; j & bit; bit >>= 1 )
+      j ^= bit;
+    j ^= bit;
+
+    if ( i < j )
+      std::swap( data[ i ], data[ j ] );
+  }
+
+  const double sign = inverse ? 1.0 : -1.0;
+
+  for ( std::size_t len = 2; len <= n; len <<= 1 )
+  {
+    const std::size_t half  = len / 2;
+    const double      angle = sign * 2.0 * M_PI / len;
+
+    for ( std::size_t k = 0; k < half; ++k )
+    {
+      const std::complex< double > w = std::polar( 1.0, angle * k );
+
+      for ( std::size_t i = k; i < n; i += len )
+      {
+        const std::complex< double > u = data[ i ];
+        const std::complex< double > v = data[ i + half ] * w;
+
+        data[ i        ] = u + v;
+        data[ i + half ] = u - v;
+      }
+    }
+  }
+}
+
+
+// Coefficients of the polynomial of Weideman's approximation of the Faddeeva
+//    function with N terms, from the discrete Fourier transform of
+//    exp( - t^2 ) ( L^2 + t^2 ) at t = L tan( theta / 2 ), theta = k pi / ( 2 N ).
+static std::vector< double > weidemanCoefs( const std::size_t& nTerms, const double& scale )
+{
+  const std::size_t nHalf   = 2 * nTerms;
+  const std::size_t nPoints = 2 * nHalf;
+
+  // The values for k = 0, ..., 2N - 1 go first, followed by those for k = -2N, ..., -1.
+  std::vector< std::complex< double > > values( nPoints, 0.0 );
+  for ( std::size_t point = 0; point < nPoints; ++point )
+  {
+    if ( point == nHalf )
+      continue;
+
+    const double k = ( point < nHalf ) ? double( point ) : double( point ) - double( nPoints );
+    const double t = scale * std::tan( k * M_PI / double( nHalf ) / 2.0 );
+
+    values[ point ] = std::exp( - t * t ) * ( scale * scale + t * t );
+  }
+
+  Math::fft( values.data(), nPoints );
+
+  std::vector< double > coefs( nTerms );
+  for ( std::size_t term = 0; term < nTerms; ++term )
+    coefs[ term ] = std::real( values[ term + 1 ] ) / double( nPoints );
+
+  return coefs;
+}
+
+
+const std::complex< double > Math::faddeeva( const std::complex< double >& z )
+{
+  if ( std::imag( z ) < 0.0 )
+    return 2.0 * std::exp( - z * z ) - faddeeva( - z );
+
+  // Scale of the approximation, sqrt( N / sqrt( 2 ) ) for N terms.
+  static const std::size_t           nTerms = 32;
+  static const double                scale  = std::sqrt( nTerms / std::sqrt( 2.0 ) );
+  static const std::vector< double > coefs  = weidemanCoefs( nTerms, scale );
+
+  const std::complex< double > iz    = std::complex< double >( 0.0, 1.0 ) * z;
+  const std::complex< double > denom = 1.0 / ( scale - iz );
+  const std::complex< double > ratio = ( scale + iz ) * denom;
+
+  // Horner's rule on the polynomial in ( L + i z ) / ( L - i z ).
+  std::complex< double > poly = 0.0;
+  for ( std::size_t term = nTerms; term > 0; --term )
+    poly = poly * ratio + coefs[ term - 1 ];
+
+  return 2.0 * poly * denom * denom + denom / std::sqrt( M_PI );
+}
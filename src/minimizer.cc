@@ -1,25 +1,1088 @@
 
 #include <vector>
+#include <string>
+#include <algorithm>
+#include <thread>
+#include <iterator>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <map>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+
+#ifdef MPI_ON
+#include <mpi.h>
+#endif
 
 #include <Minuit/MnMigrad.h>
+#include <Minuit/MnMinos.h>
 
 #include <cfit/minimizer.hh>
 #include <cfit/variable.hh>
 #include <cfit/parameter.hh>
+#include <cfit/filemapping.hh>
+#include <cfit/compensatedsum.hh>
+#include <cfit/random.hh>
+
+
+// Flatten the maps of cached values returned by a pdf into a contiguous buffer.
+template < class T >
+static void flatten( const std::map< unsigned, std::vector< T > >& cached, const std::size_t& size,
+                     std::vector< unsigned >& indices, std::vector< T >& buffer ) throw( PdfException )
+{
+  indices.clear();
+  buffer .clear();
+  buffer .reserve( cached.size() * size );
+
+  typedef typename std::map< unsigned, std::vector< T > >::const_iterator cIter;
+  for ( cIter slot = cached.begin(); slot != cached.end(); ++slot )
+  {
+    if ( slot->second.size() != size )
+      throw PdfException( "Minimizer: number of cached values does not match the size of the dataset." );
+
+    indices.push_back( slot->first );
+    buffer .insert( buffer.end(), slot->second.begin(), slot->second.end() );
+  }
+}
+
+
+// Copy the values of the events [ first, end ) of each slot of a buffer with
+//    size events per slot into a buffer with only those events.
+template < class T >
+static void copySlots( const T* values, const std::size_t& nSlots, const std::size_t& size,
+                       const std::size_t& first, const std::size_t& end, std::vector< T >& chunk )
+{
+  const std::size_t n = end - first;
+
+  chunk.resize( nSlots * n );
+  for ( std::size_t slot = 0; slot < nSlots; ++slot )
+    std::copy( values + slot * size + first, values + slot * size + end, chunk.begin() + slot * n );
+}
+
+
+// Copy the values of the given events of each slot of a buffer with size events
+//    per slot into a buffer with only those events.
+template < class T >
+static void gatherSlots( const T* values, const std::size_t& nSlots, const std::size_t& size,
+                         const std::vector< std::size_t >& entries, std::vector< T >& selected )
+{
+  const std::size_t n = entries.size();
+
+  selected.resize( nSlots * n );
+  for ( std::size_t slot = 0; slot < nSlots; ++slot )
+    for ( std::size_t entry = 0; entry < n; ++entry )
+      selected[ slot * n + entry ] = values[ slot * size + entries[ entry ] ];
+}
 
 
 void Minimizer::cache()
 {
-  const std::map< unsigned, std::vector< double >                 >& cachedR = _pdf->cacheReal   ( _data );
-  const std::map< unsigned, std::vector< std::complex< double > > >& cachedC = _pdf->cacheComplex( _data );
+  _cacheTime = 0.0;
+  const Timer timer( &_cacheTime );
+
+  // The pdf is checked once, so that the event loops evaluate it unchecked.
+  _pdf->check( _pdf->nVars() );
+
+  // The first evaluation must compute the quantities common to all events.
+  _pdf->invalidate();
+
+  const std::shared_ptr< Cache > cache = std::make_shared< Cache >();
+
+  if ( _cacheFile.empty() )
+  {
+    // The cache indices of this minimizer start at zero.
+    PdfBase::CacheLayout              layout;
+    const PdfBase::CacheLayout::Scope scope( layout );
 
-  _cacheR.insert( cachedR.begin(), cachedR.end() );
-  _cacheC.insert( cachedC.begin(), cachedC.end() );
+    PdfBase::beginCachePass();
+    flatten( _pdf->cacheReal   ( *_data ), _data->size(), cache->idxR, cache->valuesR );
+    flatten( _pdf->cacheComplex( *_data ), _data->size(), cache->idxC, cache->valuesC );
+
+    cache->realValues    = cache->valuesR.data();
+    cache->complexValues = cache->valuesC.data();
+
+    cache->nR = layout.nReal;
+    cache->nC = layout.nComplex;
+  }
+  else
+    spill( *cache );
+
+  cache->single = _single && _cacheFile.empty();
+  if ( cache->single )
+  {
+    const std::vector< std::string >& varNames = _pdf->varNames();
+    for ( std::size_t var = 0; var < varNames.size(); ++var )
+    {
+      const double* values = _data->valueColumn( _data->column( varNames[ var ] ) );
+      cache->singleVars.insert( cache->singleVars.end(), values, values + _data->size() );
+    }
+
+    cache->singleR.assign( cache->valuesR.begin(), cache->valuesR.end() );
+    cache->singleC.assign( cache->valuesC.begin(), cache->valuesC.end() );
+
+    std::vector< double                 >().swap( cache->valuesR );
+    std::vector< std::complex< double > >().swap( cache->valuesC );
+    cache->realValues    = 0;
+    cache->complexValues = 0;
+  }
+
+  _cache = cache;
+
+  place();
+
+  // Copies for the numeric derivatives are made again with the new cache.
+  _shifts.reset();
 }
 
 
+void Minimizer::place()
+{
+  _chunks.reset();
+
+  if ( ! ( _pool && _pool->pinned() ) )
+    return;
 
-FunctionMinimum Minimizer::minimize() const
+  const std::vector< std::string >& varNames = _pdf->varNames();
+
+  std::vector< std::size_t > columns;
+  for ( std::size_t var = 0; var < varNames.size(); ++var )
+    columns.push_back( _data->column( varNames[ var ] ) );
+
+  const std::size_t size    = _data->size();
+  const std::size_t nBlocks = ( size + _blockSize - 1 ) / _blockSize;
+  const unsigned    nThread = _pool->size();
+  const std::size_t nSlotsR = _cache->idxR.size();
+  const std::size_t nSlotsC = _cache->idxC.size();
+
+  const std::shared_ptr< std::vector< Chunk > > chunks = std::make_shared< std::vector< Chunk > >( nThread );
+
+  // Each thread allocates and fills its own chunk, so that their pages are first
+  //    touched by it, with the same blocks as in sumBlocks.
+  const ThreadPool::task_type task = [ & ]( const std::size_t&, const unsigned& thread )
+  {
+    const std::pair< std::size_t, std::size_t > blocks = ThreadPool::range( nBlocks, nThread, thread );
+
+    Chunk& chunk = ( *chunks )[ thread ];
+    chunk.first = std::min( blocks.first  * _blockSize, size );
+    chunk.end   = std::min( blocks.second * _blockSize, size );
+
+    const std::size_t n = chunk.end - chunk.first;
+
+    if ( _cache->single )
+    {
+      copySlots( _cache->singleVars.data(), columns.size(), size, chunk.first, chunk.end, chunk.singleVars );
+      copySlots( _cache->singleR   .data(), nSlotsR,        size, chunk.first, chunk.end, chunk.singleR    );
+      copySlots( _cache->singleC   .data(), nSlotsC,        size, chunk.first, chunk.end, chunk.singleC    );
+      return;
+    }
+
+    chunk.vars.resize( columns.size() * n );
+    for ( std::size_t var = 0; var < columns.size(); ++var )
+    {
+      const double* values = _data->valueColumn( columns[ var ] );
+      std::copy( values + chunk.first, values + chunk.end, chunk.vars.begin() + var * n );
+    }
+
+    copySlots( _cache->realValues,    nSlotsR, size, chunk.first, chunk.end, chunk.valuesR );
+    copySlots( _cache->complexValues, nSlotsC, size, chunk.first, chunk.end, chunk.valuesC );
+  };
+
+  _pool->runRanges( nThread, task );
+
+  _chunks = chunks;
+}
+
+
+// Each call to cacheReal or cacheComplex hands out new cache indices, in the
+//    same order, so the values of the slot at position k of each chunk are
+//    those of the slot at position k of the last chunk, whose indices are the
+//    ones that the pdf keeps.
+void Minimizer::spill( Cache& cache ) throw( PdfException )
+{
+  const std::size_t size = _data->size();
+
+  std::ofstream file( _cacheFile.c_str(), std::ios::binary | std::ios::trunc );
+  if ( ! file )
+    throw PdfException( "Minimizer: cannot open cache file " + _cacheFile + " for writing." );
+
+  std::size_t nSlotsR = 0;
+  std::size_t nSlotsC = 0;
+  for ( std::size_t first = 0; ( first < size ) || ( first == 0 ); first += _cacheChunk )
+  {
+    const std::size_t n = std::min( _cacheChunk, size - first );
+
+    // The whole dataset is not copied if it fits in a single chunk.
+    const Dataset chunk = ( n == size ) ? Dataset() : _data->range( first, n );
+    const Dataset& data = ( n == size ) ? *_data : chunk;
+
+    // Every chunk is given the same cache indices, starting at zero.
+    PdfBase::CacheLayout              layout;
+    const PdfBase::CacheLayout::Scope scope( layout );
+
+    std::vector< double >                 valuesR;
+    std::vector< std::complex< double > > valuesC;
+    PdfBase::beginCachePass();
+    flatten( _pdf->cacheReal   ( data ), n, cache.idxR, valuesR );
+    flatten( _pdf->cacheComplex( data ), n, cache.idxC, valuesC );
+
+    cache.nR = layout.nReal;
+    cache.nC = layout.nComplex;
+
+    if ( first == 0 )
+    {
+      nSlotsR = cache.idxR.size();
+      nSlotsC = cache.idxC.size();
+    }
+    else if ( ( cache.idxR.size() != nSlotsR ) || ( cache.idxC.size() != nSlotsC ) )
+      throw PdfException( "Minimizer: the pdf has cached a different number of values for each chunk of the dataset." );
+
+    for ( std::size_t slot = 0; slot < nSlotsR; ++slot )
+    {
+      file.seekp( ( slot * size + first ) * sizeof( double ) );
+      file.write( reinterpret_cast< const char* >( valuesR.data() + slot * n ), n * sizeof( double ) );
+    }
+
+    for ( std::size_t slot = 0; slot < nSlotsC; ++slot )
+    {
+      file.seekp( nSlotsR * size * sizeof( double ) + ( slot * size + first ) * sizeof( std::complex< double > ) );
+      file.write( reinterpret_cast< const char* >( valuesC.data() + slot * n ), n * sizeof( std::complex< double > ) );
+    }
+
+    if ( size == 0 )
+      break;
+  }
+
+  file.close();
+  if ( ! file )
+    throw PdfException( "Minimizer: error writing cache file " + _cacheFile + "." );
+
+  cache.realValues    = 0;
+  cache.complexValues = 0;
+  if ( ( nSlotsR + nSlotsC == 0 ) || ( size == 0 ) )
+    return;
+
+  std::size_t bytes;
+  try
+  {
+    cache.mapping = FileMapping::map( _cacheFile, bytes );
+  }
+  catch ( DataException& error )
+  {
+    throw PdfException( error.what() );
+  }
+
+  const char* values = static_cast< const char* >( cache.mapping.get() );
+  cache.realValues    = reinterpret_cast< const double*                 >( values );
+  cache.complexValues = reinterpret_cast< const std::complex< double >* >( values + nSlotsR * size * sizeof( double ) );
+}
+
+
+void Minimizer::advise( const std::size_t& first, const std::size_t& n, const bool& prefetch ) const
+{
+  if ( prefetch )
+    _data->prefetch( first, n );
+  else
+    _data->release( first, n );
+
+  if ( ! _cache->mapping )
+    return;
+
+  const std::size_t size = _data->size();
+
+  for ( std::size_t slot = 0; slot < _cache->idxR.size(); ++slot )
+  {
+    const double* values = _cache->realValues + slot * size + first;
+    if ( prefetch )
+      FileMapping::prefetch( values, n * sizeof( double ) );
+    else
+      FileMapping::release ( values, n * sizeof( double ) );
+  }
+
+  for ( std::size_t slot = 0; slot < _cache->idxC.size(); ++slot )
+  {
+    const std::complex< double >* values = _cache->complexValues + slot * size + first;
+    if ( prefetch )
+      FileMapping::prefetch( values, n * sizeof( std::complex< double > ) );
+    else
+      FileMapping::release ( values, n * sizeof( std::complex< double > ) );
+  }
+}
+
+
+void Minimizer::setCacheFile( const std::string& file ) throw( PdfException )
+{
+  _cacheFile = file;
+  cache();
+}
+
+
+void Minimizer::setSinglePrecision( const bool& val )
+{
+  _single = val;
+  cache();
+}
+
+
+
+const std::size_t Minimizer::_blockSize  = 1024;
+const std::size_t Minimizer::_scanChain  = 8;
+const std::size_t Minimizer::_cacheChunk = 1 << 18;
+
+
+void Minimizer::block( const std::vector< std::size_t >&                   columns,
+                       const std::size_t&                                  first  ,
+                       const Chunk*                                        chunk  ,
+                       std::vector< const double*                 >&       vars   ,
+                       std::vector< const double*                 >&       cacheR ,
+                       std::vector< const std::complex< double >* >&       cacheC ,
+                       std::vector< double                        >&       bufferR,
+                       std::vector< std::complex< double >        >&       bufferC ) const
+{
+  // Number of events of each slot of the cache or of the chunk, and position of the block in it.
+  const std::size_t size   = chunk ? chunk->end - chunk->first : _data->size();
+  const std::size_t offset = chunk ? first      - chunk->first : first;
+
+  vars.resize( columns.size() );
+
+  // The cache indices of the pdf are the same for all the blocks, so the
+  //    pointers of the rest are only cleared once.
+  if ( cacheR.size() != _cache->nR )
+    cacheR.assign( _cache->nR, 0 );
+  if ( cacheC.size() != _cache->nC )
+    cacheC.assign( _cache->nC, 0 );
+
+  if ( _cache->single )
+  {
+    const std::size_t nVars = columns.size();
+    const std::size_t n     = std::min( _blockSize, _data->size() - first );
+
+    const float*                 singleVars = chunk ? chunk->singleVars.data() : _cache->singleVars.data();
+    const float*                 singleR    = chunk ? chunk->singleR   .data() : _cache->singleR   .data();
+    const std::complex< float >* singleC    = chunk ? chunk->singleC   .data() : _cache->singleC   .data();
+
+    // The variables are converted first, followed by the real cached values.
+    bufferR.resize( ( nVars + _cache->idxR.size() ) * _blockSize );
+    bufferC.resize( _cache->idxC.size() * _blockSize );
+
+    for ( std::size_t var = 0; var < nVars; ++var )
+    {
+      const float* values = singleVars + var * size + offset;
+      std::copy( values, values + n, bufferR.begin() + var * _blockSize );
+      vars[ var ] = bufferR.data() + var * _blockSize;
+    }
+
+    for ( std::size_t slot = 0; slot < _cache->idxR.size(); ++slot )
+    {
+      const float* values = singleR + slot * size + offset;
+      std::copy( values, values + n, bufferR.begin() + ( nVars + slot ) * _blockSize );
+      cacheR[ _cache->idxR[ slot ] ] = bufferR.data() + ( nVars + slot ) * _blockSize;
+    }
+
+    for ( std::size_t slot = 0; slot < _cache->idxC.size(); ++slot )
+    {
+      const std::complex< float >* values = singleC + slot * size + offset;
+      std::copy( values, values + n, bufferC.begin() + slot * _blockSize );
+      cacheC[ _cache->idxC[ slot ] ] = bufferC.data() + slot * _blockSize;
+    }
+
+    return;
+  }
+
+  for ( std::size_t var = 0; var < columns.size(); ++var )
+    vars[ var ] = chunk ? chunk->vars.data() + var * size + offset : _data->valueColumn( columns[ var ] ) + first;
+
+  const double*                 realValues    = chunk ? chunk->valuesR.data() : _cache->realValues;
+  const std::complex< double >* complexValues = chunk ? chunk->valuesC.data() : _cache->complexValues;
+
+  for ( std::size_t slot = 0; slot < _cache->idxR.size(); ++slot )
+    cacheR[ _cache->idxR[ slot ] ] = realValues + slot * size + offset;
+
+  for ( std::size_t slot = 0; slot < _cache->idxC.size(); ++slot )
+    cacheC[ _cache->idxC[ slot ] ] = complexValues + slot * size + offset;
+}
+
+
+double Minimizer::cpuSumBlocks( const term_type& term, const bool& shape, const std::function< void() >& first ) const throw( PdfException )
+{
+  // Resolve the dataset columns of the variables that the pdf depends on.
+  const std::vector< std::string >& varNames = _pdf->varNames();
+
+  std::vector< std::size_t > columns;
+  for ( std::size_t var = 0; var < varNames.size(); ++var )
+    columns.push_back( _data->column( varNames[ var ] ) );
+
+  const std::size_t size    = _data->size();
+  const std::size_t nBlocks = ( size + _blockSize - 1 ) / _blockSize;
+  const unsigned    nThread = threads();
+  const bool        stream  = _streaming && ! _chunks;
+
+  // Partial sum of each block.
+  std::vector< double > partial( nBlocks, 0.0 );
+
+  // Pointers and values of the pdf of the block each thread is working on.
+  std::vector< std::vector< const double*                 > > vars  ( nThread );
+  std::vector< std::vector< const double*                 > > cacheR( nThread );
+  std::vector< std::vector< const std::complex< double >* > > cacheC( nThread );
+  std::vector< std::vector< double                        > > values( nThread, std::vector< double >( _blockSize ) );
+  std::vector< std::vector< double                        > > bufferR( nThread );
+  std::vector< std::vector< std::complex< double >        > > bufferC( nThread );
+
+  const ThreadPool::task_type task = [ & ]( const std::size_t& blk, const unsigned& thread )
+  {
+    const std::size_t first = blk * _blockSize;
+    const std::size_t n     = std::min( _blockSize, size - first );
+
+    // Read ahead the block that this thread will probably take next. The chunks
+    //    of a pinned pool are already in memory.
+    if ( stream && ( blk + nThread < nBlocks ) )
+      advise( first + nThread * _blockSize, std::min( _blockSize, size - first - nThread * _blockSize ), true );
+
+    const Chunk* chunk = _chunks ? &( *_chunks )[ thread ] : 0;
+
+    block( columns, first, chunk, vars[ thread ], cacheR[ thread ], cacheC[ thread ], bufferR[ thread ], bufferC[ thread ] );
+    if ( shape )
+      _pdf->evaluateShape    ( vars[ thread ], cacheR[ thread ], cacheC[ thread ], n, values[ thread ].data() );
+    else
+      _pdf->evaluateUnchecked( vars[ thread ], cacheR[ thread ], cacheC[ thread ], n, values[ thread ].data() );
+
+    partial[ blk ] = term( first, n, values[ thread ].data() );
+
+    if ( stream )
+      advise( first, n, false );
+  };
+
+  {
+    const Timer timer( profiled( _stats.loop ) );
+
+    if ( _chunks )
+      _pool->runRanges( nBlocks, task, first );
+    else if ( _pool )
+      _pool->run( nBlocks, task, first );
+    else
+    {
+      if ( first )
+        first();
+      for ( std::size_t blk = 0; blk < nBlocks; ++blk )
+        task( blk, 0 );
+    }
+  }
+
+  // The partial sums are added in the order of the blocks, so the result does
+  //    not depend on the number of threads nor on which of them took each block.
+  return _sampleScale * CompensatedSum::sum( partial.data(), nBlocks );
+}
+
+
+std::vector< double > Minimizer::sumGradientBlocks( const std::vector< bool >& requested,
+                                                    const grad_term_type&      term       ) const throw( PdfException )
+{
+  const std::size_t nPars = _pdf->nPars();
+  if ( requested.size() != nPars )
+    throw PdfException( "Minimizer: number of requested derivatives does not match the number of parameters." );
+
+  const std::vector< std::string >& varNames = _pdf->varNames();
+
+  std::vector< std::size_t > columns;
+  for ( std::size_t var = 0; var < varNames.size(); ++var )
+    columns.push_back( _data->column( varNames[ var ] ) );
+
+  const std::size_t size    = _data->size();
+  const std::size_t nBlocks = ( size + _blockSize - 1 ) / _blockSize;
+  const unsigned    nThread = threads();
+  const bool        stream  = _streaming && ! _chunks;
+
+  // Partial sums of each block, parameter after parameter.
+  std::vector< double > partial( nBlocks * nPars, 0.0 );
+
+  std::vector< std::vector< const double*                 > > vars  ( nThread );
+  std::vector< std::vector< const double*                 > > cacheR( nThread );
+  std::vector< std::vector< const std::complex< double >* > > cacheC( nThread );
+  std::vector< std::vector< double                        > > values( nThread, std::vector< double >( _blockSize ) );
+  std::vector< std::vector< double                        > > bufferR( nThread );
+  std::vector< std::vector< std::complex< double >        > > bufferC( nThread );
+  std::vector< std::vector< double                        > > derivs( nThread, std::vector< double >( _blockSize * nPars ) );
+  std::vector< std::vector< double*                       > > grad  ( nThread, std::vector< double* >( nPars, 0 ) );
+
+  for ( unsigned thread = 0; thread < nThread; ++thread )
+    for ( std::size_t par = 0; par < nPars; ++par )
+      if ( requested[ par ] )
+        grad[ thread ][ par ] = derivs[ thread ].data() + par * _blockSize;
+
+  const ThreadPool::task_type task = [ & ]( const std::size_t& blk, const unsigned& thread )
+  {
+    const std::size_t first = blk * _blockSize;
+    const std::size_t n     = std::min( _blockSize, size - first );
+
+    if ( stream && ( blk + nThread < nBlocks ) )
+      advise( first + nThread * _blockSize, std::min( _blockSize, size - first - nThread * _blockSize ), true );
+
+    const Chunk* chunk = _chunks ? &( *_chunks )[ thread ] : 0;
+
+    block( columns, first, chunk, vars[ thread ], cacheR[ thread ], cacheC[ thread ], bufferR[ thread ], bufferC[ thread ] );
+    _pdf->evaluateGradient( vars[ thread ], cacheR[ thread ], cacheC[ thread ], n, values[ thread ].data(), grad[ thread ] );
+
+    for ( std::size_t par = 0; par < nPars; ++par )
+      if ( requested[ par ] )
+        partial[ blk * nPars + par ] = term( first, n, values[ thread ].data(), grad[ thread ][ par ] );
+
+    if ( stream )
+      advise( first, n, false );
+  };
+
+  {
+    const Timer timer( profiled( _stats.loop ) );
+
+    if ( _chunks )
+      _pool->runRanges( nBlocks, task );
+    else if ( _pool )
+      _pool->run( nBlocks, task );
+    else
+      for ( std::size_t blk = 0; blk < nBlocks; ++blk )
+        task( blk, 0 );
+  }
+
+  std::vector< double > sum( nPars, 0.0 );
+  for ( std::size_t par = 0; par < nPars; ++par )
+    sum[ par ] = _sampleScale * CompensatedSum::sum( partial.data() + par, nBlocks, nPars );
+
+  return sum;
+}
+
+
+double Minimizer::derivativeStep( const std::vector< double >& pars, const std::size_t& index ) const
+{
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  pIter par = _pdf->getPars().begin();
+  std::advance( par, index );
+
+  const double& error = par->second.error();
+  return ( error > 0.0 ) ? 1.e-3 * error : 1.e-6 * ( 1.0 + std::fabs( pars[ index ] ) );
+}
+
+
+double Minimizer::numericDerivative( const std::vector< double >& pars, const std::size_t& index ) const throw( PdfException )
+{
+  const double step = derivativeStep( pars, index );
+
+  std::vector< double > shifted( pars );
+
+  shifted[ index ] = pars[ index ] + step;
+  const double up = (*this)( shifted );
+
+  shifted[ index ] = pars[ index ] - step;
+  const double down = (*this)( shifted );
+
+  return ( up - down ) / ( 2.0 * step );
+}
+
+
+void Minimizer::numericGradient( const std::vector< double >& pars     ,
+                                 const std::vector< bool   >& requested,
+                                 std::vector< double >&       grad       ) const throw( PdfException )
+{
+  std::vector< std::size_t > indices;
+  for ( std::size_t index = 0; index < requested.size(); ++index )
+    if ( requested[ index ] )
+      indices.push_back( index );
+
+#ifdef MPI_ON
+  const unsigned nThread = 1;
+#else
+  const unsigned& nThreads = _config.gradThreads();
+  const unsigned  nThread  = std::min< std::size_t >( nThreads ? nThreads : std::max( 1u, std::thread::hardware_concurrency() ),
+                                                      2 * indices.size() );
+#endif
+
+  if ( nThread <= 1 )
+  {
+    for ( std::size_t deriv = 0; deriv < indices.size(); ++deriv )
+      grad[ indices[ deriv ] ] = numericDerivative( pars, indices[ deriv ] );
+    return;
+  }
+
+  // Each thread moves the parameters of its own copy, evaluated in a single thread.
+  if ( ! _shifts || ( _shifts->copies.size() != nThread ) )
+  {
+    _shifts.reset( new Shifts() );
+    _shifts->pool.reset( new ThreadPool( nThread ) );
+    for ( unsigned thread = 0; thread < nThread; ++thread )
+    {
+      _shifts->copies.push_back( std::unique_ptr< Minimizer >( copy() ) );
+      _shifts->copies.back()->setThreads( 1 );
+    }
+  }
+
+  std::vector< double > steps;
+  for ( std::size_t deriv = 0; deriv < indices.size(); ++deriv )
+    steps.push_back( derivativeStep( pars, indices[ deriv ] ) );
+
+  // Values at the points shifted up and down for each derivative, one after the other.
+  std::vector< double > values( 2 * indices.size() );
+  const ThreadPool::task_type task = [ & ]( const std::size_t& shift, const unsigned& thread )
+  {
+    const std::size_t deriv = shift / 2;
+
+    std::vector< double > shifted( pars );
+    shifted[ indices[ deriv ] ] = pars[ indices[ deriv ] ] + ( ( shift % 2 ) ? - steps[ deriv ] : steps[ deriv ] );
+
+    values[ shift ] = ( *_shifts->copies[ thread ] )( shifted );
+  };
+
+  _shifts->pool->run( values.size(), task );
+
+  for ( std::size_t deriv = 0; deriv < indices.size(); ++deriv )
+    grad[ indices[ deriv ] ] = ( values[ 2 * deriv ] - values[ 2 * deriv + 1 ] ) / ( 2.0 * steps[ deriv ] );
+}
+
+
+std::vector< bool > Minimizer::scoreParameters() const throw( PdfException )
+{
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  const std::map< std::string, Parameter >& parMap = _pdf->getPars();
+
+  std::vector< bool > requested;
+  for ( pIter par = parMap.begin(); par != parMap.end(); ++par )
+  {
+    requested.push_back( ! par->second.isFixed() );
+    if ( requested.back() && ! _pdf->hasGradient( par->first ) )
+      throw PdfException( "Minimizer: the pdf does not provide analytic derivatives with respect to free parameter " + par->first + "." );
+  }
+
+  return requested;
+}
+
+
+std::vector< std::vector< double > > Minimizer::sumScoreBlocks( const std::vector< bool >& requested,
+                                                                const std::size_t&         nMatrices,
+                                                                const score_factor_type&   factor     ) const throw( PdfException )
+{
+  const std::size_t nPars = _pdf->nPars();
+  if ( requested.size() != nPars )
+    throw PdfException( "Minimizer: number of requested derivatives does not match the number of parameters." );
+
+  std::vector< std::size_t > indices;
+  for ( std::size_t par = 0; par < nPars; ++par )
+    if ( requested[ par ] )
+      indices.push_back( par );
+
+  const std::vector< std::string >& varNames = _pdf->varNames();
+
+  std::vector< std::size_t > columns;
+  for ( std::size_t var = 0; var < varNames.size(); ++var )
+    columns.push_back( _data->column( varNames[ var ] ) );
+
+  const std::size_t size    = _data->size();
+  const std::size_t nBlocks = ( size + _blockSize - 1 ) / _blockSize;
+  const unsigned    nThread = threads();
+  const bool        stream  = _streaming && ! _chunks;
+  const std::size_t nScores = indices.size();
+  const std::size_t nPacked = nScores * ( nScores + 1 ) / 2;
+
+  // Partial sums of the upper triangles of the matrices for each block.
+  std::vector< double > partial( nBlocks * nMatrices * nPacked, 0.0 );
+
+  std::vector< std::vector< const double*                 > > vars   ( nThread );
+  std::vector< std::vector< const double*                 > > cacheR ( nThread );
+  std::vector< std::vector< const std::complex< double >* > > cacheC ( nThread );
+  std::vector< std::vector< double                        > > values ( nThread, std::vector< double >( _blockSize ) );
+  std::vector< std::vector< double                        > > bufferR( nThread );
+  std::vector< std::vector< std::complex< double >        > > bufferC( nThread );
+  std::vector< std::vector< double                        > > derivs ( nThread, std::vector< double >( _blockSize * nPars ) );
+  std::vector< std::vector< double*                       > > grad   ( nThread, std::vector< double* >( nPars, 0 ) );
+  std::vector< std::vector< double                        > > scores ( nThread, std::vector< double >( nScores   ) );
+  std::vector< std::vector< double                        > > factors( nThread, std::vector< double >( nMatrices ) );
+
+  for ( unsigned thread = 0; thread < nThread; ++thread )
+    for ( std::size_t par = 0; par < nPars; ++par )
+      if ( requested[ par ] )
+        grad[ thread ][ par ] = derivs[ thread ].data() + par * _blockSize;
+
+  const ThreadPool::task_type task = [ & ]( const std::size_t& blk, const unsigned& thread )
+  {
+    const std::size_t first = blk * _blockSize;
+    const std::size_t n     = std::min( _blockSize, size - first );
+
+    if ( stream && ( blk + nThread < nBlocks ) )
+      advise( first + nThread * _blockSize, std::min( _blockSize, size - first - nThread * _blockSize ), true );
+
+    const Chunk* chunk = _chunks ? &( *_chunks )[ thread ] : 0;
+
+    block( columns, first, chunk, vars[ thread ], cacheR[ thread ], cacheC[ thread ], bufferR[ thread ], bufferC[ thread ] );
+    _pdf->evaluateGradient( vars[ thread ], cacheR[ thread ], cacheC[ thread ], n, values[ thread ].data(), grad[ thread ] );
+
+    double* sums  = partial.data() + blk * nMatrices * nPacked;
+    double* score = scores [ thread ].data();
+    double* fact  = factors[ thread ].data();
+    for ( std::size_t entry = 0; entry < n; ++entry )
+    {
+      const double value = values[ thread ][ entry ];
+      if ( ! value )
+        continue;
+
+      for ( std::size_t row = 0; row < nScores; ++row )
+        score[ row ] = grad[ thread ][ indices[ row ] ][ entry ] / value;
+
+      factor( first + entry, fact );
+
+      for ( std::size_t matrix = 0; matrix < nMatrices; ++matrix )
+      {
+        double* sum = sums + matrix * nPacked;
+        for ( std::size_t row = 0; row < nScores; ++row )
+        {
+          const double left = fact[ matrix ] * score[ row ];
+          for ( std::size_t col = row; col < nScores; ++col )
+            *sum++ += left * score[ col ];
+        }
+      }
+    }
+
+    if ( stream )
+      advise( first, n, false );
+  };
+
+  {
+    const Timer timer( profiled( _stats.loop ) );
+
+    if ( _chunks )
+      _pool->runRanges( nBlocks, task );
+    else if ( _pool )
+      _pool->run( nBlocks, task );
+    else
+      for ( std::size_t blk = 0; blk < nBlocks; ++blk )
+        task( blk, 0 );
+  }
+
+  // Add the blocks in their order, and fill the lower triangles.
+  std::vector< std::vector< double > > result( nMatrices, std::vector< double >( nScores * nScores ) );
+  for ( std::size_t matrix = 0; matrix < nMatrices; ++matrix )
+  {
+    std::size_t element = 0;
+    for ( std::size_t row = 0; row < nScores; ++row )
+      for ( std::size_t col = row; col < nScores; ++col, ++element )
+      {
+        const double sum = _sampleScale * CompensatedSum::sum( partial.data() + matrix * nPacked + element, nBlocks, nMatrices * nPacked );
+        result[ matrix ][ row * nScores + col ] = sum;
+        result[ matrix ][ col * nScores + row ] = sum;
+      }
+  }
+
+  return result;
+}
+
+
+std::vector< double > Minimizer::invert( const std::vector< double >& matrix, const std::size_t& n ) throw( PdfException )
+{
+  // Cholesky decomposition matrix = L L^T.
+  std::vector< double > lower( n * n, 0.0 );
+  for ( std::size_t col = 0; col < n; ++col )
+  {
+    double diag = matrix[ col * n + col ];
+    for ( std::size_t k = 0; k < col; ++k )
+      diag -= lower[ col * n + k ] * lower[ col * n + k ];
+
+    if ( ! ( diag > 0.0 ) )
+      throw PdfException( "Minimizer: the matrix to invert is not positive definite." );
+
+    lower[ col * n + col ] = std::sqrt( diag );
+    for ( std::size_t row = col + 1; row < n; ++row )
+    {
+      double value = matrix[ row * n + col ];
+      for ( std::size_t k = 0; k < col; ++k )
+        value -= lower[ row * n + k ] * lower[ col * n + k ];
+      lower[ row * n + col ] = value / lower[ col * n + col ];
+    }
+  }
+
+  // Inverse of L, which is also lower triangular.
+  std::vector< double > invLower( n * n, 0.0 );
+  for ( std::size_t col = 0; col < n; ++col )
+  {
+    invLower[ col * n + col ] = 1.0 / lower[ col * n + col ];
+    for ( std::size_t row = col + 1; row < n; ++row )
+    {
+      double value = 0.0;
+      for ( std::size_t k = col; k < row; ++k )
+        value -= lower[ row * n + k ] * invLower[ k * n + col ];
+      invLower[ row * n + col ] = value / lower[ row * n + row ];
+    }
+  }
+
+  // matrix^-1 = L^-T L^-1.
+  std::vector< double > inverse( n * n );
+  for ( std::size_t row = 0; row < n; ++row )
+    for ( std::size_t col = row; col < n; ++col )
+    {
+      double value = 0.0;
+      for ( std::size_t k = col; k < n; ++k )
+        value += invLower[ k * n + row ] * invLower[ k * n + col ];
+      inverse[ row * n + col ] = value;
+      inverse[ col * n + row ] = value;
+    }
+
+  return inverse;
+}
+
+
+MnUserCovariance Minimizer::userCovariance( const std::vector< double >& matrix, const std::size_t& n )
+{
+  MnUserCovariance covariance( n );
+  for ( std::size_t row = 0; row < n; ++row )
+    for ( std::size_t col = row; col < n; ++col )
+      covariance( row, col ) = matrix[ row * n + col ];
+
+  return covariance;
+}
+
+
+MnUserCovariance Minimizer::scoreCovariance( const std::vector< double >& pars ) const throw( PdfException )
+{
+  throw PdfException( "Minimizer: this minimizer does not provide a covariance from the scores of the events." );
+}
+
+
+MnUserCovariance Minimizer::scoreCovariance( const FunctionMinimum& min ) const throw( PdfException )
+{
+  std::vector< double > pars;
+
+  const std::vector< MinuitParameter >& minPars = min.userParameters().parameters();
+  typedef std::vector< MinuitParameter >::const_iterator mIter;
+  for ( mIter par = minPars.begin(); par != minPars.end(); ++par )
+    pars.push_back( par->value() );
+
+  return scoreCovariance( pars );
+}
+
+
+std::vector< double > Minimizer::gradient( const std::vector< double >& pars ) const throw( PdfException )
+{
+  if ( pars.size() != _pdf->nPars() )
+    throw PdfException( "Number of parameters passed does not match number of required arguments." );
+
+  count( _stats.gradients );
+
+  std::vector< double > grad( pars.size(), 0.0 );
+
+  // Fixed parameters are not varied by the minimizer.
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  const std::map< std::string, Parameter >& parMap = _pdf->getPars();
+
+  std::vector< bool > varied;
+  for ( pIter par = parMap.begin(); par != parMap.end(); ++par )
+    varied.push_back( ! par->second.isFixed() );
+
+  numericGradient( pars, varied, grad );
+
+  // Leave the pdf at the point where the gradient has been computed.
+  _pdf->setPars( pars );
+  update();
+
+  return grad;
+}
+
+
+void Minimizer::setData( const std::shared_ptr< const Dataset >& data )
+{
+  _data = data;
+  cache();
+}
+
+
+void Minimizer::append( const Dataset& events ) throw( PdfException )
+{
+  if ( events.empty() )
+    return;
+
+  std::shared_ptr< Dataset > data = std::make_shared< Dataset >( *_data );
+  try
+  {
+    data->append( events );
+  }
+  catch ( DataException& error )
+  {
+    throw PdfException( error.what() );
+  }
+
+  // Values spilled to a file are written again in full. The data are set without
+  //    the overrides of setData, since those of the subclasses would process the
+  //    events again, e.g. BinnedNll would histogram its histogram, and their
+  //    overrides of append do what they need after this.
+  if ( ! _cacheFile.empty() )
+  {
+    Minimizer::setData( data );
+    return;
+  }
+
+  // Values cached by the pdf for the new events only, with the indices of cache().
+  const std::shared_ptr< Cache > cache = std::make_shared< Cache >();
+
+  std::vector< double >                 valuesR;
+  std::vector< std::complex< double > > valuesC;
+  {
+    const Timer timer( &_cacheTime );
+
+    PdfBase::CacheLayout              layout;
+    const PdfBase::CacheLayout::Scope scope( layout );
+
+    PdfBase::beginCachePass();
+    flatten( _pdf->cacheReal   ( events ), events.size(), cache->idxR, valuesR );
+    flatten( _pdf->cacheComplex( events ), events.size(), cache->idxC, valuesC );
+
+    cache->nR     = layout.nReal;
+    cache->nC     = layout.nComplex;
+    cache->single = _cache->single;
+  }
+
+  if ( ( cache->idxR != _cache->idxR ) || ( cache->idxC != _cache->idxC ) )
+  {
+    Minimizer::setData( data );
+    return;
+  }
+
+  const Timer timer( &_cacheTime );
+
+  // Join the values of each slot, those of the new events after the others.
+  const std::size_t size = _data->size();
+  const std::size_t n    = events.size();
+  if ( cache->single )
+  {
+    const std::vector< std::string >& varNames = _pdf->varNames();
+    for ( std::size_t var = 0; var < varNames.size(); ++var )
+    {
+      const double* values = events.valueColumn( events.column( varNames[ var ] ) );
+      cache->singleVars.insert( cache->singleVars.end(), _cache->singleVars.begin() + var * size, _cache->singleVars.begin() + ( var + 1 ) * size );
+      cache->singleVars.insert( cache->singleVars.end(), values, values + n );
+    }
+
+    for ( std::size_t slot = 0; slot < cache->idxR.size(); ++slot )
+    {
+      cache->singleR.insert( cache->singleR.end(), _cache->singleR.begin() + slot * size, _cache->singleR.begin() + ( slot + 1 ) * size );
+      cache->singleR.insert( cache->singleR.end(), valuesR.begin() + slot * n, valuesR.begin() + ( slot + 1 ) * n );
+    }
+
+    for ( std::size_t slot = 0; slot < cache->idxC.size(); ++slot )
+    {
+      cache->singleC.insert( cache->singleC.end(), _cache->singleC.begin() + slot * size, _cache->singleC.begin() + ( slot + 1 ) * size );
+      cache->singleC.insert( cache->singleC.end(), valuesC.begin() + slot * n, valuesC.begin() + ( slot + 1 ) * n );
+    }
+
+    cache->realValues    = 0;
+    cache->complexValues = 0;
+  }
+  else
+  {
+    for ( std::size_t slot = 0; slot < cache->idxR.size(); ++slot )
+    {
+      cache->valuesR.insert( cache->valuesR.end(), _cache->realValues + slot * size, _cache->realValues + ( slot + 1 ) * size );
+      cache->valuesR.insert( cache->valuesR.end(), valuesR.begin() + slot * n, valuesR.begin() + ( slot + 1 ) * n );
+    }
+
+    for ( std::size_t slot = 0; slot < cache->idxC.size(); ++slot )
+    {
+      cache->valuesC.insert( cache->valuesC.end(), _cache->complexValues + slot * size, _cache->complexValues + ( slot + 1 ) * size );
+      cache->valuesC.insert( cache->valuesC.end(), valuesC.begin() + slot * n, valuesC.begin() + ( slot + 1 ) * n );
+    }
+
+    cache->realValues    = cache->valuesR.data();
+    cache->complexValues = cache->valuesC.data();
+  }
+
+  _data  = data;
+  _cache = cache;
+
+  place();
+
+  // Copies for the numeric derivatives are made again with the new cache.
+  _shifts.reset();
+}
+
+
+void Minimizer::select( const std::vector< std::size_t >& entries ) throw( PdfException )
+{
+  const std::size_t size = _data->size();
+
+  const std::shared_ptr< Cache > cache = std::make_shared< Cache >();
+  cache->nR     = _cache->nR;
+  cache->nC     = _cache->nC;
+  cache->idxR   = _cache->idxR;
+  cache->idxC   = _cache->idxC;
+  cache->single = _cache->single;
+
+  // The values spilled to a file are kept in memory for the selected events.
+  if ( cache->single )
+  {
+    gatherSlots( _cache->singleVars.data(), _pdf->varNames().size(), size, entries, cache->singleVars );
+    gatherSlots( _cache->singleR   .data(), cache->idxR.size(),      size, entries, cache->singleR    );
+    gatherSlots( _cache->singleC   .data(), cache->idxC.size(),      size, entries, cache->singleC    );
+
+    cache->realValues    = 0;
+    cache->complexValues = 0;
+  }
+  else
+  {
+    gatherSlots( _cache->realValues,    cache->idxR.size(), size, entries, cache->valuesR );
+    gatherSlots( _cache->complexValues, cache->idxC.size(), size, entries, cache->valuesC );
+
+    cache->realValues    = cache->valuesR.data();
+    cache->complexValues = cache->valuesC.data();
+  }
+
+  _data  = std::make_shared< const Dataset >( DatasetView( *_data, std::make_shared< const std::vector< std::size_t > >( entries ) ) );
+  _cache = cache;
+
+  place();
+
+  // Copies for the numeric derivatives are made again with the new cache.
+  _shifts.reset();
+}
+
+
+Minimizer* Minimizer::subsample( const double& fraction, const unsigned& seed ) const throw( PdfException )
+{
+  std::uint64_t offset = 0;
+#ifdef MPI_ON
+  // Each process draws the events of its piece of the dataset from its own range of counters.
+  offset = std::uint64_t( MPI::COMM_WORLD.Get_rank() ) << 40;
+#endif
+
+  std::vector< std::size_t > entries;
+  for ( std::size_t entry = 0; entry < _data->size(); ++entry )
+    if ( Random::counter( seed, 0, offset + entry ) < fraction )
+      entries.push_back( entry );
+
+  std::unique_ptr< Minimizer > sub( copy() );
+  sub->select( entries );
+  sub->_sampleScale = _sampleScale / fraction;
+
+  // The error of an integral on a grid falls as the square of its number of
+  //    steps, and the statistical one of the subsample as the square root of its
+  //    number of events, so the norm keeps the same relative precision with the
+  //    steps scaled by the fourth root of the fraction.
+  sub->_pdf->scaleNormSteps( std::pow( fraction, 0.25 ) );
+
+  FitConfig config( _config );
+  config.noProgressive();
+  config.setHesse( false );
+  sub->setConfig( config );
+
+  return sub.release();
+}
+
+
+void Minimizer::setThreads( const unsigned& nThreads, const bool& numa )
+{
+  const unsigned nThread = nThreads ? nThreads : std::max( 1u, std::thread::hardware_concurrency() );
+
+  delete _pool;
+  _pool = ( nThread > 1 ) ? new ThreadPool( nThread, numa ) : 0;
+
+  place();
+}
+
+
+MnUserParameters Minimizer::userParameters() const
 {
   // Work with Minuit user defined parameters.
   MnUserParameters upar;
@@ -46,9 +1109,489 @@ FunctionMinimum Minimizer::minimize() const
       upar.setLimits( par->first.c_str(), par->second.lower(), par->second.upper() );
   }
 
-  MnMigrad migrad( *this, upar );
+  return upar;
+}
+
+
+void Minimizer::setProfiling( const bool& val, const bool& summary )
+{
+  _profiling = val;
+  _summary   = summary;
+
+  resetStats();
+}
+
+
+const Minimizer::Stats Minimizer::stats() const
+{
+  Stats stats( _stats );
+  stats.cache      = _cacheTime;
+  stats.components = _pdf->profile();
+
+  return stats;
+}
+
+
+void Minimizer::resetStats() const
+{
+  _stats = Stats();
+
+  // Restarts the counters of the components, if any.
+  _pdf->setProfiling( _profiling );
+}
+
+
+void Minimizer::printStats( std::ostream& os ) const
+{
+  const Stats stats = this->stats();
+
+  // Time of the fit not spent in any of the measured parts, e.g. in Minuit.
+  const double other = stats.fit - stats.update - stats.loop - stats.reduce;
+
+  os << "Minimizer: " << stats.calls << " calls, " << stats.gradients << " gradients, over "
+     << _data->size() << " events in " << threads() << " threads." << std::endl;
+
+  const std::ios::fmtflags flags = os.flags();
+  os << std::fixed << std::setprecision( 4 );
+  os << "  cache  " << std::setw( 12 ) << stats.cache  << " s" << std::endl;
+  os << "  fit    " << std::setw( 12 ) << stats.fit    << " s" << std::endl;
+  os << "  update " << std::setw( 12 ) << stats.update << " s" << std::endl;
+  os << "  loop   " << std::setw( 12 ) << stats.loop   << " s" << std::endl;
+  os << "  reduce " << std::setw( 12 ) << stats.reduce << " s" << std::endl;
+  if ( stats.fit > 0.0 )
+    os << "  other  " << std::setw( 12 ) << other        << " s" << std::endl;
+
+  for ( std::size_t comp = 0; comp < stats.components.size(); ++comp )
+    os << "  component " << comp << " " << std::setw( 12 ) << stats.components[ comp ] << " s" << std::endl;
+
+  os.flags( flags );
+}
+
+
+const std::map< std::string, std::size_t > Minimizer::memory() const
+{
+  std::map< std::string, std::size_t > bytes;
+  bytes[ "dataset"        ] = _data->memory();
+  bytes[ "dataset mapped" ] = _data->mapped();
+
+  const std::size_t size = _data->size();
+  bytes[ "cache real"    ] = _cache->valuesR.capacity() * sizeof( double );
+  bytes[ "cache complex" ] = _cache->valuesC.capacity() * sizeof( std::complex< double > );
+  bytes[ "cache single"  ] = _cache->singleVars.capacity() * sizeof( float ) +
+                             _cache->singleR   .capacity() * sizeof( float ) +
+                             _cache->singleC   .capacity() * sizeof( std::complex< float > );
+  bytes[ "cache mapped"  ] = _cache->mapping ? _cache->idxR.size() * size * sizeof( double ) +
+                                               _cache->idxC.size() * size * sizeof( std::complex< double > ) : 0;
+
+  std::size_t chunks = 0;
+  if ( _chunks )
+  {
+    typedef std::vector< Chunk >::const_iterator cIter;
+    for ( cIter chunk = _chunks->begin(); chunk != _chunks->end(); ++chunk )
+      chunks += chunk->vars      .capacity() * sizeof( double )                 +
+                chunk->valuesR   .capacity() * sizeof( double )                 +
+                chunk->valuesC   .capacity() * sizeof( std::complex< double > ) +
+                chunk->singleVars.capacity() * sizeof( float )                  +
+                chunk->singleR   .capacity() * sizeof( float )                  +
+                chunk->singleC   .capacity() * sizeof( std::complex< float > );
+  }
+  bytes[ "chunks" ] = chunks;
+
+  bytes[ "pdf arena" ] = _arena->memory();
+
+  typedef std::map< std::string, std::size_t >::const_iterator mIter;
+  const std::map< std::string, std::size_t > pdf = _pdf->memory();
+  for ( mIter entry = pdf.begin(); entry != pdf.end(); ++entry )
+    bytes[ "pdf: " + entry->first ] = entry->second;
+
+  return bytes;
+}
+
+
+FunctionMinimum Minimizer::minimize() const
+{
+  return progressive( MnUserParameterState( userParameters() ) );
+}
+
+
+FunctionMinimum Minimizer::minimize( const FunctionMinimum& start ) const
+{
+  return progressive( start.userState() );
+}
+
+
+FunctionMinimum Minimizer::progressive( const MnUserParameterState& start ) const
+{
+  MnUserParameterState state( start );
+
+  const std::vector< double >& fractions = _config.progressive();
+  for ( std::size_t stage = 0; stage < fractions.size(); ++stage )
+  {
+    if ( ! ( fractions[ stage ] > 0.0 && fractions[ stage ] < 1.0 ) )
+      continue;
+
+    const std::unique_ptr< Minimizer > sub( subsample( fractions[ stage ], _config.progressiveSeed() ) );
+    const FunctionMinimum              min = sub->fit( *sub, state );
+
+    // The covariance of the scaled subsample approximates that of the dataset.
+    if ( min.isValid() )
+      state = min.userState();
+  }
+
+  return fit( *this, state );
+}
+
+
+void Minimizer::endFit( const double& time ) const
+{
+  _stats.fit = time;
+
+  if ( _summary )
+    printStats( std::cout );
+}
+
+
+std::vector< MinosError > Minimizer::minos( const FunctionMinimum&            min  ,
+                                            const std::vector< std::string >& names ) const throw( PdfException )
+{
+  // Indices of the requested parameters, in the order of the Minuit parameters.
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  const std::map< std::string, Parameter >& pars = _pdf->getPars();
+
+  std::vector< unsigned > indices;
+  if ( names.empty() )
+  {
+    for ( pIter par = pars.begin(); par != pars.end(); ++par )
+      if ( ! par->second.isFixed() )
+        indices.push_back( std::distance( pars.begin(), par ) );
+  }
+  else
+    for ( std::vector< std::string >::const_iterator name = names.begin(); name != names.end(); ++name )
+    {
+      pIter par = pars.find( *name );
+      if ( par == pars.end() )
+        throw PdfException( "Minimizer: cannot run Minos on unknown parameter " + *name + "." );
+      indices.push_back( std::distance( pars.begin(), par ) );
+    }
+
+  // With MPI, every evaluation reduces over the processes, so the copies run
+  //    one after the other for their collectives to match on all of them.
+#ifdef MPI_ON
+  const unsigned nThread = 1;
+#else
+  const unsigned& nThreads = _config.minosThreads();
+  const unsigned  nThread  = std::min< std::size_t >( nThreads ? nThreads : std::max( 1u, std::thread::hardware_concurrency() ),
+                                                      std::max< std::size_t >( indices.size(), 1 ) );
+#endif
+
+  // Minos moves the parameters of the function, so each thread needs its own copy,
+  //    which keeps the caches already built for the data.
+  std::vector< std::unique_ptr< Minimizer > > copies;
+  for ( unsigned thread = 0; thread < nThread; ++thread )
+  {
+    copies.push_back( std::unique_ptr< Minimizer >( copy() ) );
+    if ( nThread > 1 )
+      copies.back()->setThreads( 1 );
+  }
+
+  std::mutex                        mutex;
+  std::map< unsigned, MinosError >  errors;
+  const ThreadPool::task_type task = [ & ]( const std::size_t& index, const unsigned& thread )
+  {
+    const MnMinos    minos( *copies[ thread ], min, MnStrategy( _config.strategy() ) );
+    const MinosError error = minos.minos( indices[ index ], _config.maxCalls() );
+
+    std::lock_guard< std::mutex > lock( mutex );
+    errors.insert( std::make_pair( unsigned( index ), error ) );
+  };
+
+  if ( nThread > 1 )
+    ThreadPool( nThread ).run( indices.size(), task );
+  else
+    for ( std::size_t index = 0; index < indices.size(); ++index )
+      task( index, 0 );
+
+  std::vector< MinosError > result;
+  for ( std::map< unsigned, MinosError >::const_iterator error = errors.begin(); error != errors.end(); ++error )
+    result.push_back( error->second );
+
+  return result;
+}
+
+
+std::vector< Minimizer::ScanPoint > Minimizer::scan( const std::string&           name  ,
+                                                     const std::vector< double >& values  ) const throw( PdfException )
+{
+  return scanGrid( name, values, std::string(), std::vector< double >(), MnUserParameterState( userParameters() ) );
+}
+
+
+std::vector< Minimizer::ScanPoint > Minimizer::scan( const std::string&           name  ,
+                                                     const std::vector< double >& values,
+                                                     const FunctionMinimum&       start   ) const throw( PdfException )
+{
+  return scanGrid( name, values, std::string(), std::vector< double >(), start.userState() );
+}
+
+
+std::vector< Minimizer::ScanPoint > Minimizer::scan( const std::string&           name1  ,
+                                                     const std::vector< double >& values1,
+                                                     const std::string&           name2  ,
+                                                     const std::vector< double >& values2  ) const throw( PdfException )
+{
+  return scanGrid( name1, values1, name2, values2, MnUserParameterState( userParameters() ) );
+}
+
+
+std::vector< Minimizer::ScanPoint > Minimizer::scan( const std::string&           name1  ,
+                                                     const std::vector< double >& values1,
+                                                     const std::string&           name2  ,
+                                                     const std::vector< double >& values2,
+                                                     const FunctionMinimum&       start    ) const throw( PdfException )
+{
+  return scanGrid( name1, values1, name2, values2, start.userState() );
+}
+
+
+std::vector< Minimizer::ScanPoint > Minimizer::scanGrid( const std::string&           name1  ,
+                                                         const std::vector< double >& values1,
+                                                         const std::string&           name2  ,
+                                                         const std::vector< double >& values2,
+                                                         const MnUserParameterState&  start    ) const throw( PdfException )
+{
+  std::vector< std::string > names( 1, name1 );
+  if ( ! name2.empty() )
+    names.push_back( name2 );
+
+  const std::map< std::string, Parameter >& pars = _pdf->getPars();
+  for ( std::vector< std::string >::const_iterator name = names.begin(); name != names.end(); ++name )
+    if ( ! pars.count( *name ) )
+      throw PdfException( "Minimizer: cannot scan unknown parameter " + *name + "." );
+
+  // Points of the grid, row after row. A one-dimensional scan is a single row.
+  std::vector< std::vector< double > > points;
+  for ( std::size_t point1 = 0; point1 < values1.size(); ++point1 )
+    if ( name2.empty() )
+      points.push_back( std::vector< double >( 1, values1[ point1 ] ) );
+    else
+      for ( std::size_t point2 = 0; point2 < values2.size(); ++point2 )
+      {
+        std::vector< double > point( 1, values1[ point1 ] );
+        point.push_back( values2[ point2 ] );
+        points.push_back( point );
+      }
+
+  const std::size_t nRows   = name2.empty() ? 1              : values1.size();
+  const std::size_t rowSize = name2.empty() ? values1.size() : values2.size();
+
+  // Cut each row in chains of consecutive points, which do not depend on the number of threads.
+  std::vector< std::pair< std::size_t, std::size_t > > chains;
+  for ( std::size_t row = 0; row < nRows; ++row )
+    for ( std::size_t first = row * rowSize; first < ( row + 1 ) * rowSize; first += _scanChain )
+      chains.push_back( std::make_pair( first, std::min( first + _scanChain, ( row + 1 ) * rowSize ) ) );
+
+  // With MPI, every fit reduces over the processes, so all of them must fit the
+  //    same points in the same order, one chain after the other.
+#ifdef MPI_ON
+  const unsigned nThread = 1;
+#else
+  const unsigned& nThreads = _config.scanThreads();
+  const unsigned  nThread  = std::min< std::size_t >( nThreads ? nThreads : std::max( 1u, std::thread::hardware_concurrency() ),
+                                                      std::max< std::size_t >( chains.size(), 1 ) );
+#endif
+
+  // Each thread fits with its own copy, which keeps the caches already built for the data.
+  std::vector< std::unique_ptr< Minimizer > > copies;
+  for ( unsigned thread = 0; thread < nThread; ++thread )
+  {
+    copies.push_back( std::unique_ptr< Minimizer >( copy() ) );
+    if ( nThread > 1 )
+      copies.back()->setThreads( 1 );
+  }
+
+  std::vector< ScanPoint > result( points.size() );
+  const ThreadPool::task_type task = [ & ]( const std::size_t& index, const unsigned& thread )
+  {
+    MnUserParameterState state( start );
+    for ( std::size_t point = chains[ index ].first; point < chains[ index ].second; ++point )
+    {
+      for ( std::size_t par = 0; par < names.size(); ++par )
+      {
+        state.setValue( names[ par ].c_str(), points[ point ][ par ] );
+        state.fix     ( names[ par ].c_str() );
+      }
+
+      const FunctionMinimum min = _config.minimize( *copies[ thread ], state );
+
+      ScanPoint& scanPoint = result[ point ];
+      scanPoint.point = points[ point ];
+      scanPoint.valid = min.isValid();
+      scanPoint.fval  = min.fval();
+
+      const std::vector< MinuitParameter >& minPars = min.userParameters().parameters();
+      typedef std::vector< MinuitParameter >::const_iterator mIter;
+      for ( mIter par = minPars.begin(); par != minPars.end(); ++par )
+        scanPoint.values.push_back( par->value() );
+
+      // The next point starts from this minimum.
+      state = min.userState();
+    }
+  };
+
+  if ( nThread > 1 )
+    ThreadPool( nThread ).run( chains.size(), task );
+  else
+    for ( std::size_t index = 0; index < chains.size(); ++index )
+      task( index, 0 );
+
+  return result;
+}
+
+
+std::vector< Minimizer::StartFit > Minimizer::multiStart( const std::vector< std::vector< double > >& starts ) const throw( PdfException )
+{
+  const std::size_t nPars = _pdf->nPars();
+  for ( std::size_t start = 0; start < starts.size(); ++start )
+    if ( starts[ start ].size() != nPars )
+      throw PdfException( "Minimizer: the starting points must give the values of all the parameters." );
+
+  // With MPI, every fit reduces over the processes, so the starts are fitted one
+  //    after the other for their collectives to match on all of them.
+#ifdef MPI_ON
+  const unsigned nThread = 1;
+#else
+  const unsigned& nThreads = _config.startThreads();
+  const unsigned  nThread  = std::min< std::size_t >( nThreads ? nThreads : std::max( 1u, std::thread::hardware_concurrency() ),
+                                                      std::max< std::size_t >( starts.size(), 1 ) );
+#endif
+
+  // Each thread fits with its own copy, which keeps the caches already built for the data.
+  std::vector< std::unique_ptr< Minimizer > > copies;
+  for ( unsigned thread = 0; thread < nThread; ++thread )
+  {
+    copies.push_back( std::unique_ptr< Minimizer >( copy() ) );
+    if ( nThread > 1 )
+      copies.back()->setThreads( 1 );
+  }
+
+  // State from which each start goes on, first that of its starting point.
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  const std::map< std::string, Parameter >& pars = _pdf->getPars();
+
+  std::vector< MnUserParameterState > states( starts.size(), MnUserParameterState( userParameters() ) );
+  for ( std::size_t start = 0; start < starts.size(); ++start )
+  {
+    std::size_t index = 0;
+    for ( pIter par = pars.begin(); par != pars.end(); ++par, ++index )
+      states[ start ].setValue( par->first.c_str(), starts[ start ][ index ] );
+  }
+
+  std::vector< StartFit > result( starts.size() );
+  for ( std::size_t start = 0; start < starts.size(); ++start )
+  {
+    result[ start ].start   = starts[ start ];
+    result[ start ].valid   = false;
+    result[ start ].stopped = false;
+  }
+
+  // Fit each of the given starts from its state, with the whole sequence of the
+  //    configuration or only the first stage of Migrad.
+  const auto fitStarts = [ & ]( const std::vector< std::size_t >& indices, const bool& stage )
+  {
+    const ThreadPool::task_type task = [ & ]( const std::size_t& index, const unsigned& thread )
+    {
+      const std::size_t start = indices[ index ];
+
+      const FunctionMinimum min = stage ? MnMigrad( *copies[ thread ], states[ start ], MnStrategy( _config.strategy() ) )( _config.startCalls(), _config.tolerance() )
+                                        : _config.minimize( *copies[ thread ], states[ start ] );
+
+      StartFit& fit = result[ start ];
+      fit.valid = min.isValid();
+      fit.fval  = min.fval();
+
+      fit.values.clear();
+      const std::vector< MinuitParameter >& minPars = min.userParameters().parameters();
+      typedef std::vector< MinuitParameter >::const_iterator mIter;
+      for ( mIter par = minPars.begin(); par != minPars.end(); ++par )
+        fit.values.push_back( par->value() );
+
+      states[ start ] = min.userState();
+    };
+
+    if ( nThread > 1 )
+      ThreadPool( nThread ).run( indices.size(), task );
+    else
+      for ( std::size_t index = 0; index < indices.size(); ++index )
+        task( index, 0 );
+  };
+
+  std::vector< std::size_t > indices;
+  for ( std::size_t start = 0; start < starts.size(); ++start )
+    indices.push_back( start );
+
+  if ( _config.startCalls() && ! starts.empty() )
+  {
+    fitStarts( indices, true );
+
+    // Starts whose function is not finite, e.g. NaN, do not set the best value.
+    double best = std::numeric_limits< double >::infinity();
+    for ( std::size_t start = 0; start < starts.size(); ++start )
+      if ( std::isfinite( result[ start ].fval ) )
+        best = std::min( best, result[ start ].fval );
+
+    // Only the starts close enough to the best one go on from where they stopped,
+    //    which excludes those that are not finite. If no start is finite, all go on.
+    if ( std::isfinite( best ) )
+    {
+      indices.clear();
+      for ( std::size_t start = 0; start < starts.size(); ++start )
+        if ( ! ( result[ start ].fval <= best + _config.startCut() ) )
+          result[ start ].stopped = true;
+        else
+          indices.push_back( start );
+    }
+  }
+
+  fitStarts( indices, false );
+
+  std::stable_sort( result.begin(), result.end(),
+                    []( const StartFit& left, const StartFit& right )
+                    {
+                      if ( left.stopped != right.stopped )
+                        return right.stopped;
+                      return left.fval < right.fval;
+                    } );
+
+  return result;
+}
+
+
+std::vector< Minimizer::StartFit > Minimizer::multiStart( const std::size_t& nStarts, const unsigned& seed, const double& width ) const throw( PdfException )
+{
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  const std::map< std::string, Parameter >& pars = _pdf->getPars();
+
+  std::vector< std::vector< double > > starts( nStarts );
+  for ( std::size_t start = 0; start < nStarts; ++start )
+  {
+    Random::Stream stream( seed, start );
+    for ( pIter par = pars.begin(); par != pars.end(); ++par )
+    {
+      const Parameter& parameter = par->second;
+      if ( parameter.isFixed() )
+      {
+        starts[ start ].push_back( parameter.value() );
+        continue;
+      }
+
+      const double lower = parameter.hasLimits() ? parameter.lower() : parameter.value() - width * parameter.error();
+      const double upper = parameter.hasLimits() ? parameter.upper() : parameter.value() + width * parameter.error();
+
+      starts[ start ].push_back( std::uniform_real_distribution< double >( lower, upper )( stream.engine() ) );
+    }
+  }
 
-  return migrad();
+  return multiStart( starts );
 }
 
 
@@ -2,6 +2,7 @@
 #include <iostream>
 
 #include <algorithm>
+#include <thread>
 
 #include <Minuit/MnMigrad.h>
 
@@ -26,27 +27,31 @@ double MinimizerExpr::operator()( const std::vector< double >& pars ) const thro
   if ( pars.size() != _parMap.size() )
     throw PdfException( "Number of parameters passed does not match number of required arguments." );
 
-  // Set the local values of the parameters to match them with their names.
-  //    Unfortunately, _parMap cannot be modified because this function MUST be const
-  //    (it is a minuit requirement). A non-member parMap has to be built.
-  std::map< std::string, Parameter > parMap;
-  typedef std::map< std::string, Parameter >::const_iterator pIter;
-  int index = 0;
-  for ( pIter par = _parMap.begin(); par != _parMap.end(); ++par )
-    parMap[ par->first ].setValue( pars[ index++ ] );
+  // Evaluate each minimizer with its own parameters, taken from their positions.
+  const std::size_t nMinimizers = _minimizers.size();
+  std::vector< double > values( nMinimizers, 0.0 );
 
-  // Set each minimizer's parameter vector from the just set local values of the parameters.
-  typedef std::vector< const Minimizer* >::const_iterator mIter;
-  double total = 0.;
-  for ( mIter mmzr = _minimizers.begin(); mmzr != _minimizers.end(); ++mmzr )
+  const ThreadPool::task_type task = [ & ]( const std::size_t& mmzr, const unsigned& thread )
   {
-    const std::map< std::string, Parameter >& mParMap = (*mmzr)->pdf().getPars();
-    std::vector< double > mPars;
-    for ( pIter par = mParMap.begin(); par != mParMap.end(); ++par )
-      mPars.push_back( parMap.find( par->first )->second.value() );
+    const std::vector< std::size_t >& indices = _indices[ mmzr ];
 
-    total += (**mmzr)( mPars );
-  }
+    std::vector< double > mPars( indices.size() );
+    for ( std::size_t par = 0; par < indices.size(); ++par )
+      mPars[ par ] = pars[ indices[ par ] ];
+
+    values[ mmzr ] = (*_minimizers[ mmzr ])( mPars );
+  };
+
+  if ( _pool )
+    _pool->run( nMinimizers, task );
+  else
+    for ( std::size_t mmzr = 0; mmzr < nMinimizers; ++mmzr )
+      task( mmzr, 0 );
+
+  // Add them up in the same order, whatever the number of threads.
+  double total = 0.;
+  for ( std::size_t mmzr = 0; mmzr < nMinimizers; ++mmzr )
+    total += values[ mmzr ];
 
   if ( _verbose )
     std::cout << "total = " << total << std::endl;
@@ -56,6 +61,43 @@ double MinimizerExpr::operator()( const std::vector< double >& pars ) const thro
 
 
 
+void MinimizerExpr::setThreads( const unsigned& nThreads )
+{
+  // With MPI, each minimizer reduces its value over the processes, so they are
+  //    evaluated in turn for their collectives to match on all of them.
+#ifdef MPI_ON
+  const unsigned nThread = 1;
+#else
+  const unsigned nThread = nThreads ? nThreads : std::max( 1u, std::thread::hardware_concurrency() );
+#endif
+
+  _pool.reset();
+  if ( nThread > 1 )
+    _pool = std::make_shared< ThreadPool >( nThread );
+}
+
+
+
+void MinimizerExpr::mapPars()
+{
+  _indices.clear();
+
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  typedef std::vector< const Minimizer* >::const_iterator    mIter;
+  for ( mIter mmzr = _minimizers.begin(); mmzr != _minimizers.end(); ++mmzr )
+  {
+    const std::map< std::string, Parameter >& mParMap = (*mmzr)->pdf().getPars();
+
+    std::vector< std::size_t > indices;
+    for ( pIter par = mParMap.begin(); par != mParMap.end(); ++par )
+      indices.push_back( std::distance( _parMap.begin(), _parMap.find( par->first ) ) );
+
+    _indices.push_back( indices );
+  }
+}
+
+
+
 FunctionMinimum MinimizerExpr::minimize() const
 {
   // Work with Minuit user defined parameters.
@@ -103,6 +145,8 @@ MinimizerExpr& MinimizerExpr::operator=( const Minimizer& right )
   // Append the given minimizer.
   _minimizers.push_back( right.copy() );
 
+  mapPars();
+
   return *this;
 }
 
@@ -125,6 +169,8 @@ MinimizerExpr& MinimizerExpr::operator+=( const Minimizer& right )
   // Append the given minimizer.
   _minimizers.push_back( right.copy() );
 
+  mapPars();
+
   return *this;
 }
 
@@ -145,6 +191,8 @@ MinimizerExpr& MinimizerExpr::operator+=( const MinimizerExpr& right )
   std::transform( right._minimizers.begin(), right._minimizers.end(), std::back_inserter( _minimizers ),
                   std::mem_fn( &Minimizer::copy ) );
 
+  mapPars();
+
   return *this;
 }
 
@@ -174,6 +222,8 @@ MinimizerExpr operator+( const Minimizer& left, const Minimizer& right )
   total._minimizers.push_back( left .copy() );
   total._minimizers.push_back( right.copy() );
 
+  total.mapPars();
+
   return total;
 }
 
@@ -0,0 +1,282 @@
+
+#include <algorithm>
+#include <functional>
+
+#include <cfit/models/chebyshev.hh>
+#include <cfit/math.hh>
+
+
+Chebyshev::Chebyshev( const Variable& x, const Parameter& c1 )
+  : _hasLower( false ), _hasUpper( false ), _lower( 0.0 ), _upper( 0.0 )
+{
+  push( x );
+
+  push( c1 );
+
+  _coefs.push_back( c1 );
+}
+
+
+Chebyshev::Chebyshev( const Variable& x, const Parameter& c1, const Parameter& c2 )
+  : _hasLower( false ), _hasUpper( false ), _lower( 0.0 ), _upper( 0.0 )
+{
+  push( x );
+
+  push( c1 );
+  push( c2 );
+
+  _coefs.push_back( c1 );
+  _coefs.push_back( c2 );
+}
+
+
+Chebyshev::Chebyshev( const Variable& x, const std::vector< Parameter >& coefs )
+  : _hasLower( false ), _hasUpper( false ), _lower( 0.0 ), _upper( 0.0 )
+{
+  push( x );
+
+  typedef std::vector< Parameter >::const_iterator pIter;
+  for ( pIter par = coefs.begin(); par != coefs.end(); ++par )
+    push( *par );
+
+  std::copy( coefs.begin(), coefs.end(), std::back_inserter( _coefs ) );
+}
+
+
+
+Chebyshev::Chebyshev( const Variable& x, const ParameterExpr& c1 )
+  : _hasLower( false ), _hasUpper( false ), _lower( 0.0 ), _upper( 0.0 )
+{
+  push( x );
+
+  push( c1 );
+
+  _coefs.push_back( c1 );
+}
+
+
+Chebyshev::Chebyshev( const Variable& x, const ParameterExpr& c1, const ParameterExpr& c2 )
+  : _hasLower( false ), _hasUpper( false ), _lower( 0.0 ), _upper( 0.0 )
+{
+  push( x );
+
+  push( c1 );
+  push( c2 );
+
+  _coefs.push_back( c1 );
+  _coefs.push_back( c2 );
+}
+
+
+Chebyshev::Chebyshev( const Variable& x, const std::vector< ParameterExpr >& coefs )
+  : _hasLower( false ), _hasUpper( false ), _lower( 0.0 ), _upper( 0.0 )
+{
+  push( x );
+
+  typedef std::vector< ParameterExpr >::const_iterator pIter;
+  for ( pIter par = coefs.begin(); par != coefs.end(); ++par )
+    push( *par );
+
+  _coefs = coefs;
+}
+
+
+
+Chebyshev* Chebyshev::copy() const
+{
+  return new Chebyshev( *this );
+}
+
+
+double Chebyshev::coef( const unsigned& index ) const
+{
+  return _coefs.at( index ).evaluate();
+}
+
+
+const std::vector< double > Chebyshev::series() const
+{
+  const std::size_t order = _coefs.size();
+
+  std::vector< double > coefs( order + 1, 1.0 ); // Constant term.
+  for ( std::size_t ord = 0; ord < order; ++ord )
+    coefs[ ord + 1 ] = coef( ord );
+
+  return coefs;
+}
+
+
+const std::vector< double > Chebyshev::integral() const
+{
+  const std::vector< double >& coefs = series();
+
+  std::vector< double > integ( coefs.size() + 1 );
+  Math::chebyshevIntegral( &coefs[ 0 ], coefs.size(), &integ[ 0 ] );
+
+  return integ;
+}
+
+
+void Chebyshev::setLowerLimit( const double& lower )
+{
+  _hasLower = true;
+  _lower    = lower;
+
+  // Run cache if both upper and lower limits are defined.
+  if ( _hasUpper )
+    cache();
+}
+
+
+void Chebyshev::setUpperLimit( const double& upper )
+{
+  _hasUpper = true;
+  _upper    = upper;
+
+  // Run cache if both upper and lower limits are defined.
+  if ( _hasLower )
+    cache();
+}
+
+
+void Chebyshev::setLimits( const double& lower, const double& upper )
+{
+  _hasLower = true;
+  _hasUpper = true;
+  _lower    = lower;
+  _upper    = upper;
+
+  cache();
+}
+
+
+// The integral in x is the one in t times ( upper - lower ) / 2.
+void Chebyshev::cache()
+{
+  if ( ! _hasLower || ! _hasUpper )
+    throw PdfException( "Cannot evaluate Chebyshev polynomial without upper and lower limits defined." );
+
+  const std::vector< double >& integ = integral();
+
+  _norm  = ( _upper - _lower ) / 2.0;
+  _norm *= Math::chebyshev( &integ[ 0 ], integ.size(), 1.0 ) - Math::chebyshev( &integ[ 0 ], integ.size(), -1.0 );
+}
+
+
+const double Chebyshev::evaluate( const double& x ) const throw( PdfException )
+{
+  if ( ! _hasLower || ! _hasUpper )
+    throw PdfException( "Cannot evaluate Chebyshev polynomial without upper and lower limits defined." );
+
+  if ( ( x < _lower ) || ( x > _upper ) )
+    return 0.0;
+
+  const std::vector< double >& coefs = series();
+
+  const double& t = ( 2.0 * x - _lower - _upper ) / ( _upper - _lower );
+
+  return Math::chebyshev( &coefs[ 0 ], coefs.size(), t ) / _norm;
+}
+
+
+const double Chebyshev::evaluate( const std::vector< double >& vars ) const throw( PdfException )
+{
+  return evaluate( vars[ 0 ] );
+}
+
+
+
+void Chebyshev::evaluateBlock( const std::vector< const double*                 >& vars  ,
+                               const std::vector< const double*                 >& cacheR,
+                               const std::vector< const std::complex< double >* >& cacheC,
+                               const std::size_t&                                  n     ,
+                               double*                                             out    ) const throw( PdfException )
+{
+  check( vars.size() );
+  evaluateUnchecked( vars, cacheR, cacheC, n, out );
+}
+
+
+void Chebyshev::check( const std::size_t& nVars ) const throw( PdfException )
+{
+  if ( ! _hasLower || ! _hasUpper )
+    throw PdfException( "Cannot evaluate Chebyshev polynomial without upper and lower limits defined." );
+}
+
+
+void Chebyshev::evaluateUnchecked( const std::vector< const double*                 >& vars  ,
+                                   const std::vector< const double*                 >& cacheR,
+                                   const std::vector< const std::complex< double >* >& cacheC,
+                                   const std::size_t&                                  n     ,
+                                   double*                                             out    ) const
+{
+  const double* x = vars[ 0 ];
+
+  const std::vector< double >& coefs = series();
+
+  const double invWidth = 1.0 / ( _upper - _lower );
+  const double invNorm  = 1.0 / _norm;
+
+  // Map the events onto [ -1, 1 ] and run the recurrence on all of them.
+  for ( std::size_t entry = 0; entry < n; ++entry )
+    out[ entry ] = ( 2.0 * x[ entry ] - _lower - _upper ) * invWidth;
+
+  Math::chebyshev( &coefs[ 0 ], coefs.size(), out, n, out );
+
+  for ( std::size_t entry = 0; entry < n; ++entry )
+  {
+    const bool inside = ( x[ entry ] >= _lower ) && ( x[ entry ] <= _upper );
+    out[ entry ] = inside ? out[ entry ] * invNorm : 0.0;
+  }
+}
+
+
+void Chebyshev::setParExpr()
+{
+  std::for_each( _coefs.begin(), _coefs.end(),
+                 std::bind2nd(
+                   std::mem_fun_ref( (void (ParameterExpr::*)( const std::map< std::string, Parameter >& )) &ParameterExpr::setPars ),
+                   _parMap )
+    );
+}
+
+
+const double Chebyshev::area( const double& min, const double& max ) const throw( PdfException )
+{
+  if ( ! _hasLower || ! _hasUpper )
+    throw PdfException( "Cannot evaluate Chebyshev polynomial without upper and lower limits defined." );
+
+  double retval;
+  areas( &min, &max, 1, &retval );
+
+  return retval;
+}
+
+
+void Chebyshev::areas( const double* min, const double* max, const std::size_t& n, double* out ) const throw( PdfException )
+{
+  if ( ! _hasLower || ! _hasUpper )
+    throw PdfException( "Cannot evaluate Chebyshev polynomial without upper and lower limits defined." );
+
+  const std::vector< double >& integ = integral();
+
+  const double& invWidth = 1.0 / ( _upper - _lower );
+
+  for ( std::size_t i = 0; i < n; ++i )
+  {
+    const double& xmin = std::max( min[ i ], _lower );
+    const double& xmax = std::min( max[ i ], _upper );
+
+    if ( xmax <= xmin )
+    {
+      out[ i ] = 0.0;
+      continue;
+    }
+
+    const double& tmin = ( 2.0 * xmin - _lower - _upper ) * invWidth;
+    const double& tmax = ( 2.0 * xmax - _lower - _upper ) * invWidth;
+
+    out[ i ]  = Math::chebyshev( &integ[ 0 ], integ.size(), tmax ) - Math::chebyshev( &integ[ 0 ], integ.size(), tmin );
+    out[ i ] *= ( _upper - _lower ) / ( 2.0 * _norm );
+  }
+}
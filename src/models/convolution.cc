@@ -0,0 +1,280 @@
+
+#include <algorithm>
+#include <complex>
+#include <cmath>
+
+#include <cfit/models/convolution.hh>
+#include <cfit/math.hh>
+
+
+// Averages of a pdf in size bins of the given width from start, from its
+//    areas, such that steps such as those at the limits of the pdf are
+//    sampled correctly. Some models give negative areas for bins beyond their
+//    limits, so the averages are bounded by zero. If the pdf cannot compute
+//    areas, take its values at the centres of the bins.
+static void sample( const PdfModel& pdf, const double& start, const double& step, const std::size_t& size, double* out )
+{
+  std::vector< double > lower( size );
+  std::vector< double > upper( size );
+  for ( std::size_t bin = 0; bin < size; ++bin )
+  {
+    lower[ bin ] = start + bin * step;
+    upper[ bin ] = lower[ bin ] + step;
+  }
+
+  try
+  {
+    pdf.areas( &lower[ 0 ], &upper[ 0 ], size, out );
+
+    for ( std::size_t bin = 0; bin < size; ++bin )
+      out[ bin ] = std::max( out[ bin ], 0.0 ) / step;
+  }
+  catch ( PdfException& )
+  {
+    for ( std::size_t bin = 0; bin < size; ++bin )
+      out[ bin ] = pdf.evaluate( lower[ bin ] + step / 2.0 );
+  }
+}
+
+
+Convolution::Convolution( const Variable& x, const PdfModel& pdf, const PdfModel& resolution,
+                          const double& lower, const double& upper,
+                          const unsigned& nBins, const double& padding ) throw( PdfException )
+  : _pdf( 0 ), _resolution( 0 ),
+    _lower( lower ), _upper( upper ), _nBins( nBins ), _padding( padding ),
+    _step( 0.0 ), _offset( 0 ), _norm( 1.0 )
+{
+  if ( ( pdf.nVars() != 1 ) || ( ! pdf.getVars().count( x.name() ) ) )
+    throw PdfException( "Convolution: the pdf must depend only on the variable " + x.name() + "." );
+
+  if ( resolution.nVars() != 1 )
+    throw PdfException( "Convolution: the resolution model must depend on a single variable." );
+
+  if ( ( upper <= lower ) || ( nBins == 0 ) || ( padding < 0.0 ) )
+    throw PdfException( "Convolution: the grid must have a non-empty range, some bins and a non-negative padding." );
+
+  push( x );
+
+  // The parameters of both models, which may share some of them.
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  for ( pIter par = pdf.getPars().begin(); par != pdf.getPars().end(); ++par )
+    push( par->second );
+  for ( pIter par = resolution.getPars().begin(); par != resolution.getPars().end(); ++par )
+    if ( ! _parMap.count( par->first ) )
+      push( par->second );
+
+  _pdf        = pdf       .copy();
+  _resolution = resolution.copy();
+
+  cache();
+}
+
+
+Convolution::Convolution( const Convolution& right )
+  : PdfModel( right ),
+    _pdf       ( right._pdf       ->copy() ),
+    _resolution( right._resolution->copy() ),
+    _lower     ( right._lower      ),
+    _upper     ( right._upper      ),
+    _nBins     ( right._nBins      ),
+    _padding   ( right._padding    ),
+    _step      ( right._step       ),
+    _offset    ( right._offset     ),
+    _values    ( right._values     ),
+    _integrals ( right._integrals  ),
+    _norm      ( right._norm       )
+{}
+
+
+Convolution::~Convolution()
+{
+  // Both models have been allocated by their copy() functions.
+  delete _pdf;
+  delete _resolution;
+}
+
+
+const Convolution& Convolution::operator=( const Convolution& right )
+{
+  if ( this == &right )
+    return *this;
+
+  PdfModel::operator=( right );
+
+  delete _pdf;
+  delete _resolution;
+  _pdf        = right._pdf       ->copy();
+  _resolution = right._resolution->copy();
+
+  _lower     = right._lower;
+  _upper     = right._upper;
+  _nBins     = right._nBins;
+  _padding   = right._padding;
+  _step      = right._step;
+  _offset    = right._offset;
+  _values    = right._values;
+  _integrals = right._integrals;
+  _norm      = right._norm;
+
+  return *this;
+}
+
+
+Convolution* Convolution::copy() const
+{
+  return new Convolution( *this );
+}
+
+
+void Convolution::setParExpr()
+{
+  _pdf       ->setPars( _parMap );
+  _resolution->setPars( _parMap );
+}
+
+
+void Convolution::setLimits( const double& lower, const double& upper )
+{
+  _lower = lower;
+  _upper = upper;
+
+  cache();
+}
+
+
+void Convolution::cache()
+{
+  _pdf       ->cache();
+  _resolution->cache();
+
+  _step = ( _upper - _lower ) / _nBins;
+
+  // Size of the grid, a power of 2 with at least the padding and one bin on each side.
+  const std::size_t minSize = _nBins + 2 * ( std::size_t( std::ceil( _padding * _nBins ) ) + 1 );
+
+  std::size_t size = 1;
+  while ( size < minSize )
+    size <<= 1;
+
+  _offset = ( size - _nBins ) / 2;
+
+  // Sample the pdf in the bins, and the resolution in bins centred at the
+  //    differences between their centres, in circular order.
+  std::vector< double > pdfBins( size );
+  std::vector< double > resBins( size );
+  sample( *_pdf       , _lower - _offset * _step        , _step, size, &pdfBins[ 0 ] );
+  sample( *_resolution, - ( size / 2 + 0.5 ) * _step, _step, size, &resBins[ 0 ] );
+
+  std::vector< std::complex< double > > pdf( size );
+  std::vector< std::complex< double > > res( size );
+  for ( std::size_t bin = 0; bin < size; ++bin )
+  {
+    pdf[ bin ] = pdfBins[ bin ];
+    res[ bin ] = resBins[ ( bin + size / 2 ) % size ];
+  }
+
+  Math::fft( &pdf[ 0 ], size );
+  Math::fft( &res[ 0 ], size );
+
+  for ( std::size_t bin = 0; bin < size; ++bin )
+    pdf[ bin ] *= res[ bin ];
+
+  Math::fft( &pdf[ 0 ], size, true );
+
+  // The inverse transform is not divided by the size, and the sum over the
+  //    bins approximates the integral if multiplied by their width.
+  _values   .resize( size );
+  _integrals.resize( size );
+  for ( std::size_t bin = 0; bin < size; ++bin )
+    _values[ bin ] = std::max( pdf[ bin ].real() * _step / size, 0.0 );
+
+  _integrals[ 0 ] = 0.0;
+  for ( std::size_t bin = 1; bin < size; ++bin )
+    _integrals[ bin ] = _integrals[ bin - 1 ] + ( _values[ bin - 1 ] + _values[ bin ] ) * _step / 2.0;
+
+  _norm = 1.0;
+  _norm = integral( _upper ) - integral( _lower );
+}
+
+
+const double Convolution::integral( const double& x ) const
+{
+  // Position of x in units of bins from the centre of the first one.
+  const double      pos  = ( x - _lower ) / _step + _offset - 0.5;
+  const std::size_t bin  = std::min( std::size_t( std::max( pos, 0.0 ) ), _values.size() - 2 );
+  const double      frac = pos - bin;
+
+  const double slope = _values[ bin + 1 ] - _values[ bin ];
+
+  return _integrals[ bin ] + ( _values[ bin ] + slope * frac / 2.0 ) * frac * _step;
+}
+
+
+const double Convolution::evaluate( const double& x ) const throw( PdfException )
+{
+  if ( ( x < _lower ) || ( x > _upper ) )
+    return 0.0;
+
+  const double&      pos  = ( x - _lower ) / _step + _offset - 0.5;
+  const std::size_t& bin  = std::size_t( pos );
+  const double&      frac = pos - bin;
+
+  return ( _values[ bin ] + ( _values[ bin + 1 ] - _values[ bin ] ) * frac ) / _norm;
+}
+
+
+const double Convolution::evaluate( const std::vector< double >& vars ) const throw( PdfException )
+{
+  return evaluate( vars[ 0 ] );
+}
+
+
+void Convolution::evaluateBlock( const std::vector< const double*                 >& vars  ,
+                                 const std::vector< const double*                 >& cacheR,
+                                 const std::vector< const std::complex< double >* >& cacheC,
+                                 const std::size_t&                                  n     ,
+                                 double*                                             out    ) const throw( PdfException )
+{
+  const double* x = vars[ 0 ];
+
+  const double  invStep = 1.0 / _step;
+  const double  start   = _offset - 0.5;
+  const double  invNorm = 1.0 / _norm;
+  const double* values  = &_values[ 0 ];
+
+  for ( std::size_t entry = 0; entry < n; ++entry )
+  {
+    if ( ( x[ entry ] < _lower ) || ( x[ entry ] > _upper ) )
+    {
+      out[ entry ] = 0.0;
+      continue;
+    }
+
+    const double      pos  = ( x[ entry ] - _lower ) * invStep + start;
+    const std::size_t bin  = std::size_t( pos );
+    const double      frac = pos - bin;
+
+    out[ entry ] = ( values[ bin ] + ( values[ bin + 1 ] - values[ bin ] ) * frac ) * invNorm;
+  }
+}
+
+
+const double Convolution::area( const double& min, const double& max ) const throw( PdfException )
+{
+  const double& xmin = std::max( min, _lower );
+  const double& xmax = std::min( max, _upper );
+
+  if ( xmax <= xmin )
+    return 0.0;
+
+  return ( integral( xmax ) - integral( xmin ) ) / _norm;
+}
+
+
+const std::map< std::string, std::size_t > Convolution::memory() const
+{
+  std::map< std::string, std::size_t > bytes;
+  bytes[ "convolution grid" ] = ( _values.capacity() + _integrals.capacity() ) * sizeof( double );
+
+  return bytes;
+}
@@ -1,4 +1,7 @@
 
+#include <limits>
+#include <algorithm>
+
 #include <cfit/math.hh>
 #include <cfit/models/crystalball.hh>
 
@@ -176,6 +179,15 @@ const double CrystalBall::cumulativeNorm( const double& x ) const
 
 void CrystalBall::cache()
 {
+  const double& valpha = alpha();
+
+  _vmu      = mu();
+  _scale    = ( ( valpha > 0 ) - ( valpha < 0 ) ) / sigma();
+  _absAlpha = std::fabs( valpha );
+  _vn       = n();
+  _tailA    = std::pow( _vn / _absAlpha, _vn ) * std::exp( - valpha * valpha / 2.0 );
+  _tailB    = _vn / _absAlpha - _absAlpha;
+
   // Evaluate the area up to the lower limit (0 if it's -infinity).
   double areaLo = 0.0;
   if ( _hasLower )
@@ -195,29 +207,22 @@ void CrystalBall::cache()
   }
 
   // Assign the value of the norm as the difference of areas between the upper and lower limits.
-  _norm = areaUp - areaLo;
+  _norm    = areaUp - areaLo;
+  _invNorm = 1.0 / _norm;
 }
 
 
-// Function to compute the value of the pdf at its core (Gaussian) part.
-const double CrystalBall::core( const double& chi ) const
+double CrystalBall::shape( const double& x ) const
 {
-  return std::exp( - std::pow( chi, 2 ) / 2.0 ) / _norm;
-}
-
-
-// Function to compute the value of the pdf at its tail.
-const double CrystalBall::tail( const double& chi ) const
-{
-  const double& valpha = alpha();
-  const double& vn     = n    ();
-
-  const double& alphaSq = std::pow( valpha, 2 );
+  const double chi  = ( x - _vmu ) * _scale;
+  const double core = std::exp( - chi * chi / 2.0 );
 
-  const double& term1 = std::exp( - alphaSq / 2.0 );
-  const double& term2 = std::pow( vn / ( vn - alphaSq - std::fabs( valpha ) * chi ), vn );
+  // In the core, B - chi <= n / |alpha|, so the base of the tail is clamped
+  //    there to keep it finite where it is not used.
+  const double base = std::max( _tailB - chi, _vn / _absAlpha );
+  const double tail = _tailA * std::exp( - _vn * std::log( base ) );
 
-  return term1 * term2 / _norm;
+  return ( chi < - _absAlpha ? tail : core ) * _invNorm;
 }
 
 
@@ -230,13 +235,7 @@ const double CrystalBall::evaluate( const double& x ) const throw( PdfException
   if ( _hasUpper && ( x > _upper ) )
     return 0.0;
 
-  const double& sign = ( alpha() > 0 ) - ( alpha() < 0 );
-  const double& chi  = sign * ( x - mu() ) / sigma();
-
-  if ( chi < - std::fabs( alpha() ) )
-    return tail( chi );
-
-  return core( chi );
+  return shape( x );
 }
 
 
@@ -246,6 +245,25 @@ const double CrystalBall::evaluate( const std::vector< double >& vars ) const th
 }
 
 
+void CrystalBall::evaluateBlock( const std::vector< const double*                 >& vars  ,
+                                 const std::vector< const double*                 >& cacheR,
+                                 const std::vector< const std::complex< double >* >& cacheC,
+                                 const std::size_t&                                  n     ,
+                                 double*                                             out    ) const throw( PdfException )
+{
+  const double* x = vars[ 0 ];
+
+  const double lower = _hasLower ? _lower : - std::numeric_limits< double >::infinity();
+  const double upper = _hasUpper ? _upper :   std::numeric_limits< double >::infinity();
+
+  for ( std::size_t entry = 0; entry < n; ++entry )
+  {
+    const double value = shape( x[ entry ] );
+    out[ entry ] = ( ( x[ entry ] >= lower ) && ( x[ entry ] <= upper ) ) ? value : 0.0;
+  }
+}
+
+
 void CrystalBall::setParExpr()
 {
   _mu   .setPars( _parMap );
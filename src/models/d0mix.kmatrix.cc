@@ -1,8 +1,18 @@
 
 #include <algorithm>
 #include <functional>
-
-#include <cfit/models/d0mix.hh>
+#include <thread>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <cfit/filemapping.hh>
+#include <cfit/timebasis.hh>
+
+#include <cfit/models/d0mix.kmatrix.hh>
 #include <cfit/models/d0mix/dalitzReso.hh>
 
 // Initialize the static const values.
@@ -26,7 +36,7 @@ DalitzD0mix::DalitzD0mix( const std::vector< Variable >& vars, const std::vector
   for( std::vector< Parameter >::const_iterator par = pars.begin(); par != pars.end(); ++par )
     push( *par );
 
-  _reso = new DalitzReso[ nReso ];
+  _reso.resize( nReso );
 
   // Defining resonances.
   _reso[ 0 ] = DalitzReso( 'A', 'C', 1 ); // KStarm
@@ -79,7 +89,7 @@ DalitzD0mix::DalitzD0mix( const std::vector< Variable >& vars, const std::vector
     _integralsFixed &= getPar( par ).isFixed();
 
   // Decide which amplitudes will need to be recomputed at each minuit iteration.
-  _unfixed = new bool[ nReso ];
+  _unfixed.resize( nReso );
   _unfixed[ 0 ] = getPar(  3 ).isReleased() || getPar(  4 ).isReleased();   // KStarm
   _unfixed[ 1 ] = _unfixed[ 0 ];                                            // KStarp
   _unfixed[ 2 ] = getPar(  5 ).isReleased() || getPar(  6 ).isReleased();   // Rho
@@ -95,7 +105,7 @@ DalitzD0mix::DalitzD0mix( const std::vector< Variable >& vars, const std::vector
   _unfixed[ 9 ] = getPar( 21 ).isReleased() || getPar( 22 ).isReleased();   // KStarm1680
 
   // Decide which amplitudes are the conjugate of their previous ones to avoid recomputing.
-  _conjOfPrevious = new bool[ nReso ];
+  _conjOfPrevious.resize( nReso );
   _conjOfPrevious[ 0 ] = false; // KStarm
   _conjOfPrevious[ 1 ] = true;  // KStarp
   _conjOfPrevious[ 2 ] = false; // Rho
@@ -115,24 +125,58 @@ DalitzD0mix::DalitzD0mix( const std::vector< Variable >& vars, const std::vector
     }
   */
 
-  // Allocate memory for the direct and crossed matrices.
-  _Id = new std::complex< double >*[ nReso ];
-  _Ix = new std::complex< double >*[ nReso ];
-  for ( int reso = 0; reso < nReso; reso++ )
+  // Allocate memory for the direct and crossed matrices, which are computed by
+  //    the first call to cache(), once the file to read them from may be known.
+  _Id.assign( nReso, std::vector< std::complex< double > >( nReso ) );
+  _Ix.assign( nReso, std::vector< std::complex< double > >( nReso ) );
+  _cached = false;
+}
+
+
+DalitzD0mix::DalitzD0mix( const DalitzD0mix& right )
+  : PdfModel         ( right                   ),
+    _qp              ( right._qp               ),
+    _reso            ( right._reso             ),
+    _propagatorsFixed( right._propagatorsFixed ),
+    _integralsFixed  ( right._integralsFixed   ),
+    _unfixed         ( right._unfixed          ),
+    _conjOfPrevious  ( right._conjOfPrevious   ),
+    _Id              ( right._Id               ),
+    _Ix              ( right._Ix               ),
+    _cached          ( right._cached           ),
+    _normFile        ( right._normFile         ),
+    _gridBinY        ( right._gridBinY         ),
+    _gridRow         ( right._gridRow          ),
+    _gridA           ( right._gridA            ),
+    _gridABar        ( right._gridABar         ),
+    _i1              ( right._i1               ),
+    _iChi            ( right._iChi             ),
+    _norm            ( right._norm             )
+{}
+
+
+// Fixed propagators only need the matrices once, which can then be read from
+//    the file. The integrals I_1 and I_\chi are then only computed again if
+//    the amplitudes may vary.
+void DalitzD0mix::cache()
+{
+  if ( ! _cached && _propagatorsFixed && ! _normFile.empty() )
+  {
+    const std::string key = fileKey();
+    if ( ! loadMatrices( key ) )
     {
-      _Id[ reso ] = new std::complex< double >[ nReso ];
-      _Ix[ reso ] = new std::complex< double >[ nReso ];
+      cacheIntegralsMatrix( true );
+      saveMatrices( key );
     }
+  }
+  else if ( ! _cached || ! _propagatorsFixed )
+    cacheIntegralsMatrix( ! _cached );
 
-  // If all the resonances are fixed, compute the matrices of integrals just
-  //    once here in the constructor.
-  if ( _propagatorsFixed )
-    cacheIntegralsMatrix( true );
-
-  // If all the resonances and amplitudes are fixed, compute the I_1 and I_\chi
-  //    integrals just once here in the constructor.
-  if ( _integralsFixed )
+  if ( ! _cached || ! _integralsFixed )
     cacheDalitzIntegrals();
+
+  _cached = true;
+  _norm   = norm();
 }
 
 
@@ -171,14 +215,20 @@ void DalitzD0mix::setPars( const std::vector< double >& pars ) throw( PdfExcepti
 
 
 
-double DalitzD0mix::evaluate() const throw( PdfException )
+const double DalitzD0mix::evaluate( const std::vector< double >& vars ) const throw( PdfException )
 {
-  if ( ( m2AC() < m2ACmin( m2AB() ) ) || ( m2AC() > m2ACmax( m2AB() ) ) )
+  const double& m2AB = vars[ 0 ];
+  const double& m2AC = vars[ 1 ];
+  const double& t    = vars[ 2 ];
+
+  if ( ( m2AC < m2ACmin( m2AB ) ) || ( m2AC > m2ACmax( m2AB ) ) )
     return 0.;
 
+  const double m2BC = DalitzD0mix::m2BC( m2AB, m2AC );
+
   // Dalitz amplitudes of the decay of the particle and that of the antiparticle.
-  std::complex< double > ampDalitz     = dalitzKsPiPi( m2AB(), m2AC(), m2BC() );
-  std::complex< double > ampAntiDalitz = dalitzKsPiPi( m2AC(), m2AB(), m2BC() );
+  std::complex< double > ampDalitz     = dalitzKsPiPi( m2AB, m2AC, m2BC );
+  std::complex< double > ampAntiDalitz = dalitzKsPiPi( m2AC, m2AB, m2BC );
 
   // Assume there's no direct CP violation.
   std::complex< double > barAOverA = ampAntiDalitz / ampDalitz;
@@ -188,12 +238,23 @@ double DalitzD0mix::evaluate() const throw( PdfException )
 
   // Gamma t. Notice that Gamma is not 1 / tau, since it also depends on x and y,
   //    as well as on integrals of products of amplitudes over the Dalitz plot.
-  double gt = t() / invGamma();
-
-  // Compute time dependent amplitude.
-  std::complex< double > amp = .5 * ampDalitz * ( ( 1. + chi ) * e1( gt ) + ( 1. - chi ) * e2( gt ) );
-
-  return std::norm( amp ) / _norm;
+  double gt = t / invGamma();
+
+  // < f | H | D^0 (t) > = 1/2 A_f [ ( 1 + chi_f ) e_1(gt) + ( 1 - chi_f ) e_2(gt) ], with
+  //    e_1,2(gt) = exp( - ( 1 +- y ) gt / 2 ) exp( -+ i x gt / 2 ). Its square is written in
+  //    the basis shared with Decay3BodyMix, where this x and y play the roles of y and x:
+  //    | e_2 |^2 = psip, | e_1 |^2 = psim and e_1 e_2^* = psii^*.
+  double                 psip;
+  double                 psim;
+  std::complex< double > psii;
+  TimeBasis::evaluate( gt, 1.0, y(), x(), psip, psim, psii );
+
+  double ampSq = 0.0;
+  ampSq += std::norm( 1. + chi ) * psim;
+  ampSq += std::norm( 1. - chi ) * psip;
+  ampSq += 2. * std::real( ( 1. + chi ) * std::conj( ( 1. - chi ) * psii ) );
+
+  return .25 * std::norm( ampDalitz ) * ampSq / _norm;
 }
 
 
@@ -248,11 +309,13 @@ double DalitzD0mix::norm() const
 
 
 // If requested, compute all the terms, regardless of being changed or not.
-void DalitzD0mix::cacheIntegralsMatrix( bool all ) const
+//    Otherwise only the resonances that may have varied are evaluated again
+//    at each point, and only the matrix elements that depend on them are
+//    integrated. The rows of the grid are spread over the threads, and their
+//    partial sums are added up in order at the end.
+void DalitzD0mix::cacheIntegralsMatrix( bool all )
 {
-  // Define the amplitudes that are gonna be computed at each point.
-  std::complex< double > A   [ 10 ];
-  std::complex< double > ABar[ 10 ];
+  const int nReso = 10;
 
   // Define the properties of the integration method.
   int    nBins = 300;
@@ -260,81 +323,232 @@ void DalitzD0mix::cacheIntegralsMatrix( bool all ) const
   double max   = pow( mD0() - mPi(), 2 );
   double step  = ( max - min ) / double( nBins );
 
-  // Define the variables at each bin.
-  double m2AB;
-  double m2AC;
-  double m2BC;
+  // Find the points that lie inside the kinematically allowed Dalitz region
+  //    the first time, when all the resonances must be evaluated.
+  if ( _gridRow.empty() )
+    {
+      all = true;
 
-  // Initialize the matrix elements that need to be recomputed.
-  for ( int i = 0; i < 10; i++ )
-    for ( int j = i; j < 10; j++ )
-      if ( all || _unfixed[ i ] || _unfixed[ j ] )
+      for ( int binX = 0; binX < nBins; binX++ )
 	{
-	  _Id[ i ][ j ] = std::complex< double >();
-	  _Ix[ i ][ j ] = std::complex< double >();
+	  _gridRow.push_back( _gridBinY.size() );
+
+	  double m2AB = min + step * ( binX + .5 );
+	  for ( int binY = binX; binY < nBins; binY++ )
+	    {
+	      double m2AC = min + step * ( binY + .5 );
+	      if ( ( m2AC > m2ACmin( m2AB ) ) && ( m2AC < m2ACmax( m2AB ) ) )
+		_gridBinY.push_back( binY );
+	    }
 	}
+      _gridRow.push_back( _gridBinY.size() );
 
-  // Compute the integral on the grid.
-  for ( int binX = 0; binX < nBins; binX++ )
-    for ( int binY = binX; binY < nBins; binY++ )
-      {
-	m2AB = min + step * ( binX + .5 );
-	m2AC = min + step * ( binY + .5 );
-	m2BC = pow( mD0(), 2 ) + pow( mKs(), 2 ) + 2. * pow( mPi(), 2 ) - m2AB - m2AC;
+      _gridA   .resize( _gridBinY.size() * nReso );
+      _gridABar.resize( _gridBinY.size() * nReso );
+    }
 
-	// Proceed only if the point lies inside the kinematically allowed Dalitz region.
-	if ( ( m2AC > m2ACmin( m2AB ) ) && ( m2AC < m2ACmax( m2AB ) ) )
-	  {
-	    // Compute the resonances that may have varied.
-	    for ( int reso = 0; reso < 10; reso++ )
-	      if ( _conjOfPrevious[ reso ] )
-		{
-		  A   [ reso ] = ABar[ reso - 1 ];
-		  ABar[ reso ] = A   [ reso - 1 ];
-		}
-	      else
-		{
-		  A   [ reso ] = evaluateReso( reso, m2AB, m2AC, m2BC );
-		  ABar[ reso ] = evaluateReso( reso, m2AC, m2AB, m2BC );
-		}
-
-	    // Add the terms to the matrices.
-	    for ( int i = 0; i < 10; i++ )
-	      for ( int j = i; j < 10; j++ )
-		if ( all || _unfixed[ i ] || _unfixed[ j ] )
-		  {
-		    if ( binX == binY )
-		      {
-			_Id[ i ][ j ] += ( conj( A[ i ] ) * A   [ j ] + conj( ABar[ i ] ) * ABar[ j ] ) / 2.;
-			_Ix[ i ][ j ] += ( conj( A[ i ] ) * ABar[ j ] + conj( ABar[ i ] ) * A   [ j ] ) / 2.;
-		      }
-		    else
-		      {
-			_Id[ i ][ j ] +=   conj( A[ i ] ) * A   [ j ] + conj( ABar[ i ] ) * ABar[ j ];
-			_Ix[ i ][ j ] +=   conj( A[ i ] ) * ABar[ j ] + conj( ABar[ i ] ) * A   [ j ];
-		      }
-		  }
-	  }
-      }
+  // Resonances to evaluate again, and matrix elements of the upper triangle to recompute.
+  std::vector< int > resos;
+  for ( int reso = 0; reso < nReso; reso++ )
+    if ( all || _unfixed[ reso ] )
+      resos.push_back( reso );
 
-  // Finish the computation of the integrals and compute the lower triangle elements.
-  for ( int i = 0; i < 10; i++ )
-    for ( int j = i; j < 10; j++ )
-      {
-	_Id[ i ][ j ] *= pow( step, 2 );
-	_Ix[ i ][ j ] *= pow( step, 2 );
+  std::vector< std::pair< int, int > > elems;
+  for ( int i = 0; i < nReso; i++ )
+    for ( int j = i; j < nReso; j++ )
+      if ( all || _unfixed[ i ] || _unfixed[ j ] )
+	elems.push_back( std::make_pair( i, j ) );
+
+  if ( elems.empty() )
+    return;
+
+  const std::size_t nElems = elems.size();
 
-	if ( i != j )
+  // Partial sums of each row, the direct ones followed by the crossed ones.
+  std::vector< std::complex< double > > sums( nBins * 2 * nElems );
+
+  const ThreadPool::task_type task = [ & ]( const std::size_t& binX, const unsigned& thread )
+  {
+    std::complex< double >* sumId = sums.data() + binX * 2 * nElems;
+    std::complex< double >* sumIx = sumId + nElems;
+
+    double m2AB = min + step * ( binX + .5 );
+
+    for ( std::size_t point = _gridRow[ binX ]; point < _gridRow[ binX + 1 ]; point++ )
+      {
+	int    binY = _gridBinY[ point ];
+	double m2AC = min + step * ( binY + .5 );
+	double m2BC = pow( mD0(), 2 ) + pow( mKs(), 2 ) + 2. * pow( mPi(), 2 ) - m2AB - m2AC;
+
+	std::complex< double >* A    = _gridA   .data() + point * nReso;
+	std::complex< double >* ABar = _gridABar.data() + point * nReso;
+
+	// Compute the resonances that may have varied.
+	for ( std::vector< int >::const_iterator reso = resos.begin(); reso != resos.end(); ++reso )
+	  if ( _conjOfPrevious[ *reso ] )
+	    {
+	      A   [ *reso ] = ABar[ *reso - 1 ];
+	      ABar[ *reso ] = A   [ *reso - 1 ];
+	    }
+	  else
+	    {
+	      A   [ *reso ] = evaluateReso( *reso, m2AB, m2AC, m2BC );
+	      ABar[ *reso ] = evaluateReso( *reso, m2AC, m2AB, m2BC );
+	    }
+
+	// Points on the diagonal only count half.
+	double weight = ( int( binX ) == binY ) ? .5 : 1.;
+
+	// Add the terms to the matrices.
+	for ( std::size_t elem = 0; elem < nElems; elem++ )
 	  {
-	    _Id[ j ][ i ] = conj( _Id[ i ][ j ] );
-	    _Ix[ j ][ i ] = conj( _Ix[ i ][ j ] );
+	    int i = elems[ elem ].first;
+	    int j = elems[ elem ].second;
+
+	    sumId[ elem ] += weight * ( conj( A[ i ] ) * A   [ j ] + conj( ABar[ i ] ) * ABar[ j ] );
+	    sumIx[ elem ] += weight * ( conj( A[ i ] ) * ABar[ j ] + conj( ABar[ i ] ) * A   [ j ] );
 	  }
       }
+  };
+
+  // Fixed propagators are only integrated once, by threads that are not kept.
+  const unsigned nThread = std::max( 1u, std::thread::hardware_concurrency() );
+  if ( ! _pool && ! _propagatorsFixed && ( nThread > 1 ) )
+    _pool.reset( new ThreadPool( nThread ) );
+
+  if ( _pool )
+    _pool->run( nBins, task );
+  else if ( nThread > 1 )
+    ThreadPool( nThread ).run( nBins, task );
+  else
+    for ( int binX = 0; binX < nBins; binX++ )
+      task( binX, 0 );
+
+  // Add up the rows, finish the computation of the integrals and compute the lower triangle elements.
+  for ( std::size_t elem = 0; elem < nElems; elem++ )
+    {
+      int i = elems[ elem ].first;
+      int j = elems[ elem ].second;
+
+      _Id[ i ][ j ] = std::complex< double >();
+      _Ix[ i ][ j ] = std::complex< double >();
+      for ( int binX = 0; binX < nBins; binX++ )
+	{
+	  _Id[ i ][ j ] += sums[ binX * 2 * nElems          + elem ];
+	  _Ix[ i ][ j ] += sums[ binX * 2 * nElems + nElems + elem ];
+	}
+
+      _Id[ i ][ j ] *= pow( step, 2 );
+      _Ix[ i ][ j ] *= pow( step, 2 );
+
+      if ( i != j )
+	{
+	  _Id[ j ][ i ] = conj( _Id[ i ][ j ] );
+	  _Ix[ j ][ i ] = conj( _Ix[ i ][ j ] );
+	}
+    }
 
   return;
 }
 
 
+// Header of the file of matrices, followed by the key and by the elements of
+//    Id and then of Ix, row by row, in native byte order.
+struct D0mixFileHeader
+{
+  char     magic[ 8 ];
+  uint64_t keySize;
+  uint64_t nReso;
+};
+
+static const char d0mixFileMagic[ 8 ] = { 'C', 'F', 'I', 'T', 'D', '0', 'M', 'X' };
+
+
+const std::string DalitzD0mix::fileKey() const
+{
+  std::ostringstream key;
+  key.precision( 17 );
+  key << "DalitzD0mix masses " << mD0() << " " << mKs() << " " << mPi() << " bins 300 propagators";
+  for ( int par = 3; par < 23; par++ )
+    key << " " << getPar( par ).value();
+
+  return key.str();
+}
+
+
+bool DalitzD0mix::loadMatrices( const std::string& key )
+{
+  std::size_t                   size;
+  std::shared_ptr< const void > mapping;
+  try
+  {
+    mapping = FileMapping::map( _normFile, size );
+  }
+  catch ( DataException& )
+  {
+    return false;
+  }
+
+  const std::size_t nReso = _Id.size();
+  const std::size_t bytes = sizeof( D0mixFileHeader ) + key.size() + 2 * nReso * nReso * sizeof( std::complex< double > );
+  if ( size != bytes )
+    return false;
+
+  const char*            data   = static_cast< const char* >( mapping.get() );
+  const D0mixFileHeader& header = *reinterpret_cast< const D0mixFileHeader* >( data );
+  if ( std::memcmp( header.magic, d0mixFileMagic, sizeof( d0mixFileMagic ) ) ||
+       ( header.keySize != key.size() ) || ( header.nReso != nReso ) ||
+       key.compare( 0, key.size(), data + sizeof( D0mixFileHeader ), key.size() ) )
+    return false;
+
+  const std::complex< double >* elems = reinterpret_cast< const std::complex< double >* >( data + sizeof( D0mixFileHeader ) + key.size() );
+  for ( std::size_t row = 0; row < nReso; row++ )
+    _Id[ row ].assign( elems + row * nReso, elems + ( row + 1 ) * nReso );
+  elems += nReso * nReso;
+  for ( std::size_t row = 0; row < nReso; row++ )
+    _Ix[ row ].assign( elems + row * nReso, elems + ( row + 1 ) * nReso );
+
+  return true;
+}
+
+
+// As for NormGrid, the file is written to a temporary one that is then renamed,
+//    and failing to write it only means that the next job computes the matrices.
+void DalitzD0mix::saveMatrices( const std::string& key ) const
+{
+  std::ostringstream temp;
+  temp << _normFile << ".tmp" << getpid();
+
+  D0mixFileHeader header;
+  std::memcpy( header.magic, d0mixFileMagic, sizeof( d0mixFileMagic ) );
+  header.keySize = key.size();
+  header.nReso   = _Id.size();
+
+  {
+    std::ofstream out( temp.str().c_str(), std::ios::binary | std::ios::trunc );
+    if ( ! out )
+      return;
+
+    const std::size_t bytes = _Id.size() * sizeof( std::complex< double > );
+    out.write( reinterpret_cast< const char* >( &header ), sizeof( header ) );
+    out.write( key.data(), key.size() );
+    for ( std::size_t row = 0; row < _Id.size(); row++ )
+      out.write( reinterpret_cast< const char* >( _Id[ row ].data() ), bytes );
+    for ( std::size_t row = 0; row < _Ix.size(); row++ )
+      out.write( reinterpret_cast< const char* >( _Ix[ row ].data() ), bytes );
+    if ( ! out )
+    {
+      out.close();
+      std::remove( temp.str().c_str() );
+      return;
+    }
+  }
+
+  if ( std::rename( temp.str().c_str(), _normFile.c_str() ) )
+    std::remove( temp.str().c_str() );
+}
+
+
 // Compute _i1 and _iChi after the matrix elements have been cached.
 void DalitzD0mix::cacheDalitzIntegrals()
 {
@@ -459,25 +673,3 @@ std::complex< double > DalitzD0mix::dalitzKsPiPi( double m2AB, double m2AC, doub
 
   return amp;
 }
-
-// < f | H | D^0 (t) > = 1/2 * [ ( 1 + \chi_f ) * A_f * e_1(gt) + ( 1 - \chi_f ) * A_f * e_2(gt) ]
-std::complex< double > DalitzD0mix::e1( const double& gt ) const
-{
-  double real = exp ( - ( 1. + y() ) * gt / 2. ) * cos(   x() * gt / 2. );
-  double imag = exp ( - ( 1. + y() ) * gt / 2. ) * sin( - x() * gt / 2. );
-
-  return std::complex< double >( real, imag );
-}
-
-std::complex< double > DalitzD0mix::e2( const double& gt ) const
-{
-  double real = exp ( - ( 1. - y() ) * gt / 2. ) * cos( x() * gt / 2. );
-  double imag = exp ( - ( 1. - y() ) * gt / 2. ) * sin( x() * gt / 2. );
-
-  return std::complex< double >( real, imag );
-}
-
-double DalitzD0mix::evaluate( const std::vector< double >& vars ) const throw( PdfException )
-{
-  return 0.;
-}
@@ -1,4 +1,7 @@
 
+#include <vector>
+#include <algorithm>
+
 #include <cfit/models/decay3body.hh>
 #include <cfit/function.hh>
 #include <cfit/random.hh>
@@ -8,11 +11,10 @@ Decay3Body::Decay3Body( const Variable&   mSq12,
 			const Variable&   mSq23,
 			const Amplitude&  amp  ,
 			const PhaseSpace& ps     )
-  : DecayModel( mSq12, mSq13, mSq23, amp, ps ), _norm( 1.0 ), _maxPdf( 14.0 )
+  : DecayModel( mSq12, mSq13, mSq23, amp, ps ), _norm( 1.0 ), _stale( true ), _maxPdf( 14.0 ), _autoMax( true ), _cacheKin( false ), _kinCache( 0 )
 {
-  // Do calculations common to all values of variables
-  //    (usually compute norm).
-  cache();
+  // Without MPI, the norm is only computed when it is first needed.
+  staleNorm();
 }
 
 
@@ -22,70 +24,55 @@ Decay3Body* Decay3Body::copy() const
 }
 
 
-
-const double Decay3Body::evaluateFuncs( const double& mSq12, const double& mSq13, const double& mSq23 ) const
+const std::map< std::string, std::size_t > Decay3Body::memory() const
 {
-  double value = 1.0;
-
-  const std::string& name12 = getVar( 0 ).name(); // mSq12
-  const std::string& name13 = getVar( 1 ).name(); // mSq13
-  const std::string& name23 = getVar( 2 ).name(); // mSq23
-
-  typedef std::vector< Function >::const_iterator fIter;
-
-  std::map< std::string, double > varMap;
-  for ( fIter func = _funcs.begin(); func != _funcs.end(); ++func )
-  {
-    if ( func->dependsOn( name12 ) ) varMap[ name12 ] = mSq12;
-    if ( func->dependsOn( name13 ) ) varMap[ name13 ] = mSq13;
-    if ( func->dependsOn( name23 ) ) varMap[ name23 ] = mSq23;
+  std::map< std::string, std::size_t > bytes = DecayModel< Amplitude >::memory();
+  bytes[ "envelope" ] = _envelope ? _envelope->memory() : 0;
 
-    value *= func->evaluate( varMap );
-  }
-
-  // Always return a non-negative value. Default to zero.
-  return std::max( value, 0.0 );
+  return bytes;
 }
 
 
 
 void Decay3Body::cache()
 {
-  // Compute the value of _norm.
-  _norm = 0.0;
+  // Compute the value of _norm, only evaluating again the parts of the amplitude
+  //    and the efficiency that have changed.
+  updateNorm();
+  _norm  = _normGrid.dir();
+  _stale.clear();
 
-  // Define the properties of the integration method.
-  const int    nBins = 400;
-  const double min   = _ps.mSq12min();
-  const double max   = _ps.mSq12max();
-  const double step  = ( max - min ) / double( nBins );
+  // The envelope of the pdf is only needed to generate events.
+  _envelope.reset();
 
-  const double mSqSum = _ps.mSqSum();
+  return;
+}
 
-  // Define the variables at each bin.
-  double mSq12;
-  double mSq13;
-  double mSq23;
 
-  // Compute the integral on the grid.
-  for ( int binX = 0; binX < nBins; ++binX )
-    for ( int binY = 0; binY < nBins; ++binY )
-    {
-      mSq12 = min + step * ( binX + 0.5 );
-      mSq13 = min + step * ( binY + 0.5 );
-      mSq23 = mSqSum - mSq12 - mSq13;
 
-      // Proceed only if the point lies inside the kinematically allowed Dalitz region.
-      // std::norm returns the squared modulus of the complex number, not its norm.
-      if ( _ps.contains( mSq12, mSq13, mSq23 ) )
-        _norm += std::norm( _amp.evaluate( _ps, mSq12, mSq13, mSq23 ) ) * evaluateFuncs( mSq12, mSq13, mSq23 );
-    }
+void Decay3Body::staleNorm()
+{
+#ifdef MPI_ON
+  cache();
+#else
+  _stale.set();
+#endif
+}
 
-  _norm *= std::pow( step, 2 );
 
-  return;
-}
+// The norm is computed at the first evaluation if no minimizer has updated the
+//    pdf before. Only one of the threads that evaluate it then computes it.
+const double& Decay3Body::norm() const
+{
+  if ( _stale.test() )
+  {
+    std::lock_guard< std::mutex > guard( _normLock );
+    if ( _stale.test() )
+      const_cast< Decay3Body* >( this )->cache();
+  }
 
+  return _norm;
+}
 
 
 const double Decay3Body::evaluate( const double& mSq12, const double& mSq13, const double& mSq23 ) const throw( PdfException )
@@ -94,7 +81,7 @@ const double Decay3Body::evaluate( const double& mSq12, const double& mSq13, con
   std::complex< double > amp = _amp.evaluate( _ps, mSq12, mSq13, mSq23 );
 
   // std::norm returns the squared modulus of the complex number, not its norm.
-  return std::norm( amp ) * evaluateFuncs( mSq12, mSq13, mSq23 ) / _norm;
+  return std::norm( amp ) * evaluateFuncs( mSq12, mSq13, mSq23 ) / norm();
 }
 
 
@@ -106,43 +93,141 @@ const double Decay3Body::evaluate( const double& mSq12, const double& mSq13 ) co
   std::complex< double > amp = _amp.evaluate( _ps, mSq12, mSq13, mSq23 );
 
   // std::norm returns the squared modulus of the complex number, not its norm.
-  return std::norm( amp ) * evaluateFuncs( mSq12, mSq13, mSq23 ) / _norm;
+  return std::norm( amp ) * evaluateFuncs( mSq12, mSq13, mSq23 ) / norm();
 }
 
 
-const double Decay3Body::project( const std::string& varName, const double& x ) const throw( PdfException )
+// The efficiency of the events only needs to be computed once if it is fixed,
+//    and the kinematics of the resonances always.
+const std::map< unsigned, std::vector< double > > Decay3Body::cacheReal( const Dataset& data )
+{
+  std::map< unsigned, std::vector< double > > cached = cacheFuncs( data );
+
+  const std::size_t nKin = _amp.nKinematics();
+  const std::size_t size = data.size();
+
+  std::vector< double* > kin( nKin );
+  for ( std::size_t column = 0; column < nKin; ++column )
+  {
+    const unsigned index = nextCacheIdxReal();
+    if ( column == 0 )
+      _kinCache = index;
+
+    cached[ index ].resize( size );
+    kin[ column ] = cached[ index ].data();
+  }
+
+  _cacheKin = ( nKin != 0 );
+  if ( _cacheKin )
+    _amp.kinematics( _ps,
+                     data.valueColumn( data.column( mSq12name() ) ),
+                     data.valueColumn( data.column( mSq13name() ) ),
+                     data.valueColumn( data.column( mSq23name() ) ), size, kin.data() );
+
+  return cached;
+}
+
+
+int Decay3Body::varIndex( const std::string& varName ) const
 {
-  // Find the index of the variable to be projected.
-  int index = -1;
   for ( unsigned var = 0; var < 3; ++var )
     if ( varName == getVar( var ).name() )
-      index = var;
+      return var;
+
+  return -1;
+}
+
+
+void Decay3Body::evaluatePdf( const double* mSq12, const double* mSq13, const double* mSq23,
+                              const std::size_t& n, double* out, const bool& atNormPoints ) const throw( PdfException )
+{
+  std::vector< std::complex< double > > amps( n );
+  _amp.evaluate( _ps, mSq12, mSq13, mSq23, n, amps.data() );
+
+  if ( atNormPoints )
+    evaluateNormFuncs( mSq12, mSq13, mSq23, n, out );
+  else
+    evaluateFuncs(     mSq12, mSq13, mSq23, n, out );
+
+  // std::norm returns the squared modulus of the complex number, not its norm.
+  const double& pdfNorm = norm();
+  for ( std::size_t point = 0; point < n; ++point )
+    out[ point ] *= std::norm( amps[ point ] ) / pdfNorm;
+}
+
 
+const double Decay3Body::project( const std::string& varName, const double& x ) const throw( PdfException )
+{
+  double proj;
+  projectBlock( varName, &x, 1, &proj );
+
+  return proj;
+}
+
+
+void Decay3Body::projectBlock( const std::string& varName,
+                               const double*      values ,
+                               const std::size_t& n      ,
+                               double*            out      ) const throw( PdfException )
+{
   // If the pdf does not depend on the passed variable name, the projection is 1.
+  const int index = varIndex( varName );
   if ( index == -1 )
-    return 1.0;
+  {
+    std::fill( out, out + n, 1.0 );
+    return;
+  }
 
-  // Minimum and maximum values of the variable wrt which the integration,
-  //    is done i.e. the next to the projected variable.
-  const double& min = _ps.mSqMin( ( index + 1 ) % 3 );
-  const double& max = _ps.mSqMax( ( index + 1 ) % 3 );
+  const DalitzIntegrator::integrand_type integrand =
+    [ this ]( const double* mSq12, const double* mSq13, const double* mSq23, const std::size_t& n, double* out )
+    { evaluatePdf( mSq12, mSq13, mSq23, n, out ); };
 
-  // Integrate the model.
-  const int& nbins = 400;
-  double proj = 0.0;
-  for ( int yBin = 0; yBin < nbins; ++yBin )
-  {
-    double y = binCenter( yBin, nbins, min, max );
-    double z = _ps.mSqSum() - x - y;
+  _normGrid.integrator().project( index, values, n, integrand, out );
+}
 
-    if ( index == 0 ) proj += evaluate( x, y, z );
-    if ( index == 1 ) proj += evaluate( z, x, y );
-    if ( index == 2 ) proj += evaluate( y, z, x );
+
+void Decay3Body::projectHist( const std::string& varName,
+                              const double&      min    ,
+                              const double&      max    ,
+                              const unsigned&    nBins  ,
+                              double*            out      ) const throw( PdfException )
+{
+  const int index = varIndex( varName );
+  if ( index == -1 )
+  {
+    std::fill( out, out + nBins, 1.0 );
+    return;
   }
 
-  proj *= ( max - min ) / double( nbins );
+  const DalitzIntegrator::integrand_type integrand =
+    [ this ]( const double* mSq12, const double* mSq13, const double* mSq23, const std::size_t& n, double* out )
+    { evaluatePdf( mSq12, mSq13, mSq23, n, out, true ); };
 
-  return proj;
+  _normGrid.integrator().histogram( *_normGrid.points(), integrand, index, min, max, nBins, out );
+}
+
+
+void Decay3Body::projectHist( const std::string& var1  ,
+                              const double&      min1  ,
+                              const double&      max1  ,
+                              const unsigned&    nBins1,
+                              const std::string& var2  ,
+                              const double&      min2  ,
+                              const double&      max2  ,
+                              const unsigned&    nBins2,
+                              double*            out     ) const throw( PdfException )
+{
+  const int index1 = varIndex( var1 );
+  const int index2 = varIndex( var2 );
+  if ( ( index1 == -1 ) || ( index2 == -1 ) )
+    return PdfBase::projectHist( var1, min1, max1, nBins1, var2, min2, max2, nBins2, out );
+
+  const DalitzIntegrator::integrand_type integrand =
+    [ this ]( const double* mSq12, const double* mSq13, const double* mSq23, const std::size_t& n, double* out )
+    { evaluatePdf( mSq12, mSq13, mSq23, n, out, true ); };
+
+  _normGrid.integrator().histogram( *_normGrid.points(), integrand,
+                                    index1, min1, max1, nBins1, index2, min2, max2, nBins2, out );
 }
 
 
@@ -160,6 +245,199 @@ const double Decay3Body::evaluate( const std::vector< double >& vars ) const thr
 }
 
 
+void Decay3Body::evaluateBlock( const std::vector< const double*                 >& vars  ,
+                               const std::vector< const double*                 >& cacheR,
+                               const std::vector< const std::complex< double >* >& cacheC,
+                               const std::size_t&                                  n     ,
+                               double*                                             out    ) const throw( PdfException )
+{
+  check( vars.size() );
+  evaluateUnchecked( vars, cacheR, cacheC, n, out );
+}
+
+
+void Decay3Body::check( const std::size_t& nVars ) const throw( PdfException )
+{
+  if ( ( nVars != 2 ) && ( nVars != 3 ) )
+    throw PdfException( "Decay3Body can only take either 2 or 3 arguments." );
+}
+
+
+void Decay3Body::evaluateUnchecked( const std::vector< const double*                 >& vars  ,
+                                   const std::vector< const double*                 >& cacheR,
+                                   const std::vector< const std::complex< double >* >& cacheC,
+                                   const std::size_t&                                  n     ,
+                                   double*                                             out    ) const
+{
+  evaluateShape( vars, cacheR, cacheC, n, out );
+
+  const double invNorm = 1. / norm();
+  for ( std::size_t entry = 0; entry < n; ++entry )
+    out[ entry ] *= invNorm;
+}
+
+
+void Decay3Body::evaluateShape( const std::vector< const double*                 >& vars  ,
+                                const std::vector< const double*                 >& cacheR,
+                                const std::vector< const std::complex< double >* >& cacheC,
+                                const std::size_t&                                  n     ,
+                                double*                                             out    ) const
+{
+  const std::size_t& size = vars.size();
+
+  const double* mSq12 = vars[ 0 ];
+  const double* mSq13 = vars[ 1 ];
+
+  std::vector< double > mSq23( n );
+  if ( size == 3 )
+    std::copy( vars[ 2 ], vars[ 2 ] + n, mSq23.begin() );
+  else
+    for ( std::size_t entry = 0; entry < n; ++entry )
+      mSq23[ entry ] = _ps.mSqSum() - mSq12[ entry ] - mSq13[ entry ];
+
+  // Take the kinematics of the resonances from the cache, if they are there.
+  const std::size_t nKin   = _amp.nKinematics();
+  const bool        useKin = _cacheKin && ( cacheR.size() >= _kinCache + nKin ) && cacheR[ _kinCache ];
+
+  std::vector< const double* > kin( useKin ? nKin : 0 );
+  for ( std::size_t column = 0; column < kin.size(); ++column )
+    kin[ column ] = cacheR[ _kinCache + column ];
+
+  std::vector< std::complex< double > > amps( n );
+  _amp.evaluate( _ps, mSq12, mSq13, mSq23.data(), useKin ? kin.data() : 0, n, amps.data() );
+
+  // Evaluate the efficiency functions, unless they are cached.
+  if ( _cacheFuncs )
+    std::copy( cacheR[ _funcsCache ], cacheR[ _funcsCache ] + n, out );
+  else
+    evaluateFuncs( mSq12, mSq13, mSq23.data(), n, out );
+
+  // std::norm returns the squared modulus of the complex number, not its norm.
+  for ( std::size_t entry = 0; entry < n; ++entry )
+    out[ entry ] *= std::norm( amps[ entry ] );
+}
+
+
+// The pdf can be differentiated with respect to the parameters that only enter
+//    the amplitude through its coefficients, as long as the efficiency does not
+//    depend on them.
+bool Decay3Body::hasGradient( const std::string& par ) const
+{
+  const std::vector< std::string >& ampPars = _amp.gradientPars();
+  if ( ! std::binary_search( ampPars.begin(), ampPars.end(), par ) )
+    return false;
+
+  typedef std::vector< Function >::const_iterator fIter;
+  for ( fIter func = _funcs.begin(); func != _funcs.end(); ++func )
+    if ( func->getParMap().count( par ) )
+      return false;
+
+  return true;
+}
+
+
+void Decay3Body::cacheGradient() throw( PdfException )
+{
+  const std::vector< std::string >& ampPars = _amp.gradientPars();
+  const std::size_t                 nGrad   = ampPars.size();
+
+  _gradIdx.clear();
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  for ( pIter par = _parMap.begin(); par != _parMap.end(); ++par )
+  {
+    std::vector< std::string >::const_iterator pos = std::lower_bound( ampPars.begin(), ampPars.end(), par->first );
+    _gradIdx.push_back( ( pos != ampPars.end() && *pos == par->first ) ? int( pos - ampPars.begin() ) : -1 );
+  }
+
+  // Integrate the derivatives of the squared amplitude on the same grid as cache().
+  const DalitzIntegrator::integrand_type integrand =
+    [ this, nGrad ]( const double* mSq12, const double* mSq13, const double* mSq23, const std::size_t& n, double* out )
+    {
+      std::vector< double >                 effs( n );
+      std::vector< std::complex< double > > amps( n );
+
+      std::vector< std::complex< double > >  derivs( nGrad * n );
+      std::vector< std::complex< double >* > grad  ( nGrad );
+      for ( std::size_t par = 0; par < nGrad; ++par )
+        grad[ par ] = derivs.data() + par * n;
+
+      _amp.evaluateGradient( _ps, mSq12, mSq13, mSq23, n, amps.data(), grad );
+      evaluateNormFuncs(        mSq12, mSq13, mSq23, n, effs.data() );
+
+      for ( std::size_t par = 0; par < nGrad; ++par )
+        for ( std::size_t point = 0; point < n; ++point )
+          out[ par * n + point ] = 2.0 * std::real( std::conj( amps[ point ] ) * grad[ par ][ point ] ) * effs[ point ];
+    };
+
+  _normGrad.assign( nGrad, 0.0 );
+  if ( nGrad )
+    _normGrid.integrator().integrate( *_normGrid.points(), integrand, nGrad, _normGrad.data() );
+}
+
+
+void Decay3Body::evaluateGradient( const std::vector< const double*                 >& vars  ,
+                                   const std::vector< const double*                 >& cacheR,
+                                   const std::vector< const std::complex< double >* >& cacheC,
+                                   const std::size_t&                                  n     ,
+                                   double*                                             out   ,
+                                   const std::vector< double*                       >& grad   ) const throw( PdfException )
+{
+  const std::size_t& size = vars.size();
+
+  if ( ( size != 2 ) && ( size != 3 ) )
+    throw PdfException( "Decay3Body can only take either 2 or 3 arguments." );
+
+  if ( _gradIdx.size() != grad.size() )
+    throw PdfException( "Decay3Body::evaluateGradient: cacheGradient must be called first." );
+
+  const double* mSq12 = vars[ 0 ];
+  const double* mSq13 = vars[ 1 ];
+
+  std::vector< double > mSq23( n );
+  if ( size == 3 )
+    std::copy( vars[ 2 ], vars[ 2 ] + n, mSq23.begin() );
+  else
+    for ( std::size_t entry = 0; entry < n; ++entry )
+      mSq23[ entry ] = _ps.mSqSum() - mSq12[ entry ] - mSq13[ entry ];
+
+  const std::size_t nGrad = _normGrad.size();
+
+  std::vector< double >                  effs  ( n );
+  std::vector< std::complex< double > >  amps  ( n );
+  std::vector< std::complex< double > >  derivs( nGrad * n );
+  std::vector< std::complex< double >* > ampGrad( nGrad );
+  for ( std::size_t par = 0; par < nGrad; ++par )
+    ampGrad[ par ] = derivs.data() + par * n;
+
+  _amp.evaluateGradient( _ps, mSq12, mSq13, mSq23.data(), n, amps.data(), ampGrad );
+  if ( _cacheFuncs )
+    std::copy( cacheR[ _funcsCache ], cacheR[ _funcsCache ] + n, effs.begin() );
+  else
+    evaluateFuncs( mSq12, mSq13, mSq23.data(), n, effs.data() );
+
+  const double& pdfNorm = norm();
+  for ( std::size_t entry = 0; entry < n; ++entry )
+    out[ entry ] = std::norm( amps[ entry ] ) * effs[ entry ] / pdfNorm;
+
+  // d( |A|^2 eff / N ) = ( 2 Re( A* dA ) eff - pdf dN ) / N.
+  for ( std::size_t par = 0; par < grad.size(); ++par )
+  {
+    if ( ! grad[ par ] )
+      continue;
+
+    const int& idx = _gradIdx[ par ];
+    if ( idx < 0 )
+      throw PdfException( "Decay3Body::evaluateGradient: no analytic derivative for the requested parameter." );
+
+    const std::complex< double >* dAmp  = ampGrad[ idx ];
+    const double&                 dNorm = _normGrad[ idx ];
+    for ( std::size_t entry = 0; entry < n; ++entry )
+      grad[ par ][ entry ] = ( 2.0 * std::real( std::conj( amps[ entry ] ) * dAmp[ entry ] ) * effs[ entry ]
+                               - out[ entry ] * dNorm ) / pdfNorm;
+  }
+}
+
+
 // No need to append an operator, since it can only be multiplication.
 const Decay3Body& Decay3Body::operator*=( const Function& right ) throw( PdfException )
 {
@@ -174,10 +452,10 @@ const Decay3Body& Decay3Body::operator*=( const Function& right ) throw( PdfExce
   _parMap.insert( parMap.begin(), parMap.end() );
 
   // Append the function to the functions vector.
-  _funcs.push_back( right );
+  appendFunc( right );
 
-  // Recompute the norm, since the pdf shape has changed under this operation.
-  cache();
+  // The norm must be computed again, since the pdf shape has changed under this operation.
+  staleNorm();
 
   return *this;
 }
@@ -197,10 +475,10 @@ const Decay3Body operator*( Decay3Body left, const Function& right )
   left._parMap.insert( parMap.begin(), parMap.end() );
 
   // Append the function to the functions vector.
-  left._funcs.push_back( right );
+  left.appendFunc( right );
 
-  // Recompute the norm, since the pdf shape has changed under this operation.
-  left.cache();
+  // The norm must be computed again, since the pdf shape has changed under this operation.
+  left.staleNorm();
 
   return left;
 }
@@ -220,10 +498,10 @@ const Decay3Body operator*( const Function& left, Decay3Body right )
   right._parMap.insert( parMap.begin(), parMap.end() );
 
   // Append the function to the functions vector.
-  right._funcs.push_back( left );
+  right.appendFunc( left );
 
-  // Recompute the norm, since the pdf shape has changed under this operation.
-  right.cache();
+  // The norm must be computed again, since the pdf shape has changed under this operation.
+  right.staleNorm();
 
   return right;
 }
@@ -231,54 +509,49 @@ const Decay3Body operator*( const Function& left, Decay3Body right )
 
 const std::map< std::string, double > Decay3Body::generate() const throw( PdfException )
 {
-  // Generate mSq12 and mSq13, and compute mSq23 from these.
-  const double& min12 = std::pow( _ps.m1()      + _ps.m2(), 2 );
-  const double& min13 = std::pow( _ps.m1()      + _ps.m3(), 2 );
-  const double& max12 = std::pow( _ps.mMother() - _ps.m3(), 2 );
-  const double& max13 = std::pow( _ps.mMother() - _ps.m2(), 2 );
-
-  const std::string& mSq12name = getVar( 0 ).name();
-  const std::string& mSq13name = getVar( 1 ).name();
-  const std::string& mSq23name = getVar( 2 ).name();
-
-  // Sum of squared invariant masses of all particles (mother and daughters).
-  const double& mSqSum = _ps.mSqMother() + _ps.mSq1() + _ps.mSq2() + _ps.mSq3();
-
-  // Generate uniform mSq12 and mSq13.
   double mSq12 = 0.0;
   double mSq13 = 0.0;
   double mSq23 = 0.0;
 
-  double pdfVal  = 0.0;
-
-  // Attempts to generate an event.
-  int count = 10000;
+  generate( 1, &mSq12, &mSq13, &mSq23 );
 
   std::map< std::string, double > values;
+  values[ getVar( 0 ).name() ] = mSq12;
+  values[ getVar( 1 ).name() ] = mSq13;
+  values[ getVar( 2 ).name() ] = mSq23;
 
-  while ( count-- )
-  {
-    mSq12 = Random::flat( min12, max12 );
-    mSq13 = Random::flat( min13, max13 );
-    mSq23 = mSqSum - mSq12 - mSq13;
-
-    values[ mSq12name ] = mSq12;
-    values[ mSq13name ] = mSq13;
-    values[ mSq23name ] = mSq23;
+  return values;
+}
 
-    pdfVal = this->evaluate( mSq12, mSq13, mSq23 );
 
-    if ( pdfVal > _maxPdf )
-      std::cout << "Problem: " << pdfVal << " " << mSq12 << " " << mSq13 << " " << mSqSum - mSq12 - mSq13 << std::endl;
+void Decay3Body::generate( const std::size_t& n, double* mSq12, double* mSq13, double* mSq23 ) const throw( PdfException )
+{
+  const DalitzEnvelope::density_type pdf = [ this ]( const double* mSq12, const double* mSq13, const double* mSq23,
+                                                     const std::size_t& n, double* out )
+    { evaluatePdf( mSq12, mSq13, mSq23, n, out ); };
 
-    // Apply the accept-reject decision.
-    if ( Random::flat( 0.0, _maxPdf ) < pdfVal )
-      return values;
+  std::shared_ptr< const DalitzEnvelope > envelope;
+  {
+    std::lock_guard< std::mutex > guard( _envelopeLock );
+    if ( ! _envelope )
+      _envelope = _autoMax ? std::make_shared< const DalitzEnvelope >( _ps, pdf     )
+                           : std::make_shared< const DalitzEnvelope >( _ps, _maxPdf );
+    envelope = _envelope;
   }
 
-  values[ mSq12name ] = 0.0;
-  values[ mSq13name ] = 0.0;
-  values[ mSq23name ] = 0.0;
+  envelope->generate( pdf, n, mSq12, mSq13, mSq23 );
+}
 
-  return values;
+
+void Decay3Body::generate( const std::size_t& n, Dataset& data ) const throw( PdfException )
+{
+  std::vector< double > mSq12( n );
+  std::vector< double > mSq13( n );
+  std::vector< double > mSq23( n );
+
+  generate( n, mSq12.data(), mSq13.data(), mSq23.data() );
+
+  data.append( getVar( 0 ).name(), mSq12.data(), n );
+  data.append( getVar( 1 ).name(), mSq13.data(), n );
+  data.append( getVar( 2 ).name(), mSq23.data(), n );
 }
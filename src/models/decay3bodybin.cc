@@ -1,5 +1,6 @@
 
 #include <complex>
+#include <algorithm>
 
 #include <cfit/dataset.hh>
 #include <cfit/function.hh>
@@ -20,7 +21,7 @@ Decay3BodyBin::Decay3BodyBin( const Variable&        mSq12  ,
     _binning( binning ),
     _hasKappa( false ), _phi( phi ),
     _nDir( 0.0 ), _nXed( 0.0 ), _norm( 1.0 ), _fixedAmp( false ),
-    _binIndex( 0 )
+    _cacheBins( false ), _binIndex( 0 )
 {
   push( phi );
 
@@ -45,7 +46,7 @@ Decay3BodyBin::Decay3BodyBin( const Variable&        mSq12  ,
     _binning( binning ),
     _hasKappa( true ), _kappa( kappa ), _phi( phi ),
     _nDir( 0.0 ), _nXed( 0.0 ), _norm( 1.0 ), _fixedAmp( false ),
-    _binIndex( 0 )
+    _cacheBins( false ), _binIndex( 0 )
 {
   push( phi   );
   push( kappa );
@@ -72,7 +73,7 @@ Decay3BodyBin::Decay3BodyBin( const Variable&        mSq12  ,
     _binning( binning ),
     _hasKappa( true ), _kappa( kappa ), _phi( phi ),
     _nDir( 0.0 ), _nXed( 0.0 ), _norm( 1.0 ), _fixedAmp( false ),
-    _binIndex( 0 )
+    _cacheBins( false ), _binIndex( 0 )
 {
   push( phi   );
   push( kappa );
@@ -93,6 +94,15 @@ Decay3BodyBin* Decay3BodyBin::copy() const
 }
 
 
+const std::map< std::string, std::size_t > Decay3BodyBin::memory() const
+{
+  std::map< std::string, std::size_t > bytes = DecayModel< BinnedAmplitude >::memory();
+  bytes[ "bin cache" ] = _binCache.capacity() * sizeof( int );
+
+  return bytes;
+}
+
+
 
 void Decay3BodyBin::setParExpr()
 {
@@ -112,75 +122,44 @@ void Decay3BodyBin::cacheNormComponents()
   if ( _fixedAmp )
     return;
 
-  // Define the properties of the integration method.
-  const unsigned& nBins = 100;
-  const double min   = _ps.mSq12min();
-  const double max   = _ps.mSq12max();
-  const double step  = ( max - min ) / double( nBins );
-
-  // Determine whether the bins in the 100x100 bins should be cached.
-  //    Cache them if it has not yet been cached.
-  bool needToCache = _binCache.empty();
-  if ( needToCache )
-    _binCache.resize( std::pow( nBins, 2 ) );
-
-  double mSq12;
-  double mSq13;
-
-  unsigned bin;
-  // Integrate only over the region mSq13 < mSq12 (positive bins).
-  for ( unsigned binX = 0; binX < nBins; ++binX )
-    for ( unsigned binY = 0; binY < binX; ++binY )
-    {
-      mSq12 = min + step * ( binX + 0.5 );
-      mSq13 = min + step * ( binY + 0.5 );
-
-      if ( _ps.contains( mSq12, mSq13 ) )
-      {
-        if ( needToCache )
-        {
-          bin = std::abs( _binning.bin( mSq12, mSq13 ) );
-
-          if ( needToCache )
-            _binCache[ nBins * binX + binY ] = bin;
-        }
-        else
-        {
-          bin = _binCache[ nBins * binX + binY ];
-        }
-      }
-    }
-
   // Initialize the value of the norm components and the norm.
   _nDir = 0.0;
   _nXed = 0.0;
   _norm = 0.0;
 
-  std::vector< ParameterExpr >::const_iterator npb = _amp.npb().begin();
-  std::vector< ParameterExpr >::const_iterator nmb = _amp.nmb().begin();
-  std::vector< CoefExpr      >::const_iterator xb  = _amp.xb() .begin();
-
-  double                 np;
-  double                 nm;
-  std::complex< double > nx;
-
-  // Calculate the norm components.
-  while ( npb != _amp.npb().end() )
+  // The values of the bins are computed by the amplitude when its parameters are set.
+  for ( int bin = 1; bin <= int( _amp.nBins() ); ++bin )
   {
-    np = (npb++)->evaluate();
-    nm = (nmb++)->evaluate();
-    nx = std::sqrt( np * nm ) * (xb++)->evaluate();
+    const std::tuple< double, double, std::complex< double > >&& nx = _amp.evaluate( bin );
 
-    _nDir += np + nm;
-    _nXed += 2.0 * std::real( nx );
+    _nDir += std::get< 0 >( nx ) + std::get< 1 >( nx );
+    _nXed += 2.0 * std::real( std::get< 2 >( nx ) );
   }
 
   return;
 }
 
 
+void Decay3BodyBin::gridBins( std::vector< int >& bins ) const throw( PdfException )
+{
+  const DalitzGrid& grid = *_normGrid.points();
+
+  bins.resize( grid.size() );
+  for ( std::size_t point = 0; point < grid.size(); ++point )
+    bins[ point ] = _binning.bin( grid.mSq12()[ point ], grid.mSq13()[ point ] );
+}
+
+
 void Decay3BodyBin::cache()
 {
+  // Determine the bin of each of the points on which the norm is computed,
+  //    only if it has not yet been cached for them.
+  if ( _binCachePoints != _normGrid.points() )
+  {
+    _binCachePoints = _normGrid.points();
+    gridBins( _binCache );
+  }
+
   // Compute the norm components, only if the amplitude
   //    is not fixed or they have not yet been computed.
   cacheNormComponents();
@@ -204,37 +183,72 @@ const std::map< unsigned, std::vector< double > > Decay3BodyBin::cacheReal( cons
   std::map< unsigned, std::vector< double > > cached;
 
   // Get an index for the cached bin.
-  _binIndex = _cacheIdxReal++;
+  _cacheBins = true;
+  _binIndex  = nextCacheIdxReal();
+
+  const double* mSq12 = data.valueColumn( data.column( getVar( 0 ).name() ) );
+  const double* mSq13 = data.valueColumn( data.column( getVar( 1 ).name() ) );
 
-  const std::string& mSq12name = getVar( 0 ).name();
-  const std::string& mSq13name = getVar( 1 ).name();
+  // The bins of the events never change, so they are only searched for once.
+  std::vector< double >& bins = cached[ _binIndex ];
+  bins.resize( data.size() );
+  for ( std::size_t entry = 0; entry < bins.size(); ++entry )
+    bins[ entry ] = _binning.bin( mSq12[ entry ], mSq13[ entry ] );
 
-  double mSq12;
-  double mSq13;
+  return cached;
+}
+
+
+
+const Dataset Decay3BodyBin::binCounts( const Dataset& data, const Variable& w ) const throw( PdfException )
+{
+  if ( _varMap.count( w.name() ) )
+    throw PdfException( "Decay3BodyBin: the column of the counts of the bins cannot be a variable of the pdf." );
 
-  const std::size_t& size = data.size();
-  for ( std::size_t entry = 0; entry < size; ++entry )
+  const double* mSq12 = data.valueColumn( data.column( getVar( 0 ).name() ) );
+  const double* mSq13 = data.valueColumn( data.column( getVar( 1 ).name() ) );
+
+  // First event and number of events of each bin.
+  std::map< int, std::pair< std::size_t, std::size_t > > counts;
+  for ( std::size_t entry = 0; entry < data.size(); ++entry )
   {
-    mSq12 = data.value( mSq12name, entry );
-    mSq13 = data.value( mSq13name, entry );
+    const int bin = _binning.bin( mSq12[ entry ], mSq13[ entry ] );
 
-    cached[ _binIndex ].push_back( _binning.bin( mSq12, mSq13 ) );
+    if ( counts.count( bin ) )
+      counts[ bin ].second++;
+    else
+      counts[ bin ] = std::make_pair( entry, 1 );
   }
 
-  return cached;
-}
+  // Variables of the pdf that the dataset has.
+  std::vector< std::string > fields;
+  const std::vector< std::string >& dataFields = data.fields();
+  typedef std::vector< std::string >::const_iterator sIter;
+  for ( sIter field = dataFields.begin(); field != dataFields.end(); ++field )
+    if ( _varMap.count( *field ) )
+      fields.push_back( *field );
 
+  Dataset binned;
 
+  typedef std::map< int, std::pair< std::size_t, std::size_t > >::const_iterator cIter;
+  for ( cIter bin = counts.begin(); bin != counts.end(); ++bin )
+  {
+    std::map< std::string, double > event;
+    for ( sIter field = fields.begin(); field != fields.end(); ++field )
+      event[ *field ] = data.value( *field, bin->second.first );
 
+    event[ w.name() ] = bin->second.second;
+    binned.push( event );
+  }
+
+  return binned;
+}
 
 
 
 // Unnormalized evaluation.
-const double Decay3BodyBin::evaluateUnnorm( const double& mSq12, const double& mSq13 ) const throw( PdfException )
+const double Decay3BodyBin::evaluateUnnorm( const int& bin ) const throw( PdfException )
 {
-  // Calculate the bin number from the binning.
-  int bin = _binning.bin( mSq12, mSq13 );
-
   const std::tuple< double, double, std::complex< double > >&& tx = _amp.evaluate( bin );
 
   const std::complex< double >&& vz     = z();
@@ -246,6 +260,13 @@ const double Decay3BodyBin::evaluateUnnorm( const double& mSq12, const double& m
 }
 
 
+const double Decay3BodyBin::evaluateUnnorm( const double& mSq12, const double& mSq13 ) const throw( PdfException )
+{
+  // Calculate the bin number from the binning.
+  return evaluateUnnorm( _binning.bin( mSq12, mSq13 ) );
+}
+
+
 const double Decay3BodyBin::evaluate( const double& mSq12, const double& mSq13, const double& ) const throw( PdfException )
 {
   // Ignore any eventual 3rd argument.
@@ -276,7 +297,7 @@ const double Decay3BodyBin::evaluate( const std::vector< double >&
                                       const std::vector< double >&                 cacheR,
                                       const std::vector< std::complex< double > >& cacheC ) const throw( PdfException )
 {
-  if ( cacheR.empty() )
+  if ( ! _cacheBins )
     return evaluate( vars );
 
   const std::size_t& size = vars.size();
@@ -284,15 +305,146 @@ const double Decay3BodyBin::evaluate( const std::vector< double >&
   if ( ( size != 2 ) && ( size != 3 ) )
     throw PdfException( "Decay3BodyBin can only take either 2 or 3 arguments." );
 
-  int bin = cacheR[ _binIndex ];
+  return evaluateUnnorm( int( cacheR[ _binIndex ] ) ) / _norm;
+}
+
+
+void Decay3BodyBin::evaluateBlock( const std::vector< const double*                 >& vars  ,
+                                  const std::vector< const double*                 >& cacheR,
+                                  const std::vector< const std::complex< double >* >& cacheC,
+                                  const std::size_t&                                  n     ,
+                                  double*                                             out    ) const throw( PdfException )
+{
+  check( vars.size() );
+  evaluateUnchecked( vars, cacheR, cacheC, n, out );
+}
+
 
+void Decay3BodyBin::check( const std::size_t& nVars ) const throw( PdfException )
+{
+  if ( ( nVars != 2 ) && ( nVars != 3 ) )
+    throw PdfException( "Decay3BodyBin can only take either 2 or 3 arguments." );
+}
+
+
+void Decay3BodyBin::evaluateUnchecked( const std::vector< const double*                 >& vars  ,
+                                      const std::vector< const double*                 >& cacheR,
+                                      const std::vector< const std::complex< double >* >& cacheC,
+                                      const std::size_t&                                  n     ,
+                                      double*                                             out    ) const
+{
+  // The parameters are common to all the events of the block.
   const std::complex< double >&& vz     = z();
+  const double                   normZ  = std::norm( vz );
   const double&&                 vKappa = kappa();
 
-  const std::tuple< double, double, std::complex< double > >&& nx = _amp.evaluate( bin );
+  const double* bins = _cacheBins ? cacheR[ _binIndex ] : 0;
+
+  int bin;
+  for ( std::size_t entry = 0; entry < n; ++entry )
+  {
+    bin = bins ? int( bins[ entry ] ) : _binning.bin( vars[ 0 ][ entry ], vars[ 1 ][ entry ] );
+
+    const std::tuple< double, double, std::complex< double > >&& nx = _amp.evaluate( bin );
+
+    out[ entry ] = std::max( 0.0, ( std::get< 0 >( nx )         +
+                                    std::get< 1 >( nx ) * normZ +
+                                    2.0 * vKappa * std::real( vz * std::get< 2 >( nx ) ) ) ) / _norm;
+  }
+}
+
+
+
+int Decay3BodyBin::varIndex( const std::string& varName ) const
+{
+  for ( unsigned var = 0; var < 3; ++var )
+    if ( varName == getVar( var ).name() )
+      return var;
+
+  return -1;
+}
+
+
+void Decay3BodyBin::gridFractions( std::vector< double >& fracs ) const throw( PdfException )
+{
+  const DalitzGrid& grid = *_normGrid.points();
+
+  // Find the bins again if the points have changed since the last call to cache().
+  std::vector< int > bins;
+  const bool cached = ( _binCachePoints == _normGrid.points() );
+  if ( ! cached )
+    gridBins( bins );
 
-  return std::max( 0.0, ( std::get< 0 >( nx )                   +
-                          std::get< 1 >( nx ) * std::norm( vz ) +
-                          2.0 * vKappa * std::real( vz * std::get< 2 >( nx ) ) ) ) / _norm;
+  const std::vector< int >& pointBins = cached ? _binCache : bins;
+
+  fracs.resize( grid.size() );
+  double total = 0.0;
+  for ( std::size_t point = 0; point < grid.size(); ++point )
+    total += fracs[ point ] = evaluateUnnorm( pointBins[ point ] ) * grid.weight( point );
+
+  if ( total > 0.0 )
+    for ( std::size_t point = 0; point < grid.size(); ++point )
+      fracs[ point ] /= total;
+}
+
+
+void Decay3BodyBin::projectHist( const std::string& varName,
+                                 const double&      min    ,
+                                 const double&      max    ,
+                                 const unsigned&    nBins  ,
+                                 double*            out      ) const throw( PdfException )
+{
+  const int index = varIndex( varName );
+  if ( index == -1 )
+  {
+    std::fill( out, out + nBins, 1.0 );
+    return;
+  }
+
+  std::vector< double > fracs;
+  gridFractions( fracs );
+
+  const DalitzGrid& grid = *_normGrid.points();
+  const double* coords[ 3 ] = { grid.mSq12(), grid.mSq13(), grid.mSq23() };
+
+  std::fill( out, out + nBins, 0.0 );
+  for ( std::size_t point = 0; point < grid.size(); ++point )
+  {
+    const double& x = coords[ index ][ point ];
+    if ( ( x >= min ) && ( x < max ) )
+      out[ std::min( unsigned( ( x - min ) / ( max - min ) * nBins ), nBins - 1 ) ] += fracs[ point ];
+  }
 }
 
+
+void Decay3BodyBin::projectHist( const std::string& var1  ,
+                                 const double&      min1  ,
+                                 const double&      max1  ,
+                                 const unsigned&    nBins1,
+                                 const std::string& var2  ,
+                                 const double&      min2  ,
+                                 const double&      max2  ,
+                                 const unsigned&    nBins2,
+                                 double*            out     ) const throw( PdfException )
+{
+  const int index1 = varIndex( var1 );
+  const int index2 = varIndex( var2 );
+  if ( ( index1 == -1 ) || ( index2 == -1 ) )
+    return PdfBase::projectHist( var1, min1, max1, nBins1, var2, min2, max2, nBins2, out );
+
+  std::vector< double > fracs;
+  gridFractions( fracs );
+
+  const DalitzGrid& grid = *_normGrid.points();
+  const double* coords[ 3 ] = { grid.mSq12(), grid.mSq13(), grid.mSq23() };
+
+  std::fill( out, out + nBins1 * nBins2, 0.0 );
+  for ( std::size_t point = 0; point < grid.size(); ++point )
+  {
+    const double& x = coords[ index1 ][ point ];
+    const double& y = coords[ index2 ][ point ];
+    if ( ( x >= min1 ) && ( x < max1 ) && ( y >= min2 ) && ( y < max2 ) )
+      out[ std::min( unsigned( ( x - min1 ) / ( max1 - min1 ) * nBins1 ), nBins1 - 1 ) * nBins2 +
+           std::min( unsigned( ( y - min2 ) / ( max2 - min2 ) * nBins2 ), nBins2 - 1 ) ] += fracs[ point ];
+  }
+}
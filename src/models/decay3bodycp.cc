@@ -1,5 +1,7 @@
 
+#include <vector>
 #include <complex>
+#include <algorithm>
 
 #include <cfit/dataset.hh>
 #include <cfit/function.hh>
@@ -15,10 +17,8 @@ Decay3BodyCP::Decay3BodyCP( const Variable&   mSq12  ,
                             const CoefExpr&   phi    ,
                             const PhaseSpace& ps     ,
                             bool              docache  )
-  : DecayModel( mSq12, mSq13, mSq23, amp, ps ), _hasKappa( false ), _phi( phi ),
-    _nDir( 0.0 ), _nCnj( 0.0 ), _nXed( 0.0 ), _norm( 1.0 ), _fixed( false ),
-    _maxPdf( 14.0 ), _cacheAmps( false ), _ampDirCache( 0 ), _ampCnjCache( 0 ),
-    _nIntegSteps( 400 )
+  : ConjugateDecayModel( mSq12, mSq13, mSq23, amp, ps ), _hasKappa( false ), _phi( phi ),
+    _norm( 1.0 ), _maxPdf( 14.0 ), _autoMax( true )
 {
   push( phi );
 
@@ -39,10 +39,8 @@ Decay3BodyCP::Decay3BodyCP( const Variable&   mSq12  ,
                             const Parameter&  kappa  ,
                             const PhaseSpace& ps     ,
                             bool              docache  )
-  : DecayModel( mSq12, mSq13, mSq23, amp, ps ), _hasKappa( true ), _kappa( kappa ), _phi( phi ),
-    _nDir( 0.0 ), _nCnj( 0.0 ), _nXed( 0.0 ), _norm( 1.0 ), _fixed( false ),
-    _maxPdf( 14.0 ), _cacheAmps( false ), _ampDirCache( 0 ), _ampCnjCache( 0 ),
-    _nIntegSteps( 400 )
+  : ConjugateDecayModel( mSq12, mSq13, mSq23, amp, ps ), _hasKappa( true ), _kappa( kappa ), _phi( phi ),
+    _norm( 1.0 ), _maxPdf( 14.0 ), _autoMax( true )
 {
   push( phi   );
   push( kappa );
@@ -65,10 +63,8 @@ Decay3BodyCP::Decay3BodyCP( const Variable&      mSq12  ,
                             const ParameterExpr& kappa  ,
                             const PhaseSpace&    ps     ,
                             bool                 docache  )
-  : DecayModel( mSq12, mSq13, mSq23, amp, ps ), _hasKappa( true ), _kappa( kappa ), _phi( phi ),
-    _nDir( 0.0 ), _nCnj( 0.0 ), _nXed( 0.0 ), _norm( 1.0 ), _fixed( false ),
-    _maxPdf( 14.0 ), _cacheAmps( false ), _ampDirCache( 0 ), _ampCnjCache( 0 ),
-    _nIntegSteps( 400 )
+  : ConjugateDecayModel( mSq12, mSq13, mSq23, amp, ps ), _hasKappa( true ), _kappa( kappa ), _phi( phi ),
+    _norm( 1.0 ), _maxPdf( 14.0 ), _autoMax( true )
 {
   push( phi   );
   push( kappa );
@@ -88,6 +84,15 @@ Decay3BodyCP* Decay3BodyCP::copy() const
 }
 
 
+const std::map< std::string, std::size_t > Decay3BodyCP::memory() const
+{
+  std::map< std::string, std::size_t > bytes = DecayModel< Amplitude >::memory();
+  bytes[ "envelope" ] = _envelope ? _envelope->memory() : 0;
+
+  return bytes;
+}
+
+
 void Decay3BodyCP::setParExpr()
 {
   _phi.setPars( _parMap );
@@ -103,90 +108,11 @@ void Decay3BodyCP::cache()
   const std::complex< double >& vz     = z();
   const double&                 vKappa = kappa();
 
-  if ( _fixed )
-  {
-    _norm = _nDir + std::norm( vz ) * _nCnj + 2.0 * vKappa * real( vz * _nXed );
-    return;
-  }
-
-  // Compute the value of _norm.
-  _nDir = 0.0;
-  _nCnj = 0.0;
-  _nXed = 0.0;
-  _norm = 0.0;
-
-  // Define the properties of the integration method.
-  const double min   = _ps.mSq12min();
-  const double max   = _ps.mSq12max();
-  const double step  = ( max - min ) / double( _nIntegSteps );
-
-  const double mSqSum = _ps.mSqSum();
-
-  // Determine whether the amplitudes in the 400x400 bins should be cached.
-  //    Cache them if the amplitude is fixed, but it has not yet been cached.
-  bool cachedAmp   = ! _ampCache.empty();
-  bool needToCache = ! cachedAmp && _amp.isFixed();
-  if ( needToCache )
-    _ampCache.resize( std::pow( _nIntegSteps, 2 ) );
+  // The envelope of the pdf is only needed to generate events.
+  _envelope.reset();
 
-  // Define the variables at each bin.
-  double mSq12;
-  double mSq13;
-  double mSq23;
-
-  double funcs;
-  std::complex< double > ampDir;
-  std::complex< double > ampCnj;
-
-  unsigned binDir;
-  unsigned binCnj;
-
-  // Compute the integral on the grid.
-  for ( unsigned binX = 0; binX < _nIntegSteps; ++binX )
-    for ( unsigned binY = 0; binY < _nIntegSteps; ++binY )
-    {
-      mSq12 = min + step * ( binX + 0.5 );
-      mSq13 = min + step * ( binY + 0.5 );
-      mSq23 = mSqSum - mSq12 - mSq13;
-
-      // Proceed only if the point lies inside the kinematically allowed phase space region.
-      // std::norm returns the squared modulus of the complex number, not its norm.
-      if ( _ps.contains( mSq12, mSq13, mSq23 ) )
-      {
-        funcs = evaluateFuncs( mSq12, mSq13, mSq23 );
-
-        // If the amplitude is fixed, but the efficiency is not, use cached amplitude values.
-        if ( cachedAmp )
-        {
-          binDir = _nIntegSteps * binX + binY;
-          binCnj = _nIntegSteps * binY + binX;
-
-          ampDir = _ampCache[ binDir ];
-          ampCnj = _ampCache[ binCnj ];
-        }
-        else
-        {
-          ampDir = _amp.evaluate( _ps, mSq12, mSq13, mSq23 );
-          ampCnj = _amp.evaluate( _ps, mSq13, mSq12, mSq23 );
-
-          if ( needToCache )
-            _ampCache[ _nIntegSteps * binX + binY ] = ampDir;
-        }
-
-        _nDir += std::norm( ampDir ) * funcs;
-        _nCnj += std::norm( ampCnj ) * funcs;
-        _nXed += conj( ampDir ) * ampCnj * funcs;
-      }
-    }
-
-  const double& stepSq = std::pow( step, 2 );
-  _nDir *= stepSq;
-  _nCnj *= stepSq;
-  _nXed *= stepSq;
-
-  _fixed = _amp.isFixed();
-  for ( std::vector< Function >::const_iterator func = _funcs.begin(); func != _funcs.end(); ++func )
-    _fixed &= func->isFixed();
+  // Compute the norm components, unless they have been given.
+  updateNormComponents();
 
   _norm = _nDir + std::norm( vz ) * _nCnj + 2.0 * vKappa * std::real( vz * _nXed );
 
@@ -194,40 +120,20 @@ void Decay3BodyCP::cache()
 }
 
 
-const std::map< unsigned, std::vector< std::complex< double > > > Decay3BodyCP::cacheComplex( const Dataset& data )
+// The efficiency of the events only needs to be computed once if it is fixed.
+const std::map< unsigned, std::vector< double > > Decay3BodyCP::cacheReal( const Dataset& data )
 {
-  // Determine whether the amplitudes should be cached, i.e. only if all their parameters are fixed.
-  _cacheAmps = true;
-
-  std::map< unsigned, std::vector< std::complex< double > > > cached;
-
-  if ( ! _cacheAmps )
-    return cached;
-
-  // Get an index for the cached complex amplitudes.
-  _ampDirCache = _cacheIdxComplex++;
-  _ampCnjCache = _cacheIdxComplex++;
-
-  const std::string& mSq12name = getVar( 0 ).name();
-  const std::string& mSq13name = getVar( 1 ).name();
-  const std::string& mSq23name = getVar( 2 ).name();
-
-  double mSq12;
-  double mSq13;
-  double mSq23;
+  return cacheFuncs( data );
+}
 
-  const std::size_t& size = data.size();
-  for ( std::size_t entry = 0; entry < size; ++entry )
-  {
-    mSq12 = data.value( mSq12name, entry );
-    mSq13 = data.value( mSq13name, entry );
-    mSq23 = data.value( mSq23name, entry );
 
-    cached[ _ampDirCache ].push_back( _amp.evaluate( _ps, mSq12, mSq13, mSq23 ) );
-    cached[ _ampCnjCache ].push_back( _amp.evaluate( _ps, mSq13, mSq12, mSq23 ) );
-  }
+const std::map< unsigned, std::vector< std::complex< double > > > Decay3BodyCP::cacheComplex( const Dataset& data )
+{
+  // Determine whether the amplitudes should be cached, i.e. only if all their
+  //    parameters are fixed. Otherwise their basis functions may be.
+  _cacheAmps = _amp.isFixed();
 
-  return cached;
+  return cacheAmplitudes( data );
 }
 
 
@@ -289,9 +195,9 @@ const double Decay3BodyCP::project( const std::string& varName, const double& x
 
   // Integrate the model.
   double proj = 0.0;
-  for ( unsigned yBin = 0; yBin < _nIntegSteps; ++yBin )
+  for ( unsigned yBin = 0; yBin < integrationSteps(); ++yBin )
   {
-    double y = binCenter( yBin, _nIntegSteps, min, max );
+    double y = binCenter( yBin, integrationSteps(), min, max );
     double z = _ps.mSqSum() - x - y;
 
     if ( index == 0 ) proj += evaluate( x, y, z );
@@ -299,7 +205,7 @@ const double Decay3BodyCP::project( const std::string& varName, const double& x
     if ( index == 2 ) proj += evaluate( y, z, x );
   }
 
-  proj *= ( max - min ) / double( _nIntegSteps );
+  proj *= ( max - min ) / double( integrationSteps() );
 
   return proj;
 }
@@ -324,7 +230,7 @@ const double Decay3BodyCP::evaluate( const std::vector< double >&
                                      const std::vector< double >&                 cacheR,
                                      const std::vector< std::complex< double > >& cacheC ) const throw( PdfException )
 {
-  if ( ! _cacheAmps )
+  if ( ! _cacheAmps && ! _cacheBasis )
     return evaluate( vars );
 
   const std::size_t& size = vars.size();
@@ -332,14 +238,23 @@ const double Decay3BodyCP::evaluate( const std::vector< double >&
   if ( ( size != 2 ) && ( size != 3 ) )
     throw PdfException( "Decay3BodyCP can only take either 2 or 3 arguments." );
 
-  std::complex< double > ampDir = cacheC[ _ampDirCache ];
-  std::complex< double > ampCnj = cacheC[ _ampCnjCache ];
+  std::complex< double > ampDir;
+  std::complex< double > ampCnj;
+  if ( _cacheAmps )
+  {
+    ampDir = cacheC[ _ampDirCache ];
+    ampCnj = cacheC[ _ampCnjCache ];
+  }
+  else
+    combineBasis( cacheC, ampDir, ampCnj );
 
   const std::complex< double >& vz = z();
 
-  // Evaluate the functions that describe the efficiency.
+  // Evaluate the functions that describe the efficiency, unless they are cached.
   double funcs = 0.0;
-  if ( size == 2 )
+  if ( _cacheFuncs )
+    funcs = cacheR[ _funcsCache ];
+  else if ( size == 2 )
     funcs = evaluateFuncs( vars[ 0 ], vars[ 1 ] );
   else if ( size == 3 )
     funcs = evaluateFuncs( vars[ 0 ], vars[ 1 ], vars[ 2 ] );
@@ -356,6 +271,113 @@ const double Decay3BodyCP::evaluate( const std::vector< double >&
 }
 
 
+void Decay3BodyCP::evaluateBlock( const std::vector< const double*                 >& vars  ,
+                                 const std::vector< const double*                 >& cacheR,
+                                 const std::vector< const std::complex< double >* >& cacheC,
+                                 const std::size_t&                                  n     ,
+                                 double*                                             out    ) const throw( PdfException )
+{
+  check( vars.size() );
+  evaluateUnchecked( vars, cacheR, cacheC, n, out );
+}
+
+
+void Decay3BodyCP::check( const std::size_t& nVars ) const throw( PdfException )
+{
+  if ( ( nVars != 2 ) && ( nVars != 3 ) )
+    throw PdfException( "Decay3BodyCP can only take either 2 or 3 arguments." );
+}
+
+
+void Decay3BodyCP::evaluateUnchecked( const std::vector< const double*                 >& vars  ,
+                                     const std::vector< const double*                 >& cacheR,
+                                     const std::vector< const std::complex< double >* >& cacheC,
+                                     const std::size_t&                                  n     ,
+                                     double*                                             out    ) const
+{
+  const std::size_t& size = vars.size();
+
+  if ( ! _cacheAmps && ! _cacheBasis )
+  {
+    if ( size == 2 )
+      for ( std::size_t entry = 0; entry < n; ++entry )
+        out[ entry ] = evaluate( vars[ 0 ][ entry ], vars[ 1 ][ entry ] );
+    else
+      for ( std::size_t entry = 0; entry < n; ++entry )
+        out[ entry ] = evaluate( vars[ 0 ][ entry ], vars[ 1 ][ entry ], vars[ 2 ][ entry ] );
+    return;
+  }
+
+  // Evaluate the functions that describe the efficiency, unless they are cached.
+  if ( _cacheFuncs )
+    std::copy( cacheR[ _funcsCache ], cacheR[ _funcsCache ] + n, out );
+  else
+  {
+    std::vector< double > mSq23( n );
+    if ( size == 3 )
+      std::copy( vars[ 2 ], vars[ 2 ] + n, mSq23.begin() );
+    else
+      for ( std::size_t entry = 0; entry < n; ++entry )
+        mSq23[ entry ] = _ps.mSqSum() - vars[ 0 ][ entry ] - vars[ 1 ][ entry ];
+
+    evaluateFuncs( vars[ 0 ], vars[ 1 ], mSq23.data(), n, out );
+  }
+
+  // The complex numbers are arrays of their real and imaginary parts, which are
+  //    combined explicitly instead of through the complex multiplication.
+  std::vector< std::complex< double > > dirBlock;
+  std::vector< std::complex< double > > cnjBlock;
+  if ( _cacheBasis )
+  {
+    dirBlock.resize( n );
+    cnjBlock.resize( n );
+    combineBasis( cacheC, n, dirBlock.data(), cnjBlock.data() );
+  }
+
+  const double* ampDir = reinterpret_cast< const double* >( _cacheBasis ? dirBlock.data() : cacheC[ _ampDirCache ] );
+  const double* ampCnj = reinterpret_cast< const double* >( _cacheBasis ? cnjBlock.data() : cacheC[ _ampCnjCache ] );
+
+  // The parameters are common to all the events of the block.
+  const std::complex< double >& vz     = z();
+  const double                  zRe    = std::real( vz );
+  const double                  zIm    = std::imag( vz );
+  const double                  normZ  = std::norm( vz );
+  const double                  vKappa = kappa();
+
+  if ( ! _hasKappa )
+    // | dir + z cnj |^2.
+    for ( std::size_t entry = 0; entry < n; ++entry )
+    {
+      const double& dRe = ampDir[ 2 * entry ];
+      const double& dIm = ampDir[ 2 * entry + 1 ];
+      const double& cRe = ampCnj[ 2 * entry ];
+      const double& cIm = ampCnj[ 2 * entry + 1 ];
+
+      const double re = dRe + zRe * cRe - zIm * cIm;
+      const double im = dIm + zRe * cIm + zIm * cRe;
+
+      out[ entry ] *= ( re * re + im * im ) / _norm;
+    }
+  else
+    // | dir |^2 + | z |^2 | cnj |^2 + 2 kappa Re( z conj( dir ) cnj ).
+    for ( std::size_t entry = 0; entry < n; ++entry )
+    {
+      const double& dRe = ampDir[ 2 * entry ];
+      const double& dIm = ampDir[ 2 * entry + 1 ];
+      const double& cRe = ampCnj[ 2 * entry ];
+      const double& cIm = ampCnj[ 2 * entry + 1 ];
+
+      const double xRe = dRe * cRe + dIm * cIm;
+      const double xIm = dRe * cIm - dIm * cRe;
+
+      double ampSq  = dRe * dRe + dIm * dIm + normZ * ( cRe * cRe + cIm * cIm );
+      ampSq        += 2.0 * vKappa * ( zRe * xRe - zIm * xIm );
+
+      out[ entry ] *= ampSq / _norm;
+    }
+}
+
+
 
 
 // No need to append an operator, since it can only be multiplication.
@@ -372,10 +394,10 @@ const Decay3BodyCP& Decay3BodyCP::operator*=( const Function& right ) throw( Pdf
   _parMap.insert( parMap.begin(), parMap.end() );
 
   // Append the function to the functions vector.
-  _funcs.push_back( right );
+  appendFunc( right );
 
   // Recompute the norm, since the pdf shape has changed under this operation.
-  _fixed = false;
+  _fixedNorm = false;
   cache();
 
   return *this;
@@ -396,10 +418,10 @@ const Decay3BodyCP operator*( Decay3BodyCP left, const Function& right )
   left._parMap.insert( parMap.begin(), parMap.end() );
 
   // Append the function to the functions vector.
-  left._funcs.push_back( right );
+  left.appendFunc( right );
 
   // Recompute the norm, since the pdf shape has changed under this operation.
-  left._fixed = false;
+  left._fixedNorm = false;
   left.cache();
 
   return left;
@@ -420,10 +442,10 @@ const Decay3BodyCP operator*( const Function& left, Decay3BodyCP right )
   right._parMap.insert( parMap.begin(), parMap.end() );
 
   // Append the function to the functions vector.
-  right._funcs.push_back( left );
+  right.appendFunc( left );
 
   // Recompute the norm, since the pdf shape has changed under this operation.
-  right._fixed = false;
+  right._fixedNorm = false;
   right.cache();
 
   return right;
@@ -432,60 +454,53 @@ const Decay3BodyCP operator*( const Function& left, Decay3BodyCP right )
 
 const std::map< std::string, double > Decay3BodyCP::generate() const throw( PdfException )
 {
-  // Generate mSq12 and mSq13, and compute mSq23 from these.
-  const double& min12 = std::pow( _ps.m1()      + _ps.m2(), 2 );
-  const double& min13 = std::pow( _ps.m1()      + _ps.m3(), 2 );
-  const double& max12 = std::pow( _ps.mMother() - _ps.m3(), 2 );
-  const double& max13 = std::pow( _ps.mMother() - _ps.m2(), 2 );
-
-  const std::string& mSq12name = getVar( 0 ).name();
-  const std::string& mSq13name = getVar( 1 ).name();
-  const std::string& mSq23name = getVar( 2 ).name();
-
-  // Sum of squared invariant masses of all particles (mother and daughters).
-  const double& mSqSum = _ps.mSqMother() + _ps.mSq1() + _ps.mSq2() + _ps.mSq3();
-
   double mSq12 = 0.0;
   double mSq13 = 0.0;
   double mSq23 = 0.0;
 
-  double pdfVal  = 0.0;
-
-  // Attempts to generate an event.
-  int count = 50000;
+  generate( 1, &mSq12, &mSq13, &mSq23 );
 
   std::map< std::string, double > values;
+  values[ getVar( 0 ).name() ] = mSq12;
+  values[ getVar( 1 ).name() ] = mSq13;
+  values[ getVar( 2 ).name() ] = mSq23;
 
-  while ( count-- )
-  {
-    // Generate uniform mSq12 and mSq13.
-    mSq12 = Random::flat( min12, max12 );
-    mSq13 = Random::flat( min13, max13 );
-    mSq23 = mSqSum - mSq12 - mSq13;
-
-    if ( _ps.contains( mSq12, mSq13, mSq23 ) )
-    {
-      values[ mSq12name ] = mSq12;
-      values[ mSq13name ] = mSq13;
-      values[ mSq23name ] = mSq23;
+  return values;
+}
 
-      pdfVal = this->evaluate( mSq12, mSq13, mSq23 );
 
-      if ( pdfVal > _maxPdf )
-        std::cout << "Problem: " << pdfVal << " > " << _maxPdf
-                  << " for variables " << mSq12 << " " << mSq13 << " " << mSq23 << " " << _norm << std::endl;
+void Decay3BodyCP::generate( const std::size_t& n, double* mSq12, double* mSq13, double* mSq23 ) const throw( PdfException )
+{
+  // The pdf has no batched evaluation, so the points are evaluated one at a time.
+  const DalitzEnvelope::density_type pdf = [ this ]( const double* mSq12, const double* mSq13, const double* mSq23,
+                                                     const std::size_t& n, double* out )
+  {
+    for ( std::size_t point = 0; point < n; ++point )
+      out[ point ] = evaluate( mSq12[ point ], mSq13[ point ], mSq23[ point ] );
+  };
 
-      // Apply the accept-reject decision.
-      if ( Random::flat( 0.0, _maxPdf ) < pdfVal )
-        return values;
-    }
+  std::shared_ptr< const DalitzEnvelope > envelope;
+  {
+    std::lock_guard< std::mutex > guard( _lock );
+    if ( ! _envelope )
+      _envelope = _autoMax ? std::make_shared< const DalitzEnvelope >( _ps, pdf     )
+                           : std::make_shared< const DalitzEnvelope >( _ps, _maxPdf );
+    envelope = _envelope;
   }
 
-  std::cout << "ALERT: too many attempts trying to generate an event" << std::endl;
+  envelope->generate( pdf, n, mSq12, mSq13, mSq23 );
+}
 
-  values[ mSq12name ] = 0.0;
-  values[ mSq13name ] = 0.0;
-  values[ mSq23name ] = 0.0;
 
-  return values;
+void Decay3BodyCP::generate( const std::size_t& n, Dataset& data ) const throw( PdfException )
+{
+  std::vector< double > mSq12( n );
+  std::vector< double > mSq13( n );
+  std::vector< double > mSq23( n );
+
+  generate( n, mSq12.data(), mSq13.data(), mSq23.data() );
+
+  data.append( getVar( 0 ).name(), mSq12.data(), n );
+  data.append( getVar( 1 ).name(), mSq13.data(), n );
+  data.append( getVar( 2 ).name(), mSq23.data(), n );
 }
@@ -1,9 +1,11 @@
 
 #include <complex>
+#include <cmath>
 
 #include <cfit/dataset.hh>
 #include <cfit/function.hh>
 #include <cfit/random.hh>
+#include <cfit/timebasis.hh>
 
 #include <cfit/models/decay3bodymix.hh>
 
@@ -17,15 +19,16 @@ Decay3BodyMix::Decay3BodyMix( const Variable&      mSq12  ,
                               const CoefExpr&      z      ,
                               const PhaseSpace&    ps     ,
                               bool                 docache  )
-  : DecayModel( mSq12, mSq13, mSq23, amp, ps ),
+  : ConjugateDecayModel( mSq12, mSq13, mSq23, amp, ps ),
     _mSq12( mSq12.name() ), _mSq13( mSq13.name() ), _mSq23( mSq23.name() ), _t( t.name() ),
     _width( width ),
     _z( z ),
     _qoverp( 1.0 ),
     _hasMixing( true  ),
     _hasCPV   ( false ),
-    _nDir( 0.0 ), _nCnj( 0.0 ), _nXed( 0.0 ), _norm( 1.0 ), _fixedAmp( false ),
-    _maxPdf( 54.0 ), _cacheAmps( false ), _ampDirCache( 0 ), _ampCnjCache( 0 )
+    _norm( 1.0 ), _maxPdf( 54.0 ),
+    _cacheTime( false ), _psipCache( 0 ), _psimCache( 0 ), _psiiCache( 0 ), _foldFuncs( false ),
+    _resolution( false ), _resScale( 1.0 ), _resFixed( true ), _sigmaCache( 0 ), _gaussCache( 0 )
 {
   // Make the variables available to cfit.
   // The squared invariant masses are already made available by the DecayModel constructor.
@@ -52,15 +55,16 @@ Decay3BodyMix::Decay3BodyMix( const Variable&      mSq12  ,
                               const CoefExpr&      qoverp ,
                               const PhaseSpace&    ps     ,
                               bool                 docache  )
-  : DecayModel( mSq12, mSq13, mSq23, amp, ps ),
+  : ConjugateDecayModel( mSq12, mSq13, mSq23, amp, ps ),
     _mSq12( mSq12.name() ), _mSq13( mSq13.name() ), _mSq23( mSq23.name() ), _t( t.name() ),
     _width( width ),
     _z( z ),
     _qoverp( qoverp ),
     _hasMixing( true ),
     _hasCPV   ( true ),
-    _nDir( 0.0 ), _nCnj( 0.0 ), _nXed( 0.0 ), _norm( 1.0 ), _fixedAmp( false ),
-    _maxPdf( 54.0 ), _cacheAmps( false ), _ampDirCache( 0 ), _ampCnjCache( 0 )
+    _norm( 1.0 ), _maxPdf( 54.0 ),
+    _cacheTime( false ), _psipCache( 0 ), _psimCache( 0 ), _psiiCache( 0 ), _foldFuncs( false ),
+    _resolution( false ), _resScale( 1.0 ), _resFixed( true ), _sigmaCache( 0 ), _gaussCache( 0 )
 {
   // Make the variables available to cfit.
   // The squared invariant masses are already made available by the DecayModel constructor.
@@ -86,22 +90,11 @@ Decay3BodyMix* Decay3BodyMix::copy() const
 }
 
 
-// Time evolution functions.
-const double Decay3BodyMix::psip( const double& t ) const
+// Time evolution functions of n events with the current width and mixing parameters.
+void Decay3BodyMix::psiBlock( const double* t, const double* sigma, const double* gauss, const std::size_t& n,
+                              double* psip, double* psim, std::complex< double >* psii ) const
 {
-  return std::exp( - ( 1.0 - x() ) * gamma() * t );
-}
-
-
-const double Decay3BodyMix::psim( const double& t ) const
-{
-  return std::exp( - ( 1.0 + x() ) * gamma() * t );
-}
-
-
-const std::complex< double > Decay3BodyMix::psii( const double& t ) const
-{
-  return std::exp( - std::complex< double >( 1.0, - y() ) * gamma() * t );
+  TimeBasis::evaluate( t, sigma, gauss, n, gamma(), x(), y(), psip, psim, psii );
 }
 
 
@@ -116,6 +109,12 @@ void Decay3BodyMix::setMixing( const CoefExpr& z )
   push( _z = z );
 }
 
+void Decay3BodyMix::setResolution( const ParameterExpr& scale )
+{
+  _resolution = true;
+  push( _resScale = scale );
+}
+
 void Decay3BodyMix::setCPV( const CoefExpr& qoverp )
 {
   if ( _hasCPV )
@@ -131,127 +130,143 @@ void Decay3BodyMix::setParExpr()
 {
   _width.setPars( _parMap );
 
-  if ( _hasMixing ) _z     .setPars( _parMap );
-  if ( _hasCPV    ) _qoverp.setPars( _parMap );
+  if ( _hasMixing  ) _z       .setPars( _parMap );
+  if ( _hasCPV     ) _qoverp  .setPars( _parMap );
+  if ( _resolution ) _resScale.setPars( _parMap );
 }
 
 
 
-const double Decay3BodyMix::evaluateFuncs( const double& mSq12, const double& mSq13, const double& mSq23 ) const
+void Decay3BodyMix::cache()
 {
-  double value = 1.0;
+  // Compute the norm components, unless they have been given.
+  updateNormComponents();
 
-  typedef std::vector< Function >::const_iterator fIter;
+  // Calculate the norm.
+  const double&& xval = x();
+  const double&& yval = y();
+  const double&& xSq  = std::pow( xval, 2 );
+  const double&& ySq  = std::pow( yval, 2 );
 
-  std::map< std::string, double > varMap;
-  for ( fIter func = _funcs.begin(); func != _funcs.end(); ++func )
-  {
-    if ( func->dependsOn( _mSq12 ) ) varMap[ _mSq12 ] = mSq12;
-    if ( func->dependsOn( _mSq13 ) ) varMap[ _mSq13 ] = mSq13;
-    if ( func->dependsOn( _mSq23 ) ) varMap[ _mSq23 ] = mSq23;
+  const std::complex< double >&& qoverp = _qoverp.evaluate();
+  const double&& cpvp                   = ( 1.0 + std::norm( qoverp ) ) / 2.0;
+  const double&& cpvm                   = ( 1.0 - std::norm( qoverp ) ) / 2.0;
 
-    value *= func->evaluate( varMap );
-  }
+  _norm  = ( _nDir * cpvp + xval * std::real( _nXed * qoverp ) ) / ( 1.0 - xSq );
+  _norm += ( _nDir * cpvm - yval * std::imag( _nXed * qoverp ) ) / ( 1.0 + ySq );
+  _norm /= gamma();
 
-  // Always return a non-negative value. Default to zero.
-  return std::max( value, 0.0 );
+  return;
 }
 
 
-const double Decay3BodyMix::evaluateFuncs( const double& mSq12, const double& mSq13 ) const
-{
-  const double& mSq23 = _ps.mSqSum() - mSq12 - mSq13;
 
-  return evaluateFuncs( mSq12, mSq13, mSq23 );
-}
+const bool Decay3BodyMix::timeFixed() const
+{
+  std::map< std::string, Parameter > pars = _width.getPars();
+  if ( _hasMixing )
+  {
+    const std::map< std::string, Parameter >& zPars = _z.getPars();
+    pars.insert( zPars.begin(), zPars.end() );
+  }
+  if ( _resolution )
+  {
+    const std::map< std::string, Parameter >& scalePars = _resScale.getPars();
+    pars.insert( scalePars.begin(), scalePars.end() );
+  }
 
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  for ( pIter par = pars.begin(); par != pars.end(); ++par )
+    if ( ! _parMap.at( par->first ).isFixed() )
+      return false;
 
+  return true;
+}
 
 
-void Decay3BodyMix::cacheNormComponents()
+// The efficiency of the events only needs to be computed once if it is fixed,
+//    and so does their time dependence if the width and the mixing parameters
+//    are. The widths of the time resolution are always cached.
+const std::map< unsigned, std::vector< double > > Decay3BodyMix::cacheReal( const Dataset& data )
 {
-  // If the amplitude is fixed and the components have already
-  //    been computed, just return without recomputing anything.
-  if ( _fixedAmp )
-    return;
-
-  // Compute the value of _norm.
-  _nDir = 0.0;
-  _nCnj = 0.0;
-  _nXed = 0.0;
+  // A fixed efficiency is folded into the amplitudes if these are cached too,
+  //    and not shared with other models.
+  _foldFuncs = isFixedAmp() && ! _funcs.empty() && ! sharesAmplitudes();
 
-  // Define the properties of the integration method.
-  const int    nBins = 400;
-  const double min   = _ps.mSq12min();
-  const double max   = _ps.mSq12max();
-  const double step  = ( max - min ) / double( nBins );
-
-  const double mSqSum = _ps.mSqSum();
+  std::map< unsigned, std::vector< double > > cached;
+  if ( _foldFuncs )
+    _cacheFuncs = false;
+  else
+    cached = cacheFuncs( data );
 
-  // Define the variables at each bin.
-  double mSq12;
-  double mSq13;
-  double mSq23;
+  const std::size_t& size = data.size();
+  const std::size_t  tcol = data.column( _t );
+  const double*      t    = data.valueColumn( tcol );
 
-  double funcs;
-  std::complex< double > ampDir;
-  std::complex< double > ampCnj;
+  const std::vector< double > sigma = resolutionWidths( data );
 
-  // Compute the integral on the grid.
-  for ( int binX = 0; binX < nBins; ++binX )
-    for ( int binY = 0; binY < nBins; ++binY )
+  if ( _resolution )
+  {
+    // The widths are cached with the scale applied if it is fixed, and raw otherwise.
+    _resFixed = true;
+    typedef std::map< std::string, Parameter >::const_iterator pIter;
+    const std::map< std::string, Parameter >& scalePars = _resScale.getPars();
+    for ( pIter par = scalePars.begin(); par != scalePars.end(); ++par )
+      _resFixed &= _parMap.at( par->first ).isFixed();
+
+    _sigmaCache = nextCacheIdxReal();
+    std::vector< double >& widths = cached[ _sigmaCache ];
+    if ( _resFixed )
+      widths = sigma;
+    else
+      widths.assign( data.errorColumn( tcol ), data.errorColumn( tcol ) + size );
+
+    if ( _resFixed )
     {
-      mSq12 = min + step * ( binX + 0.5 );
-      mSq13 = min + step * ( binY + 0.5 );
-      mSq23 = mSqSum - mSq12 - mSq13;
-
-      // Proceed only if the point lies inside the kinematically allowed Dalitz region.
-      // std::norm returns the squared modulus of the complex number, not its norm.
-      if ( _ps.contains( mSq12, mSq13, mSq23 ) )
-      {
-        funcs = evaluateFuncs( mSq12, mSq13, mSq23 );
-        ampDir = _amp.evaluate( _ps, mSq12, mSq13, mSq23 );
-        ampCnj = _amp.evaluate( _ps, mSq13, mSq12, mSq23 );
-
-        _nDir += std::norm( ampDir ) * funcs;
-        _nCnj += std::norm( ampCnj ) * funcs;
-        _nXed += conj( ampDir ) * ampCnj * funcs;
-      }
+      _gaussCache = nextCacheIdxReal();
+      std::vector< double >& gauss = cached[ _gaussCache ];
+      gauss.resize( size );
+      for ( std::size_t entry = 0; entry < size; ++entry )
+        gauss[ entry ] = ( widths[ entry ] > 0.0 ) ? std::exp( - t[ entry ] * t[ entry ] / ( 2.0 * widths[ entry ] * widths[ entry ] ) ) : 0.0;
     }
+  }
 
-  const double& stepSq = std::pow( step, 2 );
-  _nDir *= stepSq;
-  _nCnj *= stepSq;
-  _nXed *= stepSq;
+  _cacheTime = timeFixed();
+  if ( ! _cacheTime )
+    return cached;
 
-  _fixedAmp = _amp.isFixed();
-}
+  // Get indices for the cached time evolution functions.
+  _psipCache = nextCacheIdxReal();
+  _psimCache = nextCacheIdxReal();
 
+  std::vector< double >& psip = cached[ _psipCache ];
+  std::vector< double >& psim = cached[ _psimCache ];
+  psip.resize( size );
+  psim.resize( size );
 
+  std::vector< std::complex< double > > psii( size );
+  psiBlock( t, _resolution ? sigma.data() : 0, 0, size, psip.data(), psim.data(), psii.data() );
 
-void Decay3BodyMix::cache()
-{
-  // Compute the norm components, only if the amplitude
-  //    is not fixed or they have not yet been computed.
-  cacheNormComponents();
+  return cached;
+}
 
-  _fixedAmp = _amp.isFixed();
 
-  // Calculate the norm.
-  const double&& xval = x();
-  const double&& yval = y();
-  const double&& xSq  = std::pow( xval, 2 );
-  const double&& ySq  = std::pow( yval, 2 );
+const std::vector< double > Decay3BodyMix::resolutionWidths( const Dataset& data ) const throw( PdfException )
+{
+  if ( ! _resolution )
+    return std::vector< double >();
 
-  const std::complex< double >&& qoverp = _qoverp.evaluate();
-  const double&& cpvp                   = ( 1.0 + std::norm( qoverp ) ) / 2.0;
-  const double&& cpvm                   = ( 1.0 - std::norm( qoverp ) ) / 2.0;
+  const double* errors = data.errorColumn( data.column( _t ) );
+  if ( ! errors )
+    throw PdfException( "Decay3BodyMix: the time resolution needs the errors of the decay time in the dataset." );
 
-  _norm  = ( _nDir * cpvp + xval * std::real( _nXed * qoverp ) ) / ( 1.0 - xSq );
-  _norm += ( _nDir * cpvm - yval * std::imag( _nXed * qoverp ) ) / ( 1.0 + ySq );
-  _norm /= gamma();
+  const double scale = _resScale.evaluate();
 
-  return;
+  std::vector< double > sigma( errors, errors + data.size() );
+  for ( std::vector< double >::iterator value = sigma.begin(); value != sigma.end(); ++value )
+    *value *= scale;
+
+  return sigma;
 }
 
 
@@ -263,27 +278,44 @@ const std::map< unsigned, std::vector< std::complex< double > > > Decay3BodyMix:
 
   std::map< unsigned, std::vector< std::complex< double > > > cached;
 
-  if ( ! _cacheAmps )
-    return cached;
+  // The real parts of the time dependence are cached by cacheReal, which is called first.
+  if ( _cacheTime )
+  {
+    _psiiCache = nextCacheIdxComplex();
+
+    const double*               t     = data.valueColumn( data.column( _t ) );
+    const std::vector< double > sigma = resolutionWidths( data );
 
-  // Get an index for the cached complex amplitudes.
-  _ampDirCache = _cacheIdxComplex++;
-  _ampCnjCache = _cacheIdxComplex++;
+    const std::size_t& size = data.size();
+    std::vector< std::complex< double > >& psii = cached[ _psiiCache ];
+    psii.resize( size );
+
+    std::vector< double > psip( size );
+    std::vector< double > psim( size );
+    psiBlock( t, _resolution ? sigma.data() : 0, 0, size, psip.data(), psim.data(), psii.data() );
+  }
 
-  double mSq12;
-  double mSq13;
-  double mSq23;
+  const std::map< unsigned, std::vector< std::complex< double > > > amps = cacheAmplitudes( data );
+  cached.insert( amps.begin(), amps.end() );
 
-  // Cache the direct and conjugated amplitudes for every point in the given dataset.
+  if ( ! _cacheAmps || ! _foldFuncs )
+    return cached;
+
+  const double* mSq12 = data.valueColumn( data.column( _mSq12 ) );
+  const double* mSq13 = data.valueColumn( data.column( _mSq13 ) );
+  const double* mSq23 = data.valueColumn( data.column( _mSq23 ) );
+
+  // Fold the efficiency into the amplitudes. evaluateFuncs clamps it at zero,
+  //    so its square root always exists.
   const std::size_t& size = data.size();
+  std::vector< double > funcs( size );
+  evaluateFuncs( mSq12, mSq13, mSq23, size, funcs.data() );
+
   for ( std::size_t entry = 0; entry < size; ++entry )
   {
-    mSq12 = data.value( _mSq12, entry );
-    mSq13 = data.value( _mSq13, entry );
-    mSq23 = data.value( _mSq23, entry );
-
-    cached[ _ampDirCache ].push_back( _amp.evaluate( _ps, mSq12, mSq13, mSq23 ) );
-    cached[ _ampCnjCache ].push_back( _amp.evaluate( _ps, mSq13, mSq12, mSq23 ) );
+    const double root = std::sqrt( funcs[ entry ] );
+    cached[ _ampDirCache ][ entry ] *= root;
+    cached[ _ampCnjCache ][ entry ] *= root;
   }
 
   return cached;
@@ -305,10 +337,15 @@ const double Decay3BodyMix::evaluateUnnorm( const double& mSq12, const double& m
   const std::complex< double >&& apb2 =          ( ampDir + ampCnj ) / 2.0;
   const std::complex< double >&& amb2 = std::conj( ampDir - ampCnj ) / 2.0;
 
+  double                 psip;
+  double                 psim;
+  std::complex< double > psii;
+  TimeBasis::evaluate( t, gamma(), x(), y(), psip, psim, psii );
+
   double ampSq = 0.0;
-  ampSq += std::norm( apb2 ) * psip( t );
-  ampSq += std::norm( amb2 ) * psim( t );
-  ampSq += 2.0 * std::real( apb2 * amb2 * psii( t ) );
+  ampSq += std::norm( apb2 ) * psip;
+  ampSq += std::norm( amb2 ) * psim;
+  ampSq += 2.0 * std::real( apb2 * amb2 * psii );
 
   return ampSq * evaluateFuncs( mSq12, mSq13, mSq23 );
 }
@@ -347,9 +384,13 @@ const double Decay3BodyMix::evaluate( const std::vector< double >&
                                       const std::vector< double >&                 cacheR,
                                       const std::vector< std::complex< double > >& cacheC ) const throw( PdfException )
 {
-  if ( ! _cacheAmps )
+  if ( ! _cacheAmps && ! _cacheBasis && ! _cacheTime && ! _resolution )
     return evaluate( vars );
 
+  const std::size_t& size = vars.size();
+  if ( ( size != 3 ) && ( size != 4 ) )
+    throw PdfException( "Decay3BodyMix can only take either 3 or 4 arguments." );
+
   std::map< std::string, Variable >::const_iterator&& tpos = _varMap.find( _t );
   if ( tpos == _varMap.end() )
     throw PdfException( "Decay3BodyMix: model does not depend on required variable. This is a bug." );
@@ -357,34 +398,211 @@ const double Decay3BodyMix::evaluate( const std::vector< double >&
   const double& t = vars[ std::distance( _varMap.begin(), tpos ) ];
 
   // Particle decay amplitude.
-  std::complex< double > ampDir = cacheC[ _ampDirCache ];
-  std::complex< double > ampCnj = cacheC[ _ampCnjCache ];
+  std::complex< double > ampDir;
+  std::complex< double > ampCnj;
+  if ( _cacheAmps )
+  {
+    ampDir = cacheC[ _ampDirCache ];
+    ampCnj = cacheC[ _ampCnjCache ];
+  }
+  else if ( _cacheBasis )
+    combineBasis( cacheC, ampDir, ampCnj );
+  else
+  {
+    const double& mSq23 = ( size == 4 ) ? vars[ 2 ] : _ps.mSqSum() - vars[ 0 ] - vars[ 1 ];
+    ampDir = _amp.evaluate( _ps, vars[ 0 ], vars[ 1 ], mSq23 );
+    ampCnj = _amp.evaluate( _ps, vars[ 1 ], vars[ 0 ], mSq23 );
+  }
+
   if ( _hasCPV )
     ampCnj *= _qoverp.evaluate();
 
   const std::complex< double >&& apb2 =          ( ampDir + ampCnj ) / 2.0;
   const std::complex< double >&& amb2 = std::conj( ampDir - ampCnj ) / 2.0;
 
+  // Time evolution functions, unless they are cached.
+  double                 psip;
+  double                 psim;
+  std::complex< double > psii;
+  if ( _cacheTime )
+  {
+    psip = cacheR[ _psipCache ];
+    psim = cacheR[ _psimCache ];
+    psii = cacheC[ _psiiCache ];
+  }
+  else if ( _resolution )
+  {
+    const double  sigma = _resFixed ? cacheR[ _sigmaCache ] : _resScale.evaluate() * cacheR[ _sigmaCache ];
+    const double* gauss = _resFixed ? &cacheR[ _gaussCache ] : 0;
+    psiBlock( &t, &sigma, gauss, 1, &psip, &psim, &psii );
+  }
+  else
+    TimeBasis::evaluate( t, gamma(), x(), y(), psip, psim, psii );
+
   // Calculate the squared amplitude.
   double ampSq = 0.0;
-  ampSq += std::norm( apb2 ) * psip( t );
-  ampSq += std::norm( amb2 ) * psim( t );
-  ampSq += 2.0 * std::real( apb2 * amb2 * psii( t ) );
+  ampSq += std::norm( apb2 ) * psip;
+  ampSq += std::norm( amb2 ) * psim;
+  ampSq += 2.0 * std::real( apb2 * amb2 * psii );
 
-  // Evaluate the efficiency functions. Could be cached if necessary.
+  // Evaluate the efficiency functions, unless they are cached or folded into the amplitudes.
   double funcs;
-  const std::size_t& size = vars.size();
-  if ( size == 3 )
+  if ( _foldFuncs && _cacheAmps )
+    funcs = 1.0;
+  else if ( _cacheFuncs )
+    funcs = cacheR[ _funcsCache ];
+  else if ( size == 3 )
     funcs = evaluateFuncs( vars[ 0 ], vars[ 1 ] );
-  else if ( size == 4 )
-    funcs = evaluateFuncs( vars[ 0 ], vars[ 1 ], vars[ 2 ] );
   else
-    throw PdfException( "Decay3BodyMix can only take either 3 or 4 arguments." );
+    funcs = evaluateFuncs( vars[ 0 ], vars[ 1 ], vars[ 2 ] );
 
   return ampSq * funcs / _norm;
 }
 
 
+void Decay3BodyMix::evaluateBlock( const std::vector< const double*                 >& vars  ,
+                                  const std::vector< const double*                 >& cacheR,
+                                  const std::vector< const std::complex< double >* >& cacheC,
+                                  const std::size_t&                                  n     ,
+                                  double*                                             out    ) const throw( PdfException )
+{
+  check( vars.size() );
+  evaluateUnchecked( vars, cacheR, cacheC, n, out );
+}
+
+
+void Decay3BodyMix::check( const std::size_t& nVars ) const throw( PdfException )
+{
+  if ( ( nVars != 3 ) && ( nVars != 4 ) )
+    throw PdfException( "Decay3BodyMix can only take either 3 or 4 arguments." );
+}
+
+
+void Decay3BodyMix::evaluateUnchecked( const std::vector< const double*                 >& vars  ,
+                                      const std::vector< const double*                 >& cacheR,
+                                      const std::vector< const std::complex< double >* >& cacheC,
+                                      const std::size_t&                                  n     ,
+                                      double*                                             out    ) const
+{
+  const std::size_t& size = vars.size();
+
+  std::map< std::string, Variable >::const_iterator&& tpos = _varMap.find( _t );
+  if ( tpos == _varMap.end() )
+    throw PdfException( "Decay3BodyMix: model does not depend on required variable. This is a bug." );
+
+  const double* t = vars[ std::distance( _varMap.begin(), tpos ) ];
+
+  // Take the amplitudes from the cache, combine their cached basis functions, or
+  //    evaluate them on the whole block at once.
+  std::vector< std::complex< double > > dirBlock;
+  std::vector< std::complex< double > > cnjBlock;
+
+  const std::complex< double >* ampDir = _cacheAmps ? cacheC[ _ampDirCache ] : 0;
+  const std::complex< double >* ampCnj = _cacheAmps ? cacheC[ _ampCnjCache ] : 0;
+
+  if ( _cacheBasis )
+  {
+    dirBlock.resize( n );
+    cnjBlock.resize( n );
+    combineBasis( cacheC, n, dirBlock.data(), cnjBlock.data() );
+
+    ampDir = dirBlock.data();
+    ampCnj = cnjBlock.data();
+  }
+  else if ( ! _cacheAmps )
+  {
+    std::vector< double > mSq23Block;
+    if ( size == 3 )
+    {
+      mSq23Block.resize( n );
+      for ( std::size_t entry = 0; entry < n; ++entry )
+        mSq23Block[ entry ] = _ps.mSqSum() - vars[ 0 ][ entry ] - vars[ 1 ][ entry ];
+    }
+
+    dirBlock.resize( n );
+    cnjBlock.resize( n );
+    _amp.evaluatePair( _ps, vars[ 0 ], vars[ 1 ], ( size == 3 ) ? mSq23Block.data() : vars[ 2 ], n,
+                       dirBlock.data(), cnjBlock.data() );
+
+    ampDir = dirBlock.data();
+    ampCnj = cnjBlock.data();
+  }
+
+  // The parameters are common to all the events of the block.
+  const std::complex< double > qp = _hasCPV ? _qoverp.evaluate() : std::complex< double >( 1.0, 0.0 );
+
+  const double invNorm = 1.0 / _norm;
+
+  // Take the time evolution functions from the cache, or evaluate them on the whole block.
+  std::vector<               double   > psipBlock;
+  std::vector<               double   > psimBlock;
+  std::vector< std::complex< double > > psiiBlock;
+
+  const double*                 psip = _cacheTime ? cacheR[ _psipCache ] : 0;
+  const double*                 psim = _cacheTime ? cacheR[ _psimCache ] : 0;
+  const std::complex< double >* psii = _cacheTime ? cacheC[ _psiiCache ] : 0;
+
+  if ( ! _cacheTime )
+  {
+    std::vector< double > widths;
+    const double* sigma = 0;
+    const double* gauss = 0;
+    if ( _resolution && _resFixed )
+    {
+      sigma = cacheR[ _sigmaCache ];
+      gauss = cacheR[ _gaussCache ];
+    }
+    else if ( _resolution )
+    {
+      const double  scale = _resScale.evaluate();
+      const double* raw   = cacheR[ _sigmaCache ];
+
+      widths.resize( n );
+      for ( std::size_t entry = 0; entry < n; ++entry )
+        widths[ entry ] = scale * raw[ entry ];
+      sigma = widths.data();
+    }
+
+    psipBlock.resize( n );
+    psimBlock.resize( n );
+    psiiBlock.resize( n );
+    psiBlock( t, sigma, gauss, n, psipBlock.data(), psimBlock.data(), psiiBlock.data() );
+
+    psip = psipBlock.data();
+    psim = psimBlock.data();
+    psii = psiiBlock.data();
+  }
+
+  const bool    folded = _foldFuncs && _cacheAmps;
+  const double* effs   = _cacheFuncs ? cacheR[ _funcsCache ] : 0;
+
+  double funcs;
+  double ampSq;
+  for ( std::size_t entry = 0; entry < n; ++entry )
+  {
+    const std::complex< double >&& apb2 =          ( ampDir[ entry ] + qp * ampCnj[ entry ] ) / 2.0;
+    const std::complex< double >&& amb2 = std::conj( ampDir[ entry ] - qp * ampCnj[ entry ] ) / 2.0;
+
+    // Calculate the squared amplitude.
+    ampSq  = std::norm( apb2 ) * psip[ entry ];
+    ampSq += std::norm( amb2 ) * psim[ entry ];
+    ampSq += 2.0 * std::real( apb2 * amb2 * psii[ entry ] );
+
+    // Evaluate the efficiency functions, unless they are cached or folded into the amplitudes.
+    if ( folded )
+      funcs = 1.0;
+    else if ( effs )
+      funcs = effs[ entry ];
+    else if ( size == 3 )
+      funcs = evaluateFuncs( vars[ 0 ][ entry ], vars[ 1 ][ entry ] );
+    else
+      funcs = evaluateFuncs( vars[ 0 ][ entry ], vars[ 1 ][ entry ], vars[ 2 ][ entry ] );
+
+    out[ entry ] = ampSq * funcs * invNorm;
+  }
+}
+
+
 
 const double Decay3BodyMix::project( const std::string& varName, const double& x ) const throw( PdfException )
 {
@@ -408,9 +626,10 @@ const Decay3BodyMix& Decay3BodyMix::operator*=( const Function& right )
   _parMap.insert( parMap.begin(), parMap.end() );
 
   // Append the function to the functions vector.
-  _funcs.push_back( right );
+  appendFunc( right );
 
   // Recompute the norm, since the pdf shape has changed under this operation.
+  _fixedNorm = false;
   cache();
 
   return *this;
@@ -431,9 +650,10 @@ const Decay3BodyMix operator*( Decay3BodyMix left, const Function& right )
   left._parMap.insert( parMap.begin(), parMap.end() );
 
   // Append the function to the functions vector.
-  left._funcs.push_back( right );
+  left.appendFunc( right );
 
   // Recompute the norm, since the pdf shape has changed under this operation.
+  left._fixedNorm = false;
   left.cache();
 
   return left;
@@ -454,9 +674,10 @@ const Decay3BodyMix operator*( const Function& left, Decay3BodyMix right )
   right._parMap.insert( parMap.begin(), parMap.end() );
 
   // Append the function to the functions vector.
-  right._funcs.push_back( left );
+  right.appendFunc( left );
 
   // Recompute the norm, since the pdf shape has changed under this operation.
+  right._fixedNorm = false;
   right.cache();
 
   return right;
@@ -467,10 +688,10 @@ const Decay3BodyMix operator*( const Function& left, Decay3BodyMix right )
 const std::map< std::string, double > Decay3BodyMix::generate() const throw( PdfException )
 {
   // Generate mSq12 and mSq13, and compute mSq23 from these.
-  const double& min12 = std::pow( _ps.m1()      + _ps.m2(), 2 );
-  const double& min13 = std::pow( _ps.m1()      + _ps.m3(), 2 );
-  const double& max12 = std::pow( _ps.mMother() - _ps.m3(), 2 );
-  const double& max13 = std::pow( _ps.mMother() - _ps.m2(), 2 );
+  const double& min12 = _ps.mSq12min();
+  const double& min13 = _ps.mSq13min();
+  const double& max12 = _ps.mSq12max();
+  const double& max13 = _ps.mSq13max();
 
   // Maximum value of the pdf.
   const double& max = _maxPdf * tau();
@@ -1,4 +1,7 @@
 
+#include <limits>
+#include <algorithm>
+
 #include <cfit/math.hh>
 #include <cfit/models/doublecrystalball.hh>
 
@@ -168,6 +171,17 @@ const double DoubleCrystalBall::cumulativeNorm( const double& x ) const
 
 void DoubleCrystalBall::cache()
 {
+  _vmu      = mu();
+  _invSigma = 1.0 / sigma();
+  _valpha   = alpha();
+  _vbeta    = beta();
+  _vn       = n();
+  _vm       = m();
+  _loA      = std::pow( _vn / _valpha, _vn ) * std::exp( - _valpha * _valpha / 2.0 );
+  _loB      = _vn / _valpha - _valpha;
+  _upA      = std::pow( _vm / _vbeta , _vm ) * std::exp( - _vbeta  * _vbeta  / 2.0 );
+  _upB      = _vm / _vbeta  - _vbeta;
+
   // Evaluate the area up to the lower limit (0 if it's -infinity).
   double areaLo = 0.0;
   if ( _hasLower )
@@ -199,7 +213,8 @@ void DoubleCrystalBall::cache()
   }
 
   // Assign the value of the norm as the difference of areas between the upper and lower limits.
-  _norm = areaUp - areaLo;
+  _norm    = areaUp - areaLo;
+  _invNorm = 1.0 / _norm;
 }
 
 
@@ -217,56 +232,31 @@ const std::map< unsigned, std::vector< double > > DoubleCrystalBall::cacheReal(
     return cached;
 
   // Get an index for the cached complex amplitudes.
-  _cacheIdx = _cacheIdxReal++;
+  _cacheIdx = nextCacheIdxReal();
 
-  const std::string& varname = getVar( 0 ).name();
+  const std::size_t  column = data.column( getVar( 0 ).name() );
   const std::size_t& size = data.size();
   for ( std::size_t entry = 0; entry < size; ++entry )
-    cached[ _cacheIdx ].push_back( evaluate( data.value( varname, entry ) ) );
+    cached[ _cacheIdx ].push_back( evaluate( data.value( column, entry ) ) );
 
   return cached;
 }
 
 
 
-// Function to compute the value of the pdf at its core (Gaussian) part.
-const double DoubleCrystalBall::core( const double& x ) const
-{
-  return std::exp( - std::pow( x - mu(), 2 ) / ( 2.0 * std::pow( sigma(), 2 ) ) ) / _norm;
-}
-
-
-// Function to compute the value of the pdf at its lower tail.
-const double DoubleCrystalBall::tailLo( const double& x ) const
-{
-  const double& vmu    = mu   ();
-  const double& vsigma = sigma();
-  const double& valpha = alpha();
-  const double& vn     = n    ();
-
-  const double& alphaSq = std::pow( valpha, 2 );
-
-  const double& num = std::pow( vn, vn ) * std::exp( - alphaSq / 2.0 );
-  const double& den = std::pow( vn - alphaSq - valpha * ( x - vmu ) / vsigma, vn );
-
-  return num / den / _norm;
-}
-
-
-// Function to compute the value of the pdf at its upper tail.
-const double DoubleCrystalBall::tailUp( const double& x ) const
+double DoubleCrystalBall::shape( const double& x ) const
 {
-  const double& vmu    = mu   ();
-  const double& vsigma = sigma();
-  const double& vbeta  = beta ();
-  const double& vm     = m    ();
-
-  const double& betaSq = std::pow( vbeta, 2 );
+  const double t    = ( x - _vmu ) * _invSigma;
+  const double core = std::exp( - t * t / 2.0 );
 
-  const double& num = std::pow( vm, vm ) * std::exp( - betaSq / 2.0 );
-  const double& den = std::pow( vm - betaSq + vbeta * ( x - vmu ) / vsigma, vm );
+  // The bases of the tails are clamped where they are not used, to keep them
+  //    finite: B_lo - t <= n / alpha for t >= - alpha, and likewise upwards.
+  const double baseLo = std::max( _loB - t, _vn / _valpha );
+  const double baseUp = std::max( _upB + t, _vm / _vbeta  );
+  const double tailLo = _loA * std::exp( - _vn * std::log( baseLo ) );
+  const double tailUp = _upA * std::exp( - _vm * std::log( baseUp ) );
 
-  return num / den / _norm;
+  return ( t < - _valpha ? tailLo : t > _vbeta ? tailUp : core ) * _invNorm;
 }
 
 
@@ -279,13 +269,7 @@ const double DoubleCrystalBall::evaluate( const double& x ) const throw( PdfExce
   if ( _hasUpper && ( x > _upper ) )
     return 0.0;
 
-  if ( x < mu() - alpha() * sigma() )
-    return tailLo( x );
-
-  if ( x > mu() + beta() * sigma() )
-    return tailUp( x );
-
-  return core( x );
+  return shape( x );
 }
 
 
@@ -307,6 +291,32 @@ const double DoubleCrystalBall::evaluate( const std::vector< double >&
 
 
 
+void DoubleCrystalBall::evaluateBlock( const std::vector< const double*                 >& vars  ,
+                                       const std::vector< const double*                 >& cacheR,
+                                       const std::vector< const std::complex< double >* >& cacheC,
+                                       const std::size_t&                                  n     ,
+                                       double*                                             out    ) const throw( PdfException )
+{
+  // Take the values from the cache, if they are there.
+  if ( _doCache && ( _cacheIdx < cacheR.size() ) && cacheR[ _cacheIdx ] )
+  {
+    std::copy( cacheR[ _cacheIdx ], cacheR[ _cacheIdx ] + n, out );
+    return;
+  }
+
+  const double* x = vars[ 0 ];
+
+  const double lower = _hasLower ? _lower : - std::numeric_limits< double >::infinity();
+  const double upper = _hasUpper ? _upper :   std::numeric_limits< double >::infinity();
+
+  for ( std::size_t entry = 0; entry < n; ++entry )
+  {
+    const double value = shape( x[ entry ] );
+    out[ entry ] = ( ( x[ entry ] >= lower ) && ( x[ entry ] <= upper ) ) ? value : 0.0;
+  }
+}
+
+
 void DoubleCrystalBall::setParExpr()
 {
   _mu   .setPars( _parMap );
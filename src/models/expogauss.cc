@@ -1,6 +1,7 @@
 
 #include <cfit/models/expogauss.hh>
 #include <cfit/math.hh>
+#include <cfit/adaptiveintegrator.hh>
 
 #include <cfit/random.hh>
 
@@ -120,9 +121,6 @@ void ExpoGauss::cache()
   const double& vmu    = mu();
   const double& vsigma = sigma();
 
-  // If the pdf has limits, define the integration technique.
-  const unsigned& nbin = 300;
-
   // Approximate minus infinity to ( mu - 5 sigma ), which is 5 sigma away from the riseup of the pdf.
   const double& minusInf = vmu - 5.0 * vsigma;
 
@@ -131,12 +129,8 @@ void ExpoGauss::cache()
   if ( _hasUpper )
   {
     const double& lower = _hasLower ? _lower : minusInf;
-    const double& dx    = ( _upper - lower ) / double( nbin );
 
-    _norm = 0.0;
-    for ( double x = lower; x < _upper; x += dx )
-      _norm += expogauss( x );
-    _norm *= dx;
+    _norm = integral( lower, _upper );
 
     return;
   }
@@ -153,11 +147,7 @@ void ExpoGauss::cache()
     }
 
     // Otherwise, integrate from minus infinity to the lower limit.
-    const double& dx = ( _lower - minusInf ) / double( nbin );
-    _norm = 0.0;
-    for ( double x = minusInf; x < _lower; x += dx )
-      _norm += expogauss( x );
-    _norm = 1.0 - _norm * dx;
+    _norm = 1.0 - integral( minusInf, _lower );
 
     return;
   }
@@ -180,7 +170,7 @@ const double ExpoGauss::expogauss( const double& x ) const
   const double& vsigmaSq = std::pow( vsigma, 2 );
 
   const double& expo    = std::exp( - vgamma * ( x - vmu ) + vgammaSq * vsigmaSq / 2.0 );
-  const double& erfFrac = ( 1.0 + std::erf( ( x - vmu - vgamma * vsigmaSq ) / ( vsigma * sqrt2 ) ) ) / 2.0;
+  const double& erfFrac = ( 1.0 + Math::erf( ( x - vmu - vgamma * vsigmaSq ) / ( vsigma * sqrt2 ) ) ) / 2.0;
 
   return expo * erfFrac / _normExpo;
 }
@@ -198,6 +188,47 @@ const double ExpoGauss::evaluate( const std::vector< double >& vars ) const thro
 }
 
 
+void ExpoGauss::evaluateBlock( const std::vector< const double*                 >& vars  ,
+                               const std::vector< const double*                 >& cacheR,
+                               const std::vector< const std::complex< double >* >& cacheC,
+                               const std::size_t&                                  n     ,
+                               double*                                             out    ) const throw( PdfException )
+{
+  const double* x = vars[ 0 ];
+
+  const double vgamma   = gamma();
+  const double vmu      = mu   ();
+  const double vsigma   = sigma();
+  const double vsigmaSq = vsigma * vsigma;
+
+  // exp( - gamma ( x - mu ) + gamma^2 sigma^2 / 2 ) ( 1 + erf( ( x - mu - gamma sigma^2 ) / ( sigma sqrt( 2 ) ) ) ) / 2.
+  const double shift   = vgamma * vgamma * vsigmaSq / 2.0;
+  const double mean    = vmu + vgamma * vsigmaSq;
+  const double invErf  = 1.0 / ( vsigma * std::sqrt( 2.0 ) );
+  const double invNorm = 0.5 / ( _normExpo * _norm );
+
+  // The error functions of the whole block at once.
+  std::vector< double > erfs( n );
+  for ( std::size_t entry = 0; entry < n; ++entry )
+    erfs[ entry ] = ( x[ entry ] - mean ) * invErf;
+
+  Math::erf( &erfs[ 0 ], n, &erfs[ 0 ] );
+
+  for ( std::size_t entry = 0; entry < n; ++entry )
+  {
+    const double& value = x[ entry ];
+
+    if ( ( _hasLower && ( value < _lower ) ) || ( _hasUpper && ( value > _upper ) ) )
+    {
+      out[ entry ] = 0.0;
+      continue;
+    }
+
+    out[ entry ] = std::exp( - vgamma * ( value - vmu ) + shift ) * ( 1.0 + erfs[ entry ] ) * invNorm;
+  }
+}
+
+
 void ExpoGauss::setParExpr()
 {
   _gamma.setPars( _parMap );
@@ -212,16 +243,22 @@ const double ExpoGauss::area( const double& min, const double& max ) const throw
   const double& xmin = _hasLower ? std::max( min, _lower ) : min;
   const double& xmax = _hasUpper ? std::min( max, _upper ) : max;
 
-  // Define the precision.
-  const unsigned& nbin = 300;
-  const double& dx = ( xmax - xmin ) / double( nbin );
+  if ( xmax <= xmin )
+    return 0.0;
 
-  // Do the integral.
-  double retval = 0.0;
-  for ( double x = xmin; x < xmax; x += dx )
-    retval += evaluate( x );
+  return integral( xmin, xmax ) / _norm;
+}
+
+
+const double ExpoGauss::integral( const double& min, const double& max ) const
+{
+  const AdaptiveIntegrator::function_type f = [ this ]( const double* x, const std::size_t& n, double* out )
+  {
+    for ( std::size_t entry = 0; entry < n; ++entry )
+      out[ entry ] = expogauss( x[ entry ] );
+  };
 
-  return retval * dx;
+  return AdaptiveIntegrator().integrate( f, min, max );
 }
 
 
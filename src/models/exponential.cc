@@ -153,6 +153,26 @@ const double Exponential::evaluate( const std::vector< double >& vars ) const th
 }
 
 
+void Exponential::evaluateBlock( const std::vector< const double*                 >& vars  ,
+                                 const std::vector< const double*                 >& cacheR,
+                                 const std::vector< const std::complex< double >* >& cacheC,
+                                 const std::size_t&                                  n     ,
+                                 double*                                             out    ) const throw( PdfException )
+{
+  const double* x = vars[ 0 ];
+
+  const double vgamma  = gamma();
+  const double invNorm = 1.0 / _norm;
+  const double lower   = _hasLower ? _lower : 0.0;
+
+  for ( std::size_t entry = 0; entry < n; ++entry )
+  {
+    const bool inside = ( x[ entry ] >= lower ) && ! ( _hasUpper && ( x[ entry ] > _upper ) );
+    out[ entry ] = inside ? std::exp( - vgamma * x[ entry ] ) * invNorm : 0.0;
+  }
+}
+
+
 void Exponential::setParExpr()
 {
   _gamma.setPars( _parMap );
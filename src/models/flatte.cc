@@ -1,4 +1,5 @@
 
+#include <vector>
 #include <complex>
 #include <cfit/phasespace.hh>
 #include <cfit/models/flatte.hh>
@@ -7,19 +8,61 @@
 
 std::complex< double > Flatte::propagator( const PhaseSpace& ps, const double& mSqAB ) const
 {
-  const std::complex< double > I( 0., 1. );
+  const double& qSqAB = qSq( ps, mSqAB );
 
-  const double& mGamma0 = mGamma();
+  std::complex< double > prop;
+  propagators( ps, &mSqAB, &qSqAB, 1, &prop );
+
+  return prop;
+}
 
-  const double& rho10 = rho( ps, mSq() );
-  const double& rho1  = rho( ps, mSqAB );
-  const double& g1    = gamma1Sq() * rho1 / rho10;
 
-  const double& rho20 = std::sqrt( kallen( mSq(), m02aSq(), m02bSq() ) ) / mSqAB;
-  const double& rho2  = std::sqrt( kallen( mSqAB, m02aSq(), m02bSq() ) ) / mSqAB;
-  const double& g2    = gamma2Sq() * rho2 / rho20;
+void Flatte::propagators( const PhaseSpace& ps, const double* mSqAB, const std::size_t& n,
+                          std::complex< double >* out ) const
+{
+  std::vector< double > qSqAB( n );
+  qSq( ps, mSqAB, n, qSqAB.data() );
 
-  return mGamma0 * gamma1Sq() / ( mSq() - mSqAB - I * mGamma0 * ( g1 + g2 ) * std::pow( blattWeisskopf( ps, mSqAB ), 2 ) );
+  propagators( ps, mSqAB, qSqAB.data(), n, out );
+}
+
+
+void Flatte::propagators( const PhaseSpace& ps, const double* mSqAB, const double* const* kin,
+                          const std::size_t& n, std::complex< double >* out ) const
+{
+  propagators( ps, mSqAB, kin[ 1 ], n, out );
+}
+
+
+// The phase space factor of the first channel is 2 sqrt( qSq / mSqAB ), and the
+//    factors at the mass and the squared Blatt-Weisskopf factors only need the
+//    parameters. mGamma0 gamma1^2 / ( a - i b ) = c ( a + i b ) / ( a^2 + b^2 ).
+void Flatte::propagators( const PhaseSpace& ps, const double* mSqAB, const double* qSq,
+                          const std::size_t& n, std::complex< double >* out ) const
+{
+  std::vector< double > bwSq( n );
+  blattWeisskopfSq( std::pow( q( ps, mSq() ), 2 ), qSq, n, bwSq.data() );
+
+  const double mSq0    = mSq();
+  const double mGamma0 = mGamma();
+  const double coef    = mGamma0 * gamma1Sq();
+  const double mSqA    = m02aSq();
+  const double mSqB    = m02bSq();
+
+  const double g1      = 2. * gamma1Sq() / rho( ps, mSq0 );
+  const double g2      = gamma2Sq() / std::sqrt( kallen( mSq0, mSqA, mSqB ) );
+
+  for ( std::size_t point = 0; point < n; ++point )
+  {
+    const double& s     = mSqAB[ point ];
+    const double  width = g1 * std::sqrt( qSq[ point ] / s ) + g2 * std::sqrt( kallen( s, mSqA, mSqB ) );
+
+    const double re = mSq0 - s;
+    const double im = mGamma0 * width * bwSq[ point ];
+    const double sq = re * re + im * im;
+
+    out[ point ] = std::complex< double >( coef * re / sq, coef * im / sq );
+  }
 }
 
 
@@ -27,4 +70,3 @@ Flatte* Flatte::copy() const
 {
   return new Flatte( *this );
 }
-
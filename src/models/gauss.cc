@@ -159,12 +159,12 @@ const std::map< unsigned, std::vector< double > > Gauss::cacheReal( const Datase
     return cached;
 
   // Get an index for the cached complex amplitudes.
-  _cacheIdx = _cacheIdxReal++;
+  _cacheIdx = nextCacheIdxReal();
 
-  const std::string& varname = getVar( 0 ).name();
+  const std::size_t  column = data.column( getVar( 0 ).name() );
   const std::size_t& size = data.size();
   for ( std::size_t entry = 0; entry < size; ++entry )
-    cached[ _cacheIdx ].push_back( evaluate( data.value( varname, entry ) ) );
+    cached[ _cacheIdx ].push_back( evaluate( data.value( column, entry ) ) );
 
   return cached;
 }
@@ -193,6 +193,33 @@ const double Gauss::evaluate( const std::vector< double >&                 vars
 }
 
 
+void Gauss::evaluateBlock( const std::vector< const double*                 >& vars  ,
+                           const std::vector< const double*                 >& cacheR,
+                           const std::vector< const std::complex< double >* >& cacheC,
+                           const std::size_t&                                  n     ,
+                           double*                                             out    ) const throw( PdfException )
+{
+  // Take the values from the cache, if they are there.
+  if ( _doCache && ( _cacheIdx < cacheR.size() ) && cacheR[ _cacheIdx ] )
+  {
+    std::copy( cacheR[ _cacheIdx ], cacheR[ _cacheIdx ] + n, out );
+    return;
+  }
+
+  const double* x = vars[ 0 ];
+
+  const double vmu     = mu();
+  const double factor  = - 0.5 / std::pow( sigma(), 2 );
+  const double invNorm = 1.0 / _norm;
+
+  for ( std::size_t entry = 0; entry < n; ++entry )
+  {
+    const double diff = x[ entry ] - vmu;
+    out[ entry ] = std::exp( factor * diff * diff ) * invNorm;
+  }
+}
+
+
 void Gauss::setParExpr()
 {
   _mu   .setPars( _parMap );
@@ -133,7 +133,7 @@ void GenArgus::cache()
 
   // Since gamma_p( a, x ) is normalized to Gamma( a ), multiply by Gamma( p + 1 ).
   _norm  = cSq / ( 2.0 * chiPow ) * Math::gamma( pPlus1 );
-  _norm *= ( Math::gamma_p( pPlus1, chiSq * argmax ) - Math::gamma_p( pPlus1, chiSq * argmin ) );
+  _norm *= ( _gammaP( pPlus1, chiSq * argmax ) - _gammaP( pPlus1, chiSq * argmin ) );
 }
 
 
@@ -169,11 +169,44 @@ const double GenArgus::evaluate( const std::vector< double >& vars ) const throw
 
 
 
+void GenArgus::evaluateBlock( const std::vector< const double*                 >& vars  ,
+                              const std::vector< const double*                 >& cacheR,
+                              const std::vector< const std::complex< double >* >& cacheC,
+                              const std::size_t&                                  n     ,
+                              double*                                             out    ) const throw( PdfException )
+{
+  const double* x = vars[ 0 ];
+
+  const double vc      = c();
+  const double chiSq   = std::pow( chi(), 2 );
+  const double invCSq  = 1.0 / ( vc * vc );
+  const double invNorm = 1.0 / _norm;
+  const double vp      = p();
+
+  for ( std::size_t entry = 0; entry < n; ++entry )
+  {
+    const double& value = x[ entry ];
+
+    if ( ( _hasLower && ( value < _lower ) ) || ( _hasUpper && ( value > _upper ) ) || ( value < 0.0 ) || ( value > vc ) )
+    {
+      out[ entry ] = 0.0;
+      continue;
+    }
+
+    const double diff = 1.0 - value * value * invCSq;
+    out[ entry ] = value * std::pow( diff, vp ) * std::exp( - chiSq * diff ) * invNorm;
+  }
+}
+
+
 void GenArgus::setParExpr()
 {
   _c  .setPars( _parMap );
   _chi.setPars( _parMap );
   _p  .setPars( _parMap );
+
+  // When parameters are set, no cached values are valid anymore.
+  _gammaP.clear();
 }
 
 
@@ -203,12 +236,50 @@ const double GenArgus::area( const double& min, const double& max ) const throw(
 
   // Since gamma_p( a, x ) is normalized to Gamma( a ), multiply by Gamma( p + 1 ).
   double retval = cSq / ( 2.0 * chiPow ) * Math::gamma( pPlus1 );
-  retval *= ( Math::gamma_p( pPlus1, chiSq * argmax ) - Math::gamma_p( pPlus1, chiSq * argmin ) ) / _norm;
+  retval *= ( _gammaP( pPlus1, chiSq * argmax ) - _gammaP( pPlus1, chiSq * argmin ) ) / _norm;
 
   return retval;
 }
 
 
+void GenArgus::areas( const double* min, const double* max, const std::size_t& n, double* out ) const throw( PdfException )
+{
+  const double& vc     = c();
+  const double& cSq    = std::pow( c()  , 2 );
+  const double& chiSq  = std::pow( chi(), 2 );
+  const double& pPlus1 = p() + 1.0;
+
+  // For the specific case when chi = 0, there are no incomplete gamma integrals.
+  if ( ( chiSq == 0.0 ) || ( n == 0 ) )
+  {
+    PdfModel::areas( min, max, n, out );
+    return;
+  }
+
+  const double& lower = _hasLower ? std::max( _lower, 0.0 ) : 0.0;
+  const double& upper = _hasUpper ? std::min( _upper, vc  ) : vc;
+
+  // Arguments of the incomplete gamma integrals at both ends of every interval.
+  std::vector< double > args( 2 * n );
+  for ( std::size_t i = 0; i < n; ++i )
+  {
+    const double& xmin = std::max( min[ i ], lower );
+    const double& xmax = std::min( max[ i ], upper );
+
+    args[ 2 * i     ] = chiSq * ( _hasLower ? 1.0 - std::pow( xmin / vc, 2 ) : 1.0 );
+    args[ 2 * i + 1 ] = chiSq * ( _hasUpper ? 1.0 - std::pow( xmax / vc, 2 ) : 0.0 );
+  }
+
+  std::vector< double > gammas( 2 * n );
+  Math::gamma_p( pPlus1, &args[ 0 ], 2 * n, &gammas[ 0 ] );
+
+  // Since gamma_p( a, x ) is normalized to Gamma( a ), multiply by Gamma( p + 1 ).
+  const double& factor = cSq / ( 2.0 * std::pow( chiSq, pPlus1 ) ) * Math::gamma( pPlus1 );
+  for ( std::size_t i = 0; i < n; ++i )
+    out[ i ] = factor * ( ( gammas[ 2 * i ] - gammas[ 2 * i + 1 ] ) / _norm );
+}
+
+
 const std::map< std::string, double > GenArgus::generate() const throw( PdfException )
 {
   const double& vc     = c();
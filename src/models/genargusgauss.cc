@@ -1,6 +1,7 @@
 
 #include <cfit/models/genargusgauss.hh>
 #include <cfit/math.hh>
+#include <cfit/adaptiveintegrator.hh>
 
 #include <cfit/dataset.hh>
 
@@ -145,7 +146,7 @@ void GenArgusGauss::cache()
 
   // Since gamma_p( a, x ) is normalized to Gamma( a ), multiply by Gamma( p + 1 ).
   _normGenArgus  = cSq / ( 2.0 * chiPow ) * Math::gamma( pPlus1 );
-  _normGenArgus *= ( Math::gamma_p( pPlus1, chiSq ) - Math::gamma_p( pPlus1, 0.0 ) );
+  _normGenArgus *= ( _gammaP( pPlus1, chiSq ) - _gammaP( pPlus1, 0.0 ) );
 
   // Evaluate the norm of the Gaussian.
   _normGauss = sigma() * std::sqrt( 2.0 * M_PI );
@@ -158,16 +159,10 @@ void GenArgusGauss::cache()
   }
 
   // Normalize the pdf if it has limits.
-  _norm = 0.0;
-  const unsigned& nbin = 300;
-  const double& lower  = _hasLower ? std::max( _lower, 0.0 ) : 0.0;
-  const double& upper  = _hasUpper ? std::min( _upper, vc  ) : vc;
+  const double& lower = _hasLower ? std::max( _lower, 0.0 ) : 0.0;
+  const double& upper = _hasUpper ? std::min( _upper, vc  ) : vc;
 
-  const double& dx = ( upper - lower ) / double( nbin );
-  for ( double x = lower; x < upper; x += dx )
-    _norm += genargusgauss( x );
-
-  _norm *= dx;
+  _norm = ( upper > lower ) ? integral( lower, upper ) : 0.0;
 }
 
 
@@ -185,12 +180,12 @@ const std::map< unsigned, std::vector< double > > GenArgusGauss::cacheReal( cons
     return cached;
 
   // Get an index for the cached complex amplitudes.
-  _cacheIdx = _cacheIdxReal++;
+  _cacheIdx = nextCacheIdxReal();
 
-  const std::string& varname = getVar( 0 ).name();
+  const std::size_t  column = data.column( getVar( 0 ).name() );
   const std::size_t& size = data.size();
   for ( std::size_t entry = 0; entry < size; ++entry )
-    cached[ _cacheIdx ].push_back( evaluate( data.value( varname, entry ) ) );
+    cached[ _cacheIdx ].push_back( evaluate( data.value( column, entry ) ) );
 
   return cached;
 }
@@ -302,6 +297,57 @@ const double GenArgusGauss::evaluate( const std::vector< double >&
   return cacheR[ _cacheIdx ];
 }
 
+void GenArgusGauss::evaluateBlock( const std::vector< const double*                 >& vars  ,
+                                   const std::vector< const double*                 >& cacheR,
+                                   const std::vector< const std::complex< double >* >& cacheC,
+                                   const std::size_t&                                  n     ,
+                                   double*                                             out    ) const throw( PdfException )
+{
+  // Take the values from the cache, if they are there.
+  if ( _doCache && ( _cacheIdx < cacheR.size() ) && cacheR[ _cacheIdx ] )
+  {
+    std::copy( cacheR[ _cacheIdx ], cacheR[ _cacheIdx ] + n, out );
+    return;
+  }
+
+  const double* x = vars[ 0 ];
+
+  const double vc     = c();
+  const double vmu    = mu();
+  const double vsigma = sigma();
+
+  // The roots and weights of the Gauss-Chebyshev quadrature of genargusgauss
+  //    and the values of the Argus core at them do not depend on x.
+  const unsigned degree  = 3.0 * vc / vsigma;
+  const unsigned maxRoot = degree / 2;
+
+  std::vector< double > shifts ( maxRoot );
+  std::vector< double > weights( maxRoot );
+  for ( unsigned k = 1; k <= maxRoot; ++k )
+  {
+    const double root   =           std::cos( ( M_PI * k ) / ( degree + 1.0 ) );
+    const double weight = std::pow( std::sin( ( M_PI * k ) / ( degree + 1.0 ) ), 2 ) * M_PI / ( degree + 1.0 );
+
+    shifts [ k - 1 ] = vmu + root * vc;
+    weights[ k - 1 ] = weight * genarguscore( root ) * vc * vc / ( _normGauss * _norm );
+  }
+
+  const double factor = - 0.5 / ( vsigma * vsigma );
+
+  for ( std::size_t entry = 0; entry < n; ++entry )
+  {
+    double integ = 0.0;
+    for ( unsigned k = 0; k < maxRoot; ++k )
+    {
+      const double diff = x[ entry ] - shifts[ k ];
+      integ += weights[ k ] * std::exp( factor * diff * diff );
+    }
+
+    out[ entry ] = integ;
+  }
+}
+
+
 void GenArgusGauss::setParExpr()
 {
   _c    .setPars( _parMap );
@@ -311,7 +357,8 @@ void GenArgusGauss::setParExpr()
   _sigma.setPars( _parMap );
 
   // When parameters are set, no cached values are valid anymore.
-  _areas.clear();
+  _areas .clear();
+  _gammaP.clear();
 }
 
 
@@ -320,26 +367,36 @@ const double GenArgusGauss::area( const double& min, const double& max ) const t
   std::pair< double, double > range = std::make_pair( min, max );
 
   // If any cached value can be used, use it.
-  if ( _areas.count( range ) )
-    return _areas.at( range );
+  {
+    std::lock_guard< std::mutex > guard( _cacheLock );
+    if ( _areas.count( range ) )
+      return _areas.at( range );
+  }
 
   // Set the limits of integration.
   const double& xmin = _hasLower ? std::max( min, _lower ) : min;
   const double& xmax = _hasUpper ? std::min( max, _upper ) : max;
 
-  // Define the precision.
-  const unsigned& nbin = 300;
-  const double& dx = ( xmax - xmin ) / double( nbin );
-
   // Do the integral.
-  double retval = 0.0;
-  for ( double x = xmin; x < xmax; x += dx )
-    retval += evaluate( x );
+  const double retval = ( xmax > xmin ) ? integral( xmin, xmax ) / _norm : 0.0;
 
   // Cache the calculation of the area for this range.
-  _areas[ range ] = retval * dx;
+  std::lock_guard< std::mutex > guard( _cacheLock );
+  _areas[ range ] = retval;
+
+  return retval;
+}
+
+
+const double GenArgusGauss::integral( const double& min, const double& max ) const
+{
+  const AdaptiveIntegrator::function_type f = [ this ]( const double* x, const std::size_t& n, double* out )
+  {
+    for ( std::size_t entry = 0; entry < n; ++entry )
+      out[ entry ] = genargusgauss( x[ entry ] );
+  };
 
-  return retval * dx;
+  return AdaptiveIntegrator().integrate( f, min, max );
 }
 
 
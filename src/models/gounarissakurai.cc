@@ -1,41 +1,108 @@
 
+#include <vector>
 #include <complex>
 #include <cfit/phasespace.hh>
 #include <cfit/models/gounarissakurai.hh>
 
-std::complex< double > GounarisSakurai::propagator( const PhaseSpace& ps, const double& mSqAB ) const
+const GounarisSakurai::Pole GounarisSakurai::pole( const PhaseSpace& ps ) const
 {
-  const std::complex< double > I( 0., 1. );
+  Pole pole;
+
+  pole.qSq      = qSq( ps, mSq() );
+  pole.gsh      = gsh( ps, mSq() );
+  pole.gshPrime = gshprime( ps, mSq() );
+
+  const double& q0 = q( ps, mSq() );
 
-  double gsd = ( 3. / M_PI ) * ( ps.mSq( _resoA ) / qSq( ps, mSq() ) );
-  gsd *= log( ( m() + 2. * q( ps, mSq() ) ) / ( 2. * ps.m( _resoA ) ) );
-  gsd += m() / ( 2. * M_PI * q( ps, mSq() ) ) - ( ps.mSq( _resoA ) * m() ) / ( M_PI * std::pow( q( ps, mSq() ), 3 ) );
+  pole.factor = width() * mSq() / q0;
 
-  std::complex< double > prop = 1. + gsd * width() / mass();
+  double gsd = ( 3. / M_PI ) * ( ps.mSq( _resoA ) / pole.qSq );
+  gsd *= log( ( m() + 2. * q0 ) / ( 2. * ps.m( _resoA ) ) );
+  gsd += m() / ( 2. * M_PI * q0 ) - ( ps.mSq( _resoA ) * m() ) / ( M_PI * std::pow( q0, 3 ) );
 
-  if ( _buggy )
-    prop *= 1. / ( std::pow( mass(), 2 ) - mSqAB + gsf( ps, mSqAB ) - I * std::sqrt( mSqAB ) * runningWidth( ps, mSqAB ) );
-  else
-    prop *= 1. / ( std::pow( mass(), 2 ) - mSqAB + gsf( ps, mSqAB ) - I * mass()             * runningWidth( ps, mSqAB ) );
+  pole.norm = 1. + gsd * width() / mass();
+
+  return pole;
+}
+
+
+std::complex< double > GounarisSakurai::propagator( const PhaseSpace& ps, const double& mSqAB ) const
+{
+  const double& qSqAB  = qSq         ( ps, mSqAB );
+  const double& gshAB  = gsh         ( ps, mSqAB );
+  const double& widths = runningWidth( ps, mSqAB );
+
+  std::complex< double > prop;
+  propagators( pole( ps ), &mSqAB, &qSqAB, &gshAB, &widths, 1, &prop );
 
   return prop;
 }
 
 
-GounarisSakurai* GounarisSakurai::copy() const
+void GounarisSakurai::propagators( const PhaseSpace& ps, const double* mSqAB, const std::size_t& n,
+                                   std::complex< double >* out ) const
 {
-  return new GounarisSakurai( *this );
+  std::vector< double > qSqAB ( n );
+  std::vector< double > gshAB ( n );
+  std::vector< double > widths( n );
+
+  qSq( ps, mSqAB, n, qSqAB.data() );
+  for ( std::size_t point = 0; point < n; ++point )
+    gshAB[ point ] = gsh( ps, mSqAB[ point ] );
+  runningWidth( ps, mSqAB, qSqAB.data(), n, widths.data() );
+
+  propagators( pole( ps ), mSqAB, qSqAB.data(), gshAB.data(), widths.data(), n, out );
 }
 
 
-double GounarisSakurai::gsf( const PhaseSpace& ps, const double& mSq12 ) const
+void GounarisSakurai::propagators( const PhaseSpace& ps, const double* mSqAB, const double* const* kin,
+                                   const std::size_t& n, std::complex< double >* out ) const
 {
-  double factor = width() * std::pow( mass(), 2 ) / q( ps, mSq() );
+  std::vector< double > widths( n );
+  runningWidth( ps, mSqAB, kin[ 1 ], n, widths.data() );
+
+  propagators( pole( ps ), mSqAB, kin[ 1 ], kin[ nCommonKinematics ], widths.data(), n, out );
+}
 
-  double first  = ( qSq( ps, mSq12 ) / qSq( ps, mSq() ) ) * ( gsh( ps, mSq12 ) - gsh( ps, mSq() ) );
-  double second = ( mSq() - mSq12 ) * gshprime( ps, mSq() );
 
-  return factor * ( first + second );
+// norm / ( a - i b ) = norm ( a + i b ) / ( a^2 + b^2 ), with a = m^2 - mSqAB + f( mSqAB ).
+void GounarisSakurai::propagators( const Pole& pole, const double* mSqAB, const double* qSq, const double* gsh,
+                                   const double* width, const std::size_t& n, std::complex< double >* out ) const
+{
+  const double m   = mass();
+  const double mSq = m * m;
+
+  for ( std::size_t point = 0; point < n; ++point )
+  {
+    const double& s   = mSqAB[ point ];
+    const double  gsf = pole.factor * ( ( qSq[ point ] / pole.qSq ) * ( gsh[ point ] - pole.gsh ) + ( mSq - s ) * pole.gshPrime );
+
+    const double re = mSq - s + gsf;
+    const double im = ( _buggy ? std::sqrt( s ) : m ) * width[ point ];
+    const double sq = re * re + im * im;
+
+    out[ point ] = std::complex< double >( pole.norm * re / sq, pole.norm * im / sq );
+  }
+}
+
+
+void GounarisSakurai::kinematics( const PhaseSpace& ps, const double* mSq12, const double* mSq13, const double* mSq23,
+                                  const std::size_t& n, double* const* kin ) const
+{
+  Resonance::kinematics( ps, mSq12, mSq13, mSq23, n, kin );
+
+  const double* mSqAB = pairMass( _noRes, mSq12, mSq13, mSq23 );
+  if ( ! mSqAB )
+    return;
+
+  for ( std::size_t point = 0; point < n; ++point )
+    kin[ nCommonKinematics ][ point ] = gsh( ps, mSqAB[ point ] );
+}
+
+
+GounarisSakurai* GounarisSakurai::copy() const
+{
+  return new GounarisSakurai( *this );
 }
 
 
@@ -54,4 +121,3 @@ double GounarisSakurai::gshprime( const PhaseSpace& ps, const double& mSq12 ) co
 
   return ( first - second ) * gsh( ps, mSq12 ) + second / M_PI;
 }
-
@@ -163,6 +163,52 @@ const double Polynomial::evaluate( const std::vector< double >& vars ) const thr
 
 
 
+void Polynomial::evaluateBlock( const std::vector< const double*                 >& vars  ,
+                                const std::vector< const double*                 >& cacheR,
+                                const std::vector< const std::complex< double >* >& cacheC,
+                                const std::size_t&                                  n     ,
+                                double*                                             out    ) const throw( PdfException )
+{
+  check( vars.size() );
+  evaluateUnchecked( vars, cacheR, cacheC, n, out );
+}
+
+
+void Polynomial::check( const std::size_t& nVars ) const throw( PdfException )
+{
+  if ( ! _hasLower || ! _hasUpper )
+    throw PdfException( "Cannot evaluate polynomial without upper and lower limits defined." );
+}
+
+
+void Polynomial::evaluateUnchecked( const std::vector< const double*                 >& vars  ,
+                                    const std::vector< const double*                 >& cacheR,
+                                    const std::vector< const std::complex< double >* >& cacheC,
+                                    const std::size_t&                                  n     ,
+                                    double*                                             out    ) const
+{
+  const double* x = vars[ 0 ];
+
+  const std::size_t order = _parOrder.size();
+
+  std::vector< double > coefs( order );
+  for ( std::size_t ord = 0; ord < order; ++ord )
+    coefs[ ord ] = coef( ord );
+
+  const double invNorm = 1.0 / _norm;
+
+  // ( 1 + Sum( c_k x^k ) ) / norm, with Horner's rule.
+  for ( std::size_t entry = 0; entry < n; ++entry )
+  {
+    double val = 0.0;
+    for ( std::size_t ord = order; ord > 0; --ord )
+      val = ( val + coefs[ ord - 1 ] ) * x[ entry ];
+
+    out[ entry ] = ( 1.0 + val ) * invNorm;
+  }
+}
+
+
 void Polynomial::setParExpr()
 {
   std::for_each( _coefs.begin(), _coefs.end(),
@@ -1,4 +1,5 @@
 
+#include <vector>
 #include <complex>
 #include <cfit/phasespace.hh>
 #include <cfit/models/relbreitwigner.hh>
@@ -11,6 +12,43 @@ std::complex< double > RelBreitWigner::propagator( const PhaseSpace& ps, const d
 }
 
 
+void RelBreitWigner::propagators( const PhaseSpace& ps, const double* mSqAB, const std::size_t& n,
+                                  std::complex< double >* out ) const
+{
+  std::vector< double > widths( n );
+  runningWidth( ps, mSqAB, n, widths.data() );
+
+  propagators( mSqAB, widths.data(), n, out );
+}
+
+
+void RelBreitWigner::propagators( const PhaseSpace& ps, const double* mSqAB, const double* const* kin,
+                                  const std::size_t& n, std::complex< double >* out ) const
+{
+  std::vector< double > widths( n );
+  runningWidth( ps, mSqAB, kin[ 1 ], n, widths.data() );
+
+  propagators( mSqAB, widths.data(), n, out );
+}
+
+
+// 1 / ( a - i b ) = ( a + i b ) / ( a^2 + b^2 ), without the checks of the complex division.
+void RelBreitWigner::propagators( const double* mSqAB, const double* width, const std::size_t& n,
+                                  std::complex< double >* out ) const
+{
+  const double m   = mass();
+  const double mSq = m * m;
+  for ( std::size_t point = 0; point < n; ++point )
+  {
+    const double re = mSq - mSqAB[ point ];
+    const double im = m * width[ point ];
+    const double sq = re * re + im * im;
+
+    out[ point ] = std::complex< double >( re / sq, im / sq );
+  }
+}
+
+
 RelBreitWigner* RelBreitWigner::copy() const
 {
   return new RelBreitWigner( *this );
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <string>
+#include <algorithm>
 
 #ifdef MPI_ON
 #include <mpi.h>
@@ -12,6 +13,8 @@
 #include <cfit/dataset.hh>
 #include <cfit/pdfmodel.hh>
 #include <cfit/nll.hh>
+#include <cfit/trace.hh>
+#include <cfit/compensatedsum.hh>
 
 
 Nll::Nll( const PdfModel& pdf, const Dataset& data )
@@ -28,69 +31,91 @@ Nll::Nll( const PdfExpr& pdf, const Dataset& data )
 }
 
 
-Nll::Nll( const Nll& nll )
-  : Minimizer( nll )
-{}
+Nll::Nll( const PdfModel& pdf, const DatasetView& data )
+  : Minimizer( pdf, data )
+{
+  _up = 1.0;
+}
 
 
-double Nll::operator()( const std::vector<double>& pars ) const throw( PdfException )
+Nll::Nll( const PdfExpr& pdf, const DatasetView& data )
+  : Minimizer( pdf, data )
 {
-  if ( pars.size() != _pdf->nPars() )
-    throw PdfException( "Number of parameters passed does not match number of required arguments." );
-
-  _pdf->setPars( pars );
+  _up = 1.0;
+}
 
-  // Before evaluating the pdf at all data points, cache anything common to
-  //    all points (usually compute the norm).
-  _pdf->cache();
 
-  // Get the vector of variable names that the pdf depends on.
-  std::vector< std::string > varNames = _pdf->varNames();
+Nll::Nll( const PdfModel& pdf, const std::shared_ptr< const Dataset >& data )
+  : Minimizer( pdf, data )
+{
+  _up = 1.0;
+}
 
-  typedef std::vector< std::string                                     >::const_iterator vIter;
-  typedef std::map   < unsigned, std::vector< double >                 >::const_iterator mrIter;
-  typedef std::map   < unsigned, std::vector< std::complex< double > > >::const_iterator mcIter;
 
-  // Vector of values of the variables that the pdf must be evaluated at, and vectors of cached values.
-  std::vector< double                 > vars;
-  std::vector< double                 > cacheR;
-  std::vector< std::complex< double > > cacheC;
+Nll::Nll( const PdfExpr& pdf, const std::shared_ptr< const Dataset >& data )
+  : Minimizer( pdf, data )
+{
+  _up = 1.0;
+}
 
-  // Allocate memory for the vectors of cached variables.
-  cacheR.reserve( _pdf->nCachedReal()    );
-  cacheC.reserve( _pdf->nCachedComplex() );
 
-  // Initialize the value of the nll.
-  double nll = 0.;
+Nll::Nll( const Nll& nll )
+  : Minimizer( nll )
+{}
 
-  double value = 0.;
 
-  // Sum of the terms of the nll.
-  for ( std::size_t n = 0; n < _data.size(); ++n )
-  {
-    // Reset the vector of values of the variables and the previously cached values.
-    vars  .clear();
-    cacheR.clear();
-    cacheC.clear();
+double Nll::operator()( const std::vector<double>& pars ) const throw( PdfException )
+{
+  if ( pars.size() != _pdf->nPars() )
+    throw PdfException( "Number of parameters passed does not match number of required arguments." );
 
-    // Fill the vector of values and sum the terms of the variance.
-    for ( vIter var = varNames.begin(); var != varNames.end(); ++var )
-      vars.push_back( _data.value( *var, n ) );
+  count( _stats.calls );
 
-    for ( mrIter cached = _cacheR.begin(); cached != _cacheR.end(); ++cached )
-      cacheR[ cached->first ] = cached->second[ n ];
+  _pdf->setPars( pars );
 
-    for ( mcIter cached = _cacheC.begin(); cached != _cacheC.end(); ++cached )
-      cacheC[ cached->first ] = cached->second[ n ];
+  // Number of events with a non null value in each block, needed to normalize
+  //    the sum of the logarithms of the shape of the pdf.
+  std::vector< std::size_t > nonNull( ( _data->size() + _blockSize - 1 ) / _blockSize, 0 );
 
-    // Add the term to the nll.
-    value = _pdf->evaluate( vars, cacheR, cacheC );
+  const term_type term = [ & ]( const std::size_t& first, const std::size_t& n, const double* values )
+  {
+    CompensatedSum sum;
+    std::size_t    nTerms = 0;
+    for ( std::size_t entry = 0; entry < n; ++entry )
+      if ( values[ entry ] )
+      {
+        sum += - 2. * log( values[ entry ] );
+        ++nTerms;
+      }
+    nonNull[ first / _blockSize ] = nTerms;
+    return sum.value();
+  };
+
+  double nll = 0.0;
+  if ( _pdf->splitsNorm() && _pdf->changed() )
+  {
+    // The shape of the pdf does not depend on its norm, so the other threads
+    //    of the pool sum the terms of the events while this one computes the
+    //    norm, and 2 log( norm ) is added for each of them once both are done.
+    //    The norm stays on the calling thread, since with MPI it is reduced
+    //    over the processes.
+    nll = sumBlocks( term, true, [ this ]() { update(); } );
+
+    std::size_t nTerms = 0;
+    for ( std::size_t blk = 0; blk < nonNull.size(); ++blk )
+      nTerms += nonNull[ blk ];
+
+    nll += 2. * nTerms * _sampleScale * log( _pdf->normFactor() );
+  }
+  else
+  {
+    // Before evaluating the pdf at all data points, cache anything common to
+    //    all points (usually compute the norm), for the parts of the pdf whose
+    //    parameters have changed since the previous call.
+    update();
 
-    if ( value )
-      nll += - 2. * log( value );
-//       else
-// 	std::cout << "Warning: pdf evaluates to zero for entry " << n
-// 		  << ". Not taking this entry into account for the nll." << std::endl;
+    // Sum of the terms of the nll.
+    nll = sumBlocks( term );
   }
 
   nll += 2.0 * _pdf->yield();
@@ -100,7 +125,11 @@ double Nll::operator()( const std::vector<double>& pars ) const throw( PdfExcept
   //    Add all the pieces up and broadcast them to all the processes.
   double result = 0.0;
   MPI::Comm& world = MPI::COMM_WORLD;
-  world.Allreduce( &nll, &result, 1, MPI::DOUBLE, MPI::SUM );
+  {
+    const Timer timer( profiled( _stats.reduce ) );
+    TRACE_SCOPE( "MPI::Allreduce" );
+    world.Allreduce( &nll, &result, 1, MPI::DOUBLE, MPI::SUM );
+  }
 
   return result;
 #else
@@ -111,3 +140,106 @@ double Nll::operator()( const std::vector<double>& pars ) const throw( PdfExcept
 #endif
 }
 
+
+
+std::vector< double > Nll::gradient( const std::vector< double >& pars ) const throw( PdfException )
+{
+  if ( pars.size() != _pdf->nPars() )
+    throw PdfException( "Number of parameters passed does not match number of required arguments." );
+
+  count( _stats.gradients );
+
+  // Classify the free parameters into those with analytic derivatives and the rest.
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  const std::map< std::string, Parameter >& parMap = _pdf->getPars();
+
+  std::vector< bool > fixed;
+  std::vector< bool > analytic;
+  for ( pIter par = parMap.begin(); par != parMap.end(); ++par )
+  {
+    fixed   .push_back( par->second.isFixed() );
+    analytic.push_back( ! par->second.isFixed() && _pdf->hasGradient( par->first ) );
+  }
+
+  std::vector< double > grad( pars.size(), 0.0 );
+
+  if ( std::find( analytic.begin(), analytic.end(), true ) != analytic.end() )
+  {
+    _pdf->setPars( pars );
+    update();
+    _pdf->cacheGradient();
+
+    // Derivative of - 2 log( pdf ). The yield of the pdfs that provide analytic
+    //    derivatives does not depend on the parameters.
+    grad = sumGradientBlocks( analytic,
+                              []( const std::size_t& first, const std::size_t& n, const double* values, const double* derivs )
+                              {
+                                CompensatedSum sum;
+                                for ( std::size_t entry = 0; entry < n; ++entry )
+                                  if ( values[ entry ] )
+                                    sum += - 2. * derivs[ entry ] / values[ entry ];
+                                return sum.value();
+                              } );
+
+#ifdef MPI_ON
+    // Add up the pieces of the gradient computed by each process.
+    std::vector< double > result( grad.size(), 0.0 );
+    MPI::Comm& world = MPI::COMM_WORLD;
+    {
+      const Timer timer( profiled( _stats.reduce ) );
+      TRACE_SCOPE( "MPI::Allreduce" );
+      world.Allreduce( grad.data(), result.data(), grad.size(), MPI::DOUBLE, MPI::SUM );
+    }
+    grad = result;
+#endif
+  }
+
+  std::vector< bool > numeric( pars.size(), false );
+  for ( std::size_t index = 0; index < pars.size(); ++index )
+    numeric[ index ] = ! fixed[ index ] && ! analytic[ index ];
+
+  if ( std::find( numeric.begin(), numeric.end(), true ) != numeric.end() )
+  {
+    numericGradient( pars, numeric, grad );
+
+    // Leave the pdf at the point where the gradient has been computed.
+    _pdf->setPars( pars );
+    update();
+  }
+
+  return grad;
+}
+
+
+MnUserCovariance Nll::scoreCovariance( const std::vector< double >& pars ) const throw( PdfException )
+{
+  if ( pars.size() != _pdf->nPars() )
+    throw PdfException( "Number of parameters passed does not match number of required arguments." );
+
+  const std::vector< bool > requested = scoreParameters();
+  const std::size_t         nFree     = std::count( requested.begin(), requested.end(), true );
+
+  _pdf->setPars( pars );
+  update();
+  _pdf->cacheGradient();
+
+  std::vector< double > info = sumScoreBlocks( requested, 1, []( const std::size_t&, double* factors ) { factors[ 0 ] = 1.0; } )[ 0 ];
+
+#ifdef MPI_ON
+  // Add up the pieces of the information computed by each process.
+  std::vector< double > result( info.size(), 0.0 );
+  MPI::Comm& world = MPI::COMM_WORLD;
+  {
+    TRACE_SCOPE( "MPI::Allreduce" );
+    world.Allreduce( info.data(), result.data(), info.size(), MPI::DOUBLE, MPI::SUM );
+  }
+  info = result;
+#endif
+
+  // The nll is - 2 log( L ), so the errors given by up = 1 are those of the information.
+  std::vector< double > covariance = invert( info, nFree );
+  for ( std::size_t element = 0; element < covariance.size(); ++element )
+    covariance[ element ] *= up();
+
+  return userCovariance( covariance, nFree );
+}
@@ -0,0 +1,679 @@
+
+#include <vector>
+#include <complex>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <unistd.h>
+
+#ifdef MPI_ON
+#include <mpi.h>
+#endif
+
+#include <cfit/normgrid.hh>
+#include <cfit/filemapping.hh>
+#include <cfit/splitcomplex.hh>
+#include <cfit/trace.hh>
+
+
+void NormGrid::update( const Amplitude&               amp        ,
+                       const eff_type&                eff        ,
+                       const std::vector< unsigned >& effVersions,
+                       const std::vector< double >&   effValues   ) throw( PdfException )
+{
+  if ( ! _shared && ! _nRecent )
+  {
+    compute( amp, eff, effVersions, effValues );
+    return;
+  }
+
+  // Values of the parameters of the amplitude, followed by those of the efficiency.
+  std::vector< double > key;
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  for ( pIter par = amp.getPars().begin(); par != amp.getPars().end(); ++par )
+    key.push_back( par->second.value() );
+  key.insert( key.end(), effValues.begin(), effValues.end() );
+
+  const std::size_t keyHash = hash( key );
+
+  if ( ! _shared )
+  {
+    if ( ! recall( key, keyHash ) )
+    {
+      compute( amp, eff, effVersions, effValues );
+      remember( key, keyHash );
+    }
+    return;
+  }
+
+  // The lock is held while computing, so that the other grids wait for the result.
+  std::lock_guard< std::mutex > guard( _shared->lock );
+
+  if ( ( _shared->points == points() ) && ( _shared->conjugate == _conjugate ) && ( _shared->key == key ) )
+  {
+    _dir = _shared->dir;
+    _cnj = _shared->cnj;
+    _xed = _shared->xed;
+    return;
+  }
+
+  if ( ! recall( key, keyHash ) )
+  {
+    compute( amp, eff, effVersions, effValues );
+    remember( key, keyHash );
+  }
+
+  _shared->points    = points();
+  _shared->conjugate = _conjugate;
+  _shared->key       = key;
+  _shared->dir       = _dir;
+  _shared->cnj       = _cnj;
+  _shared->xed       = _xed;
+}
+
+
+// FNV-1a hash of size bytes.
+static std::size_t fnv( const void* data, const std::size_t& size )
+{
+  const unsigned char* bytes = static_cast< const unsigned char* >( data );
+
+  unsigned long long value = 14695981039346656037ULL;
+  for ( std::size_t byte = 0; byte < size; ++byte )
+    value = ( value ^ bytes[ byte ] ) * 1099511628211ULL;
+
+  return value;
+}
+
+
+std::size_t NormGrid::hash( const std::vector< double >& key )
+{
+  return fnv( key.data(), key.size() * sizeof( double ) );
+}
+
+
+std::size_t NormGrid::hash( const std::string& key )
+{
+  return fnv( key.data(), key.size() );
+}
+
+
+bool NormGrid::recall( const std::vector< double >& key, const std::size_t& hash )
+{
+  typedef std::list< RecentIntegrals >::iterator rIter;
+  for ( rIter recent = _recent.begin(); recent != _recent.end(); ++recent )
+    if ( ( recent->hash == hash ) && ( recent->points == points() ) && ( recent->conjugate == _conjugate ) && ( recent->key == key ) )
+    {
+      _dir = recent->dir;
+      _cnj = recent->cnj;
+      _xed = recent->xed;
+
+      // Move it to the front, as the most recently used.
+      _recent.splice( _recent.begin(), _recent, recent );
+      return true;
+    }
+
+  return false;
+}
+
+
+void NormGrid::remember( const std::vector< double >& key, const std::size_t& hash )
+{
+  if ( ! _nRecent )
+    return;
+
+  if ( _recent.size() >= _nRecent )
+    _recent.pop_back();
+
+  RecentIntegrals recent;
+  recent.hash      = hash;
+  recent.points    = points();
+  recent.conjugate = _conjugate;
+  recent.key       = key;
+  recent.dir       = _dir;
+  recent.cnj       = _cnj;
+  recent.xed       = _xed;
+
+  _recent.push_front( recent );
+}
+
+
+void NormGrid::share( NormGrid& other )
+{
+  if ( ! _shared )
+    _shared = std::make_shared< SharedIntegrals >();
+
+  other._shared = _shared;
+
+  // The integrals can only be shared if they are computed on the same points.
+  other._integ  = _integ;
+  other._sample = _sample;
+}
+
+
+void NormGrid::compute( const Amplitude&               amp        ,
+                        const eff_type&                eff        ,
+                        const std::vector< unsigned >& effVersions,
+                        const std::vector< double >&   effValues   ) throw( PdfException )
+{
+  TRACE_SCOPE( "NormGrid::update" );
+
+  const bool        linear = amp.linear();
+  const std::size_t nBasis = linear ? amp.nBasis() : 1;
+
+  // The shape of a non-linear amplitude depends on all its parameters.
+  std::vector< unsigned > ampVersions;
+  if ( ! linear )
+  {
+    typedef std::map< std::string, Parameter >::const_iterator pIter;
+    for ( pIter par = amp.getPars().begin(); par != amp.getPars().end(); ++par )
+      ampVersions.push_back( par->second.version() );
+  }
+
+  // Integrals read from the file can only be updated by computing everything,
+  //    since the values at the points are missing.
+  if ( _loaded && ( nBasis == _nBasis ) )
+  {
+    bool changed = ( effVersions != _effVersions );
+    for ( std::size_t k = 0; k < nBasis; ++k )
+      changed |= ( ( linear ? amp.basisVersions( k ) : ampVersions ) != _versions[ k ] );
+
+    if ( changed )
+      _points.reset();
+  }
+
+  // New points or a new decomposition invalidate everything.
+  bool all = false;
+  if ( ( points() != _points ) || ( linear != _linear ) || ( nBasis != _nBasis ) )
+  {
+    _points = points();
+    _loaded = false;
+    partition();
+    _linear = linear;
+    _nBasis = nBasis;
+    _versions.assign( nBasis, std::vector< unsigned >() );
+    _effVersions.clear();
+    _effs      .reset();
+    _kinematics.reset();
+
+    // Each basis function is evaluated again into new values, not shared with any copies.
+    _basis.clear();
+    for ( std::size_t k = 0; k < nBasis; ++k )
+    {
+      _basis.push_back( std::make_shared< Basis >() );
+      _basis.back()->dirRe.assign( _points->size(), 0.0 );
+      _basis.back()->dirIm.assign( _points->size(), 0.0 );
+      _basis.back()->cnjRe.assign( _conjugate ? _points->size() : 0, 0.0 );
+      _basis.back()->cnjIm.assign( _conjugate ? _points->size() : 0, 0.0 );
+    }
+
+    all = true;
+  }
+
+  // Take the integrals from the file if it was written with the same key.
+  std::string key;
+  if ( all && ! _file.empty() )
+  {
+    key = fileKey( amp, effValues );
+    if ( load( key ) )
+    {
+      for ( std::size_t k = 0; k < nBasis; ++k )
+        _versions[ k ] = linear ? amp.basisVersions( k ) : ampVersions;
+      _effVersions = effVersions;
+      _loaded      = true;
+
+      combine( amp );
+      return;
+    }
+  }
+
+  const DalitzGrid& grid    = *_points;
+  const std::size_t nPoints = grid.size();
+
+  // The kinematics only depend on the points and on the resonances of the amplitude.
+  const std::size_t nKin = amp.nKinematics();
+  if ( all || ! _kinematics || ( _kinematics->size() != nKin * nPoints ) )
+  {
+    std::vector< double >& kinematics = own( _kinematics );
+    kinematics.resize( nKin * nPoints );
+    _integ.forEachRow( grid, [ & ]( const std::size_t& begin, const std::size_t& n )
+    {
+      std::vector< double* > kin( nKin );
+      for ( std::size_t column = 0; column < nKin; ++column )
+        kin[ column ] = kinematics.data() + column * nPoints + begin;
+
+      amp.kinematics( _ps, grid.mSq12() + begin, grid.mSq13() + begin, grid.mSq23() + begin, n, kin.data() );
+    }, _firstRow, _endRow );
+  }
+
+  // A change of the efficiency requires all the integrals, but not the basis functions.
+  if ( all || ( effVersions != _effVersions ) || ! _effs || ( _effs->size() != nPoints ) )
+  {
+    std::vector< double >& effs = own( _effs );
+    effs.resize( nPoints );
+    _integ.forEachRow( grid, [ & ]( const std::size_t& begin, const std::size_t& n )
+                       { eff( grid.mSq12() + begin, grid.mSq13() + begin, grid.mSq23() + begin, n, effs.data() + begin ); },
+                       _firstRow, _endRow );
+    _effVersions = effVersions;
+
+    all = true;
+  }
+
+  if ( all )
+  {
+    _dirInts.assign( nBasis * nBasis, 0.0 );
+    _cnjInts.assign( nBasis * nBasis, 0.0 );
+    _xedInts.assign( nBasis * nBasis, 0.0 );
+  }
+
+  // Evaluate again the basis functions whose parameters have changed.
+  std::vector< std::size_t > changed;
+  for ( std::size_t k = 0; k < nBasis; ++k )
+  {
+    const std::vector< unsigned >& versions = linear ? amp.basisVersions( k ) : ampVersions;
+    if ( all || ( versions != _versions[ k ] ) )
+    {
+      evaluate( amp, k );
+      _versions[ k ] = versions;
+      changed.push_back( k );
+    }
+  }
+
+  // Integrals of all the basis functions that have changed, one after the other.
+  std::vector< double > ints( changed.size() * nInts(), 0.0 );
+  for ( std::size_t k = 0; k < changed.size(); ++k )
+    integrate( changed[ k ], ints.data() + k * nInts() );
+
+#ifdef MPI_ON
+  // Each process has only computed a piece of the integrals.
+  if ( ! ints.empty() )
+  {
+    std::vector< double > result( ints.size(), 0.0 );
+    MPI::Comm& world = MPI::COMM_WORLD;
+    TRACE_SCOPE( "MPI::Allreduce" );
+    world.Allreduce( ints.data(), result.data(), ints.size(), MPI::DOUBLE, MPI::SUM );
+    ints = result;
+  }
+#endif
+
+  for ( std::size_t k = 0; k < changed.size(); ++k )
+    store( changed[ k ], ints.data() + k * nInts() );
+
+  if ( ! key.empty() )
+    save( key );
+
+  combine( amp );
+}
+
+
+void NormGrid::combine( const Amplitude& amp )
+{
+  std::vector< std::complex< double > > coefs( 1, 1.0 );
+  if ( _linear )
+    amp.coefficients( coefs );
+
+  _dir = quadratic( _dirInts, coefs );
+
+  if ( ! _conjugate )
+    return;
+
+  _cnj = quadratic( _cnjInts, coefs );
+
+  _xed = 0.0;
+  for ( std::size_t k = 0; k < _nBasis; ++k )
+    for ( std::size_t l = 0; l < _nBasis; ++l )
+      _xed += std::conj( coefs[ k ] ) * coefs[ l ] * _xedInts[ k * _nBasis + l ];
+}
+
+
+// Header of the file of integrals, followed by the key and by the integrals
+//    dir, cnj and xed of each pair of basis functions, in native byte order.
+struct NormFileHeader
+{
+  char     magic[ 8 ];
+  uint64_t keySize;
+  uint64_t nBasis;
+  uint64_t conjugate;
+};
+
+static const char normFileMagic[ 8 ] = { 'C', 'F', 'I', 'T', 'N', 'O', 'R', 'M' };
+
+
+const std::string NormGrid::fileKey( const Amplitude& amp, const std::vector< double >& effValues ) const
+{
+  const DalitzGrid& grid = *_points;
+
+  // The points are summarised by a hash of their coordinates and weights.
+  std::vector< double > coords( grid.mSq12(), grid.mSq12() + grid.size() );
+  coords.insert( coords.end(), grid.mSq13(), grid.mSq13() + grid.size() );
+  if ( grid.weighted() )
+    coords.insert( coords.end(), grid.weights(), grid.weights() + grid.size() );
+
+  std::ostringstream key;
+  key.precision( 17 );
+  key << "phasespace " << _ps.mMother() << " " << _ps.m1() << " " << _ps.m2() << " " << _ps.m3() << "\n";
+  key << "points " << grid.size() << " " << hash( coords ) << " " << grid.efficiencyWeighted() << "\n";
+  key << "conjugate " << _conjugate << "\n";
+
+  if ( _linear )
+    for ( std::size_t k = 0; k < _nBasis; ++k )
+      key << "basis " << amp.basisShape( k ) << "\n";
+  else
+  {
+    key << "amplitude " << amp.structure() << "\n";
+    key << "values";
+    typedef std::map< std::string, Parameter >::const_iterator pIter;
+    for ( pIter par = amp.getPars().begin(); par != amp.getPars().end(); ++par )
+      key << " " << par->first << "=" << par->second.value();
+    key << "\n";
+  }
+
+  // The efficiency may have large tables, which only enter through a hash.
+  key << "efficiency " << hash( _effShape );
+  for ( std::size_t value = 0; value < effValues.size(); ++value )
+    key << " " << effValues[ value ];
+  key << "\n";
+
+  return key.str();
+}
+
+
+bool NormGrid::load( const std::string& key )
+{
+  std::size_t                   size;
+  std::shared_ptr< const void > mapping;
+  try
+  {
+    mapping = FileMapping::map( _file, size );
+  }
+  catch ( DataException& )
+  {
+    return false;
+  }
+
+  const std::size_t nPairs = _nBasis * _nBasis;
+  const std::size_t bytes  = sizeof( NormFileHeader ) + key.size() + 3 * nPairs * sizeof( std::complex< double > );
+  if ( size != bytes )
+    return false;
+
+  const char*           data   = static_cast< const char* >( mapping.get() );
+  const NormFileHeader& header = *reinterpret_cast< const NormFileHeader* >( data );
+  if ( std::memcmp( header.magic, normFileMagic, sizeof( normFileMagic ) ) ||
+       ( header.keySize != key.size() ) || ( header.nBasis != _nBasis ) || ( header.conjugate != _conjugate ) ||
+       key.compare( 0, key.size(), data + sizeof( NormFileHeader ), key.size() ) )
+    return false;
+
+  const std::complex< double >* ints = reinterpret_cast< const std::complex< double >* >( data + sizeof( NormFileHeader ) + key.size() );
+  _dirInts.assign( ints             , ints +     nPairs );
+  _cnjInts.assign( ints +     nPairs, ints + 2 * nPairs );
+  _xedInts.assign( ints + 2 * nPairs, ints + 3 * nPairs );
+
+  return true;
+}
+
+
+// The file is written to a temporary one first, that is then renamed, so that
+//    jobs started at the same time never read half of it. Failing to write it
+//    only means that the next job computes the integrals again.
+void NormGrid::save( const std::string& key ) const
+{
+#ifdef MPI_ON
+  if ( MPI::COMM_WORLD.Get_rank() != 0 )
+    return;
+#endif
+
+  std::ostringstream temp;
+  temp << _file << ".tmp" << getpid();
+
+  NormFileHeader header;
+  std::memcpy( header.magic, normFileMagic, sizeof( normFileMagic ) );
+  header.keySize   = key.size();
+  header.nBasis    = _nBasis;
+  header.conjugate = _conjugate;
+
+  {
+    std::ofstream out( temp.str().c_str(), std::ios::binary | std::ios::trunc );
+    if ( ! out )
+      return;
+
+    const std::size_t bytes = _dirInts.size() * sizeof( std::complex< double > );
+    out.write( reinterpret_cast< const char* >( &header ), sizeof( header ) );
+    out.write( key.data(), key.size() );
+    out.write( reinterpret_cast< const char* >( _dirInts.data() ), bytes );
+    out.write( reinterpret_cast< const char* >( _cnjInts.data() ), bytes );
+    out.write( reinterpret_cast< const char* >( _xedInts.data() ), bytes );
+    if ( ! out )
+    {
+      out.close();
+      std::remove( temp.str().c_str() );
+      return;
+    }
+  }
+
+  if ( std::rename( temp.str().c_str(), _file.c_str() ) )
+    std::remove( temp.str().c_str() );
+}
+
+
+void NormGrid::partition()
+{
+  const DalitzGrid& grid = *_points;
+
+  _firstRow = 0;
+  _endRow   = grid.nRows();
+
+#ifdef MPI_ON
+  // Give each process the rows that start in its share of the points.
+  const MPI::Comm& world = MPI::COMM_WORLD;
+  const std::size_t size = world.Get_size();
+  const std::size_t rank = world.Get_rank();
+
+  const auto firstRow = [ & ]( const std::size_t& proc )
+  {
+    std::size_t row = 0;
+    while ( ( row < grid.nRows() ) && ( grid.rowBegin( row ) * size < grid.size() * proc ) )
+      ++row;
+    return row;
+  };
+
+  _firstRow = firstRow( rank );
+  _endRow   = ( rank + 1 < size ) ? firstRow( rank + 1 ) : grid.nRows();
+#endif
+}
+
+
+void NormGrid::evaluate( const Amplitude& amp, const std::size_t& k ) throw( PdfException )
+{
+  const DalitzGrid& grid    = *_points;
+  const std::size_t nPoints = grid.size();
+
+  // The cached kinematics are split in columns of nPoints values.
+  if ( nPoints == 0 )
+    throw PdfException( "NormGrid: cannot evaluate the amplitude on a grid without points." );
+
+  Basis& basis = own( _basis[ k ] );
+
+  double* dirRe = basis.dirRe.data();
+  double* dirIm = basis.dirIm.data();
+  double* cnjRe = _conjugate ? basis.cnjRe.data() : 0;
+  double* cnjIm = _conjugate ? basis.cnjIm.data() : 0;
+
+  // On a grid, the conjugated value at a point is the direct one at its mirror
+  //    image, so only the points without one need to be evaluated again. The
+  //    mirror images of the points of a process are in the rows of the others.
+  const bool mirrors = _conjugate && grid.hasMirrors() && ( _firstRow == 0 ) && ( _endRow == grid.nRows() );
+
+  _integ.forEachRow( grid, [ & ]( const std::size_t& begin, const std::size_t& n )
+  {
+    const double* mSq12 = grid.mSq12() + begin;
+    const double* mSq13 = grid.mSq13() + begin;
+    const double* mSq23 = grid.mSq23() + begin;
+
+    std::vector< std::complex< double > > dir( n );
+    if ( ! _conjugate || mirrors )
+    {
+      const std::size_t nKin = _kinematics->size() / nPoints;
+
+      std::vector< const double* > kin( nKin );
+      for ( std::size_t column = 0; column < nKin; ++column )
+        kin[ column ] = _kinematics->data() + column * nPoints + begin;
+
+      if ( _linear )
+        amp.evaluateBasis( k, _ps, mSq12, mSq13, mSq23, kin.data(), n, dir.data() );
+      else
+        amp.evaluate(         _ps, mSq12, mSq13, mSq23, kin.data(), n, dir.data() );
+    }
+    else
+    {
+      std::vector< std::complex< double > > cnj( n );
+      if ( _linear )
+        amp.evaluateBasisPair( k, _ps, mSq12, mSq13, mSq23, n, dir.data(), cnj.data() );
+      else
+        amp.evaluatePair(         _ps, mSq12, mSq13, mSq23, n, dir.data(), cnj.data() );
+
+      SplitComplex::split( cnj.data(), n, cnjRe + begin, cnjIm + begin );
+    }
+
+    SplitComplex::split( dir.data(), n, dirRe + begin, dirIm + begin );
+  }, _firstRow, _endRow );
+
+  if ( ! mirrors )
+    return;
+
+  _integ.forEachRow( grid, [ & ]( const std::size_t& begin, const std::size_t& n )
+  {
+    std::vector< double > x12;
+    std::vector< double > x13;
+    std::vector< double > x23;
+    std::vector< std::size_t > lonely;
+
+    for ( std::size_t point = begin; point < begin + n; ++point )
+      if ( grid.mirror( point ) != DalitzGrid::noMirror )
+      {
+        cnjRe[ point ] = dirRe[ grid.mirror( point ) ];
+        cnjIm[ point ] = dirIm[ grid.mirror( point ) ];
+      }
+      else
+      {
+        x12.push_back( grid.mSq13()[ point ] );
+        x13.push_back( grid.mSq12()[ point ] );
+        x23.push_back( grid.mSq23()[ point ] );
+        lonely.push_back( point );
+      }
+
+    if ( lonely.empty() )
+      return;
+
+    std::vector< std::complex< double > > values( lonely.size() );
+    if ( _linear )
+      amp.evaluateBasis( k, _ps, x12.data(), x13.data(), x23.data(), lonely.size(), values.data() );
+    else
+      amp.evaluate(         _ps, x12.data(), x13.data(), x23.data(), lonely.size(), values.data() );
+
+    for ( std::size_t point = 0; point < lonely.size(); ++point )
+    {
+      cnjRe[ lonely[ point ] ] = std::real( values[ point ] );
+      cnjIm[ lonely[ point ] ] = std::imag( values[ point ] );
+    }
+  } );
+}
+
+
+void NormGrid::integrate( const std::size_t& k, double* ints ) const
+{
+  const Basis& basisK = *_basis[ k ];
+
+  const double* dirKRe = basisK.dirRe.data();
+  const double* dirKIm = basisK.dirIm.data();
+  const double* cnjKRe = _conjugate ? basisK.cnjRe.data() : 0;
+  const double* cnjKIm = _conjugate ? basisK.cnjIm.data() : 0;
+
+  // Real and imaginary parts of the integrals of basis function k with each
+  //    basis function l: dir, followed by cnj, xed( k, l ) and xed( l, k ).
+  const std::size_t nParts = _conjugate ? 8 : 2;
+
+  const DalitzIntegrator::cached_type integrand =
+    [ & ]( const std::size_t& begin, const std::size_t& n, double* out )
+    {
+      const double* eff = _effs->data() + begin;
+
+      for ( std::size_t l = 0; l < _nBasis; ++l )
+      {
+        const Basis& basisL = *_basis[ l ];
+
+        const double* dirLRe = basisL.dirRe.data() + begin;
+        const double* dirLIm = basisL.dirIm.data() + begin;
+
+        // eff B_k conj( B_l ).
+        double* part = out + l * nParts * n;
+        SplitComplex::product( eff, dirKRe + begin, dirKIm + begin, dirLRe, dirLIm, n, part, part + n );
+
+        if ( ! _conjugate )
+          continue;
+
+        const double* cnjLRe = basisL.cnjRe.data() + begin;
+        const double* cnjLIm = basisL.cnjIm.data() + begin;
+
+        // eff Bc_k conj( Bc_l ), eff conj( B_k ) Bc_l and eff conj( B_l ) Bc_k.
+        SplitComplex::product( eff, cnjKRe + begin, cnjKIm + begin, cnjLRe, cnjLIm, n, part + 2 * n, part + 3 * n );
+        SplitComplex::product( eff, cnjLRe, cnjLIm, dirKRe + begin, dirKIm + begin, n, part + 4 * n, part + 5 * n );
+        SplitComplex::product( eff, cnjKRe + begin, cnjKIm + begin, dirLRe, dirLIm, n, part + 6 * n, part + 7 * n );
+      }
+    };
+
+  _integ.integrateCached( *_points, integrand, nInts(), ints, _firstRow, _endRow );
+}
+
+
+void NormGrid::store( const std::size_t& k, const double* ints )
+{
+  const std::size_t nParts = _conjugate ? 8 : 2;
+
+  for ( std::size_t l = 0; l < _nBasis; ++l )
+  {
+    const double* part = ints + l * nParts;
+
+    const std::complex< double > dir( part[ 0 ], part[ 1 ] );
+    _dirInts[ k * _nBasis + l ] = dir;
+    _dirInts[ l * _nBasis + k ] = std::conj( dir );
+
+    if ( ! _conjugate )
+      continue;
+
+    const std::complex< double > cnj( part[ 2 ], part[ 3 ] );
+    _cnjInts[ k * _nBasis + l ] = cnj;
+    _cnjInts[ l * _nBasis + k ] = std::conj( cnj );
+    _xedInts[ k * _nBasis + l ] = std::complex< double >( part[ 4 ], part[ 5 ] );
+    _xedInts[ l * _nBasis + k ] = std::complex< double >( part[ 6 ], part[ 7 ] );
+  }
+}
+
+
+double NormGrid::quadratic( const std::vector< std::complex< double > >& ints,
+                            const std::vector< std::complex< double > >& coefs ) const
+{
+  std::complex< double > sum = 0.0;
+  for ( std::size_t k = 0; k < _nBasis; ++k )
+    for ( std::size_t l = 0; l < _nBasis; ++l )
+      sum += coefs[ k ] * std::conj( coefs[ l ] ) * ints[ k * _nBasis + l ];
+
+  return std::real( sum );
+}
+
+
+std::size_t NormGrid::memory() const
+{
+  std::size_t bytes = ( ( _effs       ? _effs      ->capacity() : 0 ) +
+                        ( _kinematics ? _kinematics->capacity() : 0 ) ) * sizeof( double );
+
+  typedef std::vector< std::shared_ptr< Basis > >::const_iterator bIter;
+  for ( bIter basis = _basis.begin(); basis != _basis.end(); ++basis )
+    bytes += ( (*basis)->dirRe.capacity() + (*basis)->dirIm.capacity() +
+               (*basis)->cnjRe.capacity() + (*basis)->cnjIm.capacity() ) * sizeof( double );
+
+  bytes += ( _dirInts.capacity() + _cnjInts.capacity() + _xedInts.capacity() ) * sizeof( std::complex< double > );
+
+  return bytes;
+}
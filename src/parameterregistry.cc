@@ -0,0 +1,58 @@
+#include <algorithm>
+
+#include <cfit/parameterregistry.hh>
+
+
+ParameterRegistry::ParameterRegistry( const std::map< std::string, Parameter >& pars )
+{
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  for ( pIter par = pars.begin(); par != pars.end(); ++par )
+  {
+    _names .push_back( par->first          );
+    _values.push_back( par->second.value() );
+  }
+}
+
+
+unsigned ParameterRegistry::index( const std::string& name ) const throw( PdfException )
+{
+  const std::vector< std::string >::const_iterator pos = std::lower_bound( _names.begin(), _names.end(), name );
+  if ( ( pos == _names.end() ) || ( *pos != name ) )
+    throw PdfException( "ParameterRegistry: unexisting parameter " + name + "." );
+
+  return pos - _names.begin();
+}
+
+
+std::vector< unsigned > ParameterRegistry::indices( const std::vector< std::string >& names ) const throw( PdfException )
+{
+  std::vector< unsigned > idx;
+  idx.reserve( names.size() );
+
+  typedef std::vector< std::string >::const_iterator nIter;
+  for ( nIter name = names.begin(); name != names.end(); ++name )
+    idx.push_back( index( *name ) );
+
+  return idx;
+}
+
+
+void ParameterRegistry::set( const std::vector< double >& values ) throw( PdfException )
+{
+  if ( values.size() != _values.size() )
+    throw PdfException( "ParameterRegistry::set: Number of arguments passed does not match number of required arguments." );
+
+  std::copy( values.begin(), values.end(), _values.begin() );
+}
+
+
+void ParameterRegistry::set( const std::map< std::string, Parameter >& pars ) throw( PdfException )
+{
+  if ( pars.size() != _values.size() )
+    throw PdfException( "ParameterRegistry::set: Number of arguments passed does not match number of required arguments." );
+
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  std::vector< double >::iterator value = _values.begin();
+  for ( pIter par = pars.begin(); par != pars.end(); ++par )
+    *value++ = par->second.value();
+}
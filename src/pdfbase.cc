@@ -4,10 +4,13 @@
 #include <algorithm>
 
 #include <cfit/pdfbase.hh>
+#include <cfit/dataset.hh>
 
 
-unsigned PdfBase::_cacheIdxReal    = 0;
-unsigned PdfBase::_cacheIdxComplex = 0;
+thread_local PdfBase::CacheLayout* PdfBase::_layout = 0;
+thread_local PdfBase::CacheLayout  PdfBase::_defaultLayout;
+
+std::atomic< unsigned > PdfBase::_cachePass( 0 );
 
 
 void PdfBase::fix( const std::string& name ) throw( PdfException )
@@ -35,3 +38,165 @@ const std::vector< std::string > PdfBase::varNames() const
   return varNames;
 }
 
+
+
+void PdfBase::check( const std::size_t& nVars ) const throw( PdfException )
+{
+  if ( nVars != _varMap.size() )
+    throw PdfException( "PdfBase::check: Number of arguments passed does not match number of required arguments." );
+}
+
+
+
+bool PdfBase::changed() const
+{
+  if ( _cachedVersions.size() != _parMap.size() )
+    return true;
+
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  std::vector< unsigned >::const_iterator version = _cachedVersions.begin();
+  for ( pIter par = _parMap.begin(); par != _parMap.end(); ++par )
+    if ( par->second.version() != *version++ )
+      return true;
+
+  return false;
+}
+
+
+void PdfBase::update()
+{
+  if ( ! changed() )
+    return;
+
+  cache();
+
+  _cachedVersions.clear();
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  for ( pIter par = _parMap.begin(); par != _parMap.end(); ++par )
+    _cachedVersions.push_back( par->second.version() );
+}
+
+
+void PdfBase::projectBlock( const std::string& varName,
+                            const double*      values ,
+                            const std::size_t& n      ,
+                            double*            out      ) const throw( PdfException )
+{
+  for ( std::size_t point = 0; point < n; ++point )
+    out[ point ] = project( varName, values[ point ] );
+}
+
+
+void PdfBase::projectBlock( const std::string& var1,
+                            const std::string& var2,
+                            const double*      val1,
+                            const double*      val2,
+                            const std::size_t& n   ,
+                            double*            out   ) const throw( PdfException )
+{
+  for ( std::size_t point = 0; point < n; ++point )
+    out[ point ] = project( var1, var2, val1[ point ], val2[ point ] );
+}
+
+
+// Number of points per bin and variable used to integrate the projections.
+static const unsigned nSubBins = 5;
+
+
+void PdfBase::projectHist( const std::string& varName,
+                           const double&      min    ,
+                           const double&      max    ,
+                           const unsigned&    nBins  ,
+                           double*            out      ) const throw( PdfException )
+{
+  if ( ! dependsOn( varName ) )
+  {
+    std::fill( out, out + nBins, 1.0 );
+    return;
+  }
+
+  // Project at all the points at once.
+  const unsigned nPoints = nBins * nSubBins;
+  const double   step    = ( max - min ) / double( nPoints );
+
+  std::vector< double > values( nPoints );
+  std::vector< double > projs ( nPoints );
+  for ( unsigned point = 0; point < nPoints; ++point )
+    values[ point ] = min + step * ( point + 0.5 );
+
+  projectBlock( varName, values.data(), nPoints, projs.data() );
+
+  for ( unsigned bin = 0; bin < nBins; ++bin )
+  {
+    out[ bin ] = 0.0;
+    for ( unsigned sub = 0; sub < nSubBins; ++sub )
+      out[ bin ] += projs[ bin * nSubBins + sub ];
+    out[ bin ] *= step;
+  }
+}
+
+
+void PdfBase::projectHist( const std::string& var1  ,
+                           const double&      min1  ,
+                           const double&      max1  ,
+                           const unsigned&    nBins1,
+                           const std::string& var2  ,
+                           const double&      min2  ,
+                           const double&      max2  ,
+                           const unsigned&    nBins2,
+                           double*            out     ) const throw( PdfException )
+{
+  const bool dep1 = dependsOn( var1 );
+  const bool dep2 = dependsOn( var2 );
+
+  // If the pdf depends on at most one of the variables, the histogram is
+  //    the one dimensional one repeated along the other variable.
+  if ( ! ( dep1 && dep2 ) )
+  {
+    std::vector< double > hist1( nBins1, 1.0 );
+    std::vector< double > hist2( nBins2, 1.0 );
+    if ( dep1 )
+      projectHist( var1, min1, max1, nBins1, hist1.data() );
+    if ( dep2 )
+      projectHist( var2, min2, max2, nBins2, hist2.data() );
+
+    for ( unsigned bin1 = 0; bin1 < nBins1; ++bin1 )
+      for ( unsigned bin2 = 0; bin2 < nBins2; ++bin2 )
+        out[ bin1 * nBins2 + bin2 ] = hist1[ bin1 ] * hist2[ bin2 ];
+
+    return;
+  }
+
+  const unsigned nPoints1 = nBins1 * nSubBins;
+  const unsigned nPoints2 = nBins2 * nSubBins;
+  const double   step1    = ( max1 - min1 ) / double( nPoints1 );
+  const double   step2    = ( max2 - min2 ) / double( nPoints2 );
+
+  std::vector< double > val1 ( nPoints1 * nPoints2 );
+  std::vector< double > val2 ( nPoints1 * nPoints2 );
+  std::vector< double > projs( nPoints1 * nPoints2 );
+  for ( unsigned point1 = 0; point1 < nPoints1; ++point1 )
+    for ( unsigned point2 = 0; point2 < nPoints2; ++point2 )
+    {
+      val1[ point1 * nPoints2 + point2 ] = min1 + step1 * ( point1 + 0.5 );
+      val2[ point1 * nPoints2 + point2 ] = min2 + step2 * ( point2 + 0.5 );
+    }
+
+  projectBlock( var1, var2, val1.data(), val2.data(), projs.size(), projs.data() );
+
+  std::fill( out, out + nBins1 * nBins2, 0.0 );
+  for ( unsigned point1 = 0; point1 < nPoints1; ++point1 )
+    for ( unsigned point2 = 0; point2 < nPoints2; ++point2 )
+      out[ ( point1 / nSubBins ) * nBins2 + point2 / nSubBins ] += projs[ point1 * nPoints2 + point2 ];
+
+  for ( unsigned bin = 0; bin < nBins1 * nBins2; ++bin )
+    out[ bin ] *= step1 * step2;
+}
+
+
+
+void PdfBase::generate( const std::size_t& n, Dataset& data ) const throw( PdfException )
+{
+  for ( std::size_t event = 0; event < n; ++event )
+    data.push( generate() );
+}
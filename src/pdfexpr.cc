@@ -4,6 +4,7 @@
 #include <stack>
 #include <cmath>
 #include <random>
+#include <chrono>
 
 #include <Minuit/FunctionMinimum.h>
 #include <Minuit/MnUserParameters.h>
@@ -14,6 +15,9 @@
 #include <cfit/pdfmodel.hh>
 #include <cfit/pdfexpr.hh>
 #include <cfit/operation.hh>
+#include <cfit/dataset.hh>
+#include <cfit/region.hh>
+#include <cfit/trace.hh>
 
 #include <cfit/random.hh>
 
@@ -34,6 +38,26 @@ PdfExpr::PdfExpr( const PdfExpr& right )
 
   _limits = right._limits;
   _scale  = right._scale;
+
+  _tape      = right._tape;
+  _pdfVars   = right._pdfVars;
+  _parValues = right._parValues;
+  _depth     = right._depth;
+  _valid     = right._valid;
+
+  _areas        = right._areas;
+  _areaVersions = right._areaVersions;
+
+  // A copy of a profiled expression is profiled with its own counters.
+  if ( right._times )
+    setProfiling();
+}
+
+
+PdfExpr::PdfExpr( PdfExpr&& right )
+  : _scale( 1.0 ), _depth( 0 ), _valid( false )
+{
+  *this = std::move( right );
 }
 
 
@@ -64,6 +88,84 @@ void PdfExpr::clear()
   _pdfs.clear();
 
   _expression.clear();
+
+  compile();
+}
+
+
+void PdfExpr::compile() throw( PdfException )
+{
+  _tape   .clear();
+  _pdfVars.clear();
+
+  // The indices of the models may have changed.
+  _areas       .assign( _pdfs.size(), area_map()                );
+  _areaVersions.assign( _pdfs.size(), std::vector< unsigned >() );
+
+  std::size_t depth = 0;
+  _depth = 0;
+
+  unsigned pdf = 0;
+  unsigned par = 0;
+  unsigned ctt = 0;
+  unsigned ops = 0;
+
+  typedef std::map< std::string, Variable >::const_iterator vIter;
+  typedef std::string::const_iterator eIter;
+  for ( eIter ch = _expression.begin(); ch != _expression.end(); ++ch )
+  {
+    if ( *ch == 'm' )
+    {
+      // Resolve the positions of the variables of the model in the vector of variables of the expression.
+      std::vector< std::size_t > pdfVars;
+      const std::map< std::string, Variable >& vars = _pdfs[ pdf ]->_varMap;
+      for ( vIter var = vars.begin(); var != vars.end(); ++var )
+        pdfVars.push_back( std::distance( _varMap.begin(), _varMap.find( var->first ) ) );
+      _pdfVars.push_back( pdfVars );
+
+      _tape.push_back( Instruction( Instruction::model, pdf++ ) );
+      ++depth;
+    }
+    else if ( *ch == 'p' )
+    {
+      _tape.push_back( Instruction( Instruction::param, par++ ) );
+      ++depth;
+    }
+    else if ( *ch == 'c' )
+    {
+      _tape.push_back( Instruction( Instruction::ctnt, ctt++ ) );
+      ++depth;
+    }
+    else if ( *ch == 'b' )
+    {
+      if ( depth < 2 )
+        throw PdfException( "Parse error: not enough values in the stack." );
+      _tape.push_back( Instruction( Instruction::binary, ops++ ) );
+      --depth;
+    }
+    else if ( *ch == 'u' )
+    {
+      if ( depth < 1 )
+        throw PdfException( "Parse error: not enough values in the stack." );
+      _tape.push_back( Instruction( Instruction::unary, ops++ ) );
+    }
+    else
+      throw PdfException( std::string( "Parse error: unknown operation " ) + *ch + "." );
+
+    _depth = std::max( _depth, depth );
+  }
+
+  _valid = ( depth == 1 );
+
+  bindPars();
+}
+
+
+void PdfExpr::bindPars()
+{
+  _parValues.resize( _parms.size() );
+  for ( std::size_t par = 0; par < _parms.size(); ++par )
+    _parValues[ par ] = _parMap.find( _parms[ par ].name() )->second.value();
 }
 
 
@@ -75,6 +177,8 @@ void PdfExpr::append( const PdfModel& model )
   _pdfs.push_back( model.copy() );
 
   _expression += "m"; // m = model.
+
+  compile();
 }
 
 
@@ -91,6 +195,8 @@ void PdfExpr::append( const PdfExpr& pdf )
                   std::back_inserter( _pdfs ), std::mem_fun( &PdfModel::copy ) );
 
   _expression += pdf._expression;
+
+  compile();
 }
 
 // Append a parameter.
@@ -100,6 +206,8 @@ void PdfExpr::append( const Parameter& par )
   _parms.push_back( par );
 
   _expression += "p"; // p = parameter.
+
+  compile();
 }
 
 // Append a parameter expression.
@@ -112,6 +220,8 @@ void PdfExpr::append( const ParameterExpr& expr )
   _parms.insert( _parms.end(), expr._parms.begin(), expr._parms.end() );
 
   _expression += expr._expression;
+
+  compile();
 }
 
 // Append a constant.
@@ -120,6 +230,8 @@ void PdfExpr::append( const double& ctnt )
   _ctnts.push_back( ctnt );
 
   _expression += "c"; // c = constant.
+
+  compile();
 }
 
 // Append a binary operation. No unary operation should ever be appended.
@@ -128,6 +240,8 @@ void PdfExpr::append( const Operation::Op& oper )
   _opers.push_back( oper );
 
   _expression += "b";
+
+  compile();
 }
 
 
@@ -143,6 +257,9 @@ const PdfExpr& PdfExpr::operator=( const PdfModel& right )
 
 const PdfExpr& PdfExpr::operator=( const PdfExpr& right )
 {
+  if ( &right == this )
+    return *this;
+
   clear();
 
   append( right );
@@ -150,6 +267,46 @@ const PdfExpr& PdfExpr::operator=( const PdfExpr& right )
 }
 
 
+const PdfExpr& PdfExpr::operator=( PdfExpr&& right )
+{
+  if ( &right == this )
+    return *this;
+
+  typedef std::vector< PdfModel* >::iterator mIter;
+  for ( mIter model = _pdfs.begin(); model != _pdfs.end(); ++model )
+    delete *model;
+
+  _varMap         = std::move( right._varMap         );
+  _parMap         = std::move( right._parMap         );
+  _cachedVersions = std::move( right._cachedVersions );
+
+  _expression = std::move( right._expression );
+  _opers      = std::move( right._opers      );
+  _ctnts      = std::move( right._ctnts      );
+  _parms      = std::move( right._parms      );
+  _pdfs       = std::move( right._pdfs       );
+
+  // The models now belong to this expression only.
+  right._pdfs.clear();
+
+  _limits = std::move( right._limits );
+  _scale  = right._scale;
+
+  _tape      = std::move( right._tape      );
+  _pdfVars   = std::move( right._pdfVars   );
+  _parValues = std::move( right._parValues );
+  _depth     = right._depth;
+  _valid     = right._valid;
+
+  _times = std::move( right._times );
+
+  _areas        = std::move( right._areas        );
+  _areaVersions = std::move( right._areaVersions );
+
+  return *this;
+}
+
+
 const PdfExpr& PdfExpr::operator=( const ParameterExpr& right )
 {
   clear();
@@ -296,6 +453,8 @@ void PdfExpr::setPar( const std::string& name, const double& val, const double&
   for ( pdfIter pdf = _pdfs.begin(); pdf != _pdfs.end(); ++pdf )
     if ( (*pdf)->_parMap.count( name ) )
       (*pdf)->_parMap[ name ].set( val, err );
+
+  bindPars();
 }
 
 
@@ -314,6 +473,8 @@ void PdfExpr::setPars( const std::vector< double >& pars ) throw( PdfException )
   typedef std::vector< PdfModel* >::const_iterator pdfIter;
   for ( pdfIter pdf = _pdfs.begin(); pdf != _pdfs.end(); ++pdf )
     (*pdf)->setPars( _parMap );
+
+  bindPars();
 }
 
 
@@ -329,6 +490,8 @@ void PdfExpr::setPars( const std::map< std::string, Parameter >& pars ) throw( P
   typedef std::vector< PdfModel* >::const_iterator pdfIter;
   for ( pdfIter pdf = _pdfs.begin(); pdf != _pdfs.end(); ++pdf )
     (*pdf)->setPars( _parMap );
+
+  bindPars();
 }
 
 
@@ -348,6 +511,8 @@ void PdfExpr::setPars( const FunctionMinimum& min ) throw( PdfException )
   typedef std::vector< PdfModel* >::const_iterator pdfIter;
   for ( pdfIter pdf = _pdfs.begin(); pdf != _pdfs.end(); ++pdf )
     (*pdf)->setPars( _parMap );
+
+  bindPars();
 }
 
 
@@ -357,10 +522,34 @@ void PdfExpr::cache()
   for ( pIter pdf = _pdfs.begin(); pdf != _pdfs.end(); ++pdf )
     (*pdf)->cache();
 
+  // Areas computed before the norms may be wrong.
+  _areas.assign( _pdfs.size(), area_map() );
+
   return;
 }
 
 
+void PdfExpr::update()
+{
+  typedef std::vector< PdfModel* >::const_iterator pIter;
+  for ( pIter pdf = _pdfs.begin(); pdf != _pdfs.end(); ++pdf )
+  {
+    if ( (*pdf)->changed() )
+      _areas[ pdf - _pdfs.begin() ].clear();
+
+    (*pdf)->update();
+  }
+}
+
+
+void PdfExpr::invalidate()
+{
+  typedef std::vector< PdfModel* >::const_iterator pIter;
+  for ( pIter pdf = _pdfs.begin(); pdf != _pdfs.end(); ++pdf )
+    (*pdf)->invalidate();
+}
+
+
 
 const std::map< std::string, double > PdfExpr::generate() const throw( PdfException )
 {
@@ -522,174 +711,482 @@ const std::map< std::string, double > PdfExpr::generateFull() const throw( PdfEx
 }
 
 
-const std::map< unsigned, std::vector< double > > PdfExpr::cacheReal( const Dataset& data )
+void PdfExpr::generate( const std::size_t& n, Dataset& data ) const throw( PdfException )
 {
-  std::map< unsigned, std::vector< double > > cache;
-
-  for ( std::vector< PdfModel* >::iterator pdf = _pdfs.begin(); pdf != _pdfs.end(); ++pdf )
-    insert( cache, (*pdf)->cacheReal( data ) );
-
-  return cache;
-}
-
-
+  if ( _limits.empty() )
+  {
+    generateFull( n, data );
+    return;
+  }
 
-const std::map< unsigned, std::vector< std::complex< double > > > PdfExpr::cacheComplex( const Dataset& data )
-{
-  std::map< unsigned, std::vector< std::complex< double > > > cache;
+  Region region;
+  typedef std::map< std::string, std::pair< double, double > >::const_iterator lIter;
+  for ( lIter lim = _limits.begin(); lim != _limits.end(); ++lim )
+    region.setLimits( lim->first, lim->second );
 
-  for ( std::vector< PdfModel* >::iterator pdf = _pdfs.begin(); pdf != _pdfs.end(); ++pdf )
-    insert( cache, (*pdf)->cacheComplex( data ) );
+  // Generate the events still missing until all of them are within the limits.
+  std::size_t left = n;
+  while ( left )
+  {
+    Dataset full;
+    generateFull( left, full );
 
-  return cache;
+    const DatasetView valid = full.slice( region );
+    data.append( valid );
+    left -= valid.size();
+  }
 }
 
 
-
-const double PdfExpr::evaluate( const std::vector< double >& vars ) const throw( PdfException )
+// Generate n events over the full range of definition of all the models. The
+//    expression is first turned into a tree of sums and products of models, as
+//    in generateFull() for a single event. The events are then split between the
+//    terms of each sum from the top of the tree down, and each model generates
+//    all those of the terms it belongs to at once.
+void PdfExpr::generateFull( const std::size_t& n, Dataset& data ) const throw( PdfException )
 {
-  if ( _varMap.size() != vars.size() )
-    throw PdfException( "PdfExpr::evaluate: Number of arguments passed does not match number of required arguments." );
-
-  // Dictionary of the variable names with the values passed.
-  std::map< std::string, double > localVars;
-  std::vector< double > modelVars;
+  // Node of the tree: a model, or the sum or the product of two nodes. The
+  //    terms of a sum are chosen with probabilities proportional to their weights.
+  struct Node
+  {
+    int    pdf;
+    int    left;
+    int    right;
+    bool   sum;
+    double weight;
+  };
 
-  // Set the local values of the variables.
-  int index = 0;
-  typedef std::map< std::string, Variable >::const_iterator vIter;
-  for ( vIter var = _varMap.begin(); var != _varMap.end(); ++var )
-    localVars[ var->first ] = vars[ index++ ];
+  std::vector< Node > nodes;
 
+  // Values of the expression, and node of each of them, or -1 if they are numbers.
   std::stack< double > values;
+  std::stack< int    > trees;
 
   double x;
   double y;
-  std::vector< PdfModel*     >::const_iterator pdf = _pdfs .begin();
+  int    xtree;
+  int    ytree;
   std::vector< Parameter     >::const_iterator par = _parms.begin();
   std::vector< double        >::const_iterator ctt = _ctnts.begin();
   std::vector< Operation::Op >::const_iterator ops = _opers.begin();
 
+  int pdf = 0;
+
+  Operation::Op op;
+
   typedef std::string::const_iterator eIter;
   for ( eIter ch = _expression.begin(); ch != _expression.end(); ++ch )
+  {
     if ( *ch == 'm' )
     {
-      // Determine the variables that the pdf depends on.
-      modelVars.clear();
-      std::map< std::string, Variable >& pdfVars = (*pdf)->_varMap;
-      for ( vIter var = pdfVars.begin(); var != pdfVars.end(); ++var )
-        modelVars.push_back( localVars.find( var->second.name() )->second );
-
-      // Evaluate the function at the given point.
-      values.push( (*pdf++)->evaluate( modelVars ) );
+      const Node leaf = { pdf++, -1, -1, false, 0.0 };
+      values.push( 1.0 );
+      trees.push( nodes.size() );
+      nodes.push_back( leaf );
     }
     else if ( *ch == 'p' )
+    {
       values.push( _parMap.find( par++->name() )->second.value() );
+      trees.push( -1 );
+    }
     else if ( *ch == 'c' )
+    {
       values.push( *ctt++ );
-    else
+      trees.push( -1 );
+    }
+    else if ( *ch == 'u' )
     {
-      if ( *ch == 'b' )
+      if ( values.empty() )
+        throw PdfException( "Parse error: not enough values in the stack." );
+      if ( trees.top() != -1 )
+        throw PdfException( "Generation error: trying to apply unary operation to a pdf expression." );
+
+      x = values.top();
+      values.pop();
+      values.push( Operation::operate( x, *ops++ ) );
+    }
+    else if ( *ch == 'b' )
+    {
+      if ( values.size() < 2 )
+        throw PdfException( "Parse error: not enough values in the stack." );
+
+      op = *ops++;
+
+      y = values.top();
+      values.pop();
+      x = values.top();
+      values.pop();
+      values.push( Operation::operate( x, y, op ) );
+
+      ytree = trees.top();
+      trees.pop();
+      xtree = trees.top();
+      trees.pop();
+
+      if ( ( xtree == -1 ) && ( ytree == -1 ) )
+        trees.push( -1 );
+      else if ( ( op == Operation::plus ) || ( op == Operation::minus ) )
       {
-        if ( values.size() < 2 )
-          throw PdfException( "Parse error: not enough values in the stack." );
-        y = values.top();
-        values.pop();
-        x = values.top();
-        values.pop();
-        values.push( Operation::operate( x, y, *ops++ ) );
+        if ( ( xtree == -1 ) || ( ytree == -1 ) )
+          throw PdfException( "Generation error: trying to add a number to a pdf expression." );
+
+        if ( op == Operation::plus )
+          if ( ( x < 0 ) || ( y < 0 ) )
+            throw PdfException( "Generation error: negative coefficient multiplying a pdf." );
+
+        if ( op == Operation::minus )
+          if ( ( x < 0 ) || ( y > 0 ) )
+            throw PdfException( "Generation error: negative coefficient multiplying a pdf." );
+
+        const double total = x + std::fabs( y );
+        const Node   sum   = { -1, xtree, ytree, true, ( total > 0.0 ) ? x / total : 0.0 };
+        trees.push( nodes.size() );
+        nodes.push_back( sum );
       }
-      else if ( *ch == 'u' )
+      // Operations not plus or minus. A product with a number leaves the pdf unchanged.
+      else if ( xtree == -1 )
+        trees.push( ytree );
+      else if ( ytree == -1 )
+        trees.push( xtree );
+      else
       {
-        if ( values.empty() )
-          throw PdfException( "Parse error: not enough values in the stack." );
-        x = values.top();
-        values.pop();
-        values.push( Operation::operate( x, *ops++ ) );
+        const Node product = { -1, xtree, ytree, false, 0.0 };
+        trees.push( nodes.size() );
+        nodes.push_back( product );
       }
-      else
-        throw PdfException( std::string( "Parse error: unknown operation " ) + *ch + "." );
     }
+    else
+      throw PdfException( std::string( "Parse error: unknown operation " ) + *ch + "." );
+  }
 
   if ( values.size() != 1 )
     throw PdfException( "PdfExpr parse error: too many values have been supplied." );
 
-  return values.top();
+  if ( trees.top() == -1 )
+    throw PdfException( "Generation error: the expression does not contain any pdf." );
+
+  // The children of a node always come before it, so the events can be split
+  //    going through the nodes backwards.
+  std::vector< std::size_t > counts( nodes.size(), 0 );
+  std::vector< std::size_t > pdfCounts( _pdfs.size(), 0 );
+  counts[ trees.top() ] = n;
+  for ( int node = int( nodes.size() ) - 1; node >= 0; --node )
+  {
+    const Node&        current = nodes[ node ];
+    const std::size_t& count   = counts[ node ];
+
+    if ( current.pdf != -1 )
+      pdfCounts[ current.pdf ] = count;
+    else if ( current.sum )
+    {
+      counts[ current.left  ] = Random::binomial( count, current.weight );
+      counts[ current.right ] = count - counts[ current.left ];
+    }
+    else
+    {
+      counts[ current.left  ] = count;
+      counts[ current.right ] = count;
+    }
+  }
+
+  for ( std::size_t model = 0; model < _pdfs.size(); ++model )
+    if ( pdfCounts[ model ] )
+      _pdfs[ model ]->generate( pdfCounts[ model ], data );
 }
 
 
+const std::map< unsigned, std::vector< double > > PdfExpr::cacheReal( const Dataset& data )
+{
+  std::map< unsigned, std::vector< double > > cache;
 
-const double PdfExpr::evaluate( const std::vector< double                 >& vars  ,
-                                const std::vector< double                 >& cacheR,
-                                const std::vector< std::complex< double > >& cacheC  ) const throw( PdfException )
+  for ( std::vector< PdfModel* >::iterator pdf = _pdfs.begin(); pdf != _pdfs.end(); ++pdf )
+    insert( cache, (*pdf)->cacheReal( data ) );
+
+  return cache;
+}
+
+
+
+const std::map< unsigned, std::vector< std::complex< double > > > PdfExpr::cacheComplex( const Dataset& data )
+{
+  std::map< unsigned, std::vector< std::complex< double > > > cache;
+
+  for ( std::vector< PdfModel* >::iterator pdf = _pdfs.begin(); pdf != _pdfs.end(); ++pdf )
+    insert( cache, (*pdf)->cacheComplex( data ) );
+
+  return cache;
+}
+
+
+
+// Run the compiled tape at a single point. Models are evaluated with the cached
+//    values if given.
+const double PdfExpr::evaluateTape( const std::vector< double                 >&  vars  ,
+                                    const std::vector< double                 >*  cacheR,
+                                    const std::vector< std::complex< double > >*  cacheC  ) const throw( PdfException )
 {
   if ( _varMap.size() != vars.size() )
     throw PdfException( "PdfExpr::evaluate: Number of arguments passed does not match number of required arguments." );
 
-  // Dictionary of the variable names with the values passed.
-  std::map< std::string, double > localVars;
+  if ( ! _valid )
+    throw PdfException( "PdfExpr parse error: too many values have been supplied." );
+
+  // Fixed-depth stack of values.
+  double  local[ 16 ];
+  std::vector< double > heap( ( _depth > 16 ) ? _depth : 0 );
+  double* values = ( _depth > 16 ) ? heap.data() : local;
+
   std::vector< double > modelVars;
 
-  // Set the local values of the variables.
-  int index = 0;
-  typedef std::map< std::string, Variable >::const_iterator vIter;
-  for ( vIter var = _varMap.begin(); var != _varMap.end(); ++var )
-    localVars[ var->first ] = vars[ index++ ];
+  std::size_t top = 0;
+  typedef std::vector< Instruction >::const_iterator tIter;
+  for ( tIter ins = _tape.begin(); ins != _tape.end(); ++ins )
+    switch ( ins->code )
+    {
+    case Instruction::model:
+      {
+        const std::vector< std::size_t >& pdfVars = _pdfVars[ ins->index ];
+        modelVars.resize( pdfVars.size() );
+        for ( std::size_t var = 0; var < pdfVars.size(); ++var )
+          modelVars[ var ] = vars[ pdfVars[ var ] ];
+
+        const PdfModel* pdf = _pdfs[ ins->index ];
+        values[ top++ ] = cacheR ? pdf->evaluate( modelVars, *cacheR, *cacheC ) : pdf->evaluate( modelVars );
+        break;
+      }
+    case Instruction::param:
+      values[ top++ ] = _parValues[ ins->index ];
+      break;
+    case Instruction::ctnt:
+      values[ top++ ] = _ctnts[ ins->index ];
+      break;
+    case Instruction::binary:
+      --top;
+      values[ top - 1 ] = Operation::operate( values[ top - 1 ], values[ top ], _opers[ ins->index ] );
+      break;
+    case Instruction::unary:
+      values[ top - 1 ] = Operation::operate( values[ top - 1 ], _opers[ ins->index ] );
+      break;
+    }
 
-  std::stack< double > values;
+  return values[ 0 ];
+}
 
-  double x;
-  double y;
-  std::vector< PdfModel*     >::const_iterator pdf = _pdfs .begin();
-  std::vector< Parameter     >::const_iterator par = _parms.begin();
-  std::vector< double        >::const_iterator ctt = _ctnts.begin();
-  std::vector< Operation::Op >::const_iterator ops = _opers.begin();
 
-  typedef std::string::const_iterator eIter;
-  for ( eIter ch = _expression.begin(); ch != _expression.end(); ++ch )
-    if ( *ch == 'm' )
+const double PdfExpr::evaluate( const std::vector< double >& vars ) const throw( PdfException )
+{
+  return evaluateTape( vars, 0, 0 );
+}
+
+
+
+const double PdfExpr::evaluate( const std::vector< double                 >& vars  ,
+                                const std::vector< double                 >& cacheR,
+                                const std::vector< std::complex< double > >& cacheC  ) const throw( PdfException )
+{
+  return evaluateTape( vars, &cacheR, &cacheC );
+}
+
+
+// Evaluate a block of events. The compiled tape is run once for the whole block:
+//    each model is evaluated over all the events at once, and the operations
+//    are applied element-wise on a stack of blocks of values.
+void PdfExpr::evaluateBlock( const std::vector< const double*                 >& vars  ,
+                             const std::vector< const double*                 >& cacheR,
+                             const std::vector< const std::complex< double >* >& cacheC,
+                             const std::size_t&                                  n     ,
+                             double*                                             out    ) const throw( PdfException )
+{
+  check( vars.size() );
+  evaluateUnchecked( vars, cacheR, cacheC, n, out );
+}
+
+
+void PdfExpr::check( const std::size_t& nVars ) const throw( PdfException )
+{
+  if ( _varMap.size() != nVars )
+    throw PdfException( "PdfExpr::evaluateBlock: Number of arguments passed does not match number of required arguments." );
+
+  if ( ! _valid )
+    throw PdfException( "PdfExpr parse error: too many values have been supplied." );
+
+  for ( std::size_t pdf = 0; pdf < _pdfs.size(); ++pdf )
+    _pdfs[ pdf ]->check( _pdfVars[ pdf ].size() );
+}
+
+
+void PdfExpr::evaluateUnchecked( const std::vector< const double*                 >& vars  ,
+                                 const std::vector< const double*                 >& cacheR,
+                                 const std::vector< const std::complex< double >* >& cacheC,
+                                 const std::size_t&                                  n     ,
+                                 double*                                             out    ) const
+{
+  std::vector< const double* > modelVars;
+
+  const block_type model = [ & ]( const std::size_t& pdf, double* values )
+  {
+    TRACE_SCOPE( _pdfs[ pdf ]->traceName() );
+
+    const std::vector< std::size_t >& pdfVars = _pdfVars[ pdf ];
+    modelVars.resize( pdfVars.size() );
+    for ( std::size_t var = 0; var < pdfVars.size(); ++var )
+      modelVars[ var ] = vars[ pdfVars[ var ] ];
+
+    if ( ! _times || ( pdf >= _times->size() ) )
     {
-      // Determine the variables that the pdf depends on.
-      modelVars.clear();
-      std::map< std::string, Variable >& pdfVars = (*pdf)->_varMap;
-      for ( vIter var = pdfVars.begin(); var != pdfVars.end(); ++var )
-        modelVars.push_back( localVars.find( var->second.name() )->second );
-
-      // Evaluate the function at the given point.
-      values.push( (*pdf++)->evaluate( modelVars, cacheR, cacheC ) );
+      _pdfs[ pdf ]->evaluateUnchecked( modelVars, cacheR, cacheC, n, values );
+      return;
     }
-    else if ( *ch == 'p' )
-      values.push( _parMap.find( par++->name() )->second.value() );
-    else if ( *ch == 'c' )
-      values.push( *ctt++ );
-    else
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    _pdfs[ pdf ]->evaluateUnchecked( modelVars, cacheR, cacheC, n, values );
+    ( *_times )[ pdf ] += std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::steady_clock::now() - start ).count();
+  };
+
+  runTape( n, out, model );
+}
+
+
+const std::map< std::string, std::size_t > PdfExpr::memory() const
+{
+  std::map< std::string, std::size_t > bytes;
+  for ( std::size_t pdf = 0; pdf < _pdfs.size(); ++pdf )
+  {
+    std::string prefix = _pdfs[ pdf ]->name();
+    if ( prefix.empty() )
     {
-      if ( *ch == 'b' )
-      {
-        if ( values.size() < 2 )
-          throw PdfException( "Parse error: not enough values in the stack." );
-        y = values.top();
-        values.pop();
-        x = values.top();
-        values.pop();
-        values.push( Operation::operate( x, y, *ops++ ) );
-      }
-      else if ( *ch == 'u' )
-      {
-        if ( values.empty() )
-          throw PdfException( "Parse error: not enough values in the stack." );
-        x = values.top();
-        values.pop();
-        values.push( Operation::operate( x, *ops++ ) );
-      }
-      else
-        throw PdfException( std::string( "Parse error: unknown operation " ) + *ch + "." );
+      std::ostringstream index;
+      index << "model " << pdf;
+      prefix = index.str();
     }
 
-  if ( values.size() != 1 )
+    typedef std::map< std::string, std::size_t >::const_iterator mIter;
+    const std::map< std::string, std::size_t > model = _pdfs[ pdf ]->memory();
+    for ( mIter entry = model.begin(); entry != model.end(); ++entry )
+      bytes[ prefix + ": " + entry->first ] += entry->second;
+  }
+
+  return bytes;
+}
+
+
+void PdfExpr::scaleNormSteps( const double& factor )
+{
+  for ( std::size_t pdf = 0; pdf < _pdfs.size(); ++pdf )
+    _pdfs[ pdf ]->scaleNormSteps( factor );
+}
+
+
+void PdfExpr::setProfiling( const bool& val )
+{
+  if ( val )
+    _times = std::make_shared< std::vector< std::atomic< long long > > >( _pdfs.size() );
+  else
+    _times.reset();
+}
+
+
+const std::vector< double > PdfExpr::profile() const
+{
+  std::vector< double > times;
+  if ( _times )
+    for ( std::size_t pdf = 0; pdf < _times->size(); ++pdf )
+      times.push_back( 1e-9 * ( *_times )[ pdf ] );
+
+  return times;
+}
+
+
+void PdfExpr::evaluateTape( const std::size_t& n, double* out, const block_type& model ) const throw( PdfException )
+{
+  if ( ! _valid )
     throw PdfException( "PdfExpr parse error: too many values have been supplied." );
 
-  return values.top();
+  runTape( n, out, model );
+}
+
+
+void PdfExpr::runTape( const std::size_t& n, double* out, const block_type& model ) const
+{
+  // The bottom of the stack is the output array itself.
+  std::vector< double > stack( ( _depth - 1 ) * n );
+  std::vector< double* > values( _depth );
+  values[ 0 ] = out;
+  for ( std::size_t level = 1; level < _depth; ++level )
+    values[ level ] = stack.data() + ( level - 1 ) * n;
+
+  std::size_t top = 0;
+  typedef std::vector< Instruction >::const_iterator tIter;
+  for ( tIter ins = _tape.begin(); ins != _tape.end(); ++ins )
+    switch ( ins->code )
+    {
+    case Instruction::model:
+      model( ins->index, values[ top++ ] );
+      break;
+    case Instruction::param:
+      std::fill( values[ top ], values[ top ] + n, _parValues[ ins->index ] );
+      ++top;
+      break;
+    case Instruction::ctnt:
+      std::fill( values[ top ], values[ top ] + n, _ctnts[ ins->index ] );
+      ++top;
+      break;
+    case Instruction::binary:
+      --top;
+      Operation::operate( values[ top - 1 ], values[ top ], n, _opers[ ins->index ] );
+      break;
+    case Instruction::unary:
+      Operation::operate( values[ top - 1 ], n, _opers[ ins->index ] );
+      break;
+    }
+}
+
+
+void PdfExpr::projectBlock( const std::string& varName,
+                            const double*      values ,
+                            const std::size_t& n      ,
+                            double*            out      ) const throw( PdfException )
+{
+  evaluateTape( n, out, [ & ]( const std::size_t& pdf, double* block )
+                { _pdfs[ pdf ]->projectBlock( varName, values, n, block ); } );
+}
+
+
+void PdfExpr::projectBlock( const std::string& var1,
+                            const std::string& var2,
+                            const double*      val1,
+                            const double*      val2,
+                            const std::size_t& n   ,
+                            double*            out   ) const throw( PdfException )
+{
+  evaluateTape( n, out, [ & ]( const std::size_t& pdf, double* block )
+                { _pdfs[ pdf ]->projectBlock( var1, var2, val1, val2, n, block ); } );
+}
+
+
+void PdfExpr::projectHist( const std::string& varName,
+                           const double&      min    ,
+                           const double&      max    ,
+                           const unsigned&    nBins  ,
+                           double*            out      ) const throw( PdfException )
+{
+  evaluateTape( nBins, out, [ & ]( const std::size_t& pdf, double* block )
+                { _pdfs[ pdf ]->projectHist( varName, min, max, nBins, block ); } );
+}
+
+
+void PdfExpr::projectHist( const std::string& var1  ,
+                           const double&      min1  ,
+                           const double&      max1  ,
+                           const unsigned&    nBins1,
+                           const std::string& var2  ,
+                           const double&      min2  ,
+                           const double&      max2  ,
+                           const unsigned&    nBins2,
+                           double*            out     ) const throw( PdfException )
+{
+  evaluateTape( nBins1 * nBins2, out, [ & ]( const std::size_t& pdf, double* block )
+                { _pdfs[ pdf ]->projectHist( var1, min1, max1, nBins1, var2, min2, max2, nBins2, block ); } );
 }
 
 
@@ -762,6 +1259,55 @@ std::vector< std::string > PdfExpr::commonVars() const throw( PdfException )
 
 
 
+const double PdfExpr::modelArea( const std::size_t& pdf, const std::string& var, const double& min, const double& max,
+                                 const std::function< double() >& compute ) const throw( PdfException )
+{
+  // Drop the areas of the model if any of its parameters has changed.
+  std::vector< unsigned > versions;
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  const std::map< std::string, Parameter >& pars = _pdfs[ pdf ]->getPars();
+  for ( pIter par = pars.begin(); par != pars.end(); ++par )
+    versions.push_back( par->second.version() );
+
+  const std::pair< std::string, std::pair< double, double > > key( var, std::make_pair( min, max ) );
+
+  // The area is computed without holding the lock, so that other threads can
+  //    take the areas already there meanwhile.
+  {
+    std::lock_guard< std::mutex > guard( _areaLock );
+    if ( versions != _areaVersions[ pdf ] )
+    {
+      _areas       [ pdf ].clear();
+      _areaVersions[ pdf ] = versions;
+    }
+
+    area_map::const_iterator cached = _areas[ pdf ].find( key );
+    if ( cached != _areas[ pdf ].end() )
+      return cached->second;
+  }
+
+  const double area = compute ? compute() : _pdfs[ pdf ]->area( min, max );
+
+  std::lock_guard< std::mutex > guard( _areaLock );
+  if ( versions == _areaVersions[ pdf ] )
+    _areas[ pdf ][ key ] = area;
+
+  return area;
+}
+
+
+const double PdfExpr::modelArea( const std::size_t& pdf, const Region& region,
+                                 const std::function< double() >& project ) const throw( PdfException )
+{
+  for ( std::size_t limit = 0; limit < region.size(); ++limit )
+    if ( _pdfs[ pdf ]->dependsOn( region.name( limit ) ) )
+      return modelArea( pdf, region.name( limit ), region.lower( limit ), region.upper( limit ), project );
+
+  return project();
+}
+
+
+
 double PdfExpr::area( const std::string& var, const double& min, const double& max ) const throw( PdfException )
 {
   std::stack< double > values;
@@ -778,12 +1324,10 @@ double PdfExpr::area( const std::string& var, const double& min, const double& m
     if ( *ch == 'm' )
     {
       if ( (*pdf)->dependsOn( var ) )
-        values.push( (*pdf++)->area( min, max ) );
+        values.push( modelArea( pdf - _pdfs.begin(), var, min, max ) );
       else
-      {
         values.push( 1.0 );
-        pdf++;
-      }
+      pdf++;
     }
     else if ( *ch == 'p' )
       values.push( _parMap.find( par++->name() )->second.value() );
@@ -1042,8 +1586,17 @@ const double PdfExpr::project( const std::string& varName,
   typedef std::string::const_iterator eIter;
   for ( eIter ch = _expression.begin(); ch != _expression.end(); ++ch )
     if ( *ch == 'm' )
-      // Project the function at the given point.
-      values.push( (*pdf++)->project( varName, value, region ) );
+    {
+      // Project the function at the given point. If it does not depend on
+      //    the variable, the projection is an area that can be cached.
+      const PdfModel* model = *pdf;
+      if ( model->dependsOn( varName ) )
+        values.push( model->project( varName, value, region ) );
+      else
+        values.push( modelArea( pdf - _pdfs.begin(), region,
+                                [ & ]() { return model->project( varName, value, region ); } ) );
+      pdf++;
+    }
     else if ( *ch == 'p' )
       values.push( _parMap.find( par++->name() )->second.value() );
     else if ( *ch == 'c' )
@@ -1096,8 +1649,17 @@ const double PdfExpr::project( const std::string& var1, const std::string& var2,
   typedef std::string::const_iterator eIter;
   for ( eIter ch = _expression.begin(); ch != _expression.end(); ++ch )
     if ( *ch == 'm' )
-      // Project the function at the given point.
-      values.push( (*pdf++)->project( var1, var2, val1, val2, region ) );
+    {
+      // Project the function at the given point. If it does not depend on
+      //    the variables, the projection is an area that can be cached.
+      const PdfModel* model = *pdf;
+      if ( model->dependsOn( var1 ) || model->dependsOn( var2 ) )
+        values.push( model->project( var1, var2, val1, val2, region ) );
+      else
+        values.push( modelArea( pdf - _pdfs.begin(), region,
+                                [ & ]() { return model->project( var1, var2, val1, val2, region ); } ) );
+      pdf++;
+    }
     else if ( *ch == 'p' )
       values.push( _parMap.find( par++->name() )->second.value() );
     else if ( *ch == 'c' )
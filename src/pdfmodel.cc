@@ -203,7 +203,47 @@ void PdfModel::setPars( const FunctionMinimum& min ) throw( PdfException )
 }
 
 
+void PdfModel::evaluateBlock( const std::vector< const double*                 >& vars  ,
+                              const std::vector< const double*                 >& cacheR,
+                              const std::vector< const std::complex< double >* >& cacheC,
+                              const std::size_t&                                  n     ,
+                              double*                                             out    ) const throw( PdfException )
+{
+  const std::size_t nVars    = vars  .size();
+  const std::size_t nCachedR = cacheR.size();
+  const std::size_t nCachedC = cacheC.size();
+
+  // Vectors reused for all the events in the block.
+  std::vector< double                 > vals  ( nVars    );
+  std::vector< double                 > valsR ( nCachedR );
+  std::vector< std::complex< double > > valsC ( nCachedC );
+
+  for ( std::size_t entry = 0; entry < n; ++entry )
+  {
+    for ( std::size_t var = 0; var < nVars; ++var )
+      vals[ var ] = vars[ var ][ entry ];
+
+    for ( std::size_t idx = 0; idx < nCachedR; ++idx )
+      if ( cacheR[ idx ] )
+        valsR[ idx ] = cacheR[ idx ][ entry ];
+
+    for ( std::size_t idx = 0; idx < nCachedC; ++idx )
+      if ( cacheC[ idx ] )
+        valsC[ idx ] = cacheC[ idx ][ entry ];
+
+    out[ entry ] = evaluate( vals, valsR, valsC );
+  }
+}
+
+
 const double PdfModel::area( const double& min, const double& max ) const throw( PdfException )
 {
   throw PdfException( "You are trying to find the area of a model that does not have this property." );
 }
+
+
+void PdfModel::areas( const double* min, const double* max, const std::size_t& n, double* out ) const throw( PdfException )
+{
+  for ( std::size_t i = 0; i < n; ++i )
+    out[ i ] = area( min[ i ], max[ i ] );
+}
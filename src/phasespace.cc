@@ -9,7 +9,9 @@ PhaseSpace::PhaseSpace()
   : _mMother  ( 0.0 ), _m1  ( 0.0 ), _m2  ( 0.0 ), _m3  ( 0.0 ),
     _mSqMother( 0.0 ), _mSq1( 0.0 ), _mSq2( 0.0 ), _mSq3( 0.0 ),
     _mSqSum   ( 0.0 )
-{}
+{
+  precompute();
+}
 
 
 
@@ -17,15 +19,36 @@ PhaseSpace::PhaseSpace( const double& mMother, const double& m1, const double& m
   : _mMother  ( mMother           ), _m1  ( m1      ), _m2  ( m2      ), _m3  ( m3      ),
     _mSqMother( mMother * mMother ), _mSq1( m1 * m1 ), _mSq2( m2 * m2 ), _mSq3( m3 * m3 ),
     _mSqSum   ( _mSqMother + _mSq1 + _mSq2 + _mSq3 )
-{}
+{
+  precompute();
+}
+
+
+void PhaseSpace::precompute()
+{
+  _mSq12lower = ( _m1      + _m2 ) * ( _m1      + _m2 );
+  _mSq12upper = ( _mMother - _m3 ) * ( _mMother - _m3 );
+  _mSq13lower = ( _m1      + _m3 ) * ( _m1      + _m3 );
+  _mSq13upper = ( _mMother - _m2 ) * ( _mMother - _m2 );
+  _mSq23lower = ( _m2      + _m3 ) * ( _m2      + _m3 );
+  _mSq23upper = ( _mMother - _m1 ) * ( _mMother - _m1 );
+
+  const double first1 = _mSqMother + _mSq1 - _mSq2 - _mSq3;
+  const double first2 = _mSqMother - _mSq1 + _mSq2 - _mSq3;
+  const double first3 = _mSqMother - _mSq1 - _mSq2 + _mSq3;
+
+  _first1 = first1 * first1;
+  _first2 = first2 * first2;
+  _first3 = first3 * first3;
+}
 
 
 const double PhaseSpace::kallen( const double& x, const double& y, const double& z )
 {
   double result = 0.;
-  result += std::pow( x, 2 );
-  result += std::pow( y, 2 );
-  result += std::pow( z, 2 );
+  result += x * x;
+  result += y * y;
+  result += z * z;
   result -= 2. * x * y;
   result -= 2. * x * z;
   result -= 2. * y * z;
@@ -34,94 +57,158 @@ const double PhaseSpace::kallen( const double& x, const double& y, const double&
 }
 
 
+inline void PhaseSpace::roots( const double& mSqAB, const double& mSqA, const double& mSqB, const double& mSqC,
+                               double& rootAB, double& rootMC ) const
+{
+  rootAB = std::sqrt( kallen( mSqAB, mSqA      , mSqB ) );
+  rootMC = std::sqrt( kallen( mSqAB, _mSqMother, mSqC ) );
+}
+
+
+// Lower and upper limits from the constant term and the square roots.
+static inline double lowerLimit( const double& first, const double& rootAB, const double& rootMC, const double& mSqAB )
+{
+  const double sum = rootAB + rootMC;
+  return ( first - sum * sum ) / ( 4. * mSqAB );
+}
+
+
+static inline double upperLimit( const double& first, const double& rootAB, const double& rootMC, const double& mSqAB )
+{
+  const double diff = rootAB - rootMC;
+  return ( first - diff * diff ) / ( 4. * mSqAB );
+}
+
+
 const double PhaseSpace::mSq12min( const double& mSq13 ) const
 {
-  double first  = std::pow( _mSqMother + _mSq1 - _mSq2 - _mSq3, 2 );
-  double second = std::sqrt( kallen( mSq13, _mSq1     , _mSq3 ) );
-  double third  = std::sqrt( kallen( mSq13, _mSqMother, _mSq2 ) );
+  double rootAB, rootMC;
+  roots( mSq13, _mSq1, _mSq3, _mSq2, rootAB, rootMC );
 
-  return ( first - std::pow( second + third, 2 ) ) / ( 4. * mSq13 );
+  return lowerLimit( _first1, rootAB, rootMC, mSq13 );
 }
 
 
 const double PhaseSpace::mSq12max( const double& mSq13 ) const
 {
-  double first  = std::pow( _mSqMother + _mSq1 - _mSq2 - _mSq3, 2 );
-  double second = std::sqrt( kallen( mSq13, _mSq1     , _mSq3 ) );
-  double third  = std::sqrt( kallen( mSq13, _mSqMother, _mSq2 ) );
+  double rootAB, rootMC;
+  roots( mSq13, _mSq1, _mSq3, _mSq2, rootAB, rootMC );
 
-  return ( first - std::pow( second - third, 2 ) ) / ( 4. * mSq13 );
+  return upperLimit( _first1, rootAB, rootMC, mSq13 );
 }
 
 
 const double PhaseSpace::mSq13min( const double& mSq12 ) const
 {
-  double first  = std::pow( _mSqMother + _mSq1 - _mSq2 - _mSq3, 2 );
-  double second = std::sqrt( kallen( mSq12, _mSq1     , _mSq2 ) );
-  double third  = std::sqrt( kallen( mSq12, _mSqMother, _mSq3 ) );
+  double rootAB, rootMC;
+  roots( mSq12, _mSq1, _mSq2, _mSq3, rootAB, rootMC );
 
-  return ( first - std::pow( second + third, 2 ) ) / ( 4. * mSq12 );
+  return lowerLimit( _first1, rootAB, rootMC, mSq12 );
 }
 
 
 const double PhaseSpace::mSq13max( const double& mSq12 ) const
 {
-  double first  = std::pow( _mSqMother + _mSq1 - _mSq2 - _mSq3, 2 );
-  double second = std::sqrt( kallen( mSq12, _mSq1     , _mSq2 ) );
-  double third  = std::sqrt( kallen( mSq12, _mSqMother, _mSq3 ) );
+  double rootAB, rootMC;
+  roots( mSq12, _mSq1, _mSq2, _mSq3, rootAB, rootMC );
 
-  return ( first - std::pow( second - third, 2 ) ) / ( 4. * mSq12 );
+  return upperLimit( _first1, rootAB, rootMC, mSq12 );
 }
 
 
 const double PhaseSpace::mSq23min( const double& mSq12 ) const
 {
-  double first  = std::pow( _mSqMother - _mSq1 + _mSq2 - _mSq3, 2 );
-  double second = std::sqrt( kallen( mSq12, _mSq1     , _mSq2 ) );
-  double third  = std::sqrt( kallen( mSq12, _mSqMother, _mSq3 ) );
+  double rootAB, rootMC;
+  roots( mSq12, _mSq1, _mSq2, _mSq3, rootAB, rootMC );
 
-  return ( first - std::pow( second + third, 2 ) ) / ( 4. * mSq12 );
+  return lowerLimit( _first2, rootAB, rootMC, mSq12 );
 }
 
 
 const double PhaseSpace::mSq23max( const double& mSq12 ) const
 {
-  double first  = std::pow( _mSqMother - _mSq1 + _mSq2 - _mSq3, 2 );
-  double second = std::sqrt( kallen( mSq12, _mSq1     , _mSq2 ) );
-  double third  = std::sqrt( kallen( mSq12, _mSqMother, _mSq3 ) );
+  double rootAB, rootMC;
+  roots( mSq12, _mSq1, _mSq2, _mSq3, rootAB, rootMC );
 
-  return ( first - std::pow( second - third, 2 ) ) / ( 4. * mSq12 );
+  return upperLimit( _first2, rootAB, rootMC, mSq12 );
 }
 
 
 
 const double PhaseSpace::mSq23min( const double& mSq12, const double& mSq13 ) const
 {
-  double first12  = std::pow( _mSqMother - _mSq1 + _mSq2 - _mSq3, 2 );
-  double second12 = std::sqrt( kallen( mSq12, _mSq1     , _mSq2 ) );
-  double third12  = std::sqrt( kallen( mSq12, _mSqMother, _mSq3 ) );
-
-  double first13  = std::pow( _mSqMother - _mSq1 - _mSq2 + _mSq3, 2 );
-  double second13 = std::sqrt( kallen( mSq13, _mSq1     , _mSq3 ) );
-  double third13  = std::sqrt( kallen( mSq13, _mSqMother, _mSq2 ) );
+  double root12, root3;
+  double root13, root2;
+  roots( mSq12, _mSq1, _mSq2, _mSq3, root12, root3 );
+  roots( mSq13, _mSq1, _mSq3, _mSq2, root13, root2 );
 
-  return std::max( ( first12 - std::pow( second12 + third12, 2 ) ) / ( 4. * mSq12 ),
-                   ( first13 - std::pow( second13 + third13, 2 ) ) / ( 4. * mSq13 ) );
+  return std::max( lowerLimit( _first2, root12, root3, mSq12 ),
+                   lowerLimit( _first3, root13, root2, mSq13 ) );
 }
 
 
 const double PhaseSpace::mSq23max( const double& mSq12, const double& mSq13 ) const
 {
-  double first12  = std::pow( _mSqMother - _mSq1 + _mSq2 - _mSq3, 2 );
-  double second12 = std::sqrt( kallen( mSq12, _mSq1     , _mSq2 ) );
-  double third12  = std::sqrt( kallen( mSq12, _mSqMother, _mSq3 ) );
+  double root12, root3;
+  double root13, root2;
+  roots( mSq12, _mSq1, _mSq2, _mSq3, root12, root3 );
+  roots( mSq13, _mSq1, _mSq3, _mSq2, root13, root2 );
+
+  return std::min( upperLimit( _first2, root12, root3, mSq12 ),
+                   upperLimit( _first3, root13, root2, mSq13 ) );
+}
 
-  double first13  = std::pow( _mSqMother - _mSq1 - _mSq2 + _mSq3, 2 );
-  double second13 = std::sqrt( kallen( mSq13, _mSq1     , _mSq3 ) );
-  double third13  = std::sqrt( kallen( mSq13, _mSqMother, _mSq2 ) );
 
-  return std::min( ( first12 - std::pow( second12 - third12, 2 ) ) / ( 4. * mSq12 ),
-                   ( first13 - std::pow( second13 - third13, 2 ) ) / ( 4. * mSq13 ) );
+void PhaseSpace::mSq12limits( const double* mSq13, const std::size_t& n, double* lower, double* upper ) const
+{
+  for ( std::size_t point = 0; point < n; ++point )
+  {
+    double rootAB, rootMC;
+    roots( mSq13[ point ], _mSq1, _mSq3, _mSq2, rootAB, rootMC );
+    lower[ point ] = lowerLimit( _first1, rootAB, rootMC, mSq13[ point ] );
+    upper[ point ] = upperLimit( _first1, rootAB, rootMC, mSq13[ point ] );
+  }
+}
+
+
+void PhaseSpace::mSq13limits( const double* mSq12, const std::size_t& n, double* lower, double* upper ) const
+{
+  for ( std::size_t point = 0; point < n; ++point )
+  {
+    double rootAB, rootMC;
+    roots( mSq12[ point ], _mSq1, _mSq2, _mSq3, rootAB, rootMC );
+    lower[ point ] = lowerLimit( _first1, rootAB, rootMC, mSq12[ point ] );
+    upper[ point ] = upperLimit( _first1, rootAB, rootMC, mSq12[ point ] );
+  }
+}
+
+
+void PhaseSpace::mSq23limits( const double* mSq12, const std::size_t& n, double* lower, double* upper ) const
+{
+  for ( std::size_t point = 0; point < n; ++point )
+  {
+    double rootAB, rootMC;
+    roots( mSq12[ point ], _mSq1, _mSq2, _mSq3, rootAB, rootMC );
+    lower[ point ] = lowerLimit( _first2, rootAB, rootMC, mSq12[ point ] );
+    upper[ point ] = upperLimit( _first2, rootAB, rootMC, mSq12[ point ] );
+  }
+}
+
+
+void PhaseSpace::mSq23limits( const double* mSq12, const double* mSq13, const std::size_t& n, double* lower, double* upper ) const
+{
+  for ( std::size_t point = 0; point < n; ++point )
+  {
+    double root12, root3;
+    double root13, root2;
+    roots( mSq12[ point ], _mSq1, _mSq2, _mSq3, root12, root3 );
+    roots( mSq13[ point ], _mSq1, _mSq3, _mSq2, root13, root2 );
+
+    lower[ point ] = std::max( lowerLimit( _first2, root12, root3, mSq12[ point ] ),
+                               lowerLimit( _first3, root13, root2, mSq13[ point ] ) );
+    upper[ point ] = std::min( upperLimit( _first2, root12, root3, mSq12[ point ] ),
+                               upperLimit( _first3, root13, root2, mSq13[ point ] ) );
+  }
 }
 
 
@@ -159,9 +246,10 @@ const double PhaseSpace::m( unsigned index ) const
 // Check if the kinematically allowed region contains a given point.
 bool PhaseSpace::contains( const double& mSq12, const double& mSq13, const double& mSq23 ) const
 {
-  return ( mSq12 > mSq12min( mSq13        ) ) && ( mSq12 < mSq12max( mSq13        ) ) &&
-         ( mSq13 > mSq13min( mSq12        ) ) && ( mSq13 < mSq13max( mSq12        ) ) &&
-         ( mSq23 > mSq23min( mSq12, mSq13 ) ) && ( mSq23 < mSq23max( mSq12, mSq13 ) );
+  unsigned char inside;
+  contains( &mSq12, &mSq13, &mSq23, 1, &inside );
+
+  return inside;
 }
 
 
@@ -169,8 +257,51 @@ bool PhaseSpace::contains( const double& mSq12, const double& mSq13, const doubl
 // Check if the kinematically allowed region contains a given point.
 bool PhaseSpace::contains( const double& mSq12, const double& mSq13 ) const
 {
-  const double& mSq23 = _mSqSum - mSq12 - mSq13;
+  unsigned char inside;
+  contains( &mSq12, &mSq13, 1, &inside );
+
+  return inside;
+}
+
 
-  return ( mSq13 > mSq13min( mSq12 ) ) && ( mSq13 < mSq13max( mSq12 ) ) &&
-         ( mSq23 > mSq23min( mSq12 ) ) && ( mSq23 < mSq23max( mSq12 ) );
+// The limits of mSq12 and of mSq23 given mSq13 share the square roots of mSq13,
+//    and those of mSq13 and of mSq23 given mSq12 share the ones of mSq12. A
+//    point where any of them is undefined is outside.
+void PhaseSpace::contains( const double* mSq12, const double* mSq13, const double* mSq23, const std::size_t& n, unsigned char* inside ) const
+{
+  for ( std::size_t point = 0; point < n; ++point )
+  {
+    const double& x12 = mSq12[ point ];
+    const double& x13 = mSq13[ point ];
+    const double& x23 = mSq23[ point ];
+
+    double root12, root3;
+    double root13, root2;
+    roots( x12, _mSq1, _mSq2, _mSq3, root12, root3 );
+    roots( x13, _mSq1, _mSq3, _mSq2, root13, root2 );
+
+    const double min23 = std::max( lowerLimit( _first2, root12, root3, x12 ), lowerLimit( _first3, root13, root2, x13 ) );
+    const double max23 = std::min( upperLimit( _first2, root12, root3, x12 ), upperLimit( _first3, root13, root2, x13 ) );
+
+    inside[ point ] = ( x12 > lowerLimit( _first1, root13, root2, x13 ) ) & ( x12 < upperLimit( _first1, root13, root2, x13 ) ) &
+                      ( x13 > lowerLimit( _first1, root12, root3, x12 ) ) & ( x13 < upperLimit( _first1, root12, root3, x12 ) ) &
+                      ( x23 > min23                                     ) & ( x23 < max23                                     );
+  }
+}
+
+
+void PhaseSpace::contains( const double* mSq12, const double* mSq13, const std::size_t& n, unsigned char* inside ) const
+{
+  for ( std::size_t point = 0; point < n; ++point )
+  {
+    const double& x12 = mSq12[ point ];
+    const double& x13 = mSq13[ point ];
+    const double  x23 = _mSqSum - x12 - x13;
+
+    double root12, root3;
+    roots( x12, _mSq1, _mSq2, _mSq3, root12, root3 );
+
+    inside[ point ] = ( x13 > lowerLimit( _first1, root12, root3, x12 ) ) & ( x13 < upperLimit( _first1, root12, root3, x12 ) ) &
+                      ( x23 > lowerLimit( _first2, root12, root3, x12 ) ) & ( x23 < upperLimit( _first2, root12, root3, x12 ) );
+  }
 }
@@ -0,0 +1,55 @@
+
+#include <cmath>
+#include <algorithm>
+
+#include <cfit/propagatortable.hh>
+
+
+void PropagatorTable::build( const function_type& f, const double& min, const double& max,
+                             const double& tolerance, const unsigned& maxNodes )
+{
+  _min = min;
+  _max = max;
+
+  // Start with 64 intervals and double them, reusing the midpoints already computed.
+  std::vector< std::complex< double > > values( 65 );
+  for ( std::size_t node = 0; node < values.size(); ++node )
+    values[ node ] = f( min + ( max - min ) * node / double( values.size() - 1 ) );
+
+  while ( true )
+  {
+    _values  = values;
+    _invStep = ( _values.size() - 1 ) / ( max - min );
+
+    const std::size_t nIntervals = _values.size() - 1;
+
+    // Evaluate the midpoints, which are the new nodes if the table is not good enough.
+    std::vector< std::complex< double > > mids( nIntervals );
+    double largest = 0.;
+    double error   = 0.;
+    for ( std::size_t mid = 0; mid < nIntervals; ++mid )
+    {
+      const double mSqAB = min + ( max - min ) * ( mid + 0.5 ) / double( nIntervals );
+      mids[ mid ] = f( mSqAB );
+
+      largest = std::max( largest, std::abs( mids[ mid ] ) );
+      error   = std::max( error  , std::abs( mids[ mid ] - interpolate( mSqAB ) ) );
+    }
+
+    for ( std::size_t node = 0; node < _values.size(); ++node )
+      largest = std::max( largest, std::abs( _values[ node ] ) );
+
+    _error = ( largest > 0. ) ? error / largest : 0.;
+
+    if ( ( _error <= tolerance ) || ( 2 * nIntervals + 1 > maxNodes ) )
+      return;
+
+    values.resize( 2 * nIntervals + 1 );
+    for ( std::size_t node = 0; node < nIntervals; ++node )
+    {
+      values[ 2 * node     ] = _values[ node ];
+      values[ 2 * node + 1 ] = mids  [ node ];
+    }
+    values.back() = _values.back();
+  }
+}
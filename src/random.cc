@@ -1,8 +1,7 @@
 
 #include <cfit/random.hh>
 
-std::mt19937_64                          Random::_engine  = std::mt19937_64();
-
-std::uniform_real_distribution< double > Random::_uniform = std::uniform_real_distribution< double >();
-std::normal_distribution      < double > Random::_normal  = std::normal_distribution      < double >();
+thread_local Random::Stream  Random::_default;
+thread_local Random::Stream* Random::_current = 0;
 
+thread_local std::uniform_real_distribution< double > Random::_uniform = std::uniform_real_distribution< double >();
@@ -1,5 +1,7 @@
 
 #include <algorithm>
+#include <sstream>
+#include <typeinfo>
 
 #include <cfit/resonance.hh>
 #include <cfit/phasespace.hh>
@@ -9,6 +11,7 @@ void Resonance::push( const Parameter& par )
 {
   _parMap[ par.name() ] = par;
   _parOrder.push_back( par.name() );
+  _values  .push_back( par.value() );
 }
 
 
@@ -24,36 +27,85 @@ const bool Resonance::isFixed() const
 
 
 
+const std::string Resonance::structure() const
+{
+  std::ostringstream shape;
+  shape.precision( 17 );
+
+  shape << typeid( *this ).name() << " pair=" << _resoA << _resoB << " noRes=" << _noRes << " l=" << _l
+        << " helicity=" << _helicity << " twoBW=" << _twoBW << " table=" << _tableTolerance << " pars=";
+  for ( std::size_t slot = 0; slot < _values.size(); ++slot )
+    shape << ( slot ? "," : "" ) << _values[ slot ];
+
+  return shape.str();
+}
+
+
 // For resonances with larger number of parameters, be able to get them by index.
 //    Important: the zeroth extra parameter is the 3rd element in the vector.
 double Resonance::getPar( const unsigned index ) const
 {
-  if ( _parOrder.size() > index + 3 )
-    return _parMap.find( _parOrder[ index + 3 ] )->second.value();
+  if ( _values.size() > index + 3 )
+    return _values[ index + 3 ];
 
   throw PdfException( "Trying to access unexisting parameter." );
 }
 
 
+// The values are also written into their slots, which is all that the propagators read.
 void Resonance::setPars( const std::map< std::string, Parameter >& pars )
 {
-  typedef std::map< const std::string, Parameter >::iterator pIter;
-  for ( pIter par = _parMap.begin(); par != _parMap.end(); ++par )
-    par->second.setValue( pars.find( par->first )->second.value() );
+  std::vector< double > values( _parOrder.size() );
+  for ( std::size_t slot = 0; slot < _parOrder.size(); ++slot )
+    values[ slot ] = pars.find( _parOrder[ slot ] )->second.value();
+
+  setValues( values );
+}
+
+
+void Resonance::setValues( const std::vector< double >& values )
+{
+  bool changed = false;
+  for ( std::size_t slot = 0; slot < _parOrder.size(); ++slot )
+  {
+    if ( _values[ slot ] == values[ slot ] )
+      continue;
+
+    _parMap.find( _parOrder[ slot ] )->second.setValue( values[ slot ] );
+    _values[ slot ] = values[ slot ];
+    changed = true;
+  }
+
+  if ( changed && ! _table.empty() )
+    buildTable();
+}
+
+
+void Resonance::tabulate( const PhaseSpace& ps, const double& tolerance )
+{
+  _tablePs        = ps;
+  _tableTolerance = tolerance;
+
+  if ( tolerance > 0. )
+    buildTable();
+  else
+    _table.clear();
+}
+
+
+void Resonance::buildTable()
+{
+  const double min = std::pow( _tablePs.m( _resoA ) + _tablePs.m( _resoB ), 2 );
+  const double max = std::pow( _tablePs.mMother()   - _tablePs.m( _noRes ), 2 );
+
+  _table.build( [ this ]( const double& mSqAB ) { return propagator( _tablePs, mSqAB ); },
+                min, max, _tableTolerance );
 }
 
 // Kallen function lambda( x, y, z ) = x^2 + y^2 + z^2 - 2xy - 2xz - 2yz.
 double Resonance::kallen( const double& x, const double& y, const double& z )
 {
-  double result = 0.;
-  result += pow( x, 2 );
-  result += pow( y, 2 );
-  result += pow( z, 2 );
-  result -= 2. * x * y;
-  result -= 2. * x * z;
-  result -= 2. * y * z;
-
-  return result;
+  return x * x + y * y + z * z - 2. * ( x * y + x * z + y * z );
 }
 
 // Invariant mass of the resonant pair.
@@ -282,5 +334,439 @@ std::complex< double > Resonance::evaluate( const PhaseSpace& ps,
   if ( _twoBW )
     centrifugal *= blattWeisskopfPrimeP( ps, mSqAB );
 
-  return propagator( ps, mSqAB ) * angular * centrifugal;
+  return lookup( ps, mSqAB ) * angular * centrifugal;
+}
+
+
+void Resonance::evaluatePair( const PhaseSpace&       ps   ,
+                              const double&           mSq12,
+                              const double&           mSq13,
+                              const double&           mSq23,
+                              std::complex< double >& dir  ,
+                              std::complex< double >& cnj   ) const
+{
+  if ( _noRes != 1 )
+  {
+    dir = evaluate( ps, mSq12, mSq13, mSq23 );
+    cnj = evaluate( ps, mSq13, mSq12, mSq23 );
+    return;
+  }
+
+  // Swapping mSq12 and mSq13 swaps the other pairs, but not the resonant one.
+  const double& mSqAB = mSq23;
+  const double& mSqAC = m2AC( mSq12, mSq13, mSq23 );
+  const double& mSqBC = m2BC( mSq12, mSq13, mSq23 );
+
+  double angularDir;
+  double angularCnj;
+  if ( _helicity )
+  {
+    angularDir = helicity( ps, mSqAB, mSqAC, mSqBC );
+    angularCnj = helicity( ps, mSqAB, mSqBC, mSqAC );
+  }
+  else
+  {
+    angularDir = zemach( ps, mSqAB, mSqAC, mSqBC );
+    angularCnj = zemach( ps, mSqAB, mSqBC, mSqAC );
+  }
+
+  std::complex< double > common = blattWeisskopfPrime( ps, mSqAB );
+  if ( _twoBW )
+    common *= blattWeisskopfPrimeP( ps, mSqAB );
+
+  common *= lookup( ps, mSqAB );
+
+  dir = common * angularDir;
+  cnj = common * angularCnj;
+}
+
+
+// Batch versions. The loops have no branches on the values and the angular momentum
+//    is resolved outside them, so that the compiler can vectorise them.
+
+// Array of the squared invariant mass of the pair that does not contain particle index.
+const double* Resonance::pairMass( const unsigned& index, const double* mSq12, const double* mSq13, const double* mSq23 )
+{
+  if ( index == 3 ) return mSq12;
+  if ( index == 2 ) return mSq13;
+  if ( index == 1 ) return mSq23;
+
+  return 0;
+}
+
+
+void Resonance::q( const PhaseSpace& ps, const double* mSqAB, const std::size_t& n, double* out ) const
+{
+  const double mSqA = ps.mSq( _resoA );
+  const double mSqB = ps.mSq( _resoB );
+
+  for ( std::size_t point = 0; point < n; ++point )
+    out[ point ] = std::sqrt( kallen( mSqAB[ point ], mSqA, mSqB ) ) / ( 2.0 * std::sqrt( mSqAB[ point ] ) );
+}
+
+
+void Resonance::qSq( const PhaseSpace& ps, const double* mSqAB, const std::size_t& n, double* out ) const
+{
+  const double mSqA = ps.mSq( _resoA );
+  const double mSqB = ps.mSq( _resoB );
+
+  for ( std::size_t point = 0; point < n; ++point )
+    out[ point ] = kallen( mSqAB[ point ], mSqA, mSqB ) / ( 4.0 * mSqAB[ point ] );
+}
+
+
+void Resonance::p( const PhaseSpace& ps, const double* mSqAB, const std::size_t& n, double* out ) const
+{
+  const double mSqC = ps.mSq( _noRes );
+  const double mSqM = ps.mSqMother();
+
+  for ( std::size_t point = 0; point < n; ++point )
+    out[ point ] = std::sqrt( kallen( mSqAB[ point ], mSqC, mSqM ) ) / ( 2.0 * std::sqrt( mSqAB[ point ] ) );
+}
+
+
+void Resonance::pSq( const PhaseSpace& ps, const double* mSqAB, const std::size_t& n, double* out ) const
+{
+  const double mSqC = ps.mSq( _noRes );
+  const double mSqM = ps.mSqMother();
+
+  for ( std::size_t point = 0; point < n; ++point )
+    out[ point ] = kallen( mSqAB[ point ], mSqC, mSqM ) / ( 4.0 * mSqAB[ point ] );
+}
+
+
+void Resonance::rho( const PhaseSpace& ps, const double* mSqAB, const std::size_t& n, double* out ) const
+{
+  const double mSqA = ps.mSq( _resoA );
+  const double mSqB = ps.mSq( _resoB );
+
+  for ( std::size_t point = 0; point < n; ++point )
+    out[ point ] = std::sqrt( kallen( mSqAB[ point ], mSqA, mSqB ) ) / mSqAB[ point ];
+}
+
+
+void Resonance::runningWidth( const PhaseSpace& ps, const double* mSqAB, const std::size_t& n, double* out ) const
+{
+  std::vector< double > qSqAB( n );
+  qSq( ps, mSqAB, n, qSqAB.data() );
+
+  runningWidth( ps, mSqAB, qSqAB.data(), n, out );
+}
+
+
+// Since rho = sqrt( lambda ) / mSqAB and qSq = lambda / ( 4 mSqAB ), rho = 2 sqrt( qSq / mSqAB ).
+void Resonance::runningWidth( const PhaseSpace& ps, const double* mSqAB, const double* qSq,
+                              const std::size_t& n, double* out ) const
+{
+  blattWeisskopfSq( std::pow( q( ps, mSq() ), 2 ), qSq, n, out );
+
+  const double factor = 2. * width() / rho( ps, mSq() );
+  for ( std::size_t point = 0; point < n; ++point )
+    out[ point ] *= factor * std::sqrt( qSq[ point ] / mSqAB[ point ] );
+}
+
+
+// Shared by the centrifugal terms of the resonant and the non-resonant particles,
+//    given the squared momenta, and that at the mass of the resonance.
+static void barrier( const int& l, const double& rSq, const double& kSq0,
+                     const double* kSq, const std::size_t& n, double* out )
+{
+  const double rkSq0 = rSq * kSq0;
+
+  if ( l == 1 )
+    for ( std::size_t point = 0; point < n; ++point )
+      out[ point ] = std::sqrt( ( 1. + rkSq0 ) / ( 1. + rSq * kSq[ point ] ) );
+  else if ( l == 2 )
+  {
+    const double num = 9. + 3. * rkSq0 + rkSq0 * rkSq0;
+    for ( std::size_t point = 0; point < n; ++point )
+    {
+      const double rkSq = rSq * kSq[ point ];
+      out[ point ] = std::sqrt( num / ( 9. + 3. * rkSq + rkSq * rkSq ) );
+    }
+  }
+  else
+    std::fill( out, out + n, ( l == 0 ) ? 1. : 0. );
+}
+
+
+void Resonance::blattWeisskopfPrime( const PhaseSpace& ps, const double* mSqAB, const std::size_t& n, double* out ) const
+{
+  if ( _l == 0 )
+  {
+    std::fill( out, out + n, 1. );
+    return;
+  }
+
+  qSq( ps, mSqAB, n, out );
+  barrier( _l, r() * r(), std::pow( q( ps, mSq() ), 2 ), out, n, out );
+}
+
+
+void Resonance::blattWeisskopfPrimeP( const PhaseSpace& ps, const double* mSqAB, const std::size_t& n, double* out ) const
+{
+  if ( _l == 0 )
+  {
+    std::fill( out, out + n, 1. );
+    return;
+  }
+
+  pSq( ps, mSqAB, n, out );
+  barrier( _l, r() * r(), std::pow( p( ps, mSq() ), 2 ), out, n, out );
+}
+
+
+// The square of ( q / q0 )^l times the barrier, without any square root.
+void Resonance::blattWeisskopfSq( const double& qSq0, const double* qSq, const std::size_t& n, double* out ) const
+{
+  const double rSq   = r() * r();
+  const double rqSq0 = rSq * qSq0;
+
+  if ( _l == 1 )
+    for ( std::size_t point = 0; point < n; ++point )
+      out[ point ] = ( qSq[ point ] / qSq0 ) * ( 1. + rqSq0 ) / ( 1. + rSq * qSq[ point ] );
+  else if ( _l == 2 )
+  {
+    const double num = 9. + 3. * rqSq0 + rqSq0 * rqSq0;
+    for ( std::size_t point = 0; point < n; ++point )
+    {
+      const double ratio = qSq[ point ] / qSq0;
+      const double rqSq  = rSq * qSq[ point ];
+      out[ point ] = ratio * ratio * num / ( 9. + 3. * rqSq + rqSq * rqSq );
+    }
+  }
+  else
+    std::fill( out, out + n, ( _l == 0 ) ? 1. : 0. );
+}
+
+
+void Resonance::blattWeisskopf( const PhaseSpace& ps, const double* mSqAB, const std::size_t& n, double* out ) const
+{
+  if ( _l == 0 )
+  {
+    std::fill( out, out + n, 1. );
+    return;
+  }
+
+  // ( q / q0 )^l, computed from the squared momenta.
+  std::vector< double > ratio( n );
+  qSq( ps, mSqAB, n, ratio.data() );
+  blattWeisskopfPrime( ps, mSqAB, n, out );
+
+  const double qSq0 = std::pow( q( ps, mSq() ), 2 );
+  if ( _l == 2 )
+    for ( std::size_t point = 0; point < n; ++point )
+      out[ point ] *= ratio[ point ] / qSq0;
+  else
+    for ( std::size_t point = 0; point < n; ++point )
+      out[ point ] *= std::pow( ratio[ point ] / qSq0, 0.5 * _l );
+}
+
+
+void Resonance::zemach( const PhaseSpace& ps, const double* mSqAB, const double* mSqAC, const double* mSqBC,
+                        const std::size_t& n, double* out ) const
+{
+  for ( std::size_t point = 0; point < n; ++point )
+    out[ point ] = mSqAC[ point ] - mSqBC[ point ];
+
+  zemach( ps, mSqAB, out, n, out );
+}
+
+
+void Resonance::zemach( const PhaseSpace& ps, const double* mSqAB, const double* diff,
+                        const std::size_t& n, double* out ) const
+{
+  if ( ( _l != 1 ) && ( _l != 2 ) )
+  {
+    std::fill( out, out + n, ( _l == 0 ) ? 1. : 0. );
+    return;
+  }
+
+  const double diffSqMC = ps.mSqMother()   - ps.mSq( _noRes );
+  const double diffSqAB = ps.mSq( _resoA ) - ps.mSq( _resoB );
+  const double diffs    = diffSqMC * diffSqAB;
+
+  if ( _l == 1 )
+  {
+    for ( std::size_t point = 0; point < n; ++point )
+      out[ point ] = diff[ point ] - diffs / mSqAB[ point ];
+    return;
+  }
+
+  const double sumSqMC = ps.mSqMother()   + ps.mSq( _noRes );
+  const double sumSqAB = ps.mSq( _resoA ) + ps.mSq( _resoB );
+
+  for ( std::size_t point = 0; point < n; ++point )
+  {
+    const double& mSq     = mSqAB[ point ];
+    const double  zemach1 = diff[ point ] - diffs / mSq;
+    const double  first   = mSq - 2. * sumSqMC + diffSqMC * diffSqMC / mSq;
+    const double  second  = mSq - 2. * sumSqAB + diffSqAB * diffSqAB / mSq;
+
+    out[ point ] = zemach1 * zemach1 - first * second / 3.;
+  }
+}
+
+
+void Resonance::helicity( const PhaseSpace& ps, const double* mSqAB, const double* mSqAC, const double* mSqBC,
+                          const std::size_t& n, double* out ) const
+{
+  for ( std::size_t point = 0; point < n; ++point )
+    out[ point ] = mSqAC[ point ] - mSqBC[ point ];
+
+  helicity( ps, mSqAB, out, n, out );
+}
+
+
+void Resonance::helicity( const PhaseSpace& ps, const double* mSqAB, const double* diff,
+                          const std::size_t& n, double* out ) const
+{
+  if ( ( _l != 1 ) && ( _l != 2 ) )
+  {
+    std::fill( out, out + n, ( _l == 0 ) ? 1. : 0. );
+    return;
+  }
+
+  const double diffSqMC = ps.mSqMother()   - ps.mSq( _noRes );
+  const double diffSqAB = ps.mSq( _resoA ) - ps.mSq( _resoB );
+  const double diffs    = diffSqMC * diffSqAB / mSq();
+
+  if ( _l == 1 )
+  {
+    for ( std::size_t point = 0; point < n; ++point )
+      out[ point ] = diff[ point ] - diffs;
+    return;
+  }
+
+  const double sumSqMC = ps.mSqMother()   + ps.mSq( _noRes );
+  const double sumSqAB = ps.mSq( _resoA ) + ps.mSq( _resoB );
+  const double termMC  = - 2. * sumSqMC + diffSqMC * diffSqMC / mSq();
+  const double termAB  = - 2. * sumSqAB + diffSqAB * diffSqAB / mSq();
+
+  for ( std::size_t point = 0; point < n; ++point )
+  {
+    const double hel1 = diff[ point ] - diffs;
+
+    out[ point ] = hel1 * hel1 - ( mSqAB[ point ] + termMC ) * ( mSqAB[ point ] + termAB ) / 3.;
+  }
+}
+
+
+void Resonance::propagators( const PhaseSpace& ps, const double* mSqAB, const std::size_t& n,
+                             std::complex< double >* out ) const
+{
+  for ( std::size_t point = 0; point < n; ++point )
+    out[ point ] = propagator( ps, mSqAB[ point ] );
+}
+
+
+void Resonance::propagators( const PhaseSpace& ps, const double* mSqAB, const double* const* kin,
+                             const std::size_t& n, std::complex< double >* out ) const
+{
+  propagators( ps, mSqAB, n, out );
+}
+
+
+void Resonance::kinematics( const PhaseSpace& ps   ,
+                            const double*     mSq12,
+                            const double*     mSq13,
+                            const double*     mSq23,
+                            const std::size_t& n   ,
+                            double* const*    kin    ) const
+{
+  const double* mSqAB = pairMass( _noRes, mSq12, mSq13, mSq23 );
+  const double* mSqAC = pairMass( _resoB, mSq12, mSq13, mSq23 );
+  const double* mSqBC = pairMass( _resoA, mSq12, mSq13, mSq23 );
+
+  // Particles that do not label a pair have no kinematics, and are evaluated point by point.
+  if ( ! ( mSqAB && mSqAC && mSqBC ) )
+  {
+    for ( std::size_t column = 0; column < nKinematics(); ++column )
+      std::fill( kin[ column ], kin[ column ] + n, 0. );
+    return;
+  }
+
+  for ( std::size_t point = 0; point < n; ++point )
+    kin[ 0 ][ point ] = mSqAC[ point ] - mSqBC[ point ];
+
+  qSq( ps, mSqAB, n, kin[ 1 ] );
+  pSq( ps, mSqAB, n, kin[ 2 ] );
+}
+
+
+void Resonance::evaluate( const PhaseSpace&       ps   ,
+                          const double*           mSq12,
+                          const double*           mSq13,
+                          const double*           mSq23,
+                          const std::size_t&      n    ,
+                          std::complex< double >* out    ) const
+{
+  const double* mSqAB = pairMass( _noRes, mSq12, mSq13, mSq23 );
+  const double* mSqAC = pairMass( _resoB, mSq12, mSq13, mSq23 );
+  const double* mSqBC = pairMass( _resoA, mSq12, mSq13, mSq23 );
+
+  // Particles that do not label a pair have no batch version.
+  if ( ! ( mSqAB && mSqAC && mSqBC ) )
+  {
+    for ( std::size_t point = 0; point < n; ++point )
+      out[ point ] = evaluate( ps, mSq12[ point ], mSq13[ point ], mSq23[ point ] );
+    return;
+  }
+
+  const std::size_t nKin = nKinematics();
+
+  std::vector< double  > columns( nKin * n );
+  std::vector< double* > kin    ( nKin     );
+  for ( std::size_t column = 0; column < nKin; ++column )
+    kin[ column ] = columns.data() + column * n;
+
+  kinematics( ps, mSq12, mSq13, mSq23, n, kin.data() );
+
+  evaluate( ps, mSq12, mSq13, mSq23, kin.data(), n, out );
+}
+
+
+void Resonance::evaluate( const PhaseSpace&       ps   ,
+                          const double*           mSq12,
+                          const double*           mSq13,
+                          const double*           mSq23,
+                          const double* const*    kin  ,
+                          const std::size_t&      n    ,
+                          std::complex< double >* out    ) const
+{
+  const double* mSqAB = pairMass( _noRes, mSq12, mSq13, mSq23 );
+
+  if ( ! mSqAB )
+  {
+    for ( std::size_t point = 0; point < n; ++point )
+      out[ point ] = evaluate( ps, mSq12[ point ], mSq13[ point ], mSq23[ point ] );
+    return;
+  }
+
+  std::vector< double > angular    ( n );
+  std::vector< double > centrifugal( n );
+
+  if ( _helicity )
+    helicity( ps, mSqAB, kin[ 0 ], n, angular.data() );
+  else
+    zemach  ( ps, mSqAB, kin[ 0 ], n, angular.data() );
+
+  // Only the squared momenta at the mass of the resonance depend on the parameters.
+  barrier( _l, r() * r(), std::pow( q( ps, mSq() ), 2 ), kin[ 1 ], n, centrifugal.data() );
+  if ( _twoBW )
+  {
+    std::vector< double > other( n );
+    barrier( _l, r() * r(), std::pow( p( ps, mSq() ), 2 ), kin[ 2 ], n, other.data() );
+    for ( std::size_t point = 0; point < n; ++point )
+      centrifugal[ point ] *= other[ point ];
+  }
+
+  if ( _table.empty() )
+    propagators( ps, mSqAB, kin, n, out );
+  else
+    for ( std::size_t point = 0; point < n; ++point )
+      out[ point ] = lookup( ps, mSqAB[ point ] );
+
+  for ( std::size_t point = 0; point < n; ++point )
+    out[ point ] *= angular[ point ] * centrifugal[ point ];
 }
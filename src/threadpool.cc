@@ -0,0 +1,191 @@
+
+#include <cfit/threadpool.hh>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+// Affinity of the calling thread, restored when it goes out of scope.
+struct SavedAffinity
+{
+#ifdef __linux__
+  cpu_set_t mask;
+  bool      saved;
+
+  SavedAffinity( const bool& save )
+    : saved( save && ( pthread_getaffinity_np( pthread_self(), sizeof( mask ), &mask ) == 0 ) )
+  {}
+
+  ~SavedAffinity()
+  {
+    if ( saved )
+      pthread_setaffinity_np( pthread_self(), sizeof( mask ), &mask );
+  }
+#else
+  SavedAffinity( const bool& ) {}
+#endif
+};
+
+
+ThreadPool::ThreadPool( const unsigned& nThreads, const bool& pinned )
+  : _task( 0 ), _nTasks( 0 ), _next( 0 ), _finished( 0 ), _round( 0 ), _stop( false ), _ranges( false )
+{
+#ifdef __linux__
+  // The cores that the process may run on, e.g. those of the socket that an MPI
+  //    process has been bound to.
+  cpu_set_t allowed;
+  if ( pinned && ( sched_getaffinity( 0, sizeof( allowed ), &allowed ) == 0 ) )
+    for ( unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu )
+      if ( CPU_ISSET( cpu, &allowed ) )
+        _cores.push_back( cpu );
+#endif
+
+  for ( unsigned thread = 1; thread < nThreads; ++thread )
+    _threads.push_back( std::thread( &ThreadPool::work, this, thread ) );
+}
+
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard< std::mutex > lock( _mutex );
+    _stop = true;
+  }
+  _start.notify_all();
+
+  for ( std::vector< std::thread >::iterator thread = _threads.begin(); thread != _threads.end(); ++thread )
+    thread->join();
+}
+
+
+void ThreadPool::pin( const unsigned& thread ) const
+{
+#ifdef __linux__
+  if ( _cores.empty() )
+    return;
+
+  cpu_set_t core;
+  CPU_ZERO( &core );
+  CPU_SET( _cores[ thread % _cores.size() ], &core );
+  pthread_setaffinity_np( pthread_self(), sizeof( core ), &core );
+#endif
+}
+
+
+// Execute a task without the lock, which must be held when called.
+void ThreadPool::call( const std::size_t& task, const unsigned& thread, std::unique_lock< std::mutex >& lock )
+{
+  lock.unlock();
+  try
+  {
+    (*_task)( task, thread );
+  }
+  catch ( ... )
+  {
+    lock.lock();
+    if ( ! _error )
+      _error = std::current_exception();
+    lock.unlock();
+  }
+  lock.lock();
+
+  if ( ++_finished == _nTasks )
+    _done.notify_all();
+}
+
+
+// Consume tasks until there are none left for this thread. Must be called with the lock held.
+void ThreadPool::execute( const unsigned& thread, std::unique_lock< std::mutex >& lock )
+{
+  if ( _ranges )
+  {
+    const std::pair< std::size_t, std::size_t > tasks = range( _nTasks, size(), thread );
+    for ( std::size_t task = tasks.first; task < tasks.second; ++task )
+      call( task, thread, lock );
+    return;
+  }
+
+  while ( _next < _nTasks )
+    call( _next++, thread, lock );
+}
+
+
+void ThreadPool::work( const unsigned thread )
+{
+  pin( thread );
+
+  unsigned round = 0;
+
+  std::unique_lock< std::mutex > lock( _mutex );
+  while ( true )
+  {
+    _start.wait( lock, [ this, &round ]() { return _stop || ( _round != round ); } );
+
+    if ( _stop )
+      return;
+
+    round = _round;
+    execute( thread, lock );
+  }
+}
+
+
+void ThreadPool::start( const std::size_t& nTasks, const task_type& task, const bool& ranges, const std::function< void() >& first )
+{
+  // The calling thread is only bound to its core while it executes tasks.
+  const SavedAffinity affinity( pinned() );
+  pin( 0 );
+
+  std::unique_lock< std::mutex > lock( _mutex );
+
+  _task     = &task;
+  _nTasks   = nTasks;
+  _next     = 0;
+  _finished = 0;
+  _ranges   = ranges;
+  _error    = std::exception_ptr();
+  ++_round;
+
+  _start.notify_all();
+
+  // Work of the calling thread alone, done while the others execute tasks.
+  if ( first )
+  {
+    lock.unlock();
+    try
+    {
+      first();
+    }
+    catch ( ... )
+    {
+      lock.lock();
+      if ( ! _error )
+        _error = std::current_exception();
+      lock.unlock();
+    }
+    lock.lock();
+  }
+
+  // The calling thread also executes tasks, then waits for the rest to finish.
+  execute( 0, lock );
+  _done.wait( lock, [ this ]() { return _finished == _nTasks; } );
+
+  _task = 0;
+
+  if ( _error )
+    std::rethrow_exception( _error );
+}
+
+
+void ThreadPool::run( const std::size_t& nTasks, const task_type& task, const std::function< void() >& first )
+{
+  start( nTasks, task, false, first );
+}
+
+
+void ThreadPool::runRanges( const std::size_t& nTasks, const task_type& task, const std::function< void() >& first )
+{
+  start( nTasks, task, true, first );
+}
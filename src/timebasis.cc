@@ -0,0 +1,83 @@
+
+#include <complex>
+#include <cmath>
+
+#include <cfit/timebasis.hh>
+#include <cfit/math.hh>
+
+
+// psip = exp( - Gamma t ) exp( x Gamma t ), psim = exp( - Gamma t ) / exp( x Gamma t ),
+//    psii = exp( - Gamma t ) ( cos( y Gamma t ) + i sin( y Gamma t ) ).
+void TimeBasis::evaluate( const double& t, const double& gamma, const double& x, const double& y,
+                          double& psip, double& psim, std::complex< double >& psii )
+{
+  const double gammat = gamma * t;
+  const double decay  = std::exp( - gammat );
+  const double mixing = std::exp( x * gammat );
+
+  psip = decay * mixing;
+  psim = decay / mixing;
+  psii = std::polar( decay, y * gammat );
+}
+
+
+// The convolution of exp( - a t ) for t > 0 with a Gaussian of width s is
+//    R( t ) = 1/2 exp( a^2 s^2 / 2 - a t ) erfc( u ), with u = ( a s^2 - t ) / ( sqrt( 2 ) s ),
+//    which is computed with the vectorised erfc for the real rates of psip and psim.
+//    For the complex rate of psii, erfc( u ) = exp( - u^2 ) w( i u ) and
+//    R( t ) = 1/2 exp( - t^2 / 2 s^2 ) w( i u ), using w( i u ) = 2 exp( u^2 ) - w( - i u )
+//    when Re( u ) < 0, so that the exponentials never overflow.
+void TimeBasis::evaluate( const double* t, const double* sigma, const double* gauss, const std::size_t& n,
+                          const double& gamma, const double& x, const double& y,
+                          double* psip, double* psim, std::complex< double >* psii )
+{
+  if ( ! sigma )
+  {
+    for ( std::size_t entry = 0; entry < n; ++entry )
+      evaluate( t[ entry ], gamma, x, y, psip[ entry ], psim[ entry ], psii[ entry ] );
+    return;
+  }
+
+  const double                 rateP = ( 1.0 - x ) * gamma;
+  const double                 rateM = ( 1.0 + x ) * gamma;
+  const std::complex< double > rateI( gamma, - y * gamma );
+
+  const double                 sqrt2 = std::sqrt( 2.0 );
+  const std::complex< double > i( 0.0, 1.0 );
+
+  // Arguments of erfc for the real rates.
+  for ( std::size_t entry = 0; entry < n; ++entry )
+  {
+    const double& s = sigma[ entry ];
+    psip[ entry ] = ( s > 0.0 ) ? ( rateP * s * s - t[ entry ] ) / ( sqrt2 * s ) : 0.0;
+    psim[ entry ] = ( s > 0.0 ) ? ( rateM * s * s - t[ entry ] ) / ( sqrt2 * s ) : 0.0;
+  }
+
+  Math::erfc( psip, n, psip );
+  Math::erfc( psim, n, psim );
+
+  for ( std::size_t entry = 0; entry < n; ++entry )
+  {
+    const double& s    = sigma[ entry ];
+    const double& time = t    [ entry ];
+
+    if ( ! ( s > 0.0 ) )
+    {
+      evaluate( time, gamma, x, y, psip[ entry ], psim[ entry ], psii[ entry ] );
+      continue;
+    }
+
+    const double sSq = s * s;
+
+    psip[ entry ] *= 0.5 * std::exp( rateP * ( rateP * sSq / 2.0 - time ) );
+    psim[ entry ] *= 0.5 * std::exp( rateM * ( rateM * sSq / 2.0 - time ) );
+
+    const double                 gaussian = gauss ? gauss[ entry ] : std::exp( - time * time / ( 2.0 * sSq ) );
+    const std::complex< double > u        = ( rateI * sSq - time ) / ( sqrt2 * s );
+
+    if ( std::real( u ) >= 0.0 )
+      psii[ entry ] = 0.5 * gaussian * Math::faddeeva( i * u );
+    else
+      psii[ entry ] = std::exp( rateI * ( rateI * sSq / 2.0 - time ) ) - 0.5 * gaussian * Math::faddeeva( - i * u );
+  }
+}
@@ -0,0 +1,179 @@
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <random>
+#include <thread>
+#include <iterator>
+#include <algorithm>
+
+#include <Minuit/FunctionMinimum.h>
+#include <Minuit/MinuitParameter.h>
+
+#include <cfit/toystudy.hh>
+#include <cfit/nll.hh>
+#include <cfit/random.hh>
+#include <cfit/threadpool.hh>
+
+
+ToyStudy::ToyStudy( const PdfModel& pdf, const unsigned& nEvents, const unsigned& seed )
+  : _pdf     ( pdf.copy()     ),
+    _truth   ( pdf.getPars()  ),
+    _nEvents ( nEvents        ),
+    _poisson ( false          ),
+    _seed    ( seed           ),
+    _nThreads( 1              )
+{
+  _nll = []( const PdfBase& pdf, const std::shared_ptr< const Dataset >& data )
+         { return new Nll( static_cast< const PdfModel& >( pdf ), data ); };
+}
+
+
+ToyStudy::ToyStudy( const PdfExpr& pdf, const unsigned& nEvents, const unsigned& seed )
+  : _pdf     ( pdf.copy()     ),
+    _truth   ( pdf.getPars()  ),
+    _nEvents ( nEvents        ),
+    _poisson ( false          ),
+    _seed    ( seed           ),
+    _nThreads( 1              )
+{
+  _nll = []( const PdfBase& pdf, const std::shared_ptr< const Dataset >& data )
+         { return new Nll( static_cast< const PdfExpr& >( pdf ), data ); };
+}
+
+
+const std::shared_ptr< const Dataset > ToyStudy::generate( const PdfBase& pdf, const unsigned& toy ) const throw( PdfException )
+{
+  Random::Stream stream( _seed, toy );
+  Random::Scope  scope ( stream );
+
+  unsigned nEvents = _nEvents;
+  if ( _poisson )
+    nEvents = std::poisson_distribution< unsigned >( _nEvents )( Random::engine() );
+
+  const std::shared_ptr< Dataset > data = std::make_shared< Dataset >();
+  pdf.generate( nEvents, *data );
+
+  return data;
+}
+
+
+void ToyStudy::run( const unsigned& nToys, const unsigned& first ) throw( PdfException )
+{
+  const unsigned nThread = std::min( _nThreads ? _nThreads : std::max( 1u, std::thread::hardware_concurrency() ),
+                                     std::max( nToys, 1u ) );
+
+  // Each thread generates its toys with its own copy of the pdf, which stays at
+  //    the true values of the parameters, and fits them with a single Nll.
+  std::vector< std::unique_ptr< PdfBase   > > pdfs;
+  std::vector< std::unique_ptr< Minimizer > > nlls( nThread );
+  for ( unsigned thread = 0; thread < nThread; ++thread )
+  {
+    pdfs.push_back( std::unique_ptr< PdfBase >( _pdf->copy() ) );
+    pdfs.back()->update();
+  }
+
+  std::vector< Result > results( nToys );
+
+  const ThreadPool::task_type task = [ & ]( const std::size_t& index, const unsigned& thread )
+  {
+    const unsigned toy = first + index;
+
+    const std::shared_ptr< const Dataset > data = generate( *pdfs[ thread ], toy );
+
+    std::unique_ptr< Minimizer >& nll = nlls[ thread ];
+    if ( ! nll )
+    {
+      nll.reset( _nll( *pdfs[ thread ], data ) );
+      nll->setConfig( _config );
+    }
+    else
+      nll->setData( data );
+
+    nll->setPars( _truth );
+    const FunctionMinimum min = nll->minimize();
+
+    Result& result = results[ index ];
+    result.toy     = toy;
+    result.valid   = min.isValid();
+    result.fval    = min.fval();
+    result.edm     = min.edm();
+    result.nfcn    = min.nfcn();
+    result.nEvents = data->size();
+
+    const std::vector< MinuitParameter >& pars = min.userParameters().parameters();
+    typedef std::vector< MinuitParameter >::const_iterator pIter;
+    for ( pIter par = pars.begin(); par != pars.end(); ++par )
+    {
+      result.values.push_back( par->value() );
+      result.errors.push_back( par->error() );
+    }
+  };
+
+  if ( nThread > 1 )
+    ThreadPool( nThread ).run( nToys, task );
+  else
+    for ( std::size_t index = 0; index < nToys; ++index )
+      task( index, 0 );
+
+  _results.insert( _results.end(), results.begin(), results.end() );
+}
+
+
+std::vector< double > ToyStudy::pulls( const std::string& name ) const throw( PdfException )
+{
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  pIter par = _truth.find( name );
+  if ( par == _truth.end() )
+    throw PdfException( "ToyStudy: cannot compute the pulls of unknown parameter " + name + "." );
+
+  const std::size_t index = std::distance( _truth.begin(), par );
+
+  std::vector< double > pulls;
+  typedef std::vector< Result >::const_iterator rIter;
+  for ( rIter result = _results.begin(); result != _results.end(); ++result )
+  {
+    const double& error = result->errors[ index ];
+    pulls.push_back( ( error > 0.0 ) ? ( result->values[ index ] - par->second.value() ) / error : 0.0 );
+  }
+
+  return pulls;
+}
+
+
+void ToyStudy::write( const std::string& file ) const throw( PdfException )
+{
+  std::ofstream out( file.c_str() );
+  if ( ! out )
+    throw PdfException( "ToyStudy: cannot open file " + file + "." );
+
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+
+  out << "toy valid fval edm nfcn nEvents";
+  for ( pIter par = _truth.begin(); par != _truth.end(); ++par )
+    if ( ! par->second.isFixed() )
+      out << " " << par->first << " " << par->first << "_err " << par->first << "_pull";
+  out << std::endl;
+
+  out.precision( 10 );
+
+  typedef std::vector< Result >::const_iterator rIter;
+  for ( rIter result = _results.begin(); result != _results.end(); ++result )
+  {
+    out << result->toy << " " << result->valid << " " << result->fval << " "
+        << result->edm << " " << result->nfcn  << " " << result->nEvents;
+
+    std::size_t index = 0;
+    for ( pIter par = _truth.begin(); par != _truth.end(); ++par, ++index )
+    {
+      if ( par->second.isFixed() )
+        continue;
+
+      const double& value = result->values[ index ];
+      const double& error = result->errors[ index ];
+      out << " " << value << " " << error << " "
+          << ( ( error > 0.0 ) ? ( value - par->second.value() ) / error : 0.0 );
+    }
+    out << std::endl;
+  }
+}
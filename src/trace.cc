@@ -0,0 +1,5 @@
+
+#include <cfit/trace.hh>
+
+
+std::atomic< TraceSink* > Trace::_sink( 0 );
@@ -0,0 +1,433 @@
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <thread>
+#include <cmath>
+
+#ifdef MPI_ON
+#include <mpi.h>
+#endif
+
+#include <cfit/variable.hh>
+#include <cfit/dataset.hh>
+#include <cfit/pdfmodel.hh>
+#include <cfit/weightednll.hh>
+#include <cfit/trace.hh>
+#include <cfit/compensatedsum.hh>
+#include <cfit/threadpool.hh>
+#include <cfit/random.hh>
+
+
+WeightedNll::WeightedNll( const PdfModel& pdf, const Variable& w, const Dataset& data )
+  : Minimizer( pdf, data ), _w( w ), _sumW2( false ), _seed( 0 ), _replica( 0 )
+{
+  _up = 1.0;
+
+  cacheWeights();
+}
+
+
+WeightedNll::WeightedNll( const PdfExpr& pdf, const Variable& w, const Dataset& data )
+  : Minimizer( pdf, data ), _w( w ), _sumW2( false ), _seed( 0 ), _replica( 0 )
+{
+  _up = 1.0;
+
+  cacheWeights();
+}
+
+
+WeightedNll::WeightedNll( const PdfModel& pdf, const Variable& w, const DatasetView& data )
+  : Minimizer( pdf, data ), _w( w ), _sumW2( false ), _seed( 0 ), _replica( 0 )
+{
+  _up = 1.0;
+
+  cacheWeights();
+}
+
+
+WeightedNll::WeightedNll( const PdfExpr& pdf, const Variable& w, const DatasetView& data )
+  : Minimizer( pdf, data ), _w( w ), _sumW2( false ), _seed( 0 ), _replica( 0 )
+{
+  _up = 1.0;
+
+  cacheWeights();
+}
+
+
+WeightedNll::WeightedNll( const PdfModel& pdf, const Variable& w, const std::shared_ptr< const Dataset >& data )
+  : Minimizer( pdf, data ), _w( w ), _sumW2( false ), _seed( 0 ), _replica( 0 )
+{
+  _up = 1.0;
+
+  cacheWeights();
+}
+
+
+WeightedNll::WeightedNll( const PdfExpr& pdf, const Variable& w, const std::shared_ptr< const Dataset >& data )
+  : Minimizer( pdf, data ), _w( w ), _sumW2( false ), _seed( 0 ), _replica( 0 )
+{
+  _up = 1.0;
+
+  cacheWeights();
+}
+
+
+WeightedNll::WeightedNll( const WeightedNll& nll )
+  : Minimizer( nll ), _w( nll._w ), _sumW2( nll._sumW2 ),
+    _wColumn( nll._wColumn ), _sumW( nll._sumW ), _sumW2Weights( nll._sumW2Weights ),
+    _draws( nll._draws ), _seed( nll._seed ), _replica( nll._replica )
+{}
+
+
+void WeightedNll::setData( const std::shared_ptr< const Dataset >& data )
+{
+  Minimizer::setData( data );
+  if ( _draws )
+    drawReplica();
+  cacheWeights();
+}
+
+
+void WeightedNll::append( const Dataset& events ) throw( PdfException )
+{
+  Minimizer::append( events );
+  if ( _draws )
+    drawReplica();
+  cacheWeights();
+}
+
+
+void WeightedNll::select( const std::vector< std::size_t >& entries ) throw( PdfException )
+{
+  if ( _draws )
+  {
+    const std::shared_ptr< std::vector< unsigned char > > draws = std::make_shared< std::vector< unsigned char > >( entries.size() );
+    for ( std::size_t entry = 0; entry < entries.size(); ++entry )
+      ( *draws )[ entry ] = ( *_draws )[ entries[ entry ] ];
+    _draws = draws;
+  }
+
+  Minimizer::select( entries );
+  cacheWeights();
+}
+
+
+void WeightedNll::setReplica( const unsigned& seed, const unsigned& replica )
+{
+  _seed    = seed;
+  _replica = replica;
+
+  drawReplica();
+  cacheWeights();
+}
+
+
+void WeightedNll::clearReplica()
+{
+  _draws.reset();
+  cacheWeights();
+}
+
+
+void WeightedNll::drawReplica()
+{
+  std::uint64_t offset = 0;
+#ifdef MPI_ON
+  // Each process draws the events of its piece of the dataset from its own range of counters.
+  offset = std::uint64_t( MPI::COMM_WORLD.Get_rank() ) << 40;
+#endif
+
+  const std::size_t size = _data->size();
+  std::vector< unsigned char > draws( size );
+  for ( std::size_t entry = 0; entry < size; ++entry )
+  {
+    // Invert the cumulative distribution of a Poisson of mean one.
+    const double uniform = Random::counter( _seed, _replica, offset + entry );
+
+    unsigned count = 0;
+    double   prob  = std::exp( -1.0 );
+    double   cum   = prob;
+    while ( uniform >= cum && count < 255 )
+    {
+      prob /= ++count;
+      cum  += prob;
+    }
+
+    draws[ entry ] = count;
+  }
+
+  _draws = std::make_shared< const std::vector< unsigned char > >( std::move( draws ) );
+}
+
+
+void WeightedNll::cacheWeights()
+{
+  _wColumn = _data->column( _w.name() );
+
+  const double*        weights = _data->valueColumn( _wColumn );
+  const unsigned char* draws   = _draws ? _draws->data() : 0;
+
+  // An event drawn k times counts as k events of the same weight.
+  CompensatedSum sumW;
+  CompensatedSum sumW2;
+  for ( std::size_t entry = 0; entry < _data->size(); ++entry )
+  {
+    const double times = draws ? draws[ entry ] : 1.0;
+    sumW  += times * weights[ entry ];
+    sumW2 += times * weights[ entry ] * weights[ entry ];
+  }
+
+  double sums[ 2 ] = { sumW.value(), sumW2.value() };
+
+#ifdef MPI_ON
+  // Each process only holds a piece of the dataset.
+  double result[ 2 ] = { 0.0, 0.0 };
+  MPI::Comm& world = MPI::COMM_WORLD;
+  TRACE_SCOPE( "MPI::Allreduce" );
+  world.Allreduce( sums, result, 2, MPI::DOUBLE, MPI::SUM );
+  sums[ 0 ] = result[ 0 ];
+  sums[ 1 ] = result[ 1 ];
+#endif
+
+  _sumW         = sums[ 0 ];
+  _sumW2Weights = sums[ 1 ];
+}
+
+
+double WeightedNll::operator()( const std::vector<double>& pars ) const throw( PdfException )
+{
+  if ( pars.size() != _pdf->nPars() )
+    throw PdfException( "Number of parameters passed does not match number of required arguments." );
+
+  count( _stats.calls );
+
+  if ( _sumW2 && ! _sumW2Weights )
+    throw PdfException( "WeightedNll: cannot apply the sum of weights squared correction if all the weights are zero." );
+
+  _pdf->setPars( pars );
+
+  // Before evaluating the pdf at all data points, cache anything common to
+  //    all points (usually compute the norm), for the parts of the pdf whose
+  //    parameters have changed since the previous call.
+  update();
+
+  const double*        weights = _data->valueColumn( _wColumn );
+  const unsigned char* draws   = _draws ? _draws->data() : 0;
+
+  // Sum of the weighted terms of the nll.
+  double nll = sumBlocks( [ weights, draws ]( const std::size_t& first, const std::size_t& n, const double* values )
+                          {
+                            CompensatedSum sum;
+                            for ( std::size_t entry = 0; entry < n; ++entry )
+                              if ( values[ entry ] && ( ! draws || draws[ first + entry ] ) )
+                                sum += - 2. * weights[ first + entry ] * ( draws ? draws[ first + entry ] : 1.0 ) * log( values[ entry ] );
+                            return sum.value();
+                          } );
+
+#ifdef MPI_ON
+  // If running with MPI, each process has only computed a piece of the nll.
+  //    Add all the pieces up and broadcast them to all the processes.
+  double result = 0.0;
+  MPI::Comm& world = MPI::COMM_WORLD;
+  {
+    const Timer timer( profiled( _stats.reduce ) );
+    TRACE_SCOPE( "MPI::Allreduce" );
+    world.Allreduce( &nll, &result, 1, MPI::DOUBLE, MPI::SUM );
+  }
+  nll = result;
+#endif
+
+  // The extended term is only added once, after the pieces from all the processes.
+  nll = scale() * ( nll + 2.0 * _pdf->yield() );
+
+  if ( _verbose )
+    std::cout << "nll = " << nll << std::endl;
+
+  return nll;
+}
+
+
+
+std::vector< double > WeightedNll::gradient( const std::vector< double >& pars ) const throw( PdfException )
+{
+  if ( pars.size() != _pdf->nPars() )
+    throw PdfException( "Number of parameters passed does not match number of required arguments." );
+
+  count( _stats.gradients );
+
+  // Classify the free parameters into those with analytic derivatives and the rest.
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  const std::map< std::string, Parameter >& parMap = _pdf->getPars();
+
+  std::vector< bool > fixed;
+  std::vector< bool > analytic;
+  for ( pIter par = parMap.begin(); par != parMap.end(); ++par )
+  {
+    fixed   .push_back( par->second.isFixed() );
+    analytic.push_back( ! par->second.isFixed() && _pdf->hasGradient( par->first ) );
+  }
+
+  std::vector< double > grad( pars.size(), 0.0 );
+
+  if ( std::find( analytic.begin(), analytic.end(), true ) != analytic.end() )
+  {
+    _pdf->setPars( pars );
+    update();
+    _pdf->cacheGradient();
+
+    const double*        weights = _data->valueColumn( _wColumn );
+    const unsigned char* draws   = _draws ? _draws->data() : 0;
+
+    // Derivative of - 2 w log( pdf ). The yield of the pdfs that provide analytic
+    //    derivatives does not depend on the parameters.
+    grad = sumGradientBlocks( analytic,
+                              [ weights, draws ]( const std::size_t& first, const std::size_t& n, const double* values, const double* derivs )
+                              {
+                                CompensatedSum sum;
+                                for ( std::size_t entry = 0; entry < n; ++entry )
+                                  if ( values[ entry ] && ( ! draws || draws[ first + entry ] ) )
+                                    sum += - 2. * weights[ first + entry ] * ( draws ? draws[ first + entry ] : 1.0 ) * derivs[ entry ] / values[ entry ];
+                                return sum.value();
+                              } );
+
+#ifdef MPI_ON
+    // Add up the pieces of the gradient computed by each process.
+    std::vector< double > result( grad.size(), 0.0 );
+    MPI::Comm& world = MPI::COMM_WORLD;
+    {
+      const Timer timer( profiled( _stats.reduce ) );
+      TRACE_SCOPE( "MPI::Allreduce" );
+      world.Allreduce( grad.data(), result.data(), grad.size(), MPI::DOUBLE, MPI::SUM );
+    }
+    grad = result;
+#endif
+
+    for ( std::size_t index = 0; index < grad.size(); ++index )
+      grad[ index ] *= scale();
+  }
+
+  std::vector< bool > numeric( pars.size(), false );
+  for ( std::size_t index = 0; index < pars.size(); ++index )
+    numeric[ index ] = ! fixed[ index ] && ! analytic[ index ];
+
+  if ( std::find( numeric.begin(), numeric.end(), true ) != numeric.end() )
+  {
+    numericGradient( pars, numeric, grad );
+
+    // Leave the pdf at the point where the gradient has been computed.
+    _pdf->setPars( pars );
+    update();
+  }
+
+  return grad;
+}
+
+
+MnUserCovariance WeightedNll::scoreCovariance( const std::vector< double >& pars ) const throw( PdfException )
+{
+  if ( pars.size() != _pdf->nPars() )
+    throw PdfException( "Number of parameters passed does not match number of required arguments." );
+
+  const std::vector< bool > requested = scoreParameters();
+  const std::size_t         nFree     = std::count( requested.begin(), requested.end(), true );
+
+  _pdf->setPars( pars );
+  update();
+  _pdf->cacheGradient();
+
+  const double*        weights = _data->valueColumn( _wColumn );
+  const unsigned char* draws   = _draws ? _draws->data() : 0;
+
+  // An event drawn k times counts as k events of the same weight.
+  std::vector< std::vector< double > > sums = sumScoreBlocks( requested, 2,
+                                                              [ weights, draws ]( const std::size_t& entry, double* factors )
+                                                              {
+                                                                const double times = draws ? draws[ entry ] : 1.0;
+                                                                factors[ 0 ] = times * weights[ entry ];
+                                                                factors[ 1 ] = times * weights[ entry ] * weights[ entry ];
+                                                              } );
+
+#ifdef MPI_ON
+  // Add up the pieces of the matrices computed by each process.
+  MPI::Comm& world = MPI::COMM_WORLD;
+  for ( std::size_t matrix = 0; matrix < sums.size(); ++matrix )
+  {
+    std::vector< double > result( sums[ matrix ].size(), 0.0 );
+    {
+      TRACE_SCOPE( "MPI::Allreduce" );
+      world.Allreduce( sums[ matrix ].data(), result.data(), result.size(), MPI::DOUBLE, MPI::SUM );
+    }
+    sums[ matrix ] = result;
+  }
+#endif
+
+  const std::vector< double >  inverse = invert( sums[ 0 ], nFree );
+  const std::vector< double >& inner   = sums[ 1 ];
+
+  std::vector< double > left( nFree * nFree, 0.0 );
+  for ( std::size_t row = 0; row < nFree; ++row )
+    for ( std::size_t k = 0; k < nFree; ++k )
+      for ( std::size_t col = 0; col < nFree; ++col )
+        left[ row * nFree + col ] += inverse[ row * nFree + k ] * inner[ k * nFree + col ];
+
+  std::vector< double > covariance( nFree * nFree, 0.0 );
+  for ( std::size_t row = 0; row < nFree; ++row )
+    for ( std::size_t k = 0; k < nFree; ++k )
+      for ( std::size_t col = 0; col < nFree; ++col )
+        covariance[ row * nFree + col ] += up() * left[ row * nFree + k ] * inverse[ k * nFree + col ];
+
+  return userCovariance( covariance, nFree );
+}
+
+
+std::vector< WeightedNll::Replica > WeightedNll::bootstrap( const std::size_t& nReplicas, const unsigned& seed, const FunctionMinimum& start ) const throw( PdfException )
+{
+  // With MPI, every fit reduces over the processes, so the replicas are fitted one
+  //    after the other for their collectives to match on all of them.
+#ifdef MPI_ON
+  const unsigned nThread = 1;
+#else
+  const unsigned& nThreads = _config.bootThreads();
+  const unsigned  nThread  = std::min< std::size_t >( nThreads ? nThreads : std::max( 1u, std::thread::hardware_concurrency() ),
+                                                      std::max< std::size_t >( nReplicas, 1 ) );
+#endif
+
+  // Each thread fits with its own copy, which only holds the draws of its replica.
+  std::vector< std::unique_ptr< WeightedNll > > copies;
+  for ( unsigned thread = 0; thread < nThread; ++thread )
+  {
+    copies.push_back( std::unique_ptr< WeightedNll >( copy() ) );
+    if ( nThread > 1 )
+      copies.back()->setThreads( 1 );
+  }
+
+  std::vector< Replica > result( nReplicas );
+
+  const ThreadPool::task_type task = [ & ]( const std::size_t& replica, const unsigned& thread )
+  {
+    WeightedNll& nll = *copies[ thread ];
+    nll.setReplica( seed, replica );
+
+    const FunctionMinimum min = _config.minimize( nll, start.userState() );
+
+    Replica& fit = result[ replica ];
+    fit.replica = replica;
+    fit.valid   = min.isValid();
+    fit.fval    = min.fval();
+
+    const std::vector< MinuitParameter >& minPars = min.userParameters().parameters();
+    typedef std::vector< MinuitParameter >::const_iterator mIter;
+    for ( mIter par = minPars.begin(); par != minPars.end(); ++par )
+      fit.values.push_back( par->value() );
+  };
+
+  if ( nThread > 1 )
+    ThreadPool( nThread ).run( nReplicas, task );
+  else
+    for ( std::size_t replica = 0; replica < nReplicas; ++replica )
+      task( replica, 0 );
+
+  return result;
+}
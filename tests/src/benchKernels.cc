@@ -0,0 +1,357 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <complex>
+#include <functional>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <map>
+#include <cmath>
+#include <cstdlib>
+
+#include <cfit/parameter.hh>
+#include <cfit/variable.hh>
+#include <cfit/coef.hh>
+#include <cfit/coefexpr.hh>
+#include <cfit/amplitude.hh>
+#include <cfit/binnedamplitude.hh>
+#include <cfit/binning.hh>
+#include <cfit/phasespace.hh>
+#include <cfit/matrix.hh>
+#include <cfit/function.hh>
+#include <cfit/dataset.hh>
+#include <cfit/pdfexpr.hh>
+#include <cfit/random.hh>
+#include <cfit/nll.hh>
+
+#include <cfit/models/gauss.hh>
+#include <cfit/models/exponential.hh>
+#include <cfit/models/relbreitwigner.hh>
+#include <cfit/models/gounarissakurai.hh>
+#include <cfit/models/flatte.hh>
+#include <cfit/models/glass.hh>
+#include <cfit/models/decay3body.hh>
+#include <cfit/models/decay3bodycp.hh>
+#include <cfit/models/decay3bodymix.hh>
+#include <cfit/models/decay3bodybin.hh>
+
+// Micro-benchmarks of the kernels of the event loop and of a full evaluation
+//    of the nll of each family of models. Each kernel is run on several numbers
+//    of events, repeatedly until it has taken some minimum time, and the best of
+//    a few repetitions is reported in ns/event and events/s. All the events are
+//    generated from a fixed seed, so that the runs can be compared. The times of
+//    the nll include computing the norm again at every call, which dominates
+//    for the smaller datasets of the Dalitz plot models.
+//
+// Usage: benchKernels [ maxEvents ]
+
+
+// Kernel run on the first n events of its inputs.
+typedef std::function< void( const std::size_t& n ) > kernel_type;
+
+// Sink for the results of the kernels, so that the compiler cannot drop them.
+volatile double sink = 0.0;
+
+
+void measure( const std::string& name, const std::size_t& n, const kernel_type& kernel )
+{
+  typedef std::chrono::steady_clock clock_type;
+
+  const double   minTime = 0.05; // Seconds per repetition.
+  const unsigned nReps   = 5;
+
+  kernel( n );
+
+  double best = std::numeric_limits< double >::max();
+  for ( unsigned rep = 0; rep < nReps; ++rep )
+  {
+    unsigned calls   = 0;
+    double   elapsed = 0.0;
+
+    const clock_type::time_point start = clock_type::now();
+    do
+    {
+      kernel( n );
+      ++calls;
+      elapsed = std::chrono::duration< double >( clock_type::now() - start ).count();
+    }
+    while ( elapsed < minTime );
+
+    best = std::min( best, elapsed / calls );
+  }
+
+  std::cout << std::left  << std::setw( 36 ) << name
+            << std::right << std::setw( 10 ) << n
+            << std::fixed << std::setprecision( 2 ) << std::setw( 14 ) << best * 1.e9 / n
+            << std::scientific << std::setprecision( 3 ) << std::setw( 14 ) << n / best
+            << std::endl;
+}
+
+
+// Run a kernel on all the numbers of events up to maxEvents.
+void measure( const std::string& name, const std::vector< std::size_t >& sizes, const kernel_type& kernel )
+{
+  for ( std::size_t size = 0; size < sizes.size(); ++size )
+    measure( name, sizes[ size ], kernel );
+}
+
+
+int main( int argc, char** argv )
+{
+  const std::size_t maxEvents = ( argc > 1 ) ? std::strtoul( argv[ 1 ], 0, 10 ) : 100000;
+
+  std::vector< std::size_t > sizes;
+  for ( std::size_t size = 1000; size <= maxEvents; size *= 10 )
+    sizes.push_back( size );
+
+  Random::setSeed( 1 );
+
+  const PhaseSpace ps( 1.86484, 0.497614, 0.139570, 0.139570 );
+
+  // Points uniformly distributed over the phase space, with decay times.
+  std::vector< double > mSq12;
+  std::vector< double > mSq13;
+  std::vector< double > mSq23;
+  std::vector< double > time;
+  while ( mSq12.size() < maxEvents )
+  {
+    const double x = Random::flat( ps.mSq12min(), ps.mSq12max() );
+    const double y = Random::flat( ps.mSq13min(), ps.mSq13max() );
+    if ( ! ps.contains( x, y ) )
+      continue;
+
+    mSq12.push_back( x );
+    mSq13.push_back( y );
+    mSq23.push_back( ps.mSqSum() - x - y );
+    time .push_back( -0.41 * std::log( Random::flat() ) );
+  }
+
+  std::vector< std::complex< double > > amps( maxEvents );
+  std::vector< double >                 values( maxEvents );
+
+  // Resonances and F vector of a D0 -> Ks pi pi amplitude.
+  Parameter mKst ( "mKst" , 0.89166, 0.01 );
+  Parameter wKst ( "wKst" , 0.0508 , 0.01 );
+  Parameter mRho ( "mRho" , 0.77549, 0.01 );
+  Parameter wRho ( "wRho" , 0.1491 , 0.01 );
+  Parameter mF0  ( "mF0"  , 0.965  , 0.01 );
+  Parameter wF0  ( "wF0"  , 0.05   , 0.01 );
+  Parameter g1F0 ( "g1F0" , 0.165  , 0.01 );
+  Parameter g2F0 ( "g2F0" , 0.695  , 0.01 );
+  Parameter m02a ( "m02a" , 0.0195 , 0.01 );
+  Parameter m02b ( "m02b" , 0.2437 , 0.01 );
+  Parameter mK0  ( "mK0"  , 1.42155, 0.01 );
+  Parameter wK0  ( "wK0"  , 0.24673, 0.01 );
+  Parameter rBW  ( "rBW"  , 1.5    , 0.1  );
+  Parameter lassR( "lassR", 1.0    , 0.1  );
+  Parameter lassB( "lassB", 0.6177 , 0.1  );
+  Parameter lassPR( "lassPhiR",  1.1044, 0.1 );
+  Parameter lassPB( "lassPhiB", -0.0995, 0.1 );
+  Parameter lassr( "lassr", -15.0103, 0.1 );
+  Parameter lassa( "lassa",   0.2240, 0.1 );
+
+  m02a.fix();
+  m02b.fix();
+
+  RelBreitWigner  kst ( 1, 2, mKst, wKst, rBW, 1 );
+  GounarisSakurai rho ( 2, 3, mRho, wRho, rBW, 1 );
+  Flatte          f0  ( 2, 3, mF0 , wF0 , rBW, g1F0, g2F0, m02a, m02b, 0 );
+  GLass           k0  ( 1, 3, mK0 , wK0 , rBW, lassR, lassB, lassPR, lassPB, lassr, lassa, 0 );
+
+  std::vector< double > m0;
+  m0.push_back( 0.65100 );
+  m0.push_back( 1.20360 );
+  m0.push_back( 1.55817 );
+  m0.push_back( 1.21000 );
+  m0.push_back( 1.82206 );
+
+  Matrix< double > g0( 5 );
+  Matrix< double > fSc( 5 );
+  const double residues[ 5 ][ 5 ] = { {  0.22889, -0.55377,  0.00000, -0.39899, -0.34639 },
+                                      {  0.94128,  0.55095,  0.00000,  0.39065,  0.31503 },
+                                      {  0.36856,  0.23888,  0.55639,  0.18340,  0.18681 },
+                                      {  0.33650,  0.40907,  0.85679,  0.19906, -0.00984 },
+                                      {  0.18171, -0.17558, -0.79658, -0.00355,  0.22358 } };
+  const double background[ 5 ] = { 0.23399, 0.15044, -0.20545, 0.32825, 0.35412 };
+  for ( int row = 0; row < 5; ++row )
+    for ( int col = 0; col < 5; ++col )
+    {
+      g0 ( row, col ) = residues[ row ][ col ];
+      fSc( row, col ) = ( row == 0 ) ? background[ col ] : ( col == 0 ) ? background[ row ] : 0.0;
+    }
+
+  std::vector< Coef > beta;
+  std::vector< Coef > fPr;
+  for ( int pole = 0; pole < 5; ++pole )
+  {
+    const std::string index( 1, char( '0' + pole ) );
+    beta.push_back( Coef( Parameter( "reBeta" + index, 1.0 + pole, 0.1 ), Parameter( "imBeta" + index, 0.5 * pole, 0.1 ) ) );
+    fPr .push_back( Coef( Parameter( "reFPr"  + index, 0.0       , 0.1 ), Parameter( "imFPr"  + index, 0.0       , 0.1 ) ) );
+  }
+  Parameter s0pr( "s0pr", -3.92637, 0.1 );
+
+  Fvector fvec( 2, 3, m0, g0, fSc, -3.92637, -0.15, 1.0, beta, fPr, s0pr );
+
+  Parameter reKst( "reKst", -1.196, 0.01 );
+  Parameter imKst( "imKst",  1.257, 0.01 );
+  Parameter reF0 ( "reF0" ,  0.384, 0.01 );
+  Parameter imF0 ( "imF0" ,  0.023, 0.01 );
+  Parameter reK0 ( "reK0" , -0.393, 0.01 );
+  Parameter imK0 ( "imK0" , -5.285, 0.01 );
+
+  Amplitude amp;
+  amp += Coef( reKst, imKst ) * kst;
+  amp += rho;
+  amp += Coef( reF0, imF0 ) * f0;
+  amp += Coef( reK0, imK0 ) * k0;
+  amp += fvec;
+
+  std::cout << std::left  << std::setw( 36 ) << "kernel"
+            << std::right << std::setw( 10 ) << "events"
+            << std::setw( 14 ) << "ns/event"
+            << std::setw( 14 ) << "events/s" << std::endl;
+
+  measure( "Amplitude::evaluate", sizes, [ & ]( const std::size_t& n )
+  {
+    amp.evaluate( ps, mSq12.data(), mSq13.data(), mSq23.data(), n, amps.data() );
+    sink = sink + amps[ 0 ].real();
+  } );
+
+  // Propagators at the invariant mass of their own pair.
+  const std::vector< std::pair< std::string, const Resonance* > > resos = { { "RelBreitWigner", &kst }, { "GounarisSakurai", &rho },
+                                                                           { "Flatte"        , &f0  }, { "GLass"          , &k0  } };
+  for ( std::size_t reso = 0; reso < resos.size(); ++reso )
+  {
+    const std::vector< double >& mSqAB = ( reso == 0 ) ? mSq12 : ( reso == 3 ) ? mSq13 : mSq23;
+    measure( resos[ reso ].first + "::propagator", sizes, [ & ]( const std::size_t& n )
+    {
+      for ( std::size_t entry = 0; entry < n; ++entry )
+        amps[ entry ] = resos[ reso ].second->propagator( ps, mSqAB[ entry ] );
+      sink = sink + amps[ 0 ].real();
+    } );
+  }
+
+  measure( "Fvector::propagator", sizes, [ & ]( const std::size_t& n )
+  {
+    for ( std::size_t entry = 0; entry < n; ++entry )
+      amps[ entry ] = fvec.propagator( ps, mSq23[ entry ] );
+    sink = sink + amps[ 0 ].real();
+  } );
+
+  // Binning with 8 bins in the half of the phase space with mSq12 >= mSq13.
+  const unsigned nBins = 8;
+  std::vector< std::pair< std::pair< float, float >, unsigned > > points;
+  for ( std::size_t entry = 0; points.size() < 2000; ++entry )
+    if ( mSq12[ entry ] >= mSq13[ entry ] )
+      points.push_back( std::make_pair( std::make_pair( float( mSq12[ entry ] ), float( mSq13[ entry ] ) ),
+                                        1 + unsigned( nBins * ( mSq12[ entry ] - ps.mSq12min() ) / ( ps.mSq12max() - ps.mSq12min() ) ) % nBins ) );
+  const Binning binning( points );
+
+  measure( "Binning::bin", sizes, [ & ]( const std::size_t& n )
+  {
+    int sum = 0;
+    for ( std::size_t entry = 0; entry < n; ++entry )
+      sum += binning.bin( mSq12[ entry ], mSq13[ entry ] );
+    sink = sink + sum;
+  } );
+
+  Variable  x( "mSq12" );
+  Variable  y( "mSq13" );
+  Variable  z( "mSq23" );
+  Variable  t( "t"     );
+  Parameter a00( "a00", 1.0 );
+  Parameter a01( "a01", 0.2 );
+  Parameter a10( "a10", 0.3 );
+
+  Function eff = a00 + a01 * x * x + a10 * y * y;
+  eff.bind( std::vector< std::string >( { "mSq12", "mSq13" } ) );
+  const std::vector< const double* > effVars = { mSq12.data(), mSq13.data() };
+
+  measure( "Function::evaluate", sizes, [ & ]( const std::size_t& n )
+  {
+    eff.evaluate( effVars, n, values.data() );
+    sink = sink + values[ 0 ];
+  } );
+
+  // Sum of a Gauss and an exponential in the decay time.
+  Parameter mu   ( "mu"   ,  0.4 , 0.01 );
+  Parameter sigma( "sigma",  0.2 , 0.01 );
+  Parameter gamma( "gamma", -2.4 , 0.01 );
+  Parameter frac ( "frac" ,  0.3 , 0.01 );
+  Gauss       gauss( t, mu, sigma );
+  Exponential expo ( t, gamma );
+  PdfExpr     sum = frac * gauss + ( 1.0 - frac ) * expo;
+
+  measure( "PdfExpr::evaluate", sizes, [ & ]( const std::size_t& n )
+  {
+    std::vector< double > vars( 1 );
+    for ( std::size_t entry = 0; entry < n; ++entry )
+    {
+      vars[ 0 ]       = time[ entry ];
+      values[ entry ] = sum.evaluate( vars );
+    }
+    sink = sink + values[ 0 ];
+  } );
+
+  // Nll of each family of models, on datasets of each size.
+  Parameter reZ  ( "reZ"  , 0.3 , 0.01 );
+  Parameter imZ  ( "imZ"  , 0.1 , 0.01 );
+  Parameter width( "width", 2.44, 0.01 );
+
+  std::vector< Parameter > npb;
+  std::vector< Parameter > nmb;
+  std::vector< CoefExpr  > xb;
+  for ( unsigned bin = 0; bin < nBins; ++bin )
+  {
+    const std::string index( 1, char( '0' + bin ) );
+    npb.push_back( Parameter( "npb" + index, 1.0 + 0.1 * bin, 0.01 ) );
+    nmb.push_back( Parameter( "nmb" + index, 0.5 + 0.1 * bin, 0.01 ) );
+    xb .push_back( Coef( Parameter( "cb" + index, 0.5, 0.01 ), Parameter( "sb" + index, 0.1, 0.01 ) ) );
+  }
+  const BinnedAmplitude binnedAmp( npb, nmb, xb );
+
+  Decay3Body    dalitz( x, y, z, amp, ps );
+  Decay3BodyCP  cp    ( x, y, z, amp, Coef( reZ, imZ ), ps );
+  Decay3BodyMix mix   ( x, y, z, t, width, amp, Coef( reZ, imZ ), ps );
+  Decay3BodyBin binned( x, y, z, binnedAmp, binning, Coef( reZ, imZ ), ps );
+
+  const std::vector< std::pair< std::string, const PdfBase* > > models = { { "Nll PdfExpr"      , &sum    },
+                                                                          { "Nll Decay3Body"   , &dalitz },
+                                                                          { "Nll Decay3BodyCP" , &cp     },
+                                                                          { "Nll Decay3BodyMix", &mix    },
+                                                                          { "Nll Decay3BodyBin", &binned } };
+
+  for ( std::size_t model = 0; model < models.size(); ++model )
+    for ( std::size_t size = 0; size < sizes.size(); ++size )
+    {
+      Dataset data;
+      data.append( "mSq12", mSq12.data(), sizes[ size ] );
+      data.append( "mSq13", mSq13.data(), sizes[ size ] );
+      data.append( "mSq23", mSq23.data(), sizes[ size ] );
+      data.append( "t"    , time .data(), sizes[ size ] );
+
+      const PdfBase& pdf = *models[ model ].second;
+      std::unique_ptr< Nll > nll( ( model == 0 ) ? new Nll( sum, data ) : new Nll( static_cast< const PdfModel& >( pdf ), data ) );
+
+      // Start from the values of the parameters, slightly shifted every other call.
+      std::vector< double > pars;
+      typedef std::map< std::string, Parameter >::const_iterator pIter;
+      for ( pIter par = pdf.getPars().begin(); par != pdf.getPars().end(); ++par )
+        pars.push_back( par->second.value() );
+
+      unsigned call = 0;
+      measure( models[ model ].first, sizes[ size ], [ & ]( const std::size_t& )
+      {
+        std::vector< double > shifted( pars );
+        if ( ++call % 2 )
+          for ( std::size_t par = 0; par < shifted.size(); ++par )
+            shifted[ par ] *= 1.0001;
+
+        sink = sink + ( *nll )( shifted );
+      } );
+    }
+
+  return 0;
+}
@@ -0,0 +1,319 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <cstdlib>
+
+#include <Minuit/FunctionMinimum.h>
+
+#include <cfit/parameter.hh>
+#include <cfit/variable.hh>
+#include <cfit/coef.hh>
+#include <cfit/amplitude.hh>
+#include <cfit/phasespace.hh>
+#include <cfit/matrix.hh>
+#include <cfit/fvector.hh>
+#include <cfit/dataset.hh>
+#include <cfit/pdfexpr.hh>
+#include <cfit/random.hh>
+#include <cfit/nll.hh>
+
+#include <cfit/models/gauss.hh>
+#include <cfit/models/exponential.hh>
+#include <cfit/models/relbreitwigner.hh>
+#include <cfit/models/gounarissakurai.hh>
+#include <cfit/models/flatte.hh>
+#include <cfit/models/glass.hh>
+#include <cfit/models/decay3body.hh>
+#include <cfit/models/decay3bodymix.hh>
+
+// Performance regression test of complete fits. Each canned fit generates its
+//    sample from a fixed seed and fits it back with an Nll, starting from
+//    shifted values of its free parameters. Its throughput, the number of events
+//    evaluated per second of fit, i.e. the number of calls of the Nll times the
+//    number of events over the time of the fit, is written to the output file,
+//    one line per fit:
+//       name  events  calls  seconds  events/s
+//
+// If a baseline file in the same format is given, the test fails if the
+//    throughput of any fit is below the baseline by more than the tolerance,
+//    a fraction of the baseline that defaults to 0.2. The baseline of a
+//    machine is made by copying the output of a run on it.
+//
+// Usage: perfFits output [ baseline [ tolerance ] ]
+
+
+// Result of a canned fit.
+struct Result
+{
+  std::string   name;
+  std::size_t   events;
+  unsigned long calls;
+  double        seconds;
+
+  double throughput() const { return seconds > 0.0 ? calls * double( events ) / seconds : 0.0; }
+};
+
+
+// Generate events from pdf with the given seed, shift the free parameters by
+//    a tenth of their errors and fit them back.
+template < class PDF >
+Result fit( const std::string& name, PDF& pdf, const std::size_t& nEvents, const unsigned& seed )
+{
+  Random::setSeed( seed );
+
+  Dataset data;
+  pdf.generate( nEvents, data );
+
+  std::map< std::string, Parameter > start = pdf.getPars();
+  typedef std::map< std::string, Parameter >::iterator pIter;
+  for ( pIter par = start.begin(); par != start.end(); ++par )
+    if ( ! par->second.isFixed() )
+      par->second.setValue( par->second.value() + 0.1 * par->second.error() );
+
+  Nll nll( pdf, data );
+  nll.setPars( start );
+  nll.setProfiling();
+
+  const FunctionMinimum min = nll.minimize();
+
+  const Minimizer::Stats stats = nll.stats();
+
+  Result result;
+  result.name    = name;
+  result.events  = data.size();
+  result.calls   = stats.calls;
+  result.seconds = stats.fit;
+
+  std::cout << std::left  << std::setw( 24 ) << name
+            << std::right << std::setw( 10 ) << result.events
+            << std::setw( 8 ) << result.calls
+            << std::fixed << std::setprecision( 3 ) << std::setw( 10 ) << result.seconds
+            << std::scientific << std::setprecision( 3 ) << std::setw( 12 ) << result.throughput()
+            << ( min.isValid() ? "" : "  (invalid minimum)" ) << std::endl;
+
+  return result;
+}
+
+
+// Throughput of each fit of a baseline file.
+std::map< std::string, double > readBaseline( const std::string& file )
+{
+  std::map< std::string, double > baseline;
+
+  std::ifstream input( file.c_str() );
+  if ( ! input )
+  {
+    std::cerr << "Cannot open the baseline file " << file << "." << std::endl;
+    std::exit( 1 );
+  }
+
+  std::string line;
+  while ( std::getline( input, line ) )
+  {
+    if ( line.empty() || ( line[ 0 ] == '#' ) )
+      continue;
+
+    std::istringstream fields( line );
+
+    std::string   name;
+    std::size_t   events;
+    unsigned long calls;
+    double        seconds;
+    double        throughput;
+    if ( fields >> name >> events >> calls >> seconds >> throughput )
+      baseline[ name ] = throughput;
+  }
+
+  return baseline;
+}
+
+
+
+int main( int argc, char** argv )
+{
+  if ( argc < 2 )
+  {
+    std::cerr << "\nUsage: " << argv[ 0 ] << " output [ baseline [ tolerance ] ]\n" << std::endl;
+    return 1;
+  }
+
+  const std::string output    = argv[ 1 ];
+  const std::string baseline  = ( argc > 2 ) ? argv[ 2 ] : "";
+  const double      tolerance = ( argc > 3 ) ? std::atof( argv[ 3 ] ) : 0.2;
+
+  std::vector< Result > results;
+
+  // Mass fit of a Gauss peak over an exponential background.
+  Variable  mass ( "mass" );
+  Parameter mu   ( "mu"   , 1.865, 0.001 );
+  Parameter sigma( "sigma", 0.008, 0.001 );
+  Parameter gamma( "gamma", 5.0  , 0.1   );
+  Parameter frac ( "frac" , 0.4  , 0.01  );
+
+  Gauss       gauss( mass, mu, sigma );
+  Exponential expo ( mass, gamma );
+  expo.setLimits( 1.80, 1.93 );
+
+  PdfExpr massPdf = frac * gauss + ( 1.0 - frac ) * expo;
+  results.push_back( fit( "GaussExponential", massPdf, 200000, 1 ) );
+
+  // Isobar model of D0 -> Ks pi pi.
+  const PhaseSpace ps( 1.86484, 0.497614, 0.139570, 0.139570 );
+
+  Variable mSq12( "mSq12" );
+  Variable mSq13( "mSq13" );
+  Variable mSq23( "mSq23" );
+  Variable t    ( "t"     );
+
+  Parameter mKst( "mKst", 0.89166, 0.01 );
+  Parameter wKst( "wKst", 0.0508 , 0.01 );
+  Parameter mRho( "mRho", 0.77549, 0.01 );
+  Parameter wRho( "wRho", 0.1491 , 0.01 );
+  Parameter mF0 ( "mF0" , 0.965  , 0.01 );
+  Parameter wF0 ( "wF0" , 0.05   , 0.01 );
+  Parameter g1F0( "g1F0", 0.165  , 0.01 );
+  Parameter g2F0( "g2F0", 0.695  , 0.01 );
+  Parameter m02a( "m02a", 0.0195 , 0.01 );
+  Parameter m02b( "m02b", 0.2437 , 0.01 );
+  Parameter mK0 ( "mK0" , 1.42155, 0.01 );
+  Parameter wK0 ( "wK0" , 0.24673, 0.01 );
+  Parameter rBW ( "rBW" , 1.5    , 0.1  );
+
+  Parameter lassR ( "lassR"   ,   1.0    , 0.1 );
+  Parameter lassB ( "lassB"   ,   0.6177 , 0.1 );
+  Parameter lassPR( "lassPhiR",   1.1044 , 0.1 );
+  Parameter lassPB( "lassPhiB",  -0.0995 , 0.1 );
+  Parameter lassr ( "lassr"   , -15.0103 , 0.1 );
+  Parameter lassa ( "lassa"   ,   0.2240 , 0.1 );
+
+  // Only the coefficients of the amplitude are fitted.
+  mKst.fix(); wKst.fix(); mRho.fix(); wRho.fix();
+  mF0 .fix(); wF0 .fix(); g1F0.fix(); g2F0.fix(); m02a.fix(); m02b.fix();
+  mK0 .fix(); wK0 .fix(); rBW .fix();
+  lassR.fix(); lassB.fix(); lassPR.fix(); lassPB.fix(); lassr.fix(); lassa.fix();
+
+  RelBreitWigner  kst( 1, 2, mKst, wKst, rBW, 1 );
+  GounarisSakurai rho( 2, 3, mRho, wRho, rBW, 1 );
+  Flatte          f0 ( 2, 3, mF0 , wF0 , rBW, g1F0, g2F0, m02a, m02b, 0 );
+  GLass           k0 ( 1, 3, mK0 , wK0 , rBW, lassR, lassB, lassPR, lassPB, lassr, lassa, 0 );
+
+  Parameter reKst( "reKst", -1.196, 0.01 );
+  Parameter imKst( "imKst",  1.257, 0.01 );
+  Parameter reF0 ( "reF0" ,  0.384, 0.01 );
+  Parameter imF0 ( "imF0" ,  0.023, 0.01 );
+  Parameter reK0 ( "reK0" , -0.393, 0.01 );
+  Parameter imK0 ( "imK0" , -5.285, 0.01 );
+
+  Amplitude isobar;
+  isobar += Coef( reKst, imKst ) * kst;
+  isobar += rho;
+  isobar += Coef( reF0, imF0 ) * f0;
+  isobar += Coef( reK0, imK0 ) * k0;
+
+  Decay3Body dalitz( mSq12, mSq13, mSq23, isobar, ps );
+  results.push_back( fit( "Decay3Body", dalitz, 20000, 2 ) );
+
+  // Time dependent model with mixing, with the same amplitude.
+  Parameter reZ  ( "reZ"  , 0.03, 0.01 );
+  Parameter imZ  ( "imZ"  , 0.01, 0.01 );
+  Parameter width( "width", 2.44, 0.01 );
+  width.fix();
+
+  Decay3BodyMix mix( mSq12, mSq13, mSq23, t, width, isobar, Coef( reZ, imZ ), ps );
+  results.push_back( fit( "Decay3BodyMix", mix, 20000, 3 ) );
+
+  // K-matrix model, with the S-wave in the pi pi channel given by an F vector.
+  std::vector< double > m0;
+  m0.push_back( 0.65100 );
+  m0.push_back( 1.20360 );
+  m0.push_back( 1.55817 );
+  m0.push_back( 1.21000 );
+  m0.push_back( 1.82206 );
+
+  Matrix< double > g0 ( 5 );
+  Matrix< double > fSc( 5 );
+  const double residues[ 5 ][ 5 ] = { {  0.22889, -0.55377,  0.00000, -0.39899, -0.34639 },
+                                      {  0.94128,  0.55095,  0.00000,  0.39065,  0.31503 },
+                                      {  0.36856,  0.23888,  0.55639,  0.18340,  0.18681 },
+                                      {  0.33650,  0.40907,  0.85679,  0.19906, -0.00984 },
+                                      {  0.18171, -0.17558, -0.79658, -0.00355,  0.22358 } };
+  const double background[ 5 ] = { 0.23399, 0.15044, -0.20545, 0.32825, 0.35412 };
+  for ( int row = 0; row < 5; ++row )
+    for ( int col = 0; col < 5; ++col )
+    {
+      g0 ( row, col ) = residues[ row ][ col ];
+      fSc( row, col ) = ( row == 0 ) ? background[ col ] : ( col == 0 ) ? background[ row ] : 0.0;
+    }
+
+  std::vector< Coef > beta;
+  std::vector< Coef > fPr;
+  for ( int pole = 0; pole < 5; ++pole )
+  {
+    const std::string index( 1, char( '0' + pole ) );
+    Parameter reBeta( "reBeta" + index, 1.0 + pole, 0.1 );
+    Parameter imBeta( "imBeta" + index, 0.5 * pole, 0.1 );
+    Parameter reFPr ( "reFPr"  + index, 0.0       , 0.1 );
+    Parameter imFPr ( "imFPr"  + index, 0.0       , 0.1 );
+    reFPr.fix();
+    imFPr.fix();
+
+    beta.push_back( Coef( reBeta, imBeta ) );
+    fPr .push_back( Coef( reFPr , imFPr  ) );
+  }
+  Parameter s0pr( "s0pr", -3.92637, 0.1 );
+  s0pr.fix();
+
+  Fvector fvec( 2, 3, m0, g0, fSc, -3.92637, -0.15, 1.0, beta, fPr, s0pr );
+
+  Amplitude kmatrix;
+  kmatrix += Coef( reKst, imKst ) * kst;
+  kmatrix += rho;
+  kmatrix += Coef( reK0, imK0 ) * k0;
+  kmatrix += fvec;
+
+  Decay3Body dalitzKMatrix( mSq12, mSq13, mSq23, kmatrix, ps );
+  results.push_back( fit( "Decay3BodyKMatrix", dalitzKMatrix, 20000, 4 ) );
+
+  std::ofstream out( output.c_str() );
+  out << "# name events calls seconds events/s" << std::endl;
+  for ( std::size_t res = 0; res < results.size(); ++res )
+    out << results[ res ].name    << " "
+        << results[ res ].events  << " "
+        << results[ res ].calls   << " "
+        << results[ res ].seconds << " "
+        << results[ res ].throughput() << std::endl;
+  out.close();
+
+  if ( baseline.empty() )
+    return 0;
+
+  // Compare the throughputs with those of the baseline.
+  const std::map< std::string, double > reference = readBaseline( baseline );
+
+  bool failed = false;
+  for ( std::size_t res = 0; res < results.size(); ++res )
+  {
+    const std::map< std::string, double >::const_iterator ref = reference.find( results[ res ].name );
+    if ( ( ref == reference.end() ) || ( ref->second <= 0.0 ) )
+    {
+      std::cout << results[ res ].name << ": no throughput in the baseline." << std::endl;
+      continue;
+    }
+
+    const double ratio = results[ res ].throughput() / ref->second;
+    const bool   slow  = ratio < 1.0 - tolerance;
+
+    std::cout << std::left << std::setw( 24 ) << results[ res ].name << std::right
+              << std::fixed << std::setprecision( 3 ) << " " << ratio << " of the baseline"
+              << ( slow ? ", FAILED" : "" ) << std::endl;
+
+    failed = failed || slow;
+  }
+
+  return failed ? 1 : 0;
+}
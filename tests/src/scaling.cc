@@ -0,0 +1,342 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cmath>
+#include <cstdlib>
+
+#ifdef MPI_ON
+#include <mpi.h>
+#endif
+
+#include <cfit/parameter.hh>
+#include <cfit/variable.hh>
+#include <cfit/coef.hh>
+#include <cfit/amplitude.hh>
+#include <cfit/phasespace.hh>
+#include <cfit/dataset.hh>
+#include <cfit/pdfexpr.hh>
+#include <cfit/random.hh>
+#include <cfit/nll.hh>
+
+#include <cfit/models/gauss.hh>
+#include <cfit/models/exponential.hh>
+#include <cfit/models/relbreitwigner.hh>
+#include <cfit/models/gounarissakurai.hh>
+#include <cfit/models/flatte.hh>
+#include <cfit/models/glass.hh>
+#include <cfit/models/decay3body.hh>
+
+// Scaling of the evaluation of the Nll of a model with the number of events,
+//    threads and, when built with MPI_ON, processes. The nll is called repeatedly
+//    with its free parameters shifted every other call, so that its norm is
+//    computed again at every call, and the wall time per call spent updating
+//    the pdf, which is mostly computing its norm, in the event loop and reducing
+//    the sums of the processes is measured with the profiling of the minimizer.
+//
+// Two tables are printed. The strong scaling one has the times of each number
+//    of threads for each number of events, 10^4 up to maxEvents, together with
+//    the speedups of the event loop and of the whole call with respect to a
+//    single thread. The weak scaling one has the times of each number of threads
+//    with 10^4 events per thread and process, and the efficiencies of the event
+//    loop and of the whole call. The scaling with the number of processes is
+//    obtained by running the driver with mpirun for each of them, since every
+//    row is labelled with the number of processes that produced it.
+//
+// The events are spread uniformly over the range of the variables of the
+//    model, since their distribution does not change the cost of evaluating it.
+//
+// Usage: scaling [ GaussExponential | Decay3Body [ maxEvents [ maxThreads [ calls ] ] ] ]
+
+
+// Times per call of the nll with a number of events, threads and processes.
+struct Point
+{
+  std::size_t events;
+  unsigned    threads;
+  int         ranks;
+  double      norm;
+  double      loop;
+  double      reduce;
+
+  double total() const { return norm + loop + reduce; }
+};
+
+
+// Dataset with the first n events of the given columns. With MPI, only the
+//    root process has the columns, and the events are scattered over all the
+//    processes.
+Dataset makeData( const std::vector< std::string >& names, const std::vector< std::vector< double > >& columns, const std::size_t& n )
+{
+  Dataset data;
+
+#ifdef MPI_ON
+  if ( MPI::COMM_WORLD.Get_rank() == 0 )
+#endif
+    for ( std::size_t col = 0; col < names.size(); ++col )
+      data.append( names[ col ], columns[ col ].data(), n );
+
+#ifdef MPI_ON
+  data.scatter();
+#endif
+
+  return data;
+}
+
+
+template < class PDF >
+Point measure( const PDF& pdf, const Dataset& data, const std::size_t& events, const unsigned& threads, const unsigned& calls )
+{
+  Nll nll( pdf, data );
+  nll.setThreads( threads );
+
+  std::vector< double > pars;
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  for ( pIter par = pdf.getPars().begin(); par != pdf.getPars().end(); ++par )
+    pars.push_back( par->second.value() );
+
+  // The first call computes everything that does not depend on the free parameters.
+  nll( pars );
+  nll.setProfiling();
+
+  for ( unsigned call = 0; call < calls; ++call )
+  {
+    std::vector< double > shifted( pars );
+    if ( call % 2 )
+      for ( std::size_t par = 0; par < shifted.size(); ++par )
+        shifted[ par ] *= 1.0001;
+
+    nll( shifted );
+  }
+
+  const Minimizer::Stats stats = nll.stats();
+
+  Point point;
+  point.events  = events;
+  point.threads = threads;
+#ifdef MPI_ON
+  point.ranks   = MPI::COMM_WORLD.Get_size();
+#else
+  point.ranks   = 1;
+#endif
+  point.norm    = stats.update / calls;
+  point.loop    = stats.loop   / calls;
+  point.reduce  = stats.reduce / calls;
+
+  return point;
+}
+
+
+void header( const std::string& title, const std::string& ratio )
+{
+  std::cout << "\n" << title << "\n"
+            << std::setw( 6 ) << "ranks" << std::setw( 8 ) << "threads" << std::setw( 12 ) << "events"
+            << std::setw( 12 ) << "norm [s]" << std::setw( 12 ) << "loop [s]" << std::setw( 12 ) << "reduce [s]"
+            << std::setw( 12 ) << "total [s]" << std::setw( 15 ) << "loop " + ratio << std::setw( 15 ) << "total " + ratio << std::endl;
+}
+
+
+void row( const Point& point, const Point& reference, const bool& weak )
+{
+  // Speedups for strong scaling. For weak scaling, the single thread has done
+  //    a share of the work of the same size, so the ratios are the efficiencies.
+  const double loop  = ( point.loop    > 0.0 ) ? reference.loop    / point.loop    : 0.0;
+  const double total = ( point.total() > 0.0 ) ? reference.total() / point.total() : 0.0;
+
+  std::cout << std::setw( 6 ) << point.ranks << std::setw( 8 ) << point.threads << std::setw( 12 ) << point.events
+            << std::scientific << std::setprecision( 3 )
+            << std::setw( 12 ) << point.norm << std::setw( 12 ) << point.loop << std::setw( 12 ) << point.reduce
+            << std::setw( 12 ) << point.total()
+            << std::fixed << std::setprecision( weak ? 3 : 2 )
+            << std::setw( 15 ) << loop << std::setw( 15 ) << total << std::endl;
+}
+
+
+template < class PDF >
+void scale( const PDF& pdf, const std::vector< std::string >& names, const std::vector< std::vector< double > >& columns,
+            const std::size_t& maxEvents, const std::vector< unsigned >& threads, const unsigned& calls, const bool& print )
+{
+  const std::size_t minEvents = 10000;
+
+  if ( print )
+    header( "Strong scaling", "speedup" );
+  for ( std::size_t events = minEvents; events <= maxEvents; events *= 10 )
+  {
+    const Dataset data = makeData( names, columns, events );
+
+    Point reference;
+    for ( std::size_t thr = 0; thr < threads.size(); ++thr )
+    {
+      const Point point = measure( pdf, data, events, threads[ thr ], calls );
+      if ( thr == 0 )
+        reference = point;
+      if ( print )
+        row( point, reference, false );
+    }
+  }
+
+#ifdef MPI_ON
+  const std::size_t ranks = MPI::COMM_WORLD.Get_size();
+#else
+  const std::size_t ranks = 1;
+#endif
+
+  if ( print )
+    header( "Weak scaling, " + std::to_string( minEvents ) + " events per thread and rank", "eff." );
+  Point reference;
+  for ( std::size_t thr = 0; thr < threads.size(); ++thr )
+  {
+    const std::size_t events = minEvents * threads[ thr ] * ranks;
+    if ( events > maxEvents )
+      break;
+
+    const Dataset data  = makeData( names, columns, events );
+    const Point   point = measure( pdf, data, events, threads[ thr ], calls );
+    if ( thr == 0 )
+      reference = point;
+    if ( print )
+      row( point, reference, true );
+  }
+}
+
+
+
+int main( int argc, char** argv )
+{
+#ifdef MPI_ON
+  MPI::Init( argc, argv );
+  const bool root = MPI::COMM_WORLD.Get_rank() == 0;
+#else
+  const bool root = true;
+#endif
+
+  const std::string model      = ( argc > 1 ) ? argv[ 1 ] : "Decay3Body";
+  const std::size_t maxEvents  = ( argc > 2 ) ? std::strtoul( argv[ 2 ], 0, 10 ) : 1000000;
+  const unsigned    maxThreads = ( argc > 3 ) ? std::atoi( argv[ 3 ] ) : std::max( 1u, std::thread::hardware_concurrency() );
+  const unsigned    calls      = ( argc > 4 ) ? std::atoi( argv[ 4 ] ) : 10;
+
+  if ( ( model != "GaussExponential" ) && ( model != "Decay3Body" ) )
+  {
+    if ( root )
+      std::cerr << "\nUsage: " << argv[ 0 ] << " [ GaussExponential | Decay3Body [ maxEvents [ maxThreads [ calls ] ] ] ]\n" << std::endl;
+    return 1;
+  }
+
+  // Powers of two up to the maximum number of threads, and the maximum itself.
+  std::vector< unsigned > threads;
+  for ( unsigned nThreads = 1; nThreads < maxThreads; nThreads *= 2 )
+    threads.push_back( nThreads );
+  threads.push_back( maxThreads );
+
+  Random::setSeed( 1 );
+
+  if ( root )
+    std::cout << model << ", " << calls << " calls per point." << std::endl;
+
+  if ( model == "GaussExponential" )
+  {
+    Variable  mass ( "mass" );
+    Parameter mu   ( "mu"   , 1.865, 0.001 );
+    Parameter sigma( "sigma", 0.008, 0.001 );
+    Parameter gamma( "gamma", 5.0  , 0.1   );
+    Parameter frac ( "frac" , 0.4  , 0.01  );
+
+    Gauss       gauss( mass, mu, sigma );
+    Exponential expo ( mass, gamma );
+    expo.setLimits( 1.80, 1.93 );
+
+    const PdfExpr pdf = frac * gauss + ( 1.0 - frac ) * expo;
+
+    std::vector< std::vector< double > > columns( 1 );
+    if ( root )
+      for ( std::size_t entry = 0; entry < maxEvents; ++entry )
+        columns[ 0 ].push_back( Random::flat( 1.80, 1.93 ) );
+
+    scale( pdf, std::vector< std::string >( 1, "mass" ), columns, maxEvents, threads, calls, root );
+  }
+  else
+  {
+    const PhaseSpace ps( 1.86484, 0.497614, 0.139570, 0.139570 );
+
+    Variable mSq12( "mSq12" );
+    Variable mSq13( "mSq13" );
+    Variable mSq23( "mSq23" );
+
+    // The mass and width of the K* are free, so that the norm of its
+    //    resonance is computed again at every call.
+    Parameter mKst( "mKst", 0.89166, 0.01 );
+    Parameter wKst( "wKst", 0.0508 , 0.01 );
+    Parameter mRho( "mRho", 0.77549, 0.01 );
+    Parameter wRho( "wRho", 0.1491 , 0.01 );
+    Parameter mF0 ( "mF0" , 0.965  , 0.01 );
+    Parameter wF0 ( "wF0" , 0.05   , 0.01 );
+    Parameter g1F0( "g1F0", 0.165  , 0.01 );
+    Parameter g2F0( "g2F0", 0.695  , 0.01 );
+    Parameter m02a( "m02a", 0.0195 , 0.01 );
+    Parameter m02b( "m02b", 0.2437 , 0.01 );
+    Parameter mK0 ( "mK0" , 1.42155, 0.01 );
+    Parameter wK0 ( "wK0" , 0.24673, 0.01 );
+    Parameter rBW ( "rBW" , 1.5    , 0.1  );
+
+    Parameter lassR ( "lassR"   ,   1.0    , 0.1 );
+    Parameter lassB ( "lassB"   ,   0.6177 , 0.1 );
+    Parameter lassPR( "lassPhiR",   1.1044 , 0.1 );
+    Parameter lassPB( "lassPhiB",  -0.0995 , 0.1 );
+    Parameter lassr ( "lassr"   , -15.0103 , 0.1 );
+    Parameter lassa ( "lassa"   ,   0.2240 , 0.1 );
+
+    mRho.fix(); wRho.fix();
+    mF0 .fix(); wF0 .fix(); g1F0.fix(); g2F0.fix(); m02a.fix(); m02b.fix();
+    mK0 .fix(); wK0 .fix(); rBW .fix();
+    lassR.fix(); lassB.fix(); lassPR.fix(); lassPB.fix(); lassr.fix(); lassa.fix();
+
+    RelBreitWigner  kst( 1, 2, mKst, wKst, rBW, 1 );
+    GounarisSakurai rho( 2, 3, mRho, wRho, rBW, 1 );
+    Flatte          f0 ( 2, 3, mF0 , wF0 , rBW, g1F0, g2F0, m02a, m02b, 0 );
+    GLass           k0 ( 1, 3, mK0 , wK0 , rBW, lassR, lassB, lassPR, lassPB, lassr, lassa, 0 );
+
+    Parameter reKst( "reKst", -1.196, 0.01 );
+    Parameter imKst( "imKst",  1.257, 0.01 );
+    Parameter reF0 ( "reF0" ,  0.384, 0.01 );
+    Parameter imF0 ( "imF0" ,  0.023, 0.01 );
+    Parameter reK0 ( "reK0" , -0.393, 0.01 );
+    Parameter imK0 ( "imK0" , -5.285, 0.01 );
+
+    Amplitude amp;
+    amp += Coef( reKst, imKst ) * kst;
+    amp += rho;
+    amp += Coef( reF0, imF0 ) * f0;
+    amp += Coef( reK0, imK0 ) * k0;
+
+    const Decay3Body pdf( mSq12, mSq13, mSq23, amp, ps );
+
+    // Points uniformly distributed over the phase space.
+    std::vector< std::vector< double > > columns( 3 );
+    if ( root )
+      while ( columns[ 0 ].size() < maxEvents )
+      {
+        const double x = Random::flat( ps.mSq12min(), ps.mSq12max() );
+        const double y = Random::flat( ps.mSq13min(), ps.mSq13max() );
+        if ( ! ps.contains( x, y ) )
+          continue;
+
+        columns[ 0 ].push_back( x );
+        columns[ 1 ].push_back( y );
+        columns[ 2 ].push_back( ps.mSqSum() - x - y );
+      }
+
+    std::vector< std::string > names;
+    names.push_back( "mSq12" );
+    names.push_back( "mSq13" );
+    names.push_back( "mSq23" );
+
+    scale( pdf, names, columns, maxEvents, threads, calls, root );
+  }
+
+#ifdef MPI_ON
+  MPI::Finalize();
+#endif
+
+  return 0;
+}